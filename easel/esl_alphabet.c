@@ -20,6 +20,10 @@
 
 #include "easel.h"
 #include "esl_alphabet.h"
+#if defined(HAVE_SSE2) && defined(__SSSE3__)
+#define eslALPHABET_SSSE3   /* byte shuffles for inmap/sym lookups, 16 at a time */
+#include "esl_sse.h"
+#endif
 
 
 
@@ -644,6 +648,24 @@ esl_abc_CreateDsq(const ESL_ALPHABET *a, const char *seq, ESL_DSQ **ret_dsq)
 }
 
 
+#ifdef eslALPHABET_SSSE3
+/* abc_digitize16()
+ * Digitize the 16 chars at <s> through <a>'s inmap, loaded in <tbl>,
+ * into <*ret_x>. Return TRUE if all 16 are valid symbols: ASCII, and
+ * mapped to codes <= <kpmax> (Kp-1). If not, the caller redoes them
+ * one at a time.
+ */
+static inline int
+abc_digitize16(const __m128i *tbl, __m128i kpmax, const char *s, __m128i *ret_x)
+{
+  __m128i v = _mm_loadu_si128((const __m128i *) s);
+  __m128i x = esl_sse_lut128_epu8(tbl, v);
+
+  *ret_x = x;
+  return (_mm_movemask_epi8(v) == 0 && _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(x, kpmax), x)) == 0xffff);
+}
+#endif
+
 /* Function: esl_abc_Digitize()
  * Synopsis: Digitizes a sequence into existing space.
  * 
@@ -669,22 +691,39 @@ int
 esl_abc_Digitize(const ESL_ALPHABET *a, const char *seq, ESL_DSQ *dsq)
 {
   int     status;
+  int64_t L = strlen(seq);
   int64_t i;			/* position in seq */
   int64_t j;			/* position in dsq */
+  int64_t iend;
   ESL_DSQ x;
+#ifdef eslALPHABET_SSSE3
+  __m128i tbl[8];
+  __m128i kpmax = _mm_set1_epi8((char) (a->Kp - 1));
+  __m128i xv;
+
+  esl_sse_lut128_load(a->inmap, tbl);
+#endif
 
   status = eslOK;
   dsq[0] = eslDSQ_SENTINEL;
-  for (i = 0, j = 1; seq[i] != '\0'; i++) 
-    { 
-      x = a->inmap[(int) seq[i]];
-      if      (esl_abc_XIsValid(a, x)) dsq[j] = x;
-      else if (x == eslDSQ_IGNORED) continue; 
-      else {
-	status   = eslEINVAL;
-	dsq[j] = esl_abc_XGetUnknown(a);
-      }
-      j++;
+  for (i = 0, j = 1; i < L; i = iend)
+    {
+      iend = ESL_MIN(L, i+16);
+#ifdef eslALPHABET_SSSE3
+      if (iend - i == 16 && abc_digitize16(tbl, kpmax, seq+i, &xv))
+	{ _mm_storeu_si128((__m128i *) (dsq+j), xv); j += 16; continue; }
+#endif
+      for (; i < iend; i++)
+	{
+	  x = (isascii(seq[i]) ? a->inmap[(int) seq[i]] : eslDSQ_ILLEGAL);
+	  if      (esl_abc_XIsValid(a, x)) dsq[j] = x;
+	  else if (x == eslDSQ_IGNORED) continue; 
+	  else {
+	    status   = eslEINVAL;
+	    dsq[j] = esl_abc_XGetUnknown(a);
+	  }
+	  j++;
+	}
     }
   dsq[j] = eslDSQ_SENTINEL;
   return status;
@@ -711,9 +750,29 @@ esl_abc_Digitize(const ESL_ALPHABET *a, const char *seq, ESL_DSQ *dsq)
 int
 esl_abc_Textize(const ESL_ALPHABET *a, const ESL_DSQ *dsq, int64_t L, char *seq)
 {
-  int64_t i;
-  
-  for (i = 0; i < L; i++)
+  int64_t i = 0;
+#ifdef eslALPHABET_SSSE3
+  /* Codes 0..Kp-1 index sym[] through two 16-entry shuffles, if Kp <= 32 (as it is for DNA, RNA, amino). */
+  char    sym[32];
+  __m128i t0, t1, v, kpmax, hi;
+
+  if (a->Kp <= 32 && L >= 16)
+    {
+      memset(sym, 0, 32);
+      memcpy(sym, a->sym, a->Kp);
+      t0    = _mm_loadu_si128((const __m128i *) sym);
+      t1    = _mm_loadu_si128((const __m128i *) (sym+16));
+      kpmax = _mm_set1_epi8((char) (a->Kp - 1));
+      for (; i + 16 <= L; i += 16)
+	{
+	  v = _mm_loadu_si128((const __m128i *) (dsq+i+1));
+	  if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, kpmax), v)) != 0xffff) break; /* not all codes valid: finish one at a time */
+	  hi = _mm_cmpgt_epi8(v, _mm_set1_epi8(15));
+	  _mm_storeu_si128((__m128i *) (seq+i), _mm_or_si128(_mm_andnot_si128(hi, _mm_shuffle_epi8(t0, v)), _mm_and_si128(hi, _mm_shuffle_epi8(t1, v))));
+	}
+    }
+#endif
+  for (; i < L; i++)
     seq[i] = a->sym[dsq[i+1]];
   seq[i] = '\0';
   return eslOK;
@@ -1660,7 +1719,18 @@ esl_abc_ValidateSeq(const ESL_ALPHABET *a, const char *seq, int64_t L, char *err
   
   if (a)  // If we have digital alphabet <a>, it has an <inmap> we can check against 
     {
-      for (i = 0; i < L; i++) {
+      i = 0;
+#ifdef eslALPHABET_SSSE3
+      {
+	__m128i tbl[8];
+	__m128i kpmax = _mm_set1_epi8((char) (a->Kp - 1));
+	__m128i xv;
+
+	esl_sse_lut128_load(a->inmap, tbl);
+	while (i + 16 <= L && abc_digitize16(tbl, kpmax, seq+i, &xv)) i += 16; /* skip the valid prefix fast */
+      }
+#endif
+      for (; i < L; i++) {
 	if (! esl_abc_CIsValid(a, seq[i])) {
 	  if (firstpos == -1) firstpos = i;
 	  nbad++;
@@ -1981,6 +2051,53 @@ utest_Textize(void)
   return status;
 }
 
+/* utest_DigitizeLong()
+ * Long sequences exercise the 16-residue vector paths of Digitize(),
+ * Textize() and ValidateSeq(), if they're compiled in. Check them
+ * against symbol-at-a-time conversion, with an invalid (or non-ASCII)
+ * character planted at every position in turn.
+ */
+static void
+utest_DigitizeLong(int type)
+{
+  char          msg[] = "esl_abc_Digitize() long sequence unit test failed";
+  ESL_ALPHABET *a     = NULL;
+  char          bad[] = { '1', '%', (char) 0xc3 };
+  int           L     = 77;
+  char          seq[78];
+  char          txt[78];
+  ESL_DSQ       dsq[79];
+  int           i, b, pos;
+
+  if ((a = esl_alphabet_Create(type)) == NULL) esl_fatal(msg);
+  for (i = 0; i < L; i++) seq[i] = a->sym[(i*7) % a->Kp];
+  seq[L] = '\0';
+
+  if (esl_abc_ValidateSeq(a, seq, L, NULL) != eslOK) esl_fatal(msg);
+  if (esl_abc_Digitize(a, seq, dsq)        != eslOK) esl_fatal(msg);
+  if (dsq[0] != eslDSQ_SENTINEL || dsq[L+1] != eslDSQ_SENTINEL) esl_fatal(msg);
+  for (i = 0; i < L; i++)
+    if (dsq[i+1] != esl_abc_DigitizeSymbol(a, seq[i])) esl_fatal(msg);
+  if (esl_abc_Textize(a, dsq, L, txt) != eslOK) esl_fatal(msg);
+  for (i = 0; i < L; i++)
+    if (txt[i] != a->sym[dsq[i+1]]) esl_fatal(msg);
+  if (txt[L] != '\0') esl_fatal(msg);
+
+  for (b = 0; b < 3; b++)
+    for (pos = 0; pos < L; pos++)
+      {
+	txt[0]   = seq[pos];
+	seq[pos] = bad[b];
+	if (esl_abc_ValidateSeq(a, seq, L, NULL) != eslEINVAL) esl_fatal(msg);
+	if (esl_abc_Digitize(a, seq, dsq)        != eslEINVAL) esl_fatal(msg);
+	for (i = 0; i < L; i++)
+	  if (dsq[i+1] != (i == pos ? esl_abc_XGetUnknown(a) : esl_abc_DigitizeSymbol(a, seq[i]))) esl_fatal(msg);
+	seq[pos] = txt[0];
+      }
+
+  esl_alphabet_Destroy(a);
+}
+
 static int
 utest_TextizeN(void) 
 {
@@ -2297,6 +2414,8 @@ main(void)
   utest_Digitize();
   utest_Textize();
   utest_TextizeN();
+  utest_DigitizeLong(eslAMINO);
+  utest_DigitizeLong(eslDNA);
   utest_dsqdup();
   utest_dsqcat();
 
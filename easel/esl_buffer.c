@@ -593,7 +593,11 @@ esl_buffer_GetOffset(ESL_BUFFER *bf)
  * 
  *            FILE mode is handled as above, but additionally, if no
  *            anchor is set and <offset> is not in the current buffer,
- *            <fseeko()> is used to reposition in the open file. If
+ *            <fseeko()> is used to reposition in the open file. An
+ *            <offset> that's ahead of the current position but already
+ *            in the buffer is reached without a seek, so a caller
+ *            stepping forward through nearby records (for example,
+ *            SSI fetches sorted by offset) doesn't reread them. If
  *            <fseeko()> is unavailable (non-POSIX compliant systems),
  *            FILE mode is handled like other streams, with limited
  *            rewind ability.
@@ -653,6 +657,13 @@ esl_buffer_SetOffset(ESL_BUFFER *bf, esl_pos_t offset)
 	  bf->pos = offset-bf->baseoffset;
 	}
 
+      else if (offset >= bf->baseoffset + bf->pos && offset < bf->baseoffset + bf->n) /* offset is ahead of us but already read; no seek needed */
+	{
+	  bf->pos = offset-bf->baseoffset;
+	  status  = buffer_refill(bf, 0);
+	  if (status != eslEOF && status != eslOK) return status;
+	}
+
 #ifdef _POSIX_VERSION
       else if (bf->mode_is == eslBUFFER_FILE && bf->anchor == -1)
 	{			/* a posix-compliant system can always fseeko() on a file */
@@ -2395,6 +2406,18 @@ utest_SetOffset(const char *tmpfile, int nlines_expected)
   if (esl_buffer_SetOffset(bf, testoffset1) != eslOK) esl_fatal(msg);
   if (esl_buffer_GetLine(bf, &p, &n)        != eslOK) esl_fatal(msg);
   utest_compare_line(p, n, testline1);
+
+  /* Back to testline1, then forward two lines, to an offset that's
+   * already in the buffer window: that's positioned without a seek.
+   */
+  if (esl_buffer_GetLine(bf, &p, &n)        != eslOK) esl_fatal(msg);
+  thisoffset = esl_buffer_GetOffset(bf);
+  if (esl_buffer_GetLine(bf, &p, &n)        != eslOK) esl_fatal(msg);
+  thisline   = utest_whichline(p, n);
+  if (esl_buffer_SetOffset(bf, testoffset1) != eslOK) esl_fatal(msg);
+  if (esl_buffer_SetOffset(bf, thisoffset)  != eslOK) esl_fatal(msg);
+  if (esl_buffer_GetLine(bf, &p, &n)        != eslOK) esl_fatal(msg);
+  if (utest_whichline(p, n)                 != thisline) esl_fatal(msg);
   esl_buffer_Close(bf);
 #endif /*_POSIX_VERSION*/
   
@@ -6,11 +6,12 @@
  *    3. Distance matrices for aligned text sequences.      [dmatrix]
  *    4. Distance matrices for aligned digital sequences.   [alphabet,dmatrix]
  *    5. Average pairwise identity for multiple alignments. [alphabet,random]
- *    6. Private (static) functions.
- *    7. Unit tests.
- *    8. Test driver.
- *    9. Example.
- *   10. Copyright notice and license.
+ *    6. Bit-parallel pairwise identity for digital alignments. [alphabet]
+ *    7. Private (static) functions.
+ *    8. Unit tests.
+ *    9. Test driver.
+ *   10. Example.
+ *   11. Copyright notice and license.
  *    
  */
 #include "esl_config.h"
@@ -29,11 +30,50 @@
 #ifdef eslAUGMENT_RANDOM
 #include "esl_random.h"
 #endif
+#ifdef HAVE_PTHREAD
+#include "esl_threads.h"
+#endif
 #include "esl_distance.h"
 
+#ifdef HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef eslAUGMENT_DMATRIX
+/* DST_IDMX: an alignment encoded for fast all-pairs identity, and
+ * the work state of filling in its identity matrix. See section 7.
+ */
+typedef struct {
+  unsigned char  *codes;	/* [0..N-1] rows of <stride> residue codes, 16-byte aligned */
+  void           *mem;		/* allocation that <codes> is aligned within                */
+  int64_t         stride;	/* row length, a multiple of 16 >= alen                     */
+  int            *len;		/* [0..N-1] number of counted residues in each row          */
+  int             N;		/* number of sequences                                      */
+  int             is_text;	/* TRUE for text seqs: pid(i<j) is 0 if len[i] == 0         */
+  int             as_diff;	/* TRUE to fill <F> with differences 1-s, not identities s  */
+  ESL_DMATRIX    *S;		/* identity matrix being filled in; or...                   */
+  ESL_FSMATRIX   *F;		/*   ... packed float matrix being filled in                */
+  int             ntiles;	/* number of tiles on each side of the matrix               */
+  int             nexti;	/* next tile to hand out: row ...                           */
+  int             nextj;	/*   ... and column; tile (i,j) with i <= j                 */
+#ifdef HAVE_PTHREAD
+  int             use_lock;	/* TRUE when worker threads share this                      */
+  pthread_mutex_t lock;		/* protects <nexti>, <nextj>                                */
+#endif
+} DST_IDMX;
+#endif /*eslAUGMENT_DMATRIX*/
+
 /* Forward declaration of our static functions.
  */
 static int jukescantor(int n1, int n2, int alphabet_size, double *opt_distance, double *opt_variance);
+#ifdef eslAUGMENT_DMATRIX
+static int  dst_idmx_encode_text(DST_IDMX *ctx, char **as, int N);
+#ifdef eslAUGMENT_ALPHABET
+static int  dst_idmx_encode_digital(DST_IDMX *ctx, const ESL_ALPHABET *abc, ESL_DSQ **ax, int N);
+#endif
+static int  dst_idmx_run (DST_IDMX *ctx, int ncpu, ESL_DMATRIX **opt_S, ESL_FSMATRIX *F);
+static void dst_idmx_free(DST_IDMX *ctx);
+#endif
 
 
 /*****************************************************************
@@ -331,9 +371,12 @@ esl_dst_XJukesCantor(const ESL_ALPHABET *abc, const ESL_DSQ *ax, const ESL_DSQ *
  *
  * Purpose:   Given a multiple sequence alignment <as>, consisting
  *            of <N> aligned character strings; calculate
- *            a symmetric fractional pairwise identity matrix by $N(N-1)/2$
- *            calls to <esl_dst_CPairId()>, and return it in 
+ *            a symmetric fractional pairwise identity matrix 
+ *            for all $N(N-1)/2$ pairs, identical to what 
+ *            <esl_dst_CPairId()> gives for each pair, and return it in 
  *            <ret_D>.
+ *            
+ *            Same as <esl_dst_CPairIdMxParallel()> with one thread.
  *
  * Args:      as      - aligned seqs (all same length), [0..N-1]
  *            N       - # of aligned sequences
@@ -350,28 +393,54 @@ esl_dst_XJukesCantor(const ESL_ALPHABET *abc, const ESL_DSQ *ax, const ESL_DSQ *
 int
 esl_dst_CPairIdMx(char **as, int N, ESL_DMATRIX **ret_S)
 {
+  return esl_dst_CPairIdMxParallel(as, N, 1, ret_S);
+}
+
+
+/* Function:  esl_dst_CPairIdMxParallel()
+ * Synopsis:  NxN identity matrix for N aligned text sequences, multithreaded.
+ *
+ * Purpose:   Same as <esl_dst_CPairIdMx()>, but using up to <ncpu>
+ *            threads. 
+ *            
+ *            Each sequence is encoded once, and the matrix is
+ *            computed in tiles of sequence pairs, using SSE2 when
+ *            available to compare 16 columns at a time; worker
+ *            threads take tiles as they finish the last one. The
+ *            matrix is identical to the one <esl_dst_CPairId()>
+ *            would give for each pair, for any <ncpu>. If Easel was
+ *            built without POSIX threads, <ncpu> is ignored.
+ *
+ * Args:      as      - aligned seqs (all same length), [0..N-1]
+ *            N       - # of aligned sequences
+ *            ncpu    - number of threads to use (<=1: don't use threads)
+ *            ret_S   - RETURN: symmetric fractional identity matrix
+ *
+ * Returns:   <eslOK> on success, and <ret_S> contains the fractional
+ *            identity matrix. Caller free's <S> with
+ *            <esl_dmatrix_Destroy()>.
+ *
+ * Throws:    <eslEINVAL> if a seq has a different length than others.
+ *            <eslEMEM> on allocation failure; <eslESYS> on thread
+ *            failure. On failure, <ret_S> is returned <NULL> and
+ *            state of inputs is unchanged.
+ */
+int
+esl_dst_CPairIdMxParallel(char **as, int N, int ncpu, ESL_DMATRIX **ret_S)
+{
+  DST_IDMX     ctx;
   ESL_DMATRIX *S = NULL;
-  int status;
-  int i,j;
+  int          status;
+
+  if ((status = dst_idmx_encode_text(&ctx, as, N)) != eslOK) goto ERROR;
+  if ((status = dst_idmx_run(&ctx, ncpu, &S, NULL)) != eslOK) goto ERROR;
+  dst_idmx_free(&ctx);
 
-  if (( S = esl_dmatrix_Create(N,N) ) == NULL) goto ERROR;
-  
-  for (i = 0; i < N; i++)
-    {
-      S->mx[i][i] = 1.;
-      for (j = i+1; j < N; j++)
-	{
-	  status = esl_dst_CPairId(as[i], as[j], &(S->mx[i][j]), NULL, NULL);
-	  if (status != eslOK)
-	    ESL_XEXCEPTION(status, "Pairwise identity calculation failed at seqs %d,%d\n", i,j);
-	  S->mx[j][i] =  S->mx[i][j];
-	}
-    }
   if (ret_S != NULL) *ret_S = S; else esl_dmatrix_Destroy(S);
   return eslOK;
 
  ERROR:
-  if (S     != NULL)  esl_dmatrix_Destroy(S);
+  dst_idmx_free(&ctx);
   if (ret_S != NULL) *ret_S = NULL;
   return status;
 }
@@ -399,12 +468,38 @@ esl_dst_CPairIdMx(char **as, int N, ESL_DMATRIX **ret_S)
  */
 int
 esl_dst_CDiffMx(char **as, int N, ESL_DMATRIX **ret_D)
+{
+  return esl_dst_CDiffMxParallel(as, N, 1, ret_D);
+}
+
+/* Function:  esl_dst_CDiffMxParallel()
+ * Synopsis:  NxN difference matrix for N aligned text sequences, multithreaded.
+ *
+ * Purpose:   Same as <esl_dst_CDiffMx()>, but using up to <ncpu>
+ *            threads; see <esl_dst_CPairIdMxParallel()>.
+ *
+ * Args:      as      - aligned seqs (all same length), [0..N-1]
+ *            N       - # of aligned sequences
+ *            ncpu    - number of threads to use (<=1: don't use threads)
+ *            ret_D   - RETURN: symmetric fractional difference matrix
+ *
+ * Returns:   <eslOK> on success, and <ret_D> contains the
+ *            fractional difference matrix. Caller free's <D> with 
+ *            <esl_dmatrix_Destroy()>.
+ *
+ * Throws:    <eslEINVAL> if any seq has a different length than others;
+ *            <eslEMEM>, <eslESYS> on allocation or thread failure. 
+ *            On failure, <ret_D> is returned <NULL> and state of inputs
+ *            is unchanged.
+ */
+int
+esl_dst_CDiffMxParallel(char **as, int N, int ncpu, ESL_DMATRIX **ret_D)
 {
   ESL_DMATRIX *D = NULL;
   int status;
   int i,j;
 
-  status = esl_dst_CPairIdMx(as, N, &D);
+  status = esl_dst_CPairIdMxParallel(as, N, ncpu, &D);
   if (status != eslOK) goto ERROR;
 
   for (i = 0; i < N; i++)
@@ -427,6 +522,87 @@ esl_dst_CDiffMx(char **as, int N, ESL_DMATRIX **ret_D)
 
 }
 
+/* Function:  esl_dst_CPairIdFMx()
+ * Synopsis:  Packed float identity matrix for N aligned text sequences.
+ *
+ * Purpose:   Same as <esl_dst_CPairIdMxParallel()>, but stores the
+ *            fractional identities in a packed symmetric float matrix
+ *            <S> that the caller has created for <N> sequences: an
+ *            in-memory one (<esl_fsmatrix_Create()>), 1/4 the size of
+ *            an NxN <ESL_DMATRIX>, or a memory-mapped one
+ *            (<esl_fsmatrix_CreateMapped()>) for alignments too big
+ *            for RAM. Each cell is the double-precision identity,
+ *            rounded to float.
+ *
+ * Args:      as      - aligned seqs (all same length), [0..N-1]
+ *            N       - # of aligned sequences
+ *            ncpu    - number of threads to use (<=1: don't use threads)
+ *            S       - RESULT: NxN symmetric fractional identity matrix
+ *
+ * Returns:   <eslOK> on success, and <S> contains the fractional
+ *            identity matrix.
+ *
+ * Throws:    <eslEINVAL> if a seq has a different length than others,
+ *            or <S> isn't <N> x <N>. <eslEMEM> on allocation failure;
+ *            <eslESYS> on thread failure. On failure, the contents
+ *            of <S> are undefined.
+ */
+int
+esl_dst_CPairIdFMx(char **as, int N, int ncpu, ESL_FSMATRIX *S)
+{
+  DST_IDMX      ctx;
+  int           status;
+
+  if (S->n != N) ESL_EXCEPTION(eslEINVAL, "matrix is %d x %d, not %d x %d", S->n, S->n, N, N);
+  if ((status = dst_idmx_encode_text(&ctx, as, N)) != eslOK) goto ERROR;
+  if ((status = dst_idmx_run(&ctx, ncpu, NULL, S)) != eslOK) goto ERROR;
+  dst_idmx_free(&ctx);
+  return eslOK;
+
+ ERROR:
+  dst_idmx_free(&ctx);
+  return status;
+}
+
+/* Function:  esl_dst_CDiffFMx()
+ * Synopsis:  Packed float difference matrix for N aligned text sequences.
+ *
+ * Purpose:   Same as <esl_dst_CPairIdFMx()>, but calculates the
+ *            fractional difference <d=1-s> instead of the fractional
+ *            identity <s> for each pair (in double precision, then
+ *            rounded to float).
+ *
+ * Args:      as      - aligned seqs (all same length), [0..N-1]
+ *            N       - # of aligned sequences
+ *            ncpu    - number of threads to use (<=1: don't use threads)
+ *            D       - RESULT: NxN symmetric fractional difference matrix
+ *
+ * Returns:   <eslOK> on success, and <D> contains the
+ *            fractional difference matrix.
+ *
+ * Throws:    <eslEINVAL> if any seq has a different length than others,
+ *            or <D> isn't <N> x <N>; <eslEMEM>, <eslESYS> on allocation
+ *            or thread failure. On failure, the contents of <D> are
+ *            undefined.
+ */
+int
+esl_dst_CDiffFMx(char **as, int N, int ncpu, ESL_FSMATRIX *D)
+{
+  DST_IDMX      ctx;
+  int           status;
+
+  if (D->n != N) ESL_EXCEPTION(eslEINVAL, "matrix is %d x %d, not %d x %d", D->n, D->n, N, N);
+  if ((status = dst_idmx_encode_text(&ctx, as, N)) != eslOK) goto ERROR;
+  ctx.as_diff = TRUE;
+  if ((status = dst_idmx_run(&ctx, ncpu, NULL, D)) != eslOK) goto ERROR;
+  dst_idmx_free(&ctx);
+  return eslOK;
+
+ ERROR:
+  dst_idmx_free(&ctx);
+  return status;
+}
+
 /* Function:  esl_dst_CJukesCantorMx()
  * Synopsis:  NxN Jukes/Cantor distance matrix for N aligned text seqs.
  * Incept:    SRE, Tue Apr 18 16:00:16 2006 [St. Louis]
@@ -517,8 +693,11 @@ esl_dst_CJukesCantorMx(int K, char **aseq, int nseq,
  *
  * Purpose:   Given a digitized multiple sequence alignment <ax>, consisting
  *            of <N> aligned digital sequences in alphabet <abc>; calculate
- *            a symmetric pairwise fractional identity matrix by $N(N-1)/2$
- *            calls to <esl_dst_XPairId()>, and return it in <ret_S>.
+ *            a symmetric pairwise fractional identity matrix for all
+ *            $N(N-1)/2$ pairs, identical to what <esl_dst_XPairId()> gives
+ *            for each pair, and return it in <ret_S>.
+ *            
+ *            Same as <esl_dst_XPairIdMxParallel()> with one thread.
  *            
  * Args:      abc   - digital alphabet in use
  *            ax    - aligned dsq's, [0..N-1][1..alen]                  
@@ -536,28 +715,48 @@ esl_dst_CJukesCantorMx(int K, char **aseq, int nseq,
 int
 esl_dst_XPairIdMx(const ESL_ALPHABET *abc,  ESL_DSQ **ax, int N, ESL_DMATRIX **ret_S)
 {
-  int status;
+  return esl_dst_XPairIdMxParallel(abc, ax, N, 1, ret_S);
+}
+
+
+/* Function:  esl_dst_XPairIdMxParallel()
+ * Synopsis:  NxN identity matrix for N aligned digital seqs, multithreaded.
+ *
+ * Purpose:   Same as <esl_dst_XPairIdMx()>, but using up to <ncpu>
+ *            threads; see <esl_dst_CPairIdMxParallel()>. The
+ *            matrix is identical for any <ncpu>.
+ *
+ * Args:      abc   - digital alphabet in use
+ *            ax    - aligned dsq's, [0..N-1][1..alen]                  
+ *            N     - number of aligned sequences
+ *            ncpu  - number of threads to use (<=1: don't use threads)
+ *            ret_S - RETURN: NxN matrix of fractional identities
+ *
+ * Returns:   <eslOK> on success, and <ret_S> contains the distance
+ *            matrix. Caller is obligated to free <S> with 
+ *            <esl_dmatrix_Destroy()>. 
+ *
+ * Throws:    <eslEINVAL> if a seq has a different length than others;
+ *            <eslEMEM>, <eslESYS> on allocation or thread failure. 
+ *            On failure, <ret_S> is returned <NULL> and state of inputs
+ *            is unchanged.
+ */
+int
+esl_dst_XPairIdMxParallel(const ESL_ALPHABET *abc,  ESL_DSQ **ax, int N, int ncpu, ESL_DMATRIX **ret_S)
+{
+  DST_IDMX     ctx;
   ESL_DMATRIX *S = NULL;
-  int i,j;
+  int          status;
+
+  if ((status = dst_idmx_encode_digital(&ctx, abc, ax, N)) != eslOK) goto ERROR;
+  if ((status = dst_idmx_run(&ctx, ncpu, &S, NULL))        != eslOK) goto ERROR;
+  dst_idmx_free(&ctx);
 
-  if (( S = esl_dmatrix_Create(N,N) ) == NULL) goto ERROR;
-  
-  for (i = 0; i < N; i++)
-    {
-      S->mx[i][i] = 1.;
-      for (j = i+1; j < N; j++)
-	{
-	  status = esl_dst_XPairId(abc, ax[i], ax[j], &(S->mx[i][j]), NULL, NULL);
-	  if (status != eslOK)
-	    ESL_XEXCEPTION(status, "Pairwise identity calculation failed at seqs %d,%d\n", i,j);
-	  S->mx[j][i] =  S->mx[i][j];
-	}
-    }
   if (ret_S != NULL) *ret_S = S; else esl_dmatrix_Destroy(S);
   return eslOK;
 
  ERROR:
-  if (S     != NULL)  esl_dmatrix_Destroy(S);
+  dst_idmx_free(&ctx);
   if (ret_S != NULL) *ret_S = NULL;
   return status;
 }
@@ -586,12 +785,39 @@ esl_dst_XPairIdMx(const ESL_ALPHABET *abc,  ESL_DSQ **ax, int N, ESL_DMATRIX **r
  */
 int
 esl_dst_XDiffMx(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, ESL_DMATRIX **ret_D)
+{
+  return esl_dst_XDiffMxParallel(abc, ax, N, 1, ret_D);
+}
+
+/* Function:  esl_dst_XDiffMxParallel()
+ * Synopsis:  NxN difference matrix for N aligned digital seqs, multithreaded.
+ *
+ * Purpose:   Same as <esl_dst_XDiffMx()>, but using up to <ncpu>
+ *            threads; see <esl_dst_CPairIdMxParallel()>.
+ *
+ * Args:      abc   - digital alphabet in use
+ *            ax    - aligned dsq's, [0..N-1][1..alen]                  
+ *            N     - number of aligned sequences
+ *            ncpu  - number of threads to use (<=1: don't use threads)
+ *            ret_D - RETURN: NxN matrix of fractional differences
+ *            
+ * Returns:   <eslOK> on success, and <ret_D> contains the difference
+ *            matrix; caller is obligated to free <D> with 
+ *            <esl_dmatrix_Destroy()>. 
+ *
+ * Throws:    <eslEINVAL> if a seq has a different length than others;
+ *            <eslEMEM>, <eslESYS> on allocation or thread failure. 
+ *            On failure, <ret_D> is returned <NULL> and state of inputs
+ *            is unchanged.
+ */
+int
+esl_dst_XDiffMxParallel(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int ncpu, ESL_DMATRIX **ret_D)
 {
   int status;
   ESL_DMATRIX *D = NULL;
   int i,j;
 
-  status = esl_dst_XPairIdMx(abc, ax, N, &D);
+  status = esl_dst_XPairIdMxParallel(abc, ax, N, ncpu, &D);
   if (status != eslOK) goto ERROR;
 
   for (i = 0; i < N; i++)
@@ -612,6 +838,84 @@ esl_dst_XDiffMx(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, ESL_DMATRIX **ret_
   return status;
 }
 
+/* Function:  esl_dst_XPairIdFMx()
+ * Synopsis:  Packed float identity matrix for N aligned digital seqs.
+ *
+ * Purpose:   Same as <esl_dst_XPairIdMxParallel()>, but stores the
+ *            fractional identities in a caller-created packed
+ *            symmetric float matrix <S> for <N> sequences, in memory
+ *            or memory-mapped; see <esl_dst_CPairIdFMx()>.
+ *
+ * Args:      abc   - digital alphabet in use
+ *            ax    - aligned dsq's, [0..N-1][1..alen]                  
+ *            N     - number of aligned sequences
+ *            ncpu  - number of threads to use (<=1: don't use threads)
+ *            S     - RESULT: NxN symmetric fractional identity matrix
+ *
+ * Returns:   <eslOK> on success, and <S> contains the identity
+ *            matrix.
+ *
+ * Throws:    <eslEINVAL> if a seq has a different length than others,
+ *            or <S> isn't <N> x <N>; <eslEMEM>, <eslESYS> on allocation
+ *            or thread failure. On failure, the contents of <S> are
+ *            undefined.
+ */
+int
+esl_dst_XPairIdFMx(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int ncpu, ESL_FSMATRIX *S)
+{
+  DST_IDMX      ctx;
+  int           status;
+
+  if (S->n != N) ESL_EXCEPTION(eslEINVAL, "matrix is %d x %d, not %d x %d", S->n, S->n, N, N);
+  if ((status = dst_idmx_encode_digital(&ctx, abc, ax, N)) != eslOK) goto ERROR;
+  if ((status = dst_idmx_run(&ctx, ncpu, NULL, S))         != eslOK) goto ERROR;
+  dst_idmx_free(&ctx);
+  return eslOK;
+
+ ERROR:
+  dst_idmx_free(&ctx);
+  return status;
+}
+
+/* Function:  esl_dst_XDiffFMx()
+ * Synopsis:  Packed float difference matrix for N aligned digital seqs.
+ *
+ * Purpose:   Same as <esl_dst_XPairIdFMx()>, but calculates fractional
+ *            difference <1-s> instead of fractional identity <s> for
+ *            each pair.
+ *
+ * Args:      abc   - digital alphabet in use
+ *            ax    - aligned dsq's, [0..N-1][1..alen]                  
+ *            N     - number of aligned sequences
+ *            ncpu  - number of threads to use (<=1: don't use threads)
+ *            D     - RESULT: NxN symmetric fractional difference matrix
+ *            
+ * Returns:   <eslOK> on success, and <D> contains the difference
+ *            matrix.
+ *
+ * Throws:    <eslEINVAL> if a seq has a different length than others,
+ *            or <D> isn't <N> x <N>; <eslEMEM>, <eslESYS> on allocation
+ *            or thread failure. On failure, the contents of <D> are
+ *            undefined.
+ */
+int
+esl_dst_XDiffFMx(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int ncpu, ESL_FSMATRIX *D)
+{
+  DST_IDMX      ctx;
+  int           status;
+
+  if (D->n != N) ESL_EXCEPTION(eslEINVAL, "matrix is %d x %d, not %d x %d", D->n, D->n, N, N);
+  if ((status = dst_idmx_encode_digital(&ctx, abc, ax, N)) != eslOK) goto ERROR;
+  ctx.as_diff = TRUE;
+  if ((status = dst_idmx_run(&ctx, ncpu, NULL, D))         != eslOK) goto ERROR;
+  dst_idmx_free(&ctx);
+  return eslOK;
+
+ ERROR:
+  dst_idmx_free(&ctx);
+  return status;
+}
+
 /* Function:  esl_dst_XJukesCantorMx()
  * Synopsis:  NxN Jukes/Cantor distance matrix for N aligned digital seqs.
  * Incept:    SRE, Thu Apr 27 08:38:08 2006 [New York City]
@@ -790,6 +1094,7 @@ esl_dst_CAverageId(char **as, int N, int max_comparisons, double *ret_id)
 int
 esl_dst_XAverageId(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int max_comparisons, double *ret_id)
 {
+  ESL_DST_BITS *b   = NULL;
   int    status;
   double id;
   double sum = 0.;
@@ -798,6 +1103,11 @@ esl_dst_XAverageId(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int max_compari
   if (N <= 1) { *ret_id = 1.; return eslOK; }
   *ret_id = 0.;
 
+  /* Unless there are more seqs than comparisons to make, bit-slicing
+   * the alignment first is cheaper than comparing residue by residue.
+   */
+  if (N <= max_comparisons && (status = esl_dst_bits_Create(abc, ax, N, &b)) != eslOK) return status;
+
   /* Is N small enough that we can average over all pairwise comparisons? 
      watch out for numerical overflow in this: Pfam N's easily overflow when squared
    */
@@ -808,7 +1118,7 @@ esl_dst_XAverageId(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int max_compari
       for (i = 0; i < N; i++)
 	for (j = i+1; j < N; j++)
 	  {
-	    if ((status = esl_dst_XPairId(abc, ax[i], ax[j], &id, NULL, NULL)) != eslOK) return status;
+	    esl_dst_bits_PairId(b, i, j, &id, NULL, NULL);
 	    sum += id;
 	  }
       sum /= (double) (N * (N-1) / 2);
@@ -821,13 +1131,15 @@ esl_dst_XAverageId(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int max_compari
       for (n = 0; n < max_comparisons; n++)
 	{
 	  do { i = esl_rnd_Roll(r, N); j = esl_rnd_Roll(r, N); } while (j == i); /* make sure j != i */
-	  if ((status = esl_dst_XPairId(abc, ax[i], ax[j], &id, NULL, NULL)) != eslOK) return status;
+	  if (b) esl_dst_bits_PairId(b, i, j, &id, NULL, NULL);
+	  else if ((status = esl_dst_XPairId(abc, ax[i], ax[j], &id, NULL, NULL)) != eslOK) { esl_randomness_Destroy(r); return status; }
 	  sum += id;
 	}
       sum /= (double) max_comparisons;
       esl_randomness_Destroy(r);
     }
 
+  esl_dst_bits_Destroy(b);
   *ret_id = sum;
   return eslOK;
 }
@@ -838,7 +1150,273 @@ esl_dst_XAverageId(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int max_compari
 
 
 /*****************************************************************
- * 6. Private (static) functions
+ * 6. Bit-parallel pairwise identity for digital alignments. [alphabet]
+ *****************************************************************/
+
+/* Function:  esl_dst_NidThreshold()
+ * Synopsis:  Number of identities needed to exceed a fractional identity.
+ *
+ * Purpose:   Return the smallest number of identities <nid> for which
+ *            fractional identity <nid/n> is $>$ <maxid>, calculated
+ *            in double precision exactly as the pairwise identity
+ *            functions do; or <n+1> if no <nid> $\leq n$ will do. <n>
+ *            is the identity denominator, $> 0$.
+ */
+int
+esl_dst_NidThreshold(int n, double maxid)
+{
+  int need = (maxid < 0. ? 0 : (maxid >= 1. ? n+1 : (int) (maxid * n)));
+
+  if ((double) need / (double) n > maxid)
+    { while (need > 0 && (double) (need-1) / (double) n > maxid) need--; }
+  else
+    { while (need <= n && (double) need / (double) n <= maxid) need++; }
+  return need;
+}
+
+#ifdef eslAUGMENT_ALPHABET
+
+/* With a hardware popcount instruction, use it; otherwise the
+ * builtin is an out-of-line library call, and inline SWAR is faster.
+ */
+#if defined(__GNUC__) && defined(__POPCNT__)
+#define dst_popcount64(x) __builtin_popcountll(x)
+#else
+static inline int
+dst_popcount64(uint64_t x)
+{
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (int) ((x * 0x0101010101010101ULL) >> 56);
+}
+#endif
+
+/* Function:  esl_dst_bits_Create()
+ * Synopsis:  Bit-sliced encoding of a digital alignment.
+ *
+ * Purpose:   Encode the <N> aligned digital sequences <ax> in
+ *            alphabet <abc> as bit planes, for fast pairwise
+ *            identity calculations with <esl_dst_bits_PairId()>, and
+ *            return the new <ESL_DST_BITS> in <*ret_b>.
+ *
+ *            Each sequence is cut into words of 64 columns. Each
+ *            word has a mask of the columns that hold canonical
+ *            residues, and <nplanes> = $\lceil \log_2 K \rceil$
+ *            residue planes, plane <p> holding bit <p> of each
+ *            residue code. Two sequences are identical at a column
+ *            iff both masks are set there and no plane differs, so
+ *            a pair's identities are counted 64 columns at a time
+ *            with AND, XOR, and popcount.
+ *
+ *            Encoding takes $O(NL)$ time, about the same as
+ *            $N$ calls to <esl_dst_XPairId()>, and $N L (1 +
+ *            nplanes)/8$ bytes: 6 bits per column for amino acids.
+ *            It pays off whenever each sequence will be compared
+ *            to more than a few others.
+ *
+ * Args:      abc   - digital alphabet
+ *            ax    - aligned digital seqs, [0..N-1][1..L]
+ *            N     - number of sequences
+ *            ret_b - RETURN: new bit-sliced alignment
+ *
+ * Returns:   <eslOK> on success; caller frees <*ret_b> with
+ *            <esl_dst_bits_Destroy()>.
+ *
+ * Throws:    <eslEINVAL> if the seqs aren't all the same length;
+ *            <eslEMEM> on allocation failure. On either failure,
+ *            <*ret_b> is <NULL>.
+ */
+int
+esl_dst_bits_Create(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, ESL_DST_BITS **ret_b)
+{
+  ESL_DST_BITS *b  = NULL;
+  uint64_t     *wp;
+  uint64_t      bit;
+  int64_t       L  = (N > 0 ? esl_abc_dsqlen(ax[0]) : 0);
+  int64_t       k;
+  int           i, p;
+  int           status;
+
+  ESL_ALLOC(b, sizeof(ESL_DST_BITS));
+  b->bits    = NULL;
+  b->len     = NULL;
+  b->N       = N;
+  b->L       = L;
+  b->nw      = (L + 63) / 64;
+  for (b->nplanes = 1; (1 << b->nplanes) < abc->K; b->nplanes++) ;
+
+  ESL_ALLOC(b->bits, sizeof(uint64_t) * ESL_MAX(1, (int64_t) N * b->nw * (b->nplanes+1)));
+  ESL_ALLOC(b->len,  sizeof(int)      * ESL_MAX(1, N));
+  memset(b->bits, 0, sizeof(uint64_t) * (int64_t) N * b->nw * (b->nplanes+1));
+
+  for (i = 0; i < N; i++)
+    {
+      b->len[i] = 0;
+      for (k = 1; ax[i][k] != eslDSQ_SENTINEL; k++)
+	{
+	  if (k > L) break;
+	  if (! esl_abc_XIsCanonical(abc, ax[i][k])) continue;
+
+	  wp     = b->bits + ((int64_t) i * b->nw + (k-1) / 64) * (b->nplanes+1);
+	  bit    = (uint64_t) 1 << ((k-1) % 64);
+	  wp[0] |= bit;
+	  for (p = 0; p < b->nplanes; p++)
+	    if (ax[i][k] & (1 << p)) wp[p+1] |= bit;
+	  b->len[i]++;
+	}
+      if (k != L+1 || ax[i][k] != eslDSQ_SENTINEL) ESL_XEXCEPTION(eslEINVAL, "strings not same length, not aligned");
+    }
+
+  *ret_b = b;
+  return eslOK;
+
+ ERROR:
+  esl_dst_bits_Destroy(b);
+  *ret_b = NULL;
+  return status;
+}
+
+/* Function:  esl_dst_bits_PairId()
+ * Synopsis:  Pairwise identity of two seqs in a bit-sliced alignment.
+ *
+ * Purpose:   Calculate the pairwise fractional identity of sequences
+ *            <i> and <j> in bit-sliced alignment <b>, exactly as
+ *            <esl_dst_XPairId()> would on the digital sequences 
+ *            <b> was created from. Optionally return the fractional
+ *            identity in <opt_pid>, the number of identities in
+ *            <opt_nid>, and the denominator <MIN(len1,len2)> in
+ *            <opt_n>.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+esl_dst_bits_PairId(const ESL_DST_BITS *b, int i, int j, double *opt_pid, int *opt_nid, int *opt_n)
+{
+  int             ns  = b->nplanes + 1;
+  const uint64_t *x   = b->bits + (int64_t) i * b->nw * ns;
+  const uint64_t *y   = b->bits + (int64_t) j * b->nw * ns;
+  uint64_t        d;
+  int             nid = 0;
+  int             n   = ESL_MIN(b->len[i], b->len[j]);
+  int             w, p;
+
+  for (w = 0; w < b->nw; w++, x += ns, y += ns)
+    {
+      for (d = 0, p = 1; p < ns; p++) d |= x[p] ^ y[p];
+      nid += dst_popcount64(x[0] & y[0] & ~d);
+    }
+
+  if (opt_pid != NULL) *opt_pid = (n == 0 ? 0. : (double) nid / (double) n);
+  if (opt_nid != NULL) *opt_nid = nid;
+  if (opt_n   != NULL) *opt_n   = n;
+  return eslOK;
+}
+
+/* Function:  esl_dst_bits_PairIdExceeds()
+ * Synopsis:  Test whether pairwise identity exceeds a threshold, stopping early.
+ *
+ * Purpose:   Return <TRUE> if the fractional identity of sequences
+ *            <i> and <j> in bit-sliced alignment <b>, as calculated by
+ *            <esl_dst_bits_PairId()>, is $>$ <maxid>; else <FALSE>.
+ *
+ *            The answer is exactly the same as comparing the
+ *            identity from <esl_dst_bits_PairId()> against <maxid>,
+ *            but the count may stop as soon as the answer is known;
+ *            see <esl_dst_bits_NidAtLeast()>. Use this for filtering,
+ *            where most pairs are far from the threshold.
+ *
+ * Returns:   <TRUE> or <FALSE>.
+ */
+int
+esl_dst_bits_PairIdExceeds(const ESL_DST_BITS *b, int i, int j, double maxid)
+{
+  int n = ESL_MIN(b->len[i], b->len[j]);
+
+  if (n == 0) return (0. > maxid ? TRUE : FALSE);
+  return esl_dst_bits_NidAtLeast(b, i, j, esl_dst_NidThreshold(n, maxid));
+}
+
+/* Function:  esl_dst_bits_NidAtLeast()
+ * Synopsis:  Test whether a pair has at least <need> identities, stopping early.
+ *
+ * Purpose:   Return <TRUE> if sequences <i> and <j> in bit-sliced
+ *            alignment <b> have at least <need> identities, as
+ *            counted by <esl_dst_bits_PairId()>; else <FALSE>.
+ *
+ *            This is the integer form of
+ *            <esl_dst_bits_PairIdExceeds()>, for callers testing many
+ *            pairs against one threshold: they can tabulate
+ *            <esl_dst_NidThreshold()> for each denominator once.
+ *
+ *            In long alignments (1024 columns or more), the count
+ *            stops when enough identities have been seen, or when
+ *            enough mismatches have been seen that <need> can't be
+ *            reached (each mismatch costs both sequences a residue).
+ *            In shorter ones, checking costs more than it saves.
+ *
+ * Returns:   <TRUE> or <FALSE>.
+ */
+int
+esl_dst_bits_NidAtLeast(const ESL_DST_BITS *b, int i, int j, int need)
+{
+  int             ns   = b->nplanes + 1;
+  const uint64_t *x    = b->bits + (int64_t) i * b->nw * ns;
+  const uint64_t *y    = b->bits + (int64_t) j * b->nw * ns;
+  uint64_t        d;
+  int             n    = ESL_MIN(b->len[i], b->len[j]);
+  int             nid  = 0;
+  int             nmis = 0;
+  int             w, p;
+
+  if (need <= 0) return TRUE;
+  if (need >  n) return FALSE;
+
+  if (b->nw < 16)
+    {
+      for (w = 0; w < b->nw; w++, x += ns, y += ns)
+	{
+	  for (d = 0, p = 1; p < ns; p++) d |= x[p] ^ y[p];
+	  nid += dst_popcount64(x[0] & y[0] & ~d);
+	}
+      return (nid >= need ? TRUE : FALSE);
+    }
+
+  for (w = 0; w < b->nw; w++, x += ns, y += ns)
+    {
+      for (d = 0, p = 1; p < ns; p++) d |= x[p] ^ y[p];
+      nid  += dst_popcount64(x[0] & y[0] & ~d);
+      nmis += dst_popcount64(x[0] & y[0] &  d);
+      if ((w & 3) == 3)		/* check every 256 columns */
+	{
+	  if (nid      >= need) return TRUE;
+	  if (n - nmis <  need) return FALSE;
+	}
+    }
+  return (nid >= need ? TRUE : FALSE);
+}
+
+/* Function:  esl_dst_bits_Destroy()
+ * Synopsis:  Free an <ESL_DST_BITS>.
+ */
+void
+esl_dst_bits_Destroy(ESL_DST_BITS *b)
+{
+  if (b)
+    {
+      if (b->bits) free(b->bits);
+      if (b->len)  free(b->len);
+      free(b);
+    }
+}
+#endif /*eslAUGMENT_ALPHABET*/
+/*------------ end, bit-parallel pairwise identity ---------------*/
+
+
+
+
+/*****************************************************************
+ * 7. Private (static) functions
  *****************************************************************/
 
 /* jukescantor()
@@ -890,11 +1468,319 @@ jukescantor(int n1, int n2, int alphabet_size, double *opt_distance, double *opt
   if (opt_variance != NULL)  *opt_variance = HUGE_VAL;
   return status;
 }
+
+#ifdef eslAUGMENT_DMATRIX
+/* The identity matrix engine, behind esl_dst_{C,X}PairIdMx*().
+ *
+ * Each aligned sequence is encoded once as a row of bytes, one per
+ * column: a nonzero residue code, or 0 for anything that isn't
+ * counted (gaps and nonresidues; in digital mode, noncanonicals).
+ * Two rows are then identical at a column iff their codes are equal
+ * and nonzero, a test that SSE2 does 16 columns at a time. Rows are
+ * padded with 0's to a multiple of 16 columns.
+ *
+ * The upper triangle of the NxN matrix is cut into tiles of
+ * eslDST_TILE x eslDST_TILE sequence pairs, and each tile is swept
+ * in column chunks of eslDST_CHUNK, so the 2*eslDST_TILE row
+ * segments of a chunk stay in cache while all pairs in the tile use
+ * them. Tiles are handed out to worker threads one at a time.
+ */
+#define eslDST_TILE  64
+#define eslDST_CHUNK 2048
+
+static int
+dst_idmx_alloc(DST_IDMX *ctx, int N, int64_t L)
+{
+  int status;
+
+  ctx->mem    = NULL;
+  ctx->len    = NULL;
+  ctx->N      = N;
+  ctx->stride = ESL_MAX(16, ((L + 15) / 16) * 16);
+  ctx->ntiles = (N + eslDST_TILE - 1) / eslDST_TILE;
+  ctx->nexti  = 0;
+  ctx->nextj  = 0;
+  ctx->as_diff = FALSE;
+  ctx->S      = NULL;
+  ctx->F      = NULL;
+
+  ESL_ALLOC(ctx->mem, sizeof(unsigned char) * (ctx->stride * ESL_MAX(N,1) + 15));
+  ESL_ALLOC(ctx->len, sizeof(int)           * ESL_MAX(N,1));
+  ctx->codes = (unsigned char *) (((uintptr_t) ctx->mem + 15) & ~((uintptr_t) 15));
+  memset(ctx->codes, 0, sizeof(unsigned char) * ctx->stride * N);
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+static void
+dst_idmx_free(DST_IDMX *ctx)
+{
+  if (ctx->mem) free(ctx->mem);
+  if (ctx->len) free(ctx->len);
+}
+
+/* dst_idmx_encode_text()
+ * Encode <N> aligned text seqs <as>: alphabetic chars as their
+ * upper case, anything else 0.
+ * Throws <eslEINVAL> if the seqs aren't all the same length.
+ */
+static int
+dst_idmx_encode_text(DST_IDMX *ctx, char **as, int N)
+{
+  int64_t        L = (N > 0 ? strlen(as[0]) : 0);
+  unsigned char *c;
+  int64_t        k;
+  int            i;
+  int            status;
+
+  if ((status = dst_idmx_alloc(ctx, N, L)) != eslOK) return status;
+  ctx->is_text = TRUE;
+
+  for (i = 0; i < N; i++)
+    {
+      c           = ctx->codes + i * ctx->stride;
+      ctx->len[i] = 0;
+      for (k = 0; as[i][k] != '\0'; k++)
+	{
+	  if (k == L) break;
+	  if (isalpha((unsigned char) as[i][k])) { c[k] = toupper((unsigned char) as[i][k]); ctx->len[i]++; }
+	}
+      if (k != L || as[i][k] != '\0') ESL_XEXCEPTION(eslEINVAL, "strings not same length, not aligned");
+    }
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+#ifdef eslAUGMENT_ALPHABET
+/* dst_idmx_encode_digital()
+ * Encode <N> aligned digital seqs <ax> in alphabet <abc>: canonical
+ * residues x as x+1, anything else 0.
+ * Throws <eslEINVAL> if the seqs aren't all the same length.
+ */
+static int
+dst_idmx_encode_digital(DST_IDMX *ctx, const ESL_ALPHABET *abc, ESL_DSQ **ax, int N)
+{
+  int64_t        L = (N > 0 ? esl_abc_dsqlen(ax[0]) : 0);
+  unsigned char *c;
+  int64_t        k;
+  int            i;
+  int            status;
+
+  if ((status = dst_idmx_alloc(ctx, N, L)) != eslOK) return status;
+  ctx->is_text = FALSE;
+
+  for (i = 0; i < N; i++)
+    {
+      c           = ctx->codes + i * ctx->stride;
+      ctx->len[i] = 0;
+      for (k = 1; ax[i][k] != eslDSQ_SENTINEL; k++)
+	{
+	  if (k > L) break;
+	  if (esl_abc_XIsCanonical(abc, ax[i][k])) { c[k-1] = ax[i][k] + 1; ctx->len[i]++; }
+	}
+      if (k != L+1 || ax[i][k] != eslDSQ_SENTINEL) ESL_XEXCEPTION(eslEINVAL, "strings not same length, not aligned");
+    }
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+#endif /*eslAUGMENT_ALPHABET*/
+
+/* dst_ident_count()
+ * Count columns where encoded rows <a>,<b> have the same nonzero
+ * code. <n> is a multiple of 16, and <a>,<b> are 16-byte aligned.
+ */
+static int
+dst_ident_count(const unsigned char *a, const unsigned char *b, int64_t n)
+{
+#ifdef HAVE_SSE2
+  __m128i zero  = _mm_setzero_si128();
+  __m128i acc64 = _mm_setzero_si128();
+  __m128i acc8, va, vb;
+  int64_t k, kend;
+
+  for (k = 0; k < n; )
+    {
+      acc8 = zero;		/* byte counters; flushed before they can overflow at 255 */
+      kend = ESL_MIN(n, k + 255*16);
+      for (; k < kend; k += 16)
+	{
+	  va   = _mm_load_si128((const __m128i *) (a + k));
+	  vb   = _mm_load_si128((const __m128i *) (b + k));
+	  acc8 = _mm_sub_epi8(acc8, _mm_andnot_si128(_mm_cmpeq_epi8(va, zero), _mm_cmpeq_epi8(va, vb)));
+	}
+      acc64 = _mm_add_epi64(acc64, _mm_sad_epu8(acc8, zero));
+    }
+  return _mm_cvtsi128_si32(acc64) + _mm_cvtsi128_si32(_mm_srli_si128(acc64, 8));
+#else
+  int64_t k;
+  int     nid = 0;
+
+  for (k = 0; k < n; k++)
+    nid += (a[k] == b[k] && a[k] != 0);
+  return nid;
+#endif
+}
+
+/* dst_idmx_tile()
+ * Fill in the fractional identities for all pairs i<j in tile
+ * <ti>,<tj> (<ti> <= <tj>), in <ctx->S> or <ctx->F>.
+ */
+static void
+dst_idmx_tile(DST_IDMX *ctx, int ti, int tj)
+{
+  int      nid[eslDST_TILE * eslDST_TILE];
+  int      i0 = ti * eslDST_TILE,  i1 = ESL_MIN(ctx->N, i0 + eslDST_TILE);
+  int      j0 = tj * eslDST_TILE,  j1 = ESL_MIN(ctx->N, j0 + eslDST_TILE);
+  int64_t  c0, clen;
+  double   pid;
+  int      i, j, n;
+  const unsigned char *ai;
+
+  memset(nid, 0, sizeof(nid));
+  for (c0 = 0; c0 < ctx->stride; c0 += eslDST_CHUNK)
+    {
+      clen = ESL_MIN(eslDST_CHUNK, ctx->stride - c0);
+      for (i = i0; i < i1; i++)
+	{
+	  ai = ctx->codes + i * ctx->stride + c0;
+	  for (j = ESL_MAX(j0, i+1); j < j1; j++)
+	    nid[(i-i0)*eslDST_TILE + (j-j0)] += dst_ident_count(ai, ctx->codes + j * ctx->stride + c0, clen);
+	}
+    }
+
+  /* Same arithmetic as esl_dst_CPairId(), esl_dst_XPairId(), so results are identical. */
+  for (i = i0; i < i1; i++)
+    for (j = ESL_MAX(j0, i+1); j < j1; j++)
+      {
+	n = ESL_MIN(ctx->len[i], ctx->len[j]);
+	if (ctx->is_text) pid = (ctx->len[i] == 0 ? 0. : (double) nid[(i-i0)*eslDST_TILE + (j-j0)] / (double) n);
+	else              pid = (n           == 0 ? 0. : (double) nid[(i-i0)*eslDST_TILE + (j-j0)] / (double) n);
+	if (ctx->S) ctx->S->mx[i][j] = ctx->S->mx[j][i] = pid;
+	else        ctx->F->mx[esl_fsmx_Index(ctx->F, i, j)] = (float) (ctx->as_diff ? 1. - pid : pid);
+      }
+}
+
+/* dst_idmx_next_tile()
+ * Get the next tile to do in <*ret_ti>, <*ret_tj>, and return TRUE;
+ * or return FALSE if all tiles have been handed out.
+ */
+static int
+dst_idmx_next_tile(DST_IDMX *ctx, int *ret_ti, int *ret_tj)
+{
+  int more = FALSE;
+
+#ifdef HAVE_PTHREAD
+  if (ctx->use_lock) pthread_mutex_lock(&(ctx->lock));
+#endif
+  if (ctx->nexti < ctx->ntiles)
+    {
+      *ret_ti = ctx->nexti;
+      *ret_tj = ctx->nextj;
+      if (++ctx->nextj == ctx->ntiles) { ctx->nexti++; ctx->nextj = ctx->nexti; }
+      more = TRUE;
+    }
+#ifdef HAVE_PTHREAD
+  if (ctx->use_lock) pthread_mutex_unlock(&(ctx->lock));
+#endif
+  return more;
+}
+
+#ifdef HAVE_PTHREAD
+static void
+dst_idmx_thread(void *arg)
+{
+  ESL_THREADS *thr = (ESL_THREADS *) arg;
+  DST_IDMX    *ctx;
+  int          w;
+  int          ti, tj;
+
+  esl_threads_Started(thr, &w);
+  ctx = (DST_IDMX *) esl_threads_GetData(thr, w);
+  while (dst_idmx_next_tile(ctx, &ti, &tj))
+    dst_idmx_tile(ctx, ti, tj);
+  esl_threads_Finished(thr, w);
+}
+#endif /*HAVE_PTHREAD*/
+
+/* dst_idmx_run()
+ * Given an encoded alignment in <ctx>, create and fill the NxN
+ * fractional identity matrix, using <ncpu> threads, and return
+ * it in <*opt_S>; or, if <opt_S> is <NULL>, fill in the caller's
+ * NxN packed float matrix <F> (differences, if <ctx->as_diff>).
+ *
+ * Throws: <eslEMEM> on allocation failure.
+ */
+static int
+dst_idmx_run(DST_IDMX *ctx, int ncpu, ESL_DMATRIX **opt_S, ESL_FSMATRIX *F)
+{
+  int          i, ti, tj;
+  int          status;
+#ifdef HAVE_PTHREAD
+  ESL_THREADS *thr = NULL;
+  int          t;
+#endif
+
+  if (opt_S != NULL)
+    {
+      if ((ctx->S = esl_dmatrix_Create(ctx->N, ctx->N)) == NULL) { status = eslEMEM; goto ERROR; }
+      for (i = 0; i < ctx->N; i++) ctx->S->mx[i][i] = 1.;
+    }
+  else
+    {
+      ctx->F = F;
+      for (i = 0; i < ctx->N; i++) esl_fsmx_Set(ctx->F, i, i, ctx->as_diff ? 0. : 1.);
+    }
+
+  ncpu = ESL_MIN(ncpu, ctx->ntiles * (ctx->ntiles + 1) / 2);
+#ifdef HAVE_PTHREAD
+  ctx->use_lock = FALSE;
+  if (ncpu > 1)
+    {
+      if (pthread_mutex_init(&(ctx->lock), NULL) != 0) ESL_XEXCEPTION(eslESYS, "mutex init failed");
+      ctx->use_lock = TRUE;
+      if ((thr = esl_threads_Create(&dst_idmx_thread)) == NULL) { status = eslEMEM; goto ERROR; }
+      for (t = 0; t < ncpu; t++)
+	if ((status = esl_threads_AddThread(thr, (void *) ctx)) != eslOK) break;
+      esl_threads_WaitForStart (thr);
+      esl_threads_WaitForFinish(thr);
+      esl_threads_Destroy(thr);
+      thr = NULL;
+      pthread_mutex_destroy(&(ctx->lock));
+      ctx->use_lock = FALSE;
+      if (t < ncpu) goto ERROR;
+    }
+#endif
+  while (dst_idmx_next_tile(ctx, &ti, &tj)) /* serial; or a no-op, after threads have done it all */
+    dst_idmx_tile(ctx, ti, tj);
+
+  if (opt_S != NULL) *opt_S = ctx->S; 
+  ctx->S = NULL;
+  ctx->F = NULL;
+  return eslOK;
+
+ ERROR:
+#ifdef HAVE_PTHREAD
+  if (ctx->use_lock) pthread_mutex_destroy(&(ctx->lock));
+  ctx->use_lock = FALSE;
+#endif
+  if (ctx->S) esl_dmatrix_Destroy(ctx->S);
+  ctx->S = NULL;
+  ctx->F = NULL;
+  if (opt_S != NULL) *opt_S = NULL;
+  return status;
+}
+#endif /*eslAUGMENT_DMATRIX*/
 /*--------------- end of private functions ----------------------*/
 
 
 /*****************************************************************
- * 7. Unit tests.
+ * 8. Unit tests.
  *****************************************************************/ 
 #ifdef eslDISTANCE_TESTDRIVE
 
@@ -1040,9 +1926,72 @@ utest_XJukesCantor(ESL_ALPHABET *abc, char **as, ESL_DSQ **ax, int N)
   return eslOK;
 
 }
+
+/* utest_bits()
+ * Bit-sliced pairwise identities must be identical to esl_dst_XPairId()'s,
+ * for DNA and protein, for lengths around 64-column word boundaries,
+ * with gaps, degenerate residues, and an all-gap row.
+ */
+static int
+utest_bits(ESL_RANDOMNESS *r)
+{
+  ESL_ALPHABET *abc   = NULL;
+  ESL_DST_BITS *b     = NULL;
+  ESL_DSQ     **ax    = NULL;
+  char         *s     = NULL;
+  int           N     = 12;
+  int           Lv[6] = { 0, 1, 63, 64, 65, 300 };
+  int           types[2] = { eslDNA, eslAMINO };
+  double        pid, pid2;
+  int           nid, nid2, n, n2;
+  int           t, v, i, j, k;
+  int           status;
+
+  ESL_ALLOC(ax, sizeof(ESL_DSQ *) * N);
+  ESL_ALLOC(s,  sizeof(char)      * 301);
+  for (t = 0; t < 2; t++)
+    {
+      abc = esl_alphabet_Create(types[t]);
+      for (v = 0; v < 6; v++)
+	{
+	  for (i = 0; i < N; i++)
+	    {
+	      for (k = 0; k < Lv[v]; k++)
+		s[k] = (i == 3 ? '-' : abc->sym[esl_rnd_Roll(r, abc->Kp)]);
+	      s[Lv[v]] = '\0';
+	      if (i % 4 == 1) for (k = 0; k < Lv[v]; k++) if (esl_rnd_Roll(r, 5)) s[k] = abc->sym[ax[i-1][k+1]]; /* some close pairs */
+	      esl_abc_CreateDsq(abc, s, &(ax[i]));
+	    }
+
+	  if (esl_dst_bits_Create(abc, ax, N, &b) != eslOK) abort();
+	  for (i = 0; i < N; i++)
+	    for (j = 0; j < N; j++)
+	      {
+		esl_dst_bits_PairId(b, i, j, &pid, &nid, &n);
+		esl_dst_XPairId(abc, ax[i], ax[j], &pid2, &nid2, &n2);
+		if (pid != pid2 || nid != nid2 || n != n2) abort();
+		if (esl_dst_bits_PairIdExceeds(b, i, j, pid)      != FALSE)                  abort();
+		if (esl_dst_bits_PairIdExceeds(b, i, j, pid-1e-9) != TRUE)                   abort();
+		if (esl_dst_bits_PairIdExceeds(b, i, j, 0.5)      != (pid > 0.5 ? TRUE : FALSE)) abort();
+		if (n > 0 && esl_dst_bits_NidAtLeast(b, i, j, nid)   != TRUE)               abort();
+		if (n > 0 && esl_dst_bits_NidAtLeast(b, i, j, nid+1) != FALSE)              abort();
+	      }
+	  esl_dst_bits_Destroy(b);
+	  for (i = 0; i < N; i++) free(ax[i]);
+	}
+      esl_alphabet_Destroy(abc);
+    }
+  free(ax);
+  free(s);
+  return eslOK;
+
+ ERROR:
+  return status;
+}
 #endif /*eslAUGMENT_ALPHABET*/
 
 
+
 #ifdef eslAUGMENT_DMATRIX
 static int 
 utest_CPairIdMx(char **as, int N)
@@ -1162,6 +2111,123 @@ utest_XJukesCantorMx(ESL_ALPHABET *abc, char **as, ESL_DSQ **ax, int N)
   esl_dmatrix_Destroy(V2);
   return eslOK;
 }
+
+/* utest_PairIdMxParallel()
+ * The tiled identity matrix must be identical to pairwise 
+ * <esl_dst_[CX]PairId()> results, for any number of threads, 
+ * on an alignment big enough to span several tiles and column
+ * chunks, with gaps, degenerate residues, and an all-gap row.
+ */
+static int
+same_pid(double a, double b)
+{
+  return ((isnan(a) && isnan(b)) || a == b);
+}
+
+static int
+utest_PairIdMxParallel(ESL_RANDOMNESS *r, ESL_ALPHABET *abc)
+{
+  int           N   = 2*eslDST_TILE + 7;
+  int           L   = eslDST_CHUNK + 333;
+  char        **as  = NULL;
+  ESL_DSQ     **ax  = NULL;
+  ESL_DMATRIX  *S   = NULL;
+  ESL_FSMATRIX *F   = NULL;
+  ESL_FSMATRIX *G   = NULL;
+  ESL_FSMATRIX *H   = NULL;
+  double        pid;
+  int           ncpu[3] = { 1, 2, 5 };
+  int           i, j, k, c;
+  int           status;
+
+  ESL_ALLOC(as, sizeof(char *)    * N);
+  ESL_ALLOC(ax, sizeof(ESL_DSQ *) * N);
+  for (i = 0; i < N; i++) 
+    {
+      ESL_ALLOC(as[i], sizeof(char) * (L+1));
+      for (k = 0; k < L; k++)
+	as[i][k] = (i == 5 ? '-' : "ACGTacgt--.N"[esl_rnd_Roll(r, 12)]);
+      as[i][L] = '\0';
+      if (i % 3 == 1) for (k = 0; k < L; k++) as[i][k] = (esl_rnd_Roll(r, 10) ? as[i-1][k] : as[i][k]); /* some close pairs */
+      esl_abc_CreateDsq(abc, as[i], &(ax[i]));
+    }
+
+  for (c = 0; c < 3; c++)
+    {
+      if (esl_dst_CPairIdMxParallel(as, N, ncpu[c], &S) != eslOK) abort();
+      for (i = 0; i < N; i++)
+	for (j = i+1; j < N; j++)
+	  {
+	    esl_dst_CPairId(as[i], as[j], &pid, NULL, NULL);
+	    if (! same_pid(S->mx[i][j], pid) || ! same_pid(S->mx[j][i], pid)) abort();
+	  }
+      esl_dmatrix_Destroy(S);
+
+      if (esl_dst_XPairIdMxParallel(abc, ax, N, ncpu[c], &S) != eslOK) abort();
+      for (i = 0; i < N; i++)
+	{
+	  if (S->mx[i][i] != 1.0) abort();
+	  for (j = i+1; j < N; j++)
+	    {
+	      esl_dst_XPairId(abc, ax[i], ax[j], &pid, NULL, NULL);
+	      if (S->mx[i][j] != pid || S->mx[j][i] != pid) abort();
+	    }
+	}
+      esl_dmatrix_Destroy(S);
+
+      if (esl_dst_XDiffMxParallel(abc, ax, N, ncpu[c], &S) != eslOK) abort();
+      for (i = 0; i < N; i++)
+	for (j = i+1; j < N; j++)
+	  {
+	    esl_dst_XPairId(abc, ax[i], ax[j], &pid, NULL, NULL);
+	    if (S->mx[i][j] != 1. - pid) abort();
+	  }
+      esl_dmatrix_Destroy(S);
+
+      /* Packed float versions: same values, rounded to float, in memory or mapped */
+      if ((F = esl_fsmatrix_Create(N))           == NULL)  abort();
+      if ((G = esl_fsmatrix_CreateMapped(N))     == NULL)  abort();
+      if (esl_dst_CPairIdFMx(as, N, ncpu[c], F) != eslOK) abort();
+      if (esl_dst_CDiffFMx  (as, N, ncpu[c], G) != eslOK) abort();
+      for (i = 0; i < N; i++)
+	{
+	  if (esl_fsmx_Get(F, i, i) != 1.0 || esl_fsmx_Get(G, i, i) != 0.0) abort();
+	  for (j = i+1; j < N; j++)
+	    {
+	      esl_dst_CPairId(as[i], as[j], &pid, NULL, NULL);
+	      if (! same_pid(esl_fsmx_Get(F, j, i), (float) pid))      abort();
+	      if (! same_pid(esl_fsmx_Get(G, i, j), (float) (1.-pid))) abort();
+	    }
+	}
+      esl_fsmatrix_Destroy(F);
+      esl_fsmatrix_Destroy(G);
+
+      if ((F = esl_fsmatrix_Create(N))                == NULL)  abort();
+      if ((G = esl_fsmatrix_Create(N))                == NULL)  abort();
+      if ((H = esl_fsmatrix_CreateMapped(N))          == NULL)  abort();
+      if (esl_dst_XPairIdFMx(abc, ax, N, ncpu[c], F) != eslOK) abort();
+      if (esl_dst_XDiffFMx  (abc, ax, N, ncpu[c], G) != eslOK) abort();
+      if (esl_dst_XDiffFMx  (abc, ax, N, ncpu[c], H) != eslOK) abort();
+      for (i = 0; i < N; i++)
+	for (j = i+1; j < N; j++)
+	  {
+	    esl_dst_XPairId(abc, ax[i], ax[j], &pid, NULL, NULL);
+	    if (esl_fsmx_Get(F, i, j) != (float) pid || esl_fsmx_Get(F, j, i) != (float) pid) abort();
+	    if (esl_fsmx_Get(G, i, j) != (float) (1. - pid))                                   abort();
+	  }
+      if (esl_fsmatrix_Compare(G, H, 0.) != eslOK) abort();
+      esl_fsmatrix_Destroy(F);
+      esl_fsmatrix_Destroy(G);
+      esl_fsmatrix_Destroy(H);
+    }
+
+  esl_Free2D((void **) as, N);
+  esl_Free2D((void **) ax, N);
+  return eslOK;
+
+ ERROR:
+  return status;
+}
 #endif /*eslAUGMENT_ALPHABET && eslAUGMENT_DMATRIX*/
 
 /*------------------ end of unit tests --------------------------*/
@@ -1170,7 +2236,7 @@ utest_XJukesCantorMx(ESL_ALPHABET *abc, char **as, ESL_DSQ **ax, int N)
 
 
 /*****************************************************************
- * 8. Test driver.
+ * 9. Test driver.
  *****************************************************************/ 
 
 /* 
@@ -1288,6 +2354,7 @@ main(int argc, char **argv)
 #ifdef eslAUGMENT_ALPHABET
   if (utest_XPairId(abc, as, ax, N)      != eslOK) return eslFAIL;
   if (utest_XJukesCantor(abc, as, ax, N) != eslOK) return eslFAIL;
+  if (utest_bits(r)                      != eslOK) return eslFAIL;
 #endif /*eslAUGMENT_ALPHABET*/
 
 #ifdef eslAUGMENT_DMATRIX
@@ -1300,6 +2367,7 @@ main(int argc, char **argv)
   if (utest_XPairIdMx(abc, as, ax, N)       != eslOK) return eslFAIL;
   if (utest_XDiffMx(abc, as, ax, N)         != eslOK) return eslFAIL;
   if (utest_XJukesCantorMx(abc, as, ax, N)  != eslOK) return eslFAIL;
+  if (utest_PairIdMxParallel(r, abc)        != eslOK) return eslFAIL;
 #endif
 
   esl_randomness_Destroy(r);
@@ -1319,7 +2387,7 @@ main(int argc, char **argv)
 
 
 /*****************************************************************
- * 9. Example.
+ * 10. Example.
  *****************************************************************/ 
 
 #ifdef eslDISTANCE_EXAMPLE
@@ -19,6 +19,24 @@
 #include "esl_random.h"  
 #endif
 
+/* ESL_DST_BITS: a digital alignment, bit-sliced for fast pairwise identity.
+ * 
+ * Row i is cut into nw words of 64 columns. Word w of row i is 
+ * (nplanes+1) uint64_t's, starting at bits + (i*nw + w) * (nplanes+1):
+ * first a mask of the columns holding canonical residues, then 
+ * residue bit planes 0..nplanes-1.
+ */
+#ifdef eslAUGMENT_ALPHABET
+typedef struct {
+  uint64_t *bits;		/* bit planes, as above                       */
+  int      *len;		/* [0..N-1] number of canonical residues      */
+  int       N;			/* number of sequences                        */
+  int64_t   L;			/* alignment length, in columns               */
+  int64_t   nw;			/* number of 64-column words per row          */
+  int       nplanes;		/* number of residue planes: ceil(log2(K))    */
+} ESL_DST_BITS;
+#endif
+
 /* 1. Pairwise distances for aligned text sequences.
  */
 extern int esl_dst_CPairId(const char *asq1, const char *asq2, 
@@ -40,7 +58,11 @@ extern int esl_dst_XJukesCantor(const ESL_ALPHABET *abc, const ESL_DSQ *ax, cons
  */
 #ifdef eslAUGMENT_DMATRIX
 extern int esl_dst_CPairIdMx     (char **as, int N, ESL_DMATRIX **ret_S);
+extern int esl_dst_CPairIdMxParallel(char **as, int N, int ncpu, ESL_DMATRIX **ret_S);
 extern int esl_dst_CDiffMx       (char **as, int N, ESL_DMATRIX **ret_D);
+extern int esl_dst_CDiffMxParallel  (char **as, int N, int ncpu, ESL_DMATRIX **ret_D);
+extern int esl_dst_CPairIdFMx    (char **as, int N, int ncpu, ESL_FSMATRIX *S);
+extern int esl_dst_CDiffFMx      (char **as, int N, int ncpu, ESL_FSMATRIX *D);
 extern int esl_dst_CJukesCantorMx(int K, char **as, int N, ESL_DMATRIX **opt_D, ESL_DMATRIX **opt_V);
 #endif
 
@@ -48,7 +70,11 @@ extern int esl_dst_CJukesCantorMx(int K, char **as, int N, ESL_DMATRIX **opt_D,
  */
 #if defined(eslAUGMENT_DMATRIX) && defined(eslAUGMENT_ALPHABET)
 extern int esl_dst_XPairIdMx(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, ESL_DMATRIX **ret_S);
+extern int esl_dst_XPairIdMxParallel(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int ncpu, ESL_DMATRIX **ret_S);
 extern int esl_dst_XDiffMx  (const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, ESL_DMATRIX **ret_D);
+extern int esl_dst_XDiffMxParallel  (const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int ncpu, ESL_DMATRIX **ret_D);
+extern int esl_dst_XPairIdFMx(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int ncpu, ESL_FSMATRIX *S);
+extern int esl_dst_XDiffFMx  (const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int ncpu, ESL_FSMATRIX *D);
 
 extern int esl_dst_XJukesCantorMx(const ESL_ALPHABET *abc, ESL_DSQ **ax, int nseq, 
 				  ESL_DMATRIX **opt_D, ESL_DMATRIX **opt_V);
@@ -63,6 +89,17 @@ extern int esl_dst_CAverageId(char **as, int nseq, int max_comparisons, double *
 extern int esl_dst_XAverageId(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int max_comparisons, double *ret_id);
 #endif
 
+/* 6. Bit-parallel pairwise identity for digital alignments.
+ */
+extern int  esl_dst_NidThreshold(int n, double maxid);
+#ifdef eslAUGMENT_ALPHABET
+extern int  esl_dst_bits_Create (const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, ESL_DST_BITS **ret_b);
+extern int  esl_dst_bits_PairId (const ESL_DST_BITS *b, int i, int j, double *opt_pid, int *opt_nid, int *opt_n);
+extern int  esl_dst_bits_PairIdExceeds(const ESL_DST_BITS *b, int i, int j, double maxid);
+extern int  esl_dst_bits_NidAtLeast(const ESL_DST_BITS *b, int i, int j, int need);
+extern void esl_dst_bits_Destroy(ESL_DST_BITS *b);
+#endif
+
 
 #endif /*eslDISTANCE_INCLUDED*/
 /*****************************************************************
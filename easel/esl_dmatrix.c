@@ -1,20 +1,22 @@
 /* Linear algebra operations in double-precision matrices.
  * 
- * Implements ESL_DMATRIX (double-precision matrix) and 
+ * Implements ESL_DMATRIX (double-precision matrix),
+ * ESL_FSMATRIX (packed symmetric float matrix), and
  * ESL_PERMUTATION (permutation matrix) objects.
  * 
  * Table of contents:
  *   1. The ESL_DMATRIX object
  *   2. Debugging/validation code for ESL_DMATRIX
- *   3. The ESL_PERMUTATION object
- *   4. Debugging/validation code for ESL_PERMUTATION
- *   5. The rest of the dmatrix API
- *   6. Optional: Interoperability with GSL
- *   7. Optional: Interfaces to LAPACK
- *   8. Unit tests
- *   9. Test driver
- *  10. Examples
- *  11. Copyright and license 
+ *   3. The ESL_FSMATRIX object (packed symmetric floats)
+ *   4. The ESL_PERMUTATION object
+ *   5. Debugging/validation code for ESL_PERMUTATION
+ *   6. The rest of the dmatrix API
+ *   7. Optional: Interoperability with GSL
+ *   8. Optional: Interfaces to LAPACK
+ *   9. Unit tests
+ *  10. Test driver
+ *  11. Examples
+ *  12. Copyright and license 
  *
  * To do:
  *   - eventually probably want additional matrix types
@@ -27,6 +29,13 @@
 #include <string.h>
 #include <math.h>
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef _POSIX_VERSION
+#include <sys/mman.h>
+#endif
+
 #include "easel.h"
 #include "esl_vectorops.h"
 #include "esl_dmatrix.h"
@@ -422,7 +431,233 @@ esl_dmatrix_Dump(FILE *ofp, const ESL_DMATRIX *A, const char *rowlabel, const ch
 }
 
 /*****************************************************************
- * 3. The ESL_PERMUTATION object.
+ * 3. The ESL_FSMATRIX object.
+ *****************************************************************/
+
+/* Function:  esl_fsmatrix_Create()
+ *
+ * Purpose:   Creates a packed symmetric <n> x <n> matrix of floats.
+ *            Values in the matrix are uninitialized.
+ *            
+ *            Only the $n(n+1)/2$ cells $i \leq j$ are stored. Use
+ *            <esl_fsmx_Get()> and <esl_fsmx_Set()> to access cell
+ *            <i,j>, in either order; or <A->mx[esl_fsmx_Index(A,i,j)]>
+ *            directly.
+ *
+ * Returns:   a pointer to the new <ESL_FSMATRIX> object. Caller
+ *            frees with <esl_fsmatrix_Destroy()>.
+ *
+ * Throws:    <NULL> if an allocation failed.
+ */
+ESL_FSMATRIX *
+esl_fsmatrix_Create(int n)
+{
+  ESL_FSMATRIX *A = NULL;
+  int           status;
+
+  ESL_ALLOC(A, sizeof(ESL_FSMATRIX));
+  A->mx       = NULL;
+  A->n        = n;
+  A->ncells   = (int64_t) n * (n+1) / 2;
+  A->is_tiled = FALSE;
+  A->ntiles   = 0;
+  A->fp       = NULL;
+
+  ESL_ALLOC(A->mx, sizeof(float) * ESL_MAX(1, A->ncells));
+  return A;
+
+ ERROR:
+  esl_fsmatrix_Destroy(A);
+  return NULL;
+}
+
+/* Function:  esl_fsmatrix_CreateMapped()
+ *
+ * Purpose:   Creates a packed symmetric <n> x <n> matrix of floats
+ *            that lives in a memory-mapped scratch file instead of
+ *            in RAM, for distance matrices too big for memory.  The
+ *            operating system pages parts of the matrix in and out
+ *            as they're used. Values in the matrix are initialized
+ *            to 0.
+ *            
+ *            The scratch file is opened by <esl_tmpfile()>, so it is
+ *            created in the directory named by the <TMPDIR>
+ *            environment variable (or </tmp>), and it disappears when
+ *            the matrix is destroyed or the process exits. That
+ *            directory needs room for about $2n^2$ bytes.
+ *            
+ *            The matrix is stored in square tiles of
+ *            <eslFSMATRIX_TILE> x <eslFSMATRIX_TILE> cells (4KB
+ *            pages), so nearby rows and columns share pages: scanning
+ *            a row or a column touches about <n/eslFSMATRIX_TILE>
+ *            pages. Access it the same way as an in-memory
+ *            <ESL_FSMATRIX>, with <esl_fsmx_Get()>, <esl_fsmx_Set()>,
+ *            <esl_fsmx_Index()>.
+ *
+ * Returns:   a pointer to the new <ESL_FSMATRIX> object. Caller
+ *            frees with <esl_fsmatrix_Destroy()>.
+ *
+ * Throws:    <NULL> if an allocation, the scratch file, or the
+ *            memory mapping fails, or if memory mapping isn't
+ *            available on this system.
+ */
+ESL_FSMATRIX *
+esl_fsmatrix_CreateMapped(int n)
+{
+#ifdef _POSIX_VERSION
+  ESL_FSMATRIX *A           = NULL;
+  char          tmpfile[16] = "esltmpXXXXXX";
+  void         *p;
+  int           status;
+
+  ESL_ALLOC(A, sizeof(ESL_FSMATRIX));
+  A->mx       = NULL;
+  A->n        = n;
+  A->is_tiled = TRUE;
+  A->ntiles   = (n + eslFSMATRIX_TILE - 1) / eslFSMATRIX_TILE;
+  A->ncells   = ((int64_t) A->ntiles * (A->ntiles+1) / 2) * eslFSMATRIX_TILE * eslFSMATRIX_TILE;
+  A->fp       = NULL;
+
+  if ((status = esl_tmpfile(tmpfile, &(A->fp))) != eslOK) goto ERROR;
+  if (ftruncate(fileno(A->fp), (off_t) (sizeof(float) * ESL_MAX(1, A->ncells))) != 0)
+    ESL_XEXCEPTION_SYS(eslESYS, "ftruncate() failed on matrix scratch file");
+  p = mmap(NULL, sizeof(float) * ESL_MAX(1, A->ncells), PROT_READ | PROT_WRITE, MAP_SHARED, fileno(A->fp), 0);
+  if (p == MAP_FAILED) ESL_XEXCEPTION_SYS(eslESYS, "mmap() failed on matrix scratch file");
+  A->mx = (float *) p;
+  return A;
+
+ ERROR:
+  esl_fsmatrix_Destroy(A);
+  return NULL;
+#else
+  esl_exception(eslEUNIMPLEMENTED, FALSE, __FILE__, __LINE__, "memory mapping isn't available on this system");
+  return NULL;
+#endif
+}
+
+/* Function:  esl_fsmatrix_CreateFromDMatrix()
+ *
+ * Purpose:   Creates a packed symmetric float matrix from the upper
+ *            triangle (cells $i \leq j$) of square matrix <D>, which
+ *            may be a general or packed upper <ESL_DMATRIX>.
+ *
+ * Returns:   a pointer to the new <ESL_FSMATRIX> object. Caller
+ *            frees with <esl_fsmatrix_Destroy()>.
+ *
+ * Throws:    <NULL> if an allocation failed.
+ */
+ESL_FSMATRIX *
+esl_fsmatrix_CreateFromDMatrix(const ESL_DMATRIX *D)
+{
+  ESL_FSMATRIX *A = NULL;
+  int           i, j;
+
+  ESL_DASSERT1(( D->n == D->m ));
+  if ((A = esl_fsmatrix_Create(D->n)) == NULL) return NULL;
+  for (i = 0; i < D->n; i++)
+    for (j = i; j < D->n; j++)
+      esl_fsmx_Set(A, i, j, (float) D->mx[i][j]);
+  return A;
+}
+
+/* Function:  esl_fsmatrix_ToDMatrix()
+ *
+ * Purpose:   Unpack symmetric float matrix <A> into a new, general
+ *            <A->n> x <A->n> double-precision matrix, and return it
+ *            in <*ret_D>.
+ *
+ * Returns:   <eslOK> on success. Caller frees <*ret_D> with
+ *            <esl_dmatrix_Destroy()>.
+ *
+ * Throws:    <eslEMEM> on allocation failure, and <*ret_D> is <NULL>.
+ */
+int
+esl_fsmatrix_ToDMatrix(const ESL_FSMATRIX *A, ESL_DMATRIX **ret_D)
+{
+  ESL_DMATRIX *D = NULL;
+  int          i, j;
+
+  if ((D = esl_dmatrix_Create(A->n, A->n)) == NULL) { *ret_D = NULL; return eslEMEM; }
+  for (i = 0; i < A->n; i++)
+    for (j = i; j < A->n; j++)
+      D->mx[i][j] = D->mx[j][i] = esl_fsmx_Get(A, i, j);
+  *ret_D = D;
+  return eslOK;
+}
+
+/* Function:  esl_fsmatrix_Compare()
+ *
+ * Purpose:   Compares symmetric matrix <A> to <B> element by element,
+ *            using <esl_FCompare()> with fractional tolerance <tol>.
+ *            If all elements are equal, return <eslOK>; if any
+ *            elements differ, or the matrices aren't the same size,
+ *            return <eslFAIL>. <A> and <B> may be stored differently
+ *            (in memory or memory-mapped).
+ */
+int
+esl_fsmatrix_Compare(const ESL_FSMATRIX *A, const ESL_FSMATRIX *B, float tol)
+{
+  int i, j;
+
+  if (A->n != B->n) return eslFAIL;
+  for (i = 0; i < A->n; i++)
+    for (j = i; j < A->n; j++)
+      if (esl_FCompare(esl_fsmx_Get(A, i, j), esl_fsmx_Get(B, i, j), tol) == eslFAIL) return eslFAIL;
+  return eslOK;
+}
+
+/* Function:  esl_fsmatrix_Set()
+ *
+ * Purpose:   Set all elements $a_{ij}$ in matrix <A> to <x>.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+esl_fsmatrix_Set(ESL_FSMATRIX *A, float x)
+{
+  int64_t c;
+
+  for (c = 0; c < A->ncells; c++) A->mx[c] = x;
+  return eslOK;
+}
+
+/* Function:  esl_fsmatrix_SetZero()
+ *
+ * Purpose:   Sets all elements of <A> to 0.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+esl_fsmatrix_SetZero(ESL_FSMATRIX *A)
+{
+  memset(A->mx, 0, sizeof(float) * A->ncells);
+  return eslOK;
+}
+
+/* Function:  esl_fsmatrix_Destroy()
+ *
+ * Purpose:   Frees an <ESL_FSMATRIX> object <A>. If it's memory-mapped,
+ *            unmaps it and closes (thus removes) its scratch file.
+ */
+void
+esl_fsmatrix_Destroy(ESL_FSMATRIX *A)
+{
+  if (A == NULL) return;
+  if (A->fp != NULL)
+    {
+#ifdef _POSIX_VERSION
+      if (A->mx != NULL) munmap(A->mx, sizeof(float) * ESL_MAX(1, A->ncells));
+#endif
+      fclose(A->fp);
+    }
+  else if (A->mx != NULL) free(A->mx);
+  free(A);
+}
+/*------------------ end, ESL_FSMATRIX --------------------------*/
+
+
+/*****************************************************************
+ * 4. The ESL_PERMUTATION object.
  *****************************************************************/
 
 /* Function:  esl_permutation_Create()
@@ -491,7 +726,7 @@ esl_permutation_Reuse(ESL_PERMUTATION *P)
 
 
 /*****************************************************************
- * 4. Debugging/validation for ESL_PERMUTATION.
+ * 5. Debugging/validation for ESL_PERMUTATION.
  *****************************************************************/
 
 /* Function:  esl_permutation_Dump()
@@ -537,7 +772,7 @@ esl_permutation_Dump(FILE *ofp, const ESL_PERMUTATION *P, const char *rowlabel,
 }
 
 /*****************************************************************
- * 5. The rest of the dmatrix API.
+ * 6. The rest of the dmatrix API.
  *****************************************************************/
 
 
@@ -1127,7 +1362,7 @@ esl_dmx_Invert(const ESL_DMATRIX *A, ESL_DMATRIX *Ai)
 
 
 /*****************************************************************
- * 6. Optional: interoperability with GSL
+ * 7. Optional: interoperability with GSL
  *****************************************************************/
 #ifdef HAVE_LIBGSL
 
@@ -1166,7 +1401,7 @@ esl_dmx_UnmorphGSL(const gsl_matrix *G, ESL_DMATRIX **ret_E)
 #endif /*HAVE_LIBGSL*/
 
 /*****************************************************************
- * 7. Optional: Interfaces to LAPACK
+ * 8. Optional: Interfaces to LAPACK
  *****************************************************************/
 #ifdef HAVE_LIBLAPACK
 
@@ -1308,9 +1543,10 @@ esl_dmx_Diagonalize(const ESL_DMATRIX *A, double **ret_Er, double **ret_Ei,
 #endif /*HAVE_LIBLAPACK*/
 
 /*****************************************************************
- * 8. Unit tests
+ * 9. Unit tests
  *****************************************************************/ 
 #ifdef eslDMATRIX_TESTDRIVE
+#include "esl_random.h"
 
 static void 
 utest_misc_ops(void)
@@ -1369,12 +1605,100 @@ utest_Invert(ESL_DMATRIX *A)
 }
 
 
+/* utest_fsmatrix():
+ * cells of a packed symmetric matrix are distinct, and are the same
+ * either way around; conversion to and from ESL_DMATRIX round trips.
+ */
+static void
+utest_fsmatrix(ESL_RANDOMNESS *r, int n)
+{
+  char         *msg = "ESL_FSMATRIX unit test failed";
+  ESL_FSMATRIX *A   = NULL;
+  ESL_FSMATRIX *B   = NULL;
+  ESL_DMATRIX  *D   = NULL;
+  int           i, j;
+
+  if ((A = esl_fsmatrix_Create(n))                    == NULL)  esl_fatal(msg);
+  if (A->ncells != (int64_t) n * (n+1) / 2)                     esl_fatal(msg);
+  if (esl_fsmatrix_SetZero(A)                         != eslOK) esl_fatal(msg);
+  for (i = 0; i < n; i++)
+    for (j = i; j < n; j++)
+      {
+	if (esl_fsmx_Get(A, i, j) != 0.)                        esl_fatal(msg); /* each cell set only once */
+	esl_fsmx_Set(A, j, i, (float) (i * n + j + 1));
+      }
+  for (i = 0; i < n; i++)
+    for (j = 0; j < n; j++)
+      if (esl_fsmx_Get(A, i, j) != (float) (ESL_MIN(i,j) * n + ESL_MAX(i,j) + 1)) esl_fatal(msg);
+
+  for (i = 0; i < A->ncells; i++) A->mx[i] = esl_random(r);
+  if (esl_fsmatrix_ToDMatrix(A, &D)                   != eslOK) esl_fatal(msg);
+  for (i = 0; i < n; i++)
+    for (j = 0; j < n; j++)
+      if (D->mx[i][j] != esl_fsmx_Get(A, i, j))                 esl_fatal(msg);
+  if ((B = esl_fsmatrix_CreateFromDMatrix(D))         == NULL)  esl_fatal(msg);
+  if (esl_fsmatrix_Compare(A, B, 0.)                  != eslOK) esl_fatal(msg);
+  esl_fsmx_Set(B, n-1, 0, esl_fsmx_Get(B, 0, n-1) + 1.);
+  if (esl_fsmatrix_Compare(A, B, 1e-6)                != eslFAIL) esl_fatal(msg);
+
+  esl_fsmatrix_Destroy(A);
+  esl_fsmatrix_Destroy(B);
+  esl_dmatrix_Destroy(D);
+}
+
+/* utest_fsmatrix_mapped():
+ * a memory-mapped, tiled matrix starts zeroed, maps each cell i<=j to
+ * a distinct index, and holds the same values as an in-memory one.
+ */
+static void
+utest_fsmatrix_mapped(ESL_RANDOMNESS *r, int n)
+{
+  char         *msg  = "mapped ESL_FSMATRIX unit test failed";
+  ESL_FSMATRIX *A    = NULL;
+  ESL_FSMATRIX *B    = NULL;
+  ESL_DMATRIX  *D    = NULL;
+  char         *seen = NULL;
+  int64_t       c;
+  int           i, j;
+
+  if ((A = esl_fsmatrix_CreateMapped(n))              == NULL)  esl_fatal(msg);
+  if (! A->is_tiled || A->ncells % (eslFSMATRIX_TILE * eslFSMATRIX_TILE) != 0) esl_fatal(msg);
+  if ((seen = calloc(A->ncells, sizeof(char)))        == NULL)  esl_fatal(msg);
+  for (i = 0; i < n; i++)
+    for (j = i; j < n; j++)
+      {
+	c = esl_fsmx_Index(A, j, i);
+	if (c < 0 || c >= A->ncells || seen[c])                 esl_fatal(msg);
+	if (c != esl_fsmx_Index(A, i, j))                       esl_fatal(msg);
+	if (A->mx[c] != 0.)                                     esl_fatal(msg);
+	seen[c] = 1;
+	esl_fsmx_Set(A, i, j, (float) esl_random(r));
+      }
+
+  if (esl_fsmatrix_ToDMatrix(A, &D)                   != eslOK) esl_fatal(msg);
+  for (i = 0; i < n; i++)
+    for (j = 0; j < n; j++)
+      if (D->mx[i][j] != esl_fsmx_Get(A, i, j))                 esl_fatal(msg);
+  if ((B = esl_fsmatrix_CreateFromDMatrix(D))         == NULL)  esl_fatal(msg);
+  if (esl_fsmatrix_Compare(A, B, 0.)                  != eslOK) esl_fatal(msg);
+  esl_fsmx_Set(A, n-1, 0, esl_fsmx_Get(B, 0, n-1) + 1.);
+  if (esl_fsmatrix_Compare(B, A, 1e-6)                != eslFAIL) esl_fatal(msg);
+  if (esl_fsmatrix_Set(A, 0.5)                        != eslOK) esl_fatal(msg);
+  if (esl_fsmx_Get(A, n-1, n/2)                       != 0.5)   esl_fatal(msg);
+
+  free(seen);
+  esl_fsmatrix_Destroy(A);
+  esl_fsmatrix_Destroy(B);
+  esl_dmatrix_Destroy(D);
+}
+
+
 #endif /*eslDMATRIX_TESTDRIVE*/
 
 
 
 /*****************************************************************
- * 9. Test driver
+ * 10. Test driver
  *****************************************************************/ 
 
 /*   gcc -g -Wall -o test -I. -L. -DeslDMATRIX_TESTDRIVE esl_dmatrix.c -leasel -lm
@@ -1402,6 +1726,11 @@ int main(void)
 
   utest_misc_ops();
   utest_Invert(A);
+  utest_fsmatrix(r, n);
+  utest_fsmatrix(r, 1);
+  utest_fsmatrix_mapped(r, 100);
+  utest_fsmatrix_mapped(r, eslFSMATRIX_TILE);
+  utest_fsmatrix_mapped(r, 1);
 
   esl_randomness_Destroy(r);
   esl_dmatrix_Destroy(A);
@@ -1411,7 +1740,7 @@ int main(void)
 
 
 /*****************************************************************
- * 10. Examples
+ * 11. Examples
  *****************************************************************/ 
 
 /*   gcc -g -Wall -o example -I. -DeslDMATRIX_EXAMPLE esl_dmatrix.c easel.c -lm
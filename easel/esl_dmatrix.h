@@ -8,6 +8,7 @@
 #define eslDMATRIX_INCLUDED
 
 #include <stdio.h>
+#include <stdint.h>
 
 typedef struct {
   /*mx, mx[0] are allocated. */
@@ -25,6 +26,49 @@ typedef struct {
   int      n;
 } ESL_PERMUTATION;
 
+/* Object: ESL_FSMATRIX
+ *
+ * A symmetric nxn matrix of floats, such as a pairwise distance
+ * matrix, packed so only cells i <= j are stored: n(n+1)/2 floats,
+ * 1/4 the size of an nxn ESL_DMATRIX. Get and set cells with
+ * esl_fsmx_Get(), esl_fsmx_Set(), which take i,j in either order.
+ *
+ * An in-memory matrix (esl_fsmatrix_Create()) is packed row by
+ * row. A memory-mapped matrix (esl_fsmatrix_CreateMapped()), for
+ * matrices bigger than RAM, is packed in square tiles of
+ * eslFSMATRIX_TILE x eslFSMATRIX_TILE cells, one 4KB page each,
+ * tile by tile along rows of tiles; a row or column scan then
+ * touches n/eslFSMATRIX_TILE pages instead of n.
+ */
+#define eslFSMATRIX_TILESHIFT 5
+#define eslFSMATRIX_TILE      (1 << eslFSMATRIX_TILESHIFT)  /* 32 x 32 floats = 4096 bytes */
+
+typedef struct {
+  float   *mx;			/* packed upper triangle [0..ncells-1], see esl_fsmx_Index() */
+  int      n;			/* rows = columns */
+  int64_t  ncells;		/* n(n+1)/2 if packed by rows; nt(nt+1)/2 tiles of cells if tiled */
+  int      is_tiled;		/* TRUE if packed in tiles                                */
+  int      ntiles;		/* if tiled: nt, number of tiles on each side             */
+  FILE    *fp;			/* if mapped: open, unlinked scratch file backing <mx>; else NULL */
+} ESL_FSMATRIX;
+
+/* index of cell (i,j) or (j,i) in <A->mx> */
+static inline int64_t
+esl_fsmx_Index(const ESL_FSMATRIX *A, int i, int j)
+{
+  int64_t ti, tj;
+
+  if (i > j) { int tmp = i; i = j; j = tmp; }
+  if (! A->is_tiled) return (int64_t) i * A->n - (int64_t) i * (i-1) / 2 + (j - i);
+
+  ti = i >> eslFSMATRIX_TILESHIFT;
+  tj = j >> eslFSMATRIX_TILESHIFT;
+  return ((ti * A->ntiles - ti * (ti-1) / 2 + (tj - ti)) << (2 * eslFSMATRIX_TILESHIFT))
+    + ((i & (eslFSMATRIX_TILE-1)) << eslFSMATRIX_TILESHIFT) + (j & (eslFSMATRIX_TILE-1));
+}
+static inline float esl_fsmx_Get(const ESL_FSMATRIX *A, int i, int j)    { return A->mx[esl_fsmx_Index(A, i, j)]; }
+static inline void  esl_fsmx_Set(ESL_FSMATRIX *A, int i, int j, float x) { A->mx[esl_fsmx_Index(A, i, j)] = x;    }
+
 /* 1. The ESL_DMATRIX object. */
 extern ESL_DMATRIX *esl_dmatrix_Create(int n, int m);
 extern ESL_DMATRIX *esl_dmatrix_CreateUpper(int n);
@@ -41,16 +85,26 @@ extern int          esl_dmatrix_SetIdentity(ESL_DMATRIX *A);
 extern int          esl_dmatrix_Dump(FILE *ofp, const ESL_DMATRIX *A, 
 				     const char *rowlabel, const char *collabel);
 
-/* 3. The ESL_PERMUTATION object. */
+/* 3. The ESL_FSMATRIX object. */
+extern ESL_FSMATRIX *esl_fsmatrix_Create(int n);
+extern ESL_FSMATRIX *esl_fsmatrix_CreateMapped(int n);
+extern ESL_FSMATRIX *esl_fsmatrix_CreateFromDMatrix(const ESL_DMATRIX *D);
+extern int           esl_fsmatrix_ToDMatrix(const ESL_FSMATRIX *A, ESL_DMATRIX **ret_D);
+extern int           esl_fsmatrix_Compare(const ESL_FSMATRIX *A, const ESL_FSMATRIX *B, float tol);
+extern int           esl_fsmatrix_Set(ESL_FSMATRIX *A, float x);
+extern int           esl_fsmatrix_SetZero(ESL_FSMATRIX *A);
+extern void          esl_fsmatrix_Destroy(ESL_FSMATRIX *A);
+
+/* 4. The ESL_PERMUTATION object. */
 extern ESL_PERMUTATION *esl_permutation_Create(int n);
 extern int              esl_permutation_Destroy(ESL_PERMUTATION *P);
 extern int              esl_permutation_Reuse(ESL_PERMUTATION *P);
 
-/* 4. Debugging/validation for ESL_PERMUTATION. */
+/* 5. Debugging/validation for ESL_PERMUTATION. */
 extern int              esl_permutation_Dump(FILE *ofp, const ESL_PERMUTATION *P, 
 					     const char *rowlabel, const char *collabel);
 
-/* 5. The rest of the dmatrix API. */
+/* 6. The rest of the dmatrix API. */
 extern double       esl_dmx_Max    (const ESL_DMATRIX *A);
 extern double       esl_dmx_Min    (const ESL_DMATRIX *A);
 extern double       esl_dmx_Sum    (const ESL_DMATRIX *A);
@@ -67,14 +121,14 @@ extern int          esl_dmx_LUP_decompose(ESL_DMATRIX *A, ESL_PERMUTATION *P);
 extern int          esl_dmx_LU_separate(const ESL_DMATRIX *LU, ESL_DMATRIX *L, ESL_DMATRIX *U);
 extern int          esl_dmx_Invert(const ESL_DMATRIX *A, ESL_DMATRIX *Ai);
 
-/* 6. Optional: interoperability with GSL */
+/* 7. Optional: interoperability with GSL */
 #ifdef HAVE_LIBGSL
 #include <gsl/gsl_matrix.h>
 extern int          esl_dmx_MorphGSL(const ESL_DMATRIX *E, gsl_matrix **ret_G);
 extern int          esl_dmx_UnmorphGSL(const gsl_matrix *G, ESL_DMATRIX **ret_E);
 #endif
 
-/* 7. Optional: interfaces to LAPACK  */
+/* 8. Optional: interfaces to LAPACK  */
 #ifdef HAVE_LIBLAPACK
 extern int esl_dmx_Diagonalize(const ESL_DMATRIX *A, double **ret_Er, double **ret_Ei, ESL_DMATRIX **ret_UL, ESL_DMATRIX **ret_UR);
 #endif
@@ -17,16 +17,40 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <limits.h>
 
 #include "easel.h"
 #include "esl_mem.h"
 #include "esl_keyhash.h"
 
 static ESL_KEYHASH *keyhash_create(uint32_t hashsize, int init_key_alloc, int init_string_alloc);
-static uint32_t     jenkins_hash(const char *key, esl_pos_t n, uint32_t hashsize);
+static uint32_t     jenkins_hash(const char *key, esl_pos_t n);
+static int          key_probe(const ESL_KEYHASH *kh, const char *key, esl_pos_t n, uint32_t h, uint32_t *ret_pos, uint32_t *ret_d);
+static void         key_insert(ESL_KEYHASH *kh, uint32_t pos, uint32_t d, uint32_t h, int idx);
 static int          key_upsize(ESL_KEYHASH *kh);
 
+/* Largest table we'll grow to: 2^30 slots. Beyond that, keys (int
+ * indices) would run out before the table does.
+ */
+#define eslKEYHASH_MAXSIZE (1U<<30)
+
+/* Maximum load: grow the table when nkeys/hashsize would exceed 3/4.
+ * Robin Hood probing keeps expected probe lengths short up to much
+ * higher loads than this, but misses get slower as load rises.
+ */
+#define KEYHASH_FULL(kh, nk) ((uint64_t) (nk) * 4 > (uint64_t) (kh)->hashsize * 3)
+
+/* Keys per group in esl_keyhash_LookupBatch(): we hash a whole group
+ * and prefetch all their home slots before probing any of them, so
+ * the cache misses of one group overlap.
+ */
+#define eslKEYHASH_BATCH 16
+
+#if defined(__GNUC__)
+#define KEYHASH_PREFETCH(p) __builtin_prefetch((p), 0, 1)
+#else
+#define KEYHASH_PREFETCH(p) 
+#endif
+
 
 /*****************************************************************
  *# 1. The <ESL_KEYHASH> object
@@ -40,13 +64,13 @@ static int          key_upsize(ESL_KEYHASH *kh);
  *            
  * Throws:    <NULL> on allocation failure.
  *            
- * Note:      128*sizeof(int)*3 + 2048*sizeof(char) + sizeof(ESL_KEYHASH):
- *            about 2400 bytes for an initial KEYHASH.
+ * Note:      256*8 + 128*sizeof(int) + 2048*sizeof(char) + sizeof(ESL_KEYHASH):
+ *            about 4600 bytes for an initial KEYHASH.
  */
 ESL_KEYHASH *
 esl_keyhash_Create(void)
 {
-  return keyhash_create(128,   /* initial hash table size (power of 2)              */
+  return keyhash_create(256,   /* initial hash table size (power of 2)              */
 			128,   /* initial alloc for up to 128 keys                  */
 			2048); /* initial alloc for keys totalling up to 2048 chars */
 }
@@ -65,7 +89,9 @@ esl_keyhash_Create(void)
  *            use a customized allocation is when you're trying to
  *            minimize memory footprint and you expect your keyhash to
  *            be smaller than the default (of up to 128 keys, of total
- *            length up to 2048).
+ *            length up to 2048), or to avoid rehashing when you know
+ *            you're about to store a great many keys. The table
+ *            holds up to 3/4 <hashsize> keys before it grows.
  *
  * Throws:    <NULL> on allocation failure.
  */
@@ -88,18 +114,11 @@ ESL_KEYHASH *
 esl_keyhash_Clone(const ESL_KEYHASH *kh)
 {
   ESL_KEYHASH *nw;		
-  int          h;
 
   if ((nw = keyhash_create(kh->hashsize, kh->kalloc, kh->salloc)) == NULL) goto ERROR;
 
-  for (h = 0; h < kh->hashsize; h++)
-    nw->hashtable[h] = kh->hashtable[h];
-
-  for (h = 0; h < kh->nkeys; h++)  
-    {
-      nw->nxt[h]        = kh->nxt[h];
-      nw->key_offset[h] = kh->key_offset[h];
-    }
+  memcpy(nw->hashtable,  kh->hashtable,  sizeof(ESL_KEYHASH_SLOT) * kh->hashsize);
+  memcpy(nw->key_offset, kh->key_offset, sizeof(int)              * kh->nkeys);
   nw->nkeys = kh->nkeys;
 
   memcpy(nw->smem, kh->smem, sizeof(char) * kh->sn);
@@ -147,9 +166,9 @@ esl_keyhash_Sizeof(const ESL_KEYHASH *kh)
   size_t n = 0;
 
   n += sizeof(ESL_KEYHASH);
-  n += sizeof(int)  * kh->hashsize;
-  n += sizeof(int)  * kh->kalloc * 2;
-  n += sizeof(char) * kh->salloc;
+  n += sizeof(ESL_KEYHASH_SLOT) * kh->hashsize;
+  n += sizeof(int)              * kh->kalloc;
+  n += sizeof(char)             * kh->salloc;
   return n;
 }
 
@@ -164,9 +183,9 @@ esl_keyhash_Sizeof(const ESL_KEYHASH *kh)
 int 
 esl_keyhash_Reuse(ESL_KEYHASH *kh)
 {
-  int i;
+  uint32_t i;
 
-  for (i = 0; i < kh->hashsize; i++) kh->hashtable[i] = -1;
+  for (i = 0; i < kh->hashsize; i++) kh->hashtable[i].idx = -1;
   kh->nkeys = 0;
   kh->sn = 0;
   return eslOK;
@@ -187,7 +206,6 @@ esl_keyhash_Destroy(ESL_KEYHASH *kh)
   if (kh == NULL) return;	
   if (kh->hashtable  != NULL) free(kh->hashtable);
   if (kh->key_offset != NULL) free(kh->key_offset);
-  if (kh->nxt        != NULL) free(kh->nxt);
   if (kh->smem       != NULL) free(kh->smem);
   free(kh);
 }
@@ -203,28 +221,27 @@ esl_keyhash_Destroy(ESL_KEYHASH *kh)
 void
 esl_keyhash_Dump(FILE *fp, const ESL_KEYHASH *kh)
 {
-  int idx;
-  int h;
-  int nkeys;
-  int nempty  = 0;
-  int maxkeys = -1;
-  int minkeys = INT_MAX;
+  uint32_t mask   = kh->hashsize - 1;
+  uint32_t h;
+  uint32_t d;
+  uint32_t maxd   = 0;
+  uint64_t totd   = 0;
+  int      nempty = 0;
 
   for (h = 0; h < kh->hashsize; h++)
     {
-      for (nkeys = 0, idx = kh->hashtable[h]; idx != -1; idx = kh->nxt[idx]) nkeys++;
-
-      if (nkeys == 0)      nempty++;
-      if (nkeys > maxkeys) maxkeys = nkeys;
-      if (nkeys < minkeys) minkeys = nkeys;
+      if (kh->hashtable[h].idx == -1) { nempty++; continue; }
+      d     = (h - kh->hashtable[h].hash) & mask;
+      totd += d;
+      if (d > maxd) maxd = d;
     }
 
   fprintf(fp, "Total keys:             %d\n", kh->nkeys);
-  fprintf(fp, "Hash table size:        %d\n", kh->hashsize);
+  fprintf(fp, "Hash table size:        %u\n", kh->hashsize);
   fprintf(fp, "Average occupancy:      %.2f\n", (float) kh->nkeys /(float) kh->hashsize);
   fprintf(fp, "Unoccupied slots:       %d\n", nempty);
-  fprintf(fp, "Most in one slot:       %d\n", maxkeys);
-  fprintf(fp, "Least in one slot:      %d\n", minkeys);
+  fprintf(fp, "Mean probe distance:    %.2f\n", kh->nkeys ? (float) totd / (float) kh->nkeys : 0.);
+  fprintf(fp, "Max probe distance:     %u\n", maxd);
   fprintf(fp, "Keys allocated for:     %d\n", kh->kalloc);
   fprintf(fp, "Key string space alloc: %d\n", kh->salloc);
   fprintf(fp, "Key string space used:  %d\n", kh->sn);
@@ -261,25 +278,33 @@ esl_keyhash_Dump(FILE *fp, const ESL_KEYHASH *kh)
 int
 esl_keyhash_Store(ESL_KEYHASH *kh, const char *key, esl_pos_t n, int *opt_index)
 {
-  uint32_t val = jenkins_hash(key, n, kh->hashsize);
-  int idx;
-  int status;
+  uint32_t h;
+  uint32_t pos, d;
+  int      idx;
+  int      status;
   
   if (n == -1) n = strlen(key);
+  h = jenkins_hash(key, n);
 
   /* Was this key already stored?  */
-  for (idx = kh->hashtable[val]; idx != -1; idx = kh->nxt[idx])
-    if (esl_memstrcmp(key, n, kh->smem + kh->key_offset[idx]))
-      { 
-	if (opt_index != NULL) *opt_index = idx; 
-	return eslEDUP; 
-      }
+  if ((idx = key_probe(kh, key, n, h, &pos, &d)) != -1)
+    {
+      if (opt_index != NULL) *opt_index = idx; 
+      return eslEDUP; 
+    }
+
+  /* Time to upsize? Then the probe has to be redone in the new table. */
+  if (KEYHASH_FULL(kh, kh->nkeys+1) && kh->hashsize < eslKEYHASH_MAXSIZE)
+    {
+      if ((status = key_upsize(kh)) != eslOK) goto ERROR;
+      key_probe(kh, key, n, h, &pos, &d);
+    }
+  else if (kh->nkeys+1 >= kh->hashsize) ESL_XEXCEPTION(eslEMEM, "keyhash is full");
 
   /* Reallocate key ptr/index memory if needed */
   if (kh->nkeys == kh->kalloc) 
     { 
       ESL_REALLOC(kh->key_offset, sizeof(int)*kh->kalloc*2);
-      ESL_REALLOC(kh->nxt,        sizeof(int)*kh->kalloc*2);
       kh->kalloc *= 2;
     }
 
@@ -297,13 +322,8 @@ esl_keyhash_Store(ESL_KEYHASH *kh, const char *key, esl_pos_t n, int *opt_index)
   esl_memstrcpy(key, n, kh->smem + kh->key_offset[idx]);
   kh->nkeys++;
 
-  /* Insert new element at head of the approp linked list in hashtable */
-  kh->nxt[idx]       = kh->hashtable[val];
-  kh->hashtable[val] = idx;
-
-  /* Time to upsize? If we're 3x saturated, expand the hash table */
-  if (kh->nkeys > 3*kh->hashsize)
-    if ((status = key_upsize(kh)) != eslOK) goto ERROR;
+  /* Put it in the table where the probe stopped, displacing others as needed */
+  key_insert(kh, pos, d, h, idx);
 
   if (opt_index != NULL) *opt_index = idx;
   return eslOK;
@@ -316,30 +336,76 @@ esl_keyhash_Store(ESL_KEYHASH *kh, const char *key, esl_pos_t n, int *opt_index)
 /* Function:  esl_keyhash_Lookup()
  * Synopsis:  Look up a key's array index.
  *
- * Purpose:   Look up a <key> in the hash table <kh>.
+ * Purpose:   Look up a <key> of length <n> in the hash table <kh>.
  *            If <key> is found, return <eslOK>, and optionally set <*opt_index>
  *            to its array index (0..nkeys-1).
  *            If <key> is not found, return <eslENOTFOUND>, and
  *            optionally set <*opt_index> to -1.
+ *            
+ *            <key>, <n> follow the standard idiom for strings and
+ *            unterminated buffers.
  */
 int
 esl_keyhash_Lookup(const ESL_KEYHASH *kh, const char *key, esl_pos_t n, int *opt_index)
 {
-  uint32_t val  = jenkins_hash(key, n, kh->hashsize);
+  uint32_t pos, d;
   int      idx;
 
-  for (idx = kh->hashtable[val]; idx != -1; idx = kh->nxt[idx])
-    if (strcmp(key, kh->smem + kh->key_offset[idx]) == 0) 
-      { 
-	if (opt_index != NULL) *opt_index = idx;
-	return eslOK; 
-      }
-
-  if (opt_index != NULL) *opt_index = -1;
-  return eslENOTFOUND;
+  if (n == -1) n = strlen(key);
+  idx = key_probe(kh, key, n, jenkins_hash(key, n), &pos, &d);
+  if (opt_index != NULL) *opt_index = idx;
+  return (idx == -1 ? eslENOTFOUND : eslOK);
 }
 
 
+/* Function:  esl_keyhash_LookupBatch()
+ * Synopsis:  Look up the array indices of many keys at once.
+ *
+ * Purpose:   Look up <nk> keys <keys[0..nk-1]> in the hash table <kh>,
+ *            and set <ret_index[i]> to the array index (0..nkeys-1) of
+ *            <keys[i]>, or to -1 if it isn't stored. <n[i]> is the
+ *            length of <keys[i]>, following the usual idiom for
+ *            strings and unterminated buffers; or <n> may be
+ *            <NULL> if all the keys are <NUL>-terminated strings.
+ *            Optionally, return the number of keys found in
+ *            <*opt_nfound>.
+ *
+ *            The result is the same as calling <esl_keyhash_Lookup()>
+ *            on each key, but faster on big tables: keys are hashed
+ *            in small groups, and each group's hash table slots are
+ *            prefetched before any of them is probed, so memory
+ *            latency overlaps instead of adding up.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+esl_keyhash_LookupBatch(const ESL_KEYHASH *kh, char *const *keys, const esl_pos_t *n, int nk, int *ret_index, int *opt_nfound)
+{
+  uint32_t  h[eslKEYHASH_BATCH];
+  esl_pos_t len[eslKEYHASH_BATCH];
+  uint32_t  mask   = kh->hashsize - 1;
+  uint32_t  pos, d;
+  int       nfound = 0;
+  int       i, b, nb;
+
+  for (i = 0; i < nk; i += eslKEYHASH_BATCH)
+    {
+      nb = ESL_MIN(eslKEYHASH_BATCH, nk - i);
+      for (b = 0; b < nb; b++)
+	{
+	  len[b] = ((n == NULL || n[i+b] == -1) ? (esl_pos_t) strlen(keys[i+b]) : n[i+b]);
+	  h[b]   = jenkins_hash(keys[i+b], len[b]);
+	  KEYHASH_PREFETCH(kh->hashtable + (h[b] & mask));
+	}
+      for (b = 0; b < nb; b++)
+	{
+	  ret_index[i+b] = key_probe(kh, keys[i+b], len[b], h[b], &pos, &d);
+	  if (ret_index[i+b] != -1) nfound++;
+	}
+    }
+  if (opt_nfound != NULL) *opt_nfound = nfound;
+  return eslOK;
+}
 /*---------- end, API for storing/retrieving keys ---------------*/
 
 
@@ -365,25 +431,22 @@ ESL_KEYHASH *
 keyhash_create(uint32_t hashsize, int init_key_alloc, int init_string_alloc)
 {
   ESL_KEYHASH *kh = NULL;
-  int  i;
-  int  status;
+  uint32_t     i;
+  int          status;
 
   ESL_ALLOC(kh, sizeof(ESL_KEYHASH));
   kh->hashtable  = NULL;
   kh->key_offset = NULL;
-  kh->nxt        = NULL;
   kh->smem       = NULL;
 
-  kh->hashsize  = hashsize;
-  kh->kalloc    = init_key_alloc;
-  kh->salloc    = init_string_alloc;
+  kh->hashsize  = ESL_MAX(hashsize, 2);
+  kh->kalloc    = ESL_MAX(init_key_alloc, 1);
+  kh->salloc    = ESL_MAX(init_string_alloc, 1);
 
-  ESL_ALLOC(kh->hashtable, sizeof(int) * kh->hashsize);
-  for (i = 0; i < kh->hashsize; i++)  kh->hashtable[i] = -1;
+  ESL_ALLOC(kh->hashtable, sizeof(ESL_KEYHASH_SLOT) * kh->hashsize);
+  for (i = 0; i < kh->hashsize; i++)  kh->hashtable[i].idx = -1;
 
   ESL_ALLOC(kh->key_offset, sizeof(int) * kh->kalloc);
-  ESL_ALLOC(kh->nxt,        sizeof(int) * kh->kalloc);
-  for (i = 0; i < kh->kalloc; i++)  kh->nxt[i] = -1;
 
   ESL_ALLOC(kh->smem,   sizeof(char) * kh->salloc);
   kh->nkeys = 0;
@@ -400,15 +463,16 @@ keyhash_create(uint32_t hashsize, int init_key_alloc, int init_string_alloc)
  * 
  * The hash function.
  * This is Bob Jenkins' "one at a time" hash.
- * <key> is a NUL-terminated string of any length.
- * <hashsize> must be a power of 2.
+ * <key> is a string of length <n>, or a NUL-terminated
+ * string of any length if <n> is -1. Returns the full
+ * 32-bit hash; callers mask it to the table size.
  * 
  * References:
  * [1]  http://en.wikipedia.org/wiki/Hash_table
  * [2]  http://www.burtleburtle.net/bob/hash/doobs.html
  */
 static uint32_t
-jenkins_hash(const char *key, esl_pos_t n, uint32_t hashsize)
+jenkins_hash(const char *key, esl_pos_t n)
 {
   esl_pos_t pos;
   uint32_t  val = 0;
@@ -435,7 +499,72 @@ jenkins_hash(const char *key, esl_pos_t n, uint32_t hashsize)
   val ^= (val >> 11);
   val += (val << 15);
 
-  return (val & (hashsize - 1));
+  return val;
+}
+
+/* key_probe()
+ *
+ * Look for <key> of length <n> (not -1), with hash <h>, in <kh>.
+ * Return its index if found, or -1 if not.
+ * 
+ * Either way, also return the slot <*ret_pos> and probe distance
+ * <*ret_d> where the probe stopped. If <key> is not found, that's
+ * where it belongs: <key_insert()> takes it from there.
+ */
+static int
+key_probe(const ESL_KEYHASH *kh, const char *key, esl_pos_t n, uint32_t h, uint32_t *ret_pos, uint32_t *ret_d)
+{
+  const ESL_KEYHASH_SLOT *slot;
+  uint32_t mask = kh->hashsize - 1;
+  uint32_t pos  = h & mask;
+  uint32_t d;
+
+  for (d = 0; ; d++, pos = (pos + 1) & mask)
+    {
+      slot = kh->hashtable + pos;
+      if (slot->idx == -1 || ((pos - slot->hash) & mask) < d) break;
+      if (slot->hash == h && esl_memstrcmp(key, n, kh->smem + kh->key_offset[slot->idx]))
+	{ *ret_pos = pos; *ret_d = d; return slot->idx; }
+    }
+  *ret_pos = pos;
+  *ret_d   = d;
+  return -1;
+}
+
+/* key_insert()
+ *
+ * Put key number <idx>, with hash <h>, into slot <pos> at probe
+ * distance <d> from its home, as found by <key_probe()>. Whatever
+ * was there moves down the table, Robin Hood style: at each slot,
+ * whichever of the two keys is further from home keeps the slot,
+ * until the key in hand finds an empty slot.
+ *
+ * Caller guarantees the table has at least one empty slot.
+ */
+static void
+key_insert(ESL_KEYHASH *kh, uint32_t pos, uint32_t d, uint32_t h, int idx)
+{
+  ESL_KEYHASH_SLOT *slot;
+  ESL_KEYHASH_SLOT  tmp;
+  uint32_t          mask = kh->hashsize - 1;
+  uint32_t          sd;
+
+  for (;; d++, pos = (pos + 1) & mask)
+    {
+      slot = kh->hashtable + pos;
+      if (slot->idx == -1) { slot->hash = h; slot->idx = idx; return; }
+
+      sd = (pos - slot->hash) & mask;
+      if (sd < d)
+	{
+	  tmp        = *slot;
+	  slot->hash = h;
+	  slot->idx  = idx;
+	  h          = tmp.hash;
+	  idx        = tmp.idx;
+	  d          = sd;
+	}
+    }
 }
 
 /* key_upsize()
@@ -444,9 +573,7 @@ jenkins_hash(const char *key, esl_pos_t n, uint32_t hashsize)
  *
  * Args:     old - the KEY hash table to reallocate.
  *
- * Returns:  <eslOK> on success. 'Success' includes the case
- *           where the hash table is already at its maximum size,
- *           and cannot be upsized any more.
+ * Returns:  <eslOK> on success. 
  *           
  * Throws:   <eslEMEM> on allocation failure, and
  *           the hash table is left in its initial state.
@@ -454,30 +581,28 @@ jenkins_hash(const char *key, esl_pos_t n, uint32_t hashsize)
 static int
 key_upsize(ESL_KEYHASH *kh)
 {
-  void     *p;
-  int       i;
-  uint32_t  val;
-  int       status;
-
-  /* 28 below because we're going to upsize in steps of 8x (2^3); need to be < 2^{31-3} */
-  if (kh->hashsize >= (1<<28)) return eslOK; /* quasi-success (can't grow any more)    */
-
-  /* The catch here is that when you upsize the table, all the hash functions
-   * change; so you have to go through all the keys, recompute their hash functions,
-   * and store them again in the new table.
+  ESL_KEYHASH_SLOT *old     = kh->hashtable;
+  uint32_t          oldsize = kh->hashsize;
+  ESL_KEYHASH_SLOT *nw      = NULL;
+  uint32_t          i;
+  int               status;
+
+  /* The catch here is that when you upsize the table, every key's home
+   * slot changes; so you have to go through all the keys and store them
+   * again in the new table. The full hashes stored in the slots save us
+   * from rehashing the key strings.
    */
   /* Allocate a new, larger hash table. (Don't change <kh> until this succeeds) */
-  ESL_RALLOC(kh->hashtable, p, sizeof(int) * (kh->hashsize << 3));
-  kh->hashsize  = kh->hashsize << 3; /* 8x */
-  for (i = 0; i < kh->hashsize; i++) kh->hashtable[i] = -1;
+  ESL_ALLOC(nw, sizeof(ESL_KEYHASH_SLOT) * (oldsize << 1));
+  for (i = 0; i < (oldsize << 1); i++) nw[i].idx = -1;
+  kh->hashtable = nw;
+  kh->hashsize  = oldsize << 1; /* 2x */
 
   /* Store all the keys again. */
-  for (i = 0; i < kh->nkeys; i++) 
-    {
-      val                = jenkins_hash(kh->smem + kh->key_offset[i], -1, kh->hashsize);
-      kh->nxt[i]         = kh->hashtable[val];
-      kh->hashtable[val] = i;
-    }
+  for (i = 0; i < oldsize; i++)
+    if (old[i].idx != -1)
+      key_insert(kh, old[i].hash & (kh->hashsize - 1), 0, old[i].hash, old[i].idx);
+  free(old);
   return eslOK;
 
  ERROR:
@@ -493,6 +618,8 @@ key_upsize(ESL_KEYHASH *kh)
 /* 
    gcc -g -O2 -o keyhash_benchmark -I. -L. -DeslKEYHASH_BENCHMARK esl_keyhash.c -leasel -lm
    time ./keyhash_benchmark /usr/share/dict/words /usr/share/dict/words
+   ./keyhash_benchmark -N 10000000         # 10M random keys; then look up 10M, half of them stored
+   ./keyhash_benchmark -N 10000000 -b      # same, with esl_keyhash_LookupBatch()
  */
 #include "esl_config.h"
 
@@ -501,69 +628,156 @@ key_upsize(ESL_KEYHASH *kh)
 #include "easel.h"
 #include "esl_getopts.h"
 #include "esl_keyhash.h"
+#include "esl_random.h"
 #include "esl_stopwatch.h"
 
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
   { "-h",        eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-b",        eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "look keys up with esl_keyhash_LookupBatch()",      0 },
+  { "-N",        eslARG_INT,      "0",  NULL,"n>=0", NULL,  NULL, NULL, "no keyfiles: store and look up <n> random keys",   0 },
+  { "-s",        eslARG_INT,     "42",  NULL, NULL,  NULL,  NULL, NULL, "set random number seed for -N to <n>",             0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
-static char usage[]  = "[-options] <keyfile1> <keyfile2>";
+static char usage[]  = "[-options] <keyfile1> <keyfile2>\n  or: [-options] -N <n>";
 static char banner[] = "benchmarking speed of keyhash module";
 
-int
-main(int argc, char **argv)
+/* read_keys()
+ * Read keys from <file>, first token on each line, into a new array of
+ * strings, <*ret_keys>, <*ret_nk> of them.
+ */
+static void
+read_keys(char *file, char ***ret_keys, int *ret_nk)
 {
-  ESL_GETOPTS    *go      = esl_getopts_CreateDefaultApp(options, 2, argc, argv, banner, usage);
-  ESL_KEYHASH    *kh      = esl_keyhash_Create();
-  ESL_STOPWATCH  *w       = esl_stopwatch_Create();
-  char           *file1   = esl_opt_GetArg(go, 1);
-  char           *file2   = esl_opt_GetArg(go, 2);
-  FILE           *fp;
-  char            buf[256];
-  char           *s, *tok;
-  int             idx;
-  int             nstored, nsearched, nshared;
-
-  /* Read/store keys from file 1.
-   */
-  esl_stopwatch_Start(w);
-  if ((fp = fopen(file1, "r")) == NULL)
-    { fprintf(stderr, "couldn't open %s\n", argv[1]); exit(1); }
-  nstored = 0;
+  FILE  *fp;
+  char   buf[256];
+  char  *s, *tok;
+  char **keys   = NULL;
+  int    nk     = 0;
+  int    kalloc = 1024;
+  int    status;
+
+  if ((fp = fopen(file, "r")) == NULL) esl_fatal("couldn't open %s\n", file);
+  ESL_ALLOC(keys, sizeof(char *) * kalloc);
   while (fgets(buf, 256, fp) != NULL)
     {
       s = buf;
-      esl_strtok(&s, " \t\r\n", &tok);
-      esl_keyhash_Store(kh, tok, -1, &idx);
-      nstored++;
+      if (esl_strtok(&s, " \t\r\n", &tok) != eslOK) continue;
+      if (nk == kalloc) { ESL_REALLOC(keys, sizeof(char *) * kalloc * 2); kalloc *= 2; }
+      esl_strdup(tok, -1, &(keys[nk++]));
     }
   fclose(fp);
-  printf("Stored %d keys.\n", nstored);
+  *ret_keys = keys;
+  *ret_nk   = nk;
+  return;
 
-  /* Look up keys from file 2.
+ ERROR:
+  esl_fatal("allocation failed");
+}
+
+/* random_keys()
+ * Create <nk> random alphanumeric keys, 8-20 chars long, in <*ret_keys>.
+ */
+static void
+random_keys(ESL_RANDOMNESS *r, int nk, char ***ret_keys)
+{
+  static char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_.";
+  char      **keys = NULL;
+  int         i, j, len;
+  int         status;
+
+  ESL_ALLOC(keys, sizeof(char *) * nk);
+  for (i = 0; i < nk; i++)
+    {
+      len = 8 + esl_rnd_Roll(r, 13);
+      ESL_ALLOC(keys[i], sizeof(char) * (len+1));
+      for (j = 0; j < len; j++) keys[i][j] = alphabet[esl_rnd_Roll(r, 64)];
+      keys[i][len] = '\0';
+    }
+  *ret_keys = keys;
+  return;
+
+ ERROR:
+  esl_fatal("allocation failed");
+}
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = esl_getopts_Create(options);
+  ESL_KEYHASH    *kh      = esl_keyhash_Create();
+  ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  ESL_RANDOMNESS *r       = NULL;
+  int             N;
+  char          **skeys   = NULL;
+  char          **lkeys   = NULL;
+  int             ns, nl;
+  int            *idx     = NULL;
+  int             i;
+  int             nshared;
+  int             status;
+
+  if (esl_opt_ProcessCmdline(go, argc, argv) != eslOK || esl_opt_VerifyConfig(go) != eslOK) 
+    { printf("Failed to parse command line: %s\n", go->errbuf); esl_usage(stdout, argv[0], usage); exit(1); }
+  if (esl_opt_GetBoolean(go, "-h")) 
+    { esl_banner(stdout, argv[0], banner); esl_usage(stdout, argv[0], usage); puts("\nOptions:"); esl_opt_DisplayHelp(stdout, go, 0, 2, 80); exit(0); }
+  N = esl_opt_GetInteger(go, "-N");
+  if (esl_opt_ArgNumber(go) != (N ? 0 : 2))
+    { puts("Incorrect number of command line arguments."); esl_usage(stdout, argv[0], usage); exit(1); }
+
+  /* Get the keys before the timer starts: from files, or
+   * N random ones to store, and N to look up, half of them stored ones.
    */
-  if ((fp = fopen(file2, "r")) == NULL)
-    { fprintf(stderr, "couldn't open %s\n", argv[2]); exit(1); }
-  nsearched = nshared = 0;
-  while (fgets(buf, 256, fp) != NULL)
+  if (N) 
     {
-      s = buf;
-      esl_strtok(&s, " \t\r\n", &tok);
+      r = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+      random_keys(r, N, &skeys);
+      random_keys(r, N, &lkeys);
+      for (i = 0; i < N; i += 2) { free(lkeys[i]); esl_strdup(skeys[esl_rnd_Roll(r, N)], -1, &(lkeys[i])); }
+      ns = nl = N;
+    }
+  else
+    {
+      read_keys(esl_opt_GetArg(go, 1), &skeys, &ns);
+      read_keys(esl_opt_GetArg(go, 2), &lkeys, &nl);
+    }
+  ESL_ALLOC(idx, sizeof(int) * ESL_MAX(nl, 1));
 
-      if (esl_keyhash_Lookup(kh, tok, -1, &idx) == eslOK) nshared++;
-      nsearched++;
+  /* Store keys. */
+  esl_stopwatch_Start(w);
+  for (i = 0; i < ns; i++)
+    esl_keyhash_Store(kh, skeys[i], -1, &(idx[0]));
+  esl_stopwatch_Stop(w);
+  printf("Stored %d keys (%d distinct).\n", ns, esl_keyhash_GetNumber(kh));
+  esl_stopwatch_Display(stdout, w, "# Store CPU Time:  ");
+
+  /* Look up keys. */
+  esl_stopwatch_Start(w);
+  if (esl_opt_GetBoolean(go, "-b"))
+    esl_keyhash_LookupBatch(kh, lkeys, NULL, nl, idx, &nshared);
+  else 
+    {
+      for (nshared = 0, i = 0; i < nl; i++)
+	if (esl_keyhash_Lookup(kh, lkeys[i], -1, &(idx[i])) == eslOK) nshared++;
     }
-  fclose(fp);
   esl_stopwatch_Stop(w);
-  printf("Looked up %d keys.\n", nsearched);
+  printf("Looked up %d keys.\n", nl);
   printf("In common: %d keys.\n", nshared);
-  esl_stopwatch_Display(stdout, w, "# CPU Time: ");
-
+  esl_stopwatch_Display(stdout, w, "# Lookup CPU Time: ");
+
+  for (i = 0; i < ns; i++) free(skeys[i]);
+  for (i = 0; i < nl; i++) free(lkeys[i]);
+  free(skeys);
+  free(lkeys);
+  free(idx);
+  esl_randomness_Destroy(r);
   esl_stopwatch_Destroy(w);
   esl_keyhash_Destroy(kh);
   esl_getopts_Destroy(go);
   return 0;
+
+ ERROR:
+  return status;
 }
 #endif /*eslKEYHASH_BENCHMARK*/
 
@@ -620,7 +834,7 @@ main(int argc, char **argv)
   int             nkeys;
   int             i;
   int             status;
-  uint32_t (*hashfunc)(const char*,uint32_t) = jenkins_hash;
+  uint32_t (*hashfunc)(const char*,esl_pos_t) = jenkins_hash;
   
   /* 1. Store the keys from the file, before starting the benchmark timer. */
   kalloc = 256;
@@ -648,7 +862,7 @@ main(int argc, char **argv)
 
   /* 2. benchmark hashing the keys. */
   esl_stopwatch_Start(w);
-  for (i = 0; i < nkeys; i++) (*hashfunc)(karr[i], hashsize);
+  for (i = 0; i < nkeys; i++) (*hashfunc)(karr[i], -1);
   esl_stopwatch_Stop(w);
   esl_stopwatch_Display(stdout, w, "# CPU Time: ");
 
@@ -658,7 +872,7 @@ main(int argc, char **argv)
   if (esl_opt_GetBoolean(go, "-v"))
     {
       for (i = 0; i < nkeys; i++) 
-	printf("%-20s %9d\n", karr[i], (*hashfunc)(karr[i], hashsize));
+	printf("%-20s %9d\n", karr[i], (*hashfunc)(karr[i], -1) & (hashsize-1));
     }
 
   /* Likewise, if user wanted to see statistical uniformity test...
@@ -669,7 +883,7 @@ main(int argc, char **argv)
 
       ESL_ALLOC(ct, sizeof(int) * hashsize);
       esl_vec_ISet(ct, hashsize, 0);
-      for (i = 0; i < nkeys; i++) ct[(*hashfunc)(karr[i], hashsize)]++;
+      for (i = 0; i < nkeys; i++) ct[(*hashfunc)(karr[i], -1) & (hashsize-1)]++;
       
       esl_stats_IMean(ct, hashsize, &mean, &var);
       for (X2 = 0.0, i = 0; i < hashsize; i++)
@@ -707,6 +921,123 @@ main(int argc, char **argv)
 /*****************************************************************
  * 5. Unit tests
  *****************************************************************/
+#ifdef eslKEYHASH_TESTDRIVE
+#include "esl_random.h"
+
+/* utest_growth()
+ * Store <nk> random keys in a keyhash that starts tiny, so the table
+ * is upsized many times; check every key is found with the right
+ * index, by string and by unterminated buffer; that duplicates are
+ * detected; and that Clone() and Reuse() work.
+ */
+static void
+utest_growth(ESL_RANDOMNESS *r, int nk)
+{
+  char        *msg  = "keyhash growth unit test failed";
+  ESL_KEYHASH *kh   = esl_keyhash_CreateCustom(2, 1, 1);
+  ESL_KEYHASH *kh2  = NULL;
+  char       **keys = NULL;
+  char         buf[16];
+  int          i, j, idx, nstored;
+  int          status;
+
+  ESL_ALLOC(keys, sizeof(char *) * nk);
+  for (i = 0; i < nk; i++)
+    {
+      ESL_ALLOC(keys[i], sizeof(char) * 7);
+      for (j = 0; j < 6; j++) keys[i][j] = 'a' + esl_rnd_Roll(r, 4); /* 4^6 = 4096 possible keys */
+      keys[i][6] = '\0';
+    }
+
+  for (nstored = 0, i = 0; i < nk; i++)
+    {
+      status = esl_keyhash_Store(kh, keys[i], -1, &idx);
+      if      (status == eslOK)   { if (idx != nstored) esl_fatal(msg); nstored++; }
+      else if (status == eslEDUP) { if (idx >= nstored || strcmp(esl_keyhash_Get(kh, idx), keys[i]) != 0) esl_fatal(msg); }
+      else esl_fatal(msg);
+    }
+  if (esl_keyhash_GetNumber(kh) != nstored) esl_fatal(msg);
+
+  if ((kh2 = esl_keyhash_Clone(kh)) == NULL) esl_fatal(msg);
+  for (i = 0; i < nk; i++)
+    {
+      if (esl_keyhash_Lookup(kh,  keys[i], -1, &idx) != eslOK)      esl_fatal(msg);
+      if (strcmp(esl_keyhash_Get(kh, idx), keys[i])  != 0)          esl_fatal(msg);
+      snprintf(buf, 16, "%sXYZ", keys[i]);
+      if (esl_keyhash_Lookup(kh2, buf, 6, &j) != eslOK || j != idx) esl_fatal(msg);
+      if (esl_keyhash_Lookup(kh2, buf, 7, &j) != eslENOTFOUND)      esl_fatal(msg);
+      if (j != -1)                                                  esl_fatal(msg);
+    }
+
+  esl_keyhash_Reuse(kh);
+  if (esl_keyhash_GetNumber(kh) != 0)                        esl_fatal(msg);
+  if (esl_keyhash_Lookup(kh, keys[0], -1, &idx) != eslENOTFOUND) esl_fatal(msg);
+  if (esl_keyhash_Store (kh, keys[0], -1, &idx) != eslOK)        esl_fatal(msg);
+  if (idx != 0)                                                  esl_fatal(msg);
+
+  for (i = 0; i < nk; i++) free(keys[i]);
+  free(keys);
+  esl_keyhash_Destroy(kh);
+  esl_keyhash_Destroy(kh2);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+
+/* utest_batch()
+ * LookupBatch() must give the same answers as Lookup() one at a time,
+ * for strings and unterminated buffers, across batch boundaries.
+ */
+static void
+utest_batch(ESL_RANDOMNESS *r, int nk)
+{
+  char        *msg  = "keyhash batch lookup unit test failed";
+  ESL_KEYHASH *kh   = esl_keyhash_Create();
+  char       **keys = NULL;
+  esl_pos_t   *n    = NULL;
+  int         *idx  = NULL;
+  int          i, j, nfound, nexpect;
+  int          status;
+
+  ESL_ALLOC(keys, sizeof(char *)    * nk);
+  ESL_ALLOC(n,    sizeof(esl_pos_t) * nk);
+  ESL_ALLOC(idx,  sizeof(int)       * nk);
+  for (i = 0; i < nk; i++)
+    {
+      ESL_ALLOC(keys[i], sizeof(char) * 6);
+      for (j = 0; j < 5; j++) keys[i][j] = 'a' + esl_rnd_Roll(r, 6);
+      keys[i][5] = '\0';
+      n[i] = (i % 3 == 0 ? -1 : 4); /* some keys are 5-char strings, some 4-char buffers */
+    }
+  for (i = 0; i < nk; i += 2) esl_keyhash_Store(kh, keys[i], n[i], NULL);
+
+  if (esl_keyhash_LookupBatch(kh, keys, n, nk, idx, &nfound) != eslOK) esl_fatal(msg);
+  for (nexpect = 0, i = 0; i < nk; i++)
+    {
+      if (esl_keyhash_Lookup(kh, keys[i], n[i], &j) == eslOK) nexpect++;
+      if (idx[i] != j) esl_fatal(msg);
+    }
+  if (nfound != nexpect) esl_fatal(msg);
+
+  esl_keyhash_LookupBatch(kh, keys, NULL, nk, idx, NULL);
+  for (i = 0; i < nk; i++)
+    {
+      esl_keyhash_Lookup(kh, keys[i], -1, &j);
+      if (idx[i] != j) esl_fatal(msg);
+    }
+
+  for (i = 0; i < nk; i++) free(keys[i]);
+  free(keys);
+  free(n);
+  free(idx);
+  esl_keyhash_Destroy(kh);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+#endif /*eslKEYHASH_TESTDRIVE*/
 
 
 /*---------------------- end, unit tests ------------------------*/
@@ -723,6 +1054,7 @@ main(int argc, char **argv)
 #include <assert.h>
 #include "easel.h"
 #include "esl_keyhash.h"
+#include "esl_random.h"
 
 #define NSTORE  1200
 #define NLOOKUP 1200
@@ -731,7 +1063,8 @@ main(int argc, char **argv)
 int
 main(int argc, char **argv)
 {
-  ESL_KEYHASH *h;
+  ESL_KEYHASH    *h;
+  ESL_RANDOMNESS *r;
   char keys[NSTORE+NLOOKUP][KEYLEN+1]; 
   int  i,j,nk,k42;
   int  nmissed;
@@ -781,6 +1114,11 @@ main(int argc, char **argv)
   */
 
   esl_keyhash_Destroy(h);
+
+  r = esl_randomness_Create(42);
+  utest_growth(r, 5000);
+  utest_batch (r, 1000);
+  esl_randomness_Destroy(r);
   exit (0);
 }
 #endif /*eslKEYHASH_TESTDRIVE*/
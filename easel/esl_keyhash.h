@@ -15,27 +15,34 @@
  * Each key has an offset in this array, key_offset[i].
  * Thus key number <i> is at: smem + key_offset[i].
  * 
- * The keys are hashed, and stored in linked lists in
- * a hashtable by their index i = (0..nkeys-1), with -1
- * as a sentinel for end-of-list.
- *
- * hashtable[0..hashsize-1] = head of linked list; 
- *                            index of first elem in list (0..nkeys-1), 
- *                            or -1 if empty.
- * nxt[0..nkeys-1] = next elem in list (0..nkeys-1), or -1 if none.
+ * The hash table is open-addressed, with linear probing and Robin
+ * Hood insertion: a key whose home slot is h = hash & (hashsize-1)
+ * sits in slot h + d for some small probe distance d, and keys
+ * along any probe sequence appear in nondecreasing order of d.
+ * Each slot holds the key's full 32-bit hash and its index
+ * (0..nkeys-1), or -1 if the slot is empty. A probe compares
+ * stored hashes, touching the key string in smem only on a hash
+ * match, and it stops as soon as it reaches an empty slot or a
+ * key closer to its home than the probe is.
  *
  * Thus a typical loop, looking for a <key>:
- *    uint32_t val = jenkins_hash(key, kh->hashsize);
- *    for (i = kh->hashtable[val]; i != -1; i = kh->nxt[i])
- *      if (strcmp(key, kh->smem + kh->key_offset[i]) == 0) found_it;
- *
+ *    uint32_t h = jenkins_hash(key, n);
+ *    for (d = 0, pos = h & mask; ; d++, pos = (pos+1) & mask) {
+ *      if (hashtable[pos].idx == -1)                          not_found;
+ *      if (((pos - hashtable[pos].hash) & mask) < d)          not_found;
+ *      if (hashtable[pos].hash == h && key matches smem + key_offset[idx]) found_it;
+ *    }
  */
 typedef struct {
-  int      *hashtable;          /* hashtable[0..hashsize-1] = index of first elem, or -1 */
-  uint32_t  hashsize;	        /* size of the hash table                                */
+  uint32_t  hash;		/* full (unmasked) hash value of the key in this slot    */
+  int       idx;		/* index of the key (0..nkeys-1), or -1 if slot is empty */
+} ESL_KEYHASH_SLOT;
+
+typedef struct {
+  ESL_KEYHASH_SLOT *hashtable;  /* hashtable[0..hashsize-1]: open-addressed slots        */
+  uint32_t  hashsize;	        /* size of the hash table (a power of 2)                 */
 
   int      *key_offset;		/* key [idx=0..nkeys-1] starts at smem + key_offset[idx] */
-  int      *nxt;		/* nxt [idx=0..nkeys-1], next "pointers" in hash table   */
   int       nkeys;		/* number of keys stored                                 */
   int       kalloc;		/* number of keys allocated for                          */
 
@@ -56,6 +63,7 @@ extern void         esl_keyhash_Dump(FILE *fp, const ESL_KEYHASH *kh);
 
 extern int  esl_keyhash_Store (      ESL_KEYHASH *kh, const char *key, esl_pos_t n, int *ret_index);
 extern int  esl_keyhash_Lookup(const ESL_KEYHASH *kh, const char *key, esl_pos_t n, int *ret_index);
+extern int  esl_keyhash_LookupBatch(const ESL_KEYHASH *kh, char *const *keys, const esl_pos_t *n, int nk, int *ret_index, int *opt_nfound);
 
 
 #endif /* eslKEYHASH_INCLUDED */
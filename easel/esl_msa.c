@@ -5,10 +5,11 @@
  *    2. Digital mode MSA's         (augmentation: alphabet)
  *    3. Setting, checking data fields in an <ESL_MSA>
  *    4. Miscellaneous functions for manipulating MSAs
- *    5. Debugging, testing, development
- *    6. Unit tests
- *    7. Test driver
- *    8. Copyright and license information
+ *    5. Deferred per-residue annotation
+ *    6. Debugging, testing, development
+ *    7. Unit tests
+ *    8. Test driver
+ *    9. Copyright and license information
  *   
  * Augmentations:
  *   alphabet:  adds support for digital MSAs
@@ -29,6 +30,7 @@
 
 #include "easel.h"
 #include "esl_mem.h"
+#include "esl_buffer.h"
 #ifdef eslAUGMENT_KEYHASH
 #include "esl_keyhash.h"
 #endif
@@ -38,6 +40,9 @@
 #ifdef eslAUGMENT_SSI
 #include "esl_ssi.h"
 #endif
+#ifdef HAVE_PTHREAD
+#include "esl_threads.h"
+#endif
 #include "esl_msa.h"
 #include "esl_msafile.h"
 #include "esl_vectorops.h"
@@ -50,6 +55,12 @@
  *****************************************************************************/
 
 static ESL_MSA *msa_create_mostly(int nseq, int64_t alen);
+static int      msa_create_arena  (ESL_MSA *msa, int nseq, int64_t alen);
+static void     msa_destroy_arena (ESL_MSA_ARENA *ar);
+static int      msa_arena_contains(const ESL_MSA *msa, const void *p);
+static void     msa_free_seqstr   (const ESL_MSA *msa, void *s);
+static void     msa_free2D        (const ESL_MSA *msa, void **p, int n);
+static int      msa_seqstrdup     (ESL_MSA *msa, const char *s, esl_pos_t n, char **ret_s);
 
 
 /* Function:  esl_msa_Create()
@@ -124,6 +135,62 @@ esl_msa_Create(int nseq, int64_t alen)
 }
 
 
+/* Function:  esl_msa_CreateArena()
+ * Synopsis:  Create a fixed-size <ESL_MSA> with slab-allocated rows.
+ *
+ * Purpose:   Same as <esl_msa_Create()> for a fixed-size alignment of
+ *            <nseq> sequences and <alen> columns, except that the
+ *            aligned rows are carved out of a single 64-byte aligned
+ *            block (each row starts on a 64-byte boundary), and
+ *            sequence names, accessions, and descriptions set with
+ *            the usual <esl_msa_Set*()> and <esl_msa_Format*()> calls
+ *            come from a growing string pool instead of one
+ *            <malloc()> apiece. For large alignments this saves
+ *            hundreds of thousands of small allocations, and
+ *            <esl_msa_Destroy()> releases the whole thing with a
+ *            handful of <free()> calls.
+ *
+ *            An arena MSA is not growable: <alen> must be known, and
+ *            <esl_msa_Expand()> does not apply. Everything else in
+ *            the API works on it as usual.
+ *
+ * Args:      <nseq> - number of sequences
+ *            <alen> - length of alignment in columns
+ *
+ * Returns:   pointer to new MSA object, w/ all values initialized,
+ *            and <msa->nseq> set to <nseq>.
+ *
+ * Throws:    <NULL> on allocation failure, or if <alen> is -1.
+ */
+ESL_MSA *
+esl_msa_CreateArena(int nseq, int64_t alen)
+{
+  ESL_MSA *msa = NULL;
+  int      i;
+  int      status;
+
+  if (alen < 0) ESL_XEXCEPTION(eslEINVAL, "arena MSA needs a known alen");
+
+  msa = msa_create_mostly(nseq, alen); /* aseq is null upon successful return */
+  if (msa == NULL) return NULL;
+  if ((status = msa_create_arena(msa, nseq, alen)) != eslOK) goto ERROR;
+
+  ESL_ALLOC(msa->aseq,   sizeof(char *) * msa->sqalloc);
+  for (i = 0; i < msa->sqalloc; i++)
+    msa->aseq[i] = NULL;
+  for (i = 0; i < nseq; i++)
+    {
+      msa->aseq[i]       = msa->arena->rows + i * msa->arena->rowstride;
+      msa->aseq[i][alen] = '\0';
+    }
+  msa->nseq = nseq;
+  return msa;
+
+ ERROR:
+  esl_msa_Destroy(msa);
+  return NULL;
+}
+
 /* Function:  esl_msa_Expand()
  * Synopsis:  Reallocate for more sequences.
  *
@@ -259,8 +326,13 @@ esl_msa_Expand(ESL_MSA *msa)
  *            it's unlikely that <esl_msa_Copy()> is useful on its own;
  *            the caller would be expected to call <esl_msa_Clone()> 
  *            instead.
+ *            
+ *            Any deferred annotation of <msa> (<msa->lazy>) is
+ *            materialized first, so <new> gets all of it.
  *
  * Returns:   <eslOK> on success.
+ *            <eslENOTFOUND> or <eslECORRUPT> if deferred annotation
+ *            can't be read; see <esl_msa_MaterializeAnnotation()>.
  *
  * Throws:    <eslEMEM> on allocation failure. In this case, <new>
  *            was only partially constructed, and should be treated
@@ -272,6 +344,9 @@ esl_msa_Copy(const ESL_MSA *msa, ESL_MSA *new)
   int i, x, j;
   int status;
 
+  /* Deferred annotation is a cache of the input file, not a change to <msa>'s contents */
+  if (msa->lazy && (status = esl_msa_MaterializeAnnotation((ESL_MSA *) msa, NULL)) != eslOK) return status;
+
   /* aseq[0..nseq-1][0..alen-1] strings,
    * or ax[0..nseq-1][(0) 1..alen (alen+1)] digital seqs 
    * <new> must have one of them allocated already.
@@ -289,7 +364,7 @@ esl_msa_Copy(const ESL_MSA *msa, ESL_MSA *new)
 #endif
   
   for (i = 0; i < msa->nseq; i++) {
-    esl_strdup(msa->sqname[i], -1, &(new->sqname[i]));
+    msa_seqstrdup(new, msa->sqname[i], -1, &(new->sqname[i]));
     new->wgt[i] = msa->wgt[i];
   }
   /* alen, nseq were already set by Create() */
@@ -307,12 +382,12 @@ esl_msa_Copy(const ESL_MSA *msa, ESL_MSA *new)
 
   if (msa->sqacc != NULL) {
     ESL_ALLOC(new->sqacc, sizeof(char **) * new->sqalloc);
-    for (i = 0; i < msa->nseq;    i++) esl_strdup(msa->sqacc[i], -1, &(new->sqacc[i]));
+    for (i = 0; i < msa->nseq;    i++) msa_seqstrdup(new, msa->sqacc[i], -1, &(new->sqacc[i]));
     for (     ; i < new->sqalloc; i++) new->sqacc[i] = NULL;
   }
   if (msa->sqdesc != NULL) {
     ESL_ALLOC(new->sqdesc, sizeof(char **) * new->sqalloc);
-    for (i = 0; i < msa->nseq;    i++) esl_strdup(msa->sqdesc[i], -1, &(new->sqdesc[i]));
+    for (i = 0; i < msa->nseq;    i++) msa_seqstrdup(new, msa->sqdesc[i], -1, &(new->sqdesc[i]));
     for (     ; i < new->sqalloc; i++) new->sqdesc[i] = NULL;
   }
   if (msa->ss != NULL) {
@@ -389,6 +464,8 @@ esl_msa_Copy(const ESL_MSA *msa, ESL_MSA *new)
     }
   }
 
+  esl_msa_lazy_Destroy(new->lazy); new->lazy = NULL;
+
 #ifdef eslAUGMENT_KEYHASH
   esl_keyhash_Destroy(new->index);  new->index  = NULL;
   esl_keyhash_Destroy(new->gs_idx); new->gs_idx = NULL;
@@ -429,11 +506,16 @@ esl_msa_Clone(const ESL_MSA *msa)
   int      status;
 
 #ifdef eslAUGMENT_ALPHABET
-  if (msa->flags & eslMSA_DIGITAL) {
+  if ((msa->flags & eslMSA_DIGITAL) && msa->arena) {
+      if ((nw = esl_msa_CreateDigitalArena(msa->abc, msa->nseq, msa->alen)) == NULL)  return NULL;
+  } else if (msa->flags & eslMSA_DIGITAL) {
       if ((nw = esl_msa_CreateDigital(msa->abc, msa->nseq, msa->alen)) == NULL)  return NULL;
   } else
 #endif
-  if ((nw     = esl_msa_Create(msa->nseq, msa->alen)) == NULL)  return NULL;  
+  if (msa->arena) {
+      if ((nw = esl_msa_CreateArena(msa->nseq, msa->alen)) == NULL)  return NULL;
+  } 
+  else if ((nw = esl_msa_Create(msa->nseq, msa->alen)) == NULL)  return NULL;  
 
   if ((status = esl_msa_Copy(msa, nw) )               != eslOK) goto ERROR;
   return nw;
@@ -457,15 +539,15 @@ esl_msa_Destroy(ESL_MSA *msa)
   if (msa == NULL) return;
 
   if (msa->aseq != NULL) 
-    esl_Free2D((void **) msa->aseq, msa->nseq);
+    msa_free2D(msa, (void **) msa->aseq, msa->nseq);
 #ifdef eslAUGMENT_ALPHABET
   if (msa->ax != NULL) 
-    esl_Free2D((void **) msa->ax, msa->nseq);
+    msa_free2D(msa, (void **) msa->ax, msa->nseq);
 #endif /*eslAUGMENT_ALPHABET*/
 
-  esl_Free2D((void **) msa->sqname, msa->nseq);
-  esl_Free2D((void **) msa->sqacc,  msa->nseq);
-  esl_Free2D((void **) msa->sqdesc, msa->nseq);
+  msa_free2D(msa, (void **) msa->sqname, msa->nseq);
+  msa_free2D(msa, (void **) msa->sqacc,  msa->nseq);
+  msa_free2D(msa, (void **) msa->sqdesc, msa->nseq);
   esl_Free2D((void **) msa->ss,     msa->nseq);
   esl_Free2D((void **) msa->sa,     msa->nseq);
   esl_Free2D((void **) msa->pp,     msa->nseq);
@@ -496,6 +578,7 @@ esl_msa_Destroy(ESL_MSA *msa)
   esl_Free2D((void **) msa->gc,      msa->ngc);
   esl_Free2D((void **) msa->gr_tag,  msa->ngr);
   esl_Free3D((void ***)msa->gr,      msa->ngr, msa->nseq);
+  esl_msa_lazy_Destroy(msa->lazy);
 
 #ifdef eslAUGMENT_KEYHASH
   esl_keyhash_Destroy(msa->index);
@@ -504,6 +587,7 @@ esl_msa_Destroy(ESL_MSA *msa)
   esl_keyhash_Destroy(msa->gr_idx);
 #endif /* keyhash augmentation */  
 
+  msa_destroy_arena(msa->arena);
   free(msa);
   return;
 }
@@ -580,6 +664,7 @@ msa_create_mostly(int nseq, int64_t alen)
   msa->salen   = NULL;
   msa->pplen   = NULL;
   msa->lastidx = 0;
+  msa->arena   = NULL;
 
   /* Unparsed markup, including comments and Stockholm tags.
    * GS, GC, and GR Stockholm tags require keyhash augmentation
@@ -605,6 +690,8 @@ msa_create_mostly(int nseq, int64_t alen)
   msa->gr             = NULL;
   msa->ngr            = 0;
 
+  msa->lazy           = NULL;
+
 #ifdef eslAUGMENT_KEYHASH
   msa->index     = esl_keyhash_Create();
   msa->gs_idx    = NULL;
@@ -638,6 +725,147 @@ msa_create_mostly(int nseq, int64_t alen)
   esl_msa_Destroy(msa);
   return NULL;
 }
+
+/* msa_create_arena()
+ *
+ * Called by esl_msa_CreateArena() and esl_msa_CreateDigitalArena()
+ * on a newly created <msa>: allocate a 64-byte aligned residue matrix
+ * for <nseq> rows of <alen> residues (plus room for digital
+ * sentinels), and an empty string pool, in <msa->arena>.
+ *
+ * Throws:   <eslEMEM> on allocation failure; caller destroys <msa>.
+ */
+static int
+msa_create_arena(ESL_MSA *msa, int nseq, int64_t alen)
+{
+  ESL_MSA_ARENA *ar = NULL;
+  int            status;
+
+  ESL_ALLOC(ar, sizeof(ESL_MSA_ARENA));
+  ar->mem       = NULL;
+  ar->rows      = NULL;
+  ar->rowstride = ((alen + 2 + 63) / 64) * 64;
+  ar->nrows     = nseq;
+  ar->pool      = NULL;
+  ar->poolsize  = NULL;
+  ar->npool     = 0;
+  ar->palloc    = 8;
+  ar->pool_n    = 0;
+  msa->arena    = ar;
+
+  ESL_ALLOC(ar->mem,      sizeof(char)    * (ar->rowstride * nseq + 63));
+  ESL_ALLOC(ar->pool,     sizeof(char *)  * ar->palloc);
+  ESL_ALLOC(ar->poolsize, sizeof(int64_t) * ar->palloc);
+  ar->rows = (char *) (((uintptr_t) ar->mem + 63) & ~((uintptr_t) 63));
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* msa_destroy_arena()
+ * Free an <ESL_MSA_ARENA>.
+ */
+static void
+msa_destroy_arena(ESL_MSA_ARENA *ar)
+{
+  if (ar)
+    {
+      esl_Free2D((void **) ar->pool, ar->npool);
+      if (ar->poolsize) free(ar->poolsize);
+      if (ar->mem)      free(ar->mem);
+      free(ar);
+    }
+}
+
+/* msa_arena_contains()
+ * Return TRUE if <p> points into the arena of <msa> (its residue
+ * matrix or its string pool), and so must not be free()'d on its
+ * own; FALSE if it's a separate allocation, or <msa> has no arena.
+ */
+static int
+msa_arena_contains(const ESL_MSA *msa, const void *p)
+{
+  const ESL_MSA_ARENA *ar = msa->arena;
+  const char          *c  = (const char *) p;
+  int                  k;
+
+  if (ar == NULL || c == NULL) return FALSE;
+  if (c >= ar->rows && c < ar->rows + ar->rowstride * ar->nrows) return TRUE;
+  for (k = 0; k < ar->npool; k++)
+    if (c >= ar->pool[k] && c < ar->pool[k] + ar->poolsize[k]) return TRUE;
+  return FALSE;
+}
+
+/* msa_free_seqstr()
+ * Free a row, or a sequence name, accession, or description <s> of
+ * <msa>, unless it's in the arena.
+ */
+static void
+msa_free_seqstr(const ESL_MSA *msa, void *s)
+{
+  if (s && ! msa_arena_contains(msa, s)) free(s);
+}
+
+/* msa_free2D()
+ * Like <esl_Free2D()> for per-sequence arrays of <msa> (rows, names,
+ * accessions, descriptions), but leaves what's in the arena alone.
+ */
+static void
+msa_free2D(const ESL_MSA *msa, void **p, int n)
+{
+  int i;
+
+  if (p == NULL) return;
+  if (msa->arena == NULL) { esl_Free2D(p, n); return; }
+  for (i = 0; i < n; i++) msa_free_seqstr(msa, p[i]);
+  free(p);
+}
+
+/* msa_seqstrdup()
+ * Duplicate a sequence name, accession, or description <s> of length
+ * <n> (<n> <= 0 if <s> is NUL-terminated and its length is unknown)
+ * for <msa>: allocated from the string pool, if <msa> has an arena;
+ * else as a separate allocation. If <s> is NULL, <*ret_s> is NULL.
+ *
+ * Throws:  <eslEMEM> on allocation failure.
+ */
+static int
+msa_seqstrdup(ESL_MSA *msa, const char *s, esl_pos_t n, char **ret_s)
+{
+  ESL_MSA_ARENA *ar = msa->arena;
+  int64_t        bsize;
+  int            status;
+
+  if (s == NULL)  { *ret_s = NULL; return eslOK; }
+  if (n <= 0)     n = strlen(s);
+  if (ar == NULL) return esl_memstrdup(s, n, ret_s);
+
+  if (ar->npool == 0 || ar->pool_n + n + 1 > ar->poolsize[ar->npool-1])
+    { /* start a new block, twice as big as the last one */
+      if (ar->npool == ar->palloc) {
+	ESL_REALLOC(ar->pool,     sizeof(char *)  * ar->palloc * 2);
+	ESL_REALLOC(ar->poolsize, sizeof(int64_t) * ar->palloc * 2);
+	ar->palloc *= 2;
+      }
+      bsize = (ar->npool ? ar->poolsize[ar->npool-1] * 2 : (int64_t) ESL_MAX(ar->nrows, 1) * 32);
+      bsize = ESL_MAX(bsize, n+1);
+      ESL_ALLOC(ar->pool[ar->npool], sizeof(char) * bsize);
+      ar->poolsize[ar->npool] = bsize;
+      ar->npool++;
+      ar->pool_n = 0;
+    }
+
+  *ret_s = ar->pool[ar->npool-1] + ar->pool_n;
+  memcpy(*ret_s, s, n);
+  (*ret_s)[n] = '\0';
+  ar->pool_n += n+1;
+  return eslOK;
+
+ ERROR:
+  *ret_s = NULL;
+  return status;
+}
 /*------------------- end, ESL_MSA object -----------------------*/
 
 
@@ -803,6 +1031,82 @@ esl_msa_CreateDigital(const ESL_ALPHABET *abc, int nseq, int64_t alen)
   return NULL;
 }
 
+/* Function:  esl_msa_CreateDigitalArena()
+ * Synopsis:  Create a fixed-size digital <ESL_MSA> with slab-allocated rows.
+ *
+ * Purpose:   Same as <esl_msa_CreateArena()>, except the returned MSA
+ *            is configured for a digital alignment using internal
+ *            alphabet <abc>: each 64-byte aligned row is an <ax[i]>
+ *            of <alen+2> residues, with sentinels set at positions
+ *            0 and <alen+1>.
+ *
+ * Args:      <abc>  - digital alphabet
+ *            <nseq> - number of sequences
+ *            <alen> - length of alignment in columns
+ *
+ * Returns:   pointer to new MSA object, w/ all values initialized,
+ *            and <msa->nseq> set to <nseq>.
+ *
+ * Throws:    <NULL> on allocation failure, or if <alen> is -1.
+ */
+ESL_MSA *
+esl_msa_CreateDigitalArena(const ESL_ALPHABET *abc, int nseq, int64_t alen)
+{
+  ESL_MSA *msa = NULL;
+  int      i;
+  int      status;
+
+  if (alen < 0) ESL_XEXCEPTION(eslEINVAL, "arena MSA needs a known alen");
+
+  msa = msa_create_mostly(nseq, alen); /* aseq is null upon successful return */
+  if (msa == NULL) return NULL;
+  if ((status = msa_create_arena(msa, nseq, alen)) != eslOK) goto ERROR;
+
+  ESL_ALLOC(msa->ax,   sizeof(ESL_DSQ *) * msa->sqalloc);
+  for (i = 0; i < msa->sqalloc; i++)
+    msa->ax[i] = NULL;
+  for (i = 0; i < nseq; i++)
+    {
+      msa->ax[i] = (ESL_DSQ *) (msa->arena->rows + i * msa->arena->rowstride);
+      msa->ax[i][0] = msa->ax[i][alen+1] = eslDSQ_SENTINEL;
+    }
+  msa->nseq = nseq;
+
+  msa->abc    = (ESL_ALPHABET *) abc; /* this cast away from const-ness is deliberate & safe. */
+  msa->flags |= eslMSA_DIGITAL;
+  return msa;
+
+ ERROR:
+  esl_msa_Destroy(msa);
+  return NULL;
+}
+
+/* MSA_DIGITIZE: the work state of esl_msa_DigitizeParallel(). Rows
+ * are handed out in chunks, first to be validated (pass 1), then to
+ * be converted (pass 2).
+ */
+#define eslMSA_DIGITIZE_ROWS 64
+
+typedef struct {
+  const ESL_ALPHABET *abc;
+  ESL_MSA            *msa;
+  int                 pass;	/* 1 = validating; 2 = converting                 */
+  int                 next;	/* next chunk to claim in current pass            */
+  int                 nchunks;	/* number of chunks of rows                       */
+  int                 firstbad;	/* pass 1: lowest invalid row, or -1              */
+  int                 status;	/* pass 2: eslOK, or eslEMEM                      */
+#ifdef HAVE_PTHREAD
+  int                 use_lock;
+  pthread_mutex_t     lock;	/* protects next, firstbad, status                */
+#endif
+} MSA_DIGITIZE;
+
+static int  msa_digitize_next  (MSA_DIGITIZE *ctx);
+static void msa_digitize_rows  (MSA_DIGITIZE *ctx, int c, ESL_DSQ *tmp);
+#ifdef HAVE_PTHREAD
+static void msa_digitize_thread(void *arg);
+#endif
+
 /* Function:  esl_msa_Digitize()
  * Synopsis:  Digitizes an msa, converting it from text mode.
  *
@@ -838,44 +1142,215 @@ esl_msa_CreateDigital(const ESL_ALPHABET *abc, int nseq, int64_t alen)
 int
 esl_msa_Digitize(const ESL_ALPHABET *abc, ESL_MSA *msa, char *errbuf)
 {
-  char errbuf2[eslERRBUFSIZE];
-  int  i;
-  int  status;
+  return esl_msa_DigitizeParallel(abc, msa, 1, errbuf);
+}
+
+/* Function:  esl_msa_DigitizeParallel()
+ * Synopsis:  Digitizes an msa, using multiple threads.
+ *
+ * Purpose:   Same as <esl_msa_Digitize()>, using up to <ncpu>
+ *            threads. Chunks of rows are validated, then converted,
+ *            by whichever thread claims them next. Each row is only
+ *            touched by one thread, and the result is identical to
+ *            <esl_msa_Digitize()>'s, including the error message
+ *            for an invalid alignment (which names the first invalid
+ *            sequence).
+ *
+ * Args:      abc    - digital alphabet
+ *            msa    - multiple alignment to digitize
+ *            ncpu   - number of threads to use ($\geq 1$)
+ *            errbuf - optional: error message buffer, or <NULL>
+ *
+ * Returns:   <eslOK> on success; <eslEINVAL> if one or more sequences
+ *            contain invalid characters, and <msa> is unaltered.
+ *
+ * Throws:    <eslEMEM> on allocation failure; in this case, state of
+ *            <msa> may be wedged, and it should only be destroyed, not
+ *            used. <eslESYS> if a mutex can't be initialized.
+ */
+int
+esl_msa_DigitizeParallel(const ESL_ALPHABET *abc, ESL_MSA *msa, int ncpu, char *errbuf)
+{
+  char          errbuf2[eslERRBUFSIZE];
+  MSA_DIGITIZE  ctx;
+  ESL_DSQ      *tmp = NULL;
+  int           pass, c, i;
+  int           status;
+#ifdef HAVE_PTHREAD
+  ESL_THREADS  *thr = NULL;
+  int           t, nt;
+#endif
 
   /* Contract checks */
   if (msa->aseq == NULL)           ESL_EXCEPTION(eslEINVAL, "msa has no text alignment");
   if (msa->ax   != NULL)           ESL_EXCEPTION(eslEINVAL, "msa already has digital alignment");
   if (msa->flags & eslMSA_DIGITAL) ESL_EXCEPTION(eslEINVAL, "msa is flagged as digital");
 
-  /* Validate before we convert. Then we can leave the <aseq> untouched if
-   * any of the sequences contain invalid characters.
-   */
-  for (i = 0; i < msa->nseq; i++)
-    if (esl_abc_ValidateSeq(abc, msa->aseq[i], msa->alen, errbuf2) != eslOK) 
-      ESL_FAIL(eslEINVAL, errbuf, "%s: %s", msa->sqname[i], errbuf2);
+  ctx.abc      = abc;
+  ctx.msa      = msa;
+  ctx.nchunks  = (msa->nseq + eslMSA_DIGITIZE_ROWS - 1) / eslMSA_DIGITIZE_ROWS;
+  ctx.firstbad = -1;
+  ctx.status   = eslOK;
+#ifdef HAVE_PTHREAD
+  ctx.use_lock = FALSE;
+  if (ncpu > 1 && ctx.nchunks > 1)
+    {
+      if (pthread_mutex_init(&(ctx.lock), NULL) != 0) ESL_EXCEPTION(eslESYS, "mutex init failed");
+      ctx.use_lock = TRUE;
+    }
+#endif
 
-  /* Convert, sequence-by-sequence, free'ing aseq as we go.  */
-  ESL_ALLOC(msa->ax, msa->sqalloc * sizeof(ESL_DSQ *));
-  for (i = 0; i < msa->nseq; i++)
+  /* Validate before we convert (pass 1). Then we can leave the <aseq>
+   * untouched if any of the sequences contain invalid characters.
+   * Convert in pass 2, free'ing aseq rows as we go. Rows in an arena
+   * are converted in place, through a <tmp> row.
+   */
+  for (pass = 1; pass <= 2; pass++)
     {
-      ESL_ALLOC(msa->ax[i], (msa->alen+2) * sizeof(ESL_DSQ));
-      status = esl_abc_Digitize(abc, msa->aseq[i], msa->ax[i]);
-      if (status != eslOK) goto ERROR;
-      free(msa->aseq[i]);
-    }    
-  for (; i < msa->sqalloc; i++) 
-    msa->ax[i] = NULL;
+      if (pass == 2) 
+	{
+	  if (ctx.firstbad != -1) 
+	    {
+	      esl_abc_ValidateSeq(abc, msa->aseq[ctx.firstbad], msa->alen, errbuf2);
+	      ESL_XFAIL(eslEINVAL, errbuf, "%s: %s", msa->sqname[ctx.firstbad], errbuf2);
+	    }
+	  if (msa->arena) ESL_ALLOC(tmp, (msa->alen+2) * sizeof(ESL_DSQ));
+	  ESL_ALLOC(msa->ax, msa->sqalloc * sizeof(ESL_DSQ *));
+	  for (i = 0; i < msa->sqalloc; i++) msa->ax[i] = NULL;
+	}
+
+      ctx.pass = pass;
+      ctx.next = 0;
+#ifdef HAVE_PTHREAD
+      nt = ESL_MIN(ncpu, ctx.nchunks);
+      if (nt > 1)
+	{
+	  if ((thr = esl_threads_Create(&msa_digitize_thread)) == NULL) { status = eslEMEM; goto ERROR; }
+	  for (t = 0; t < nt; t++)
+	    if (esl_threads_AddThread(thr, (void *) &ctx) != eslOK) break; /* the serial loop picks up the slack */
+	  esl_threads_WaitForStart (thr);
+	  esl_threads_WaitForFinish(thr);
+	  esl_threads_Destroy(thr);
+	  thr = NULL;
+	}
+#endif
+      while ((c = msa_digitize_next(&ctx)) != -1) /* serial; or a no-op, after threads have done it all */
+	msa_digitize_rows(&ctx, c, tmp);
+      if (ctx.status != eslOK) { status = ctx.status; goto ERROR; }
+    }
+
   free(msa->aseq);
   msa->aseq = NULL;
 
+#ifdef HAVE_PTHREAD
+  if (ctx.use_lock) pthread_mutex_destroy(&(ctx.lock));
+#endif
+  if (tmp) free(tmp);
+
   msa->abc   =  (ESL_ALPHABET *) abc; /* convince compiler that removing const-ness is safe */
   msa->flags |= eslMSA_DIGITAL;
   return eslOK;
 
  ERROR:
+#ifdef HAVE_PTHREAD
+  if (ctx.use_lock) pthread_mutex_destroy(&(ctx.lock));
+#endif
+  if (tmp) free(tmp);
   return status;
 }
 
+/* msa_digitize_next()
+ * Claim the next chunk of rows, or return -1 if all have been claimed.
+ */
+static int
+msa_digitize_next(MSA_DIGITIZE *ctx)
+{
+  int c = -1;
+
+#ifdef HAVE_PTHREAD
+  if (ctx->use_lock) pthread_mutex_lock(&(ctx->lock));
+#endif
+  if (ctx->next < ctx->nchunks) c = ctx->next++;
+#ifdef HAVE_PTHREAD
+  if (ctx->use_lock) pthread_mutex_unlock(&(ctx->lock));
+#endif
+  return c;
+}
+
+/* msa_digitize_rows()
+ * Validate (pass 1) or convert (pass 2) the rows of chunk <c>.
+ * <tmp> is a scratch row for converting arena rows in place. 
+ * On an allocation failure, the rest of the chunk is left
+ * unconverted.
+ */
+static void
+msa_digitize_rows(MSA_DIGITIZE *ctx, int c, ESL_DSQ *tmp)
+{
+  ESL_MSA *msa    = ctx->msa;
+  int      i0     = c * eslMSA_DIGITIZE_ROWS;
+  int      i1     = ESL_MIN(msa->nseq, i0 + eslMSA_DIGITIZE_ROWS);
+  int      bad    = -1;
+  int      i;
+  int      status = eslOK;
+
+  if (ctx->pass == 1)
+    {
+      for (i = i0; i < i1; i++)
+	if (esl_abc_ValidateSeq(ctx->abc, msa->aseq[i], msa->alen, NULL) != eslOK) { bad = i; break; }
+      if (bad == -1) return;
+      goto ERROR;
+    }
+
+  for (i = i0; i < i1; i++)
+    {
+      if (msa_arena_contains(msa, msa->aseq[i]))
+	{
+	  esl_abc_Digitize(ctx->abc, msa->aseq[i], tmp);
+	  msa->ax[i] = (ESL_DSQ *) msa->aseq[i];
+	  memcpy(msa->ax[i], tmp, (msa->alen+2) * sizeof(ESL_DSQ));
+	  continue;
+	}
+      ESL_ALLOC(msa->ax[i], (msa->alen+2) * sizeof(ESL_DSQ));
+      esl_abc_Digitize(ctx->abc, msa->aseq[i], msa->ax[i]); /* can't fail: rows were validated */
+      free(msa->aseq[i]);
+      msa->aseq[i] = NULL;
+    }
+  return;
+
+ ERROR: /* pass 1: an invalid row; pass 2: an allocation failure */
+#ifdef HAVE_PTHREAD
+  if (ctx->use_lock) pthread_mutex_lock(&(ctx->lock));
+#endif
+  if (bad != -1 && (ctx->firstbad == -1 || bad < ctx->firstbad)) ctx->firstbad = bad;
+  if (status != eslOK) ctx->status = status;
+#ifdef HAVE_PTHREAD
+  if (ctx->use_lock) pthread_mutex_unlock(&(ctx->lock));
+#endif
+}
+
+#ifdef HAVE_PTHREAD
+static void
+msa_digitize_thread(void *arg)
+{
+  ESL_THREADS  *thr = (ESL_THREADS *) arg;
+  MSA_DIGITIZE *ctx;
+  ESL_DSQ      *tmp = NULL;
+  int           w;
+  int           c;
+
+  esl_threads_Started(thr, &w);
+  ctx = (MSA_DIGITIZE *) esl_threads_GetData(thr, w);
+
+  /* A thread that can't get its own <tmp> row leaves its share to the others. */
+  if (ctx->pass == 1 || ! ctx->msa->arena || (tmp = malloc((ctx->msa->alen+2) * sizeof(ESL_DSQ))) != NULL)
+    while ((c = msa_digitize_next(ctx)) != -1)
+      msa_digitize_rows(ctx, c, tmp);
+
+  if (tmp) free(tmp);
+  esl_threads_Finished(thr, w);
+}
+#endif /*HAVE_PTHREAD*/
+
 /* Function:  esl_msa_Textize()
  * Synopsis:  Convert a digital msa to text mode.
  *
@@ -898,8 +1373,9 @@ esl_msa_Digitize(const ESL_ALPHABET *abc, ESL_MSA *msa, char *errbuf)
 int
 esl_msa_Textize(ESL_MSA *msa)
 {
-  int status;
-  int i;
+  char *tmp = NULL;
+  int   status;
+  int   i;
 
   /* Contract checks
    */
@@ -909,10 +1385,19 @@ esl_msa_Textize(ESL_MSA *msa)
   if (msa->abc  == NULL)               ESL_EXCEPTION(eslEINVAL, "msa has no digital alphabet");
 
   /* Convert, sequence-by-sequence, free'ing ax as we go.
+   * Rows in an arena are converted in place, through <tmp>.
    */
+  if (msa->arena) ESL_ALLOC(tmp, (msa->alen+1) * sizeof(char));
   ESL_ALLOC(msa->aseq, msa->sqalloc * sizeof(char *));
   for (i = 0; i < msa->nseq; i++)
     {
+      if (msa_arena_contains(msa, msa->ax[i]))
+	{
+	  if ((status = esl_abc_Textize(msa->abc, msa->ax[i], msa->alen, tmp)) != eslOK) goto ERROR;
+	  msa->aseq[i] = (char *) msa->ax[i];
+	  memcpy(msa->aseq[i], tmp, (msa->alen+1) * sizeof(char));
+	  continue;
+	}
       ESL_ALLOC(msa->aseq[i], (msa->alen+1) * sizeof(char));
       status = esl_abc_Textize(msa->abc, msa->ax[i], msa->alen, msa->aseq[i]);
       if (status != eslOK) goto ERROR;
@@ -923,11 +1408,14 @@ esl_msa_Textize(ESL_MSA *msa)
   free(msa->ax);
   msa->ax = NULL;
   
+  if (tmp) free(tmp);
+  
   msa->abc    = NULL;      	 /* nullify reference (caller still owns real abc) */
   msa->flags &= ~eslMSA_DIGITAL; /* drop the flag */
   return eslOK;
 
  ERROR:
+  if (tmp) free(tmp);
   return status;
 }
 
@@ -1115,9 +1603,8 @@ esl_msa_SetSeqName(ESL_MSA *msa, int idx, const char *s, esl_pos_t n)
   if (idx  >= msa->sqalloc) ESL_EXCEPTION(eslEINCONCEIVABLE, "no such sequence %d (only %d allocated)", idx, msa->sqalloc);
   if (s == NULL)            ESL_EXCEPTION(eslEINCONCEIVABLE, "seq names are mandatory; NULL is not a valid name");
 
-  if (msa->sqname[idx]) free(msa->sqname[idx]);
-  if (n > 0) return esl_memstrdup(s,  n, &(msa->sqname[idx])); 
-  else       return esl_strdup(   s, -1, &(msa->sqname[idx])); 
+  msa_free_seqstr(msa, msa->sqname[idx]);
+  return msa_seqstrdup(msa, s, n, &(msa->sqname[idx]));
 }
 
 /* Function:  esl_msa_SetSeqAccession()
@@ -1148,7 +1635,7 @@ esl_msa_SetSeqAccession(ESL_MSA *msa, int idx, const char *s, esl_pos_t n)
 
   if (idx  >= msa->sqalloc) ESL_EXCEPTION(eslEINCONCEIVABLE, "no such sequence %d (only %d allocated)", idx, msa->sqalloc);
 
-  if (msa->sqacc && msa->sqacc[idx]) { free(msa->sqacc[idx]); msa->sqacc[idx] = NULL; }
+  if (msa->sqacc && msa->sqacc[idx]) { msa_free_seqstr(msa, msa->sqacc[idx]); msa->sqacc[idx] = NULL; }
 
   /* erasure case */
   if (! s) {				
@@ -1163,8 +1650,7 @@ esl_msa_SetSeqAccession(ESL_MSA *msa, int idx, const char *s, esl_pos_t n)
     for (i = 0; i < msa->sqalloc; i++) msa->sqacc[i] = NULL;
   } 
 
-  if (n > 0) status = esl_memstrdup(s,  n, &(msa->sqacc[idx])); 
-  else       status = esl_strdup(   s, -1, &(msa->sqacc[idx])); 
+  status = msa_seqstrdup(msa, s, n, &(msa->sqacc[idx]));
 
   return status;
   
@@ -1200,7 +1686,7 @@ esl_msa_SetSeqDescription(ESL_MSA *msa, int idx, const char *s, esl_pos_t n)
 
   if (idx  >= msa->sqalloc) ESL_EXCEPTION(eslEINCONCEIVABLE, "no such sequence %d (only %d allocated)", idx, msa->sqalloc);
 
-  if (msa->sqdesc && msa->sqdesc[idx]) { free(msa->sqdesc[idx]); msa->sqdesc[idx] = NULL; }
+  if (msa->sqdesc && msa->sqdesc[idx]) { msa_free_seqstr(msa, msa->sqdesc[idx]); msa->sqdesc[idx] = NULL; }
 
   /* erasure case */
   if (! s) {				
@@ -1215,8 +1701,7 @@ esl_msa_SetSeqDescription(ESL_MSA *msa, int idx, const char *s, esl_pos_t n)
     for (i = 0; i < msa->sqalloc; i++) msa->sqdesc[i] = NULL;
   } 
 
-  if (n > 0) status = esl_memstrdup(s,  n, &(msa->sqdesc[idx])); 
-  else       status = esl_strdup(   s, -1, &(msa->sqdesc[idx])); 
+  status = msa_seqstrdup(msa, s, n, &(msa->sqdesc[idx]));
 
  ERROR:
   return status;
@@ -1399,7 +1884,7 @@ esl_msa_FormatSeqName(ESL_MSA *msa, int idx, const char *name, ...)
   if (idx  >= msa->sqalloc) ESL_EXCEPTION(eslEINVAL, "no such sequence %d (only %d allocated)", idx, msa->sqalloc);
   if (name == NULL)         ESL_EXCEPTION(eslEINVAL, "seq names are mandatory; NULL is not a valid name");
 
-  if (msa->sqname[idx] != NULL) free(msa->sqname[idx]);
+  msa_free_seqstr(msa, msa->sqname[idx]);
 
   va_start(ap, name);
   status = esl_vsprintf(&(msa->sqname[idx]), name, &ap);
@@ -1428,7 +1913,7 @@ esl_msa_FormatSeqAccession(ESL_MSA *msa, int idx, const char *acc, ...)
 
   if (idx  >= msa->sqalloc) ESL_EXCEPTION(eslEINVAL, "no such sequence %d (only %d allocated)", idx, msa->sqalloc);
   if (acc == NULL) {
-    if (msa->sqacc != NULL) { free(msa->sqacc[idx]); msa->sqacc[idx] = NULL; }
+    if (msa->sqacc != NULL) { msa_free_seqstr(msa, msa->sqacc[idx]); msa->sqacc[idx] = NULL; }
     return eslOK;
   }
 
@@ -1437,7 +1922,7 @@ esl_msa_FormatSeqAccession(ESL_MSA *msa, int idx, const char *acc, ...)
     ESL_ALLOC(msa->sqacc, sizeof(char *) * msa->sqalloc);
     for (i = 0; i < msa->sqalloc; i++) msa->sqacc[i] = NULL;
   } 
-  if (msa->sqacc[idx] != NULL) free(msa->sqacc[idx]);
+  msa_free_seqstr(msa, msa->sqacc[idx]);
 
   va_start(ap, acc);
   status = esl_vsprintf(&(msa->sqacc[idx]), acc, &ap);
@@ -1469,7 +1954,7 @@ esl_msa_FormatSeqDescription(ESL_MSA *msa, int idx, const char *desc, ...)
 
   if (idx  >= msa->sqalloc) ESL_EXCEPTION(eslEINVAL, "no such sequence %d (only %d allocated)", idx, msa->sqalloc);
   if (desc == NULL) {
-    if (msa->sqdesc != NULL) { free(msa->sqdesc[idx]); msa->sqdesc[idx] = NULL; }
+    if (msa->sqdesc != NULL) { msa_free_seqstr(msa, msa->sqdesc[idx]); msa->sqdesc[idx] = NULL; }
     return eslOK;
   }
 
@@ -1478,7 +1963,7 @@ esl_msa_FormatSeqDescription(ESL_MSA *msa, int idx, const char *desc, ...)
     ESL_ALLOC(msa->sqdesc, sizeof(char *) * msa->sqalloc);
     for (i = 0; i < msa->sqalloc; i++) msa->sqdesc[i] = NULL;
   } 
-  if (msa->sqdesc[idx] != NULL) free(msa->sqdesc[idx]);
+  msa_free_seqstr(msa, msa->sqdesc[idx]);
 
   va_start(ap, desc);
   status = esl_vsprintf(&(msa->sqdesc[idx]), desc, &ap);
@@ -2186,9 +2671,13 @@ esl_msa_MarkFragments(ESL_MSA *msa, double fragthresh)
  *            
  *            <msa> may be in text mode or digital mode. The new MSA
  *            in <ret_new> will have the same mode.
+ *            
+ *            Any deferred annotation of <msa> is materialized first.
  *
  * Returns:   <eslOK> on success, and <ret_new> is set to point at a new
  *            (smaller) alignment.
+ *            <eslENOTFOUND> or <eslECORRUPT> if deferred annotation
+ *            can't be read; see <esl_msa_MaterializeAnnotation()>.
  *
  * Throws:    <eslEINVAL> if the subset has no sequences in it;
  *            <eslEMEM> on allocation error.
@@ -2205,6 +2694,7 @@ esl_msa_SequenceSubset(const ESL_MSA *msa, const int *useme, ESL_MSA **ret_new)
   int  status;
   
   *ret_new = NULL;
+  if (msa->lazy && (status = esl_msa_MaterializeAnnotation((ESL_MSA *) msa, NULL)) != eslOK) return status;
 
   nnew = 0; 
   for (oidx = 0; oidx < msa->nseq; oidx++)
@@ -2302,7 +2792,8 @@ esl_msa_SequenceSubset(const ESL_MSA *msa, const int *useme, ESL_MSA **ret_new)
  *            modified: <msa->alen> is reduced, <msa->aseq> is shrunk 
  *            (or <msa->ax>, in the case of a digital mode alignment), 
  *            and all associated per-residue or per-column annotation
- *            is shrunk.
+ *            is shrunk. Any deferred annotation (<msa->lazy>) is
+ *            materialized first.
  * 
  * Returns:   <eslOK> on success.
  *            Possibilities from <esl_msa_RemoveBrokenBasepairs()> call:
@@ -2319,6 +2810,9 @@ esl_msa_ColumnSubset(ESL_MSA *msa, char *errbuf, const int *useme)
   int     idx;			/* sequence index */
   int     i;			/* markup index */
 
+  /* Offsets of deferred annotation would be wrong in the new columns */
+  if (msa->lazy && (status = esl_msa_MaterializeAnnotation(msa, NULL)) != eslOK) return status;
+
   /* For RNA/DNA digital alignments only:
    * Remove any basepairs from SS_cons and individual sequence SS
    * for aln columns i,j for which useme[i-1] or useme[j-1] are FALSE 
@@ -2393,8 +2887,13 @@ esl_msa_ColumnSubset(ESL_MSA *msa, char *errbuf, const int *useme)
  *            okay if <consider_rf> is TRUE and <msa->rf> is NULL
  *            (no error is thrown), the function will behave as if 
  *            <consider_rf> is FALSE.
+ *            
+ *            Any deferred annotation (<msa->lazy>) is materialized
+ *            first.
  *
  * Returns:   <eslOK> on success.
+ *            <eslENOTFOUND> or <eslECORRUPT> if deferred annotation
+ *            can't be read; see <esl_msa_MaterializeAnnotation()>.
  * 
  * Throws:    <eslEMEM> on allocation failure.
  *            Possibilities from <esl_msa_ColumnSubset()> call:
@@ -2413,6 +2912,8 @@ esl_msa_MinimGaps(ESL_MSA *msa, char *errbuf, const char *gaps, int consider_rf)
   int     status;
   int     rf_is_nongap; /* TRUE if current position is not a gap in msa->rf OR msa->rf is NULL */
 
+  if (msa->lazy && (status = esl_msa_MaterializeAnnotation(msa, NULL)) != eslOK) return status;
+
 #ifdef eslAUGMENT_ALPHABET	   /* digital mode case */
   if (msa->flags & eslMSA_DIGITAL) /* be careful of off-by-one: useme is 0..L-1 indexed */
     {
@@ -2469,6 +2970,9 @@ esl_msa_MinimGaps(ESL_MSA *msa, char *errbuf, const char *gaps, int consider_rf)
  *            Ditto for the <gaps> string: we don't know what symbols
  *            are supposed to be gaps unless we're told something like 
  *            <"-_.~">.
+ *            
+ *            Any deferred annotation (<msa->lazy>) is materialized
+ *            first.
  *
  * Args:      msa         - alignment to remove all-gap cols from
  *            errbuf      - if non-<NULL>, space for an informative error message on failure
@@ -2493,6 +2997,8 @@ esl_msa_MinimGapsText(ESL_MSA *msa, char *errbuf, const char *gaps, int consider
   int     status;
   int     rf_is_nongap; /* TRUE if current position is not a gap in msa->rf OR msa->rf is NULL */
 
+  if (msa->lazy && (status = esl_msa_MaterializeAnnotation(msa, NULL)) != eslOK) return status;
+
   ESL_ALLOC(useme, sizeof(int) * (msa->alen+1)); /* +1 is just to deal w/ alen=0 special case */
 
   for (apos = 0; apos < msa->alen; apos++)
@@ -2840,9 +3346,12 @@ esl_msa_RemoveBrokenBasepairsFromSS(char *ss, char *errbuf, int len, const int *
  *            <useme>.
  * 
  *            If the original structure data is inconsistent it's left
- *            untouched.
+ *            untouched. Any deferred annotation (<msa->lazy>) is
+ *            materialized first.
  *
  * Returns:   <eslOK> on success.
+ *            <eslENOTFOUND> or <eslECORRUPT> if deferred annotation
+ *            can't be read; see <esl_msa_MaterializeAnnotation()>.
  *            <eslESYNTAX> if WUSS string for <SS_cons> or <msa->ss>
  *            following <esl_wuss_nopseudo()> is inconsistent.
  *            <eslEINVAL> if a derived ct array implies a pknotted 
@@ -2856,6 +3365,8 @@ esl_msa_RemoveBrokenBasepairs(ESL_MSA *msa, char *errbuf, const int *useme)
   int status;
   int  i;
 
+  if (msa->lazy && (status = esl_msa_MaterializeAnnotation(msa, NULL)) != eslOK) return status;
+
   if (msa->ss_cons) {
     if((status = esl_msa_RemoveBrokenBasepairsFromSS(msa->ss_cons, errbuf, msa->alen, useme)) != eslOK) return status; 
   }
@@ -2966,7 +3477,357 @@ esl_msa_Hash(ESL_MSA *msa)
 
 
 /*****************************************************************
- * 5. Debugging, testing, development
+ * 5. Deferred per-residue annotation
+ *****************************************************************/
+
+static int lazy_grow_blocks(ESL_MSA_LAZY *lz);
+static int lazy_destination(ESL_MSA *msa, const char *tag, int seqidx, char ***ret_dp);
+
+/* Function:  esl_msa_lazy_Create()
+ * Synopsis:  Create a record of deferred annotation.
+ *
+ * Purpose:   Create a new, empty <ESL_MSA_LAZY> for deferred
+ *            per-residue annotation whose text is in file
+ *            <filename>. A parser then adds each deferred line with
+ *            <esl_msa_lazy_AddLine()> as it sees it in the first
+ *            alignment block, records where its text is in each block
+ *            with <esl_msa_lazy_SetOffset()>, and calls
+ *            <esl_msa_lazy_EndBlock()> at the end of every block.
+ *
+ * Returns:   ptr to the new <ESL_MSA_LAZY>.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+ESL_MSA_LAZY *
+esl_msa_lazy_Create(const char *filename)
+{
+  ESL_MSA_LAZY *lz = NULL;
+  int           status;
+
+  ESL_ALLOC(lz, sizeof(ESL_MSA_LAZY));
+  lz->filename  = NULL;
+  lz->nline     = 0;
+  lz->lalloc    = 16;
+  lz->tag       = NULL;
+  lz->seqidx    = NULL;
+  lz->is_loaded = NULL;
+  lz->off       = NULL;
+  lz->nblock    = 0;
+  lz->balloc    = 16;
+  lz->bcol      = NULL;
+
+  if ((status = esl_strdup(filename, -1, &(lz->filename))) != eslOK) goto ERROR;
+  ESL_ALLOC(lz->tag,       sizeof(char *)      * lz->lalloc);
+  ESL_ALLOC(lz->seqidx,    sizeof(int)         * lz->lalloc);
+  ESL_ALLOC(lz->is_loaded, sizeof(int)         * lz->lalloc);
+  ESL_ALLOC(lz->off,       sizeof(esl_pos_t *) * lz->lalloc);
+  ESL_ALLOC(lz->bcol,      sizeof(int64_t)     * (lz->balloc+1));
+  lz->bcol[0] = 0;
+  return lz;
+
+ ERROR:
+  esl_msa_lazy_Destroy(lz);
+  return NULL;
+}
+
+/* Function:  esl_msa_lazy_AddLine()
+ * Synopsis:  Add a deferred annotation line.
+ *
+ * Purpose:   Add a new deferred annotation line to <lz>: a #=GR line
+ *            for sequence <seqidx> with tag <tag>, or if <seqidx> is
+ *            -1, a #=GC line with tag <tag>. <tag> is <taglen> bytes
+ *            long, or <taglen> is -1 if <tag> is a NUL-terminated
+ *            string. The new line's index is <lz->nline-1>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <lz> is unchanged.
+ */
+int
+esl_msa_lazy_AddLine(ESL_MSA_LAZY *lz, const char *tag, esl_pos_t taglen, int seqidx)
+{
+  int a = lz->nline;
+  int status;
+
+  if (lz->nline == lz->lalloc)
+    {
+      ESL_REALLOC(lz->tag,       sizeof(char *)      * lz->lalloc * 2);
+      ESL_REALLOC(lz->seqidx,    sizeof(int)         * lz->lalloc * 2);
+      ESL_REALLOC(lz->is_loaded, sizeof(int)         * lz->lalloc * 2);
+      ESL_REALLOC(lz->off,       sizeof(esl_pos_t *) * lz->lalloc * 2);
+      lz->lalloc *= 2;
+    }
+
+  lz->tag[a] = NULL;
+  lz->off[a] = NULL;
+  if ((status = esl_memstrdup(tag, (taglen == -1 ? strlen(tag) : taglen), &(lz->tag[a]))) != eslOK) goto ERROR;
+  ESL_ALLOC(lz->off[a], sizeof(esl_pos_t) * lz->balloc);
+  lz->seqidx[a]    = seqidx;
+  lz->is_loaded[a] = FALSE;
+  lz->nline++;
+  return eslOK;
+
+ ERROR:
+  if (lz->tag[a]) { free(lz->tag[a]); lz->tag[a] = NULL; }
+  return status;
+}
+
+/* Function:  esl_msa_lazy_SetOffset()
+ * Synopsis:  Record where a deferred line's text is in current block.
+ *
+ * Purpose:   Record that the text of deferred line <a> in the current
+ *            alignment block (block number <lz->nblock>) starts at
+ *            byte <offset> of the input file.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+esl_msa_lazy_SetOffset(ESL_MSA_LAZY *lz, int a, esl_pos_t offset)
+{
+  int status;
+
+  if (lz->nblock == lz->balloc && (status = lazy_grow_blocks(lz)) != eslOK) return status;
+  lz->off[a][lz->nblock] = offset;
+  return eslOK;
+}
+
+/* Function:  esl_msa_lazy_EndBlock()
+ * Synopsis:  End the current alignment block.
+ *
+ * Purpose:   End the current alignment block, which was <width>
+ *            columns wide.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+esl_msa_lazy_EndBlock(ESL_MSA_LAZY *lz, int64_t width)
+{
+  int status;
+
+  if (lz->nblock == lz->balloc && (status = lazy_grow_blocks(lz)) != eslOK) return status;
+  lz->bcol[lz->nblock+1] = lz->bcol[lz->nblock] + width;
+  lz->nblock++;
+  return eslOK;
+}
+
+/* Function:  esl_msa_lazy_Clone()
+ * Synopsis:  Duplicate a record of deferred annotation.
+ *
+ * Returns:   ptr to the new <ESL_MSA_LAZY>.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+ESL_MSA_LAZY *
+esl_msa_lazy_Clone(const ESL_MSA_LAZY *lz)
+{
+  ESL_MSA_LAZY *new = NULL;
+  int           a;
+
+  if ((new = esl_msa_lazy_Create(lz->filename)) == NULL) goto ERROR;
+  while (new->balloc < lz->balloc)
+    if (lazy_grow_blocks(new) != eslOK) goto ERROR;
+
+  for (a = 0; a < lz->nline; a++)
+    {
+      if (esl_msa_lazy_AddLine(new, lz->tag[a], -1, lz->seqidx[a]) != eslOK) goto ERROR;
+      memcpy(new->off[a], lz->off[a], sizeof(esl_pos_t) * lz->nblock);
+      new->is_loaded[a] = lz->is_loaded[a];
+    }
+  memcpy(new->bcol, lz->bcol, sizeof(int64_t) * (lz->nblock+1));
+  new->nblock = lz->nblock;
+  return new;
+
+ ERROR:
+  esl_msa_lazy_Destroy(new);
+  return NULL;
+}
+
+/* Function:  esl_msa_lazy_Destroy()
+ * Synopsis:  Free a record of deferred annotation.
+ */
+void
+esl_msa_lazy_Destroy(ESL_MSA_LAZY *lz)
+{
+  if (lz)
+    {
+      esl_Free2D((void **) lz->tag, lz->nline);
+      esl_Free2D((void **) lz->off, lz->nline);
+      if (lz->seqidx)    free(lz->seqidx);
+      if (lz->is_loaded) free(lz->is_loaded);
+      if (lz->bcol)      free(lz->bcol);
+      if (lz->filename)  free(lz->filename);
+      free(lz);
+    }
+}
+
+/* Function:  esl_msa_MaterializeAnnotation()
+ * Synopsis:  Read deferred per-residue annotation into an MSA.
+ *
+ * Purpose:   If the per-residue annotation of <msa> was deferred by
+ *            its parser (<msa->lazy> is non-NULL), read the text of
+ *            the deferred lines tagged <tag> from the input file, and
+ *            store it where the parser would have: for example, tag
+ *            <"SS_cons"> in <msa->ss_cons>, <"PP"> in <msa->pp[i]>,
+ *            and an unparsed tag in <msa->gc[]> or <msa->gr[][]>. If
+ *            <tag> is <NULL>, materialize all deferred lines. Lines
+ *            that are already materialized are skipped, so it's cheap
+ *            to call this before each access to annotation that may
+ *            have been deferred. Once all lines are materialized,
+ *            <msa->lazy> is freed and set to <NULL>.
+ *
+ *            If a field is already set (for example, the caller
+ *            computed its own <msa->rf>), it's left alone.
+ *
+ *            The input file must still exist and be unchanged since
+ *            <msa> was read.
+ *
+ * Args:      msa - alignment, perhaps with deferred annotation
+ *            tag - tag to materialize, such as "SS_cons"; or NULL for all
+ *
+ * Returns:   <eslOK> on success; or if <msa> has no deferred annotation.
+ *
+ *            <eslENOTFOUND> if the input file can't be opened.
+ *
+ *            <eslECORRUPT> if the input file is shorter than expected,
+ *            which means it changed since <msa> was read.
+ *
+ *            On either error, some annotation may already have been
+ *            materialized, and the rest is still deferred.
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ *            <eslEINCONCEIVABLE> if <msa> and its deferred annotation
+ *            don't agree.
+ */
+int
+esl_msa_MaterializeAnnotation(ESL_MSA *msa, const char *tag)
+{
+  ESL_MSA_LAZY *lz = msa->lazy;
+  ESL_BUFFER   *bf = NULL;
+  char        **dp;
+  int           a, b;
+  int           nloaded = 0;
+  int           status;
+
+  if (lz == NULL) return eslOK;
+  if (lz->bcol[lz->nblock] != msa->alen) ESL_EXCEPTION(eslEINCONCEIVABLE, "deferred annotation doesn't match alignment length");
+
+  for (a = 0; a < lz->nline; a++)
+    {
+      if (! lz->is_loaded[a] && (tag == NULL || strcmp(tag, lz->tag[a]) == 0))
+	{
+	  if ((status = lazy_destination(msa, lz->tag[a], lz->seqidx[a], &dp)) != eslOK) goto ERROR;
+
+	  if (*dp == NULL)
+	    {
+	      if (! bf && (status = esl_buffer_OpenFile(lz->filename, &bf)) != eslOK) goto ERROR;
+
+	      ESL_ALLOC(*dp, sizeof(char) * (msa->alen+1));
+	      for (b = 0; b < lz->nblock; b++)
+		{
+		  status = esl_buffer_SetOffset(bf, lz->off[a][b]);
+		  if (status == eslOK) status = esl_buffer_Read(bf, lz->bcol[b+1] - lz->bcol[b], *dp + lz->bcol[b]);
+		  if (status == eslEOF) status = eslECORRUPT;
+		  if (status != eslOK) { free(*dp); *dp = NULL; goto ERROR; }
+		}
+	      (*dp)[msa->alen] = '\0';
+	    }
+	  lz->is_loaded[a] = TRUE;
+	}
+      if (lz->is_loaded[a]) nloaded++;
+    }
+
+  if (nloaded == lz->nline) { esl_msa_lazy_Destroy(lz); msa->lazy = NULL; }
+  if (bf) esl_buffer_Close(bf);
+  return eslOK;
+
+ ERROR:
+  if (bf) esl_buffer_Close(bf);
+  return status;
+}
+
+
+/* lazy_grow_blocks()
+ * Double the number of blocks <lz> has room for.
+ */
+static int
+lazy_grow_blocks(ESL_MSA_LAZY *lz)
+{
+  int a;
+  int status;
+
+  ESL_REALLOC(lz->bcol, sizeof(int64_t) * (lz->balloc * 2 + 1));
+  for (a = 0; a < lz->nline; a++)
+    ESL_REALLOC(lz->off[a], sizeof(esl_pos_t) * lz->balloc * 2);
+  lz->balloc *= 2;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* lazy_destination()
+ * Find where the text of a deferred line with <tag> and <seqidx>
+ * (-1 for #=GC) belongs in <msa>; return a ptr to that string ptr in
+ * <*ret_dp>. Allocates <msa->ss>, <msa->sa>, or <msa->pp> if needed.
+ */
+static int
+lazy_destination(ESL_MSA *msa, const char *tag, int seqidx, char ***ret_dp)
+{
+  char ***dpp = NULL;
+  int     z;
+  int     status;
+
+  if (seqidx == -1)
+    {
+      if      (strcmp(tag, "SS_cons") == 0) *ret_dp = &(msa->ss_cons);
+      else if (strcmp(tag, "SA_cons") == 0) *ret_dp = &(msa->sa_cons);
+      else if (strcmp(tag, "PP_cons") == 0) *ret_dp = &(msa->pp_cons);
+      else if (strcmp(tag, "RF")      == 0) *ret_dp = &(msa->rf);
+      else if (strcmp(tag, "MM")      == 0) *ret_dp = &(msa->mm);
+      else
+	{
+	  for (z = 0; z < msa->ngc; z++)
+	    if (strcmp(tag, msa->gc_tag[z]) == 0) break;
+	  if (z == msa->ngc) ESL_EXCEPTION(eslEINCONCEIVABLE, "deferred #=GC %s line has no tag in msa", tag);
+	  *ret_dp = &(msa->gc[z]);
+	}
+      return eslOK;
+    }
+
+  if (seqidx >= msa->nseq) ESL_EXCEPTION(eslEINCONCEIVABLE, "deferred #=GR line for a seq that isn't in msa");
+  if      (strcmp(tag, "SS") == 0) dpp = &(msa->ss);
+  else if (strcmp(tag, "SA") == 0) dpp = &(msa->sa);
+  else if (strcmp(tag, "PP") == 0) dpp = &(msa->pp);
+
+  if (dpp)
+    {
+      if (*dpp == NULL) {
+	ESL_ALLOC(*dpp, sizeof(char *) * msa->sqalloc);
+	for (z = 0; z < msa->sqalloc; z++) (*dpp)[z] = NULL;
+      }
+      *ret_dp = &((*dpp)[seqidx]);
+    }
+  else
+    {
+      for (z = 0; z < msa->ngr; z++)
+	if (strcmp(tag, msa->gr_tag[z]) == 0) break;
+      if (z == msa->ngr) ESL_EXCEPTION(eslEINCONCEIVABLE, "deferred #=GR %s line has no tag in msa", tag);
+      *ret_dp = &(msa->gr[z][seqidx]);
+    }
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+/*------------- end, deferred per-residue annotation ------------*/
+
+
+/*****************************************************************
+ * 6. Debugging, testing, development
  *****************************************************************/
 
 /* Function:  esl_msa_Validate()
@@ -3127,15 +3988,20 @@ esl_msa_CompareMandatory(ESL_MSA *a1, ESL_MSA *a2)
  * Incept:    SRE, Wed Jun 13 09:52:48 2007 [Janelia]
  *
  * Purpose:   Compare optional contents of two MSAs, <a1> and <a2>.
+ *            Deferred annotation of either is materialized first.
  *
  * Returns:   <eslOK> if the MSAs are identical; 
- *            <eslFAIL> if they are not.
+ *            <eslFAIL> if they are not, or if deferred annotation
+ *            can't be read.
  */
 int
 esl_msa_CompareOptional(ESL_MSA *a1, ESL_MSA *a2)
 {
   int i;
 
+  if (esl_msa_MaterializeAnnotation(a1, NULL) != eslOK) return eslFAIL;
+  if (esl_msa_MaterializeAnnotation(a2, NULL) != eslOK) return eslFAIL;
+
   if (esl_CCompare(a1->name,    a2->name)    != eslOK) return eslFAIL;
   if (esl_CCompare(a1->desc,    a2->desc)    != eslOK) return eslFAIL;
   if (esl_CCompare(a1->acc,     a2->acc)     != eslOK) return eslFAIL;
@@ -3178,7 +4044,7 @@ esl_msa_CompareOptional(ESL_MSA *a1, ESL_MSA *a2)
 
 
 /******************************************************************************
- * 15. Unit tests
+ * 7. Unit tests
  *****************************************************************************/
 #ifdef eslMSA_TESTDRIVE
 
@@ -3375,6 +4241,109 @@ utest_Textize(ESL_ALPHABET *abc, char *filename)
 }
 #endif /*eslAUGMENT_ALPHABET*/
 
+/* utest_DigitizeParallel()
+ * Build a synthetic alignment big enough to be split into several
+ * chunks of rows, in a malloc'ed or arena MSA; check that invalid
+ * characters are reported for the first bad row no matter how many
+ * threads see them, leaving the msa untouched; then check the
+ * digitized rows residue by residue.
+ */
+#ifdef eslAUGMENT_ALPHABET
+static void
+utest_DigitizeParallel(const ESL_ALPHABET *abc, int use_arena, int ncpu)
+{
+  char     *msg     = "DigitizeParallel() unit test failure";
+  char     *symlist = "ACDEFGHIKLMNPQRSTVWY-acd.";
+  int       nseq    = 300;
+  int       alen    = 123;
+  ESL_MSA  *msa     = NULL;
+  char      errbuf[eslERRBUFSIZE];
+  int       i, j;
+
+  msa = (use_arena ? esl_msa_CreateArena(nseq, alen) : esl_msa_Create(nseq, alen));
+  if (msa == NULL) esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    {
+      if (esl_msa_FormatSeqName(msa, i, "seq%d", i) != eslOK) esl_fatal(msg);
+      for (j = 0; j < alen; j++) msa->aseq[i][j] = symlist[(i*7 + j*3) % 25];
+      msa->aseq[i][alen] = '\0';
+    }
+  msa->alen = alen;
+
+  msa->aseq[250][100] = '%';
+  msa->aseq[70][5]    = '%';
+  if (esl_msa_DigitizeParallel(abc, msa, ncpu, errbuf) != eslEINVAL) esl_fatal(msg);
+  if (strncmp(errbuf, "seq70:", 6)   != 0)                           esl_fatal(msg);
+  if (msa->ax != NULL || msa->aseq == NULL || (msa->flags & eslMSA_DIGITAL)) esl_fatal(msg);
+  if (msa->aseq[69][5] != symlist[(69*7 + 5*3) % 25])                esl_fatal(msg);
+  msa->aseq[250][100] = symlist[(250*7 + 100*3) % 25];
+  msa->aseq[70][5]    = symlist[(70*7 + 5*3) % 25];
+
+  if (esl_msa_DigitizeParallel(abc, msa, ncpu, errbuf) != eslOK)     esl_fatal(msg);
+  if (msa->aseq != NULL || ! (msa->flags & eslMSA_DIGITAL))          esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    {
+      if (msa->ax[i][0] != eslDSQ_SENTINEL || msa->ax[i][alen+1] != eslDSQ_SENTINEL) esl_fatal(msg);
+      for (j = 0; j < alen; j++)
+	if (msa->ax[i][j+1] != esl_abc_DigitizeSymbol(abc, symlist[(i*7 + j*3) % 25])) esl_fatal(msg);
+    }
+  esl_msa_Destroy(msa);
+}
+#endif /*eslAUGMENT_ALPHABET*/
+
+/* utest_Arena()
+ * Copy the known alignment <m1> into an arena MSA; check row alignment,
+ * name/acc/desc setting and resetting (pooled and malloc'ed strings
+ * mixed together), cloning, and in-place digitization round trips.
+ */
+#ifdef eslAUGMENT_ALPHABET
+static void
+utest_Arena(ESL_MSA *m1, const ESL_ALPHABET *abc)
+{
+  char    *msg = "Arena unit test failure";
+  ESL_MSA *m2  = NULL;
+  ESL_MSA *m3  = NULL;
+  int      i;
+
+  if ((m2 = esl_msa_CreateArena(m1->nseq, m1->alen)) == NULL) esl_fatal(msg);
+  if (m2->nseq != m1->nseq)                                    esl_fatal(msg);
+  for (i = 0; i < m2->nseq; i++)
+    {
+      if (((uintptr_t) m2->aseq[i]) % 64 != 0)                                esl_fatal(msg);
+      strcpy(m2->aseq[i], m1->aseq[i]);
+      if (esl_msa_SetSeqName       (m2, i, "placeholder", -1) != eslOK)       esl_fatal(msg);
+      if (esl_msa_SetSeqName       (m2, i, m1->sqname[i], -1) != eslOK)       esl_fatal(msg);
+      if (esl_msa_SetSeqAccession  (m2, i, "PF00001", 5)      != eslOK)       esl_fatal(msg);
+      if (esl_msa_FormatSeqDescription(m2, i, "seq %d", i)    != eslOK)       esl_fatal(msg);
+    }
+  if (strcmp(m2->sqacc[0],  "PF000")  != 0) esl_fatal(msg);
+  if (strcmp(m2->sqdesc[2], "seq 2")  != 0) esl_fatal(msg);
+  if (esl_msa_FormatSeqName(m2, 0, "tmp%d", 0)    != eslOK) esl_fatal(msg);
+  if (esl_msa_SetSeqName   (m2, 0, m1->sqname[0], -1) != eslOK) esl_fatal(msg);
+  compare_to_known(m2);
+
+  if ((m3 = esl_msa_Clone(m2)) == NULL)     esl_fatal(msg);
+  if (m3->arena == NULL)                    esl_fatal(msg);
+  compare_to_known(m3);
+  esl_msa_Destroy(m3);
+
+  if (esl_msa_Digitize(abc, m2, NULL) != eslOK) esl_fatal(msg);
+  compare_to_known(m2);
+  if ((m3 = esl_msa_Clone(m2)) == NULL)         esl_fatal(msg);
+  compare_to_known(m3);
+  if (esl_msa_Textize(m2) != eslOK)             esl_fatal(msg);
+  compare_to_known(m2);
+  esl_msa_Destroy(m3);
+
+  if ((m3 = esl_msa_CreateDigitalArena(abc, 4, 10)) == NULL)   esl_fatal(msg);
+  for (i = 0; i < m3->nseq; i++)
+    if (m3->ax[i][0] != eslDSQ_SENTINEL || m3->ax[i][11] != eslDSQ_SENTINEL || ((uintptr_t) m3->ax[i]) % 64 != 0) esl_fatal(msg);
+  esl_msa_Destroy(m3);
+  esl_msa_Destroy(m2);
+  return;
+}
+#endif /*eslAUGMENT_ALPHABET*/
+
 static void
 utest_SequenceSubset(ESL_MSA *m1)
 {
@@ -3613,7 +4582,7 @@ utest_ZeroLengthMSA(const char *tmpfile)
 
 
 /*****************************************************************************
- * 7. Test driver
+ * 8. Test driver
  *****************************************************************************/
 #ifdef eslMSA_TESTDRIVE
 /* 
@@ -3691,6 +4660,16 @@ main(int argc, char **argv)
   utest_CreateDigital(abc);
   utest_Digitize(abc, tmpfile);
   utest_Textize(abc, tmpfile);
+  utest_DigitizeParallel(abc, FALSE, 1);
+  utest_DigitizeParallel(abc, FALSE, 3);
+  utest_DigitizeParallel(abc, TRUE,  1);
+  utest_DigitizeParallel(abc, TRUE,  3);
+
+  if (eslx_msafile_Open(NULL, tmpfile, NULL, eslMSAFILE_STOCKHOLM, NULL, &mfp) != eslOK)  esl_fatal("MSA text open failed");
+  esl_msa_Destroy(msa);
+  if (eslx_msafile_Read(mfp, &msa) != eslOK)  esl_fatal("MSA text read failed");
+  eslx_msafile_Close(mfp);
+  utest_Arena(msa, abc);
 
   esl_alphabet_Destroy(abc);
   esl_msa_Destroy(msa);
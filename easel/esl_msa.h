@@ -22,6 +22,50 @@
 #define eslMSA_NCUTS   6
 /*::cexcerpt::msa_cutoffs::end::*/
 
+/* Object: ESL_MSA_LAZY
+ *
+ * Per-residue annotation that a parser deferred (Stockholm #=GR and
+ * #=GC lines, when the input was opened with
+ * <eslx_msafile_SetLazyAnnotation()>). Instead of the text, only
+ * where it is in the input file is kept: in alignment block <b>, the
+ * text of deferred line <a> (columns <bcol[b]..bcol[b+1]-1>) starts
+ * at byte <off[a][b]> of <filename>. <esl_msa_MaterializeAnnotation()>
+ * reads it into the usual <ESL_MSA> fields on demand.
+ */
+typedef struct {
+  char       *filename;   /* input file that the offsets refer to                       */
+  int         nline;      /* number of deferred annotation lines                        */
+  int         lalloc;     /* number of lines allocated for                              */
+  char      **tag;        /* tag[a]: #=GC or #=GR tag of line a, e.g. "SS_cons", "PP"  */
+  int        *seqidx;     /* seqidx[a]: seq index of #=GR line a; -1 for a #=GC line    */
+  int        *is_loaded;  /* is_loaded[a]: TRUE once line a has been materialized       */
+  esl_pos_t **off;        /* off[a][b]: offset of the text of line a in block b         */
+  int         nblock;     /* number of complete alignment blocks                        */
+  int         balloc;     /* number of blocks allocated for, in bcol[] and each off[a]  */
+  int64_t    *bcol;       /* bcol[0..nblock]: block b is columns bcol[b]..bcol[b+1]-1   */
+} ESL_MSA_LAZY;
+
+
+/* Object: ESL_MSA_ARENA
+ *
+ * Memory of an MSA created by <esl_msa_CreateArena()> or
+ * <esl_msa_CreateDigitalArena()>: all aligned sequences are rows of
+ * one 64-byte aligned residue matrix, and sequence names,
+ * accessions, and descriptions are allocated from a string pool.
+ */
+typedef struct {
+  void     *mem;         /* allocation that <rows> is aligned within                     */
+  char     *rows;        /* residue matrix; row i is rows + i*rowstride, 64-byte aligned  */
+  int64_t   rowstride;   /* bytes per row: a multiple of 64, >= alen+2                    */
+  int       nrows;       /* number of rows                                                */
+  char    **pool;        /* string pool blocks pool[0..npool-1]                           */
+  int64_t  *poolsize;    /* poolsize[k]: size of block k, in bytes                        */
+  int       npool;       /* number of blocks in the pool                                  */
+  int       palloc;      /* number of blocks allocated for                                */
+  int64_t   pool_n;      /* number of bytes used in the last block, pool[npool-1]         */
+} ESL_MSA_ARENA;
+
+
 /* Object: ESL_MSA
  * 
  * A multiple sequence alignment.
@@ -78,6 +122,7 @@ typedef struct {
   int64_t *salen;               /* individual sa lengths during parsing     */
   int64_t *pplen;               /* individual pp lengths during parsing     */
   int      lastidx;		/* last index we saw; use for guessing next */
+  ESL_MSA_ARENA *arena;         /* rows, seq names in an arena; or NULL     */
 
   /* Optional information, especially Stockholm markup.
    * (The stuff we don't understand, but we can regurgitate.)
@@ -107,6 +152,8 @@ typedef struct {
   char ***gr;                   /* [0..ngr-1][0..nseq-1][0..alen-1] markup */
   int     ngr;			/* number of #=GR tag types                */
 
+  ESL_MSA_LAZY *lazy;           /* deferred #=GC, #=GR text; or NULL       */
+
   /* Optional augmentation w/ keyhashes. 
    * This can significantly speed up parsing of large alignments
    * with many (>1,000) sequences.
@@ -134,6 +181,7 @@ typedef struct {
 
 /* 1. The ESL_MSA object */
 extern ESL_MSA *esl_msa_Create(int nseq, int64_t alen);
+extern ESL_MSA *esl_msa_CreateArena(int nseq, int64_t alen);
 extern int      esl_msa_Expand(ESL_MSA *msa);
 extern int      esl_msa_Copy (const ESL_MSA *msa, ESL_MSA *new);
 extern ESL_MSA *esl_msa_Clone(const ESL_MSA *msa);
@@ -143,7 +191,9 @@ extern void     esl_msa_Destroy(ESL_MSA *msa);
 #ifdef eslAUGMENT_ALPHABET
 extern int      esl_msa_GuessAlphabet(const ESL_MSA *msa, int *ret_type);
 extern ESL_MSA *esl_msa_CreateDigital(const ESL_ALPHABET *abc, int nseq, int64_t alen);
+extern ESL_MSA *esl_msa_CreateDigitalArena(const ESL_ALPHABET *abc, int nseq, int64_t alen);
 extern int      esl_msa_Digitize(const ESL_ALPHABET *abc, ESL_MSA *msa, char *errmsg);
+extern int      esl_msa_DigitizeParallel(const ESL_ALPHABET *abc, ESL_MSA *msa, int ncpu, char *errmsg);
 extern int      esl_msa_Textize(ESL_MSA *msa);
 extern int      esl_msa_ConvertDegen2X(ESL_MSA *msa);
 #endif /*eslAUGMENT_ALPHABET*/
@@ -192,7 +242,16 @@ extern int esl_msa_RemoveBrokenBasepairs(ESL_MSA *msa, char *errbuf, const int *
 extern int esl_msa_Hash(ESL_MSA *msa);
 #endif
 
-/* 5. Debugging, testing, development */
+/* 5. Deferred per-residue annotation */
+extern ESL_MSA_LAZY *esl_msa_lazy_Create(const char *filename);
+extern int           esl_msa_lazy_AddLine  (ESL_MSA_LAZY *lz, const char *tag, esl_pos_t taglen, int seqidx);
+extern int           esl_msa_lazy_SetOffset(ESL_MSA_LAZY *lz, int a, esl_pos_t offset);
+extern int           esl_msa_lazy_EndBlock (ESL_MSA_LAZY *lz, int64_t width);
+extern ESL_MSA_LAZY *esl_msa_lazy_Clone(const ESL_MSA_LAZY *lz);
+extern void          esl_msa_lazy_Destroy(ESL_MSA_LAZY *lz);
+extern int           esl_msa_MaterializeAnnotation(ESL_MSA *msa, const char *tag);
+
+/* 6. Debugging, testing, development */
 extern int      esl_msa_Validate(const ESL_MSA *msa, char *errmsg);
 extern ESL_MSA *esl_msa_CreateFromString(const char *s, int fmt);
 extern int      esl_msa_Compare         (ESL_MSA *a1, ESL_MSA *a2);
@@ -6,8 +6,9 @@
  *    3. Some internal functions needed for regression tests
  *    4. Unit tests
  *    5. Test driver
- *    6. Example
- *    7. Copyright and license.
+ *    6. Benchmark
+ *    7. Example
+ *    8. Copyright and license.
  * 
  *  Augmentations:
  *    eslAUGMENT_ALPHABET:  adds support for digital MSAs
@@ -20,10 +21,15 @@
  */
 #include "esl_config.h"
 
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+
 #include "easel.h"
 #include "esl_cluster.h"
 #include "esl_distance.h"
 #include "esl_msa.h"
+#include "esl_random.h"
 #ifdef eslAUGMENT_ALPHABET
 #include "esl_alphabet.h"
 #endif
@@ -33,7 +39,6 @@
  * testing section further below:
  */
 #if defined(eslMSACLUSTER_REGRESSION) || defined(eslMSAWEIGHT_REGRESSION)
-#include <ctype.h>
 static double squid_distance(char *s1, char *s2);
 #ifdef eslAUGMENT_ALPHABET
 static double squid_xdistance(ESL_ALPHABET *a, ESL_DSQ *x1, ESL_DSQ *x2);
@@ -48,13 +53,31 @@ static int msacluster_clinkage(const void *v1, const void *v2, const void *p, in
 static int msacluster_xlinkage(const void *v1, const void *v2, const void *p, int *ret_link);
 #endif
 
-/* In digital mode, we'll need to pass the clustering routine two parameters -
- * %id threshold and alphabet ptr - so make a structure that bundles them.
+/* Approximate mode buckets rows by hashing their residues in random
+ * bands of columns (see esl_msacluster_SingleLinkageApprox()):
+ */
+#define eslMSACLUSTER_LSH_MAXW    64  /* max columns per band                                 */
+#define eslMSACLUSTER_LSH_WINDOW  64  /* compare a seq to at most this many earlier ones in a bucket */
+struct lsh_key_s {
+  uint64_t key;
+  int      idx;
+};
+static int msacluster_lsh_key(const ESL_MSA *msa, int i, const int *cols, int w, uint64_t *ret_key);
+static int msacluster_lsh_key_compare(const void *v1, const void *v2);
+static int msacluster_uf_find(int *parent, int i);
+static int msacluster_pair_compare(const void *v1, const void *v2);
+
+/* In digital mode, we'll need to pass the clustering routine several parameters -
+ * %id threshold, alphabet ptr, and the alignment, both as is and
+ * bit-sliced for fast %id - so make a structure that bundles them.
+ * The clustering routine then works on an array of sequence indices.
  */
 #ifdef eslAUGMENT_ALPHABET
 struct msa_param_s {
   double        maxid;
   ESL_ALPHABET *abc;
+  ESL_DSQ     **ax;
+  ESL_DST_BITS *bits;
 };
 #endif
 
@@ -129,6 +152,8 @@ esl_msacluster_SingleLinkage(const ESL_MSA *msa, double maxid,
   int   i;
 #ifdef eslAUGMENT_ALPHABET
   struct msa_param_s param;
+  int  *idx        = NULL;
+  param.bits       = NULL;
 #endif
 
   /* Allocations */
@@ -144,11 +169,18 @@ esl_msacluster_SingleLinkage(const ESL_MSA *msa, double maxid,
   else {
     param.maxid = maxid;
     param.abc   = msa->abc;
-    status = esl_cluster_SingleLinkage((void *) msa->ax, (size_t) msa->nseq, sizeof(ESL_DSQ *),
+    param.ax    = msa->ax;
+    if ((status = esl_dst_bits_Create(msa->abc, msa->ax, msa->nseq, &(param.bits))) != eslOK) goto ERROR;
+    ESL_ALLOC(idx, sizeof(int) * msa->nseq);
+    for (i = 0; i < msa->nseq; i++) idx[i] = i;
+    status = esl_cluster_SingleLinkage((void *) idx, (size_t) msa->nseq, sizeof(int),
 				       msacluster_xlinkage, (void *) &param, 
 				       workspace, assignment, &nc);
+    free(idx);                      idx        = NULL;
+    esl_dst_bits_Destroy(param.bits); param.bits = NULL;
   }
 #endif
+  if (status != eslOK) goto ERROR;
 
   if (opt_nin != NULL) 
     {
@@ -169,12 +201,299 @@ esl_msacluster_SingleLinkage(const ESL_MSA *msa, double maxid,
   if (workspace  != NULL) free(workspace);
   if (assignment != NULL) free(assignment);
   if (nin        != NULL) free(nin);
+#ifdef eslAUGMENT_ALPHABET
+  if (idx        != NULL) free(idx);
+  esl_dst_bits_Destroy(param.bits);
+#endif
   if (opt_c  != NULL) *opt_c  = NULL;
   if (opt_nc != NULL) *opt_nc = 0;
   return status;
 }
 
 
+/* Function:  esl_msacluster_SingleLinkageApprox()
+ * Synopsis:  Approximate single linkage clustering, for very large MSAs.
+ *
+ * Purpose:   Same as <esl_msacluster_SingleLinkage()>, but only tests
+ *            candidate pairs found by locality-sensitive hashing on
+ *            aligned columns, rather than (in the worst case) all
+ *            $N^2$ pairs. Meant for alignments of $10^5$--$10^6$
+ *            sequences, where exact clustering is impractical.
+ *
+ *            <nbands> random bands of <bandw> alignment columns each
+ *            are sampled using the random number generator <r>. For
+ *            each band, sequences are bucketed by the residues they
+ *            have in the band's columns. Sequences that share a
+ *            bucket in any band are candidates, and each candidate
+ *            pair is tested with the exact %id linkage rule. A pair
+ *            at identity $p$ lands in the same bucket in a band with
+ *            probability about $p^w$, so it is a candidate with
+ *            probability about $1 - (1 - p^w)^b$. Rows that have no
+ *            residues in a band are not bucketed in that band.
+ *
+ *            If <bandw> is $\leq 0$, it is chosen so that a pair at
+ *            exactly <maxid> collides in one band with probability
+ *            about 0.1. If <nbands> is $\leq 0$, the default of 32 is
+ *            used. With these defaults, a pair at exactly <maxid>
+ *            is a candidate with probability about 0.97, and more
+ *            similar pairs are almost certain to be candidates.
+ *
+ *            In a very large bucket, each sequence is compared to
+ *            only the 64 sequences before it in the bucket. This
+ *            caps the cost of buckets made by highly conserved
+ *            columns.
+ *
+ *            Every link found is a true link, so each approximate
+ *            cluster lies entirely inside one exact cluster. An exact
+ *            cluster may be split into several approximate ones if
+ *            the links holding it together were missed. Use
+ *            <esl_msacluster_PairRecall()> to measure how close the
+ *            result is to the exact clustering. Clusters are numbered
+ *            in order of their lowest-numbered sequence.
+ *
+ *            If <maxid> is $\leq 0$, or <msa> has fewer than two
+ *            sequences or no columns, this just calls the exact
+ *            <esl_msacluster_SingleLinkage()>.
+ *
+ * Args:      msa     - multiple alignment to cluster
+ *            maxid   - pairwise identity threshold: cluster if $\geq$ <maxid>
+ *            nbands  - number of LSH bands; $\leq 0$ for the default
+ *            bandw   - columns per band; $\leq 0$ to choose from <maxid>
+ *            r       - random number generator, used to choose band columns
+ *            opt_c   - optRETURN: cluster assignments for each sequence, [0..nseq-1]
+ *            opt_nin - optRETURN: number of seqs in each cluster, [0..nc-1] 
+ *            opt_nc  - optRETURN: number of clusters        
+ *
+ * Returns:   <eslOK> on success, and <opt_c>, <opt_nin>, <opt_nc> are
+ *            as for <esl_msacluster_SingleLinkage()>.
+ *
+ * Throws:    <eslEMEM> on allocation failure, and <eslEINVAL> if a pairwise
+ *            comparison is invalid. In either case, <opt_c> and
+ *            <opt_nin> are set to <NULL>, <opt_nc> is set to 0, and
+ *            the <msa> is unmodified.
+ */
+int
+esl_msacluster_SingleLinkageApprox(const ESL_MSA *msa, double maxid, int nbands, int bandw, ESL_RANDOMNESS *r,
+				   int **opt_c, int **opt_nin, int *opt_nc)
+{
+  struct lsh_key_s *keys   = NULL;
+  int              *cols   = NULL;
+  int              *parent = NULL;
+  int              *size   = NULL;
+  int              *assignment = NULL;
+  int              *nin    = NULL;
+  void             *base;
+  size_t            elemsize;
+  void             *param;
+  int             (*linkfunc)(const void *, const void *, const void *, int *);
+  int               nkeys;
+  int               nc;
+  int               b, i, s, t, a1, a2;
+  int               start, end;
+  int               do_link;
+  int               status;
+#ifdef eslAUGMENT_ALPHABET
+  struct msa_param_s xparam;
+  int              *idx = NULL;
+  xparam.bits           = NULL;
+#endif
+
+  if (maxid <= 0. || msa->nseq < 2 || msa->alen < 1)
+    return esl_msacluster_SingleLinkage(msa, maxid, opt_c, opt_nin, opt_nc);
+
+  if (nbands <= 0) nbands = 32;
+  if (bandw  <= 0) bandw  = (maxid >= 1. ? eslMSACLUSTER_LSH_MAXW : (int) ceil(log(0.1) / log(maxid)));
+  bandw = ESL_MAX(1, ESL_MIN(bandw, eslMSACLUSTER_LSH_MAXW));
+
+  /* Exact linkage, for testing candidate pairs: the same callbacks that exact mode uses */
+  if (! (msa->flags & eslMSA_DIGITAL))
+    {
+      base     = (void *) msa->aseq;
+      elemsize = sizeof(char *);
+      linkfunc = msacluster_clinkage;
+      param    = (void *) &maxid;
+    }
+#ifdef eslAUGMENT_ALPHABET
+  else
+    {
+      xparam.maxid = maxid;
+      xparam.abc   = msa->abc;
+      xparam.ax    = msa->ax;
+      if ((status = esl_dst_bits_Create(msa->abc, msa->ax, msa->nseq, &(xparam.bits))) != eslOK) goto ERROR;
+      ESL_ALLOC(idx, sizeof(int) * msa->nseq);
+      for (i = 0; i < msa->nseq; i++) idx[i] = i;
+      base     = (void *) idx;
+      elemsize = sizeof(int);
+      linkfunc = msacluster_xlinkage;
+      param    = (void *) &xparam;
+    }
+#endif
+
+  ESL_ALLOC(keys,   sizeof(struct lsh_key_s) * msa->nseq);
+  ESL_ALLOC(cols,   sizeof(int) * bandw);
+  ESL_ALLOC(parent, sizeof(int) * msa->nseq);
+  ESL_ALLOC(size,   sizeof(int) * msa->nseq);
+  for (i = 0; i < msa->nseq; i++) { parent[i] = i; size[i] = 1; }
+
+  for (b = 0; b < nbands; b++)
+    {
+      /* Choose the band's columns, 0..alen-1 */
+      for (t = 0; t < bandw; t++) cols[t] = esl_rnd_Roll(r, msa->alen);
+
+      nkeys = 0;
+      for (i = 0; i < msa->nseq; i++)
+	if (msacluster_lsh_key(msa, i, cols, bandw, &(keys[nkeys].key)))
+	  keys[nkeys++].idx = i;
+      qsort(keys, nkeys, sizeof(struct lsh_key_s), msacluster_lsh_key_compare);
+
+      /* Within each bucket, try to link each seq to the ones before it */
+      for (start = 0; start < nkeys; start = end)
+	{
+	  for (end = start+1; end < nkeys && keys[end].key == keys[start].key; end++) ;
+
+	  for (s = start+1; s < end; s++)
+	    for (t = s-1; t >= start && s-t <= eslMSACLUSTER_LSH_WINDOW; t--)
+	      {
+		a1 = msacluster_uf_find(parent, keys[s].idx);
+		a2 = msacluster_uf_find(parent, keys[t].idx);
+		if (a1 == a2) continue;
+
+		if ((status = (*linkfunc)((char *) base + keys[s].idx * elemsize,
+					  (char *) base + keys[t].idx * elemsize,
+					  param, &do_link)) != eslOK) goto ERROR;
+		if (do_link) {
+		  if (size[a1] < size[a2]) ESL_SWAP(a1, a2, int);
+		  parent[a2] = a1;
+		  size[a1]  += size[a2];
+		}
+	      }
+	}
+    }
+
+  /* Number the clusters in order of their lowest-numbered seq;
+   * size[] is reused to map roots to cluster numbers.
+   */
+  ESL_ALLOC(assignment, sizeof(int) * msa->nseq);
+  for (i = 0; i < msa->nseq; i++) size[i] = -1;
+  nc = 0;
+  for (i = 0; i < msa->nseq; i++)
+    {
+      a1 = msacluster_uf_find(parent, i);
+      if (size[a1] == -1) size[a1] = nc++;
+      assignment[i] = size[a1];
+    }
+
+  if (opt_nin != NULL) 
+    {
+      ESL_ALLOC(nin, sizeof(int) * nc);
+      for (i = 0; i < nc; i++) nin[i] = 0;
+      for (i = 0; i < msa->nseq; i++)
+	nin[assignment[i]]++;
+      *opt_nin = nin;
+    }
+
+  free(keys);
+  free(cols);
+  free(parent);
+  free(size);
+#ifdef eslAUGMENT_ALPHABET
+  if (idx != NULL) free(idx);
+  esl_dst_bits_Destroy(xparam.bits);
+#endif
+  if (opt_c  != NULL) *opt_c  = assignment; else free(assignment);
+  if (opt_nc != NULL) *opt_nc = nc;
+  return eslOK;
+
+ ERROR:
+  if (keys   != NULL) free(keys);
+  if (cols   != NULL) free(cols);
+  if (parent != NULL) free(parent);
+  if (size   != NULL) free(size);
+  if (assignment != NULL) free(assignment);
+  if (nin    != NULL) free(nin);
+#ifdef eslAUGMENT_ALPHABET
+  if (idx    != NULL) free(idx);
+  esl_dst_bits_Destroy(xparam.bits);
+#endif
+  if (opt_c   != NULL) *opt_c   = NULL;
+  if (opt_nin != NULL) *opt_nin = NULL;
+  if (opt_nc  != NULL) *opt_nc  = 0;
+  return status;
+}
+
+
+/* Function:  esl_msacluster_PairRecall()
+ * Synopsis:  Compare a clustering to a reference clustering, by pairs.
+ *
+ * Purpose:   Given a reference clustering <c_ref[0..n-1]> and a test
+ *            clustering <c_test[0..n-1]> of the same <n> sequences,
+ *            count the pairs of sequences that are in the same
+ *            cluster. Return the fraction of pairs co-clustered in
+ *            <c_ref> that are also co-clustered in <c_test> in
+ *            <*opt_recall>. Return the fraction of pairs co-clustered
+ *            in <c_test> that are also co-clustered in <c_ref> in
+ *            <*opt_precision>. Either fraction is 1.0 if it has no
+ *            pairs to count.
+ *
+ *            This is the recall report for
+ *            <esl_msacluster_SingleLinkageApprox()>: with the exact
+ *            clustering as <c_ref>, recall measures the links the
+ *            approximation missed. Precision is always 1.0 there,
+ *            because approximate clusters never join sequences that
+ *            the exact clusters keep apart.
+ *
+ *            Cluster numbers only need to be consistent within each
+ *            array, not between them. Takes $O(n \log n)$ time.
+ *
+ * Args:      c_ref         - reference cluster assignments, [0..n-1]
+ *            c_test        - test cluster assignments, [0..n-1]
+ *            n             - number of sequences
+ *            opt_recall    - optRETURN: fraction of <c_ref> pairs found in <c_test>
+ *            opt_precision - optRETURN: fraction of <c_test> pairs found in <c_ref>
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <*opt_recall> and
+ *            <*opt_precision> are set to 0.
+ */
+int
+esl_msacluster_PairRecall(const int *c_ref, const int *c_test, int n, double *opt_recall, double *opt_precision)
+{
+  int    *pr = NULL;		/* (ref,test) pairs, [0..2n-1] */
+  double  nref, ntest, nboth;
+  int     i, k;
+  int     status;
+
+  ESL_ALLOC(pr, sizeof(int) * 2 * ESL_MAX(n, 1));
+  for (i = 0; i < n; i++) { pr[2*i] = c_ref[i]; pr[2*i+1] = c_test[i]; }
+
+  /* sorted by (ref,test): count pairs in runs of equal ref, and of equal (ref,test) */
+  qsort(pr, n, sizeof(int) * 2, msacluster_pair_compare);
+  nref = nboth = 0.;
+  for (i = 0, k = 1; i < n; i++, k++)
+    if (i == n-1 || pr[2*i] != pr[2*i+2]) { nref += (double) k * (k-1) / 2.; k = 0; }
+  for (i = 0, k = 1; i < n; i++, k++)
+    if (i == n-1 || pr[2*i] != pr[2*i+2] || pr[2*i+1] != pr[2*i+3]) { nboth += (double) k * (k-1) / 2.; k = 0; }
+
+  /* swapped to (test,ref) and resorted: count pairs in runs of equal test */
+  for (i = 0; i < n; i++) ESL_SWAP(pr[2*i], pr[2*i+1], int);
+  qsort(pr, n, sizeof(int) * 2, msacluster_pair_compare);
+  ntest = 0.;
+  for (i = 0, k = 1; i < n; i++, k++)
+    if (i == n-1 || pr[2*i] != pr[2*i+2]) { ntest += (double) k * (k-1) / 2.; k = 0; }
+
+  if (opt_recall    != NULL) *opt_recall    = (nref  > 0. ? nboth / nref  : 1.0);
+  if (opt_precision != NULL) *opt_precision = (ntest > 0. ? nboth / ntest : 1.0);
+  free(pr);
+  return eslOK;
+
+ ERROR:
+  if (opt_recall    != NULL) *opt_recall    = 0.;
+  if (opt_precision != NULL) *opt_precision = 0.;
+  return status;
+}
+
+
 
 
 
@@ -207,16 +526,16 @@ msacluster_clinkage(const void *v1, const void *v2, const void *p, int *ret_link
 static int
 msacluster_xlinkage(const void *v1, const void *v2, const void *p, int *ret_link)
 {
-  ESL_DSQ *ax1              = *(ESL_DSQ **) v1;
-  ESL_DSQ *ax2              = *(ESL_DSQ **) v2;
+  int      i                = *(int *) v1;
+  int      j                = *(int *) v2;
   struct msa_param_s *param = (struct msa_param_s *) p;
   double   pid;
   int      status = eslOK;
 
 #if defined(eslMSACLUSTER_REGRESSION) || defined(eslMSAWEIGHT_REGRESSION)
-  pid = 1. - squid_xdistance(param->abc, ax1, ax2);
+  pid = 1. - squid_xdistance(param->abc, param->ax[i], param->ax[j]);
 #else  
-  if ( (status = esl_dst_XPairId(param->abc, ax1, ax2, &pid, NULL, NULL)) != eslOK) return status;
+  esl_dst_bits_PairId(param->bits, i, j, &pid, NULL, NULL);
 #endif
 
   *ret_link = (pid >= param->maxid ? TRUE : FALSE); 
@@ -225,6 +544,80 @@ msacluster_xlinkage(const void *v1, const void *v2, const void *p, int *ret_link
 #endif
 
 
+/* Approximate mode's LSH bucketing. msacluster_lsh_key() hashes
+ * row <i>'s residues in band columns <cols[0..w-1]> (0..alen-1) to
+ * <*ret_key>. All gap and missing-data symbols hash alike, and case
+ * is ignored, as in the %id calculation. Returns TRUE if the row has
+ * at least one residue in the band, FALSE if it has none and should
+ * not be bucketed.
+ */
+static int
+msacluster_lsh_key(const ESL_MSA *msa, int i, const int *cols, int w, uint64_t *ret_key)
+{
+  uint64_t h      = 14695981039346656037ULL; /* FNV-1a offset basis */
+  int      nres   = 0;
+  int      t, x;
+
+  for (t = 0; t < w; t++)
+    {
+      if (! (msa->flags & eslMSA_DIGITAL))
+	{
+	  x = msa->aseq[i][cols[t]];
+	  if (isalpha(x)) { x = toupper(x); nres++; } else x = 0;
+	}
+#ifdef eslAUGMENT_ALPHABET
+      else
+	{
+	  x = msa->ax[i][cols[t]+1];
+	  if (esl_abc_XIsResidue(msa->abc, x)) nres++; else x = 0xff;
+	}
+#endif
+      h = (h ^ (uint64_t) x) * 1099511628211ULL;             /* FNV-1a prime */
+    }
+  *ret_key = h;
+  return (nres > 0 ? TRUE : FALSE);
+}
+
+/* Sort bucket keys; ties stay in seq index order, so results don't depend on qsort() */
+static int
+msacluster_lsh_key_compare(const void *v1, const void *v2)
+{
+  const struct lsh_key_s *k1 = (const struct lsh_key_s *) v1;
+  const struct lsh_key_s *k2 = (const struct lsh_key_s *) v2;
+
+  if      (k1->key < k2->key) return -1;
+  else if (k1->key > k2->key) return  1;
+  else if (k1->idx < k2->idx) return -1;
+  else if (k1->idx > k2->idx) return  1;
+  return 0;
+}
+
+/* Union-find for approximate mode's clusters: root of <i>, with path halving */
+static int
+msacluster_uf_find(int *parent, int i)
+{
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i         = parent[i];
+  }
+  return i;
+}
+
+/* Sort int pairs lexicographically, for esl_msacluster_PairRecall() */
+static int
+msacluster_pair_compare(const void *v1, const void *v2)
+{
+  const int *p1 = (const int *) v1;
+  const int *p2 = (const int *) v2;
+
+  if      (p1[0] < p2[0]) return -1;
+  else if (p1[0] > p2[0]) return  1;
+  else if (p1[1] < p2[1]) return -1;
+  else if (p1[1] > p2[1]) return  1;
+  return 0;
+}
+
+
 
 
 /*****************************************************************
@@ -289,8 +682,110 @@ utest_SingleLinkage(ESL_GETOPTS *go, const ESL_MSA *msa, double maxid, int expec
   free(assignment);
   free(nin);
 }
+/* Approximate clusters must each lie within one exact cluster, and
+ * must recover at least <min_recall> of the exact co-clustered pairs.
+ */
+static void
+utest_SingleLinkageApprox(ESL_RANDOMNESS *r, const ESL_MSA *msa, double maxid, double min_recall)
+{
+  char  *msg    = "utest_SingleLinkageApprox() failed";
+  int   *c_ex   = NULL;
+  int   *c_ap   = NULL;
+  int   *nin    = NULL;
+  int   *map    = NULL;
+  int    nc_ex, nc_ap;
+  int    i, sum;
+  double recall, precision;
+
+  if (esl_msacluster_SingleLinkage      (msa, maxid,       &c_ex, NULL, &nc_ex) != eslOK) esl_fatal(msg);
+  if (esl_msacluster_SingleLinkageApprox(msa, maxid, 0, 0, r, &c_ap, &nin, &nc_ap) != eslOK) esl_fatal(msg);
+  if (nc_ap < nc_ex)                                                                     esl_fatal(msg);
+
+  if ((map = malloc(sizeof(int) * nc_ap)) == NULL) esl_fatal(msg);
+  for (i = 0; i < nc_ap; i++) map[i] = -1;
+  for (i = 0; i < msa->nseq; i++)
+    {
+      if      (map[c_ap[i]] == -1)      map[c_ap[i]] = c_ex[i];
+      else if (map[c_ap[i]] != c_ex[i]) esl_fatal(msg);
+    }
+  for (sum = 0, i = 0; i < nc_ap; i++) sum += nin[i];
+  if (sum != msa->nseq) esl_fatal(msg);
+  if (c_ap[0] != 0)     esl_fatal(msg);
+
+  if (esl_msacluster_PairRecall(c_ex, c_ap, msa->nseq, &recall, &precision) != eslOK) esl_fatal(msg);
+  if (precision != 1.0)       esl_fatal(msg);
+  if (recall    <  min_recall) esl_fatal(msg);
+  if (nc_ap == nc_ex && recall != 1.0) esl_fatal(msg);
+
+  free(map);
+  free(nin);
+  free(c_ap);
+  free(c_ex);
+}
+
+static void
+utest_PairRecall(void)
+{
+  char  *msg    = "utest_PairRecall() failed";
+  int    c1[6]  = { 0, 0, 0, 1, 1, 2 };   /* 3+1 = 4 pairs         */
+  int    c2[6]  = { 5, 5, 3, 4, 4, 4 };   /* 1+3 = 4 pairs, 2 shared */
+  double recall, precision;
+
+  if (esl_msacluster_PairRecall(c1, c2, 6, &recall, &precision) != eslOK) esl_fatal(msg);
+  if (recall != 0.5 || precision != 0.5)                                  esl_fatal(msg);
+  if (esl_msacluster_PairRecall(c1, c1, 6, &recall, &precision) != eslOK) esl_fatal(msg);
+  if (recall != 1.0 || precision != 1.0)                                  esl_fatal(msg);
+  if (esl_msacluster_PairRecall(c1, c1, 0, &recall, &precision) != eslOK) esl_fatal(msg);
+  if (recall != 1.0 || precision != 1.0)                                  esl_fatal(msg);
+}
 #endif /*eslMSACLUSTER_TESTDRIVE*/
 
+#if defined(eslMSACLUSTER_TESTDRIVE) || defined(eslMSACLUSTER_BENCHMARK)
+#ifdef eslAUGMENT_ALPHABET
+/* Create a digital MSA of <nfam> families of <nper> seqs, of
+ * length <L>. Each family is a random ancestor; each of its seqs
+ * changes each column to a random residue with probability <mu>,
+ * or to a gap with probability <gap>. Families are interleaved, so
+ * seq i belongs to family i % nfam.
+ */
+static ESL_MSA *
+synthetic_families(ESL_RANDOMNESS *r, const ESL_ALPHABET *abc, int nfam, int nper, int L, double mu, double gap)
+{
+  ESL_MSA  *msa = esl_msa_CreateDigital(abc, nfam*nper, L);
+  ESL_DSQ **anc = malloc(sizeof(ESL_DSQ *) * nfam);
+  char      name[32];
+  double    p;
+  int       f, i, pos;
+
+  if (msa == NULL || anc == NULL) esl_fatal("allocation failed");
+  for (f = 0; f < nfam; f++)
+    {
+      if ((anc[f] = malloc(sizeof(ESL_DSQ) * (L+2))) == NULL) esl_fatal("allocation failed");
+      for (pos = 1; pos <= L; pos++) anc[f][pos] = esl_rnd_Roll(r, abc->K);
+    }
+
+  for (i = 0; i < nfam*nper; i++)
+    {
+      f = i % nfam;
+      for (pos = 1; pos <= L; pos++)
+	{
+	  p = esl_random(r);
+	  if      (p < gap)      msa->ax[i][pos] = abc->K;              /* gap */
+	  else if (p < gap + mu) msa->ax[i][pos] = esl_rnd_Roll(r, abc->K);
+	  else                   msa->ax[i][pos] = anc[f][pos];
+	}
+      snprintf(name, 32, "seq%d", i);
+      esl_msa_SetSeqName(msa, i, name, -1);
+    }
+  msa->nseq = nfam*nper;
+
+  for (f = 0; f < nfam; f++) free(anc[f]);
+  free(anc);
+  return msa;
+}
+#endif /*eslAUGMENT_ALPHABET*/
+#endif /*eslMSACLUSTER_TESTDRIVE || eslMSACLUSTER_BENCHMARK*/
+
 /*****************************************************************
  * 5. Test driver
  *****************************************************************/
@@ -308,10 +803,12 @@ utest_SingleLinkage(ESL_GETOPTS *go, const ESL_MSA *msa, double maxid, int expec
 #include "esl_msa.h"
 #include "esl_msacluster.h"
 #include "esl_msafile.h"
+#include "esl_random.h"
 
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
   { "-h",        eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,     "42",  NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 static char usage[]  = "[-options]";
@@ -321,7 +818,9 @@ int
 main(int argc, char **argv)
 {
   ESL_GETOPTS    *go      = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r       = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
   ESL_ALPHABET   *abc     = esl_alphabet_Create(eslAMINO);
+  ESL_MSA        *fam     = NULL;
   ESL_MSA        *msa     = esl_msa_CreateFromString("\
 # STOCKHOLM 1.0\n\
 \n\
@@ -343,15 +842,27 @@ seq11 MMMMMMMMMM\n\
   utest_SingleLinkage(go, msa, 1.0, 11, 10);    /* at 100% id, only seq0/seq1 cluster */
   utest_SingleLinkage(go, msa, 0.5,  6,  5);    /* at 50% id, seq0-seq6 cluster       */
   utest_SingleLinkage(go, msa, 0.0,  1,  0);    /* at 0% id, everything clusters      */
+  utest_SingleLinkageApprox(r, msa, 1.0, 1.0);  /* identical seq0/seq1 collide in every band */
+  utest_SingleLinkageApprox(r, msa, 0.5, 0.0);
+  utest_SingleLinkageApprox(r, msa, 0.0, 1.0);  /* falls back to exact mode */
+  utest_PairRecall();
 
   /* Do the same tests, but now with a digital MSA */
   esl_msa_Digitize(abc, msa, NULL);
   utest_SingleLinkage(go, msa, 1.0, 11, 10);    /* at 100% id, only seq0/seq1 cluster */
   utest_SingleLinkage(go, msa, 0.5,  6,  5);    /* at 50% id, seq0-seq6 cluster       */
   utest_SingleLinkage(go, msa, 0.0,  1,  0);    /* at 0% id, everything clusters      */
+  utest_SingleLinkageApprox(r, msa, 1.0, 1.0); 
+  utest_SingleLinkageApprox(r, msa, 0.5, 0.0);
 
+  /* Approximate mode on 20 families of 50 seqs, ~72% id within a family */
+  fam = synthetic_families(r, abc, 20, 50, 200, 0.15, 0.05);
+  utest_SingleLinkageApprox(r, fam, 0.62, 0.99);
+
+  esl_msa_Destroy(fam);
   esl_msa_Destroy(msa);
   esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(r);
   esl_getopts_Destroy(go);
   return 0;
 }
@@ -361,7 +872,143 @@ seq11 MMMMMMMMMM\n\
 
 
 /*****************************************************************
- * 6. Example
+ * 6. Benchmark
+ *****************************************************************/
+#ifdef eslMSACLUSTER_BENCHMARK
+/* gcc -O2 -o msacluster_benchmark -I. -L. -DeslMSACLUSTER_BENCHMARK esl_msacluster.c -leasel -lm
+ * ./msacluster_benchmark                      # synthetic families
+ * ./msacluster_benchmark -N 20000 --noexact   # approximate mode only
+ * ./msacluster_benchmark <msafile>            # each MSA in a file
+ *
+ * Times exact and approximate single linkage clustering, and reports
+ * the approximate mode's pair recall relative to exact mode.
+ */
+#include "esl_config.h"
+
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_msa.h"
+#include "esl_msacluster.h"
+#include "esl_msafile.h"
+#include "esl_random.h"
+#include "esl_stopwatch.h"
+
+static ESL_OPTIONS options[] = {
+  /* name       type          default  env  range   toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,   NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-n",        eslARG_INT,     "50", NULL, "n>0",  NULL,  NULL, NULL, "synthetic: number of seqs per family",             0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,   NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-L",        eslARG_INT,    "200", NULL, "n>0",  NULL,  NULL, NULL, "synthetic: alignment length",                      0 },
+  { "-N",        eslARG_INT,    "100", NULL, "n>0",  NULL,  NULL, NULL, "synthetic: number of families",                    0 },
+  { "--mu",      eslARG_REAL,  "0.15", NULL, "0<=x<=1",NULL,NULL, NULL, "synthetic: per-column substitution probability",   0 },
+  { "--id",      eslARG_REAL,  "0.62", NULL, "0<=x<=1",NULL,NULL, NULL, "%id threshold for linkage",                        0 },
+  { "--nbands",  eslARG_INT,      "0", NULL, NULL,   NULL,  NULL, NULL, "number of LSH bands (0=default)",                  0 },
+  { "--bandw",   eslARG_INT,      "0", NULL, NULL,   NULL,  NULL, NULL, "columns per LSH band (0=choose from --id)",        0 },
+  { "--noexact", eslARG_NONE,   FALSE, NULL, NULL,   NULL,  NULL, NULL, "don't run exact mode (no recall report)",          0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] [<msafile>]";
+static char banner[] = "benchmark driver for msacluster module";
+
+static void
+run_benchmark(ESL_GETOPTS *go, ESL_RANDOMNESS *r, ESL_STOPWATCH *w, const ESL_MSA *msa)
+{
+  double maxid   = esl_opt_GetReal   (go, "--id");
+  int    nbands  = esl_opt_GetInteger(go, "--nbands");
+  int    bandw   = esl_opt_GetInteger(go, "--bandw");
+  int   *c_ex    = NULL;
+  int   *c_ap    = NULL;
+  int    nc_ex   = 0;
+  int    nc_ap;
+  double t_ex    = 0.;
+  double t_ap;
+  double recall, precision;
+
+  if (! esl_opt_GetBoolean(go, "--noexact"))
+    {
+      esl_stopwatch_Start(w);
+      if (esl_msacluster_SingleLinkage(msa, maxid, &c_ex, NULL, &nc_ex) != eslOK) esl_fatal("exact clustering failed");
+      esl_stopwatch_Stop(w);
+      t_ex = w->user;
+    }
+
+  esl_stopwatch_Start(w);
+  if (esl_msacluster_SingleLinkageApprox(msa, maxid, nbands, bandw, r, &c_ap, NULL, &nc_ap) != eslOK) esl_fatal("approximate clustering failed");
+  esl_stopwatch_Stop(w);
+  t_ap = w->user;
+
+  if (c_ex != NULL)
+    {
+      if (esl_msacluster_PairRecall(c_ex, c_ap, msa->nseq, &recall, &precision) != eslOK) esl_fatal("recall failed");
+      printf("%-20s %8d %6d  exact: %6d clusters %8.2fs  approx: %6d clusters %8.2fs  recall %.4f precision %.4f\n",
+	     msa->name ? msa->name : "-", msa->nseq, (int) msa->alen, nc_ex, t_ex, nc_ap, t_ap, recall, precision);
+    }
+  else
+    printf("%-20s %8d %6d  approx: %6d clusters %8.2fs\n", msa->name ? msa->name : "-", msa->nseq, (int) msa->alen, nc_ap, t_ap);
+
+  free(c_ex);
+  free(c_ap);
+}
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go  = esl_getopts_Create(options);
+  ESL_RANDOMNESS *r   = NULL;
+  ESL_STOPWATCH  *w   = esl_stopwatch_Create();
+  ESL_ALPHABET   *abc = NULL;
+  ESLX_MSAFILE   *afp = NULL;
+  ESL_MSA        *msa = NULL;
+  int             status;
+
+  if (esl_opt_ProcessCmdline(go, argc, argv) != eslOK) esl_fatal("failed to parse cmd line: %s", go->errbuf);
+  if (esl_opt_VerifyConfig(go)               != eslOK) esl_fatal("failed to parse cmd line: %s", go->errbuf);
+  if (esl_opt_GetBoolean(go, "-h") == TRUE) {
+    esl_banner(stdout, argv[0], banner);
+    esl_usage (stdout, argv[0], usage);
+    puts("\n  where options are:");
+    esl_opt_DisplayHelp(stdout, go, 0, 2, 80);
+    return 0;
+  }
+  if (esl_opt_ArgNumber(go) > 1) esl_fatal("Incorrect number of command line arguments.\nUsage: %s %s", argv[0], usage);
+  r = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+
+  if (esl_opt_ArgNumber(go) == 0)
+    {
+      abc = esl_alphabet_Create(eslAMINO);
+      msa = synthetic_families(r, abc, esl_opt_GetInteger(go, "-N"), esl_opt_GetInteger(go, "-n"),
+			       esl_opt_GetInteger(go, "-L"), esl_opt_GetReal(go, "--mu"), 0.05);
+      run_benchmark(go, r, w, msa);
+      esl_msa_Destroy(msa);
+    }
+  else
+    {
+      if ((status = eslx_msafile_Open(&abc, esl_opt_GetArg(go, 1), NULL, eslMSAFILE_UNKNOWN, NULL, &afp)) != eslOK)
+	eslx_msafile_OpenFailure(afp, status);
+      while ((status = eslx_msafile_Read(afp, &msa)) != eslEOF)
+	{
+	  if (status != eslOK) eslx_msafile_ReadFailure(afp, status);
+	  run_benchmark(go, r, w, msa);
+	  esl_msa_Destroy(msa);
+	}
+      eslx_msafile_Close(afp);
+    }
+
+  esl_alphabet_Destroy(abc);
+  esl_stopwatch_Destroy(w);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*eslMSACLUSTER_BENCHMARK*/
+
+
+
+/*****************************************************************
+ * 7. Example
  *****************************************************************/
 
 #ifdef eslMSACLUSTER_EXAMPLE
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
 
 #include "easel.h"
 #include "esl_mem.h"
@@ -337,6 +338,49 @@ eslx_msafile_SetDigital(ESLX_MSAFILE *afp, const ESL_ALPHABET *abc)
   return status;
 }
 
+/* Function:  eslx_msafile_SetLazyAnnotation()
+ * Synopsis:  Defer parsing of per-residue annotation.
+ *
+ * Purpose:   If <do_lazy> is TRUE, ask the parser of <afp> to defer
+ *            per-residue annotation (Stockholm and Pfam #=GR and #=GC
+ *            lines, including SS_cons, RF, PP and the like) in the
+ *            MSAs it reads. Such lines are still checked for format
+ *            errors, but their text isn't stored; instead, the
+ *            parser only records where the text is in the input file,
+ *            in <msa->lazy>, and leaves the annotation fields of
+ *            <msa> unset. A caller that does need some annotation
+ *            gets it on demand with <esl_msa_MaterializeAnnotation()>.
+ *            This saves time and memory for applications that only
+ *            need the aligned sequences. Easel functions that use the
+ *            annotation (the MSA writers, <esl_msa_Copy()>,
+ *            <esl_msa_Clone()>, <esl_msa_SequenceSubset()>,
+ *            <esl_msa_ColumnSubset()> and the functions built on it)
+ *            materialize it themselves, so nothing is lost.
+ *
+ *            Deferral needs to reopen the input file later, so it is
+ *            only possible if <afp> is reading an ordinary file, not
+ *            a stream, pipe, or string. Formats without per-residue
+ *            annotation ignore the setting.
+ *
+ *            If <do_lazy> is FALSE, turn deferral back off (the
+ *            default).
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEINVAL> if <afp> isn't reading an ordinary file;
+ *            annotation won't be deferred.
+ */
+int
+eslx_msafile_SetLazyAnnotation(ESLX_MSAFILE *afp, int do_lazy)
+{
+  afp->do_lazy = FALSE;
+  if (! do_lazy) return eslOK;
+
+  if (afp->bf->filename == NULL) return eslEINVAL;
+  if (afp->bf->mode_is != eslBUFFER_FILE && afp->bf->mode_is != eslBUFFER_ALLFILE && afp->bf->mode_is != eslBUFFER_MMAP) return eslEINVAL;
+  afp->do_lazy = TRUE;
+  return eslOK;
+}
+
 /* Function:  eslx_msafile_Close()
  * Synopsis:  Close an open <ESLX_MSAFILE>.
  */
@@ -365,6 +409,7 @@ msafile_Create(ESLX_MSAFILE **ret_afp)
   afp->format     = eslMSAFILE_UNKNOWN;
   afp->abc        = NULL;
   afp->ssi        = NULL;
+  afp->do_lazy    = FALSE;
   afp->errmsg[0]  = '\0';
 
   eslx_msafile_fmtdata_Init(&(afp->fmtd));
@@ -1041,6 +1086,86 @@ eslx_msafile_PositionByKey(ESLX_MSAFILE *afp, const char *key)
   afp->linenumber = -1; 
   return eslOK;
 }
+
+
+/* Function:  eslx_msafile_FetchBatch()
+ * Synopsis:  Fetch many MSAs at once, reading the file in order.
+ *
+ * Purpose:   Fetch the MSAs named (or accessioned) <keys[0..nk-1]>
+ *            from open MSA input <afp>, which must have an open SSI
+ *            index. All keys are looked up first; then the MSAs are
+ *            read in the order they occur in the file, in one forward
+ *            pass, rather than by one random seek per key as with
+ *            <eslx_msafile_PositionByKey()>.
+ *            
+ *            Caller provides the array <msa[0..nk-1]>; each MSA is
+ *            allocated here, and the caller becomes responsible for
+ *            free'ing them. If <in_file_order> is <TRUE>, <msa[j]> is
+ *            the <j>'th MSA in file order; otherwise <msa[i]> is the
+ *            MSA for <keys[i]>. Optionally, caller provides
+ *            <opt_order[0..nk-1]>, and it is set to the index of the
+ *            key whose MSA was read <j>'th.
+ *
+ * Returns:   <eslOK> on success.
+ * 
+ *            <eslENOTFOUND> if any of the <keys> isn't in the index;
+ *            nothing is fetched, and <afp->errmsg> names the missing
+ *            key.
+ *            
+ *            <eslEFORMAT> on a parse error, and <afp->errmsg> is set.
+ *            
+ *            On any error, all <msa[]> are <NULL>.
+ *
+ * Throws:    <eslENODATA> if there's no open SSI index;
+ *            <eslEINVAL> if an offset is invalid;
+ *            <eslESYS> if a system call such as <fread()> fails;
+ *            <eslEMEM> on allocation failure.
+ */
+int
+eslx_msafile_FetchBatch(ESLX_MSAFILE *afp, char *const *keys, int nk, int in_file_order, ESL_MSA **msa, int *opt_order)
+{
+  uint16_t *fh     = NULL;
+  off_t    *roff   = NULL;
+  int      *order  = NULL;
+  int       nfound;
+  int       i, j;
+  int       status;
+
+  for (i = 0; i < nk; i++) msa[i] = NULL;
+  if (afp->ssi == NULL) ESL_EXCEPTION(eslENODATA, "Need an open SSI index to call eslx_msafile_FetchBatch()");
+  if (nk == 0) return eslOK;
+
+  ESL_ALLOC(fh,    sizeof(uint16_t) * nk);
+  ESL_ALLOC(roff,  sizeof(off_t)    * nk);
+  ESL_ALLOC(order, sizeof(int)      * nk);
+
+  if ((status = esl_ssi_FindNameBatch(afp->ssi, keys, nk, fh, roff, order, &nfound)) != eslOK) goto ERROR;
+  if (nfound < nk) {
+    for (i = 0; i < nk; i++) if (roff[i] == -1) break;
+    ESL_XFAIL(eslENOTFOUND, afp->errmsg, "key %s not found in SSI index", keys[i]);
+  }
+
+  for (j = 0; j < nk; j++)
+    {
+      i = order[j];
+      if ((status = esl_buffer_SetOffset(afp->bf, roff[i])) != eslOK) goto ERROR;
+      afp->linenumber = -1;
+      if ((status = eslx_msafile_Read(afp, in_file_order ? &(msa[j]) : &(msa[i]))) != eslOK) goto ERROR;
+      if (opt_order != NULL) opt_order[j] = i;
+    }
+
+  free(fh);
+  free(roff);
+  free(order);
+  return eslOK;
+
+ ERROR:
+  for (i = 0; i < nk; i++) { esl_msa_Destroy(msa[i]); msa[i] = NULL; }
+  if (fh    != NULL) free(fh);
+  if (roff  != NULL) free(roff);
+  if (order != NULL) free(order);
+  return status;
+}
 #endif /*eslAUGMENT_SSI*/
 /*------------- end of functions added by SSI augmentation -------------------*/
 
@@ -1302,6 +1427,86 @@ eslx_msafile_PutLine(ESLX_MSAFILE *afp)
   return eslOK;
 }
 
+
+/* Function:  eslx_msafile_SplitRecords()
+ * Synopsis:  Divide in-memory input into chunks at record starts.
+ *
+ * Purpose:   Used by parallel parsers for FASTA-like formats (aligned
+ *            FASTA, A2M), where each sequence record starts with a
+ *            line whose first non-whitespace character is <c> ('>').
+ *
+ *            The input <afp> must be entirely in memory (a slurped
+ *            file, an mmap()'ed file, or a string). The unparsed
+ *            remainder of its buffer, <afp->bf->mem[pos..n-1]>, is
+ *            cut into <nchunks> roughly equal pieces, and each cut
+ *            point after the first is moved forward to the start of
+ *            the next record. Chunk <i> is then
+ *            <afp->bf->mem[chunkoff[i]..chunkoff[i+1]-1]>, for
+ *            <i=0..*ret_nchunks-1>. The first chunk starts at the
+ *            current parse position (which might be on blank lines
+ *            that precede the first record), and the last chunk ends
+ *            at <afp->bf->n>. Cut points that collapse onto each
+ *            other (short input, or very long records) are merged,
+ *            so <*ret_nchunks> may be less than <nchunks>.
+ *
+ *            Caller provides <chunkoff>, allocated for at least
+ *            <nchunks+1> offsets. The parse position of <afp> is not
+ *            changed.
+ *
+ * Args:      afp        - open in-memory input
+ *            c          - record start character, such as '>'
+ *            nchunks    - maximum number of chunks to make; >= 1
+ *            chunkoff   - RETURN: chunk offsets in <afp->bf->mem>, [0..*ret_nchunks]
+ *            ret_nchunks- RETURN: number of chunks made
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEINVAL> if <afp> is not entirely in memory;
+ *            <*ret_nchunks> is 0.
+ */
+int
+eslx_msafile_SplitRecords(ESLX_MSAFILE *afp, char c, int nchunks, esl_pos_t *chunkoff, int *ret_nchunks)
+{
+  ESL_BUFFER *bf = afp->bf;
+  esl_pos_t   chunksize;
+  esl_pos_t   pos, i;
+  esl_pos_t   nline;
+  int         nterm;
+  int         k   = 0;
+
+  if (bf->mode_is != eslBUFFER_ALLFILE && bf->mode_is != eslBUFFER_MMAP && bf->mode_is != eslBUFFER_STRING)
+    { *ret_nchunks = 0; return eslEINVAL; }
+  if (nchunks < 1) nchunks = 1;
+
+  chunksize   = (bf->n - bf->pos) / nchunks;
+  chunkoff[0] = bf->pos;
+  while (k < nchunks-1)
+    {
+      /* start at the target cut point, back up to start of its line */
+      pos = ESL_MAX(chunkoff[k] + 1, bf->pos + (k+1) * chunksize);
+      while (pos > chunkoff[k] + 1 && bf->mem[pos-1] != '\n') pos--;
+      if (pos <= chunkoff[k]) pos = chunkoff[k] + 1;
+
+      /* then go forward, line by line, to the next record start */
+      while (pos < bf->n)
+	{
+	  if (bf->mem[pos-1] == '\n')
+	    {
+	      for (i = pos; i < bf->n && isspace((int) bf->mem[i]) && bf->mem[i] != '\n'; i++) ;
+	      if (i < bf->n && bf->mem[i] == c) break;
+	    }
+	  esl_memnewline(bf->mem + pos, bf->n - pos, &nline, &nterm);
+	  pos += nline + nterm;
+	}
+      if (pos >= bf->n) break;
+      chunkoff[++k] = pos;
+    }
+  chunkoff[++k] = bf->n;
+
+  *ret_nchunks = k;
+  return eslOK;
+}
+
 /*--------------- end, parser utilities -------------------------*/
 
 
@@ -1426,6 +1631,73 @@ aaaaa\n";
 
   eslx_msafile_Close(afp);
 }
+
+#ifdef eslAUGMENT_SSI
+/* Index a file of several named MSAs, then fetch a batch of them
+ * (with a repeat) in request order and in file order.
+ */
+static void
+utest_fetch_batch(void)
+{
+  char          msg[]        = "esl_msafile: fetch_batch unit test failed";
+  char          tmpfile[32]  = "esltmpXXXXXX";
+  char          ssifile[48];
+  char          name[32];
+  FILE         *ofp          = NULL;
+  ESL_NEWSSI   *ns           = NULL;
+  ESLX_MSAFILE *afp          = NULL;
+  ESL_MSA      *msa[4];
+  char         *keys[4]      = { "ali2", "ali0", "ali2", "ali1" };
+  char         *badkey[1]    = { "ali3" };
+  int           file_order[4]= { 1, 3, 0, 2 };
+  int           order[4];
+  int           nali         = 3;
+  uint16_t      fh;
+  off_t         roff;
+  int           i;
+
+  if (esl_tmpfile_named(tmpfile, &ofp) != eslOK) esl_fatal(msg);
+  snprintf(ssifile, 48, "%s.ssi", tmpfile);
+  if (esl_newssi_Open(ssifile, TRUE, &ns)                         != eslOK) esl_fatal(msg);
+  if (esl_newssi_AddFile(ns, tmpfile, eslMSAFILE_STOCKHOLM, &fh) != eslOK) esl_fatal(msg);
+  for (i = 0; i < nali; i++)
+    {
+      snprintf(name, 32, "ali%d", i);
+      if ((roff = ftello(ofp)) == -1)                       esl_fatal(msg);
+      if (esl_newssi_AddKey(ns, name, fh, roff, 0, 0) != eslOK) esl_fatal(msg);
+      fprintf(ofp, "# STOCKHOLM 1.0\n#=GF ID %s\n\nseq1 ACDEF%.*s\nseq2 ACDEF%.*s\n//\n", name, i+1, "GHIK", i+1, "GHIK");
+    }
+  fclose(ofp);
+  if (esl_newssi_Write(ns) != eslOK) esl_fatal(msg);
+  esl_newssi_Close(ns);
+
+  if (eslx_msafile_Open(NULL, tmpfile, NULL, eslMSAFILE_STOCKHOLM, NULL, &afp) != eslOK) esl_fatal(msg);
+  if (esl_ssi_Open(ssifile, &(afp->ssi))                                       != eslOK) esl_fatal(msg);
+
+  if (eslx_msafile_FetchBatch(afp, keys, 4, FALSE, msa, order) != eslOK) esl_fatal(msg);
+  for (i = 0; i < 4; i++)
+    {
+      if (strcmp(msa[i]->name, keys[i])        != 0)                     esl_fatal(msg);
+      if (msa[i]->alen != 5 + keys[i][3] - '0' + 1)                      esl_fatal(msg);
+      if (order[i]     != file_order[i])                                 esl_fatal(msg);
+      esl_msa_Destroy(msa[i]);
+    }
+
+  if (eslx_msafile_FetchBatch(afp, keys, 4, TRUE, msa, NULL) != eslOK) esl_fatal(msg);
+  for (i = 0; i < 4; i++)
+    {
+      if (strcmp(msa[i]->name, keys[file_order[i]]) != 0) esl_fatal(msg);
+      esl_msa_Destroy(msa[i]);
+    }
+
+  if (eslx_msafile_FetchBatch(afp, badkey, 1, FALSE, msa, NULL) != eslENOTFOUND) esl_fatal(msg);
+  if (msa[0] != NULL) esl_fatal(msg);
+
+  eslx_msafile_Close(afp);
+  remove(tmpfile);
+  remove(ssifile);
+}
+#endif /*eslAUGMENT_SSI*/
 #endif /*eslMSAFILE_TESTDRIVE*/
 /*----------------- end, unit tests -----------------------------*/
 
@@ -1467,6 +1739,9 @@ main(int argc, char **argv)
       utest_format2format(fmt1, fmt2);
 
   utest_tricky_format_decisions();
+#ifdef eslAUGMENT_SSI
+  utest_fetch_batch();
+#endif
 
   esl_getopts_Destroy(go);
   exit(0);
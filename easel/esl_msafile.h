@@ -63,6 +63,7 @@ typedef struct {
   ESL_DSQ              inmap[128];    /* input map, 0..127                                     */
   const ESL_ALPHABET  *abc;	      /* non-NULL if augmented and in digital mode             */
   ESL_SSI             *ssi;	      /* open SSI index; or NULL, if none or not augmented     */
+  int                  do_lazy;       /* TRUE to defer #=GR, #=GC text: see SetLazyAnnotation() */
   char                 errmsg[eslERRBUFSIZE];   /* user-directed message for normal errors     */
 } ESLX_MSAFILE;
 
@@ -93,6 +94,7 @@ extern int   eslx_msafile_OpenMem   (ESL_ALPHABET **byp_abc, const char *p, esl_
 extern int   eslx_msafile_OpenBuffer(ESL_ALPHABET **byp_abc, ESL_BUFFER *bf,                       int format, ESLX_MSAFILE_FMTDATA *fmtd, ESLX_MSAFILE **ret_afp);
 extern void  eslx_msafile_OpenFailure(ESLX_MSAFILE *afp, int status);
 extern int   eslx_msafile_SetDigital (ESLX_MSAFILE *afp, const ESL_ALPHABET *abc);
+extern int   eslx_msafile_SetLazyAnnotation(ESLX_MSAFILE *afp, int do_lazy);
 extern void  eslx_msafile_Close(ESLX_MSAFILE *afp);
 
 /* 2. ESLX_MSAFILE_FMTDATA: optional extra constraints on formats */
@@ -113,6 +115,7 @@ extern int eslx_msafile_GuessAlphabet(ESLX_MSAFILE *afp, int *ret_type);
 /* 5. Random access in a MSA flatfile database */
 #ifdef eslAUGMENT_SSI
 extern int eslx_msafile_PositionByKey(ESLX_MSAFILE *afp, const char *key);
+extern int eslx_msafile_FetchBatch(ESLX_MSAFILE *afp, char *const *keys, int nk, int in_file_order, ESL_MSA **msa, int *opt_order);
 #endif
 
 /* 6. Reading an MSA from an ESLX_MSAFILE */
@@ -125,6 +128,7 @@ extern int eslx_msafile_Write(FILE *fp, ESL_MSA *msa, int fmt);
 /* 8. Utilities for specific parsers */
 extern int eslx_msafile_GetLine(ESLX_MSAFILE *afp, char **opt_p, esl_pos_t *opt_n);
 extern int eslx_msafile_PutLine(ESLX_MSAFILE *afp);
+extern int eslx_msafile_SplitRecords(ESLX_MSAFILE *afp, char c, int nchunks, esl_pos_t *chunkoff, int *ret_nchunks);
 
 #include "esl_msafile_a2m.h"
 #include "esl_msafile_afa.h"
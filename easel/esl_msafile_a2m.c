@@ -25,10 +25,46 @@
 #include "esl_msafile.h"
 #include "esl_msafile_a2m.h"
 
+#ifdef HAVE_PTHREAD
+#include "esl_threads.h"
+#endif
+
+static int a2m_padding_rf     (ESL_MSA *msa, int *nins, int ncons);
 #ifdef eslAUGMENT_ALPHABET
-static int a2m_padding_digital(ESL_MSA *msa, char **csflag, int *nins, int ncons);
+static int a2m_padding_digital(ESL_MSA *msa, char **csflag, int *nins, int ncons, int idx1, int idx2);
 #endif
-static int a2m_padding_text   (ESL_MSA *msa, char **csflag, int *nins, int ncons);
+static int a2m_padding_text   (ESL_MSA *msa, char **csflag, int *nins, int ncons, int idx1, int idx2);
+
+#ifdef HAVE_PTHREAD
+/* A2M_CHUNK: one worker's share of a parallel parse */
+typedef struct {
+  ESLX_MSAFILE *afp;                    /* input; shared, read-only (bf->mem, inmap, abc)            */
+  char         *p;                      /* start of this chunk in <afp->bf->mem>                     */
+  esl_pos_t     n;                      /* length of this chunk in bytes                             */
+  ESL_MSA      *msa;                    /* RETURN: unaligned rows parsed from this chunk             */
+  char        **csflag;                 /* RETURN: consensus flags for each row, [0..msa->nseq-1][]  */
+  int           ncons;                  /* RETURN: # of consensus columns (all rows in chunk agree)  */
+  int          *nins;                   /* RETURN: max # of inserts before each cons col, [0..ncons] */
+  int64_t       nlines;                 /* RETURN: number of input lines in this chunk               */
+  int           status;                 /* RETURN: eslOK, eslEFORMAT, or exception code              */
+  char          errmsg[eslERRBUFSIZE];  /* private error message                                     */
+} A2M_CHUNK;
+
+/* A2M_PADJOB: one worker's share of the padding phase: rows idx1..idx2-1 */
+typedef struct {
+  ESL_MSA *msa;
+  char   **csflag;
+  int     *nins;
+  int      ncons;
+  int      idx1, idx2;
+  int      status;
+} A2M_PADJOB;
+
+static int  a2m_read_parallel(ESLX_MSAFILE *afp, int ncpu, ESL_MSA **ret_msa);
+static void a2m_chunk_thread (void *arg);
+static void a2m_pad_thread   (void *arg);
+static int  a2m_parse_chunk  (A2M_CHUNK *ck);
+#endif /*HAVE_PTHREAD*/
 
 /*****************************************************************
  *# 1. API for reading/writing A2M format
@@ -263,6 +299,7 @@ esl_msafile_a2m_Read(ESLX_MSAFILE *afp, ESL_MSA **ret_msa)
       ESL_REALLOC(csflag, sizeof(char *) * msa->sqalloc);
       for (idx = old_sqalloc; idx < msa->sqalloc; idx++) csflag[idx] = NULL;
     }
+    msa->nseq = nseq+1;		/* keep nseq current, so the error path frees every row and csflag[] */
 
     if (     (status = esl_msa_SetSeqName       (msa, nseq, tok, toklen)) != eslOK) goto ERROR;
     if (n && (status = esl_msa_SetSeqDescription(msa, nseq, p,   n))      != eslOK) goto ERROR;
@@ -273,6 +310,9 @@ esl_msafile_a2m_Read(ESLX_MSAFILE *afp, ESL_MSA **ret_msa)
     if (nseq) {
       for (cpos = 0; cpos <= ncons; cpos++)
 	this_nins[cpos] = 0;
+    } else {			/* first seq: <this_nins> grows with its lines; it may have none */
+      ESL_REALLOC(this_nins, sizeof(int));
+      this_nins[0] = 0;
     }
 
     while ( (status = eslx_msafile_GetLine(afp, &p, &n)) == eslOK)
@@ -294,7 +334,7 @@ esl_msafile_a2m_Read(ESLX_MSAFILE *afp, ESL_MSA **ret_msa)
 	    else if (isupper(p[bpos])) { csflag[nseq][spos++] = TRUE;  this_ncons++;            }
 	    else if (islower(p[bpos])) { csflag[nseq][spos++] = FALSE; this_nins[this_ncons]++; }
 	    else if (p[bpos] == '-')   { csflag[nseq][spos++] = TRUE;  this_ncons++;            }
-	    if (ncons && this_ncons > ncons) ESL_XFAIL(eslEFORMAT, afp->errmsg,  "unexpected # of consensus residues, didn't match previous seq(s)");
+	    if (nseq && this_ncons > ncons) ESL_XFAIL(eslEFORMAT, afp->errmsg,  "unexpected # of consensus residues, didn't match previous seq(s)");
 	  }
 	csflag[nseq][spos] = TRUE; /* need a sentinel, because of the way the padding functions work */
 
@@ -332,10 +372,11 @@ esl_msafile_a2m_Read(ESLX_MSAFILE *afp, ESL_MSA **ret_msa)
    * This is sufficient information to reconstruct each aligned sequence.
    */
   msa->nseq = nseq;
+  if ((status = a2m_padding_rf(msa, nins, ncons)) != eslOK) goto ERROR;
 #ifdef eslAUGMENT_ALPHABET
-  if (msa->abc)  { if ((status = a2m_padding_digital(msa, csflag, nins, ncons)) != eslOK) goto ERROR; }
+  if (msa->abc)  { if ((status = a2m_padding_digital(msa, csflag, nins, ncons, 0, nseq)) != eslOK) goto ERROR; }
 #endif
-  if (!msa->abc) { if ((status = a2m_padding_text   (msa, csflag, nins, ncons)) != eslOK) goto ERROR; }
+  if (!msa->abc) { if ((status = a2m_padding_text   (msa, csflag, nins, ncons, 0, nseq)) != eslOK) goto ERROR; }
 
   if (( status = esl_msa_SetDefaultWeights(msa)) != eslOK) goto ERROR;
 
@@ -359,6 +400,60 @@ esl_msafile_a2m_Read(ESLX_MSAFILE *afp, ESL_MSA **ret_msa)
 }
 
 
+/* Function:  esl_msafile_a2m_ReadParallel()
+ * Synopsis:  Read a UCSC A2M format alignment, using threads.
+ *
+ * Purpose:   Same as <esl_msafile_a2m_Read()>, but when the input is
+ *            entirely in memory (a slurped or mmap()'ed file, or a
+ *            string), split it at '>' record boundaries into <ncpu>
+ *            chunks and parse the chunks concurrently on <ncpu>
+ *            worker threads. The per-chunk rows are merged in input
+ *            order, and then the insert-padding phase that converts
+ *            the unaligned A2M rows to aligned rows is also divided
+ *            among the threads, by ranges of rows.
+ *
+ *            If <ncpu> is <= 1, if the input is a stream, or if Easel
+ *            was compiled without POSIX threads, this simply calls
+ *            <esl_msafile_a2m_Read()>.
+ *
+ *            The result is identical to that of
+ *            <esl_msafile_a2m_Read()>. If the threaded parse finds a
+ *            format error, the input is rewound and reparsed
+ *            serially, so the <eslEFORMAT> diagnostics in <afp> are
+ *            exactly those of the serial parser.
+ *
+ * Args:      afp     - open <ESLX_MSAFILE>
+ *            ncpu    - number of worker threads to use
+ *            ret_msa - RETURN: newly parsed <ESL_MSA>
+ *
+ * Returns:   (same as <esl_msafile_a2m_Read()>.)
+ *
+ * Throws:    (same as <esl_msafile_a2m_Read()>), and also
+ *            <eslESYS> if thread creation or synchronization fails.
+ */
+int
+esl_msafile_a2m_ReadParallel(ESLX_MSAFILE *afp, int ncpu, ESL_MSA **ret_msa)
+{
+#ifdef HAVE_PTHREAD
+  esl_pos_t start      = afp->bf->pos;
+  int64_t   linenumber = afp->linenumber;
+  int       status;
+
+  if (ncpu > 1)
+    {
+      status = a2m_read_parallel(afp, ncpu, ret_msa);
+      if (status == eslEFORMAT) 
+	{ /* rewind, and reparse serially for diagnostics */
+	  esl_buffer_SetOffset(afp->bf, start);
+	  afp->linenumber = linenumber;
+	}
+      else if (status != eslEINVAL) return status; /* eslEINVAL: input isn't in memory; use serial parser */
+    }
+#endif
+  return esl_msafile_a2m_Read(afp, ret_msa);
+}
+
+
 /* Function:  esl_msafile_a2m_Write()
  * Synopsis:  Write an A2M (UCSC SAM) dotless format alignment to a stream.
  *
@@ -392,6 +487,8 @@ esl_msafile_a2m_Read(ESLX_MSAFILE *afp, ESL_MSA **ret_msa)
  *            msa - MSA to write       
  *
  * Returns:   <eslOK> on success.
+ *            <eslENOTFOUND> or <eslECORRUPT> if deferred annotation
+ *            (<msa->lazy>) can't be read; see <esl_msa_MaterializeAnnotation()>.
  * 
  * Throws:    <eslEMEM> on allocation failure.
  *            <eslEWRITE> on any system write error, such as filled disk.
@@ -410,6 +507,8 @@ esl_msafile_a2m_Write(FILE *fp, const ESL_MSA *msa)
   int     sym;
   int     status;
 
+  if (msa->lazy && (status = esl_msa_MaterializeAnnotation((ESL_MSA *) msa, NULL)) != eslOK) return status; /* deferred annotation is part of <msa> */
+
   ESL_ALLOC(buf, sizeof(char) * (cpl+1));
 
   for (i = 0; i < msa->nseq; i++)
@@ -484,7 +583,10 @@ esl_msafile_a2m_Write(FILE *fp, const ESL_MSA *msa)
  *****************************************************************/
 
 /* A2M parser has an input phase, followed by an alignment padding phase.
- * The a2m_padding_{digital,text} functions do the padding phase.
+ * a2m_padding_rf() sets the RF line and the alignment length, then
+ * the a2m_padding_{digital,text} functions pad rows idx1..idx2-1.
+ * Rows are independent, so the parallel parser gives each worker
+ * thread its own range of rows to pad.
  * 
  * Upon call:
  *   msa->nseq is set;
@@ -502,19 +604,15 @@ esl_msafile_a2m_Write(FILE *fp, const ESL_MSA *msa)
  *
  * Upon successful return:
  *  msa->alen is set
- *  all msa->ax[]/msa->aseq are now aligned digital sequences         
+ *  msa->ax[]/msa->aseq[] idx1..idx2-1 are now aligned sequences
  *  msa->rf is set
  */
-#ifdef eslAUGMENT_ALPHABET
 static int
-a2m_padding_digital(ESL_MSA *msa, char **csflag, int *nins, int ncons)
+a2m_padding_rf(ESL_MSA *msa, int *nins, int ncons)
 {
-  ESL_DSQ *ax     = NULL;		/* new aligned sequence - will be swapped into msa->ax[] */
-  ESL_DSQ  gapsym = esl_abc_XGetGap(msa->abc);
-  int      apos, cpos, spos;	/* position counters for alignment 0..alen, consensus cols 0..cpos-1, sequence position 0..slen-1 */
+  int      apos, cpos;
   int      alen;
   int      icount;
-  int      idx;
   int      status;
 
   alen = ncons;
@@ -528,8 +626,26 @@ a2m_padding_digital(ESL_MSA *msa, char **csflag, int *nins, int ncons)
       if  (cpos < ncons) msa->rf[apos++] = 'x';
     }
   msa->rf[apos] = '\0';
+  msa->alen     = alen;
+  return eslOK;
 
-  for (idx = 0; idx < msa->nseq; idx++)
+ ERROR:
+  return status;
+}
+
+#ifdef eslAUGMENT_ALPHABET
+static int
+a2m_padding_digital(ESL_MSA *msa, char **csflag, int *nins, int ncons, int idx1, int idx2)
+{
+  ESL_DSQ *ax     = NULL;		/* new aligned sequence - will be swapped into msa->ax[] */
+  ESL_DSQ  gapsym = esl_abc_XGetGap(msa->abc);
+  int      apos, cpos, spos;	/* position counters for alignment 0..alen, consensus cols 0..cpos-1, sequence position 0..slen-1 */
+  int      alen   = msa->alen;
+  int      icount;
+  int      idx;
+  int      status;
+
+  for (idx = idx1; idx < idx2; idx++)
     {
       ESL_ALLOC(ax, sizeof(ESL_DSQ) * (alen + 2));    
       ax[0] = eslDSQ_SENTINEL;
@@ -548,10 +664,6 @@ a2m_padding_digital(ESL_MSA *msa, char **csflag, int *nins, int ncons)
       msa->ax[idx] = ax;
       ax = NULL;
     }
-  msa->alen = alen;
-
-
-
   return eslOK;
   
  ERROR:
@@ -561,28 +673,16 @@ a2m_padding_digital(ESL_MSA *msa, char **csflag, int *nins, int ncons)
 #endif /*eslAUGMENT_ALPHABET*/
 
 static int
-a2m_padding_text(ESL_MSA *msa, char **csflag, int *nins, int ncons)
+a2m_padding_text(ESL_MSA *msa, char **csflag, int *nins, int ncons, int idx1, int idx2)
 {
   char   *aseq = NULL;		/* new aligned sequence - will be swapped into msa->aseq[] */
   int     apos, cpos, spos;	/* position counters for alignment 0..alen, consensus cols 0..cpos-1, sequence position 0..slen-1 */
-  int     alen;
+  int     alen = msa->alen;
   int     icount;
   int     idx;
   int     status;
 
-  alen = ncons;
-  for (cpos = 0; cpos <= ncons; cpos++)
-    alen += nins[cpos];
-
-  ESL_ALLOC(msa->rf, sizeof(char) * (alen+1));
-  for (apos = 0, cpos = 0; cpos <= ncons; cpos++)
-    {
-      for (icount = 0; icount < nins[cpos]; icount++) msa->rf[apos++] = '.';
-      if  (cpos < ncons) msa->rf[apos++] = 'x';
-    }
-  msa->rf[apos] = '\0';
-  
-  for (idx = 0; idx < msa->nseq; idx++)
+  for (idx = idx1; idx < idx2; idx++)
     {
       ESL_ALLOC(aseq, sizeof(char) * (alen + 1));    
       apos = spos  = 0; 
@@ -600,13 +700,358 @@ a2m_padding_text(ESL_MSA *msa, char **csflag, int *nins, int ncons)
       msa->aseq[idx] = aseq;
       aseq = NULL;
     }
-  msa->alen = alen;
   return eslOK;
   
  ERROR:
   if (aseq) free(aseq);
   return status;
 }
+#ifdef HAVE_PTHREAD
+/* a2m_read_parallel()
+ *
+ * The threaded parse. Phase 1: split the in-memory input into chunks
+ * at '>' record starts, and parse each chunk on its own worker thread
+ * into its own growable MSA of unaligned rows, with their consensus
+ * flags and the chunk's insert counts. Merge: move rows (pointers, not
+ * data) into the final MSA in input order, check that all chunks
+ * agree on the number of consensus columns, and take the max insert
+ * counts over chunks. Phase 2: set RF and alen, then pad rows to the
+ * alignment, with each worker taking a range of rows.
+ *
+ * Returns <eslEFORMAT> on any parse error, without diagnostics;
+ * caller rewinds and reparses serially. Returns <eslEINVAL> if the
+ * input isn't entirely in memory, or if there's only one chunk.
+ */
+static int
+a2m_read_parallel(ESLX_MSAFILE *afp, int ncpu, ESL_MSA **ret_msa)
+{
+  ESL_THREADS *thr      = NULL;
+  A2M_CHUNK   *ck       = NULL;
+  A2M_PADJOB  *pj       = NULL;
+  esl_pos_t   *chunkoff = NULL;
+  ESL_MSA     *msa      = NULL;
+  char       **csflag   = NULL;
+  int         *nins     = NULL;
+  int          nchunks  = 0;
+  int          nseq     = 0;
+  int          ncons    = -1;
+  int64_t      nlines   = 0;
+  int          c, i, idx, cpos;
+  int          status;
+
+  ESL_DASSERT1( (afp->format == eslMSAFILE_A2M) );
+  afp->errmsg[0] = '\0';
+
+  ESL_ALLOC(chunkoff, sizeof(esl_pos_t) * (ncpu+1));
+  if ((status = eslx_msafile_SplitRecords(afp, '>', ncpu, chunkoff, &nchunks)) != eslOK) goto ERROR;
+  if (nchunks < 2) { status = eslEINVAL; goto ERROR; }
+
+  ESL_ALLOC(ck, sizeof(A2M_CHUNK) * nchunks);
+  for (c = 0; c < nchunks; c++)
+    {
+      ck[c].afp       = afp;
+      ck[c].p         = afp->bf->mem + chunkoff[c];
+      ck[c].n         = chunkoff[c+1] - chunkoff[c];
+      ck[c].msa       = NULL;
+      ck[c].csflag    = NULL;
+      ck[c].ncons     = 0;
+      ck[c].nins      = NULL;
+      ck[c].nlines    = 0;
+      ck[c].status    = eslOK;
+      ck[c].errmsg[0] = '\0';
+    }
+
+  /* Phase 1: parse chunks. */
+  if ((thr = esl_threads_Create(&a2m_chunk_thread)) == NULL) { status = eslEMEM; goto ERROR; }
+  for (c = 0; c < nchunks; c++)
+    if ((status = esl_threads_AddThread(thr, (void *) &(ck[c]))) != eslOK) break;
+  esl_threads_WaitForStart (thr);
+  esl_threads_WaitForFinish(thr);
+  esl_threads_Destroy(thr);
+  thr = NULL;
+  if (c < nchunks) goto ERROR;
+
+  for (c = 0; c < nchunks; c++)
+    {
+      if (ck[c].status != eslOK) { status = ck[c].status; goto ERROR; }
+      nlines += ck[c].nlines;
+      if (ck[c].msa->nseq == 0) continue; /* only chunk 0 can be empty: blank lines before the first record */
+      if (ncons != -1 && ck[c].ncons != ncons) { status = eslEFORMAT; goto ERROR; }
+      ncons = ck[c].ncons;
+      nseq += ck[c].msa->nseq;
+    }
+  if (nseq == 0) { status = eslEFORMAT; goto ERROR; }
+
+  /* Merge. */
+  ESL_ALLOC(nins, sizeof(int) * (ncons+1));
+  for (cpos = 0; cpos <= ncons; cpos++) nins[cpos] = 0;
+  for (c = 0; c < nchunks; c++)
+    if (ck[c].msa->nseq)
+      for (cpos = 0; cpos <= ncons; cpos++)
+	nins[cpos] = ESL_MAX(nins[cpos], ck[c].nins[cpos]);
+
+#ifdef eslAUGMENT_ALPHABET
+  if (afp->abc   &&  (msa = esl_msa_CreateDigital(afp->abc, nseq, -1)) == NULL) { status = eslEMEM; goto ERROR; }
+#endif
+  if (! afp->abc &&  (msa = esl_msa_Create(                 nseq, -1)) == NULL) { status = eslEMEM; goto ERROR; }
+  ESL_ALLOC(csflag, sizeof(char *) * nseq);
+  for (idx = 0; idx < nseq; idx++) csflag[idx] = NULL;
+
+  for (idx = 0, c = 0; c < nchunks; c++)
+    for (i = 0; i < ck[c].msa->nseq; i++, idx++)
+      {
+#ifdef eslAUGMENT_ALPHABET
+	if (msa->abc)   { msa->ax[idx]   = ck[c].msa->ax[i];   ck[c].msa->ax[i]   = NULL; }
+#endif
+	if (! msa->abc) { msa->aseq[idx] = ck[c].msa->aseq[i]; ck[c].msa->aseq[i] = NULL; }
+	msa->sqname[idx] = ck[c].msa->sqname[i];  ck[c].msa->sqname[i] = NULL;
+	csflag[idx]      = ck[c].csflag[i];       ck[c].csflag[i]      = NULL;
+
+	if (ck[c].msa->sqdesc && ck[c].msa->sqdesc[i])
+	  {
+	    if (! msa->sqdesc) {
+	      ESL_ALLOC(msa->sqdesc, sizeof(char *) * msa->sqalloc);
+	      for (cpos = 0; cpos < msa->sqalloc; cpos++) msa->sqdesc[cpos] = NULL;
+	    }
+	    msa->sqdesc[idx] = ck[c].msa->sqdesc[i];  ck[c].msa->sqdesc[i] = NULL;
+	  }
+	msa->nseq = idx+1;
+      }
+
+  /* Phase 2: pad rows to the alignment. */
+  if ((status = a2m_padding_rf(msa, nins, ncons)) != eslOK) goto ERROR;
+  if (ncpu > nseq) ncpu = nseq;
+  ESL_ALLOC(pj, sizeof(A2M_PADJOB) * ncpu);
+  for (c = 0; c < ncpu; c++)
+    {
+      pj[c].msa    = msa;
+      pj[c].csflag = csflag;
+      pj[c].nins   = nins;
+      pj[c].ncons  = ncons;
+      pj[c].idx1   = (int) ((int64_t) nseq *  c    / ncpu);
+      pj[c].idx2   = (int) ((int64_t) nseq * (c+1) / ncpu);
+      pj[c].status = eslOK;
+    }
+  if ((thr = esl_threads_Create(&a2m_pad_thread)) == NULL) { status = eslEMEM; goto ERROR; }
+  for (c = 0; c < ncpu; c++)
+    if ((status = esl_threads_AddThread(thr, (void *) &(pj[c]))) != eslOK) break;
+  esl_threads_WaitForStart (thr);
+  esl_threads_WaitForFinish(thr);
+  if (c < ncpu) goto ERROR;
+  for (c = 0; c < ncpu; c++)
+    if (pj[c].status != eslOK) { status = pj[c].status; goto ERROR; }
+
+  if (( status = esl_msa_SetDefaultWeights(msa)) != eslOK) goto ERROR;
+
+  /* Leave <afp> at EOF, as the serial parser would. */
+  esl_buffer_SetOffset(afp->bf, afp->bf->n);
+  afp->line       = NULL;
+  afp->n          = 0;
+  afp->lineoffset = -1;
+  if (afp->linenumber != -1) afp->linenumber += nlines;
+
+  for (c = 0; c < nchunks; c++) {
+    esl_Free2D((void **) ck[c].csflag, ck[c].msa->nseq);
+    esl_msa_Destroy(ck[c].msa);
+    free(ck[c].nins);
+  }
+  esl_Free2D((void **) csflag, nseq);
+  free(ck);
+  free(pj);
+  free(nins);
+  free(chunkoff);
+  esl_threads_Destroy(thr);
+  *ret_msa = msa;
+  return eslOK;
+
+ ERROR:
+  if (ck) {
+    for (c = 0; c < nchunks; c++) {
+      if (ck[c].msa) esl_Free2D((void **) ck[c].csflag, ck[c].msa->nseq);
+      esl_msa_Destroy(ck[c].msa);
+      if (ck[c].nins) free(ck[c].nins);
+    }
+    free(ck);
+  }
+  if (csflag)   esl_Free2D((void **) csflag, nseq);
+  if (pj)       free(pj);
+  if (nins)     free(nins);
+  if (chunkoff) free(chunkoff);
+  if (thr)      esl_threads_Destroy(thr);
+  if (msa)      esl_msa_Destroy(msa);
+  *ret_msa = NULL;
+  return status;
+}
+
+static void
+a2m_chunk_thread(void *arg)
+{
+  ESL_THREADS *thr = (ESL_THREADS *) arg;
+  A2M_CHUNK   *ck;
+  int          w;
+
+  esl_threads_Started(thr, &w);
+  ck         = (A2M_CHUNK *) esl_threads_GetData(thr, w);
+  ck->status = a2m_parse_chunk(ck);
+  esl_threads_Finished(thr, w);
+  return;
+}
+
+static void
+a2m_pad_thread(void *arg)
+{
+  ESL_THREADS *thr = (ESL_THREADS *) arg;
+  A2M_PADJOB  *pj;
+  int          w;
+
+  esl_threads_Started(thr, &w);
+  pj = (A2M_PADJOB *) esl_threads_GetData(thr, w);
+#ifdef eslAUGMENT_ALPHABET
+  if (pj->msa->abc)   pj->status = a2m_padding_digital(pj->msa, pj->csflag, pj->nins, pj->ncons, pj->idx1, pj->idx2);
+#endif
+  if (! pj->msa->abc) pj->status = a2m_padding_text   (pj->msa, pj->csflag, pj->nins, pj->ncons, pj->idx1, pj->idx2);
+  esl_threads_Finished(thr, w);
+  return;
+}
+
+/* a2m_parse_chunk()
+ *
+ * Parse the A2M records in <ck->p[0..ck->n-1]> into a new growable MSA
+ * of unaligned rows, <ck->msa>, by the same rules as the input phase
+ * of <esl_msafile_a2m_Read()>: set consensus flags <ck->csflag[]> for
+ * each row, the number of consensus columns <ck->ncons>, and the max
+ * number of inserted residues before each consensus column,
+ * <ck->nins[0..ncons]>. The chunk starts on a record's '>' line,
+ * except for the first chunk, which may start with blank lines.
+ *
+ * Returns <eslOK> on success; <eslEFORMAT> on a parse error, with a
+ * message in <ck->errmsg>. Throws <eslEMEM> on allocation failure.
+ * In all cases <ck->msa>, <ck->csflag>, <ck->nins> are left for the
+ * caller to free, with <ck->msa->nseq> counting the rows allocated
+ * so far.
+ */
+static int
+a2m_parse_chunk(A2M_CHUNK *ck)
+{
+  ESLX_MSAFILE *afp        = ck->afp;
+  ESL_MSA      *msa        = NULL;
+  int          *this_nins  = NULL;
+  char         *p          = ck->p;
+  esl_pos_t     nleft      = ck->n;
+  int           idx        = -1;
+  int           ncons      = 0;
+  int64_t       thislen    = 0;
+  int64_t       spos;
+  int           this_ncons = 0;
+  int           cpos, bpos, i;
+  char         *line, *tok;
+  esl_pos_t     n, toklen;
+  int           nterm;
+  int           status;
+
+#ifdef eslAUGMENT_ALPHABET
+  if (afp->abc   &&  (msa = esl_msa_CreateDigital(afp->abc, 16, -1)) == NULL) { status = eslEMEM; goto ERROR; }
+#endif
+  if (! afp->abc &&  (msa = esl_msa_Create(                 16, -1)) == NULL) { status = eslEMEM; goto ERROR; }
+  ck->msa = msa;
+  ESL_ALLOC(ck->csflag, sizeof(char *) * msa->sqalloc);
+  for (i = 0; i < msa->sqalloc; i++) ck->csflag[i] = NULL; 
+
+  while (nleft >= 0)
+    {
+      if (nleft > 0) {
+	esl_memnewline(p, nleft, &n, &nterm);
+	line   = p;
+	p     += n + nterm;
+	nleft -= n + nterm;
+	ck->nlines++;
+	while (n && isspace(*line)) { line++; n--; } 
+	if (n == 0) continue;
+      } else nleft = -1;	/* end of chunk: one more pass to finish the last record */
+
+      if (nleft == -1 || *line == '>')
+	{
+	  /* Finish the previous record, if any */
+	  if (idx == 0) 
+	    {
+	      ncons = this_ncons;
+	      ESL_ALLOC(ck->nins, sizeof(int) * (ncons+1));
+	      for (cpos = 0; cpos <= ncons; cpos++)
+		ck->nins[cpos] = this_nins[cpos];
+	    }
+	  else if (idx > 0)
+	    {
+	      if (this_ncons != ncons) ESL_XFAIL(eslEFORMAT, ck->errmsg, "unexpected # of consensus residues, didn't match previous seq(s)");
+	      for (cpos = 0; cpos <= ncons; cpos++) 
+		ck->nins[cpos] = ESL_MAX(ck->nins[cpos], this_nins[cpos]);
+	    }
+	  if (nleft == -1) break;
+
+	  /* Start a new one */
+	  idx++;
+	  line++; n--;
+	  if ( (status = esl_memtok(&line, &n, " \t", &tok, &toklen)) != eslOK) ESL_XFAIL(eslEFORMAT, ck->errmsg, "no name found for A2M record");
+	  if (idx >= msa->sqalloc) {
+	    int old_sqalloc = msa->sqalloc;
+	    if ( (status = esl_msa_Expand(msa)) != eslOK) goto ERROR;
+	    ESL_REALLOC(ck->csflag, sizeof(char *) * msa->sqalloc);
+	    for (i = old_sqalloc; i < msa->sqalloc; i++) ck->csflag[i] = NULL;
+	  }
+	  msa->nseq = idx+1;
+
+	  if (     (status = esl_msa_SetSeqName       (msa, idx, tok,  toklen)) != eslOK) goto ERROR;
+	  if (n && (status = esl_msa_SetSeqDescription(msa, idx, line, n))      != eslOK) goto ERROR;
+
+	  thislen    = 0;
+	  this_ncons = 0;
+	  if (idx) {
+	    for (cpos = 0; cpos <= ncons; cpos++)
+	      this_nins[cpos] = 0;
+	  } else {
+	    ESL_REALLOC(this_nins, sizeof(int));
+	    this_nins[0] = 0;
+	  }
+	}
+      else
+	{
+	  if (idx < 0) ESL_XFAIL(eslEFORMAT, ck->errmsg, "expected A2M name/desc line starting with >");    
+
+	  ESL_REALLOC(ck->csflag[idx], sizeof(char) * (thislen + n + 1));
+	  if (idx == 0) {
+	    ESL_REALLOC(this_nins, sizeof(int) * (this_ncons + n + 1));
+	    for (cpos = this_ncons; cpos <= this_ncons+n; cpos++)
+	      this_nins[cpos] = 0;
+	  }
+
+	  for (spos = thislen, bpos = 0; bpos < n; bpos++)
+	    {
+	      if      (line[bpos] == 'O')   continue;
+	      else if (isupper(line[bpos])) { ck->csflag[idx][spos++] = TRUE;  this_ncons++;            }
+	      else if (islower(line[bpos])) { ck->csflag[idx][spos++] = FALSE; this_nins[this_ncons]++; }
+	      else if (line[bpos] == '-')   { ck->csflag[idx][spos++] = TRUE;  this_ncons++;            }
+	      if (idx && this_ncons > ncons) ESL_XFAIL(eslEFORMAT, ck->errmsg,  "unexpected # of consensus residues, didn't match previous seq(s)");
+	    }
+	  ck->csflag[idx][spos] = TRUE; /* sentinel for the padding functions */
+
+#ifdef eslAUGMENT_ALPHABET
+	  if (msa->abc)   { status = esl_abc_dsqcat(afp->inmap, &(msa->ax[idx]),   &thislen, line, n); } 
+#endif
+	  if (! msa->abc) { status = esl_strmapcat (afp->inmap, &(msa->aseq[idx]), &thislen, line, n); }
+	  if      (status == eslEINVAL) ESL_XFAIL(eslEFORMAT, ck->errmsg, "one or more invalid sequence characters");
+	  else if (status != eslOK)     goto ERROR;
+	  ESL_DASSERT1( (spos == thislen) );
+	}
+    }
+
+  ck->ncons = ncons;
+  if (this_nins) free(this_nins);
+  return eslOK;
+
+ ERROR:
+  if (this_nins) free(this_nins);
+  return status;
+}
+#endif /*HAVE_PTHREAD*/
 /*---------- end, internal functions for the parser -------------*/
 
 
@@ -848,6 +1293,115 @@ read_test_msas_text(char *a2mfile, char *stkfile)
   esl_msa_Destroy(msa4);
 }
 
+/* write_test_msa_big()
+ * A larger A2M file for testing the parallel parser: <nseq> seqs with
+ * <ncons> consensus columns each, variable inserts, variable line
+ * lengths, blank lines, and some sloppy name lines. If <badidx> is
+ * a valid seq index, that seq has one extra consensus column, which
+ * the parser must detect as a format error; likewise if <emptyidx>
+ * is, that seq has a name line and no sequence lines.
+ */
+static void
+write_test_msa_big(FILE *ofp, int nseq, int ncons, int badidx, int emptyidx)
+{
+  char *res = "ACDEFGHIKLMNPQRSTVWY-";
+  int   i, cpos, x, nres;
+
+  fputs("  \n\n", ofp);
+  for (i = 0; i < nseq; i++)
+    {
+      if (i % 7 == 3) fprintf(ofp, "  >seq%d\r\n", i);
+      else            fprintf(ofp, ">seq%d description of seq%d\n", i, i);
+      if (i == emptyidx) continue;
+      for (nres = 0, cpos = 0; cpos < ncons + (i == badidx ? 1 : 0); cpos++)
+	{
+	  for (x = 0; x < (i * 13 + cpos * 5) % 23 / 8; x++, nres++)   /* inserts of 0..2 residues */
+	    fputc(tolower(res[(i + cpos + x) % 20]), ofp);
+	  fputc(res[(i * 31 + cpos * 7) % 21], ofp);
+	  if (++nres % (40 + i % 11) == 0) fputc('\n', ofp);
+	}
+      fputs("\n", ofp);
+      if (i % 5 == 0) fputs("   \n", ofp);
+    }
+}
+
+static void
+utest_parallel(void)
+{
+  char          msg[]       = "a2m parallel read unit test failed";
+  char          tmpfile[32] = "esltmpXXXXXX";
+  int           ncpus[]     = { 1, 2, 3, 4, 5, 8, 16, 40, 64 };
+  int           nncpus      = sizeof(ncpus) / sizeof(int);
+  int           nseq        = 37;
+  int           ncons       = 113;
+  ESL_ALPHABET *abc         = NULL;
+  ESLX_MSAFILE *afp         = NULL;
+  ESL_MSA      *msa1        = NULL;
+  ESL_MSA      *msa2        = NULL;
+  FILE         *ofp         = NULL;
+  int64_t       nlines;
+  char          errmsg[eslERRBUFSIZE];
+  int           do_digital, k, i;
+
+  if (esl_tmpfile_named(tmpfile, &ofp) != eslOK) esl_fatal(msg);
+  write_test_msa_big(ofp, nseq, ncons, -1, -1);
+  fclose(ofp);
+
+  for (do_digital = 0; do_digital <= 1; do_digital++)
+    {
+      if (eslx_msafile_Open((do_digital ? &abc : NULL), tmpfile, NULL, eslMSAFILE_A2M, NULL, &afp) != eslOK) esl_fatal(msg);
+      if (esl_msafile_a2m_Read(afp, &msa1) != eslOK) esl_fatal(msg);
+      if (msa1->nseq != nseq || msa1->alen <= ncons) esl_fatal(msg);
+      nlines = afp->linenumber;
+      eslx_msafile_Close(afp);
+
+      for (k = 0; k < nncpus; k++)
+	{
+	  if (eslx_msafile_Open((do_digital ? &abc : NULL), tmpfile, NULL, eslMSAFILE_A2M, NULL, &afp) != eslOK) esl_fatal(msg);
+	  if (esl_msafile_a2m_ReadParallel(afp, ncpus[k], &msa2) != eslOK)  esl_fatal(msg);
+	  if (esl_msa_Validate(msa2, NULL)                       != eslOK)  esl_fatal(msg);
+	  if (esl_msa_Compare(msa1, msa2)                        != eslOK)  esl_fatal(msg);
+	  if (strcmp(msa1->rf, msa2->rf)                         != 0)      esl_fatal(msg);
+	  if (afp->linenumber != nlines)                                    esl_fatal(msg);
+	  esl_msa_Destroy(msa2);
+	  if (esl_msafile_a2m_ReadParallel(afp, ncpus[k], &msa2) != eslEOF) esl_fatal(msg);
+	  eslx_msafile_Close(afp);
+	}
+      esl_msa_Destroy(msa1);
+    }
+  remove(tmpfile);
+
+  /* Bad files: one seq with an extra consensus column, late in the file;
+   * or any one seq with no sequence lines, which at some <ncpu> is the
+   * first record of a chunk. Every <ncpu> must give the serial parser's
+   * error.
+   */
+  for (i = -1; i < nseq; i++)
+    {
+      strcpy(tmpfile, "esltmpXXXXXX");
+      if (esl_tmpfile_named(tmpfile, &ofp) != eslOK) esl_fatal(msg);
+      if (i == -1) write_test_msa_big(ofp, nseq, ncons, nseq-2, -1);
+      else         write_test_msa_big(ofp, nseq, ncons, -1,     i);
+      fclose(ofp);
+
+      if (eslx_msafile_Open(&abc, tmpfile, NULL, eslMSAFILE_A2M, NULL, &afp) != eslOK) esl_fatal(msg);
+      if (esl_msafile_a2m_Read(afp, &msa1) != eslEFORMAT) esl_fatal(msg);
+      nlines = afp->linenumber;
+      strcpy(errmsg, afp->errmsg);
+      eslx_msafile_Close(afp);
+
+      for (k = 0; k < nncpus; k++)
+	{
+	  if (eslx_msafile_Open(&abc, tmpfile, NULL, eslMSAFILE_A2M, NULL, &afp) != eslOK) esl_fatal(msg);
+	  if (esl_msafile_a2m_ReadParallel(afp, ncpus[k], &msa2) != eslEFORMAT) esl_fatal(msg);
+	  if (afp->linenumber != nlines || strcmp(afp->errmsg, errmsg) != 0)   esl_fatal(msg);
+	  eslx_msafile_Close(afp);
+	}
+      remove(tmpfile);
+    }
+  esl_alphabet_Destroy(abc);
+}
+
 #endif /*eslMSAFILE_A2M_TESTDRIVE*/
 /*---------------------- end, unit tests ------------------------*/
 
@@ -903,6 +1457,7 @@ main(int argc, char **argv)
 
   read_test_msas_digital(a2mfile, stkfile);
   read_test_msas_text   (a2mfile, stkfile);
+  utest_parallel();
 
   /* Various "good" files that should be parsed correctly */
   for (testnumber = 1; testnumber <= ngoodtests; testnumber++)
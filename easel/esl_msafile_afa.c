@@ -2,10 +2,11 @@
  *
  * Contents:
  *   1. API for reading/writing AFA format
- *   2. Unit tests.
- *   3. Test driver.
- *   4. Examples.
- *   5. License and copyright.
+ *   2. Internal functions used by the parallel AFA parser
+ *   3. Unit tests.
+ *   4. Test driver.
+ *   5. Examples.
+ *   6. License and copyright.
  */
 #include "esl_config.h"
 
@@ -22,6 +23,27 @@
 #include "esl_msa.h"
 #include "esl_msafile.h"
 #include "esl_msafile_afa.h"
+#ifdef HAVE_PTHREAD
+#include "esl_threads.h"
+#endif
+
+#ifdef HAVE_PTHREAD
+/* AFA_CHUNK: one worker's share of a parallel parse */
+typedef struct {
+  ESLX_MSAFILE *afp;                    /* input; shared, read-only (bf->mem, inmap, abc) */
+  char         *p;                      /* start of this chunk in <afp->bf->mem>          */
+  esl_pos_t     n;                      /* length of this chunk in bytes                  */
+  ESL_MSA      *msa;                    /* RETURN: rows parsed from this chunk            */
+  int64_t       alen;                   /* RETURN: alignment length of rows in this chunk */
+  int64_t       nlines;                 /* RETURN: number of input lines in this chunk    */
+  int           status;                 /* RETURN: eslOK, eslEFORMAT, or exception code   */
+  char          errmsg[eslERRBUFSIZE];  /* private error message; see note on reparsing   */
+} AFA_CHUNK;
+
+static int  afa_read_parallel(ESLX_MSAFILE *afp, int ncpu, ESL_MSA **ret_msa);
+static void afa_chunk_thread (void *arg);
+static int  afa_parse_chunk  (AFA_CHUNK *ck);
+#endif /*HAVE_PTHREAD*/
 
 /*****************************************************************
  *# 1. API for reading/writing AFA format
@@ -215,6 +237,7 @@ esl_msafile_afa_Read(ESLX_MSAFILE *afp, ESL_MSA **ret_msa)
 
     if ( (status = esl_memtok(&p, &n, " \t", &tok, &ntok)) != eslOK) ESL_XFAIL(eslEFORMAT, afp->errmsg, "no name found for aligned FASTA record");
     if (idx >= msa->sqalloc && (status = esl_msa_Expand(msa))    != eslOK) goto ERROR;
+    msa->nseq = idx+1;		/* keep nseq current, so esl_msa_Destroy() on an error path frees every row */
 
     if (     (status = esl_msa_SetSeqName       (msa, idx, tok, ntok)) != eslOK) goto ERROR;
     if (n && (status = esl_msa_SetSeqDescription(msa, idx, p,   n))    != eslOK) goto ERROR;
@@ -260,6 +283,58 @@ esl_msafile_afa_Read(ESLX_MSAFILE *afp, ESL_MSA **ret_msa)
 
 }
 
+
+/* Function:  esl_msafile_afa_ReadParallel()
+ * Synopsis:  Read an aligned FASTA format alignment, using threads.
+ *
+ * Purpose:   Same as <esl_msafile_afa_Read()>, but when the input is
+ *            entirely in memory (a slurped or mmap()'ed file, or a
+ *            string), split it at '>' record boundaries into <ncpu>
+ *            chunks, parse the chunks concurrently on <ncpu> worker
+ *            threads, each into its own growable MSA, and merge the
+ *            rows in input order.
+ *
+ *            If <ncpu> is <= 1, if the input is a stream, or if Easel
+ *            was compiled without POSIX threads, this simply calls
+ *            <esl_msafile_afa_Read()>.
+ *
+ *            The result is identical to that of
+ *            <esl_msafile_afa_Read()>. If the threaded parse finds a
+ *            format error, the input is rewound and reparsed
+ *            serially, so the <eslEFORMAT> diagnostics in <afp> are
+ *            exactly those of the serial parser.
+ *
+ * Args:      afp     - open <ESLX_MSAFILE>
+ *            ncpu    - number of worker threads to use
+ *            ret_msa - RETURN: newly parsed <ESL_MSA>
+ *
+ * Returns:   (same as <esl_msafile_afa_Read()>.)
+ *
+ * Throws:    (same as <esl_msafile_afa_Read()>), and also
+ *            <eslESYS> if thread creation or synchronization fails.
+ */
+int
+esl_msafile_afa_ReadParallel(ESLX_MSAFILE *afp, int ncpu, ESL_MSA **ret_msa)
+{
+#ifdef HAVE_PTHREAD
+  esl_pos_t start      = afp->bf->pos;
+  int64_t   linenumber = afp->linenumber;
+  int       status;
+
+  if (ncpu > 1)
+    {
+      status = afa_read_parallel(afp, ncpu, ret_msa);
+      if (status == eslEFORMAT) 
+	{ /* rewind, and reparse serially for diagnostics */
+	  esl_buffer_SetOffset(afp->bf, start);
+	  afp->linenumber = linenumber;
+	}
+      else if (status != eslEINVAL) return status; /* eslEINVAL: input isn't in memory; use serial parser */
+    }
+#endif
+  return esl_msafile_afa_Read(afp, ret_msa);
+}
+
 /* Function:  esl_msafile_afa_Write()
  * Synopsis:  Write an aligned FASTA format alignment file to a stream.
  *
@@ -311,7 +386,237 @@ esl_msafile_afa_Write(FILE *fp, const ESL_MSA *msa)
 }
 
 /*****************************************************************
- * 2. Unit tests.
+ * 2. Internal functions used by the parallel AFA parser
+ *****************************************************************/
+#ifdef HAVE_PTHREAD
+
+/* afa_read_parallel()
+ * 
+ * The threaded parse: split the in-memory input into chunks at '>'
+ * record starts, parse each chunk into its own growable MSA on its
+ * own worker thread, then move the rows (pointers, not data) into
+ * the final MSA in input order.
+ *
+ * Workers never touch <afp> except to read its buffer and input map;
+ * each has a private error message buffer. We don't try to construct
+ * diagnostics here: on <eslEFORMAT>, caller rewinds and reparses
+ * serially. Returns <eslEINVAL> if the input isn't entirely in
+ * memory, or if there's only one chunk; caller takes that as a
+ * signal to use the serial parser.
+ */
+static int
+afa_read_parallel(ESLX_MSAFILE *afp, int ncpu, ESL_MSA **ret_msa)
+{
+  ESL_THREADS *thr      = NULL;
+  AFA_CHUNK   *ck       = NULL;
+  esl_pos_t   *chunkoff = NULL;
+  ESL_MSA     *msa      = NULL;
+  int          nchunks  = 0;
+  int          nseq     = 0;
+  int64_t      alen     = 0;
+  int64_t      nlines   = 0;
+  int          c, i, idx, x;
+  int          status;
+
+  ESL_DASSERT1( (afp->format == eslMSAFILE_AFA) );
+  afp->errmsg[0] = '\0';
+
+  ESL_ALLOC(chunkoff, sizeof(esl_pos_t) * (ncpu+1));
+  if ((status = eslx_msafile_SplitRecords(afp, '>', ncpu, chunkoff, &nchunks)) != eslOK) goto ERROR;
+  if (nchunks < 2) { status = eslEINVAL; goto ERROR; }
+
+  ESL_ALLOC(ck, sizeof(AFA_CHUNK) * nchunks);
+  for (c = 0; c < nchunks; c++)
+    {
+      ck[c].afp       = afp;
+      ck[c].p         = afp->bf->mem + chunkoff[c];
+      ck[c].n         = chunkoff[c+1] - chunkoff[c];
+      ck[c].msa       = NULL;
+      ck[c].alen      = 0;
+      ck[c].nlines    = 0;
+      ck[c].status    = eslOK;
+      ck[c].errmsg[0] = '\0';
+    }
+
+  if ((thr = esl_threads_Create(&afa_chunk_thread)) == NULL) { status = eslEMEM; goto ERROR; }
+  for (c = 0; c < nchunks; c++)
+    if ((status = esl_threads_AddThread(thr, (void *) &(ck[c]))) != eslOK) break;
+  esl_threads_WaitForStart (thr);
+  esl_threads_WaitForFinish(thr);
+  if (c < nchunks) goto ERROR;
+
+  /* Check that chunks agree with each other, and count rows. */
+  for (c = 0; c < nchunks; c++)
+    {
+      if (ck[c].status != eslOK) { status = ck[c].status; goto ERROR; }
+      nlines += ck[c].nlines;
+      if (ck[c].msa->nseq == 0)  continue; /* only chunk 0 can be empty: blank lines before the first record */
+      if (alen && ck[c].alen != alen) { status = eslEFORMAT; goto ERROR; }
+      alen    = ck[c].alen;
+      nseq   += ck[c].msa->nseq;
+    }
+  if (nseq == 0) { status = eslEFORMAT; goto ERROR; }
+
+  /* Merge: move rows into the final MSA, in input order. */
+#ifdef eslAUGMENT_ALPHABET
+  if (afp->abc   &&  (msa = esl_msa_CreateDigital(afp->abc, nseq, -1)) == NULL) { status = eslEMEM; goto ERROR; }
+#endif
+  if (! afp->abc &&  (msa = esl_msa_Create(                 nseq, -1)) == NULL) { status = eslEMEM; goto ERROR; }
+
+  for (idx = 0, c = 0; c < nchunks; c++)
+    for (i = 0; i < ck[c].msa->nseq; i++, idx++)
+      {
+#ifdef eslAUGMENT_ALPHABET
+	if (msa->abc)   { msa->ax[idx]   = ck[c].msa->ax[i];   ck[c].msa->ax[i]   = NULL; }
+#endif
+	if (! msa->abc) { msa->aseq[idx] = ck[c].msa->aseq[i]; ck[c].msa->aseq[i] = NULL; }
+	msa->sqname[idx] = ck[c].msa->sqname[i];  ck[c].msa->sqname[i] = NULL;
+
+	if (ck[c].msa->sqdesc && ck[c].msa->sqdesc[i])
+	  {
+	    if (! msa->sqdesc) {
+	      ESL_ALLOC(msa->sqdesc, sizeof(char *) * msa->sqalloc);
+	      for (x = 0; x < msa->sqalloc; x++) msa->sqdesc[x] = NULL;
+	    }
+	    msa->sqdesc[idx] = ck[c].msa->sqdesc[i];  ck[c].msa->sqdesc[i] = NULL;
+	  }
+	msa->nseq = idx+1;
+      }
+  msa->alen = alen;
+  if (( status = esl_msa_SetDefaultWeights(msa)) != eslOK) goto ERROR;
+
+  /* Leave <afp> at EOF, as the serial parser would. */
+  esl_buffer_SetOffset(afp->bf, afp->bf->n);
+  afp->line       = NULL;
+  afp->n          = 0;
+  afp->lineoffset = -1;
+  if (afp->linenumber != -1) afp->linenumber += nlines;
+
+  for (c = 0; c < nchunks; c++) esl_msa_Destroy(ck[c].msa);
+  free(ck);
+  free(chunkoff);
+  esl_threads_Destroy(thr);
+  *ret_msa = msa;
+  return eslOK;
+
+ ERROR:
+  if (ck) {
+    for (c = 0; c < nchunks; c++) esl_msa_Destroy(ck[c].msa);
+    free(ck);
+  }
+  if (chunkoff) free(chunkoff);
+  if (thr)      esl_threads_Destroy(thr);
+  if (msa)      esl_msa_Destroy(msa);
+  *ret_msa = NULL;
+  return status;
+}
+
+static void
+afa_chunk_thread(void *arg)
+{
+  ESL_THREADS *thr = (ESL_THREADS *) arg;
+  AFA_CHUNK   *ck;
+  int          w;
+
+  esl_threads_Started(thr, &w);
+  ck         = (AFA_CHUNK *) esl_threads_GetData(thr, w);
+  ck->status = afa_parse_chunk(ck);
+  esl_threads_Finished(thr, w);
+  return;
+}
+
+/* afa_parse_chunk()
+ *
+ * Parse the aligned FASTA records in <ck->p[0..ck->n-1]> into a new
+ * growable MSA, <ck->msa>, by the same rules as
+ * <esl_msafile_afa_Read()>. The chunk starts on a record's '>' line,
+ * except for the first chunk, which may start with blank lines.
+ * Sets <ck->alen> and <ck->nlines>.
+ *
+ * Returns <eslOK> on success; <eslEFORMAT> on a parse error, with a
+ * message in <ck->errmsg>. Throws <eslEMEM> on allocation failure.
+ * In all cases <ck->msa> is left for the caller to free, with
+ * <ck->msa->nseq> counting the rows allocated so far.
+ */
+static int
+afa_parse_chunk(AFA_CHUNK *ck)
+{
+  ESLX_MSAFILE *afp       = ck->afp;
+  ESL_MSA      *msa       = NULL;
+  char         *p         = ck->p;
+  esl_pos_t     nleft     = ck->n;
+  int           idx       = -1;
+  int64_t       alen      = 0;
+  int64_t       this_alen = 0;
+  char         *line, *tok;
+  esl_pos_t     n, ntok;
+  int           nterm;
+  int           status;
+
+#ifdef eslAUGMENT_ALPHABET
+  if (afp->abc   &&  (msa = esl_msa_CreateDigital(afp->abc, 16, -1)) == NULL) { status = eslEMEM; goto ERROR; }
+#endif
+  if (! afp->abc &&  (msa = esl_msa_Create(                 16, -1)) == NULL) { status = eslEMEM; goto ERROR; }
+  ck->msa = msa;
+
+  while (nleft > 0)
+    {
+      esl_memnewline(p, nleft, &n, &nterm);
+      line   = p;
+      p     += n + nterm;
+      nleft -= n + nterm;
+      ck->nlines++;
+
+      while (n && isspace(*line)) { line++; n--; } 
+      if (n == 0) continue;
+
+      if (*line == '>')
+	{
+	  if (idx >= 0) {
+	    if (this_alen == 0)            ESL_XFAIL(eslEFORMAT, ck->errmsg, "sequence %s has alen %" PRId64 , msa->sqname[idx], this_alen);
+	    if (alen && alen != this_alen) ESL_XFAIL(eslEFORMAT, ck->errmsg, "sequence %s has alen %" PRId64 "; expected %" PRId64, msa->sqname[idx], this_alen, alen);
+	    alen = this_alen;
+	  }
+	  idx++;
+	  this_alen = 0;
+
+	  if (n <= 1) ESL_XFAIL(eslEFORMAT, ck->errmsg, "expected aligned FASTA name/desc line starting with >");    
+	  line++; n--;
+	  if ( (status = esl_memtok(&line, &n, " \t", &tok, &ntok)) != eslOK) ESL_XFAIL(eslEFORMAT, ck->errmsg, "no name found for aligned FASTA record");
+	  if (idx >= msa->sqalloc && (status = esl_msa_Expand(msa))    != eslOK) goto ERROR;
+	  msa->nseq = idx+1;
+
+	  if (     (status = esl_msa_SetSeqName       (msa, idx, tok,  ntok)) != eslOK) goto ERROR;
+	  if (n && (status = esl_msa_SetSeqDescription(msa, idx, line, n))    != eslOK) goto ERROR;
+	}
+      else
+	{
+	  if (idx < 0) ESL_XFAIL(eslEFORMAT, ck->errmsg, "expected aligned FASTA name/desc line starting with >");    
+#ifdef eslAUGMENT_ALPHABET
+	  if (msa->abc)   { status = esl_abc_dsqcat(afp->inmap, &(msa->ax[idx]),   &this_alen, line, n); }
+#endif
+	  if (! msa->abc) { status = esl_strmapcat (afp->inmap, &(msa->aseq[idx]), &this_alen, line, n); }
+	  if      (status == eslEINVAL) ESL_XFAIL(eslEFORMAT, ck->errmsg, "one or more invalid sequence characters");
+	  else if (status != eslOK)     goto ERROR;
+	}
+    }
+
+  if (idx >= 0) {
+    if (this_alen == 0)            ESL_XFAIL(eslEFORMAT, ck->errmsg, "sequence %s has alen %" PRId64 , msa->sqname[idx], this_alen);
+    if (alen && alen != this_alen) ESL_XFAIL(eslEFORMAT, ck->errmsg, "sequence %s has alen %" PRId64 "; expected %" PRId64, msa->sqname[idx], this_alen, alen);
+  }
+  ck->alen = this_alen;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+#endif /*HAVE_PTHREAD*/
+/*------------ end, parallel AFA parser internals ---------------*/
+
+
+/*****************************************************************
+ * 3. Unit tests.
  *****************************************************************/
 #ifdef eslMSAFILE_AFA_TESTDRIVE
 /* a standard globin example, but dusted with evil:
@@ -554,12 +859,109 @@ read_test_msas_text(char *afafile, char *stkfile)
   esl_msa_Destroy(msa3);  
   esl_msa_Destroy(msa4);
 }
+
+/* write a larger AFA file, with some sloppy whitespace and varying
+ * line widths; row <badidx> (if >= 0) is one column too long.
+ */
+static void
+write_test_msa_big(FILE *ofp, int nseq, int alen, int badidx)
+{
+  char *res = "ACDEFGHIKLMNPQRSTVWY-";
+  int   i, pos;
+
+  fputs("  \n\n", ofp);
+  for (i = 0; i < nseq; i++)
+    {
+      if (i % 7 == 3) fprintf(ofp, "  >seq%d\r\n", i);
+      else            fprintf(ofp, ">seq%d description of seq%d\n", i, i);
+      for (pos = 0; pos < alen + (i == badidx ? 1 : 0); pos++)
+	{
+	  fputc(res[(i * 31 + pos * 7) % 21], ofp);
+	  if ((pos+1) % (40 + i % 11) == 0) fputc('\n', ofp);
+	}
+      fputs("\n", ofp);
+      if (i % 5 == 0) fputs("   \n", ofp);
+    }
+}
+
+/* utest_parallel()
+ * Threaded parsing gives the same MSA as the serial parser, in text
+ * and digital mode, for any number of threads; and on a bad file, it
+ * gives the serial parser's error and diagnostics.
+ */
+static void
+utest_parallel(void)
+{
+  char          msg[]       = "afa parallel read unit test failed";
+  char          tmpfile[32] = "esltmpXXXXXX";
+  int           ncpus[]     = { 1, 2, 3, 8, 64 };
+  int           nncpus      = sizeof(ncpus) / sizeof(int);
+  int           nseq        = 37;
+  int           alen        = 113;
+  ESL_ALPHABET *abc         = NULL;
+  ESLX_MSAFILE *afp         = NULL;
+  ESL_MSA      *msa1        = NULL;
+  ESL_MSA      *msa2        = NULL;
+  FILE         *ofp         = NULL;
+  int64_t       nlines;
+  char          errmsg[eslERRBUFSIZE];
+  int           do_digital, k;
+
+  if (esl_tmpfile_named(tmpfile, &ofp) != eslOK) esl_fatal(msg);
+  write_test_msa_big(ofp, nseq, alen, -1);
+  fclose(ofp);
+
+  for (do_digital = 0; do_digital <= 1; do_digital++)
+    {
+      if (eslx_msafile_Open((do_digital ? &abc : NULL), tmpfile, NULL, eslMSAFILE_AFA, NULL, &afp) != eslOK) esl_fatal(msg);
+      if (esl_msafile_afa_Read(afp, &msa1) != eslOK) esl_fatal(msg);
+      if (msa1->nseq != nseq || msa1->alen != alen)  esl_fatal(msg);
+      nlines = afp->linenumber;
+      eslx_msafile_Close(afp);
+
+      for (k = 0; k < nncpus; k++)
+	{
+	  if (eslx_msafile_Open((do_digital ? &abc : NULL), tmpfile, NULL, eslMSAFILE_AFA, NULL, &afp) != eslOK) esl_fatal(msg);
+	  if (esl_msafile_afa_ReadParallel(afp, ncpus[k], &msa2) != eslOK) esl_fatal(msg);
+	  if (esl_msa_Validate(msa2, NULL)                       != eslOK) esl_fatal(msg);
+	  if (esl_msa_Compare(msa1, msa2)                        != eslOK) esl_fatal(msg);
+	  if (afp->linenumber != nlines)                                   esl_fatal(msg);
+	  esl_msa_Destroy(msa2);
+	  if (esl_msafile_afa_ReadParallel(afp, ncpus[k], &msa2) != eslEOF) esl_fatal(msg);
+	  eslx_msafile_Close(afp);
+	}
+      esl_msa_Destroy(msa1);
+    }
+  remove(tmpfile);
+
+  /* A bad file: one row too long, late in the file */
+  strcpy(tmpfile, "esltmpXXXXXX");
+  if (esl_tmpfile_named(tmpfile, &ofp) != eslOK) esl_fatal(msg);
+  write_test_msa_big(ofp, nseq, alen, nseq-2);
+  fclose(ofp);
+
+  if (eslx_msafile_Open(&abc, tmpfile, NULL, eslMSAFILE_AFA, NULL, &afp) != eslOK) esl_fatal(msg);
+  if (esl_msafile_afa_Read(afp, &msa1) != eslEFORMAT) esl_fatal(msg);
+  nlines = afp->linenumber;
+  strcpy(errmsg, afp->errmsg);
+  eslx_msafile_Close(afp);
+
+  for (k = 0; k < nncpus; k++)
+    {
+      if (eslx_msafile_Open(&abc, tmpfile, NULL, eslMSAFILE_AFA, NULL, &afp) != eslOK) esl_fatal(msg);
+      if (esl_msafile_afa_ReadParallel(afp, ncpus[k], &msa2) != eslEFORMAT) esl_fatal(msg);
+      if (afp->linenumber != nlines || strcmp(afp->errmsg, errmsg) != 0)   esl_fatal(msg);
+      eslx_msafile_Close(afp);
+    }
+  remove(tmpfile);
+  esl_alphabet_Destroy(abc);
+}
 #endif /*eslMSAFILE_AFA_TESTDRIVE*/
 /*---------------------- end, unit tests ------------------------*/
 
 
 /*****************************************************************
- * 3. Test driver.
+ * 4. Test driver.
  *****************************************************************/
 #ifdef eslMSAFILE_AFA_TESTDRIVE
 /* compile: gcc -g -Wall -I. -L. -o esl_msafile_afa_utest -DeslMSAFILE_AFA_TESTDRIVE esl_msafile_afa.c -leasel -lm
@@ -609,6 +1011,7 @@ main(int argc, char **argv)
 
   read_test_msas_digital(afafile, stkfile);
   read_test_msas_text   (afafile, stkfile);
+  utest_parallel();
 
   /* Various "good" files that should be parsed correctly */
   for (testnumber = 1; testnumber <= ngoodtests; testnumber++)
@@ -635,7 +1038,7 @@ main(int argc, char **argv)
 
 
 /*****************************************************************
- * 4. Examples.
+ * 5. Examples.
  *****************************************************************/
 
 #ifdef eslMSAFILE_AFA_EXAMPLE
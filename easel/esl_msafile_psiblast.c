@@ -320,6 +320,8 @@ esl_msafile_psiblast_Read(ESLX_MSAFILE *afp, ESL_MSA **ret_msa)
  *            msa - MSA to write       
  *
  * Returns:   <eslOK> on success.
+ *            <eslENOTFOUND> or <eslECORRUPT> if deferred annotation
+ *            (<msa->lazy>) can't be read; see <esl_msa_MaterializeAnnotation()>.
  *
  * Throws:    <eslEMEM> on allocation failure.
  *            <eslEWRITE> on any system write failure, such as filled disk.
@@ -338,6 +340,8 @@ esl_msafile_psiblast_Write(FILE *fp, const ESL_MSA *msa)
   int      is_residue;
   int      status;
 
+  if (msa->lazy && (status = esl_msa_MaterializeAnnotation((ESL_MSA *) msa, NULL)) != eslOK) return status; /* deferred annotation is part of <msa> */
+
   ESL_ALLOC(buf, sizeof(char) * (cpl+1));
 
   for (pos = 0; pos < msa->alen; pos += cpl)
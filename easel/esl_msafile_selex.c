@@ -285,6 +285,8 @@ esl_msafile_selex_Read(ESLX_MSAFILE *afp, ESL_MSA **ret_msa)
  *            msa - alignment to write
  *
  * Returns:   <eslOK> on success.
+ *            <eslENOTFOUND> or <eslECORRUPT> if deferred annotation
+ *            (<msa->lazy>) can't be read; see <esl_msa_MaterializeAnnotation()>.
  *
  * Throws:    <eslEMEM> on allocation error.
  *            <eslEWRITE> on any system write error, such
@@ -301,6 +303,8 @@ esl_msafile_selex_Write(FILE *fp, const ESL_MSA *msa)
   int64_t apos;
   int     status;
 
+  if (msa->lazy && (status = esl_msa_MaterializeAnnotation((ESL_MSA *) msa, NULL)) != eslOK) return status; /* deferred annotation is part of <msa> */
+
   ESL_ALLOC(buf, sizeof(char) * (cpl+1));
   buf[cpl] = '\0';
   for (i = 0; i < msa->nseq; i++) {
@@ -6,11 +6,12 @@
  *   2. Internal: ESL_STOCKHOLM_PARSEDATA auxiliary structure.
  *   3. Internal: parsing Stockholm line types.
  *   4. Internal: looking up seq, tag indices.
- *   5. Internal: writing Stockholm/Pfam formats
- *   6. Unit tests.
- *   7. Test driver.
- *   8. Example.
- *   9. License and copyright.
+ *   5. Internal: parallel parsing of alignment blocks.
+ *   6. Internal: writing Stockholm/Pfam formats
+ *   7. Unit tests.
+ *   8. Test driver.
+ *   9. Example.
+ *  10. License and copyright.
  */
 #include "esl_config.h"
 
@@ -25,6 +26,9 @@
 #include "esl_msa.h"
 #include "esl_msafile.h"
 #include "esl_msafile_stockholm.h"
+#ifdef HAVE_PTHREAD
+#include "esl_threads.h"
+#endif
 
 /* Valid line types in an alignment block */
 #define eslSTOCKHOLM_LINE_SQ        1
@@ -48,6 +52,8 @@ typedef struct {
   int       in_block;		/* TRUE if we're in a block (GC, GR, or sequence lines) */
   char     *blinetype;		/* blinetype[bi=0..npb-1] = code for linetype on parsed block line [bi]: GC, GR, or seq  */
   int      *bidx;		/* bidx[bi=0.npb-1] = seq index si=0..nseq-1 of seq or GR on parsed block line [bi]; or -1 for GC lines */
+  int      *btagidx;		/* btagidx[bi=0..npb-1] = tag index of unparsed GC or GR tag on parsed block line [bi]; or -1      */
+  int      *blazy;		/* blazy[bi=0..npb-1] = index of deferred annotation line in msa->lazy on block line [bi]; or -1  */
   int       npb;		/* number of lines per block. Set by bi in 1st block; checked against bi thereafter */
   int       bi;			/* index of current line in a block, 0..npb-1  */
   int       si;		        /* current (next expected) sequence index, 0..nseq */
@@ -79,17 +85,47 @@ static int                      stockholm_parsedata_ExpandSeq  (ESL_STOCKHOLM_PA
 static int                      stockholm_parsedata_ExpandBlock(ESL_STOCKHOLM_PARSEDATA *pd);
 static void                     stockholm_parsedata_Destroy    (ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa);
 
+static int stockholm_parse_header(ESLX_MSAFILE *afp);
+static int stockholm_parse_blocks(ESLX_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa, int maxblock, int *ret_eor);
+static int stockholm_parse_finish(ESLX_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa);
 static int stockholm_parse_gf(ESLX_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa, char *p, esl_pos_t n);
 static int stockholm_parse_gs(ESLX_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa, char *p, esl_pos_t n);
 static int stockholm_parse_gc(ESLX_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa, char *p, esl_pos_t n);
 static int stockholm_parse_gr(ESLX_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa, char *p, esl_pos_t n);
 static int stockholm_parse_sq(ESLX_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa, char *p, esl_pos_t n);
 static int stockholm_parse_comment(ESL_MSA *msa, char *p, esl_pos_t n);
+static int stockholm_defer_line(ESLX_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa, char *tag, esl_pos_t taglen, int seqidx, char *p);
 
 static int stockholm_get_seqidx   (ESL_MSA *msa, ESL_STOCKHOLM_PARSEDATA *pd, char *name, esl_pos_t n,      int *ret_idx);
 static int stockholm_get_gr_tagidx(ESL_MSA *msa, ESL_STOCKHOLM_PARSEDATA *pd, char *tag,  esl_pos_t taglen, int *ret_tagidx);
 static int stockholm_get_gc_tagidx(ESL_MSA *msa, ESL_STOCKHOLM_PARSEDATA *pd, char *tag,  esl_pos_t taglen, int *ret_tagidx);
 
+#ifdef HAVE_PTHREAD
+/* STOCKHOLM_SLAB: one worker's share of a parallel parse: a run of
+ * whole alignment blocks, parsed into one column slab per block line.
+ */
+typedef struct {
+  ESLX_MSAFILE            *afp;                   /* input; shared, read-only (inmap, abc)                         */
+  ESL_STOCKHOLM_PARSEDATA *pd;                    /* first block's line order; shared, read-only                   */
+  ESL_MSA                 *msa;                   /* seq names, tags from first block; shared, read-only           */
+  char                    *p;                     /* start of this chunk in <afp->bf->mem>                         */
+  esl_pos_t                n;                     /* length of this chunk in bytes                                 */
+  char                   **slab;                  /* RETURN: text columns for block line bi=0..npb-1; or NULL      */
+  ESL_DSQ                **dslab;                 /* RETURN: digital columns for seq lines, if <afp->abc>; or NULL */
+  int64_t                  alen;                  /* RETURN: number of columns in each slab                        */
+  int                      nb;                    /* RETURN: number of blocks in this chunk                        */
+  int                      nballoc;               /* number of blocks allocated for in <loff>, <bwidth>            */
+  esl_pos_t               *loff;                  /* RETURN: lazy mode: offset of deferred line bi in block k, [k*npb+bi] */
+  int64_t                 *bwidth;                /* RETURN: lazy mode: bwidth[k] = number of columns in block k   */
+  int                      status;                /* RETURN: eslOK, eslEFORMAT, or exception code                  */
+  char                     errmsg[eslERRBUFSIZE]; /* private error message                                         */
+} STOCKHOLM_SLAB;
+
+static int  stockholm_read_parallel(ESLX_MSAFILE *afp, int ncpu, ESL_MSA **ret_msa);
+static void stockholm_slab_thread  (void *arg);
+static int  stockholm_parse_slab   (STOCKHOLM_SLAB *sl);
+#endif /*HAVE_PTHREAD*/
+
 static int stockholm_write(FILE *fp, const ESL_MSA *msa, int64_t cpl);
 
 
@@ -217,6 +253,12 @@ esl_msafile_stockholm_GuessAlphabet(ESLX_MSAFILE *afp, int *ret_type)
  *            MSA, and return it by reference through 
  *            <*ret_msa>. Caller is responsible for freeing
  *            this <ESL_MSA>.
+ *
+ *            If <afp> was set to defer per-residue annotation by
+ *            <eslx_msafile_SetLazyAnnotation()>, #=GC and #=GR lines
+ *            are checked but their text is left in the file, and
+ *            <msa->lazy> says where it is; see
+ *            <esl_msa_MaterializeAnnotation()>.
  *            
  * Args:      <afp>     - open <ESL_MSAFILE> to read from
  *            <ret_msa> - RETURN: newly parsed, created <ESL_MSA>
@@ -249,9 +291,7 @@ esl_msafile_stockholm_Read(ESLX_MSAFILE *afp, ESL_MSA **ret_msa)
 {
   ESL_MSA                 *msa      = NULL;
   ESL_STOCKHOLM_PARSEDATA *pd       = NULL;
-  char                    *p;
-  esl_pos_t                n;
-  int                      idx;
+  int                      is_eor;
   int                      status;
 
   ESL_DASSERT1( (afp->format == eslMSAFILE_PFAM || afp->format == eslMSAFILE_STOCKHOLM) );
@@ -264,66 +304,11 @@ esl_msafile_stockholm_Read(ESLX_MSAFILE *afp, ESL_MSA **ret_msa)
 #endif
   if (! afp->abc &&  (msa = esl_msa_Create(                 16, -1)) == NULL) { status = eslEMEM; goto ERROR; }
   if ( (pd = stockholm_parsedata_Create(msa))                        == NULL) { status = eslEMEM; goto ERROR; }
+  if (afp->do_lazy && (msa->lazy = esl_msa_lazy_Create(afp->bf->filename)) == NULL) { status = eslEMEM; goto ERROR; }
 
-  /* Skip leading blank lines in file. EOF here is a normal EOF return. */
-  do { 
-    if ( ( status = eslx_msafile_GetLine(afp, &p, &n)) != eslOK) goto ERROR;  /* eslEOF is OK here - end of input (eslEOF) [eslEMEM|eslESYS] */
-  } while (esl_memspn(afp->line, afp->n, " \t") == afp->n ||                  /* skip blank lines             */
-	   (esl_memstrpfx(afp->line, afp->n, "#")                             /* and skip comment lines       */
-	    && ! esl_memstrpfx(afp->line, afp->n, "# STOCKHOLM")));           /* but stop on Stockholm header */
-
-  /* Check for the magic Stockholm header */
-  if (! esl_memstrpfx(afp->line, afp->n, "# STOCKHOLM 1."))  ESL_XFAIL(eslEFORMAT, afp->errmsg, "missing Stockholm header");
-
-  while ( (status = eslx_msafile_GetLine(afp, &p, &n)) == eslOK) /* (eslEOF) [eslEMEM|eslESYS] */
-    {
-      while (n && ( *p == ' ' || *p == '\t')) { p++; n--; } /* skip leading whitespace */
-
-      if (!n || esl_memstrpfx(p, n, "//"))
-	{ /* blank lines and the Stockholm end-of-record // trigger end-of-block logic */
-	  if (pd->in_block) {
-	    if (pd->nblock) { if (pd->nseq_b != pd->nseq) ESL_XFAIL(eslEFORMAT, afp->errmsg, "number of seqs in block did not match number in earlier block(s)");     }
-	    else            { if (pd->nseq_b < pd->nseq)  ESL_XFAIL(eslEFORMAT, afp->errmsg, "number of seqs in block did not match number annotated by #=GS lines"); };
-	    if (pd->nblock) { if (pd->bi != pd->npb)      ESL_XFAIL(eslEFORMAT, afp->errmsg, "unexpected number of lines in alignment block"); }
-
-	    pd->nseq     = msa->nseq = pd->nseq_b;
-	    pd->alen    += pd->alen_b;
-	    pd->in_block = FALSE;
-	    pd->npb      = pd->bi;
-	    pd->bi       = 0;
-	    pd->si       = 0;
-	    pd->nblock  += 1;
-	    pd->nseq_b   = 0;
-	    pd->alen_b   = 0;
-	  }
-	  if   (esl_memstrpfx(p, n, "//"))   break; /* Stockholm end-of-record marker */
-	  else continue;			    /* else, on to next block */
-	}
-
-      if (*p == '#') 
-	{
-	  if      (esl_memstrpfx(p, n, "#=GF")) { if ((status = stockholm_parse_gf     (afp, pd, msa, p, n)) != eslOK) goto ERROR; }
-	  else if (esl_memstrpfx(p, n, "#=GS")) { if ((status = stockholm_parse_gs     (afp, pd, msa, p, n)) != eslOK) goto ERROR; }
-	  else if (esl_memstrpfx(p, n, "#=GC")) { if ((status = stockholm_parse_gc     (afp, pd, msa, p, n)) != eslOK) goto ERROR; }
-	  else if (esl_memstrpfx(p, n, "#=GR")) { if ((status = stockholm_parse_gr     (afp, pd, msa, p, n)) != eslOK) goto ERROR; }
-	  else if (esl_memstrcmp(p, n, "# STOCKHOLM 1.0")) ESL_XFAIL(eslEFORMAT, afp->errmsg, "two # STOCKHOLM 1.0 headers in a row?");
-	  else                                  { if ((status = stockholm_parse_comment(         msa, p, n)) != eslOK) goto ERROR; }
-	}
-      else if (                                       (status = stockholm_parse_sq     (afp, pd, msa, p, n)) != eslOK) goto ERROR;
-    }
-  if      (status == eslEOF) ESL_XFAIL(eslEFORMAT, afp->errmsg, "missing // terminator after MSA");
-  else if (status != eslOK)  goto ERROR;
-  if (pd->nblock == 0)       ESL_XFAIL(eslEFORMAT, afp->errmsg, "no alignment data followed Stockholm header");
-
-  msa->alen = pd->alen;
-
-  /* Stockholm file can set weights. If eslMSA_HASWGTS flag is up, at least one was set: then all must be. */
-  if (msa->flags & eslMSA_HASWGTS)
-    {
-      for (idx = 0; idx < msa->nseq; idx++)
-	if (msa->wgt[idx] == -1.0) ESL_XFAIL(eslEFORMAT, afp->errmsg, "stockholm record ended without a weight for %s", msa->sqname[idx]);
-    }
-  else if (( status = esl_msa_SetDefaultWeights(msa)) != eslOK) goto ERROR;
+  if ((status = stockholm_parse_header(afp))                     != eslOK) goto ERROR; /* includes normal EOF */
+  if ((status = stockholm_parse_blocks(afp, pd, msa, 0, &is_eor)) != eslOK) goto ERROR;
+  if ((status = stockholm_parse_finish(afp, pd, msa))             != eslOK) goto ERROR;
 
   stockholm_parsedata_Destroy(pd, msa);
   *ret_msa  = msa;
@@ -337,6 +322,71 @@ esl_msafile_stockholm_Read(ESLX_MSAFILE *afp, ESL_MSA **ret_msa)
 }
 
 
+/* Function:  esl_msafile_stockholm_ReadParallel()
+ * Synopsis:  Read a Stockholm alignment, parsing blocks in parallel.
+ *
+ * Purpose:   Same as <esl_msafile_stockholm_Read()>, but for a
+ *            multiblock (interleaved) Stockholm alignment that is
+ *            entirely in memory (a slurped or mmap()'ed file, or a
+ *            string), parse the alignment blocks after the first
+ *            one on <ncpu> worker threads.
+ *
+ *            The header and the first block are parsed serially; this
+ *            learns the sequence names and the order of lines in a
+ *            block. The rest of the record, up to its <//>, is cut
+ *            at block boundaries into <ncpu> chunks, and each worker
+ *            parses its chunk into column slabs, one per block line,
+ *            using the line order learned from the first block
+ *            instead of a name lookup on each line. The slabs are
+ *            then appended to each sequence and annotation line in
+ *            chunk order.
+ *
+ *            Only #=GC, #=GR, and sequence lines are handled in the
+ *            parallel phase, and they must appear exactly in the
+ *            order of the first block. A record that doesn't follow
+ *            this pattern (#=GF or #=GS lines or comments after the
+ *            first block, for example), or that has a format error
+ *            after the first block, is rewound and reparsed by
+ *            <esl_msafile_stockholm_Read()>. The result, including
+ *            the <eslEFORMAT> diagnostics in <afp>, is always
+ *            identical to that of <esl_msafile_stockholm_Read()>.
+ *
+ *            If <ncpu> is <= 1, if the input is a stream, or if Easel
+ *            was compiled without POSIX threads, this simply calls
+ *            <esl_msafile_stockholm_Read()>.
+ *
+ * Args:      afp     - open <ESLX_MSAFILE> to read from
+ *            ncpu    - number of worker threads to use
+ *            ret_msa - RETURN: newly parsed, created <ESL_MSA>
+ *
+ * Returns:   (same as <esl_msafile_stockholm_Read()>.)
+ *
+ * Throws:    (same as <esl_msafile_stockholm_Read()>), and also
+ *            <eslESYS> if thread creation or synchronization fails.
+ */
+int
+esl_msafile_stockholm_ReadParallel(ESLX_MSAFILE *afp, int ncpu, ESL_MSA **ret_msa)
+{
+#ifdef HAVE_PTHREAD
+  ESL_BUFFER *bf         = afp->bf;
+  esl_pos_t   start      = esl_buffer_GetOffset(afp->bf);
+  int64_t     linenumber = afp->linenumber;
+  int         status;
+
+  if (ncpu > 1 && (bf->mode_is == eslBUFFER_ALLFILE || bf->mode_is == eslBUFFER_MMAP || bf->mode_is == eslBUFFER_STRING))
+    {
+      status = stockholm_read_parallel(afp, ncpu, ret_msa);
+      if (status != eslEFORMAT) return status;
+
+      /* rewind, and reparse serially for diagnostics */
+      esl_buffer_SetOffset(afp->bf, start);
+      afp->linenumber = linenumber;
+    }
+#endif
+  return esl_msafile_stockholm_Read(afp, ret_msa);
+}
+
+
 /* Function:  esl_msafile_stockholm_Write()
  * Synopsis:  Write a Stockholm format alignment to a stream.
  *
@@ -352,6 +402,8 @@ esl_msafile_stockholm_Read(ESLX_MSAFILE *afp, ESL_MSA **ret_msa)
  *            fmt - eslMSAFILE_STOCKHOLM | eslMSAFILE_PFAM
  *
  * Returns:   <eslOK> on success.
+ *            <eslENOTFOUND> or <eslECORRUPT> if deferred annotation
+ *            (<msa->lazy>) can't be read; see <esl_msa_MaterializeAnnotation()>.
  *
  * Throws:    <eslEMEM> on allocation error.
  *            <eslEWRITE> on any system write error, such as filled disk.
@@ -359,6 +411,10 @@ esl_msafile_stockholm_Read(ESLX_MSAFILE *afp, ESL_MSA **ret_msa)
 int
 esl_msafile_stockholm_Write(FILE *fp, const ESL_MSA *msa, int fmt)
 {
+  int status;
+
+  if (msa->lazy && (status = esl_msa_MaterializeAnnotation((ESL_MSA *) msa, NULL)) != eslOK) return status; /* deferred annotation is part of <msa> */
+
   switch (fmt) {
   case eslMSAFILE_PFAM:       return stockholm_write(fp, msa, msa->alen);
   case eslMSAFILE_STOCKHOLM:  return stockholm_write(fp, msa, 200);
@@ -393,6 +449,8 @@ stockholm_parsedata_Create(ESL_MSA *msa)
   pd->in_block      = FALSE;
   pd->blinetype     = NULL;
   pd->bidx          = NULL;
+  pd->btagidx       = NULL;
+  pd->blazy         = NULL;
   pd->npb           = 0;
   pd->bi            = 0;
   pd->si            = 0;
@@ -417,6 +475,8 @@ stockholm_parsedata_Create(ESL_MSA *msa)
 
   ESL_ALLOC(pd->blinetype, sizeof(char) * 16);
   ESL_ALLOC(pd->bidx,      sizeof(int)  * 16);
+  ESL_ALLOC(pd->btagidx,   sizeof(int)  * 16);
+  ESL_ALLOC(pd->blazy,     sizeof(int)  * 16);
   pd->balloc = 16;
 
   ESL_ALLOC(pd->sqlen,     sizeof(int64_t) * msa->sqalloc);
@@ -480,6 +540,8 @@ stockholm_parsedata_ExpandBlock(ESL_STOCKHOLM_PARSEDATA *pd)
 
   ESL_REALLOC(pd->blinetype, sizeof(char) * (pd->balloc * 2));
   ESL_REALLOC(pd->bidx,      sizeof(int)  * (pd->balloc * 2));
+  ESL_REALLOC(pd->btagidx,   sizeof(int)  * (pd->balloc * 2));
+  ESL_REALLOC(pd->blazy,     sizeof(int)  * (pd->balloc * 2));
   pd->balloc *= 2;
   return eslOK;
 
@@ -496,6 +558,8 @@ stockholm_parsedata_Destroy(ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa)
 
   if (pd->blinetype) free(pd->blinetype);
   if (pd->bidx)      free(pd->bidx);
+  if (pd->btagidx)   free(pd->btagidx);
+  if (pd->blazy)     free(pd->blazy);
 
   if (pd->sqlen)     free(pd->sqlen);
   if (pd->sslen)     free(pd->sslen);
@@ -519,6 +583,112 @@ stockholm_parsedata_Destroy(ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa)
  * 3. Internal: parsing Stockholm line types
  *****************************************************************/ 
 
+/* stockholm_parse_header()
+ * Skip leading blank lines and comments, and check for the
+ * Stockholm header. Returns <eslEOF> if there's no (more) data
+ * in <afp>: a normal EOF. Returns <eslEFORMAT> if the header
+ * is missing.
+ */
+static int
+stockholm_parse_header(ESLX_MSAFILE *afp)
+{
+  char      *p;
+  esl_pos_t  n;
+  int        status;
+
+  /* Skip leading blank lines in file. EOF here is a normal EOF return. */
+  do { 
+    if ( ( status = eslx_msafile_GetLine(afp, &p, &n)) != eslOK) return status;  /* eslEOF is OK here - end of input (eslEOF) [eslEMEM|eslESYS] */
+  } while (esl_memspn(afp->line, afp->n, " \t") == afp->n ||                  /* skip blank lines             */
+	   (esl_memstrpfx(afp->line, afp->n, "#")                             /* and skip comment lines       */
+	    && ! esl_memstrpfx(afp->line, afp->n, "# STOCKHOLM")));           /* but stop on Stockholm header */
+
+  /* Check for the magic Stockholm header */
+  if (! esl_memstrpfx(afp->line, afp->n, "# STOCKHOLM 1."))  ESL_FAIL(eslEFORMAT, afp->errmsg, "missing Stockholm header");
+  return eslOK;
+}
+
+/* stockholm_parse_blocks()
+ * Parse lines of a Stockholm record, after the header, until the
+ * <//> end-of-record line; or, if <maxblock> is > 0, stop early, at
+ * the end of the first <maxblock> alignment blocks. <*ret_eor> is
+ * TRUE if we read the <//>, FALSE if we stopped early. 
+ */
+static int
+stockholm_parse_blocks(ESLX_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa, int maxblock, int *ret_eor)
+{
+  char      *p;
+  esl_pos_t  n;
+  int        status;
+
+  *ret_eor = FALSE;
+  while ( (status = eslx_msafile_GetLine(afp, &p, &n)) == eslOK) /* (eslEOF) [eslEMEM|eslESYS] */
+    {
+      while (n && ( *p == ' ' || *p == '\t')) { p++; n--; } /* skip leading whitespace */
+
+      if (!n || esl_memstrpfx(p, n, "//"))
+	{ /* blank lines and the Stockholm end-of-record // trigger end-of-block logic */
+	  if (pd->in_block) {
+	    if (pd->nblock) { if (pd->nseq_b != pd->nseq) ESL_FAIL(eslEFORMAT, afp->errmsg, "number of seqs in block did not match number in earlier block(s)");     }
+	    else            { if (pd->nseq_b < pd->nseq)  ESL_FAIL(eslEFORMAT, afp->errmsg, "number of seqs in block did not match number annotated by #=GS lines"); };
+	    if (pd->nblock) { if (pd->bi != pd->npb)      ESL_FAIL(eslEFORMAT, afp->errmsg, "unexpected number of lines in alignment block"); }
+	    if (msa->lazy && (status = esl_msa_lazy_EndBlock(msa->lazy, pd->alen_b)) != eslOK) return status;
+
+	    pd->nseq     = msa->nseq = pd->nseq_b;
+	    pd->alen    += pd->alen_b;
+	    pd->in_block = FALSE;
+	    pd->npb      = pd->bi;
+	    pd->bi       = 0;
+	    pd->si       = 0;
+	    pd->nblock  += 1;
+	    pd->nseq_b   = 0;
+	    pd->alen_b   = 0;
+	  }
+	  if   (esl_memstrpfx(p, n, "//"))   { *ret_eor = TRUE; return eslOK; } /* Stockholm end-of-record marker */
+	  if   (maxblock > 0 && pd->nblock == maxblock) return eslOK;
+	  continue;			    /* else, on to next block */
+	}
+
+      if (*p == '#') 
+	{
+	  if      (esl_memstrpfx(p, n, "#=GF")) { if ((status = stockholm_parse_gf     (afp, pd, msa, p, n)) != eslOK) return status; }
+	  else if (esl_memstrpfx(p, n, "#=GS")) { if ((status = stockholm_parse_gs     (afp, pd, msa, p, n)) != eslOK) return status; }
+	  else if (esl_memstrpfx(p, n, "#=GC")) { if ((status = stockholm_parse_gc     (afp, pd, msa, p, n)) != eslOK) return status; }
+	  else if (esl_memstrpfx(p, n, "#=GR")) { if ((status = stockholm_parse_gr     (afp, pd, msa, p, n)) != eslOK) return status; }
+	  else if (esl_memstrcmp(p, n, "# STOCKHOLM 1.0")) ESL_FAIL(eslEFORMAT, afp->errmsg, "two # STOCKHOLM 1.0 headers in a row?");
+	  else                                  { if ((status = stockholm_parse_comment(         msa, p, n)) != eslOK) return status; }
+	}
+      else if (                                       (status = stockholm_parse_sq     (afp, pd, msa, p, n)) != eslOK) return status;
+    }
+  if      (status == eslEOF) ESL_FAIL(eslEFORMAT, afp->errmsg, "missing // terminator after MSA");
+  return status;
+}
+
+/* stockholm_parse_finish()
+ * After the <//> end-of-record line: final validation of the
+ * record, and setting <msa->alen> and weights.
+ */
+static int
+stockholm_parse_finish(ESLX_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa)
+{
+  int idx;
+
+  if (pd->nblock == 0)       ESL_FAIL(eslEFORMAT, afp->errmsg, "no alignment data followed Stockholm header");
+
+  msa->alen = pd->alen;
+  if (msa->lazy && msa->lazy->nline == 0) { esl_msa_lazy_Destroy(msa->lazy); msa->lazy = NULL; }
+
+  /* Stockholm file can set weights. If eslMSA_HASWGTS flag is up, at least one was set: then all must be. */
+  if (msa->flags & eslMSA_HASWGTS)
+    {
+      for (idx = 0; idx < msa->nseq; idx++)
+	if (msa->wgt[idx] == -1.0) ESL_FAIL(eslEFORMAT, afp->errmsg, "stockholm record ended without a weight for %s", msa->sqname[idx]);
+      return eslOK;
+    }
+  return esl_msa_SetDefaultWeights(msa);
+}
+
+
 /* stockholm_parse_gf()
  * Line format is:
  *   #=GF <tag> <text>
@@ -699,47 +869,51 @@ stockholm_parse_gc(ESLX_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa,
       else if (esl_memstrcmp(tag, taglen, "MM"))       pd->blinetype[pd->bi] = eslSTOCKHOLM_LINE_GC_MM;
       else                                             pd->blinetype[pd->bi] = eslSTOCKHOLM_LINE_GC_OTHER;
       pd->bidx[pd->bi]      = -1;
+      pd->btagidx[pd->bi]   = -1;
+      pd->blazy[pd->bi]     = -1;
     }
 
   if (pd->blinetype[pd->bi] == eslSTOCKHOLM_LINE_GC_SSCONS)
     {
       if (pd->ssconslen != pd->alen) ESL_FAIL(eslEFORMAT, afp->errmsg, "more than one #=GC SS_cons line in block");
-      if ( (status = esl_strcat(&(msa->ss_cons), pd->ssconslen, p, n)) != eslOK) return status; /* [eslEMEM] */
+      if (! msa->lazy && (status = esl_strcat(&(msa->ss_cons), pd->ssconslen, p, n)) != eslOK) return status; /* [eslEMEM] */
       pd->ssconslen += n;
     }
   else if (pd->blinetype[pd->bi] == eslSTOCKHOLM_LINE_GC_SACONS)
     {
       if (pd->saconslen != pd->alen) ESL_FAIL(eslEFORMAT, afp->errmsg, "more than one #=GC SA_cons line in block");
-      if ((status = esl_strcat(&(msa->sa_cons), pd->saconslen, p, n)) != eslOK) return status; /* [eslEMEM] */
+      if (! msa->lazy && (status = esl_strcat(&(msa->sa_cons), pd->saconslen, p, n)) != eslOK) return status; /* [eslEMEM] */
       pd->saconslen += n;
     }
   else if (pd->blinetype[pd->bi] == eslSTOCKHOLM_LINE_GC_PPCONS)
     {
       if (pd->ppconslen != pd->alen) ESL_FAIL(eslEFORMAT, afp->errmsg, "more than one #=GC PP_cons line in block");
-      if ((status = esl_strcat(&(msa->pp_cons), pd->ppconslen, p, n)) != eslOK) return status; /* [eslEMEM] */
+      if (! msa->lazy && (status = esl_strcat(&(msa->pp_cons), pd->ppconslen, p, n)) != eslOK) return status; /* [eslEMEM] */
       pd->ppconslen += n;
     }
   else if (pd->blinetype[pd->bi] == eslSTOCKHOLM_LINE_GC_RF)
     {
       if (pd->rflen != pd->alen) ESL_FAIL(eslEFORMAT, afp->errmsg, "more than one #=GC RF line in block");
-      if ((status = esl_strcat(&(msa->rf), pd->rflen, p, n)) != eslOK) return status; /* [eslEMEM] */
+      if (! msa->lazy && (status = esl_strcat(&(msa->rf), pd->rflen, p, n)) != eslOK) return status; /* [eslEMEM] */
       pd->rflen += n;
     }
   else if (pd->blinetype[pd->bi] == eslSTOCKHOLM_LINE_GC_MM)
     {
       if (pd->mmasklen != pd->alen) ESL_FAIL(eslEFORMAT, afp->errmsg, "more than one #=GC MM line in block");
-      if ((status = esl_strcat(&(msa->mm), pd->mmasklen, p, n)) != eslOK) return status; /* [eslEMEM] */
+      if (! msa->lazy && (status = esl_strcat(&(msa->mm), pd->mmasklen, p, n)) != eslOK) return status; /* [eslEMEM] */
       pd->mmasklen += n;
     }
   else
     {
       if ((status = stockholm_get_gc_tagidx(msa, pd, tag, taglen, &tagidx)) != eslOK) return status;
-      
+      if (! pd->nblock) pd->btagidx[pd->bi] = tagidx;
       if (pd->ogc_len[tagidx] != pd->alen) ESL_FAIL(eslEFORMAT, afp->errmsg, "more than one #=GC %.*s line in block", (int) taglen, tag);
-      if ((status = esl_strcat(&(msa->gc[tagidx]), pd->ogc_len[tagidx], p, n)) != eslOK) return status; /* [eslEMEM] */
+      if (! msa->lazy && (status = esl_strcat(&(msa->gc[tagidx]), pd->ogc_len[tagidx], p, n)) != eslOK) return status; /* [eslEMEM] */
       pd->ogc_len[tagidx] += n;
     }
 
+  if (msa->lazy && (status = stockholm_defer_line(afp, pd, msa, tag, taglen, -1, p)) != eslOK) return status;
+
   if (pd->bi && n != pd->alen_b) ESL_FAIL(eslEFORMAT, afp->errmsg, "unexpected # of aligned annotation in #=GC %.*s line", (int) taglen, tag); 
   pd->alen_b   = n;
   pd->in_block = TRUE;
@@ -785,6 +959,8 @@ stockholm_parse_gr(ESLX_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa,
       else if (esl_memstrcmp(tag, taglen, "PP")) pd->blinetype[pd->bi] = eslSTOCKHOLM_LINE_GR_PP;
       else                                       pd->blinetype[pd->bi] = eslSTOCKHOLM_LINE_GR_OTHER;
       pd->bidx[pd->bi]      = seqidx;
+      pd->btagidx[pd->bi]   = -1;
+      pd->blazy[pd->bi]     = -1;
     }
   else 
     {				/* subsequent block(s) */
@@ -808,7 +984,7 @@ stockholm_parse_gr(ESLX_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa,
 	for (z = 0; z < msa->sqalloc; z++) { msa->ss[z] = NULL; pd->sslen[z] = 0; }
       }
       if (pd->sslen[seqidx] != pd->alen) ESL_FAIL(eslEFORMAT, afp->errmsg, "more than one #=GR %.*s SS line in block", (int) namelen, name);
-      if (( status = esl_strcat(&(msa->ss[seqidx]), pd->sslen[seqidx], p, n)) != eslOK) return status; /* [eslEMEM] */
+      if (! msa->lazy && (status = esl_strcat(&(msa->ss[seqidx]), pd->sslen[seqidx], p, n)) != eslOK) return status; /* [eslEMEM] */
       pd->sslen[seqidx] += n;
     }
   else if (pd->blinetype[pd->bi] == eslSTOCKHOLM_LINE_GR_PP)
@@ -819,7 +995,7 @@ stockholm_parse_gr(ESLX_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa,
 	for (z = 0; z < msa->sqalloc; z++) { msa->pp[z] = NULL; pd->pplen[z] = 0; }
       }
       if (pd->pplen[seqidx] != pd->alen) ESL_FAIL(eslEFORMAT, afp->errmsg, "more than one #=GR %.*s PP line in block", (int) namelen, name);
-      if ((status = esl_strcat(&(msa->pp[seqidx]), pd->pplen[seqidx], p, n)) != eslOK) return status; /* [eslEMEM] */
+      if (! msa->lazy && (status = esl_strcat(&(msa->pp[seqidx]), pd->pplen[seqidx], p, n)) != eslOK) return status; /* [eslEMEM] */
       pd->pplen[seqidx] += n;
     }
   else if (pd->blinetype[pd->bi] == eslSTOCKHOLM_LINE_GR_SA)
@@ -830,18 +1006,21 @@ stockholm_parse_gr(ESLX_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa,
 	for (z = 0; z < msa->sqalloc; z++) { msa->sa[z] = NULL; pd->salen[z] = 0; }
       }
       if (pd->salen[seqidx] != pd->alen) ESL_FAIL(eslEFORMAT, afp->errmsg, "more than one #=GR %.*s SA line in block", (int) namelen, name);
-      if ((status = esl_strcat(&(msa->sa[seqidx]), pd->salen[seqidx], p, n)) != eslOK) return status;
+      if (! msa->lazy && (status = esl_strcat(&(msa->sa[seqidx]), pd->salen[seqidx], p, n)) != eslOK) return status;
       pd->salen[seqidx] += n;
     }
   else
     {
       if ((status = stockholm_get_gr_tagidx(msa, pd, tag, taglen, &tagidx)) != eslOK) return status; /* [eslEMEM] */
+      if (! pd->nblock) pd->btagidx[pd->bi] = tagidx;
 
       if (pd->ogr_len[tagidx][seqidx] != pd->alen) ESL_FAIL(eslEFORMAT, afp->errmsg, "more than one #=GR %.*s %.*s line in block", (int) namelen, name, (int) taglen, tag);
-      if ((status = esl_strcat(&(msa->gr[tagidx][seqidx]), pd->ogr_len[tagidx][seqidx], p, n)) != eslOK) return status;
+      if (! msa->lazy && (status = esl_strcat(&(msa->gr[tagidx][seqidx]), pd->ogr_len[tagidx][seqidx], p, n)) != eslOK) return status;
       pd->ogr_len[tagidx][seqidx] += n;
     }
 
+  if (msa->lazy && (status = stockholm_defer_line(afp, pd, msa, tag, taglen, seqidx, p)) != eslOK) return status;
+
   if (pd->bi && n != pd->alen_b) ESL_FAIL(eslEFORMAT, afp->errmsg, "unexpected # of aligned annotation in #=GR %.*s %.*s line", (int) namelen, name, (int) taglen, tag); 
   pd->alen_b   = n;
   pd->in_block = TRUE;
@@ -887,6 +1066,8 @@ stockholm_parse_sq(ESLX_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa,
 
       pd->blinetype[pd->bi] = eslSTOCKHOLM_LINE_SQ;
       pd->bidx[pd->bi]      = seqidx;
+      pd->btagidx[pd->bi]   = -1;
+      pd->blazy[pd->bi]     = -1;
     }
   else 
     {				/* subsequent block(s) */
@@ -932,6 +1113,37 @@ stockholm_parse_comment(ESL_MSA *msa, char *p, esl_pos_t n)
 
   return esl_msa_AddComment(msa, p, n);
 }
+
+/* stockholm_defer_line()
+ * In lazy mode, instead of storing the aligned text <p> of the
+ * current #=GC line (<seqidx> -1) or #=GR line, record its offset
+ * in the input in <msa->lazy>. In the first block, each such line is
+ * a new deferred line; after that, the deferred line on the same line
+ * <bi> of the first block is the expected one, but unparsed tags may
+ * come in a different order (the serial parser allows that).
+ */
+static int
+stockholm_defer_line(ESLX_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa, char *tag, esl_pos_t taglen, int seqidx, char *p)
+{
+  ESL_MSA_LAZY *lz = msa->lazy;
+  int           a;
+  int           status;
+
+  if (! pd->nblock)
+    {
+      if ((status = esl_msa_lazy_AddLine(lz, tag, taglen, seqidx)) != eslOK) return status;
+      a = pd->blazy[pd->bi] = lz->nline-1;
+    }
+  else
+    {
+      a = pd->blazy[pd->bi];
+      if (a == -1 || lz->seqidx[a] != seqidx || ! esl_memstrcmp(tag, taglen, lz->tag[a]))
+	for (a = 0; a < lz->nline; a++)
+	  if (lz->seqidx[a] == seqidx && esl_memstrcmp(tag, taglen, lz->tag[a])) break;
+      if (a == lz->nline) ESL_EXCEPTION(eslEINCONCEIVABLE, "deferred annotation line not seen in first block");
+    }
+  return esl_msa_lazy_SetOffset(lz, a, afp->lineoffset + (p - afp->line));
+}
 /*------------- end, parsing Stockholm line types ---------------*/  
 
 
@@ -1084,7 +1296,399 @@ stockholm_get_gc_tagidx(ESL_MSA *msa, ESL_STOCKHOLM_PARSEDATA *pd, char *tag, es
 
 
 /*****************************************************************
- * 5. Internal: writing Stockholm/Pfam format
+ * 5. Internal: parallel parsing of alignment blocks
+ *****************************************************************/
+#ifdef HAVE_PTHREAD
+
+/* stockholm_read_parallel()
+ *
+ * Parse the header and the first block serially, with the usual line
+ * parsers, which records the order of lines in a block in <pd>. Then
+ * find the end of the record (the // line) and cut the rest of the
+ * record at block boundaries (after blank lines) into <ncpu>
+ * chunks. Workers parse each chunk into a slab per block line; then
+ * each slab is appended to the sequence or annotation line it
+ * belongs to, in chunk order.
+ *
+ * Returns <eslEFORMAT> on any parse error; caller rewinds and
+ * reparses serially, to get the diagnostics right.
+ */
+static int
+stockholm_read_parallel(ESLX_MSAFILE *afp, int ncpu, ESL_MSA **ret_msa)
+{
+  ESL_BUFFER              *bf       = afp->bf;
+  ESL_MSA                 *msa      = NULL;
+  ESL_STOCKHOLM_PARSEDATA *pd       = NULL;
+  ESL_THREADS             *thr      = NULL;
+  STOCKHOLM_SLAB          *sl       = NULL;
+  esl_pos_t               *chunkoff = NULL;
+  int                      nchunks  = 0;
+  int64_t                  nlines   = 0;
+  esl_pos_t                eor      = -1;   /* offset of the // line in <bf->mem>    */
+  esl_pos_t                eorn     = 0;    /* length of the // line, w/o terminator */
+  esl_pos_t                pos, next, chunksize;
+  esl_pos_t                n, i;
+  int64_t                  alen, apos;
+  int                      nterm;
+  int                      is_eor;
+  int                      c, bi, k;
+  char                   **dp;
+  ESL_DSQ                **ddp;
+  int                      status;
+
+  ESL_DASSERT1( (afp->format == eslMSAFILE_PFAM || afp->format == eslMSAFILE_STOCKHOLM) );
+  afp->errmsg[0] = '\0';
+
+#ifdef eslAUGMENT_ALPHABET
+  if (afp->abc   &&  (msa = esl_msa_CreateDigital(afp->abc, 16, -1)) == NULL) { status = eslEMEM; goto ERROR; }
+#endif
+  if (! afp->abc &&  (msa = esl_msa_Create(                 16, -1)) == NULL) { status = eslEMEM; goto ERROR; }
+  if ( (pd = stockholm_parsedata_Create(msa))                        == NULL) { status = eslEMEM; goto ERROR; }
+  if (afp->do_lazy && (msa->lazy = esl_msa_lazy_Create(afp->bf->filename)) == NULL) { status = eslEMEM; goto ERROR; }
+
+  /* The header and first block, serially. */
+  if ((status = stockholm_parse_header(afp))                     != eslOK) goto ERROR; /* includes normal EOF */
+  if ((status = stockholm_parse_blocks(afp, pd, msa, 1, &is_eor)) != eslOK) goto ERROR;
+
+  if (! is_eor)
+    {
+      /* Find the // that ends the record, counting lines. */
+      for (pos = bf->pos; pos < bf->n; pos += n + nterm)
+	{
+	  esl_memnewline(bf->mem + pos, bf->n - pos, &n, &nterm);
+	  nlines++;
+	  for (i = 0; i < n && (bf->mem[pos+i] == ' ' || bf->mem[pos+i] == '\t'); i++) ;
+	  if (esl_memstrpfx(bf->mem + pos + i, n - i, "//")) { eor = pos; eorn = n; break; }
+	}
+      if (eor == -1) { status = eslEFORMAT; goto ERROR; } /* missing //; let the serial parser say so */
+
+      /* Cut bf->mem[bf->pos..eor-1] into chunks, each cut just after a blank line. */
+      ESL_ALLOC(chunkoff, sizeof(esl_pos_t) * (ncpu+1));
+      chunksize   = (eor - bf->pos) / ncpu;
+      chunkoff[0] = bf->pos;
+      for (c = 1; c < ncpu; c++)
+	{
+	  pos = ESL_MAX(chunkoff[nchunks], bf->pos + c * chunksize);
+	  while (pos > chunkoff[nchunks] && bf->mem[pos-1] != '\n') pos--;  /* back up to start of line */
+	  for ( ; pos < eor; pos = next)
+	    {
+	      esl_memnewline(bf->mem + pos, eor - pos, &n, &nterm);
+	      next = pos + n + nterm;
+	      if (esl_memspn(bf->mem + pos, n, " \t") == n) { pos = next; break; }
+	    }
+	  if (pos >= eor) break;
+	  chunkoff[++nchunks] = pos;
+	}
+      chunkoff[++nchunks] = eor;
+
+      /* Parse chunks into slabs. */
+      ESL_ALLOC(sl, sizeof(STOCKHOLM_SLAB) * nchunks);
+      for (c = 0; c < nchunks; c++)
+	{
+	  sl[c].afp       = afp;
+	  sl[c].pd        = pd;
+	  sl[c].msa       = msa;
+	  sl[c].p         = bf->mem + chunkoff[c];
+	  sl[c].n         = chunkoff[c+1] - chunkoff[c];
+	  sl[c].slab      = NULL;
+	  sl[c].dslab     = NULL;
+	  sl[c].alen      = 0;
+	  sl[c].nb        = 0;
+	  sl[c].nballoc   = 0;
+	  sl[c].loff      = NULL;
+	  sl[c].bwidth    = NULL;
+	  sl[c].status    = eslOK;
+	  sl[c].errmsg[0] = '\0';
+	}
+
+      if ((thr = esl_threads_Create(&stockholm_slab_thread)) == NULL) { status = eslEMEM; goto ERROR; }
+      for (c = 0; c < nchunks; c++)
+	if ((status = esl_threads_AddThread(thr, (void *) &(sl[c]))) != eslOK) break;
+      esl_threads_WaitForStart (thr);
+      esl_threads_WaitForFinish(thr);
+      if (c < nchunks) goto ERROR;
+
+      alen = pd->alen;
+      for (c = 0; c < nchunks; c++)
+	{
+	  if (sl[c].status != eslOK) { status = sl[c].status; goto ERROR; }
+	  alen += sl[c].alen;
+	}
+
+      /* Append the slabs to each line of the first block, in chunk order. */
+      for (bi = 0; bi < pd->npb; bi++)
+	{
+	  if (pd->blazy[bi] >= 0) continue; /* deferred annotation: no slab */
+	  dp  = NULL;
+	  ddp = NULL;
+	  switch (pd->blinetype[bi]) {
+	  case eslSTOCKHOLM_LINE_SQ:
+#ifdef eslAUGMENT_ALPHABET
+	    if (msa->abc)   ddp = &(msa->ax[pd->bidx[bi]]);
+#endif
+	    if (! msa->abc) dp  = &(msa->aseq[pd->bidx[bi]]);
+	    break;
+	  case eslSTOCKHOLM_LINE_GC_SSCONS: dp = &(msa->ss_cons);                           break;
+	  case eslSTOCKHOLM_LINE_GC_SACONS: dp = &(msa->sa_cons);                           break;
+	  case eslSTOCKHOLM_LINE_GC_PPCONS: dp = &(msa->pp_cons);                           break;
+	  case eslSTOCKHOLM_LINE_GC_RF:     dp = &(msa->rf);                                break;
+	  case eslSTOCKHOLM_LINE_GC_MM:     dp = &(msa->mm);                                break;
+	  case eslSTOCKHOLM_LINE_GC_OTHER:  dp = &(msa->gc[pd->btagidx[bi]]);               break;
+	  case eslSTOCKHOLM_LINE_GR_SS:     dp = &(msa->ss[pd->bidx[bi]]);                  break;
+	  case eslSTOCKHOLM_LINE_GR_SA:     dp = &(msa->sa[pd->bidx[bi]]);                  break;
+	  case eslSTOCKHOLM_LINE_GR_PP:     dp = &(msa->pp[pd->bidx[bi]]);                  break;
+	  case eslSTOCKHOLM_LINE_GR_OTHER:  dp = &(msa->gr[pd->btagidx[bi]][pd->bidx[bi]]); break;
+	  default: ESL_XEXCEPTION(eslEINCONCEIVABLE, "no such Stockholm block line type");
+	  }
+
+	  if (ddp)
+	    {
+	      ESL_REALLOC(*ddp, sizeof(ESL_DSQ) * (alen+2));
+	      for (apos = pd->alen+1, c = 0; c < nchunks; apos += sl[c].alen, c++)
+		if (sl[c].alen) memcpy(*ddp + apos, sl[c].dslab[bi]+1, sizeof(ESL_DSQ) * sl[c].alen);
+	      (*ddp)[alen+1] = eslDSQ_SENTINEL;
+	    }
+	  else
+	    {
+	      ESL_REALLOC(*dp, sizeof(char) * (alen+1));
+	      for (apos = pd->alen, c = 0; c < nchunks; apos += sl[c].alen, c++)
+		if (sl[c].alen) memcpy(*dp + apos, sl[c].slab[bi], sizeof(char) * sl[c].alen);
+	      (*dp)[alen] = '\0';
+	    }
+	}
+      pd->alen = alen;
+
+      /* In lazy mode, append the chunks' offsets of deferred lines, block by block. */
+      if (msa->lazy)
+	for (c = 0; c < nchunks; c++)
+	  for (k = 0; k < sl[c].nb; k++)
+	    {
+	      for (bi = 0; bi < pd->npb; bi++)
+		if (pd->blazy[bi] >= 0 && (status = esl_msa_lazy_SetOffset(msa->lazy, pd->blazy[bi], sl[c].loff[k*pd->npb + bi])) != eslOK) goto ERROR;
+	      if ((status = esl_msa_lazy_EndBlock(msa->lazy, sl[c].bwidth[k])) != eslOK) goto ERROR;
+	    }
+
+      /* Leave <afp> on the // line, as the serial parser would. */
+      esl_memnewline(bf->mem + eor, bf->n - eor, &n, &nterm);
+      afp->lineoffset = bf->baseoffset + eor;
+      afp->line       = bf->mem + eor;
+      afp->n          = eorn;
+      if (afp->linenumber != -1) afp->linenumber += nlines;
+      esl_buffer_SetOffset(bf, bf->baseoffset + eor + n + nterm);
+    }
+
+  if ((status = stockholm_parse_finish(afp, pd, msa)) != eslOK) goto ERROR;
+
+  if (sl) {
+    for (c = 0; c < nchunks; c++) {
+      esl_Free2D((void **) sl[c].slab,  pd->npb);
+      esl_Free2D((void **) sl[c].dslab, pd->npb);
+      if (sl[c].loff)   free(sl[c].loff);
+      if (sl[c].bwidth) free(sl[c].bwidth);
+    }
+    free(sl);
+  }
+  if (thr)      esl_threads_Destroy(thr);
+  if (chunkoff) free(chunkoff);
+  stockholm_parsedata_Destroy(pd, msa);
+  *ret_msa = msa;
+  return eslOK;
+
+ ERROR:
+  if (sl) {
+    for (c = 0; c < nchunks; c++) {
+      esl_Free2D((void **) sl[c].slab,  pd->npb);
+      esl_Free2D((void **) sl[c].dslab, pd->npb);
+      if (sl[c].loff)   free(sl[c].loff);
+      if (sl[c].bwidth) free(sl[c].bwidth);
+    }
+    free(sl);
+  }
+  if (thr)      esl_threads_Destroy(thr);
+  if (chunkoff) free(chunkoff);
+  if (pd)       stockholm_parsedata_Destroy(pd, msa);
+  if (msa)      esl_msa_Destroy(msa);
+  *ret_msa = NULL;
+  return status;
+}
+
+static void
+stockholm_slab_thread(void *arg)
+{
+  ESL_THREADS    *thr = (ESL_THREADS *) arg;
+  STOCKHOLM_SLAB *sl;
+  int             w;
+
+  esl_threads_Started(thr, &w);
+  sl         = (STOCKHOLM_SLAB *) esl_threads_GetData(thr, w);
+  sl->status = stockholm_parse_slab(sl);
+  esl_threads_Finished(thr, w);
+  return;
+}
+
+/* stockholm_parse_slab()
+ *
+ * Parse the alignment blocks in <sl->p[0..sl->n-1]>, appending the
+ * aligned text of each block line <bi> to slab <sl->slab[bi]> (or
+ * <sl->dslab[bi]>, for sequence lines in digital mode). Each line must
+ * match the type, seq name, and tag of the same line in the first
+ * block, as recorded in <sl->pd>, so no name lookups are needed.
+ *
+ * This is stricter than the serial parser: only #=GC, #=GR, and
+ * sequence lines are allowed. Anything unexpected is an
+ * <eslEFORMAT>, and the caller falls back to the serial parser, which
+ * either accepts the record or reports the error properly.
+ *
+ * Returns <eslOK> on success, and <sl->alen> is the number of columns
+ * in each slab. Returns <eslEFORMAT> on a parse error. Throws <eslEMEM>
+ * on allocation failure. In all cases, slabs are left for the caller
+ * to free.
+ */
+static int
+stockholm_parse_slab(STOCKHOLM_SLAB *sl)
+{
+  ESL_STOCKHOLM_PARSEDATA *pd       = sl->pd;
+  ESL_MSA                 *msa      = sl->msa;
+  char                    *p        = sl->p;
+  esl_pos_t                nleft    = sl->n;
+  int                      in_block = FALSE;
+  int                      bi       = 0;
+  int64_t                  alen_b   = 0;
+  int64_t                  L;
+  char                    *line, *tok, *name, *tag;
+  esl_pos_t                n, toklen, namelen, taglen;
+  int                      nterm;
+  int                      linetype;
+  int                      z;
+  int                      status;
+
+  ESL_ALLOC(sl->slab, sizeof(char *) * pd->npb);
+  for (z = 0; z < pd->npb; z++) sl->slab[z] = NULL;
+#ifdef eslAUGMENT_ALPHABET
+  if (sl->afp->abc) {
+    ESL_ALLOC(sl->dslab, sizeof(ESL_DSQ *) * pd->npb);
+    for (z = 0; z < pd->npb; z++) sl->dslab[z] = NULL;
+  }
+#endif
+
+  while (nleft > 0)
+    {
+      esl_memnewline(p, nleft, &n, &nterm);
+      line   = p;
+      p     += n + nterm;
+      nleft -= n + nterm;
+      while (n && (*line == ' ' || *line == '\t')) { line++; n--; } /* skip leading whitespace */
+
+      if (! n)
+	{ /* blank line: end of block */
+	  if (in_block) {
+	    if (bi != pd->npb) ESL_XFAIL(eslEFORMAT, sl->errmsg, "unexpected number of lines in alignment block");
+	    if (sl->bwidth) sl->bwidth[sl->nb] = alen_b;
+	    sl->alen += alen_b;
+	    sl->nb++;
+	    in_block  = FALSE;
+	    bi        = 0;
+	  }
+	  continue;
+	}
+      if (bi >= pd->npb) ESL_XFAIL(eslEFORMAT, sl->errmsg, "more lines than expected in this alignment block");
+      if (bi == 0 && msa->lazy && sl->nb == sl->nballoc)
+	{ /* lazy mode: room for offsets in one more block */
+	  sl->nballoc = (sl->nballoc ? sl->nballoc * 2 : 16);
+	  ESL_REALLOC(sl->loff,   sizeof(esl_pos_t) * sl->nballoc * pd->npb);
+	  ESL_REALLOC(sl->bwidth, sizeof(int64_t)   * sl->nballoc);
+	}
+
+      name    = tag    = NULL;
+      namelen = taglen = 0;
+      if (*line == '#')
+	{
+	  esl_memtok(&line, &n, " \t", &tok, &toklen);
+	  if      (esl_memstrcmp(tok, toklen, "#=GC")) linetype = eslSTOCKHOLM_LINE_GC_OTHER;
+	  else if (esl_memstrcmp(tok, toklen, "#=GR")) linetype = eslSTOCKHOLM_LINE_GR_OTHER;
+	  else ESL_XFAIL(eslEFORMAT, sl->errmsg, "only #=GC, #=GR, and seq lines are expected after the first block");
+
+	  if (linetype == eslSTOCKHOLM_LINE_GR_OTHER && esl_memtok(&line, &n, " \t", &name, &namelen) != eslOK) ESL_XFAIL(eslEFORMAT, sl->errmsg, "#=GR line missing <seqname>");
+	  if (esl_memtok(&line, &n, " \t", &tag, &taglen) != eslOK)                                               ESL_XFAIL(eslEFORMAT, sl->errmsg, "#=GC or #=GR line missing <tag>");
+
+	  if (linetype == eslSTOCKHOLM_LINE_GC_OTHER) {
+	    if      (esl_memstrcmp(tag, taglen, "SS_cons")) linetype = eslSTOCKHOLM_LINE_GC_SSCONS;
+	    else if (esl_memstrcmp(tag, taglen, "SA_cons")) linetype = eslSTOCKHOLM_LINE_GC_SACONS;
+	    else if (esl_memstrcmp(tag, taglen, "PP_cons")) linetype = eslSTOCKHOLM_LINE_GC_PPCONS;
+	    else if (esl_memstrcmp(tag, taglen, "RF"))      linetype = eslSTOCKHOLM_LINE_GC_RF;
+	    else if (esl_memstrcmp(tag, taglen, "MM"))      linetype = eslSTOCKHOLM_LINE_GC_MM;
+	  } else {
+	    if      (esl_memstrcmp(tag, taglen, "SS"))      linetype = eslSTOCKHOLM_LINE_GR_SS;
+	    else if (esl_memstrcmp(tag, taglen, "SA"))      linetype = eslSTOCKHOLM_LINE_GR_SA;
+	    else if (esl_memstrcmp(tag, taglen, "PP"))      linetype = eslSTOCKHOLM_LINE_GR_PP;
+	  }
+	}
+      else
+	{
+	  esl_memtok(&line, &n, " \t", &name, &namelen);
+	  linetype = eslSTOCKHOLM_LINE_SQ;
+	}
+      while (n && strchr(" \t", line[n-1])) n--; /* skip backwards from eol, to delimit aligned text */
+
+      /* The line must match the same line of the first block. */
+      if (! n)                                                                 ESL_XFAIL(eslEFORMAT, sl->errmsg, "line with no aligned text");
+      if (linetype != pd->blinetype[bi])                                       ESL_XFAIL(eslEFORMAT, sl->errmsg, "unexpected line type; first block in different order?");
+      if (name && ! esl_memstrcmp(name, namelen, msa->sqname[pd->bidx[bi]]))   ESL_XFAIL(eslEFORMAT, sl->errmsg, "unexpected seq name; first block in different order?");
+      if (linetype == eslSTOCKHOLM_LINE_GC_OTHER && ! esl_memstrcmp(tag, taglen, msa->gc_tag[pd->btagidx[bi]])) ESL_XFAIL(eslEFORMAT, sl->errmsg, "unexpected #=GC tag; first block in different order?");
+      if (linetype == eslSTOCKHOLM_LINE_GR_OTHER && ! esl_memstrcmp(tag, taglen, msa->gr_tag[pd->btagidx[bi]])) ESL_XFAIL(eslEFORMAT, sl->errmsg, "unexpected #=GR tag; first block in different order?");
+      if (bi && n != alen_b)                                                   ESL_XFAIL(eslEFORMAT, sl->errmsg, "unexpected number of aligned columns on line");
+
+      L = sl->alen;
+#ifdef eslAUGMENT_ALPHABET
+      if (linetype == eslSTOCKHOLM_LINE_SQ && sl->afp->abc)
+	{
+	  status = esl_abc_dsqcat(sl->afp->inmap, &(sl->dslab[bi]), &L, line, n);
+	  if      (status == eslEINVAL) ESL_XFAIL(eslEFORMAT, sl->errmsg, "invalid sequence character(s) on line");
+	  else if (status != eslOK)     goto ERROR;
+	}
+#endif
+      if (linetype == eslSTOCKHOLM_LINE_SQ && ! sl->afp->abc)
+	{
+	  status = esl_strmapcat(sl->afp->inmap, &(sl->slab[bi]), &L, line, n);
+	  if      (status == eslEINVAL) ESL_XFAIL(eslEFORMAT, sl->errmsg, "invalid sequence character(s) on line");
+	  else if (status != eslOK)     goto ERROR;
+	}
+      if (linetype != eslSTOCKHOLM_LINE_SQ && pd->blazy[bi] >= 0)
+	{
+	  sl->loff[sl->nb * pd->npb + bi] = sl->afp->bf->baseoffset + (line - sl->afp->bf->mem);
+	  L += n;
+	}
+      else if (linetype != eslSTOCKHOLM_LINE_SQ)
+	{
+	  if ((status = esl_strcat(&(sl->slab[bi]), sl->alen, line, n)) != eslOK) goto ERROR;
+	  L += n;
+	}
+      if (L - sl->alen != n) ESL_XFAIL(eslEFORMAT, sl->errmsg, "symbols ignored by inmap; GR, GC annotation would misalign");
+
+      alen_b   = n;
+      in_block = TRUE;
+      bi++;
+    }
+
+  if (in_block)
+    { /* the last block in the record ends at the // line, maybe without a blank line */
+      if (bi != pd->npb) ESL_XFAIL(eslEFORMAT, sl->errmsg, "unexpected number of lines in alignment block");
+      if (sl->bwidth) sl->bwidth[sl->nb] = alen_b;
+      sl->alen += alen_b;
+      sl->nb++;
+    }
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+#endif /*HAVE_PTHREAD*/
+/*------------ end, parallel parsing of alignment blocks --------*/
+
+
+
+/*****************************************************************
+ * 6. Internal: writing Stockholm/Pfam format
  *****************************************************************/
 
 /* stockholm_write()
@@ -1323,7 +1927,7 @@ stockholm_write(FILE *fp, const ESL_MSA *msa, int64_t cpl)
 
 
 /*****************************************************************
- * 6. Unit tests
+ * 7. Unit tests
  *****************************************************************/
 #ifdef eslMSAFILE_STOCKHOLM_TESTDRIVE
 
@@ -2390,6 +2994,27 @@ utest_bad_format(char *filename, int testnumber, int expected_linenumber, char *
 }
 
 
+/* Same, using the parallel parser; which must fall back to the
+ * serial parser and report exactly the same error.
+ */
+static void
+utest_bad_format_parallel(char *filename, int testnumber, int expected_linenumber, char *expected_errmsg)
+{
+  ESL_ALPHABET *abc = esl_alphabet_Create(eslAMINO);
+  ESLX_MSAFILE *afp = NULL;
+  int           fmt = eslMSAFILE_STOCKHOLM;
+  ESL_MSA      *msa = NULL;
+  int           status;
+  
+  if ( (status = eslx_msafile_Open(&abc, filename, NULL, fmt, NULL, &afp)) != eslOK)  esl_fatal("stockholm parallel bad format test %d failed: unexpected open failure", testnumber);
+  if ( (status = esl_msafile_stockholm_ReadParallel(afp, 4, &msa)) != eslEFORMAT)     esl_fatal("stockholm parallel bad format test %d failed: unexpected error code",   testnumber);
+  if (strstr(afp->errmsg, expected_errmsg) == NULL)                                   esl_fatal("stockholm parallel bad format test %d failed: unexpected errmsg",       testnumber);
+  if (afp->linenumber != expected_linenumber)                                         esl_fatal("stockholm parallel bad format test %d failed: unexpected linenumber",   testnumber);
+  eslx_msafile_Close(afp);
+  esl_alphabet_Destroy(abc);
+  esl_msa_Destroy(msa);
+}
+
 static void
 utest_good_format(ESL_ALPHABET **byp_abc, int fmt, int expected_nseq, int64_t expected_alen, char *buf)
 {
@@ -2464,13 +3089,307 @@ utest_bad_read(ESL_ALPHABET **byp_abc, int fmt, char *expected_errmsg, int expec
   esl_msa_Destroy(msa);
   eslx_msafile_Close(afp);
 }
+/* write_test_msa_big()
+ * A two-record file for testing the parallel parser. The first
+ * record has <nblock> blocks of <nseq> seqs, with #=GR and #=GC
+ * lines of both the parsed and unparsed kinds; the last block is
+ * narrower, and isn't followed by a blank line. The second record
+ * is a single block.
+ * <mode> 1: swap two seq lines in a late block (a format error);
+ * <mode> 2: put a #=GF line between two late blocks (legal, but not
+ *           handled by the parallel phase: tests the fallback).
+ */
+static void
+write_test_msa_big(FILE *ofp, int nseq, int nblock, int mode)
+{
+  char *res = "ACDEFGHIKLMNPQRSTVWY-.";
+  char *pp  = "0123456789*.";
+  char *ss  = "<>.-_";
+  int   b, i, pos, ii;
+  int   w;
+
+  fputs("# STOCKHOLM 1.0\n#=GF ID big\n\n", ofp);
+  for (i = 0; i < nseq; i += 3) fprintf(ofp, "#=GS seq%d DE description of seq%d\n", i, i);
+  fputs("\n", ofp);
+  for (b = 0; b < nblock; b++)
+    {
+      w = (b == nblock-1 ? 17 : 60);
+      for (i = 0; i < nseq; i++)
+	{
+	  ii = i;
+	  if (mode == 1 && b == nblock-2 && i == 1) ii = 2;
+	  if (mode == 1 && b == nblock-2 && i == 2) ii = 1;
+	  fprintf(ofp, "seq%-6d ", ii);
+	  for (pos = 0; pos < w; pos++) fputc(res[(ii * 7 + b * 3 + pos * 11) % 22], ofp);
+	  fputs("  \n", ofp);
+	  if (ii % 3 == 0) {
+	    fprintf(ofp, "#=GR seq%-6d PP  ", ii);
+	    for (pos = 0; pos < w; pos++) fputc(pp[(ii + b + pos) % 12], ofp);
+	    fputs("\n", ofp);
+	  }
+	  if (ii % 4 == 1) {
+	    fprintf(ofp, "#=GR seq%-6d xx  ", ii);
+	    for (pos = 0; pos < w; pos++) fputc(ss[(ii + b * 2 + pos) % 5], ofp);
+	    fputs("\n", ofp);
+	  }
+	}
+      fputs("#=GC SS_cons       ", ofp);  for (pos = 0; pos < w; pos++) fputc(ss[(b + pos) % 5], ofp);       fputs("\n", ofp);
+      fputs("#=GC RF            ", ofp);  for (pos = 0; pos < w; pos++) fputc('x', ofp);                     fputs("\n", ofp);
+      fputs("#=GC yy            ", ofp);  for (pos = 0; pos < w; pos++) fputc(pp[(b * 5 + pos) % 12], ofp); fputs("\r\n", ofp);
+      if (b < nblock-1)                       fputs((b % 2 ? "\n" : "  \n\n"), ofp);
+      if (mode == 2 && b == nblock-3)         fputs("#=GF CC a comment between blocks\n\n", ofp);
+    }
+  fputs("//\n", ofp);
+
+  fputs("# STOCKHOLM 1.0\n\nseq1 ACDEFGHIKL\nseq2 ACDEFGHIKL\n//\n", ofp);
+}
+
+static void
+utest_parallel(void)
+{
+  char          msg[]       = "stockholm parallel read unit test failed";
+  char          tmpfile[32];
+  int           ncpus[]     = { 1, 2, 3, 8, 64 };
+  int           nncpus      = sizeof(ncpus) / sizeof(int);
+  int           nseq        = 23;
+  int           nblock      = 29;
+  ESL_ALPHABET *abc         = NULL;
+  ESLX_MSAFILE *afp         = NULL;
+  ESL_MSA      *msa1        = NULL;
+  ESL_MSA      *msa2        = NULL;
+  ESL_MSA      *msa3        = NULL;
+  FILE         *ofp         = NULL;
+  int64_t       nlines1, nlines2;
+  char          errmsg[eslERRBUFSIZE];
+  int           mode, do_digital, k;
+
+  for (mode = 0; mode <= 2; mode++)
+    {
+      strcpy(tmpfile, "esltmpXXXXXX");
+      if (esl_tmpfile_named(tmpfile, &ofp) != eslOK) esl_fatal(msg);
+      write_test_msa_big(ofp, nseq, nblock, mode);
+      fclose(ofp);
+
+      for (do_digital = 0; do_digital <= 1; do_digital++)
+	{
+	  if (eslx_msafile_Open((do_digital ? &abc : NULL), tmpfile, NULL, eslMSAFILE_STOCKHOLM, NULL, &afp) != eslOK) esl_fatal(msg);
+	  if (mode == 1)
+	    {
+	      if (esl_msafile_stockholm_Read(afp, &msa1) != eslEFORMAT) esl_fatal(msg);
+	      nlines1 = afp->linenumber;
+	      strcpy(errmsg, afp->errmsg);
+	    }
+	  else
+	    {
+	      if (esl_msafile_stockholm_Read(afp, &msa1) != eslOK)      esl_fatal(msg);
+	      if (msa1->nseq != nseq || msa1->alen != (nblock-1) * 60 + 17) esl_fatal(msg);
+	      nlines1 = afp->linenumber;
+	      if (esl_msafile_stockholm_Read(afp, &msa3) != eslOK)      esl_fatal(msg);
+	      esl_msa_Destroy(msa3);
+	    }
+	  nlines2 = afp->linenumber;
+	  eslx_msafile_Close(afp);
+
+	  for (k = 0; k < nncpus; k++)
+	    {
+	      if (eslx_msafile_Open((do_digital ? &abc : NULL), tmpfile, NULL, eslMSAFILE_STOCKHOLM, NULL, &afp) != eslOK) esl_fatal(msg);
+	      if (mode == 1)
+		{
+		  if (esl_msafile_stockholm_ReadParallel(afp, ncpus[k], &msa2) != eslEFORMAT) esl_fatal(msg);
+		  if (afp->linenumber != nlines1 || strcmp(afp->errmsg, errmsg) != 0)        esl_fatal(msg);
+		}
+	      else
+		{
+		  if (esl_msafile_stockholm_ReadParallel(afp, ncpus[k], &msa2) != eslOK)  esl_fatal(msg);
+		  if (esl_msa_Validate(msa2, NULL)                             != eslOK)  esl_fatal(msg);
+		  if (esl_msa_Compare(msa1, msa2)                              != eslOK)  esl_fatal(msg);
+		  if (afp->linenumber != nlines1)                                         esl_fatal(msg);
+		  esl_msa_Destroy(msa2);
+		  if (esl_msafile_stockholm_ReadParallel(afp, ncpus[k], &msa2) != eslOK)  esl_fatal(msg);
+		  if (msa2->nseq != 2 || msa2->alen != 10)                                esl_fatal(msg);
+		  if (afp->linenumber != nlines2)                                         esl_fatal(msg);
+		  esl_msa_Destroy(msa2);
+		  if (esl_msafile_stockholm_ReadParallel(afp, ncpus[k], &msa2) != eslEOF) esl_fatal(msg);
+		}
+	      eslx_msafile_Close(afp);
+	    }
+	  esl_msa_Destroy(msa1);
+	}
+      remove(tmpfile);
+    }
+  esl_alphabet_Destroy(abc);
+}
+
+static void
+utest_lazy(void)
+{
+  char          msg[]   = "stockholm lazy annotation unit test failed";
+  char          tmpfile[32];
+  char          s[]     = "# STOCKHOLM 1.0\n\nseq1 ACDEFGHIKL\n#=GC RF xxxxxxxxxx\n//\n";
+  int           nseq    = 23;
+  int           nblock  = 29;
+  ESLX_MSAFILE *afp     = NULL;
+  ESL_MSA      *msa1    = NULL;
+  ESL_MSA      *msa2    = NULL;
+  ESL_MSA      *msa3    = NULL;
+  ESL_MSA      *msa;
+  FILE         *ofp     = NULL;
+  int           ncpu, i, z;
+
+  strcpy(tmpfile, "esltmpXXXXXX");
+  if (esl_tmpfile_named(tmpfile, &ofp) != eslOK) esl_fatal(msg);
+  write_test_msa_big(ofp, nseq, nblock, 0);
+  fclose(ofp);
+
+  if (eslx_msafile_Open(NULL, tmpfile, NULL, eslMSAFILE_STOCKHOLM, NULL, &afp) != eslOK) esl_fatal(msg);
+  if (esl_msafile_stockholm_Read(afp, &msa1)                                  != eslOK) esl_fatal(msg);
+  if (msa1->lazy != NULL)                                                               esl_fatal(msg);
+  eslx_msafile_Close(afp);
+
+  for (ncpu = 1; ncpu <= 4; ncpu += 3)
+    {
+      if (eslx_msafile_Open(NULL, tmpfile, NULL, eslMSAFILE_STOCKHOLM, NULL, &afp) != eslOK) esl_fatal(msg);
+      if (eslx_msafile_SetLazyAnnotation(afp, TRUE)                               != eslOK) esl_fatal(msg);
+      if (esl_msafile_stockholm_ReadParallel(afp, ncpu, &msa2)                    != eslOK) esl_fatal(msg);
+      if (esl_msafile_stockholm_ReadParallel(afp, ncpu, &msa3)                    != eslOK) esl_fatal(msg);
+      if (msa3->lazy != NULL)                                                               esl_fatal(msg); /* no annotation, nothing deferred */
+      esl_msa_Destroy(msa3);
+      eslx_msafile_Close(afp);  /* materialization reopens the file */
+
+      /* sequences are all there; annotation isn't */
+      if (esl_msa_CompareMandatory(msa1, msa2) != eslOK) esl_fatal(msg);
+      if (msa2->lazy == NULL || msa2->ss_cons != NULL || msa2->rf != NULL) esl_fatal(msg);
+      if (msa2->ngc != msa1->ngc || msa2->ngr != msa1->ngr)                 esl_fatal(msg);
+      for (i = 0; i < msa2->nseq; i++)
+	if ((msa2->pp && msa2->pp[i]) || msa2->gr[0][i]) esl_fatal(msg);
+
+      /* one tag at a time */
+      if (esl_msa_MaterializeAnnotation(msa2, "RF") != eslOK) esl_fatal(msg);
+      if (msa2->rf == NULL || strcmp(msa2->rf, msa1->rf) != 0)  esl_fatal(msg);
+      if (msa2->ss_cons != NULL || msa2->lazy == NULL)          esl_fatal(msg);
+      if (esl_msa_MaterializeAnnotation(msa2, "RF") != eslOK) esl_fatal(msg);
+
+      /* then everything: a clone gets all of it, and so does its source */
+      if ((msa3 = esl_msa_Clone(msa2)) == NULL)                 esl_fatal(msg);
+      if (msa2->lazy != NULL || msa3->lazy != NULL)             esl_fatal(msg);
+      for (z = 0; z < 2; z++)
+	{
+	  msa = (z == 0 ? msa2 : msa3);
+	  if (esl_msa_MaterializeAnnotation(msa, NULL) != eslOK) esl_fatal(msg);
+	  if (msa->lazy != NULL)                                 esl_fatal(msg);
+	  if (esl_msa_Compare(msa1, msa) != eslOK)               esl_fatal(msg);
+	  for (i = 0; i < msa1->ngc; i++)
+	    if (esl_CCompare(msa1->gc[i], msa->gc[i]) != eslOK) esl_fatal(msg);
+	  for (i = 0; i < msa1->nseq; i++)
+	    if (esl_CCompare(msa1->gr[0][i], msa->gr[0][i]) != eslOK) esl_fatal(msg);
+	}
+      esl_msa_Destroy(msa2);
+      esl_msa_Destroy(msa3);
+    }
+  esl_msa_Destroy(msa1);
+  remove(tmpfile);
+
+  /* deferral needs a file that can be reopened */
+  if (eslx_msafile_OpenMem(NULL, s, strlen(s), eslMSAFILE_STOCKHOLM, NULL, &afp) != eslOK) esl_fatal(msg);
+  if (eslx_msafile_SetLazyAnnotation(afp, TRUE)                                != eslEINVAL) esl_fatal(msg);
+  if (esl_msafile_stockholm_Read(afp, &msa1)                                   != eslOK) esl_fatal(msg);
+  if (msa1->lazy != NULL || strcmp(msa1->rf, "xxxxxxxxxx") != 0)                         esl_fatal(msg);
+  esl_msa_Destroy(msa1);
+  eslx_msafile_Close(afp);
+}
+
+/* utest_lazy_write()
+ * An alignment read with deferred annotation must write out exactly
+ * as one read without it, in every format that writes annotation;
+ * and a sequence subset of it must keep its annotation too.
+ */
+static void
+utest_lazy_write(void)
+{
+  char          msg[]     = "stockholm lazy annotation write unit test failed";
+  char          tmpfile[32];
+  char          outfile1[32];
+  char          outfile2[32];
+  int           fmts[]    = { eslMSAFILE_STOCKHOLM, eslMSAFILE_PFAM, eslMSAFILE_SELEX, eslMSAFILE_A2M, eslMSAFILE_PSIBLAST };
+  int           nfmts     = sizeof(fmts) / sizeof(int);
+  int           nseq      = 23;
+  ESLX_MSAFILE *afp       = NULL;
+  ESL_MSA      *msa1      = NULL;
+  ESL_MSA      *msa2      = NULL;
+  ESL_MSA      *sub1      = NULL;
+  ESL_MSA      *sub2      = NULL;
+  FILE         *ofp       = NULL;
+  FILE         *fp1, *fp2;
+  int          *useme     = NULL;
+  int           c1, c2;
+  int           k, i;
+
+  strcpy(tmpfile, "esltmpXXXXXX");
+  if (esl_tmpfile_named(tmpfile, &ofp) != eslOK) esl_fatal(msg);
+  write_test_msa_big(ofp, nseq, 7, 0);
+  fclose(ofp);
+
+  if (eslx_msafile_Open(NULL, tmpfile, NULL, eslMSAFILE_STOCKHOLM, NULL, &afp) != eslOK) esl_fatal(msg);
+  if (esl_msafile_stockholm_Read(afp, &msa1)                                  != eslOK) esl_fatal(msg);
+  eslx_msafile_Close(afp);
+
+  for (k = 0; k <= nfmts; k++)
+    {
+      if (eslx_msafile_Open(NULL, tmpfile, NULL, eslMSAFILE_STOCKHOLM, NULL, &afp) != eslOK) esl_fatal(msg);
+      if (eslx_msafile_SetLazyAnnotation(afp, TRUE)                               != eslOK) esl_fatal(msg);
+      if (esl_msafile_stockholm_Read(afp, &msa2)                                  != eslOK) esl_fatal(msg);
+      if (msa2->lazy == NULL)                                                               esl_fatal(msg);
+      eslx_msafile_Close(afp);
+
+      if (k == nfmts)		/* last pass: a sequence subset instead of a write */
+	{
+	  if ((useme = malloc(sizeof(int) * nseq)) == NULL) esl_fatal(msg);
+	  for (i = 0; i < nseq; i++) useme[i] = (i % 2 == 0);
+	  if (esl_msa_SequenceSubset(msa1, useme, &sub1) != eslOK) esl_fatal(msg);
+	  if (esl_msa_SequenceSubset(msa2, useme, &sub2) != eslOK) esl_fatal(msg);
+	  if (msa2->lazy != NULL)                                  esl_fatal(msg);
+	  if (esl_msa_Compare(sub1, sub2)                != eslOK) esl_fatal(msg);
+	  for (i = 0; i < sub1->nseq; i++)
+	    if (esl_CCompare(sub1->gr[0][i], sub2->gr[0][i]) != eslOK) esl_fatal(msg);
+	  esl_msa_Destroy(sub1);
+	  esl_msa_Destroy(sub2);
+	  free(useme);
+	  esl_msa_Destroy(msa2);
+	  break;
+	}
+
+      strcpy(outfile1, "esltmpXXXXXX");
+      strcpy(outfile2, "esltmpXXXXXX");
+      if (esl_tmpfile_named(outfile1, &fp1)       != eslOK) esl_fatal(msg);
+      if (esl_tmpfile_named(outfile2, &fp2)       != eslOK) esl_fatal(msg);
+      if (eslx_msafile_Write(fp1, msa1, fmts[k]) != eslOK) esl_fatal(msg);
+      if (eslx_msafile_Write(fp2, msa2, fmts[k]) != eslOK) esl_fatal(msg);
+      if (msa2->lazy != NULL)                              esl_fatal(msg);
+      rewind(fp1);
+      rewind(fp2);
+      do {
+	c1 = fgetc(fp1);
+	c2 = fgetc(fp2);
+	if (c1 != c2) esl_fatal(msg);
+      } while (c1 != EOF);
+      fclose(fp1);
+      fclose(fp2);
+      remove(outfile1);
+      remove(outfile2);
+      esl_msa_Destroy(msa2);
+    }
+
+  esl_msa_Destroy(msa1);
+  remove(tmpfile);
+}
+
 #endif /*eslMSAFILE_STOCKHOLM_TESTDRIVE*/
 /*----------------- end, unit tests -----------------------------*/
 
 
 
 /*****************************************************************
- * 7. Test driver.
+ * 8. Test driver.
  *****************************************************************/
 #ifdef eslMSAFILE_STOCKHOLM_TESTDRIVE
 /* compile: gcc -g -Wall -I. -L. -o esl_msafile_stockholm_utest -DeslMSAFILE_STOCKHOLM_TESTDRIVE esl_msafile_stockholm.c -leasel -lm
@@ -2520,6 +3439,10 @@ main(int argc, char **argv)
 
   utest_identical_io(NULL, eslMSAFILE_UNKNOWN, "# STOCKHOLM 1.0\n\nseq1 ACDEFGHIKL\nseq2 ACDEFGHIKL\n//\n");
 
+  utest_parallel();
+  utest_lazy();
+  utest_lazy_write();
+
   /* Various "good" files, that should be parsed correctly. */
   for (testnumber = 1; testnumber <= ngoodtests; testnumber++)
     {
@@ -2608,7 +3531,8 @@ main(int argc, char **argv)
       }
       fclose(ofp);
       
-      utest_bad_format(tmpfile, testnumber, expected_linenumber, expected_errmsg);
+      utest_bad_format         (tmpfile, testnumber, expected_linenumber, expected_errmsg);
+      utest_bad_format_parallel(tmpfile, testnumber, expected_linenumber, expected_errmsg);
       remove(tmpfile);
     }
 
@@ -2620,7 +3544,7 @@ main(int argc, char **argv)
 
 
 /*****************************************************************
- * 8. Examples.
+ * 9. Examples.
  *****************************************************************/
 
 #ifdef eslMSAFILE_STOCKHOLM_EXAMPLE
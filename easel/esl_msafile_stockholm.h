@@ -6,6 +6,7 @@
 extern int esl_msafile_stockholm_SetInmap     (ESLX_MSAFILE *afp);
 extern int esl_msafile_stockholm_GuessAlphabet(ESLX_MSAFILE *afp, int *ret_type);
 extern int esl_msafile_stockholm_Read         (ESLX_MSAFILE *afp, ESL_MSA **ret_msa);
+extern int esl_msafile_stockholm_ReadParallel (ESLX_MSAFILE *afp, int ncpu, ESL_MSA **ret_msa);
 extern int esl_msafile_stockholm_Write        (FILE *fp, const ESL_MSA *msa, int fmt);
 
 #endif /*eslMSAFILE_STOCKHOLM_INCLUDED*/
@@ -28,6 +28,10 @@
 #include "esl_msa.h"
 #include "esl_dmatrix.h"
 #include "esl_vectorops.h"
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include "esl_threads.h"
+#endif
 
 /* Dependencies on phylogeny modules: */
 #include "esl_distance.h"
@@ -35,6 +39,70 @@
 #include "esl_msacluster.h"
 #include "esl_msaweight.h"
 
+/* IDFilter works through candidate seqs in blocks, screening each
+ * block against the seqs kept so far; see esl_msaweight_IDFilterParallel().
+ */
+#define eslMSAWEIGHT_IDBLOCK 1024
+
+typedef struct {
+  const ESL_MSA *msa;
+  double         maxid;
+  int           *len;		/* [0..nseq-1] residues in each seq                 */
+  int           *first;		/* [0..nseq-1] column of first residue (0..alen-1)  */
+  int           *last;		/* [0..nseq-1] column of last residue               */
+  int           *need;		/* [n=0..alen] identities needed to exceed maxid, for min length n */
+  int           *list;		/* seqs kept so far, [0..nlist-1]                   */
+  int            nlist;
+  int           *pass;		/* [c-start] TRUE if candidate c passes screening   */
+  int            start, end;	/* current block of candidates is start..end-1      */
+  int            next;		/* next candidate to claim                          */
+  int            status;	/* first error thrown by a screening thread         */
+#ifdef eslAUGMENT_ALPHABET
+  ESL_DST_BITS  *bits;		/* bit-sliced alignment, in digital mode            */
+#endif
+#ifdef HAVE_PTHREAD
+  int             use_lock;
+  pthread_mutex_t lock;		/* protects next and status                         */
+#endif
+} MSAWEIGHT_IDF;
+
+/* PB works in two passes: column chunks are counted into per-column
+ * weight contributions, then seq chunks sum them in column order;
+ * see esl_msaweight_PBParallel().
+ */
+#define eslMSAWEIGHT_PBCOLS 256
+#define eslMSAWEIGHT_PBSEQS 256
+
+typedef struct {
+  const ESL_MSA *msa;
+  int            K;		/* residue codes 0..K-1 count; code K is anything else     */
+  unsigned char  map[256];	/* text char or digital code -> residue code 0..K          */
+  double        *contrib;	/* [pos*(K+1) + x] = 1/(ntotal*nres[x]) in column pos; 0 for x=K */
+  int            pass;		/* 1 = counting columns; 2 = summing seqs                   */
+  int            next;		/* next chunk to claim in current pass                     */
+  int            nchunks;	/* number of chunks in current pass                        */
+#ifdef HAVE_PTHREAD
+  int             use_lock;
+  pthread_mutex_t lock;		/* protects next                                           */
+#endif
+} MSAWEIGHT_PB;
+
+static int  msaweight_gsc   (ESL_MSA *msa, int use_mapped, int ncpu);
+static int  idfilter_create (const ESL_MSA *msa, double maxid, MSAWEIGHT_IDF *ctx);
+static void idfilter_destroy(MSAWEIGHT_IDF *ctx);
+static int  idfilter_exceeds(const MSAWEIGHT_IDF *ctx, int i, int j, int *ret_exceeds);
+static void idfilter_screen (MSAWEIGHT_IDF *ctx, int c);
+static int  idfilter_next   (MSAWEIGHT_IDF *ctx);
+#ifdef HAVE_PTHREAD
+static void idfilter_thread (void *arg);
+#endif
+static void pb_columns      (MSAWEIGHT_PB *ctx, int c);
+static void pb_seqs         (MSAWEIGHT_PB *ctx, int c);
+static int  pb_next         (MSAWEIGHT_PB *ctx);
+#ifdef HAVE_PTHREAD
+static void pb_thread       (void *arg);
+#endif
+
 
 /*****************************************************************
  * 1. Implementations of weighting algorithms
@@ -61,29 +129,21 @@
  *            representation", JMB 236:1067-1078, 1994.
  *            
  *            The algorithm is $O(N^2)$ memory (it requires a pairwise
- *            distance matrix) and $O(N^3 + LN^2)$ time ($N^3$ for a UPGMA
- *            tree building step, $LN^2$ for distance matrix construction)
- *            for an alignment of N sequences and L columns. 
+ *            distance matrix) and $O(N^2 + LN^2)$ time in practice
+ *            ($N^2$ for a UPGMA tree building step that caches row
+ *            minima, $LN^2$ for distance matrix construction) for an
+ *            alignment of N sequences and L columns. 
  *            
  *            In the current implementation, the actual memory
- *            requirement is dominated by two full NxN distance
- *            matrices (one tmp copy in UPGMA, and one here): for
- *            8-byte doubles, that's $16N^2$ bytes. To keep the
+ *            requirement is dominated by the NxN distance matrix of
+ *            8-byte doubles, plus UPGMA's working copy of it, a
+ *            packed triangle of doubles: $12N^2$ bytes. To keep the
  *            calculation under memory limits, don't process large
- *            alignments: max 1400 sequences for 32 MB, max 4000
- *            sequences for 256 MB, max 8000 seqs for 1 GB. Watch
- *            out, because Pfam alignments can easily blow this up.
- *            
- * Note:      Memory usage could be improved. UPGMA consumes a distance
- *            matrix, but that can be D itself, not a copy, if the
- *            caller doesn't mind the destruction of D. Also, D is
- *            symmetrical, so we could use upper or lower triangular
- *            matrices if we rewrote dmatrix to allow them.
- *            
- *            I also think UPGMA can be reduced to O(N^2) time, by
- *            being more tricky about rapidly identifying the minimum
- *            element: could keep min of each row, and update that,
- *            I think.
+ *            alignments: max 1600 sequences for 32 MB, max 4600
+ *            sequences for 256 MB, max 9000 seqs for 1 GB. Watch
+ *            out, because Pfam alignments can easily blow this up;
+ *            see <esl_msaweight_GSCMapped()> for alignments too big
+ *            for RAM.
  *
  * Returns:   <eslOK> on success, and the weights inside <msa> have been
  *            modified.  
@@ -98,7 +158,90 @@
 int
 esl_msaweight_GSC(ESL_MSA *msa)
 {
-  ESL_DMATRIX *D = NULL;     /* distance matrix */
+  return msaweight_gsc(msa, FALSE, 1);
+}
+
+/* Function:  esl_msaweight_GSCParallel()
+ * Synopsis:  GSC weights, using multiple threads.
+ *
+ * Purpose:   Same as <esl_msaweight_GSC()>, using up to <ncpu>
+ *            threads. The weights are identical to the serial ones,
+ *            bit for bit, for any <ncpu>; and both are identical to
+ *            the weights of Easel's original implementation.
+ *
+ *            Threads share out the $O(LN^2)$ distance matrix
+ *            calculation, which dominates the time (see
+ *            <esl_dst_XDiffMxParallel()>). The $O(N^2)$ UPGMA clustering
+ *            and the two $O(N)$ tree traversals that apportion the
+ *            weights run in the calling thread.
+ *
+ * Args:      msa   - alignment to weight
+ *            ncpu  - number of threads to use ($\geq 1$)
+ *
+ * Returns:   <eslOK> on success, and the weights inside <msa> have been
+ *            modified.  
+ *
+ * Throws:    <eslEINVAL> if the alignment data are somehow invalid and
+ *            distance matrices can't be calculated. <eslEMEM> on an
+ *            allocation error; <eslESYS> if a thread can't be
+ *            created. In any case, the original <msa> is left
+ *            unmodified.
+ */
+int
+esl_msaweight_GSCParallel(ESL_MSA *msa, int ncpu)
+{
+  return msaweight_gsc(msa, FALSE, ncpu);
+}
+
+/* Function:  esl_msaweight_GSCMapped()
+ * Synopsis:  GSC weights, with an out-of-core distance matrix.
+ *
+ * Purpose:   Same as <esl_msaweight_GSC()>, but the pairwise distance
+ *            matrix lives in a memory-mapped scratch file (see
+ *            <esl_fsmatrix_CreateMapped()>) instead of in RAM, so
+ *            alignments of more sequences than the $2N^2$ bytes of
+ *            the matrix would allow can be weighted; the rest of the
+ *            memory requirement is $O(N)$. The scratch file is
+ *            created in <TMPDIR> (or </tmp>), which needs room for
+ *            $2N^2$ bytes, and is removed on return.
+ *
+ *            The matrix holds 4-byte floats, not doubles, so weights
+ *            agree with <esl_msaweight_GSC()>'s only approximately:
+ *            distances that differ by less than float precision tie,
+ *            and UPGMA's merged distances are rounded, which can
+ *            change the order of merges among (nearly) tied pairs.
+ *
+ *            Time is still $O(N^2 + LN^2)$, but now each $O(N)$ row
+ *            scan in the clustering touches about $N/32$ pages, with
+ *            I/O when the matrix doesn't fit in the page cache; so
+ *            expect this to be much slower than <esl_msaweight_GSC()>
+ *            on problems that <esl_msaweight_GSC()> can handle.
+ *
+ * Returns:   <eslOK> on success, and the weights inside <msa> have been
+ *            modified.  
+ *
+ * Throws:    <eslEINVAL> if the alignment data are somehow invalid and
+ *            distance matrices can't be calculated. <eslEMEM> on an
+ *            allocation error, including failure to create and map the
+ *            scratch file. In either case, the original <msa> is left
+ *            unmodified.
+ */
+int
+esl_msaweight_GSCMapped(ESL_MSA *msa)
+{
+  return msaweight_gsc(msa, TRUE, 1);
+}
+
+/* msaweight_gsc()
+ * The implementation of GSC weights, keeping the distance matrix in
+ * RAM (in doubles), or in a memory-mapped scratch file (in floats)
+ * if <use_mapped> is TRUE, and calculating it with <ncpu> threads.
+ */
+static int
+msaweight_gsc(ESL_MSA *msa, int use_mapped, int ncpu)
+{
+  ESL_DMATRIX  *DD = NULL;   /* distance matrix, in RAM */
+  ESL_FSMATRIX *D  = NULL;   /* distance matrix, packed floats, mapped */
   ESL_TREE    *T = NULL;     /* UPGMA tree */
   double      *x = NULL;     /* storage per node, 0..N-2 */
   double       lw, rw;       /* total branchlen on left, right subtrees */
@@ -117,23 +260,43 @@ esl_msaweight_GSC(ESL_MSA *msa)
   /* GSC weights use a rooted tree with "branch lengths" calculated by
    * UPGMA on a fractional difference matrix - pretty crude.
    */
-  if (! (msa->flags & eslMSA_DIGITAL)) {
-    if ((status = esl_dst_CDiffMx(msa->aseq, msa->nseq, &D))         != eslOK) goto ERROR;
-  } 
+  if (use_mapped)
+    {
+      if ((D = esl_fsmatrix_CreateMapped(msa->nseq)) == NULL) { status = eslEMEM; goto ERROR; }
+      if (! (msa->flags & eslMSA_DIGITAL)) {
+	if ((status = esl_dst_CDiffFMx(msa->aseq, msa->nseq, ncpu, D))         != eslOK) goto ERROR;
+      } 
 #ifdef eslAUGMENT_ALPHABET
-  else {
-    if ((status = esl_dst_XDiffMx(msa->abc, msa->ax, msa->nseq, &D)) != eslOK) goto ERROR;
-  }
+      else {
+	if ((status = esl_dst_XDiffFMx(msa->abc, msa->ax, msa->nseq, ncpu, D)) != eslOK) goto ERROR;
+      }
+#endif
+    }
+  else
+    {
+      if (! (msa->flags & eslMSA_DIGITAL)) {
+	if ((status = esl_dst_CDiffMxParallel(msa->aseq, msa->nseq, ncpu, &DD))         != eslOK) goto ERROR;
+      } 
+#ifdef eslAUGMENT_ALPHABET
+      else {
+	if ((status = esl_dst_XDiffMxParallel(msa->abc, msa->ax, msa->nseq, ncpu, &DD)) != eslOK) goto ERROR;
+      }
 #endif
+    }
 
   /* oi, look out here.  UPGMA is correct, but old squid library uses
    * single linkage, so for regression tests ONLY, we use single link. 
    */
 #ifdef  eslMSAWEIGHT_REGRESSION
-  if ((status = esl_tree_SingleLinkage(D, &T)) != eslOK) goto ERROR; 
+  if (D != NULL) status = esl_tree_ClusterFMx(D, eslSINGLE_LINKAGE, &T);
+  else           status = esl_tree_SingleLinkage(DD, &T);
 #else
-  if ((status = esl_tree_UPGMA(D, &T)) != eslOK) goto ERROR; 
+  if (D != NULL) status = esl_tree_ClusterFMx(D, eslUPGMA, &T);
+  else           status = esl_tree_UPGMA(DD, &T);
 #endif
+  if (status != eslOK) goto ERROR;
+  if (D  != NULL) { esl_fsmatrix_Destroy(D);  D  = NULL; } /* clustering used it up */
+  if (DD != NULL) { esl_dmatrix_Destroy(DD);  DD = NULL; }
   esl_tree_SetCladesizes(T);	
 
   ESL_ALLOC(x, sizeof(double) * (T->N-1));
@@ -198,13 +361,13 @@ esl_msaweight_GSC(ESL_MSA *msa)
 
   free(x);
   esl_tree_Destroy(T);
-  esl_dmatrix_Destroy(D);
   return eslOK;
 
  ERROR:
-  if (x != NULL) free(x);
-  if (T != NULL) esl_tree_Destroy(T);
-  if (D != NULL) esl_dmatrix_Destroy(D);
+  if (x  != NULL) free(x);
+  if (T  != NULL) esl_tree_Destroy(T);
+  if (D  != NULL) esl_fsmatrix_Destroy(D);
+  if (DD != NULL) esl_dmatrix_Destroy(DD);
   return status;
 }
 
@@ -233,9 +396,10 @@ esl_msaweight_GSC(ESL_MSA *msa)
  *            that effect), then normalized to sum to nseq.
  *            
  *            An advantage of the PB method is efficiency.
- *            It is $O(1)$ in memory and $O(NL)$ time, for an alignment of
- *            N sequences and L columns. This makes it a good method 
- *            for ad hoc weighting of very deep alignments.
+ *            It is $O(LK)$ in memory and $O(NL)$ time, for an alignment of
+ *            N sequences and L columns in an alphabet of size K. This
+ *            makes it a good method for ad hoc weighting of very deep
+ *            alignments.
  *            
  *            When the alignment is in simple text mode, IUPAC
  *            degenerate symbols are not dealt with correctly; instead,
@@ -243,6 +407,8 @@ esl_msaweight_GSC(ESL_MSA *msa)
  *            (case-insensitively), and treats all other residues as
  *            gaps.
  *
+ *            Same as <esl_msaweight_PBParallel()> with one thread.
+ *
  * Returns:   <eslOK> on success, and the weights inside <msa> have been
  *            modified. 
  *
@@ -254,12 +420,47 @@ esl_msaweight_GSC(ESL_MSA *msa)
 int
 esl_msaweight_PB(ESL_MSA *msa)
 {
-  int    *nres = NULL;   	/* counts of each residue observed in a column */
-  int     ntotal;		/* number of different symbols observed in a column */
-  int     rlen;			/* number of residues in a sequence */
-  int     idx, pos, i;
-  int     K;			/* alphabet size */
-  int     status;
+  return esl_msaweight_PBParallel(msa, 1);
+}
+
+/* Function:  esl_msaweight_PBParallel()
+ * Synopsis:  PB weights, using multiple threads.
+ *
+ * Purpose:   Same as <esl_msaweight_PB()>, using up to <ncpu>
+ *            threads. The weights are identical, bit for bit, for
+ *            any <ncpu>.
+ *
+ *            Works in two passes over the alignment, each shared out
+ *            among threads in chunks. First, chunks of columns are
+ *            counted, reading each sequence's stretch of the chunk
+ *            contiguously, and each column's count of residue <x>
+ *            becomes its weight contribution $1/(n_{tot} n_x)$, in a
+ *            table. Second, chunks of sequences sum their
+ *            contributions from that table in column order. No
+ *            thread writes another's data, so there is nothing to
+ *            reduce, and the inner loops have no divisions or
+ *            branches.
+ *
+ * Args:      msa   - alignment to weight
+ *            ncpu  - number of threads to use ($\geq 1$)
+ *
+ * Returns:   <eslOK> on success, and the weights inside <msa> have been
+ *            modified. 
+ *
+ * Throws:    <eslEMEM> on allocation error; <eslESYS> if a thread
+ *            can't be created. In either case <msa> is returned
+ *            unmodified.
+ */
+int
+esl_msaweight_PBParallel(ESL_MSA *msa, int ncpu)
+{
+  MSAWEIGHT_PB   ctx;
+  int            pass, c, x;
+  int            status;
+#ifdef HAVE_PTHREAD
+  ESL_THREADS   *thr    = NULL;
+  int            t, nt;
+#endif
 
   /* Contract checks
    */
@@ -267,80 +468,67 @@ esl_msaweight_PB(ESL_MSA *msa)
   ESL_DASSERT1( (msa->alen >= 1) );
   if (msa->nseq == 1) { msa->wgt[0] = 1.0; return eslOK; }
 
-  /* Initialize
+  /* Map residues to codes 0..K-1, anything else to K: in text mode,
+   * the 26 letters, case-insensitively; in digital mode, canonical
+   * residues.
    */
+  ctx.msa     = msa;
+  ctx.contrib = NULL;
+#ifdef HAVE_PTHREAD
+  ctx.use_lock = FALSE;
+#endif
   if (! (msa->flags & eslMSA_DIGITAL)) 
-    { ESL_ALLOC(nres, sizeof(int) * 26);          K = 26;          }
+    {
+      ctx.K = 26;
+      for (x = 0; x < 256; x++) ctx.map[x] = (isalpha(x) ? toupper(x) - 'A' : ctx.K);
+    }
 #ifdef eslAUGMENT_ALPHABET
   else 
-    { ESL_ALLOC(nres, sizeof(int) * msa->abc->K); K = msa->abc->K; }
+    {
+      ctx.K = msa->abc->K;
+      for (x = 0; x < 256; x++) ctx.map[x] = (esl_abc_XIsCanonical(msa->abc, x) ? x : ctx.K);
+    }
 #endif
+  ESL_ALLOC(ctx.contrib, sizeof(double) * msa->alen * (ctx.K+1));
+  ncpu = ESL_MAX(1, ncpu);
 
-  esl_vec_DSet(msa->wgt, msa->nseq, 0.);
-
-  /* This section handles text alignments */
-  if (! (msa->flags & eslMSA_DIGITAL)) 
+#ifdef HAVE_PTHREAD
+  if (ncpu > 1)
     {
-      for (pos = 0; pos < msa->alen; pos++)
-	{
-	  /* Collect # of letters A..Z in this column, and total */
-	  esl_vec_ISet(nres, K, 0.);
-	  for (idx = 0; idx < msa->nseq; idx++)
-	    if (isalpha((int) msa->aseq[idx][pos]))
-	      nres[toupper((int) msa->aseq[idx][pos]) - 'A'] ++;
-	  for (ntotal = 0, i = 0; i < K; i++) if (nres[i] > 0) ntotal++;
-
-	  /* Bump weight on each seq by PB rule */
-	  if (ntotal > 0) {
-	    for (idx = 0; idx < msa->nseq; idx++) {
-	      if (isalpha((int) msa->aseq[idx][pos]))
-		msa->wgt[idx] += 1. / 
-		  (double) (ntotal * nres[toupper((int) msa->aseq[idx][pos]) - 'A'] );
-	    }
-	  }
-	}
-
-      /* first normalization by # of residues counted in each seq */
-      for (idx = 0; idx < msa->nseq; idx++) {
-	for (rlen = 0, pos = 0; pos < msa->alen; pos++) 
-      	  if (isalpha((int) msa->aseq[idx][pos])) rlen++;
-	if (ntotal > 0) msa->wgt[idx] /= (double) rlen;
-	/* if rlen == 0 for this seq, its weight is still 0.0, as initialized. */
-      }
+      if (pthread_mutex_init(&(ctx.lock), NULL) != 0) ESL_XEXCEPTION(eslESYS, "mutex init failed");
+      ctx.use_lock = TRUE;
     }
+#endif
 
-  /* This section handles digital alignments. */
-#ifdef eslAUGMENT_ALPHABET
-  else
+  /* Pass 1 fills in contrib[] from column chunks; pass 2 sets msa->wgt[] from seq chunks.
+   * Only pass 2 touches <msa>, and it can't fail.
+   */
+  for (pass = 1; pass <= 2; pass++)
     {
-      for (pos = 1; pos <= msa->alen; pos++)
+      ctx.pass    = pass;
+      ctx.next    = 0;
+      ctx.nchunks = (pass == 1 ? (msa->alen + eslMSAWEIGHT_PBCOLS - 1) / eslMSAWEIGHT_PBCOLS
+		                : (msa->nseq + eslMSAWEIGHT_PBSEQS - 1) / eslMSAWEIGHT_PBSEQS);
+#ifdef HAVE_PTHREAD
+      nt = ESL_MIN(ncpu, ctx.nchunks);
+      if (nt > 1)
 	{
-	  /* Collect # of residues 0..K-1 in this column, and total # */
-	  esl_vec_ISet(nres, K, 0.);
-	  for (idx = 0; idx < msa->nseq; idx++)
-	    if (esl_abc_XIsCanonical(msa->abc, msa->ax[idx][pos]))
-	      nres[(int) msa->ax[idx][pos]] ++;
-	  for (ntotal = 0, i = 0; i < K; i++) if (nres[i] > 0) ntotal++;
-
-	  /* Bump weight on each sequence by PB rule */
-	  if (ntotal > 0) {
-	    for (idx = 0; idx < msa->nseq; idx++) {
-	      if (esl_abc_XIsCanonical(msa->abc, msa->ax[idx][pos]))
-		msa->wgt[idx] += 1. / (double) (ntotal * nres[msa->ax[idx][pos]]);
-	    }
-	  }
+	  if ((thr = esl_threads_Create(&pb_thread)) == NULL) { status = eslEMEM; goto ERROR; }
+	  for (t = 0; t < nt; t++)
+	    if ((status = esl_threads_AddThread(thr, (void *) &ctx)) != eslOK) break;
+	  esl_threads_WaitForStart (thr);
+	  esl_threads_WaitForFinish(thr);
+	  esl_threads_Destroy(thr);
+	  thr = NULL;
+	  if (t < nt && pass == 1) goto ERROR; /* in pass 2, <msa> is changing; serial loop finishes it */
 	}
-
-      /* first normalization by # of residues counted in each seq */
-      for (idx = 0; idx < msa->nseq; idx++)
+#endif
+      while ((c = pb_next(&ctx)) != -1) /* serial; or a no-op, after threads have done it all */
 	{
-	  for (rlen = 0, pos = 1; pos <= msa->alen; pos++) 
-	    if (esl_abc_XIsCanonical(msa->abc, msa->ax[idx][pos])) rlen++;
-	  if (rlen > 0) msa->wgt[idx] /= (double) rlen;
-	  /* if rlen == 0 for this seq, its weight is still 0.0, as initialized. */
+	  if (pass == 1) pb_columns(&ctx, c);
+	  else           pb_seqs   (&ctx, c);
 	}
     }
-#endif
 
   /* Make weights normalize up to nseq, and return.  In pathological
    * case where all wgts were 0 (no seqs contain any unambiguous
@@ -350,11 +538,17 @@ esl_msaweight_PB(ESL_MSA *msa)
   esl_vec_DScale(msa->wgt, msa->nseq, (double) msa->nseq);	
   msa->flags |= eslMSA_HASWGTS;
 
-  free(nres);
+#ifdef HAVE_PTHREAD
+  if (ctx.use_lock) pthread_mutex_destroy(&(ctx.lock));
+#endif
+  free(ctx.contrib);
   return eslOK;
 
  ERROR:
-  if (nres != NULL) free(nres);
+#ifdef HAVE_PTHREAD
+  if (ctx.use_lock) pthread_mutex_destroy(&(ctx.lock));
+#endif
+  if (ctx.contrib != NULL) free(ctx.contrib);
   return status;
 }
 
@@ -458,13 +652,55 @@ esl_msaweight_BLOSUM(ESL_MSA *msa, double maxid)
 int
 esl_msaweight_IDFilter(const ESL_MSA *msa, double maxid, ESL_MSA **ret_newmsa)
 {
-  int     *list   = NULL;               /* array of seqs in new msa */
-  int     *useme  = NULL;               /* TRUE if seq is kept in new msa */
-  int      nnew;			/* number of seqs in new alignment */
-  double   ident;                       /* pairwise percentage id */
-  int      i,j;                         /* seqs counters*/
-  int      remove;                      /* TRUE if sq is to be removed */
-  int      status;
+  return esl_msaweight_IDFilterParallel(msa, maxid, 1, ret_newmsa);
+}
+
+/* Function:  esl_msaweight_IDFilterParallel()
+ * Synopsis:  Filter by %ID, using multiple threads.
+ *
+ * Purpose:   Same as <esl_msaweight_IDFilter()>, using up to <ncpu>
+ *            threads. The result is identical to the serial one:
+ *            a sequence is kept if and only if it is no more than
+ *            <maxid> identical to every earlier kept sequence.
+ *
+ *            Candidates are taken in blocks. Threads share out a
+ *            block's candidates, and test each one against the
+ *            sequences kept before the block. Those that survive
+ *            are then tested against each other in alignment order,
+ *            so later sequences still lose to earlier ones.
+ *
+ *            With <ncpu> = 1, or without POSIX threads, everything
+ *            runs in the calling thread. Either way, pairs whose
+ *            residue spans overlap too little to reach <maxid> are
+ *            rejected without counting identities, and for digital
+ *            alignments the count stops early once the answer is
+ *            known (see <esl_dst_bits_PairIdExceeds()>).
+ *
+ * Args:      msa        - alignment to filter
+ *            maxid      - remove seqs with $>$ <maxid> identity to a kept seq
+ *            ncpu       - number of threads to use ($\geq 1$)
+ *            ret_newmsa - RETURN: new, filtered alignment
+ *
+ * Return:    <eslOK> on success, and the <newmsa>.
+ *
+ * Throws:    <eslEMEM> on allocation error; <eslESYS> if a thread
+ *            can't be created. <eslEINVAL> if a pairwise identity
+ *            calculation fails because of corrupted sequence data. In
+ *            any case, the <msa> is unmodified.
+ */
+int
+esl_msaweight_IDFilterParallel(const ESL_MSA *msa, double maxid, int ncpu, ESL_MSA **ret_newmsa)
+{
+  MSAWEIGHT_IDF  ctx;
+  int           *useme  = NULL;               /* TRUE if seq is kept in new msa */
+  int            nold;			      /* number of seqs kept before this block */
+  int            c, j;
+  int            remove;
+  int            status;
+#ifdef HAVE_PTHREAD
+  ESL_THREADS   *thr    = NULL;
+  int            t;
+#endif
   
   /* Contract checks
    */
@@ -472,49 +708,358 @@ esl_msaweight_IDFilter(const ESL_MSA *msa, double maxid, ESL_MSA **ret_newmsa)
   ESL_DASSERT1( (msa->nseq >= 1)    );
   ESL_DASSERT1( (msa->alen >= 1)    );
 
-  /* allocate */
-  ESL_ALLOC(list,  sizeof(int) * msa->nseq);
+  if ((status = idfilter_create(msa, maxid, &ctx)) != eslOK) goto ERROR;
   ESL_ALLOC(useme, sizeof(int) * msa->nseq);
   esl_vec_ISet(useme, msa->nseq, 0); /* initialize array */
+  ncpu = ESL_MAX(1, ncpu);
 
-  /* find which seqs to keep (list) */
-  nnew = 0;
-  for (i = 0; i < msa->nseq; i++)
+#ifdef HAVE_PTHREAD
+  if (ncpu > 1)
+    {
+      if (pthread_mutex_init(&(ctx.lock), NULL) != 0) ESL_XEXCEPTION(eslESYS, "mutex init failed");
+      ctx.use_lock = TRUE;
+    }
+#endif
+
+  for (ctx.start = 0; ctx.start < msa->nseq; ctx.start = ctx.end)
     {
-      remove = FALSE;
-      for (j = 0; j < nnew; j++)
+      /* Small blocks while there are few kept seqs to screen against */
+      ctx.end  = ESL_MIN(msa->nseq, ctx.start + ESL_MAX(1, ESL_MIN(eslMSAWEIGHT_IDBLOCK, ctx.nlist)));
+      ctx.next = ctx.start;
+      nold     = ctx.nlist;
+
+      /* Screen candidates against the nold seqs kept before this block */
+#ifdef HAVE_PTHREAD
+      if (ncpu > 1 && ctx.end - ctx.start > 1 && nold > 0)
 	{
-	  if (! (msa->flags & eslMSA_DIGITAL)) {
-	    if ((status = esl_dst_CPairId(msa->aseq[i], msa->aseq[list[j]], &ident, NULL, NULL))       != eslOK) goto ERROR;
-	  } 
-#ifdef eslAUGMENT_ALPHABET
-	  else {
-	    if ((status = esl_dst_XPairId(msa->abc, msa->ax[i], msa->ax[list[j]], &ident, NULL, NULL)) != eslOK) goto ERROR;
-	  }
+	  if ((thr = esl_threads_Create(&idfilter_thread)) == NULL) { status = eslEMEM; goto ERROR; }
+	  for (t = 0; t < ESL_MIN(ncpu, ctx.end - ctx.start); t++)
+	    if ((status = esl_threads_AddThread(thr, (void *) &ctx)) != eslOK) break;
+	  esl_threads_WaitForStart (thr);
+	  esl_threads_WaitForFinish(thr);
+	  esl_threads_Destroy(thr);
+	  thr = NULL;
+	  if (t < ESL_MIN(ncpu, ctx.end - ctx.start)) goto ERROR;
+	}
 #endif
-	  
-	  if (ident > maxid)
-	    { 
-	      remove = TRUE; 
-	      break; 
+      while ((c = idfilter_next(&ctx)) != -1) /* serial; or a no-op, after threads have done it all */
+	idfilter_screen(&ctx, c);
+      if (ctx.status != eslOK) { status = ctx.status; goto ERROR; }
+
+      /* Survivors also have to pass the seqs kept earlier in this block */
+      for (c = ctx.start; c < ctx.end; c++)
+	{
+	  if (! ctx.pass[c - ctx.start]) continue;
+	  for (remove = FALSE, j = nold; j < ctx.nlist; j++)
+	    {
+	      if ((status = idfilter_exceeds(&ctx, c, ctx.list[j], &remove)) != eslOK) goto ERROR;
+	      if (remove) break;
 	    }
+	  if (remove == FALSE) {
+	    ctx.list[ctx.nlist++] = c;
+	    useme[c]              = TRUE;
+	  }
 	}
-      if (remove == FALSE) {
-	list[nnew++] = i;
-	useme[i]     = TRUE;
-      }
     }
   if ((status = esl_msa_SequenceSubset(msa, useme, ret_newmsa)) != eslOK) goto ERROR;
  
-  free(list);
+  idfilter_destroy(&ctx);
   free(useme);
   return eslOK;
 
  ERROR:
-  if (list  != NULL) free(list);
+  idfilter_destroy(&ctx);
   if (useme != NULL) free(useme);
   return status;
 }
+
+
+/* IDFilter's shared state, and the pair test. The test is done in
+ * integers: need[n] is the number of identities needed to exceed
+ * maxid when the shorter seq has n residues. Each seq's residue span
+ * (first to last residue column) bounds the identities it can share
+ * with another, so pairs of barely overlapping fragments are
+ * rejected without counting.
+ */
+static int
+idfilter_create(const ESL_MSA *msa, double maxid, MSAWEIGHT_IDF *ctx)
+{
+  int     i;
+  int64_t pos;
+  int     status;
+
+  ctx->msa    = msa;
+  ctx->maxid  = maxid;
+  ctx->len    = ctx->first = ctx->last = ctx->need = ctx->list = ctx->pass = NULL;
+  ctx->nlist  = 0;
+  ctx->start  = ctx->end = ctx->next = 0;
+  ctx->status = eslOK;
+#ifdef eslAUGMENT_ALPHABET
+  ctx->bits   = NULL;
+#endif
+#ifdef HAVE_PTHREAD
+  ctx->use_lock = FALSE;
+#endif
+
+  ESL_ALLOC(ctx->len,   sizeof(int) * msa->nseq);
+  ESL_ALLOC(ctx->first, sizeof(int) * msa->nseq);
+  ESL_ALLOC(ctx->last,  sizeof(int) * msa->nseq);
+  ESL_ALLOC(ctx->need,  sizeof(int) * (msa->alen+1));
+  ESL_ALLOC(ctx->list,  sizeof(int) * msa->nseq);
+  ESL_ALLOC(ctx->pass,  sizeof(int) * eslMSAWEIGHT_IDBLOCK);
+
+  /* Residues counted exactly as the %id calculations count them:
+   * canonical residues in digital mode, alphabetic chars in text mode. 
+   */
+  for (i = 0; i < msa->nseq; i++)
+    {
+      ctx->len[i]   = 0;
+      ctx->first[i] = msa->alen;
+      ctx->last[i]  = -1;
+      for (pos = 0; pos < msa->alen; pos++)
+	{
+	  if (! (msa->flags & eslMSA_DIGITAL)) {
+	    if (! isalpha(msa->aseq[i][pos])) continue;
+	  }
+#ifdef eslAUGMENT_ALPHABET
+	  else if (! esl_abc_XIsCanonical(msa->abc, msa->ax[i][pos+1])) continue;
+#endif
+	  if (ctx->len[i] == 0) ctx->first[i] = pos;
+	  ctx->last[i] = pos;
+	  ctx->len[i]++;
+	}
+    }
+
+  /* An identity fraction of 0/0 counts as 0 */
+  ctx->need[0] = (0. > maxid ? 0 : 1);
+  for (pos = 1; pos <= msa->alen; pos++)
+    ctx->need[pos] = esl_dst_NidThreshold(pos, maxid);
+
+#ifdef eslAUGMENT_ALPHABET
+  if ((msa->flags & eslMSA_DIGITAL) && (status = esl_dst_bits_Create(msa->abc, msa->ax, msa->nseq, &(ctx->bits))) != eslOK) goto ERROR;
+#endif
+  return eslOK;
+
+ ERROR:
+  idfilter_destroy(ctx);
+  return status;
+}
+
+static void
+idfilter_destroy(MSAWEIGHT_IDF *ctx)
+{
+  if (ctx->len)   free(ctx->len);
+  if (ctx->first) free(ctx->first);
+  if (ctx->last)  free(ctx->last);
+  if (ctx->need)  free(ctx->need);
+  if (ctx->list)  free(ctx->list);
+  if (ctx->pass)  free(ctx->pass);
+  ctx->len = ctx->first = ctx->last = ctx->need = ctx->list = ctx->pass = NULL;
+#ifdef eslAUGMENT_ALPHABET
+  esl_dst_bits_Destroy(ctx->bits);
+  ctx->bits = NULL;
+#endif
+#ifdef HAVE_PTHREAD
+  if (ctx->use_lock) pthread_mutex_destroy(&(ctx->lock));
+  ctx->use_lock = FALSE;
+#endif
+}
+
+/* Set <*ret_exceeds> TRUE if seqs <i>,<j> are > maxid identical */
+static int
+idfilter_exceeds(const MSAWEIGHT_IDF *ctx, int i, int j, int *ret_exceeds)
+{
+  int        need = ctx->need[ESL_MIN(ctx->len[i], ctx->len[j])];
+  int        ub;
+  double     pid;
+  int        status;
+
+  /* Identities can only fall where the two residue spans overlap */
+  ub = ESL_MIN(ctx->last[i], ctx->last[j]) - ESL_MAX(ctx->first[i], ctx->first[j]) + 1;
+  if (ub < need) { *ret_exceeds = (need <= 0); return eslOK; }
+
+  if (! (ctx->msa->flags & eslMSA_DIGITAL)) {
+    if ((status = esl_dst_CPairId(ctx->msa->aseq[i], ctx->msa->aseq[j], &pid, NULL, NULL)) != eslOK) return status;
+    *ret_exceeds = (pid > ctx->maxid);
+  }
+#ifdef eslAUGMENT_ALPHABET
+  else
+    *ret_exceeds = esl_dst_bits_NidAtLeast(ctx->bits, i, j, need);
+#endif
+  return eslOK;
+}
+
+/* Screen candidate <c> against the seqs kept before its block */
+static void
+idfilter_screen(MSAWEIGHT_IDF *ctx, int c)
+{
+  int nold   = ctx->nlist;
+  int remove = FALSE;
+  int j;
+  int status = eslOK;
+
+  for (j = 0; j < nold; j++)
+    {
+      if ((status = idfilter_exceeds(ctx, c, ctx->list[j], &remove)) != eslOK) break;
+      if (remove) break;
+    }
+  ctx->pass[c - ctx->start] = (remove || status != eslOK ? FALSE : TRUE);
+
+  if (status != eslOK) 
+    {
+#ifdef HAVE_PTHREAD
+      if (ctx->use_lock) pthread_mutex_lock(&(ctx->lock));
+#endif
+      ctx->status = status;
+#ifdef HAVE_PTHREAD
+      if (ctx->use_lock) pthread_mutex_unlock(&(ctx->lock));
+#endif
+    }
+}
+
+/* Claim the next candidate in the current block; -1 when there are none left */
+static int
+idfilter_next(MSAWEIGHT_IDF *ctx)
+{
+  int c = -1;
+
+#ifdef HAVE_PTHREAD
+  if (ctx->use_lock) pthread_mutex_lock(&(ctx->lock));
+#endif
+  if (ctx->next < ctx->end) c = ctx->next++;
+#ifdef HAVE_PTHREAD
+  if (ctx->use_lock) pthread_mutex_unlock(&(ctx->lock));
+#endif
+  return c;
+}
+
+#ifdef HAVE_PTHREAD
+static void
+idfilter_thread(void *arg)
+{
+  ESL_THREADS   *thr = (ESL_THREADS *) arg;
+  MSAWEIGHT_IDF *ctx;
+  int            w;
+  int            c;
+
+  esl_threads_Started(thr, &w);
+  ctx = (MSAWEIGHT_IDF *) esl_threads_GetData(thr, w);
+  while ((c = idfilter_next(ctx)) != -1)
+    idfilter_screen(ctx, c);
+  esl_threads_Finished(thr, w);
+}
+#endif /*HAVE_PTHREAD*/
+/* PB pass 1: count residues in column chunk <c>, seq by seq, into
+ * its rows of the contrib[] table, then turn each column's counts
+ * into its weight contributions 1/(ntotal*nres[x]): the same double
+ * as the textbook per-column calculation. (Counts are small integers,
+ * exact in a double.)
+ */
+static void
+pb_columns(MSAWEIGHT_PB *ctx, int c)
+{
+  const ESL_MSA       *msa   = ctx->msa;
+  int                  Kp    = ctx->K + 1;
+  int64_t              p0    = (int64_t) c * eslMSAWEIGHT_PBCOLS;
+  int                  ncol  = (int) ESL_MIN(eslMSAWEIGHT_PBCOLS, msa->alen - p0);
+  double              *cnt   = ctx->contrib + p0 * Kp;
+  const unsigned char *row;
+  int                  idx, p, x, ntotal;
+
+  esl_vec_DSet(cnt, ncol * Kp, 0.);
+  for (idx = 0; idx < msa->nseq; idx++)
+    {
+      if (! (msa->flags & eslMSA_DIGITAL)) row = (const unsigned char *) msa->aseq[idx] + p0;
+#ifdef eslAUGMENT_ALPHABET
+      else                                 row = (const unsigned char *) msa->ax[idx]   + p0 + 1;
+#endif
+      for (p = 0; p < ncol; p++)
+	cnt[p*Kp + ctx->map[row[p]]] += 1.;
+    }
+
+  for (p = 0; p < ncol; p++, cnt += Kp)
+    {
+      for (ntotal = 0, x = 0; x < ctx->K; x++) if (cnt[x] > 0.) ntotal++;
+      for (x = 0; x < ctx->K; x++)
+	if (cnt[x] > 0.) cnt[x] = 1. / (double) (ntotal * (int) cnt[x]);
+      cnt[ctx->K] = 0.;
+    }
+}
+
+/* PB pass 2: for seqs in chunk <c>, sum contributions of their
+ * residues in column order, and divide by residue count. Adding a 0
+ * for gaps leaves the sum bit-identical.
+ */
+static void
+pb_seqs(MSAWEIGHT_PB *ctx, int c)
+{
+  const ESL_MSA       *msa  = ctx->msa;
+  int                  Kp   = ctx->K + 1;
+  int                  i0   = c * eslMSAWEIGHT_PBSEQS;
+  int                  i1   = ESL_MIN(msa->nseq, i0 + eslMSAWEIGHT_PBSEQS);
+  const double        *contrib;
+  const unsigned char *row;
+  double               w;
+  int64_t              pos;
+  int                  idx, x, rlen;
+
+  for (idx = i0; idx < i1; idx++)
+    {
+      if (! (msa->flags & eslMSA_DIGITAL)) row = (const unsigned char *) msa->aseq[idx];
+#ifdef eslAUGMENT_ALPHABET
+      else                                 row = (const unsigned char *) msa->ax[idx] + 1;
+#endif
+      w       = 0.;
+      rlen    = 0;
+      contrib = ctx->contrib;
+      for (pos = 0; pos < msa->alen; pos++, contrib += Kp)
+	{
+	  x     = ctx->map[row[pos]];
+	  w    += contrib[x];
+	  rlen += (x < ctx->K);
+	}
+      /* first normalization by # of residues counted in each seq;
+       * if rlen == 0 for this seq, its weight stays 0.0.
+       */
+      msa->wgt[idx] = (rlen > 0 ? w / (double) rlen : 0.);
+    }
+}
+
+/* Claim the next chunk in the current PB pass; -1 when there are none left */
+static int
+pb_next(MSAWEIGHT_PB *ctx)
+{
+  int c = -1;
+
+#ifdef HAVE_PTHREAD
+  if (ctx->use_lock) pthread_mutex_lock(&(ctx->lock));
+#endif
+  if (ctx->next < ctx->nchunks) c = ctx->next++;
+#ifdef HAVE_PTHREAD
+  if (ctx->use_lock) pthread_mutex_unlock(&(ctx->lock));
+#endif
+  return c;
+}
+
+#ifdef HAVE_PTHREAD
+static void
+pb_thread(void *arg)
+{
+  ESL_THREADS  *thr = (ESL_THREADS *) arg;
+  MSAWEIGHT_PB *ctx;
+  int           w;
+  int           c;
+
+  esl_threads_Started(thr, &w);
+  ctx = (MSAWEIGHT_PB *) esl_threads_GetData(thr, w);
+  while ((c = pb_next(ctx)) != -1)
+    {
+      if (ctx->pass == 1) pb_columns(ctx, c);
+      else                pb_seqs   (ctx, c);
+    }
+  esl_threads_Finished(thr, w);
+}
+#endif /*HAVE_PTHREAD*/
 /*---------------- end, weighting implementations ----------------*/
 
 
@@ -524,6 +1069,8 @@ esl_msaweight_IDFilter(const ESL_MSA *msa, double maxid, ESL_MSA **ret_newmsa)
  * 2. Unit tests
  *****************************************************************/
 #ifdef eslMSAWEIGHT_TESTDRIVE
+#include "esl_msafile.h"
+#include "esl_random.h"
 
 static int
 utest_GSC(ESL_ALPHABET *abc, ESL_MSA *msa, double *expect)
@@ -532,12 +1079,16 @@ utest_GSC(ESL_ALPHABET *abc, ESL_MSA *msa, double *expect)
 
   if (esl_msaweight_GSC(msa)                               != eslOK) esl_fatal(msg);
   if (esl_vec_DCompare(msa->wgt, expect, msa->nseq, 0.001) != eslOK) esl_fatal(msg);
+  if (esl_msaweight_GSCMapped(msa)                         != eslOK) esl_fatal(msg);
+  if (esl_vec_DCompare(msa->wgt, expect, msa->nseq, 0.001) != eslOK) esl_fatal(msg);
   
   if (abc != NULL) 
     {
       if (esl_msa_Digitize(abc, msa, NULL)                     != eslOK) esl_fatal(msg);
       if (esl_msaweight_GSC(msa)                               != eslOK) esl_fatal(msg);
       if (esl_vec_DCompare(msa->wgt, expect, msa->nseq, 0.001) != eslOK) esl_fatal(msg);
+      if (esl_msaweight_GSCMapped(msa)                         != eslOK) esl_fatal(msg);
+      if (esl_vec_DCompare(msa->wgt, expect, msa->nseq, 0.001) != eslOK) esl_fatal(msg);
       if (esl_msa_Textize(msa)                                 != eslOK) esl_fatal(msg);
     }
   return eslOK;
@@ -578,6 +1129,309 @@ utest_BLOSUM(ESL_ALPHABET *abc, ESL_MSA *msa, double maxid, double *expect)
     }
   return eslOK;
 }
+
+/* family_msa()
+ * Create a random text alignment of <N> seqs of length <L>, in 10
+ * families, with some fragments, so that both bounds and the full
+ * identity count get exercised.
+ */
+static ESL_MSA *
+family_msa(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, int N, int L)
+{
+  ESL_MSA  *msa = esl_msa_Create(N, L);
+  char      name[32];
+  int       i, pos, lo, hi;
+
+  if (msa == NULL) return NULL;
+  for (i = 0; i < N; i++)
+    {
+      for (pos = 0; pos < L; pos++)
+	{
+	  if (i >= 10 && esl_rnd_Roll(r, 4)) msa->aseq[i][pos] = msa->aseq[i % 10][pos];        /* 10 families */
+	  else                               msa->aseq[i][pos] = abc->sym[esl_rnd_Roll(r, abc->K)];
+	}
+      if (esl_rnd_Roll(r, 5) == 0) {                                                            /* fragments */
+	lo = esl_rnd_Roll(r, L);
+	hi = lo + esl_rnd_Roll(r, L - lo);
+	for (pos = 0; pos < L; pos++) if (pos < lo || pos > hi) msa->aseq[i][pos] = '-';
+      }
+      msa->aseq[i][L] = '\0';
+      snprintf(name, 32, "seq%d", i);
+      esl_msa_SetSeqName(msa, i, name, -1);
+    }
+  msa->nseq = N;
+  return msa;
+}
+
+/* GSCParallel() must give exactly the same weights as GSC(),
+ * for any number of threads, in text and digital mode.
+ */
+static int
+utest_GSCParallel(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, int N, int L)
+{
+  char     *msg    = "GSCParallel unit test failure";
+  ESL_MSA  *msa    = family_msa(r, abc, N, L);
+  double   *wgt    = malloc(sizeof(double) * N);
+  int       ncpu, mode;
+
+  if (msa == NULL || wgt == NULL) esl_fatal(msg);
+  for (mode = 0; mode < 2; mode++)
+    {
+      if (mode == 1 && esl_msa_Digitize(abc, msa, NULL) != eslOK) esl_fatal(msg);
+      if (esl_msaweight_GSC(msa)                         != eslOK) esl_fatal(msg);
+      esl_vec_DCopy(msa->wgt, N, wgt);
+      for (ncpu = 1; ncpu <= 4; ncpu++)
+	{
+	  esl_vec_DSet(msa->wgt, N, 0.);
+	  if (esl_msaweight_GSCParallel(msa, ncpu)              != eslOK) esl_fatal(msg);
+	  if (memcmp(msa->wgt, wgt, sizeof(double) * N)          != 0)     esl_fatal(msg);
+	}
+    }
+
+  esl_msa_Destroy(msa);
+  free(wgt);
+  return eslOK;
+}
+
+/* utest_GSCReference()
+ * GSC weights of two fixed alignments, full of tied distances, must
+ * be exactly the ones the original (O(N^3) UPGMA) implementation
+ * gave, serial or threaded, in text or digital mode.
+ */
+static void
+utest_GSCReference(ESL_ALPHABET *nt_abc, ESL_ALPHABET *aa_abc)
+{
+  char   *msg = "GSC reference weights unit test failure";
+  char   *nt_sto =
+    "# STOCKHOLM 1.0\n\n"
+    "s0   GTTCTTG-CG-ATTAGTCAACC-TTTTA-G\n"
+    "s1   TTTCCTC--GC--TT-AAAAACATGTCCGT\n"
+    "s2   TTTCCT-GT-GAAGTCAAAACCATATCCGG\n"
+    "s3   TTTCCTCATGCAATTCAAAACCATGTACA-\n"
+    "s4   TTTCGCCATGC-ATTCA---C-GTGTCC-T\n"
+    "s5   AATGTAGGCGAAATAGTAA-CCATTATACG\n"
+    "s6   -T-TCCCATGCAATTTT-AGCC-TGTC-GT\n"
+    "s7   AATGTATGCGA-ATGGTAAACCATTTTACG\n"
+    "s8   TTTCCTC-TGCA-TTCAAAACCATGTCCGT\n"
+    "s9   ATTGAC-GCGAAATAGTTAACCA--TTGCG\n"
+    "s10  A-T-CAGTCG-AAGAGGAA-ATCCTTTATA\n"
+    "s11  AAT-TAC-CGA--TAGTAAACCATTTTACG\n"
+    "s12  AATGTAGGGGAGATAGTAAACCATATTACG\n"
+    "s13  GTTCCTCTTACAATTCAAAACCATGTCCCT\n"
+    "s14  TTGCGCCAT-CAATTCATA-CTTTGTCCGT\n"
+    "s15  A-GGTAGGCGAA--AGTAGACGAT--TACG\n"
+    "s16  AAAGTAGGCG--ATAGT-AACCATTTTAG-\n"
+    "s17  TTTCC-CATGCAATTCAA-ACCGTGTCCG-\n"
+    "s18  -TTCATCATGGAATGCT--ACCATGTCCGT\n"
+    "s19  TTTCCTCATGCAATCCA--ACCGTG-CCGT\n"
+    "s20  T-TCCTCATGCAATTCAAAACCA-TTCCGC\n"
+    "s21  TTT-CTCACGCAA-TCAGAACCGCGTT-GT\n"
+    "s22  TTTCCTCATTCAATTCAAAACCA-GTCCGT\n"
+    "s23  T-TCCTCATCCC-TTCCAAACCACGTCCGT\n"
+    "s24  AATGG-GGC-AACTAG-AAA-CATTTCATG\n"
+    "s25  AATGC-GGG-AAAAAG-AA-CAATTTTACG\n"
+    "s26  -TTT-TCATGCAAGTCAAAACCATGTCCGT\n"
+    "s27  TTTCCTCAT-CAACTCAAAACCAT-TCACT\n"
+    "s28  TTCTCTCAAGCATT-CAGAAC-AT-T-CAT\n"
+    "s29  AATGTAGG-GCAATAGTACAC--ATATGCG\n"
+    "s30  -T--CCCTTGTAATTCAAAACCA-G-C-GT\n"
+    "s31  TTTCC-CTT--TATTCAAAAC-GTGTCCGT\n"
+    "s32  T-TCCTCATGCCTTTTATAACCATGTCCGC\n"
+    "s33  AAT--AGGCGAA-TA-TTA-C---TTTACG\n"
+    "s34  TTGCCCCATG-A-TTCAAGACCATGTCCG-\n"
+    "s35  GTTCCTCATGCAAG-CA-AACGACGTG-GT\n"
+    "s36  TTTCC-C-TGCAATTCAAAACAATGTCCGA\n"
+    "s37  AATGTAGGCCAAATAGTAAACCATTCTA-G\n"
+    "s38  TATGTAGGCGAA-TAGTAAA--A-TATACG\n"
+    "s39  AATGGAGGCGAA-T-GTAGATCATTTTACG\n"
+    "//\n";
+  double  nt_wgt[40] = {  /* baseline esl_msaweight_GSC(), exactly */
+    0x1.b4b0a2c5895e8p+0, 0x1.9fcd44a363757p-2, 0x1.40eb0857c9bf4p+0,
+    0x1.3f7f1dd06bb49p-1, 0x1.e461ed241559ep-1, 0x1.2d1941262937ep-1,
+    0x1.8032e921b586bp+0, 0x1.30dbb80c12a54p-1, 0x1.9fcd44a363757p-2,
+    0x1.7933d3b08ad59p+0, 0x1.171b95c3f7ea9p+1, 0x1.30dbb80c12a54p-1,
+    0x1.7b55c62809dcp-1, 0x1.619f683182e1ap-1, 0x1.e461ed241559ep-1,
+    0x1.38ba6b3604125p+0, 0x1.03a982537ed72p+0, 0x1.3f7f1dd06bb49p-1,
+    0x1.4d356f0400914p+0, 0x1.d00cf62bb16b7p-1, 0x1.9426879c8b133p-1,
+    0x1.4d6b7625280c3p+0, 0x1.253fed0a231cdp-1, 0x1.12f6e999a5aaap+0,
+    0x1.0b79cb75e5ec2p+0, 0x1.5e011781117a3p+0, 0x1.bd2b312e4cc0ep-1,
+    0x1.f77d0ef441c06p-1, 0x1.a6b22ad73ae0cp+0, 0x1.6eb31db5cb408p+0,
+    0x1.031a76e91a929p+0, 0x1.e41466edcd7b9p-1, 0x1.12f6e999a5aaap+0,
+    0x1.9f6c8a237623p-1, 0x1.031a76e91a929p+0, 0x1.4d6b7625280c3p+0,
+    0x1.54cbdb88fb6b4p-1, 0x1.78dbe488f32d4p-1, 0x1.2d1941262937ep-1,
+    0x1.0b79cb75e5ec2p+0
+  };
+  char   *aa_sto =
+    "# STOCKHOLM 1.0\n\n"
+    "s0   SKTNFPYNSKRDIVAYFRNIMHCW-DTA-DACV-KKREQF\n"
+    "s1   -KTNFP-NS-RYKVA-FR-NMHMWHDTMPDACTIDMREQF\n"
+    "s2   SKANKP-NSKRYIVAYFRNGMHCFHDTMPDAN-IDQRE-F\n"
+    "s3   SNTNDPA-SKR--VAYF-NGNHCWHDM-PDA-TID-REQF\n"
+    "s4   SKTNFPANSIRSNVAYFRNGCHCWHDTMPDAC--DQRNQF\n"
+    "s5   SKTNFPG--KRYIVEYF-AGMHCWHDTMPDACTIDQREQF\n"
+    "s6   S-TNFPWNSKRYIVAYFRNGMHCWNETMPIQCTIDQREQ-\n"
+    "s7   MKTVFPANSWR-IVAYFRNGMH-W-DTMPDACTIDTK-QL\n"
+    "s8   S-I-FHANSKRYIVAY-RNGMHCWHLTMP-ACTIDCRE--\n"
+    "s9   SKHIFPANSKHYIVAYFYNGMHLSHDVMPDACTIDQRDQF\n"
+    "s10  -KTNFPANSKREIFFTF-NGM-CWHDTMPDACT-YQREQF\n"
+    "s11  SKTNFPANSM-YIVADFRNGMHIWHMTM--ECTI--REQF\n"
+    "s12  SKT-FP--S-RYIVAYF-NGMHVWHDTSPDA-RIDQSEQF\n"
+    "s13  SKTNFPANYTHYIVAYERLGVHCWGDMMEKACTIDQREQF\n"
+    "s14  SKTMFPANSKDY-VAYFRNGMGC-HDTMP-HCTID-DEMF\n"
+    "s15  SKMNQ--N-KRYIVFNFH-GDHCW-DTMFDACCIDQR-QF\n"
+    "s16  SSTNFQANSKRYIVAYFRNG-HCWFDTSPDA-TID-REQF\n"
+    "s17  SKVIFPANSKRYITAYFHNGEHCWHDTNPVACT--Q-EQF\n"
+    "s18  SKTWPPANSKRYSVAYF-NGMCCWHDTAPDACTNA-REQF\n"
+    "s19  SKTNFRANS-RYIVA-FRNGMHCIHDTMEDAQTIDQREQ-\n"
+    "s20  SKTNFPAFSKRY-VAYFRRG-HCWHVTMPDACTIDQREQF\n"
+    "s21  SKVNVPA-SKRWILAYFINGMHCW-DTMPDACTIRQREQS\n"
+    "s22  SKTNFPANSKRYIVAYFRNGMHKTH-TMSDACTIDARE-T\n"
+    "s23  AKTNFPANSK-RIVAYFRNGMHCWHDV-PDK-TIDPQEQF\n"
+    "s24  ST-NFPAYSK-YIVAYFRNGMHWNHDTIPDAKTDDQRMQF\n"
+    "s25  RKVNFPFN-KRYIVAYFR-GMRC-HDTMPLHCTIDQHEQF\n"
+    "s26  TKE-FPANSKRYI-AHF-NGMHCNHDTMSDACT-DQEEQF\n"
+    "s27  SKTNFPANSKRYI--YFWNGMHCWHDTMADN-TID-RWQF\n"
+    "s28  SLTNSPANLK--IVA-FRFGMHCWHDTM-DACG-CHR-Q-\n"
+    "s29  SKDN-PANSK-YIVAYFRNTMHTWPDKMPDLCTIDEREQF\n"
+    "//\n";
+  double  aa_wgt[30] = {  /* baseline esl_msaweight_GSC(), exactly */
+    0x1.39c944c775406p+0, 0x1.a75affdc849f4p-1, 0x1.c9f765a5261ecp-1,
+    0x1.9576a94b04eefp-1, 0x1.cd39f7278e47ep-1, 0x1.73ddc511440f6p-1,
+    0x1.b84404be59ecp-1, 0x1.1d664bc9d724ep+0, 0x1.b84404be59ecp-1,
+    0x1.0daa7e598e34cp+0, 0x1.0c7abf180168dp+0, 0x1.cfb77813ff241p-1,
+    0x1.c9f765a5261ecp-1, 0x1.4b3cb0c1953c8p+0, 0x1.16a114a6306b1p+0,
+    0x1.6a6b06fcce5c2p+0, 0x1.9576a94b04eefp-1, 0x1.0916e3cf031a8p+0,
+    0x1.0c7abf180168dp+0, 0x1.b6484484dbc78p-1, 0x1.73ddc511440f6p-1,
+    0x1.1b2c216ea70fp+0, 0x1.b6484484dbc78p-1, 0x1.13ba4988505b3p+0,
+    0x1.3940842acb32dp+0, 0x1.16a114a6306b1p+0, 0x1.0916e3cf031a8p+0,
+    0x1.e6dfeff443c8fp-1, 0x1.39c944c775406p+0, 0x1.13ba4988505b3p+0
+  };
+  ESL_ALPHABET *abc;
+  ESL_MSA      *msa;
+  double       *expect;
+  int           which, mode, ncpu;
+
+  for (which = 0; which < 2; which++)
+    {
+      abc    = (which == 0 ? nt_abc : aa_abc);
+      expect = (which == 0 ? nt_wgt : aa_wgt);
+      if ((msa = esl_msa_CreateFromString(which == 0 ? nt_sto : aa_sto, eslMSAFILE_STOCKHOLM)) == NULL) esl_fatal(msg);
+      for (mode = 0; mode < 2; mode++)
+	{
+	  if (mode == 1 && esl_msa_Digitize(abc, msa, NULL) != eslOK) esl_fatal(msg);
+	  for (ncpu = 0; ncpu <= 4; ncpu++)
+	    {
+	      esl_vec_DSet(msa->wgt, msa->nseq, 0.);
+	      if (ncpu == 0) { if (esl_msaweight_GSC(msa)               != eslOK) esl_fatal(msg); }
+	      else           { if (esl_msaweight_GSCParallel(msa, ncpu) != eslOK) esl_fatal(msg); }
+	      if (memcmp(msa->wgt, expect, sizeof(double) * msa->nseq) != 0) esl_fatal(msg);
+	    }
+	}
+      esl_msa_Destroy(msa);
+    }
+}
+
+/* PBParallel() must give exactly the weights of the textbook
+ * column-by-column calculation, for any number of threads, in text
+ * and digital mode.
+ */
+static int
+utest_PBParallel(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, int N, int L)
+{
+  char     *msg    = "PBParallel unit test failure";
+  ESL_MSA  *msa    = family_msa(r, abc, N, L);
+  double   *wgt    = malloc(sizeof(double) * N);
+  int      *nres   = malloc(sizeof(int) * abc->K);
+  int      *rlen   = malloc(sizeof(int) * N);
+  int       ntotal, x;
+  int       i, pos, ncpu;
+
+  if (msa == NULL || wgt == NULL || nres == NULL || rlen == NULL) esl_fatal(msg);
+  if (esl_msa_Digitize(abc, msa, NULL) != eslOK) esl_fatal(msg);
+
+  esl_vec_DSet(wgt,  N, 0.);
+  esl_vec_ISet(rlen, N, 0);
+  for (pos = 1; pos <= L; pos++)
+    {
+      esl_vec_ISet(nres, abc->K, 0);
+      for (i = 0; i < N; i++)
+	if (esl_abc_XIsCanonical(abc, msa->ax[i][pos])) { nres[msa->ax[i][pos]]++; rlen[i]++; }
+      for (ntotal = 0, x = 0; x < abc->K; x++) if (nres[x] > 0) ntotal++;
+      for (i = 0; i < N; i++)
+	if (esl_abc_XIsCanonical(abc, msa->ax[i][pos])) wgt[i] += 1. / (double) (ntotal * nres[msa->ax[i][pos]]);
+    }
+  for (i = 0; i < N; i++) if (rlen[i] > 0) wgt[i] /= (double) rlen[i];
+  esl_vec_DNorm (wgt, N);
+  esl_vec_DScale(wgt, N, (double) N);
+
+  for (ncpu = 1; ncpu <= 4; ncpu++)
+    {
+      esl_vec_DSet(msa->wgt, N, 0.);
+      if (esl_msaweight_PBParallel(msa, ncpu)               != eslOK) esl_fatal(msg);
+      if (memcmp(msa->wgt, wgt, sizeof(double) * N)          != 0)     esl_fatal(msg);
+    }
+
+  /* text mode counts letters; family_msa() only uses canonical letters and '-' */
+  if (esl_msa_Textize(msa)                                   != eslOK) esl_fatal(msg);
+  for (ncpu = 1; ncpu <= 4; ncpu++)
+    {
+      esl_vec_DSet(msa->wgt, N, 0.);
+      if (esl_msaweight_PBParallel(msa, ncpu)               != eslOK) esl_fatal(msg);
+      if (memcmp(msa->wgt, wgt, sizeof(double) * N)          != 0)     esl_fatal(msg);
+    }
+
+  esl_msa_Destroy(msa);
+  free(wgt);
+  free(nres);
+  free(rlen);
+  return eslOK;
+}
+
+/* IDFilterParallel() must keep exactly the seqs that the obvious
+ * serial algorithm keeps, for any number of threads. 
+ */
+static int
+utest_IDFilter(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, int N, int L, double maxid)
+{
+  char     *msg    = "IDFilter unit test failure";
+  ESL_MSA  *msa    = family_msa(r, abc, N, L);
+  ESL_MSA  *newmsa = NULL;
+  int      *keep   = malloc(sizeof(int) * N);
+  double    pid;
+  int       nkeep  = 0;
+  int       i, j;
+  int       ncpu, mode;
+
+  if (msa == NULL || keep == NULL) esl_fatal(msg);
+
+  /* the obvious serial algorithm */
+  for (i = 0; i < N; i++)
+    {
+      for (j = 0; j < nkeep; j++) {
+	esl_dst_CPairId(msa->aseq[i], msa->aseq[keep[j]], &pid, NULL, NULL);
+	if (pid > maxid) break;
+      }
+      if (j == nkeep) keep[nkeep++] = i;
+    }
+  if (nkeep == N || nkeep < 10) esl_fatal(msg);
+
+  for (mode = 0; mode < 2; mode++)
+    {
+      if (mode == 1 && esl_msa_Digitize(abc, msa, NULL) != eslOK) esl_fatal(msg);
+      for (ncpu = 1; ncpu <= 4; ncpu++)
+	{
+	  if (esl_msaweight_IDFilterParallel(msa, maxid, ncpu, &newmsa) != eslOK) esl_fatal(msg);
+	  if (newmsa->nseq != nkeep)                                               esl_fatal(msg);
+	  for (j = 0; j < nkeep; j++)
+	    if (strcmp(newmsa->sqname[j], msa->sqname[keep[j]]) != 0)             esl_fatal(msg);
+	  esl_msa_Destroy(newmsa);
+	}
+    }
+
+  esl_msa_Destroy(msa);
+  free(keep);
+  return eslOK;
+}
 #endif /*eslMSAWEIGHT_TESTDRIVE*/
 /*-------------------- end, unit tests  -------------------------*/
 
@@ -600,6 +1454,7 @@ utest_BLOSUM(ESL_ALPHABET *abc, ESL_MSA *msa, double maxid, double *expect)
 int
 main(int argc, char **argv)
 {
+  ESL_RANDOMNESS *r    = esl_randomness_Create(42);
   ESL_ALPHABET *aa_abc = NULL,
                *nt_abc = NULL;
   ESL_MSA      *msa1   = NULL,
@@ -675,6 +1530,16 @@ main(int argc, char **argv)
   utest_BLOSUM(aa_abc, msa4, 0.0,  uniform);
   utest_BLOSUM(aa_abc, msa4, 1.0,  uniform);
 
+  utest_GSCParallel(r, aa_abc, 300, 80);
+  utest_GSCParallel(r, nt_abc, 150, 64);
+  utest_GSCReference(nt_abc, aa_abc);
+
+  utest_PBParallel(r, aa_abc, 1000, 600);
+  utest_PBParallel(r, nt_abc,  300,  64);
+
+  utest_IDFilter(r, aa_abc, 3000, 80, 0.62);
+  utest_IDFilter(r, nt_abc,  500, 64, 0.8);
+
   esl_msa_Destroy(msa1);
   esl_msa_Destroy(msa2);
   esl_msa_Destroy(msa3);
@@ -682,6 +1547,7 @@ main(int argc, char **argv)
   esl_msa_Destroy(msa5);
   esl_alphabet_Destroy(aa_abc);
   esl_alphabet_Destroy(nt_abc);
+  esl_randomness_Destroy(r);
   exit(0);
 }
 #endif /*eslMSAWEIGHT_TESTDRIVE*/
@@ -720,7 +1586,7 @@ main(int argc, char **argv)
 #include "squidconf.h"
 #include "squid.h"
 
-#define WGROUP "--blosum,--gsc,--pb"
+#define WGROUP "--blosum,--gsc,--pb,--idf"
 
 static ESL_OPTIONS options[] = {
     /* name     type         deflt   env   rng   togs    req      incmpt   help                          docgrp */
@@ -775,6 +1641,8 @@ main(int argc, char **argv)
   do_blosum = esl_opt_GetBoolean(go, "--blosum");
   do_gsc    = esl_opt_GetBoolean(go, "--gsc");
   do_pb     = esl_opt_GetBoolean(go, "--pb");
+  do_idf    = esl_opt_GetBoolean(go, "--idf");
+  ncpu      = esl_opt_GetInteger(go, "--cpu");
   maxid     = esl_opt_GetReal   (go, "--id");
   tol       = esl_opt_GetReal   (go, "--tol");
   maxN      = esl_opt_GetInteger(go, "--maxN");
@@ -862,8 +1730,11 @@ main(int argc, char **argv)
  *
  * Script for benchmarks on Pfam:
  *     ./benchmark --gsc --maxN 4000 /misc/data0/databases/Pfam/Pfam-A.full
+ *     ./benchmark --gsc --cpu 8     /misc/data0/databases/Pfam/Pfam-A.full
  *     ./benchmark --blosum          /misc/data0/databases/Pfam/Pfam-A.full
  *     ./benchmark --pb              /misc/data0/databases/Pfam/Pfam-A.full
+ *     ./benchmark --pb --cpu 8      /misc/data0/databases/Pfam/Pfam-A.full
+ *     ./benchmark --idf --cpu 8     /misc/data0/databases/Pfam/Pfam-A.full
  */
 #include "easel.h"
 #include "esl_getopts.h"
@@ -873,7 +1744,7 @@ main(int argc, char **argv)
 #include "esl_vectorops.h"
 #include "esl_stopwatch.h"
 
-#define WGROUP "--blosum,--gsc,--pb"
+#define WGROUP "--blosum,--gsc,--pb,--idf"
 
 static ESL_OPTIONS options[] = {
     /* name     type         deflt   env   rng   togs    req      incmpt   help                          docgrp */
@@ -881,7 +1752,9 @@ static ESL_OPTIONS options[] = {
   { "--blosum", eslARG_NONE, FALSE,  NULL, NULL, WGROUP, NULL,      NULL, "use BLOSUM weights",              0 },
   { "--gsc",    eslARG_NONE,"default",NULL,NULL, WGROUP, NULL,      NULL, "use GSC weights",                 0 },
   { "--pb",     eslARG_NONE, FALSE,  NULL, NULL, WGROUP, NULL,      NULL, "use position-based weights",      0 },
-  { "--id",     eslARG_REAL, "0.62", NULL,"0<=x<=1",NULL,"--blosum",NULL, "id threshold for --blosum",       0 },  
+  { "--idf",    eslARG_NONE, FALSE,  NULL, NULL, WGROUP, NULL,      NULL, "use %id filtering (IDFilter)",    0 },
+  { "--id",     eslARG_REAL, "0.62", NULL,"0<=x<=1",NULL,  NULL,    NULL, "id threshold for --blosum, --idf",0 },  
+  { "--cpu",    eslARG_INT,    "1",  NULL,"n>0",  NULL,  NULL,      NULL, "number of threads for --gsc, --pb, --idf", 0 },
   { "--maxN",   eslARG_INT,    "0",  NULL,"n>=0",  NULL,  NULL,     NULL, "skip alignments w/ > <n> seqs",   0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
@@ -899,6 +1772,9 @@ main(int argc, char **argv)
   int            do_gsc;
   int            do_pb;
   int            do_blosum;
+  int            do_idf;
+  int            ncpu;
+  ESL_MSA       *newmsa;
   int            maxN;
   double         maxid;
   double         cpu;
@@ -918,6 +1794,8 @@ main(int argc, char **argv)
   do_blosum = esl_opt_GetBoolean(go, "--blosum");
   do_gsc    = esl_opt_GetBoolean(go, "--gsc");
   do_pb     = esl_opt_GetBoolean(go, "--pb");
+  do_idf    = esl_opt_GetBoolean(go, "--idf");
+  ncpu      = esl_opt_GetInteger(go, "--cpu");
   maxid     = esl_opt_GetReal   (go, "--id");
   maxN      = esl_opt_GetInteger(go, "--maxN");
   if (esl_opt_ArgNumber(go) != 1) {
@@ -942,9 +1820,10 @@ main(int argc, char **argv)
 
       esl_stopwatch_Start(w);
 
-      if      (do_gsc) 	  esl_msaweight_GSC(msa);
-      else if (do_pb) 	  esl_msaweight_PB(msa);
+      if      (do_gsc) 	  esl_msaweight_GSCParallel(msa, ncpu);
+      else if (do_pb) 	  esl_msaweight_PBParallel(msa, ncpu);
       else if (do_blosum) esl_msaweight_BLOSUM(msa, maxid);
+      else if (do_idf)    { esl_msaweight_IDFilterParallel(msa, maxid, ncpu, &newmsa); esl_msa_Destroy(newmsa); }
 
       esl_stopwatch_Stop(w);
       cpu = w->user;
@@ -981,7 +1860,7 @@ main(int argc, char **argv)
 #include "esl_msaweight.h"
 #include "esl_vectorops.h"
 
-#define WGROUP "--blosum,--gsc,--pb"
+#define WGROUP "--blosum,--gsc,--pb,--idf"
 
 static ESL_OPTIONS options[] = {
     /* name     type         deflt   env   rng   togs    req      incmpt   help                          docgrp */
@@ -989,7 +1868,9 @@ static ESL_OPTIONS options[] = {
   { "--blosum", eslARG_NONE, FALSE,  NULL, NULL, WGROUP, NULL,      NULL, "use BLOSUM weights",              0 },
   { "--gsc",    eslARG_NONE,"default",NULL,NULL, WGROUP, NULL,      NULL, "use GSC weights",                 0 },
   { "--pb",     eslARG_NONE, FALSE,  NULL, NULL, WGROUP, NULL,      NULL, "use position-based weights",      0 },
-  { "--id",     eslARG_REAL, "0.62", NULL,"0<=x<=1",NULL,"--blosum",NULL, "id threshold for --blosum",       0 },  
+  { "--idf",    eslARG_NONE, FALSE,  NULL, NULL, WGROUP, NULL,      NULL, "use %id filtering (IDFilter)",    0 },
+  { "--id",     eslARG_REAL, "0.62", NULL,"0<=x<=1",NULL,  NULL,    NULL, "id threshold for --blosum, --idf",0 },  
+  { "--cpu",    eslARG_INT,    "1",  NULL,"n>0",  NULL,  "--idf",   NULL, "number of threads for --idf",     0 },
   { "--maxN",   eslARG_INT,    "0",  NULL,"n>=0",  NULL,  NULL,     NULL, "skip alignments w/ > <n> seqs",   0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
@@ -1025,6 +1906,8 @@ main(int argc, char **argv)
   do_blosum = esl_opt_GetBoolean(go, "--blosum");
   do_gsc    = esl_opt_GetBoolean(go, "--gsc");
   do_pb     = esl_opt_GetBoolean(go, "--pb");
+  do_idf    = esl_opt_GetBoolean(go, "--idf");
+  ncpu      = esl_opt_GetInteger(go, "--cpu");
   maxid     = esl_opt_GetReal   (go, "--id");
   maxN      = esl_opt_GetInteger(go, "--maxN");
   if (esl_opt_ArgNumber(go) != 1) {
@@ -1048,6 +1931,7 @@ main(int argc, char **argv)
       if      (do_gsc) 	  esl_msaweight_GSC(msa);
       else if (do_pb) 	  esl_msaweight_PB(msa);
       else if (do_blosum) esl_msaweight_BLOSUM(msa, maxid);
+      else if (do_idf)    { esl_msaweight_IDFilterParallel(msa, maxid, ncpu, &newmsa); esl_msa_Destroy(newmsa); }
 
       for (nsmall = 0, nbig = 0, i = 0; i < msa->nseq; i++) {
 	if (msa->wgt[i] < 0.2) nsmall++;
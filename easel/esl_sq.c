@@ -35,6 +35,10 @@ static ESL_SQ *sq_create(int do_digital);
 static ESL_SQ *sq_create_from(const char *name, const char *desc, const char *acc);
 
 static ESL_SQ_BLOCK *sq_createblock(int count, int do_digital);
+static ESL_SQ_BLOCK *sq_createarenablock(int count, int do_digital, int64_t arena_size);
+static int           sq_arena_grow(ESL_SQ_BLOCK *block, int64_t need);
+static int           sq_arena_take(ESL_SQ_BLOCK *block, int64_t nname, int64_t nacc, int64_t ndesc, int64_t nsrc,
+				   int64_t nres, int do_ss, ESL_SQ **ret_sq);
 
 static int  sq_init(ESL_SQ *sq, int do_digital);
 static void sq_free(ESL_SQ *sq);
@@ -578,16 +582,207 @@ esl_sq_DestroyBlock(ESL_SQ_BLOCK *block)
 
   if (block == NULL) return;
 
-  for (i = 0; i < block->listSize; ++i)
+  if (block->arena != NULL)
+    {	/* sequences are views into the arena; they own nothing */
+      if (block->arena->mem   != NULL) free(block->arena->mem);
+      if (block->arena->tmpsq != NULL) esl_sq_Destroy(block->arena->tmpsq);
+      free(block->arena);
+    }
+  else if (block->list != NULL)
     {
-      sq_free(block->list + i);
+      for (i = 0; i < block->listSize; ++i)
+	sq_free(block->list + i);
     }
 
-  free(block->list);
+  if (block->list != NULL) free(block->list);
   free(block);
   return;
 }
 
+/* Function:  esl_sq_CreateArenaBlock()
+ * Synopsis:  Create a new block of <ESL_SQ> stored in one arena.
+ *
+ * Purpose:   Creates an empty block for up to <count> text sequences
+ *            whose names, accessions, descriptions, sources, residues
+ *            and ss annotation are packed one sequence after another
+ *            in a single allocation (an arena) of initially
+ *            <arena_size> bytes, rather than each <ESL_SQ> owning
+ *            buffers of its own. A block's residues are therefore
+ *            contiguous in memory, in order.
+ *
+ *            Sequences are added with <esl_sq_BlockAppend()> or
+ *            <esl_sq_BlockReserve()>, or read by
+ *            <esl_sqio_ReadBlock()>. <esl_sq_ReuseBlock()> empties the
+ *            block in constant time. The arena doubles when it must,
+ *            so once a block has held its largest load, refilling it
+ *            allocates nothing; recycle blocks (through an
+ *            <ESL_WORK_QUEUE> between a reader and its workers, for
+ *            example) rather than creating new ones.
+ *
+ *            The sequences in an arena block are views into the
+ *            arena. Their residues may be changed in place, but
+ *            nothing in them may be reallocated or freed: don't set
+ *            their strings, grow, <Reuse()>, <Digitize()>,
+ *            <Textize()>, <ReverseComplement()> or <Destroy()> them.
+ *            <esl_sq_Copy()> one out to do any of that. Extra residue
+ *            markups (<xr>) aren't stored in an arena.
+ *
+ * Returns:   a pointer to the new <ESL_SQ_BLOCK>. Caller frees this
+ *            with <esl_sq_DestroyBlock()>.
+ *
+ * Throws:    <NULL> if allocation fails.
+ */
+ESL_SQ_BLOCK *
+esl_sq_CreateArenaBlock(int count, int64_t arena_size)
+{
+  ESL_SQ_BLOCK *block;
+
+  if ((block = sq_createarenablock(count, FALSE, arena_size)) == NULL) return NULL;
+  if ((block->arena->tmpsq = esl_sq_Create())                 == NULL) { esl_sq_DestroyBlock(block); return NULL; }
+  return block;
+}
+
+/* Function:  esl_sq_ReuseBlock()
+ * Synopsis:  Empty a block so it can be refilled.
+ *
+ * Purpose:   Empty block <block>. For an arena block, the arena is
+ *            simply rewound; otherwise each of the block's sequences
+ *            is reinitialized with <esl_sq_Reuse()>.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+esl_sq_ReuseBlock(ESL_SQ_BLOCK *block)
+{
+  int i;
+
+  if (block->arena != NULL) block->arena->n = 0;
+  else
+    {
+      for (i = 0; i < block->listSize; ++i)
+	esl_sq_Reuse(block->list + i);
+    }
+  block->count = 0;
+  return eslOK;
+}
+
+/* Function:  esl_sq_BlockAppend()
+ * Synopsis:  Add a copy of a sequence to the end of a block.
+ *
+ * Purpose:   Copy sequence <sq> into the next free slot of block
+ *            <block>, and count it. In an arena block, <sq> is packed
+ *            into the arena, and must be in the block's mode (text or
+ *            digital); in an ordinary block, it's copied with
+ *            <esl_sq_Copy()>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if the block is full.
+ *            <eslEINCOMPAT> if <sq> and an arena block differ in mode.
+ *            <eslEMEM> on allocation failure.
+ */
+int
+esl_sq_BlockAppend(ESL_SQ_BLOCK *block, const ESL_SQ *sq)
+{
+  ESL_SQ  *dst;
+  int64_t  ns;
+  int      status;
+
+  if (block->count == block->listSize) ESL_EXCEPTION(eslEINVAL, "block is full");
+
+  if (block->arena == NULL)
+    {
+      dst = block->list + block->count;
+      if ((status = esl_sq_Copy(sq, dst)) != eslOK) return status;
+      dst->tax_id = sq->tax_id;
+      dst->idx    = sq->idx;
+      block->count++;
+      return eslOK;
+    }
+
+  if ((sq->dsq != NULL) != block->arena->do_digital) ESL_EXCEPTION(eslEINCOMPAT, "sequence and arena block differ in text/digital mode");
+
+  status = sq_arena_take(block, strlen(sq->name)+1, strlen(sq->acc)+1, strlen(sq->desc)+1, strlen(sq->source)+1,
+			 sq->n, (sq->ss != NULL), &dst);
+  if (status != eslOK) return status;
+
+  strcpy(dst->name,   sq->name);
+  strcpy(dst->acc,    sq->acc);
+  strcpy(dst->desc,   sq->desc);
+  strcpy(dst->source, sq->source);
+
+  ns = dst->salloc;
+  if (sq->dsq != NULL)
+    {
+      memcpy(dst->dsq, sq->dsq, sizeof(ESL_DSQ) * ns);
+      dst->dsq[0] = dst->dsq[sq->n+1] = eslDSQ_SENTINEL;
+    }
+  else
+    {
+      memcpy(dst->seq, sq->seq, sizeof(char) * sq->n);
+      dst->seq[sq->n] = '\0';
+    }
+  if (sq->ss != NULL)
+    {
+      memcpy(dst->ss, sq->ss, sizeof(char) * ns);
+      dst->ss[ns-1] = '\0';
+    }
+
+  dst->tax_id = sq->tax_id;
+  dst->n      = sq->n;
+  dst->start  = sq->start;
+  dst->end    = sq->end;
+  dst->C      = sq->C;
+  dst->W      = sq->W;
+  dst->L      = sq->L;
+  dst->idx    = sq->idx;
+  dst->roff   = sq->roff;
+  dst->hoff   = sq->hoff;
+  dst->doff   = sq->doff;
+  dst->eoff   = sq->eoff;
+  return eslOK;
+}
+
+/* Function:  esl_sq_BlockReserve()
+ * Synopsis:  Take the next sequence of an arena block, to be filled in place.
+ *
+ * Purpose:   Take the next free sequence of arena block <block>, and
+ *            count it. Its name is set to <name[0..nlen-1]> and its
+ *            description to <desc[0..dlen-1]> (neither needs to be
+ *            NUL-terminated); accession and source are empty; and it
+ *            has room for <nres> residues, but holds none yet
+ *            (<n=0>). The caller stores the residues directly, in
+ *            <seq[0..nres-1]> or <dsq[1..nres]>, terminates them, and
+ *            sets <n> and the coords.
+ *
+ *            The sequence is returned in <*ret_sq>. It stays where it
+ *            is until the next <esl_sq_BlockReserve()> or
+ *            <esl_sq_BlockAppend()> on <block>, which may move the
+ *            arena.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <block> isn't an arena block, or is full.
+ *            <eslEMEM> on allocation failure.
+ *            In either case <*ret_sq> is <NULL>.
+ */
+int
+esl_sq_BlockReserve(ESL_SQ_BLOCK *block, const char *name, int64_t nlen, const char *desc, int64_t dlen,
+		    int64_t nres, ESL_SQ **ret_sq)
+{
+  ESL_SQ *sq = NULL;
+  int     status;
+
+  *ret_sq = NULL;
+  if (block->arena == NULL) ESL_EXCEPTION(eslEINVAL, "not an arena block");
+  if ((status = sq_arena_take(block, nlen+1, 1, dlen+1, 1, nres, FALSE, &sq)) != eslOK) return status;
+
+  memcpy(sq->name, name, sizeof(char) * nlen);  sq->name[nlen] = '\0';
+  memcpy(sq->desc, desc, sizeof(char) * dlen);  sq->desc[dlen] = '\0';
+  *ret_sq = sq;
+  return eslOK;
+}
+
 #ifdef eslAUGMENT_ALPHABET
 
 /* Function:  esl_sq_CreateDigitalBlock()
@@ -622,6 +817,31 @@ esl_sq_CreateDigitalBlock(int count, const ESL_ALPHABET *abc)
   return block;
 }
 
+/* Function:  esl_sq_CreateDigitalArenaBlock()
+ * Synopsis:  Create a new block of digital <ESL_SQ> stored in one arena.
+ *
+ * Purpose:   Same as <esl_sq_CreateArenaBlock()>, except the block
+ *            holds digital sequences in alphabet <abc>.
+ *
+ * Returns:   a pointer to the new <ESL_SQ_BLOCK>. Caller frees this with
+ *            <esl_sq_DestroyBlock()>.
+ *
+ * Throws:    <NULL> if an allocation fails.
+ */
+ESL_SQ_BLOCK *
+esl_sq_CreateDigitalArenaBlock(int count, const ESL_ALPHABET *abc, int64_t arena_size)
+{
+  int i;
+  ESL_SQ_BLOCK *block;
+
+  if ((block = sq_createarenablock(count, TRUE, arena_size)) == NULL) return NULL;
+  if ((block->arena->tmpsq = esl_sq_CreateDigital(abc))      == NULL) { esl_sq_DestroyBlock(block); return NULL; }
+
+  for (i = 0; i < count; ++i)
+    block->list[i].abc = abc;
+  return block;
+}
+
 #endif /* eslAUGMENT_ALPHABET */
 
 /*--------------- end of ESL_SQ object functions ----------------*/
@@ -1975,6 +2195,8 @@ sq_createblock(int count, int do_digital)
   block->first_seqidx = -1;
   block->list  = NULL;
   block->complete = TRUE;
+  block->arena = NULL;
+  block->listSize = 0;
 
   ESL_ALLOC(block->list, sizeof(ESL_SQ) * count);
   block->listSize = count;
@@ -1991,6 +2213,141 @@ sq_createblock(int count, int do_digital)
   return NULL;
 }  
 
+/* Create an arena <ESL_SQ_BLOCK>. Its sequences are empty views,
+ * pointed into the arena by sq_arena_take() as they're filled.
+ */
+static ESL_SQ_BLOCK *
+sq_createarenablock(int count, int do_digital, int64_t arena_size)
+{
+  ESL_SQ_BLOCK *block = NULL;
+  ESL_SQ       *sq;
+  int           i;
+  int           status;
+
+  ESL_ALLOC(block, sizeof(ESL_SQ_BLOCK));
+  block->count        = 0;
+  block->listSize     = 0;
+  block->complete     = TRUE;
+  block->first_seqidx = -1;
+  block->list         = NULL;
+  block->arena        = NULL;
+
+  ESL_ALLOC(block->arena, sizeof(ESL_SQ_ARENA));
+  block->arena->mem        = NULL;
+  block->arena->n          = 0;
+  block->arena->nalloc     = ESL_MAX(arena_size, 1);
+  block->arena->do_digital = do_digital;
+  block->arena->tmpsq      = NULL;
+  ESL_ALLOC(block->arena->mem, sizeof(char) * block->arena->nalloc);
+
+  ESL_ALLOC(block->list, sizeof(ESL_SQ) * count);
+  block->listSize = count;
+  for (i = 0; i < count; ++i)
+    {
+      sq = block->list + i;
+      sq->name   = sq->acc = sq->desc = sq->source = sq->seq = sq->ss = NULL;
+      sq->dsq    = NULL;
+      sq->nalloc = sq->aalloc = sq->dalloc = sq->srcalloc = 0;
+      sq->salloc = 0;
+      sq->n      = 0;
+      sq->nxr    = 0;
+      sq->xr_tag = NULL;
+      sq->xr     = NULL;
+      sq->abc    = NULL;
+    }
+  return block;
+
+ ERROR:
+  esl_sq_DestroyBlock(block);
+  return NULL;
+}
+
+/* sq_arena_grow()
+ * Make room for <need> more bytes in the arena of <block>. If the
+ * arena has to move, the block's sequences are moved with it.
+ */
+static int
+sq_arena_grow(ESL_SQ_BLOCK *block, int64_t need)
+{
+  ESL_SQ_ARENA *a   = block->arena;
+  char         *mem = NULL;
+  ESL_SQ       *sq;
+  int64_t       nalloc;
+  int           i;
+  int           status;
+
+  if (a->n + need <= a->nalloc) return eslOK;
+
+  nalloc = ESL_MAX(a->nalloc * 2, a->n + need);
+  ESL_ALLOC(mem, sizeof(char) * nalloc);
+  if (a->n > 0) memcpy(mem, a->mem, a->n);
+
+  for (i = 0; i < block->count; ++i)
+    {
+      sq = block->list + i;
+      sq->name   = mem + (sq->name   - a->mem);
+      sq->acc    = mem + (sq->acc    - a->mem);
+      sq->desc   = mem + (sq->desc   - a->mem);
+      sq->source = mem + (sq->source - a->mem);
+      if (sq->seq != NULL) sq->seq = mem + (sq->seq - a->mem);
+      if (sq->dsq != NULL) sq->dsq = (ESL_DSQ *) (mem + ((char *) sq->dsq - a->mem));
+      if (sq->ss  != NULL) sq->ss  = mem + (sq->ss  - a->mem);
+    }
+
+  free(a->mem);
+  a->mem    = mem;
+  a->nalloc = nalloc;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* sq_arena_take()
+ * Carve the next sequence of arena block <block> out of the arena:
+ * strings of <nname>, <nacc>, <ndesc>, <nsrc> bytes (each counting
+ * its \0), room for <nres> residues, and an ss line of the same size
+ * if <do_ss>. The strings are empty and coords are reset, as by
+ * esl_sq_Reuse(). Count it in the block, and return it in <*ret_sq>.
+ */
+static int
+sq_arena_take(ESL_SQ_BLOCK *block, int64_t nname, int64_t nacc, int64_t ndesc, int64_t nsrc,
+	      int64_t nres, int do_ss, ESL_SQ **ret_sq)
+{
+  ESL_SQ_ARENA *a  = block->arena;
+  int64_t       ns = (a->do_digital ? nres+2 : nres+1); /* dsq[0..n+1] with sentinels; or seq[0..n-1] and \0 */
+  ESL_SQ       *sq;
+  char         *p;
+  int           status;
+
+  if (block->count == block->listSize) ESL_EXCEPTION(eslEINVAL, "arena block is full");
+  if ((status = sq_arena_grow(block, nname + nacc + ndesc + nsrc + (do_ss ? 2*ns : ns))) != eslOK) return status;
+
+  sq = block->list + block->count;
+  p  = a->mem + a->n;
+  sq->name   = p;  p += nname;
+  sq->acc    = p;  p += nacc;
+  sq->desc   = p;  p += ndesc;
+  sq->source = p;  p += nsrc;
+  if (a->do_digital) { sq->dsq = (ESL_DSQ *) p; sq->seq = NULL; }
+  else               { sq->seq = p;             sq->dsq = NULL; }
+  p += ns;
+  if (do_ss) { sq->ss = p; p += ns; }
+  else         sq->ss = NULL;
+  a->n = p - a->mem;
+
+  sq->nalloc   = nname;
+  sq->aalloc   = nacc;
+  sq->dalloc   = ndesc;
+  sq->srcalloc = nsrc;
+  sq->salloc   = ns;
+  esl_sq_Reuse(sq);
+
+  block->count++;
+  *ret_sq = sq;
+  return eslOK;
+}
+
 /* Initialize <ESL_SQ> object */
 static int
 sq_init(ESL_SQ *sq, int do_digital)
@@ -2477,6 +2834,114 @@ ERROR:
 }
 
 
+/* utest_ArenaBlock()
+ * Fill arena blocks (text, then digital) from an arena too small to
+ * start with, so it has to move; check the packed sequences against
+ * their originals, and that they are contiguous. Then empty the
+ * block and refill it in place with esl_sq_BlockReserve().
+ */
+static void
+utest_ArenaBlock(ESL_RANDOMNESS *r)
+{
+  char         *msg  = "failure in utest_ArenaBlock()";
+  int           nseq = 8;
+  ESL_SQ      **sq   = NULL;
+  ESL_SQ_BLOCK *block = NULL;
+  ESL_SQ       *rsq  = NULL;
+  char          seq[64];
+  char          ss[64];
+  char          name[32];
+  int           i, j, n;
+  int           status;
+#ifdef eslAUGMENT_ALPHABET
+  ESL_ALPHABET *abc  = NULL;
+  ESL_SQ       *dsq  = NULL;
+#endif
+
+  ESL_ALLOC(sq, sizeof(ESL_SQ *) * nseq);
+  for (i = 0; i < nseq; i++)
+    {
+      n = esl_rnd_Roll(r, 60);
+      for (j = 0; j < n; j++) { seq[j] = "ACGT"[esl_rnd_Roll(r, 4)]; ss[j] = ".<>"[esl_rnd_Roll(r, 3)]; }
+      seq[n] = ss[n] = '\0';
+      snprintf(name, 32, "seq%d", i);
+      if ((sq[i] = esl_sq_CreateFrom(name, seq, (i%2 ? "a description" : NULL), (i%3 ? NULL : "XX0001"), (i%2 ? NULL : ss))) == NULL) esl_fatal(msg);
+      sq[i]->idx = i;
+    }
+
+  /* text */
+  if ((block = esl_sq_CreateArenaBlock(nseq, 16)) == NULL) esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    if (esl_sq_BlockAppend(block, sq[i]) != eslOK) esl_fatal(msg);
+  if (block->count != nseq) esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    {
+      if (esl_sq_Compare(block->list+i, sq[i]) != eslOK) esl_fatal(msg);
+      if (block->list[i].idx != i)                      esl_fatal(msg);
+      if (i > 0 && block->list[i].name <= block->list[i-1].seq) esl_fatal(msg);
+    }
+  if (block->list[0].name != block->arena->mem) esl_fatal(msg);
+  if ((rsq = esl_sq_Create())                    == NULL)  esl_fatal(msg); /* copying one out */
+  if (esl_sq_Copy(block->list+nseq-1, rsq)       != eslOK) esl_fatal(msg);
+  if (esl_sq_Compare(block->list+nseq-1, rsq)    != eslOK) esl_fatal(msg);
+  esl_sq_Destroy(rsq);
+
+  /* empty it, and refill it in place */
+  esl_sq_ReuseBlock(block);
+  if (block->count != 0 || block->arena->n != 0) esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    {
+      if (esl_sq_BlockReserve(block, sq[i]->name, strlen(sq[i]->name), sq[i]->desc, strlen(sq[i]->desc), sq[i]->n, &rsq) != eslOK) esl_fatal(msg);
+      memcpy(rsq->seq, sq[i]->seq, sq[i]->n);
+      rsq->seq[sq[i]->n] = '\0';
+      rsq->n = sq[i]->n;
+      esl_sq_SetCoordComplete(rsq, rsq->n);
+    }
+  for (i = 0; i < nseq; i++)
+    {
+      if (strcmp(block->list[i].name, sq[i]->name) != 0) esl_fatal(msg);
+      if (strcmp(block->list[i].desc, sq[i]->desc) != 0) esl_fatal(msg);
+      if (strcmp(block->list[i].seq,  sq[i]->seq)  != 0) esl_fatal(msg);
+      if (block->list[i].L != sq[i]->n)                  esl_fatal(msg);
+    }
+  esl_exception_SetHandler(&esl_nonfatal_handler);
+  if (esl_sq_BlockAppend(block, sq[0]) != eslEINVAL) esl_fatal(msg); /* full */
+  esl_exception_ResetDefaultHandler();
+  esl_sq_DestroyBlock(block);  block = NULL;
+
+#ifdef eslAUGMENT_ALPHABET
+  /* digital */
+  if ((abc   = esl_alphabet_Create(eslDNA))                   == NULL) esl_fatal(msg);
+  if ((block = esl_sq_CreateDigitalArenaBlock(nseq, abc, 16)) == NULL) esl_fatal(msg);
+  esl_exception_SetHandler(&esl_nonfatal_handler);
+  if (esl_sq_BlockAppend(block, sq[0]) != eslEINCOMPAT) esl_fatal(msg);
+  esl_exception_ResetDefaultHandler();
+  for (i = 0; i < nseq; i++)
+    {
+      if ((dsq = esl_sq_CreateDigital(abc))  == NULL)  esl_fatal(msg);
+      if (esl_sq_Copy(sq[i], dsq)            != eslOK) esl_fatal(msg);
+      if (esl_sq_BlockAppend(block, dsq)     != eslOK) esl_fatal(msg);
+      if (esl_sq_Compare(block->list+i, dsq) != eslOK) esl_fatal(msg);
+      esl_sq_Destroy(dsq);
+    }
+  for (i = 0; i < nseq; i++)
+    {
+      if (block->list[i].abc != abc)                                   esl_fatal(msg);
+      if (block->list[i].dsq[0]                 != eslDSQ_SENTINEL)    esl_fatal(msg);
+      if (block->list[i].dsq[sq[i]->n+1]        != eslDSQ_SENTINEL)    esl_fatal(msg);
+    }
+  esl_sq_DestroyBlock(block);
+  esl_alphabet_Destroy(abc);
+#endif
+
+  for (i = 0; i < nseq; i++) esl_sq_Destroy(sq[i]);
+  free(sq);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+
 #endif /* eslSQ_TESTDRIVE*/
 /*--------------------- end, unit tests -------------------------*/
 
@@ -2526,6 +2991,7 @@ main(int argc, char **argv)
 #endif
 
   utest_ExtraResMarkups();
+  utest_ArenaBlock(r);
 
   esl_randomness_Destroy(r);
   esl_getopts_Destroy(go);
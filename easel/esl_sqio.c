@@ -55,6 +55,7 @@ static int convert_sq_to_msa(ESL_SQ *sq, ESL_MSA **ret_msa);
  *****************************************************************/ 
 
 static int  sqfile_open(const char *filename, int format, const char *env, ESL_SQFILE **ret_sqfp);
+static int  sqio_read_arena_block(ESL_SQFILE *sqfp, ESL_SQ_BLOCK *sqBlock, int max_sequences);
 
 /* Function:  esl_sqfile_Open()
  * Synopsis:  Open a sequence file for reading.
@@ -205,6 +206,7 @@ sqfile_open(const char *filename, int format, const char *env, ESL_SQFILE **ret_
   sqfp->fetch             = NULL;
   sqfp->fetch_info        = NULL;
   sqfp->fetch_subseq      = NULL;
+  sqfp->fetch_batch       = NULL;
 #endif
 
   sqfp->get_error         = NULL;
@@ -1024,6 +1026,13 @@ esl_sqio_ReadWindow(ESL_SQFILE *sqfp, int C, int W, ESL_SQ *sq)
  * Purpose:   Reads a block of sequences from open sequence file <sqfp> into 
  *            <sqBlock>.
  *
+ *            If <sqBlock> is an arena block (see
+ *            <esl_sq_CreateArenaBlock()>), each sequence is read into
+ *            the arena's scratch sequence and packed into the block
+ *            with <esl_sq_BlockAppend()>, so a recycled block's
+ *            sequences need no allocation of their own. Arena blocks
+ *            can't be read as <long_target> windows.
+ *
  * Returns:   <eslOK> on success; the new sequence is stored in <sqBlock>.
  * 
  *            Returns <eslEOF> when there is no sequence left in the
@@ -1035,14 +1044,51 @@ esl_sqio_ReadWindow(ESL_SQFILE *sqfp, int C, int W, ESL_SQ *sq)
  *            error message is placed in <sqfp->errbuf>. 
  *
  * Throws:    <eslEMEM> on allocation failure;
+ *            <eslEINVAL> if <long_target> is set for an arena block;
  *            <eslEINCONCEIVABLE> on internal error.
  */
 int
 esl_sqio_ReadBlock(ESL_SQFILE *sqfp, ESL_SQ_BLOCK *sqBlock, int max_residues, int max_sequences, int long_target)
 {
+  if (sqBlock->arena != NULL)
+    {
+      if (long_target) ESL_EXCEPTION(eslEINVAL, "arena blocks can't hold long_target windows");
+      return sqio_read_arena_block(sqfp, sqBlock, max_sequences);
+    }
   return sqfp->read_block(sqfp, sqBlock, max_residues, max_sequences, long_target);
 }
 
+/* sqio_read_arena_block()
+ * esl_sqio_ReadBlock() for an arena block: read whole sequences one
+ * at a time into the arena's scratch sq, and pack each into the
+ * block, until the block holds <max_sequences> or about
+ * MAX_RESIDUE_COUNT residues, as the format-specific readers do.
+ */
+static int
+sqio_read_arena_block(ESL_SQFILE *sqfp, ESL_SQ_BLOCK *sqBlock, int max_sequences)
+{
+  ESL_SQ  *tmpsq = sqBlock->arena->tmpsq;
+  int64_t  size  = 0;
+  int      status = eslOK;
+
+  esl_sq_ReuseBlock(sqBlock);
+  if (max_sequences < 1 || max_sequences > sqBlock->listSize)
+    max_sequences = sqBlock->listSize;
+
+  while (sqBlock->count < max_sequences && size < MAX_RESIDUE_COUNT)
+    {
+      esl_sq_Reuse(tmpsq);
+      if ((status = esl_sqio_Read(sqfp, tmpsq))         != eslOK) break;
+      if ((status = esl_sq_BlockAppend(sqBlock, tmpsq)) != eslOK) return status;
+      size += tmpsq->n;
+    }
+
+  /* EOF will be returned only in the case were no sequences were read */
+  if (status == eslEOF && sqBlock->count > 0) status = eslOK;
+  sqBlock->complete = TRUE;
+  return status;
+}
+
 /* Function:  esl_sqio_Echo()
  * Synopsis:  Echo a sequence's record onto output stream.
  *
@@ -1090,7 +1136,10 @@ esl_sqio_Echo(ESL_SQFILE *sqfp, const ESL_SQ *sq, FILE *ofp)
  * Purpose:   Opens an SSI index file associated with the already open
  *            sequence file <sqfp>. If successful, the necessary
  *            information about the open SSI file is stored internally
- *            in <sqfp>.
+ *            in <sqfp>. The index is memory mapped if it can be;
+ *            if not (no <mmap()> on this system, or a filesystem
+ *            that can't map it), it's read as a stream, as by
+ *            <esl_ssi_Open()>. See <esl_ssi_OpenMapped()>.
  *            
  *            The SSI index file name is determined in one of two
  *            ways, depending on whether a non-<NULL> <ssifile_hint>
@@ -1121,7 +1170,8 @@ esl_sqio_Echo(ESL_SQFILE *sqfp, const ESL_SQ *sq, FILE *ofp)
  *            or multiple alignment files that we're reading
  *            sequentially.
  *            
- *            Throws <eslEMEM> on allocation error.
+ *            Throws <eslEMEM> on allocation error; <eslESYS> if the
+ *            index can't be memory mapped.
  */
 int
 esl_sqfile_OpenSSI(ESL_SQFILE *sqfp, const char *ssifile_hint)
@@ -1295,6 +1345,42 @@ esl_sqio_FetchSubseq(ESL_SQFILE *sqfp, const char *source, int64_t start, int64_
 {
   return sqfp->fetch_subseq(sqfp, source, start, end, sq);
 }  
+
+
+/* Function:  esl_sqio_FetchBatch()
+ * Synopsis:  Fetch many sequences at once, reading the file in order.
+ *
+ * Purpose:   Fetch the sequences named (or accessioned) <keys[0..nk-1]>
+ *            from the repositionable, open sequence file <sqfp>, which
+ *            must have an open SSI index. All keys are looked up
+ *            first; then the records are read in the order they
+ *            occur in the file, in one forward pass with coalesced
+ *            reads, rather than by one random seek per key as with
+ *            <esl_sqio_Fetch()>.
+ *            
+ *            Caller provides <sq[0..nk-1]>, created and empty. If
+ *            <in_file_order> is <TRUE>, <sq[j]> is the <j>'th
+ *            sequence in file order; otherwise <sq[i]> is the
+ *            sequence for <keys[i]>, in request order. Optionally,
+ *            caller provides <opt_order[0..nk-1]>, and it is set to
+ *            the index of the key whose sequence was read <j>'th.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEINVAL> if no SSI index is present, or if <sqfp> can't
+ *            be repositioned.
+ *            <eslENOTFOUND> if any of the <keys> isn't in the index;
+ *            then nothing is fetched, and <esl_sqfile_GetErrorBuf()>
+ *            names the missing key.
+ *            <eslEFORMAT> if either the index file or the sequence file
+ *            can't be parsed, because of unexpected format issues.
+ *       
+ * Throws:    <eslEMEM> on allocation error.
+ */
+int
+esl_sqio_FetchBatch(ESL_SQFILE *sqfp, char *const *keys, int nk, int in_file_order, ESL_SQ **sq, int *opt_order)
+{
+  return sqfp->fetch_batch(sqfp, keys, nk, in_file_order, sq, opt_order);
+}
 #endif /*eslAUGMENT_SSI*/
 /*------------- end, random sequence access with SSI -------------------*/
 
@@ -1564,6 +1650,7 @@ main(int argc, char **argv)
   int            n        = 0;
   int64_t        magic    = 0;
   int64_t        nr       = 0;
+  struct stat    st;
 
   if (esl_opt_IsOn(go, "--format")) {
     format = esl_sqio_EncodeFormat(esl_opt_GetString(go, "--format"));
@@ -1623,6 +1710,8 @@ main(int argc, char **argv)
   esl_stopwatch_Stop(w);
   esl_stopwatch_Display(stdout, w, "sqio:  ");
   printf("Read %d sequences; %lld residues.\n", n, (long long int) nr);
+  if (stat(filename, &st) == 0 && w->elapsed > 0.)
+    printf("sqio throughput: %.1f MB/s of input\n", (double) st.st_size / 1e6 / w->elapsed);
 
 #ifdef eslAUGMENT_NCBI
   if (sqfp->format == eslSQFILE_NCBI)
@@ -2122,6 +2211,106 @@ utest_fetch_subseq(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, ESL_SQ **sqarr, int N,
 }
 
 
+/* Fetch a random batch of keys (with repeats) in request order and
+ * in file order; both must give the right seqs, and the file order
+ * must be sorted by record offset.
+ */
+static void
+utest_fetch_batch(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, ESL_SQ **sqarr, int N, char *seqfile, char *ssifile, int format)
+{
+  char       *msg         = "sqio batch fetch unit test failure";
+  ESL_SQFILE *sqfp        = NULL;
+  int         nk          = 2*N;
+  char      **keys        = malloc(sizeof(char *)   * nk);
+  int        *which       = malloc(sizeof(int)      * nk);
+  int        *order       = malloc(sizeof(int)      * nk);
+  ESL_SQ    **sq          = malloc(sizeof(ESL_SQ *) * nk);
+  char       *badkey[1]   = { "no-such-key" };
+  int         i, j;
+
+  if (keys == NULL || which == NULL || order == NULL || sq == NULL) esl_fatal(msg);
+  for (i = 0; i < nk; i++)
+    {
+      which[i] = esl_rnd_Roll(r, N);
+      keys[i]  = sqarr[which[i]]->name;
+      sq[i]    = esl_sq_CreateDigital(abc);
+    }
+
+  if (esl_sqfile_OpenDigital(abc, seqfile, format, NULL, &sqfp) != eslOK) esl_fatal(msg);
+  if (esl_sqfile_OpenSSI(sqfp, ssifile)                         != eslOK) esl_fatal(msg);
+
+  /* request order */
+  if (esl_sqio_FetchBatch(sqfp, keys, nk, FALSE, sq, order) != eslOK) esl_fatal(msg);
+  for (i = 0; i < nk; i++)
+    {
+      if (strcmp(sq[i]->name, sqarr[which[i]]->name)                         != 0) esl_fatal(msg);
+      if (sq[i]->n != sqarr[which[i]]->n)                                          esl_fatal(msg);
+      if (memcmp(sq[i]->dsq, sqarr[which[i]]->dsq, sizeof(ESL_DSQ) * (sq[i]->n+2)) != 0) esl_fatal(msg);
+      esl_sq_Reuse(sq[i]);
+    }
+
+  /* file order */
+  if (esl_sqio_FetchBatch(sqfp, keys, nk, TRUE, sq, order) != eslOK) esl_fatal(msg);
+  for (j = 0; j < nk; j++)
+    {
+      i = order[j];
+      if (strcmp(sq[j]->name, sqarr[which[i]]->name)                         != 0) esl_fatal(msg);
+      if (memcmp(sq[j]->dsq, sqarr[which[i]]->dsq, sizeof(ESL_DSQ) * (sq[j]->n+2)) != 0) esl_fatal(msg);
+      if (j > 0 && sq[j]->roff < sq[j-1]->roff)                                    esl_fatal(msg);
+      if (j > 0 && sq[j]->roff == sq[j-1]->roff && order[j] < order[j-1])          esl_fatal(msg);
+    }
+
+  /* a missing key fails normally, and the file is still usable */
+  if (esl_sqio_FetchBatch(sqfp, badkey, 1, FALSE, sq, NULL) != eslENOTFOUND) esl_fatal(msg);
+  esl_sq_Reuse(sq[0]);
+  if (esl_sqio_Fetch(sqfp, sqarr[0]->name, sq[0])            != eslOK)        esl_fatal(msg);
+  if (strcmp(sq[0]->name, sqarr[0]->name)                    != 0)            esl_fatal(msg);
+
+  esl_sqfile_Close(sqfp);
+  for (i = 0; i < nk; i++) esl_sq_Destroy(sq[i]);
+  free(sq);
+  free(order);
+  free(which);
+  free(keys);
+}
+
+/* Read the file in blocks, into one small arena block that has to
+ * grow and is refilled for each block; the sequences must come out
+ * the same as esl_sqio_Read() gives them.
+ */
+static void
+utest_read_arena_block(ESL_ALPHABET *abc, ESL_SQ **sqarr, int N, char *seqfile, int format)
+{
+  char         *msg   = "sqio arena block read unit test failed";
+  ESL_SQ_BLOCK *block = esl_sq_CreateDigitalArenaBlock(7, abc, 64);
+  ESL_SQFILE   *sqfp  = NULL;
+  ESL_SQ       *sq;
+  int           nseq  = 0;
+  int           i;
+  int           status;
+
+  if (block == NULL) esl_fatal(msg);
+  if (esl_sqfile_OpenDigital(abc, seqfile, format, NULL, &sqfp) != eslOK) esl_fatal(msg);
+  while ((status = esl_sqio_ReadBlock(sqfp, block, 0, 0, FALSE)) == eslOK)
+    {
+      if (block->count < 1 || block->count > 7) esl_fatal(msg);
+      for (i = 0; i < block->count; i++, nseq++)
+	{
+	  sq = block->list + i;
+	  if (nseq >= N)                                                           esl_fatal(msg);
+	  if (strcmp(sq->name, sqarr[nseq]->name)                            != 0) esl_fatal(msg);
+	  if (sq->n != sqarr[nseq]->n || sq->L != sqarr[nseq]->n)                  esl_fatal(msg);
+	  if (memcmp(sq->dsq, sqarr[nseq]->dsq, sizeof(ESL_DSQ) * (sq->n+2)) != 0) esl_fatal(msg);
+	  if (i > 0 && (char *) sq->name <= (char *) block->list[i-1].dsq)         esl_fatal(msg);
+	}
+    }
+  if (status != eslEOF) esl_fatal(msg);
+  if (nseq   != N)      esl_fatal(msg);
+
+  esl_sqfile_Close(sqfp);
+  esl_sq_DestroyBlock(block);
+}
+
 /* Write the sequences out to a tmpfile in chosen <format>;
  * read them back and make sure they're the same.
  * reposition to beginning, read and check again.
@@ -2161,6 +2350,42 @@ utest_write(ESL_ALPHABET *abc, ESL_SQ **sqarr, int N, int format)
   esl_sq_Destroy(sq);
   remove(tmpfile);
 }
+
+/* utest_illegal_char()
+ * An illegal character anywhere in a sequence line, including in the
+ * middle of a run of residues that's parsed 16 at a time, is caught
+ * and reported on the right line.
+ */
+static void
+utest_illegal_char(ESL_ALPHABET *abc)
+{
+  char       *msg         = "sqio illegal char unit test failure";
+  char        tmpfile[32];
+  ESL_SQFILE *sqfp        = NULL;
+  ESL_SQ     *sq          = esl_sq_CreateDigital(abc);
+  FILE       *fp          = NULL;
+  int         pos, i;
+
+  for (pos = 0; pos < 40; pos++)
+    {
+      strcpy(tmpfile, "esltmpXXXXXX");
+      if (esl_tmpfile_named(tmpfile, &fp) != eslOK) esl_fatal(msg);
+      fprintf(fp, ">seq1\nACGTACGTACGT\n>seq2 desc\nACGT\n");
+      for (i = 0; i < 40; i++) fputc((i == pos ? '9' : "ACGT"[i%4]), fp);
+      fprintf(fp, "\nACGT\n");
+      fclose(fp);
+
+      if (esl_sqfile_OpenDigital(abc, tmpfile, eslSQFILE_FASTA, NULL, &sqfp) != eslOK)      esl_fatal(msg);
+      if (esl_sqio_Read(sqfp, sq)                                            != eslOK)      esl_fatal(msg);
+      esl_sq_Reuse(sq);
+      if (esl_sqio_Read(sqfp, sq)                                            != eslEFORMAT) esl_fatal(msg);
+      if (strcmp(esl_sqfile_GetErrorBuf(sqfp), "Line 5: illegal character 9") != 0)         esl_fatal(msg);
+      esl_sqfile_Close(sqfp);
+      esl_sq_Reuse(sq);
+      remove(tmpfile);
+    }
+  esl_sq_Destroy(sq);
+}
 #endif /*eslSQIO_TESTDRIVE*/
 /*------------------ end, unit tests ----------------------------*/
 
@@ -2240,13 +2465,16 @@ main(int argc, char **argv)
       utest_read        (abc, sqarr, N, tmpfile, eslSQFILE_FASTA, mode);
       utest_read_info   (abc, sqarr, N, tmpfile, eslSQFILE_FASTA, mode);
       utest_read_window (abc, sqarr, N, tmpfile, eslSQFILE_FASTA, mode);
+      utest_read_arena_block(abc, sqarr, N, tmpfile, eslSQFILE_FASTA);
       utest_fetch_subseq(r, abc, sqarr, N, tmpfile, ssifile, eslSQFILE_FASTA);
+      utest_fetch_batch (r, abc, sqarr, N, tmpfile, ssifile, eslSQFILE_FASTA);
 
       remove(tmpfile);
       remove(ssifile);
     }  
 
   utest_write(abc, sqarr, N, eslMSAFILE_STOCKHOLM);
+  utest_illegal_char(abc);
 
   for (i = 0; i < N; i++) esl_sq_Destroy(sqarr[i]);
   free(sqarr);
@@ -41,6 +41,10 @@
 #endif
 #include "esl_sqio.h"
 #include "esl_sq.h"
+#if defined(HAVE_SSE2) && defined(__SSSE3__) && defined(__GNUC__)
+#define eslSQASCII_SSSE3  /* byte shuffles for input map lookups; __builtin_ctz() */
+#include "esl_sse.h"
+#endif
 
 /* format specific routines */
 static int   sqascii_GuessFileFormat(ESL_SQFILE *sqfp, int *ret_fmt);
@@ -65,6 +69,7 @@ static int   sqascii_PositionByNumber(ESL_SQFILE *sqfp, int which);
 static int   sqascii_Fetch           (ESL_SQFILE *sqfp, const char *key, ESL_SQ *sq);
 static int   sqascii_FetchInfo       (ESL_SQFILE *sqfp, const char *key, ESL_SQ *sq);
 static int   sqascii_FetchSubseq     (ESL_SQFILE *sqfp, const char *source, int64_t start, int64_t end, ESL_SQ *sq);
+static int   sqascii_FetchBatch      (ESL_SQFILE *sqfp, char *const *keys, int nk, int in_file_order, ESL_SQ **sq, int *opt_order);
 #endif /*eslAUGMENT_SSI*/
 
 /* Internal routines shared by parsers. */
@@ -74,6 +79,8 @@ static int  nextchar (ESL_SQFILE *sqfp, char *ret_c);
 static int  seebuf   (ESL_SQFILE *sqfp, int64_t maxn, int64_t *opt_nres, int64_t *opt_endpos);
 static void addbuf   (ESL_SQFILE *sqfp, ESL_SQ *sq, int64_t nres);
 static void skipbuf  (ESL_SQFILE *sqfp, int64_t nskip);
+static int64_t residue_run(const ESL_DSQ *inmap, const char *s, int64_t n);
+static int64_t map_run    (const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *out);
 static int  read_nres(ESL_SQFILE *sqfp, ESL_SQ *sq, int64_t nskip, int64_t nres, int64_t *opt_actual_nres);
 static int  skip_whitespace(ESL_SQFILE *sqfp);
 
@@ -338,6 +345,7 @@ esl_sqascii_Open(char *filename, int format, ESL_SQFILE *sqfp)
   sqfp->fetch             = &sqascii_Fetch;
   sqfp->fetch_info        = &sqascii_FetchInfo;
   sqfp->fetch_subseq      = &sqascii_FetchSubseq;
+  sqfp->fetch_batch       = &sqascii_FetchBatch;
 #endif
 
   sqfp->get_error         = &sqascii_GetError;
@@ -516,7 +524,17 @@ sqascii_Position(ESL_SQFILE *sqfp, off_t offset)
     }
   else/* normal case: unaligned sequence file */
     {
-      if (fseeko(ascii->fp, offset, SEEK_SET) != 0) ESL_EXCEPTION(eslESYS, "fseeko() failed");
+      /* If <offset> is still in <mem>, as it is when records are fetched
+       * in file order, point there and skip the seek and the reread.
+       */
+      if (ascii->mem != NULL && ascii->is_recording != TRUE &&
+	  offset >= ascii->moff && offset < ascii->moff + ascii->mn)
+	ascii->mpos = offset - ascii->moff;
+      else
+	{
+	  if (fseeko(ascii->fp, offset, SEEK_SET) != 0) ESL_EXCEPTION(eslESYS, "fseeko() failed");
+	  ascii->mpos = ascii->mn;/* this forces loadbuf to load new data */
+	}
 
       ascii->currpl     = -1;
       ascii->curbpl     = -1;
@@ -524,7 +542,6 @@ sqascii_Position(ESL_SQFILE *sqfp, off_t offset)
       ascii->prvbpl     = -1;
       ascii->linenumber = (offset == 0) ? 1 : -1; /* -1 is "unknown" */
       ascii->L          = -1;
-      ascii->mpos       = ascii->mn;/* this forces loadbuf to load new data */
       if ((status = loadbuf(sqfp)) != eslOK) return status;
     }
   return eslOK;
@@ -1729,7 +1746,8 @@ sqascii_Echo(ESL_SQFILE *sqfp, const ESL_SQ *sq, FILE *ofp)
  *            or multiple alignment files that we're reading
  *            sequentially.
  *            
- *            Throws <eslEMEM> on allocation error.
+ *            Throws <eslEMEM> on allocation error; <eslESYS> if the
+ *            index can't be memory mapped.
  */
 static int
 sqascii_OpenSSI(ESL_SQFILE *sqfp, const char *ssifile_hint)
@@ -1749,7 +1767,7 @@ sqascii_OpenSSI(ESL_SQFILE *sqfp, const char *ssifile_hint)
     if ((status = esl_strdup(ssifile_hint, -1, &(ascii->ssifile)))             != eslOK) return status;
   }
 
-  return esl_ssi_Open(ascii->ssifile, &(ascii->ssi));
+  return esl_ssi_OpenMapped(ascii->ssifile, &(ascii->ssi));
 }
 
 
@@ -2077,6 +2095,83 @@ loadmem(ESL_SQFILE *sqfp)
   return status;
 }
 
+
+/* Function:  sqascii_FetchBatch()
+ * Synopsis:  Fetch many sequences in one forward pass, using SSI indexing.
+ *
+ * Purpose:   Fetch the <nk> sequences named (or accessioned)
+ *            <keys[0..nk-1]> from the repositionable, open sequence
+ *            file <sqfp>, which must have an open SSI index. The
+ *            keys are looked up first, and the records are read in
+ *            the order they occur in the file, so the file is read
+ *            front to back instead of by random seeks; nearby
+ *            records come out of the same input buffer.
+ *            
+ *            If <in_file_order> is <TRUE>, <sq[j]> is the <j>'th
+ *            sequence in file order; otherwise <sq[i]> is the
+ *            sequence for <keys[i]>. Caller provides <sq[0..nk-1]>,
+ *            created and empty. Optionally, <opt_order[j]> is set to
+ *            the index of the key whose sequence was read <j>'th.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEINVAL> if no SSI index is present, or if <sqfp> can't
+ *            be repositioned.
+ *            <eslENOTFOUND> if any key isn't in the index; nothing
+ *            is fetched, and <ascii->errbuf> names the first missing key.
+ *            <eslEFORMAT> if either the index file or the sequence file
+ *            can't be parsed, because of unexpected format issues.
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ */
+static int
+sqascii_FetchBatch(ESL_SQFILE *sqfp, char *const *keys, int nk, int in_file_order, ESL_SQ **sq, int *opt_order)
+{
+  uint16_t *fh     = NULL;
+  off_t    *roff   = NULL;
+  int      *order  = NULL;
+  int       nfound;
+  int       i, j;
+  int       status;
+
+  ESL_SQASCII_DATA *ascii = &sqfp->data.ascii;
+
+  if (ascii->ssi == NULL) ESL_FAIL(eslEINVAL, ascii->errbuf, "No SSI index for %s; can't fetch sequences", sqfp->filename);
+  if (nk == 0) return eslOK;
+
+  ESL_ALLOC(fh,    sizeof(uint16_t) * nk);
+  ESL_ALLOC(roff,  sizeof(off_t)    * nk);
+  ESL_ALLOC(order, sizeof(int)      * nk);
+
+  if ((status = esl_ssi_FindNameBatch(ascii->ssi, keys, nk, fh, roff, order, &nfound)) != eslOK) goto ERROR;
+  if (nfound < nk) {
+    for (i = 0; i < nk; i++) if (roff[i] == -1) break;
+    ESL_XFAIL(eslENOTFOUND, ascii->errbuf, "key %s not found in SSI index for %s", keys[i], sqfp->filename);
+  }
+
+  for (j = 0; j < nk; j++)
+    {
+      i = order[j];
+      status = esl_sqfile_Position(sqfp, roff[i]);
+      if      (status == eslEOF)    ESL_XFAIL(eslEFORMAT, ascii->errbuf, "Position appears to be off the end of the file");
+      else if (status == eslEINVAL) ESL_XFAIL(status,     ascii->errbuf, "Sequence file is not repositionable");
+      else if (status != eslOK)     goto ERROR;
+
+      if ((status = sqascii_Read(sqfp, in_file_order ? sq[j] : sq[i])) != eslOK) goto ERROR;
+      if (opt_order != NULL) opt_order[j] = i;
+    }
+
+  free(fh);
+  free(roff);
+  free(order);
+  return eslOK;
+
+ ERROR:
+  if (fh    != NULL) free(fh);
+  if (roff  != NULL) free(roff);
+  if (order != NULL) free(order);
+  return status;
+}
+
 /* [1] Be alert for a possible problem above in that fread().
  *     Farrar had inserted an alternative case as follows:
  *     "If we are reading from stdin, buffered read cannot be used
@@ -2200,6 +2295,82 @@ nextchar(ESL_SQFILE *sqfp, char *ret_c)
   return eslOK;
 }
 
+/* residue_run(), map_run()
+ *
+ * The inner loops of the residue parsers: find the run of residues
+ * (chars that <inmap> maps to codes <= 127) at the start of
+ * <s[0..n-1]>, and return its length. map_run() also stores the
+ * mapped codes in <out[0..run-1]>. Anything else (whitespace,
+ * newline, illegal or non-ASCII chars, end of data) ends the run and
+ * is left for the caller to deal with one char at a time.
+ *
+ * With SSSE3, 16 chars at a time are mapped through the 128-entry
+ * <inmap> with byte shuffles, one 16-entry lookup per high nibble;
+ * everything that isn't a residue comes out with its high bit set,
+ * so one movemask finds the end of the run. Otherwise residue_run()
+ * tests 8 chars at a time with one branch, and map_run() is a plain
+ * loop.
+ */
+#ifdef eslSQASCII_SSSE3
+static inline __m128i
+inmap_lookup16(const __m128i *tbl, __m128i v)
+{ /* non-ASCII chars stay flagged by their high bit */
+  return _mm_or_si128(esl_sse_lut128_epu8(tbl, v), _mm_and_si128(v, _mm_set1_epi8((char) 0x80)));
+}
+#endif
+
+static int64_t
+residue_run(const ESL_DSQ *inmap, const char *s, int64_t n)
+{
+  int64_t i = 0;
+#ifdef eslSQASCII_SSSE3
+  __m128i tbl[8];
+  int     mask;
+
+  if (n >= 16)
+    {
+      esl_sse_lut128_load(inmap, tbl);
+      for (; i + 16 <= n; i += 16)
+	if ((mask = _mm_movemask_epi8(inmap_lookup16(tbl, _mm_loadu_si128((const __m128i *) (s + i))))) != 0)
+	  return i + __builtin_ctz(mask);
+    }
+#else
+  int     acc, k;
+
+  for (; i + 8 <= n; i += 8)
+    {
+      for (acc = 0, k = 0; k < 8; k++) acc |= (s[i+k] & 0x80) | inmap[s[i+k] & 0x7f];
+      if (acc & 0x80) break;
+    }
+#endif
+  while (i < n && ! (s[i] & 0x80) && inmap[(int) s[i]] <= 127) i++;
+  return i;
+}
+
+static int64_t
+map_run(const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *out)
+{
+  int64_t i = 0;
+  ESL_DSQ x;
+#ifdef eslSQASCII_SSSE3
+  __m128i tbl[8];
+  __m128i m;
+
+  if (n >= 16)
+    {
+      esl_sse_lut128_load(inmap, tbl);
+      for (; i + 16 <= n; i += 16)
+	{
+	  m = inmap_lookup16(tbl, _mm_loadu_si128((const __m128i *) (s + i)));
+	  if (_mm_movemask_epi8(m)) break;
+	  _mm_storeu_si128((__m128i *) (out + i), m);
+	}
+    }
+#endif
+  for (; i < n && ! (s[i] & 0x80) && (x = inmap[(int) s[i]]) <= 127; i++) out[i] = x;
+  return i;
+}
+
 /* seebuf()
  * 
  * Examine and validate the current buffer <sqfp->buf> from its
@@ -2254,6 +2425,7 @@ seebuf(ESL_SQFILE *sqfp, int64_t maxn, int64_t *opt_nres, int64_t *opt_endpos)
   int     sym;
   ESL_DSQ x;
   int     lasteol;
+  int64_t run;
   int     status  = eslOK;
 
   ESL_SQASCII_DATA *ascii = &sqfp->data.ascii;
@@ -2263,6 +2435,12 @@ seebuf(ESL_SQFILE *sqfp, int64_t maxn, int64_t *opt_nres, int64_t *opt_endpos)
 
   for (bpos = ascii->bpos; nres < maxn && bpos < ascii->nc; bpos++)
   {
+      /* skip the run of residues up to the next special char; the bookkeeping below only needs bpos, nres */
+      run   = residue_run(sqfp->inmap, ascii->buf + bpos, ESL_MIN(ascii->nc - bpos, maxn - nres));
+      nres += run;
+      bpos += run;
+      if (nres == maxn || bpos == ascii->nc) break;
+
       sym = ascii->buf[bpos];
       //printf ("nres: %d, bpos: %d  (%d)\n", nres, bpos, sym);
       if (!isascii(sym)) ESL_FAIL(eslEFORMAT, ascii->errbuf, "Line %" PRId64 ": non-ASCII character %c in sequence", ascii->linenumber, sym); 
@@ -2332,21 +2510,25 @@ seebuf(ESL_SQFILE *sqfp, int64_t maxn, int64_t *opt_nres, int64_t *opt_endpos)
 static void
 addbuf(ESL_SQFILE *sqfp, ESL_SQ *sq, int64_t nres)
 {
-  ESL_DSQ x;
+  int64_t run;
   ESL_SQASCII_DATA *ascii = &sqfp->data.ascii;
 
   if (sq->dsq != NULL) 
     {
       while (nres) {
-        x  = sq->abc->inmap[(int) ascii->buf[ascii->bpos++]];
-        if (x <= 127) { nres--; sq->dsq[++sq->n] = x; }
+        run          = map_run(sq->abc->inmap, ascii->buf + ascii->bpos, nres, sq->dsq + sq->n + 1);
+        sq->n       += run;
+        nres        -= run;
+        ascii->bpos += run + (nres ? 1 : 0); 
       } /* we skipped IGNORED, EOL. EOD, ILLEGAL don't occur; seebuf() already checked  */
     } 
   else
     {
       while (nres) {
-        x   = sqfp->inmap[(int) ascii->buf[ascii->bpos++]];
-        if (x <= 127) { nres--; sq->seq[sq->n++] = x; }
+        run          = map_run(sqfp->inmap, ascii->buf + ascii->bpos, nres, (ESL_DSQ *) sq->seq + sq->n);
+        sq->n       += run;
+        nres        -= run;
+        ascii->bpos += run + (nres ? 1 : 0);
       }
     }
 }
@@ -2358,12 +2540,13 @@ addbuf(ESL_SQFILE *sqfp, ESL_SQ *sq, int64_t nres)
 static void
 skipbuf(ESL_SQFILE *sqfp, int64_t nskip)
 {
-  ESL_DSQ x;
+  int64_t run;
   ESL_SQASCII_DATA *ascii = &sqfp->data.ascii;
 
   while (nskip) {
-    x  = sqfp->inmap[(int) ascii->buf[ascii->bpos++]];
-    if (x <= 127) nskip--;/* skip IGNORED, EOL. */
+    run          = residue_run(sqfp->inmap, ascii->buf + ascii->bpos, nskip);
+    nskip       -= run;
+    ascii->bpos += run + (nskip ? 1 : 0); /* skip IGNORED, EOL. */
   }
 }
 
@@ -3159,6 +3342,275 @@ esl_sqascii_WriteFasta(FILE *fp, ESL_SQ *sq, int save_offsets)
   if (save_offsets) sq->eoff = ftello(fp) - 1;
   return eslOK;
 }
+
+/* Function:  esl_sqascii_ReadRecords()
+ * Synopsis:  Read raw bytes of whole FASTA records.
+ *
+ * Purpose:   Read the raw text of the next whole FASTA records from
+ *            open FASTA file <sqfp>, for parsing elsewhere (for
+ *            example, in another thread) by
+ *            <esl_sqascii_ParseRecords()>. Bytes are copied into
+ *            <*buf>, which is reallocated as needed (<*balloc> is its
+ *            allocated size; pass <*buf=NULL>, <*balloc=0> the first
+ *            time). Reading stops just before the start of a record
+ *            when the chunk already holds <maxrec> records or at
+ *            least <maxbytes> bytes, or at the end of the file.
+ *            Only record boundaries are found; nothing is validated.
+ *            A record starts at any '>' that isn't on a header line,
+ *            as in <esl_sqio_Read()>.
+ *
+ *            <*ret_n> is the number of bytes read (<*buf> is also
+ *            NUL-terminated). <*ret_boff> is the disk offset of the
+ *            first byte, <*ret_linenumber> is the line number it's
+ *            on, and <*ret_eof> is <TRUE> if the chunk ends at the
+ *            end of the file.
+ *
+ *            <sqfp> is left positioned at the first record after the
+ *            chunk, so sequential reading may continue.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEOF> if there's no more data in the file.
+ *
+ * Throws:    <eslEINVAL> if <sqfp> isn't a FASTA file.
+ *            <eslEMEM> on allocation failure.
+ */
+int
+esl_sqascii_ReadRecords(ESL_SQFILE *sqfp, int64_t maxbytes, int maxrec, char **buf, int64_t *balloc,
+			int64_t *ret_n, off_t *ret_boff, int64_t *ret_linenumber, int *ret_eof)
+{
+  ESL_SQASCII_DATA *ascii     = &sqfp->data.ascii;
+  int64_t           n         = 0;
+  int               nrec      = 0;
+  int               in_header = FALSE;
+  int               eof       = FALSE;
+  char             *start, *p, *q, *e, *end, *stop;
+  int64_t           len;
+  void             *tmp;
+  int               status;
+
+  if (sqfp->format != eslSQFILE_FASTA || ascii->is_linebased) ESL_EXCEPTION(eslEINVAL, "not a FASTA file");
+  if (ascii->nc == 0) return eslEOF;
+  if (ascii->bpos == ascii->nc && (status = loadbuf(sqfp)) != eslOK) return status; /* EOF, EMEM */
+
+  *ret_boff       = ascii->boff + ascii->bpos;
+  *ret_linenumber = ascii->linenumber;
+
+  while (1)
+    {
+      start = ascii->buf + ascii->bpos;
+      end   = ascii->buf + ascii->nc;
+      stop  = NULL;
+      for (p = start; p < end; )
+	{
+	  if (in_header)
+	    { /* a header line ends at \n or \r; the data scan below counts the \n */
+	      while (p < end && *p != '\n' && *p != '\r') p++;
+	      if (p == end) break;
+	      in_header = FALSE;
+	    }
+	  else
+	    { /* in sequence data (or space before the first record), any '>' starts a record */
+	      q = memchr(p, '>', end - p);
+	      e = (q ? q : end);
+	      if (ascii->linenumber != -1)
+		while ((p = memchr(p, '\n', e - p)) != NULL) { ascii->linenumber++; p++; }
+	      if (q == NULL) break;
+	      if (nrec == maxrec || (nrec > 0 && n + (q - start) >= maxbytes)) { stop = q; break; }
+	      nrec++;
+	      in_header = TRUE;
+	      p = q + 1;
+	    }
+	}
+
+      len = (stop ? stop : end) - start;
+      if (n + len + 1 > *balloc) {
+	ESL_RALLOC(*buf, tmp, sizeof(char) * ESL_MAX(n + len + 1, *balloc * 2));
+	*balloc = ESL_MAX(n + len + 1, *balloc * 2);
+      }
+      memcpy(*buf + n, start, len);
+      n           += len;
+      ascii->bpos += len;
+      if (stop) break;
+
+      if      ((status = loadbuf(sqfp)) == eslEOF) { eof = TRUE; break; }
+      else if (status != eslOK) return status;
+    }
+
+  (*buf)[n]       = '\0';
+  *ret_n          = n;
+  *ret_eof        = eof;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* set_span()
+ * Copy <len> chars of <src> into string <*s> of allocated size <*salloc>,
+ * reallocating as needed; NUL-terminate.
+ */
+static int
+set_span(char **s, int *salloc, const char *src, int64_t len)
+{
+  void *tmp;
+  int   status;
+
+  if (len + 1 > *salloc) {
+    ESL_RALLOC(*s, tmp, sizeof(char) * (len + 1));
+    *salloc = len + 1;
+  }
+  memcpy(*s, src, len);
+  (*s)[len] = '\0';
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* Function:  esl_sqascii_ParseRecords()
+ * Synopsis:  Parse FASTA records from a buffer into a block.
+ *
+ * Purpose:   Parse the FASTA records in <buf[0..nc-1]>, as read by
+ *            <esl_sqascii_ReadRecords()> from <sqfp>, into block
+ *            <sqBlock>, exactly as <esl_sqio_Read()> would have read
+ *            them from <sqfp>: same names, descriptions, residues,
+ *            and record offsets. <boff> and <linenumber> are the disk
+ *            offset and line number of <buf[0]>, and <at_eof> is
+ *            <TRUE> if the buffer ends at the end of the file.
+ *
+ *            <sqfp> is only consulted for its input map and
+ *            alphabet, and isn't changed; so this may be called from
+ *            any number of threads at once while another thread
+ *            reads on with <esl_sqascii_ReadRecords()>. If <sqfp> is
+ *            digital, <sqBlock> must be a digital block.
+ *
+ *            If <sqBlock> is an arena block (see
+ *            <esl_sq_CreateArenaBlock()>), records are parsed
+ *            straight into its arena, with no copy.
+ *
+ *            Line numbers count every newline, so they can be
+ *            larger than <esl_sqio_Read()>'s in files with blank
+ *            lines right after a header or before the first record.
+ *
+ * Returns:   <eslOK> on success; <sqBlock->count> is the number of
+ *            records parsed (which may be 0, if <buf> only holds
+ *            whitespace).
+ *
+ *            <eslEFORMAT> on a parse error; an informative message
+ *            is in <errbuf>, which is at least <eslERRBUFSIZE>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ *            <eslEINCONCEIVABLE> if <buf> holds more records than
+ *            <sqBlock> can hold.
+ */
+int
+esl_sqascii_ParseRecords(const ESL_SQFILE *sqfp, const char *buf, int64_t nc, off_t boff, int64_t linenumber, int at_eof,
+			 ESL_SQ_BLOCK *sqBlock, char *errbuf)
+{
+  ESL_SQ  *sq;
+  int64_t  p = 0;
+  int64_t  q;
+  int64_t  roff, hoff;		/* record and header end offsets in <buf> */
+  int64_t  name, nlen;		/* name is buf[name..name+nlen-1] */
+  int64_t  desc, dlen;		/* description is buf[desc..desc+dlen-1] */
+  int64_t  nres;
+  int64_t  run;
+  int      sym;
+  ESL_DSQ  x;
+
+  sqBlock->count    = 0;
+  sqBlock->complete = TRUE;
+  while (1)
+    {
+      while (p < nc && isspace(buf[p])) { if (buf[p] == '\n' && linenumber != -1) linenumber++; p++; }
+      if (p == nc) break;
+      if (buf[p] != '>') ESL_FAIL(eslEFORMAT, errbuf, "Line %" PRId64 ": unexpected char %c; expected FASTA to start with >", linenumber, buf[p]);
+      if (sqBlock->count == sqBlock->listSize) ESL_EXCEPTION(eslEINCONCEIVABLE, "more FASTA records than the block holds");
+
+      roff = p;
+
+      /* header: name, then description */
+      for (p++; p < nc && (buf[p] == ' ' || buf[p] == '\t'); p++) ;
+      for (q = p; q < nc && ! isspace(buf[q]); q++) ;
+      if (q == p) ESL_FAIL(eslEFORMAT, errbuf, "Line %" PRId64 ": no FASTA name found", linenumber);
+      name = p;  nlen = q-p;
+
+      for (p = q; p < nc && (buf[p] == ' ' || buf[p] == '\t'); p++) ;
+      for (q = p; q < nc && buf[q] != '\n' && buf[q] != '\r'; q++) ;
+      desc = p;  dlen = q-p;
+      hoff = q;
+
+      for (p = q; p < nc && (buf[p] == '\n' || buf[p] == '\r'); p++)
+	if (buf[p] == '\n' && linenumber != -1) linenumber++;
+      if (p == nc && at_eof) ESL_FAIL(eslEFORMAT, errbuf, "Premature EOF in parsing FASTA name/description line");
+
+      /* sequence: validate and count, then store */
+      nres = 0;
+      for (q = p; q < nc; q++)
+	{
+	  run   = residue_run(sqfp->inmap, buf+q, nc-q);
+	  nres += run;
+	  q    += run;
+	  if (q == nc) break;
+
+	  sym = buf[q];
+	  if (! isascii(sym)) ESL_FAIL(eslEFORMAT, errbuf, "Line %" PRId64 ": non-ASCII character %c in sequence", linenumber, sym);
+	  x = sqfp->inmap[sym];
+	  if      (x <= 127)            nres++;
+	  else if (x == eslDSQ_EOL)     { if (linenumber != -1) linenumber++; }
+	  else if (x == eslDSQ_ILLEGAL) ESL_FAIL(eslEFORMAT, errbuf, "Line %" PRId64 ": illegal character %c", linenumber, sym);
+	  else if (x == eslDSQ_EOD)     break;
+	  else if (x != eslDSQ_IGNORED) ESL_FAIL(eslEFORMAT, errbuf, "inmap corruption?");
+	}
+
+      /* an arena block packs the record straight into its arena */
+      if (sqBlock->arena != NULL)
+	{
+	  if (esl_sq_BlockReserve(sqBlock, buf+name, nlen, buf+desc, dlen, nres, &sq) != eslOK) return eslEMEM;
+	}
+      else
+	{
+	  sq = sqBlock->list + sqBlock->count++;
+	  esl_sq_Reuse(sq);
+	  if (set_span(&(sq->name), &(sq->nalloc), buf+name, nlen) != eslOK) return eslEMEM;
+	  if (set_span(&(sq->desc), &(sq->dalloc), buf+desc, dlen) != eslOK) return eslEMEM;
+	  if (esl_sq_GrowTo(sq, nres)                              != eslOK) return eslEMEM;
+	}
+      sq->roff = boff + roff;
+      sq->hoff = boff + hoff;
+      sq->doff = boff + p;
+
+      if (sq->dsq != NULL)
+	{
+	  for (; p < q; p++)
+	    {
+	      run    = map_run(sq->abc->inmap, buf+p, q-p, sq->dsq + sq->n + 1);
+	      sq->n += run;
+	      p     += run;
+	      if (p == q) break;
+	    }
+	  sq->dsq[sq->n+1] = eslDSQ_SENTINEL;
+	}
+      else
+	{
+	  for (; p < q; p++)
+	    {
+	      run    = map_run(sqfp->inmap, buf+p, q-p, (ESL_DSQ *) sq->seq + sq->n);
+	      sq->n += run;
+	      p     += run;
+	      if (p == q) break;
+	    }
+	  sq->seq[sq->n] = '\0';
+	}
+      sq->eoff  = boff + q - 1;
+      sq->start = 1;
+      sq->end   = sq->n;
+      sq->C     = 0;
+      sq->W     = sq->n;
+      sq->L     = sq->n;
+    }
+  return eslOK;
+}
 /*------------------- end of FASTA i/o ---------------------------*/
 
 /*****************************************************************
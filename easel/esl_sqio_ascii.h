@@ -94,6 +94,10 @@ typedef struct esl_sqascii_s {
 extern int  esl_sqascii_Open(char *seqfile, int format, struct esl_sqio_s *sqfp);
 extern int  esl_sqascii_WriteFasta(FILE *fp, ESL_SQ *s, int update);
 extern int  esl_sqascii_Parse(char *buf, int size, ESL_SQ *s, int format);
+extern int  esl_sqascii_ReadRecords(struct esl_sqio_s *sqfp, int64_t maxbytes, int maxrec, char **buf, int64_t *balloc,
+				    int64_t *ret_n, off_t *ret_boff, int64_t *ret_linenumber, int *ret_eof);
+extern int  esl_sqascii_ParseRecords(const struct esl_sqio_s *sqfp, const char *buf, int64_t nc, off_t boff, int64_t linenumber, int at_eof,
+				     ESL_SQ_BLOCK *sqBlock, char *errbuf);
 
 
 #endif /*eslSQIO_ASCII_INCLUDED*/
@@ -23,12 +23,24 @@
 #include <endian.h>
 #endif
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef _POSIX_VERSION
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif /* _POSIX_VERSION */
+
 #include "easel.h"
 #ifdef eslAUGMENT_ALPHABET
 #include "esl_alphabet.h"	/* alphabet aug adds digital sequences */
 #endif 
 #include "esl_sqio.h"
 #include "esl_sq.h"
+#if defined(HAVE_SSE2) && defined(__SSSE3__)
+#define eslSQNCBI_SSSE3   /* byte shuffles for unpacking 2-bit dna */
+#include "esl_sse.h"
+#endif
 
 #ifndef htobe32
 #ifdef  WORDS_BIGENDIAN
@@ -62,6 +74,10 @@ static void reset_db            (ESL_SQNCBI_DATA *ncbi);
 static int  pos_sequence        (ESL_SQNCBI_DATA *ncbi, int inx);
 static int  volume_open         (ESL_SQNCBI_DATA *ncbi, int volume);
 static void reset_header_values (ESL_SQNCBI_DATA *ncbi);
+static void map_db              (ESL_SQNCBI_DATA *ncbi);
+static void unmap_db            (ESL_SQNCBI_DATA *ncbi);
+static int  read_db             (FILE *fp, const unsigned char *mem, off_t memn, off_t off, void *buf, size_t n);
+static void unpack_dna          (const unsigned char *src, int64_t nbytes, char *dst, const char *code);
 
 static int  read_amino          (ESL_SQFILE *sqfp, ESL_SQ *sq);
 static int  read_dna            (ESL_SQFILE *sqfp, ESL_SQ *sq);
@@ -137,6 +153,13 @@ esl_sqncbi_Open(char *filename, int format, ESL_SQFILE *sqfp)
   ncbi->fpphr        = NULL;
   ncbi->fppsq        = NULL;
 
+  ncbi->pin_mem      = NULL;
+  ncbi->phr_mem      = NULL;
+  ncbi->psq_mem      = NULL;
+  ncbi->pin_n        = 0;
+  ncbi->phr_n        = 0;
+  ncbi->psq_n        = 0;
+
   ncbi->title        = NULL;
   ncbi->timestamp    = NULL;
 
@@ -541,6 +564,9 @@ sqncbi_Open(ESL_SQNCBI_DATA *ncbi, char *filename)
   /* skip the first sentinal byte in the .psq file */
   fgetc(ncbi->fppsq);
 
+  /* read through a mapping of the files if we can */
+  map_db(ncbi);
+
   if (name != NULL) free(name);
   return eslOK;
 
@@ -602,6 +628,8 @@ sqncbi_Close(ESL_SQFILE *sqfp)
 
   if (ncbi->alphasym != NULL)    free(ncbi->alphasym);
 
+  unmap_db(ncbi);
+
   if (ncbi->fppin != NULL) fclose(ncbi->fppin);
   if (ncbi->fpphr != NULL) fclose(ncbi->fpphr);
   if (ncbi->fppsq != NULL) fclose(ncbi->fppsq);
@@ -1163,7 +1191,7 @@ sqncbi_ReadBlock(ESL_SQFILE *sqfp, ESL_SQ_BLOCK *sqBlock, int max_residues, int
 	  int     i = 0;
 	  int     size = 0;
 	  int     status = eslOK;
-	  ESL_SQ *tmpsq;
+	  ESL_SQ *tmpsq  = NULL;
 
 	  sqBlock->count = 0;
 
@@ -1343,6 +1371,8 @@ reset_db(ESL_SQNCBI_DATA *ncbi)
   if (ncbi->title     != NULL) free(ncbi->title);
   if (ncbi->timestamp != NULL) free(ncbi->timestamp);
 
+  unmap_db(ncbi);
+
   if (ncbi->fppin != NULL) fclose(ncbi->fppin);
   if (ncbi->fpphr != NULL) fclose(ncbi->fpphr);
   if (ncbi->fppsq != NULL) fclose(ncbi->fppsq);
@@ -1375,6 +1405,100 @@ reset_header_values(ESL_SQNCBI_DATA *ncbi)
   ncbi->str_id_size = 0;
 }
 
+#ifdef _POSIX_VERSION
+/* map_file()
+ *
+ * Map all of the open file <fp> read-only. Return the mapping
+ * in <*ret_mem> and its size in <*ret_n>.
+ */
+static int
+map_file(FILE *fp, unsigned char **ret_mem, off_t *ret_n)
+{
+  struct stat  st;
+  void        *p;
+
+  if (fstat(fileno(fp), &st) != 0 || st.st_size == 0) return eslFAIL;
+  if ((p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0)) == MAP_FAILED) return eslFAIL;
+
+  *ret_mem = (unsigned char *) p;
+  *ret_n   = st.st_size;
+  return eslOK;
+}
+#endif /*_POSIX_VERSION*/
+
+/* map_db()
+ *
+ * Map the index, header and sequence files of the open database
+ * (or volume) into memory, so sequences are translated straight
+ * out of the page cache instead of being seeked to and copied
+ * through stdio. If any of the three can't be mapped, none are,
+ * and reading falls back to the open files.
+ */
+static void
+map_db(ESL_SQNCBI_DATA *ncbi)
+{
+#ifdef _POSIX_VERSION
+  if (ncbi->psq_mem != NULL) return;
+
+  if (map_file(ncbi->fppin, &ncbi->pin_mem, &ncbi->pin_n) != eslOK ||
+      map_file(ncbi->fpphr, &ncbi->phr_mem, &ncbi->phr_n) != eslOK ||
+      map_file(ncbi->fppsq, &ncbi->psq_mem, &ncbi->psq_n) != eslOK)
+    {
+      unmap_db(ncbi);
+      return;
+    }
+
+  /* a database is mostly scanned front to back */
+#ifdef MADV_SEQUENTIAL
+  madvise(ncbi->phr_mem, ncbi->phr_n, MADV_SEQUENTIAL);
+  madvise(ncbi->psq_mem, ncbi->psq_n, MADV_SEQUENTIAL);
+#endif
+#endif /*_POSIX_VERSION*/
+}
+
+/* unmap_db()
+ *
+ * Release any mappings made by <map_db()>.
+ */
+static void
+unmap_db(ESL_SQNCBI_DATA *ncbi)
+{
+#ifdef _POSIX_VERSION
+  if (ncbi->pin_mem != NULL) munmap(ncbi->pin_mem, ncbi->pin_n);
+  if (ncbi->phr_mem != NULL) munmap(ncbi->phr_mem, ncbi->phr_n);
+  if (ncbi->psq_mem != NULL) munmap(ncbi->psq_mem, ncbi->psq_n);
+#endif
+  ncbi->pin_mem = NULL;
+  ncbi->phr_mem = NULL;
+  ncbi->psq_mem = NULL;
+  ncbi->pin_n   = 0;
+  ncbi->phr_n   = 0;
+  ncbi->psq_n   = 0;
+}
+
+/* read_db()
+ *
+ * Copy <n> bytes at offset <off> of a database file into <buf>:
+ * out of its mapping <mem> of <memn> bytes if it's mapped, else
+ * by seeking and reading the open file <fp>.
+ *
+ * Returns <eslOK> on success; <eslEFORMAT> if the file is too
+ * short; <eslESYS> if the seek fails.
+ */
+static int
+read_db(FILE *fp, const unsigned char *mem, off_t memn, off_t off, void *buf, size_t n)
+{
+  if (mem != NULL) {
+    if (off < 0 || off + (off_t) n > memn) return eslEFORMAT;
+    memcpy(buf, mem + off, n);
+    return eslOK;
+  }
+
+  if (fseek(fp, off, SEEK_SET) != 0)          return eslESYS;
+  if (fread(buf, sizeof(char), n, fp) != n)   return eslEFORMAT;
+  return eslOK;
+}
+
 /* volume_open()
  *
  * Open up the index, head and sequence files for a particular
@@ -1396,6 +1520,8 @@ volume_open(ESL_SQNCBI_DATA *ncbi, int volume)
   /* if the db has no volumes return */
   if (ncbi->volumes == 0) return eslOK;
 
+  unmap_db(ncbi);
+
   if (ncbi->fppin != NULL) fclose(ncbi->fppin);
   if (ncbi->fpphr != NULL) fclose(ncbi->fpphr);
   if (ncbi->fppsq != NULL) fclose(ncbi->fppsq);
@@ -1446,6 +1572,8 @@ volume_open(ESL_SQNCBI_DATA *ncbi, int volume)
   /* skip the first sentinal byte in the .psq file */
   fgetc(ncbi->fppsq);
 
+  map_db(ncbi);
+
   /* zero terminate the name other functions can just
    * tack on any extension without a lot of testing.
    */
@@ -1531,27 +1659,27 @@ pos_sequence(ESL_SQNCBI_DATA *ncbi, int inx)
     ncbi->index_end = ncbi->index_start + cnt - 2;
 
     offset = ncbi->hdr_off + (sizeof(uint32_t) * start);
-    if (fseek(ncbi->fppin, offset, SEEK_SET) != 0) {
+    status = read_db(ncbi->fppin, ncbi->pin_mem, ncbi->pin_n, offset, ncbi->hdr_indexes, sizeof(uint32_t) * cnt);
+    if (status == eslESYS) {
       ESL_FAIL(eslEFORMAT, ncbi->errbuf, "Error seeking header index %d\n", offset);
-    }
-    if (fread(ncbi->hdr_indexes, sizeof(uint32_t), cnt, ncbi->fppin) != cnt) {
+    } else if (status != eslOK) {
       ESL_FAIL(eslEFORMAT, ncbi->errbuf, "Error reading header index %d at %d(%d)\n", start, offset, cnt);
     }
 
     offset = ncbi->seq_off + (sizeof(uint32_t) * start);
-    if (fseek(ncbi->fppin, offset, SEEK_SET) != 0) {
+    status = read_db(ncbi->fppin, ncbi->pin_mem, ncbi->pin_n, offset, ncbi->seq_indexes, sizeof(uint32_t) * cnt);
+    if (status == eslESYS) {
       ESL_FAIL(eslEFORMAT, ncbi->errbuf, "Error seeking sequence index %d\n", offset);
-    }
-    if (fread(ncbi->seq_indexes, sizeof(uint32_t), cnt, ncbi->fppin) != cnt) {
+    } else if (status != eslOK) {
       ESL_FAIL(eslEFORMAT, ncbi->errbuf, "Error reading sequence index %d at %d(%d)\n", start, offset, cnt);
     }
 
     if (ncbi->alphatype == eslDNA) {
       offset = ncbi->amb_off + (sizeof(uint32_t) * start);
-      if (fseek(ncbi->fppin, offset, SEEK_SET) != 0) {
+      status = read_db(ncbi->fppin, ncbi->pin_mem, ncbi->pin_n, offset, ncbi->amb_indexes, sizeof(uint32_t) * cnt);
+      if (status == eslESYS) {
 	ESL_FAIL(eslEFORMAT, ncbi->errbuf, "Error seeking ambiguity index %d\n", offset);
-      }
-      if (fread(ncbi->amb_indexes, sizeof(uint32_t), cnt, ncbi->fppin) != cnt) {
+      } else if (status != eslOK) {
 	ESL_FAIL(eslEFORMAT, ncbi->errbuf, "Error reading ambiguity index %d at %d(%d)\n", start, offset, cnt);
       }
     }
@@ -1573,6 +1701,9 @@ pos_sequence(ESL_SQNCBI_DATA *ncbi, int inx)
     ncbi->seq_alen = 0;
   }
 
+  /* a mapped volume is read in place; nothing to seek */
+  if (ncbi->psq_mem != NULL) return eslOK;
+
   if (fseek(ncbi->fpphr, ncbi->roff, SEEK_SET) != 0) return eslESYS;
   if (fseek(ncbi->fppsq, ncbi->doff, SEEK_SET) != 0) return eslESYS;
 
@@ -1591,33 +1722,46 @@ read_amino(ESL_SQFILE *sqfp, ESL_SQ *sq)
   int     inx;
   int     size;
 
+  const unsigned char *src;
+
   ESL_SQNCBI_DATA *ncbi = &sqfp->data.ncbi;
 
   if (ncbi->index >= ncbi->num_seq) return eslEOF;
 
   size = sq->eoff - sq->doff;
+  if (ncbi->psq_mem != NULL && sq->eoff > ncbi->psq_n) return eslEFORMAT;
 
   /* figure out the sequence length */
   if (esl_sq_GrowTo(sq, size) != eslOK) return eslEMEM;
 
-  /* figure out if the sequence is in digital mode or not */
+  /* figure out if the sequence is in digital mode or not.  a mapped
+   * sequence is translated straight out of the mapping; otherwise
+   * it's read into place and translated there.
+   */
   if (sq->dsq != NULL) {
     ESL_DSQ *ptr = sq->dsq + 1;
-    if (fread(ptr, sizeof(char), size, ncbi->fppsq) != size) return eslEFORMAT;
+    if (ncbi->psq_mem != NULL) {
+      src = ncbi->psq_mem + sq->doff;
+    } else {
+      if (fread(ptr, sizeof(char), size, ncbi->fppsq) != size) return eslEFORMAT;
+      src = ptr;
+    }
     for (inx = 0; inx < size - 1; ++inx) {
-      *ptr = sqfp->inmap[(int) *ptr];
-      ++ptr;
+      ptr[inx] = sqfp->inmap[(int) src[inx]];
     }
-    *ptr = eslDSQ_SENTINEL;
+    ptr[inx] = eslDSQ_SENTINEL;
   } else {
     char *ptr = sq->seq;
-    if (fread(ptr, sizeof(char), size, ncbi->fppsq) != size) return eslEFORMAT;
+    if (ncbi->psq_mem != NULL) {
+      src = ncbi->psq_mem + sq->doff;
+    } else {
+      if (fread(ptr, sizeof(char), size, ncbi->fppsq) != size) return eslEFORMAT;
+      src = (unsigned char *) ptr;
+    }
     for (inx = 0; inx < size - 1; ++inx) {
-      *ptr = sqfp->inmap[(int) *ptr];
-      *ptr = ncbi->alphasym[(int) *ptr];
-      ++ptr;
+      ptr[inx] = ncbi->alphasym[(int) sqfp->inmap[(int) src[inx]]];
     }
-    *ptr = '\0';
+    ptr[inx] = '\0';
   }
 
   sq->start = 1;
@@ -1655,8 +1799,10 @@ read_dna(ESL_SQFILE *sqfp, ESL_SQ *sq)
 
   char    *ptr;
   void    *t;
+  char     code[4];
 
-  unsigned char c;
+  unsigned char        c;
+  const unsigned char *buf;
 
   ESL_SQNCBI_DATA *ncbi = &sqfp->data.ncbi;
 
@@ -1667,14 +1813,20 @@ read_dna(ESL_SQFILE *sqfp, ESL_SQ *sq)
    * before the real size can be figured out.
    */
   size = sq->eoff - sq->doff;
-  if (ncbi->hdr_alloced < size) {
-    while (ncbi->hdr_alloced < size) ncbi->hdr_alloced += ncbi->hdr_alloced;
-    ESL_RALLOC(ncbi->hdr_buf, t, sizeof(char) * ncbi->hdr_alloced);
+  if (ncbi->psq_mem != NULL) {
+    if (sq->eoff > ncbi->psq_n) return eslEFORMAT;
+    buf = ncbi->psq_mem + sq->doff;
+  } else {
+    if (ncbi->hdr_alloced < size) {
+      while (ncbi->hdr_alloced < size) ncbi->hdr_alloced += ncbi->hdr_alloced;
+      ESL_RALLOC(ncbi->hdr_buf, t, sizeof(char) * ncbi->hdr_alloced);
+    }
+    if (fread(ncbi->hdr_buf, sizeof(char), size, ncbi->fppsq) != size) return eslEFORMAT;
+    buf = ncbi->hdr_buf;
   }
-  if (fread(ncbi->hdr_buf, sizeof(char), size, ncbi->fppsq) != size) return eslEFORMAT;
 
   ssize     = ncbi->seq_apos - sq->doff - 1;
-  remainder = *(ncbi->hdr_buf + ssize) & 0x03;
+  remainder = *(buf + ssize) & 0x03;
   length    = ssize * 4 + remainder;
 
   /* figure out the sequence length */
@@ -1689,28 +1841,18 @@ read_dna(ESL_SQFILE *sqfp, ESL_SQ *sq)
     ptr = sq->seq;
   }
 
-  for (inx = 0; inx < ssize; ++inx) {
-    c = ncbi->hdr_buf[inx];
-    n = 1 << ((c >> 6) & 0x03);
-    *ptr = sqfp->inmap[n];
-    if (text) *ptr = ncbi->alphasym[(int) *ptr];
-    ++ptr;
-    n = 1 << ((c >> 4) & 0x03);
-    *ptr = sqfp->inmap[n];
-    if (text) *ptr = ncbi->alphasym[(int) *ptr];
-    ++ptr;
-    n = 1 << ((c >> 2) & 0x03);
-    *ptr = sqfp->inmap[n];
-    if (text) *ptr = ncbi->alphasym[(int) *ptr];
-    ++ptr;
-    n = 1 << ((c >> 0) & 0x03);
-    *ptr = sqfp->inmap[n];
-    if (text) *ptr = ncbi->alphasym[(int) *ptr];
-    ++ptr;
+  /* the four 2-bit codes, translated once */
+  for (n = 0; n < 4; ++n) {
+    code[n] = sqfp->inmap[1 << n];
+    if (text) code[n] = ncbi->alphasym[(int) code[n]];
   }
 
+  unpack_dna(buf, ssize, ptr, code);
+  ptr += ssize * 4;
+  inx  = ssize;
+
   /* handle the remainder */
-  c = ncbi->hdr_buf[inx];
+  c = buf[inx];
   for (inx = 0; inx < remainder; ++inx) {
     n = 1 << ((c >> (6 - inx * 2)) & 0x03);
     *ptr = sqfp->inmap[n];
@@ -1725,7 +1867,7 @@ read_dna(ESL_SQFILE *sqfp, ESL_SQ *sq)
    */
   amb32 = 0;
   if (ncbi->seq_apos - sq->doff < size) {
-    amb32 = ((ncbi->hdr_buf[ncbi->seq_apos - sq->doff] & 0x80) == 0);
+    amb32 = ((buf[ncbi->seq_apos - sq->doff] & 0x80) == 0);
   }
 
   /* skip past the count and start processing the abmiguity table */
@@ -1734,36 +1876,36 @@ read_dna(ESL_SQFILE *sqfp, ESL_SQ *sq)
 
   while (ssize < size) {
     /* get the ambiguity character */
-    n = ((ncbi->hdr_buf[ssize] >> 4) & 0x0f);
+    n = ((buf[ssize] >> 4) & 0x0f);
     c = sqfp->inmap[n];
     if (text) c = ncbi->alphasym[(int) c];
 
     if (amb32) {
       /* get the repeat count 4 bits */
-      cnt = (ncbi->hdr_buf[ssize] & 0x0f);
+      cnt = (buf[ssize] & 0x0f);
       cnt += 1;
 
       /* get the offset 24 bits */
-      off = ncbi->hdr_buf[ssize+1];
-      off = (off << 8) | ncbi->hdr_buf[ssize+2];
-      off = (off << 8) | ncbi->hdr_buf[ssize+3];
+      off = buf[ssize+1];
+      off = (off << 8) | buf[ssize+2];
+      off = (off << 8) | buf[ssize+3];
 
       for (inx = 0; inx < cnt; ++inx) ptr[off+inx] = c;
 
       ssize += 4;
     } else {
       /* get the repeat count 12 bits */
-      cnt = (ncbi->hdr_buf[ssize] & 0x0f);
-      cnt = (cnt << 8) | ncbi->hdr_buf[ssize+1];
+      cnt = (buf[ssize] & 0x0f);
+      cnt = (cnt << 8) | buf[ssize+1];
       cnt += 1;
 
       /* get the offset 48 bits*/
-      off = ncbi->hdr_buf[ssize+2];
-      off = (off << 8) | ncbi->hdr_buf[ssize+3];
-      off = (off << 8) | ncbi->hdr_buf[ssize+4];
-      off = (off << 8) | ncbi->hdr_buf[ssize+5];
-      off = (off << 8) | ncbi->hdr_buf[ssize+6];
-      off = (off << 8) | ncbi->hdr_buf[ssize+7];
+      off = buf[ssize+2];
+      off = (off << 8) | buf[ssize+3];
+      off = (off << 8) | buf[ssize+4];
+      off = (off << 8) | buf[ssize+5];
+      off = (off << 8) | buf[ssize+6];
+      off = (off << 8) | buf[ssize+7];
 
       for (inx = 0; inx < cnt; ++inx) ptr[off+inx] = c;
 
@@ -1797,6 +1939,7 @@ read_nres_amino(ESL_SQFILE *sqfp, ESL_SQ *sq, int len, uint64_t *nres)
   int     inx;
   int     off;
   int     size;
+  int     status;
 
   char   *ptr;
 
@@ -1825,9 +1968,8 @@ read_nres_amino(ESL_SQFILE *sqfp, ESL_SQ *sq, int len, uint64_t *nres)
   size = ncbi->seq_L - (sq->start + sq->n - 1);
   size = (size > len) ? len : size;
 
-  /* seek to the windows location and read into the buffer */
-  if (fseek(ncbi->fppsq, off, SEEK_SET) != 0) return eslESYS;
-  if (fread(ptr, sizeof(char), size, ncbi->fppsq) != size) return eslEFORMAT;
+  /* read the window into the buffer */
+  if ((status = read_db(ncbi->fppsq, ncbi->psq_mem, ncbi->psq_n, off, ptr, size)) != eslOK) return status;
 
   /* figure out if the sequence is in digital mode or not */
   for (inx = 0; inx < size; ++inx) {
@@ -1849,12 +1991,16 @@ read_nres_amino(ESL_SQFILE *sqfp, ESL_SQ *sq, int len, uint64_t *nres)
  * Synopsis:  Read in the dna sequence
  * Incept:    MSF, Thu Feb 4, 2010 [Janelia]
  *
- * Purpose:   Correct any ambiguity characters.
+ * Purpose:   Correct any ambiguity characters in the <len> residues
+ *            just read into a window of <sq>. As in <read_dna()>,
+ *            the ambiguity table runs from the end of the packed
+ *            sequence to the start of the next one; there may be
+ *            none.
  */
 static int
 correct_ambiguity(ESL_SQFILE *sqfp, ESL_SQ *sq, int len)
 {
-  int64_t   alen;         /* ambiguity length       */
+  int64_t   alen;         /* table bytes not yet read */
   int64_t   soff;         /* starting offset        */
   int64_t   eoff;         /* ending offset          */
   int64_t   ainx;         /* ambiguity index        */
@@ -1862,6 +2008,10 @@ correct_ambiguity(ESL_SQFILE *sqfp, ESL_SQ *sq, int len)
   int64_t   cnt;          /* repeat count           */
   int64_t   off;
   int64_t   n;
+  int64_t   inx;
+  off_t     apos;         /* disk offset in the table */
+  int       esize;        /* size of one table entry  */
+  int       status;
 
   int       amb32;        /* flag for 32 or 64 bits */
   char     *ptr;
@@ -1870,14 +2020,16 @@ correct_ambiguity(ESL_SQFILE *sqfp, ESL_SQ *sq, int len)
 
   ESL_SQNCBI_DATA *ncbi = &sqfp->data.ncbi;
 
-  if (ncbi->seq_alen == 0) return eslOK;
+  if (ncbi->seq_apos + 4 > ncbi->eoff) return eslOK;  /* no table */
 
   /* go to the start of the ambiguity table and see if the table
    * is in 32 or 64 bit entries.
    */
-  if (fseek(ncbi->fppsq, ncbi->seq_apos, SEEK_SET)       != 0) return eslESYS;
-  if (fread(ncbi->hdr_buf, sizeof(char), 4, ncbi->fppsq) != 4) return eslEFORMAT;
+  apos = ncbi->seq_apos;
+  if ((status = read_db(ncbi->fppsq, ncbi->psq_mem, ncbi->psq_n, apos, ncbi->hdr_buf, 4)) != eslOK) return status;
   amb32 = ((ncbi->hdr_buf[0] & 0x80) == 0);
+  esize = amb32 ? 4 : 8;
+  apos += 4;
 
   ptr = (sq->dsq != NULL) ? (char *)sq->dsq + 1 : sq->seq;
   ptr += sq->n;
@@ -1886,16 +2038,16 @@ correct_ambiguity(ESL_SQFILE *sqfp, ESL_SQ *sq, int len)
   soff = sq->start + sq->n - 1;
   eoff = soff + len;
 
-  off = 0;
   ainx = 0;
   size = 0;
-  alen = ncbi->seq_alen - 4;
-  while (off < eoff) {
+  alen = ncbi->eoff - apos;
+  while (ainx + esize <= size || alen >= esize) {
     /* check if we need to read in more of the  abmiguity table */
-    if (ainx == size) {
-      size = alen;
+    if (ainx + esize > size) {
+      size = alen - alen % esize;
       size = (size > INIT_HDR_BUFFER_SIZE) ? INIT_HDR_BUFFER_SIZE : size;
-      if (fread(ncbi->hdr_buf, sizeof(char), size, ncbi->fppsq) != size) return eslEFORMAT;
+      if ((status = read_db(ncbi->fppsq, ncbi->psq_mem, ncbi->psq_n, apos, ncbi->hdr_buf, size)) != eslOK) return status;
+      apos += size;
       alen -= size;
       ainx = 0;
     }
@@ -1914,8 +2066,6 @@ correct_ambiguity(ESL_SQFILE *sqfp, ESL_SQ *sq, int len)
       off = ncbi->hdr_buf[ainx+1];
       off = (off << 8) | ncbi->hdr_buf[ainx+2];
       off = (off << 8) | ncbi->hdr_buf[ainx+3];
-
-      ainx += 4;
     } else {
       /* get the repeat count 12 bits */
       cnt = (ncbi->hdr_buf[ainx] & 0x0f);
@@ -1929,18 +2079,11 @@ correct_ambiguity(ESL_SQFILE *sqfp, ESL_SQ *sq, int len)
       off = (off << 8) | ncbi->hdr_buf[ainx+5];
       off = (off << 8) | ncbi->hdr_buf[ainx+6];
       off = (off << 8) | ncbi->hdr_buf[ainx+7];
-
-      ainx += 8;
-    }
-
-    if (off + cnt >= soff && off < eoff) {
-      int inx;
-      int start = (off > soff) ? off - soff : 0;
-      int end   = (off + cnt > eoff) ? eoff : off - soff + cnt;
-      for (inx = start; inx < end; ++inx) ptr[inx] = c;
     }
+    ainx += esize;
 
-    off += cnt;
+    /* the part of the run that falls in the window */
+    for (inx = ESL_MAX(off, soff); inx < ESL_MIN(off + cnt, eoff); ++inx) ptr[inx - soff] = c;
   }
 
   return eslOK;
@@ -1971,6 +2114,7 @@ read_nres_dna(ESL_SQFILE *sqfp, ESL_SQ *sq, int len, uint64_t *nres)
 
   char   *ptr;
   void   *t;
+  char    code[4];
 
   unsigned char c;
 
@@ -1980,8 +2124,7 @@ read_nres_dna(ESL_SQFILE *sqfp, ESL_SQ *sq, int len, uint64_t *nres)
 
   /* if we don't know the sequence length, figure it out */
   if (ncbi->seq_L == -1) {
-    if (fseek(ncbi->fppsq, ncbi->seq_apos - 1, SEEK_SET) != 0) return eslESYS;
-    if (fread(&c, sizeof(char), 1, ncbi->fppsq) != 1)          return eslEFORMAT;
+    if ((status = read_db(ncbi->fppsq, ncbi->psq_mem, ncbi->psq_n, ncbi->seq_apos - 1, &c, 1)) != eslOK) return status;
 
     ssize       = ncbi->seq_apos - sq->doff - 1;
     remainder   = c & 0x03;
@@ -2012,13 +2155,12 @@ read_nres_dna(ESL_SQFILE *sqfp, ESL_SQ *sq, int len, uint64_t *nres)
   /* calculate bytes need to read in the window */
   ssize = (cnt + skip + 3) / 4;
 
-  /* seek to the windows location and read into the buffer */
-  if (fseek(ncbi->fppsq, off, SEEK_SET) != 0) return eslESYS;
+  /* read the window into the buffer */
   if (ncbi->hdr_alloced < ssize) {
     while (ncbi->hdr_alloced < ssize) ncbi->hdr_alloced += ncbi->hdr_alloced;
     ESL_RALLOC(ncbi->hdr_buf, t, sizeof(char) * ncbi->hdr_alloced);
   }
-  if (fread(ncbi->hdr_buf, sizeof(char), ssize, ncbi->fppsq) != ssize) return eslEFORMAT;
+  if ((status = read_db(ncbi->fppsq, ncbi->psq_mem, ncbi->psq_n, off, ncbi->hdr_buf, ssize)) != eslOK) return status;
 
   /* figure out if the sequence is in digital mode or not */
   if (sq->dsq != NULL) {
@@ -2039,24 +2181,15 @@ read_nres_dna(ESL_SQFILE *sqfp, ESL_SQ *sq, int len, uint64_t *nres)
     ++ptr;
   }
 
-  for (inx = 1; inx < ssize - 1; ++inx) {
-    c = ncbi->hdr_buf[inx];
-    n = 1 << ((c >> 6) & 0x03);
-    *ptr = sqfp->inmap[n];
-    if (text) *ptr = ncbi->alphasym[(int) *ptr];
-    ++ptr;
-    n = 1 << ((c >> 4) & 0x03);
-    *ptr = sqfp->inmap[n];
-    if (text) *ptr = ncbi->alphasym[(int) *ptr];
-    ++ptr;
-    n = 1 << ((c >> 2) & 0x03);
-    *ptr = sqfp->inmap[n];
-    if (text) *ptr = ncbi->alphasym[(int) *ptr];
-    ++ptr;
-    n = 1 << ((c >> 0) & 0x03);
-    *ptr = sqfp->inmap[n];
-    if (text) *ptr = ncbi->alphasym[(int) *ptr];
-    ++ptr;
+  for (n = 0; n < 4; ++n) {
+    code[n] = sqfp->inmap[1 << n];
+    if (text) code[n] = ncbi->alphasym[(int) code[n]];
+  }
+  inx = 1;
+  if (ssize > 2) {
+    unpack_dna(ncbi->hdr_buf + 1, ssize - 2, ptr, code);
+    ptr += (ssize - 2) * 4;
+    inx  = ssize - 1;
   }
 
   /* handle the remainder */
@@ -2075,7 +2208,7 @@ read_nres_dna(ESL_SQFILE *sqfp, ESL_SQ *sq, int len, uint64_t *nres)
 
   /* start processing the abmiguity table if there is one */
   if (ncbi->seq_alen > 0) {
-    correct_ambiguity(sqfp, sq, ncnt);
+    if ((status = correct_ambiguity(sqfp, sq, ncnt)) != eslOK) return status;
   }
 
   sq->n = sq->n + ncnt;
@@ -2089,6 +2222,53 @@ read_nres_dna(ESL_SQFILE *sqfp, ESL_SQ *sq, int len, uint64_t *nres)
 }
 
 
+/* unpack_dna()
+ *
+ * Unpack <nbytes> bytes of ncbi 2-bit dna <src>, four residues to
+ * a byte with the first in the high bits, into <dst>, translating
+ * each 2-bit value through <code[0..3]>. With SSSE3, 16 bytes are
+ * split into their four fields, looked up with a byte shuffle and
+ * interleaved back in order, 64 residues at a time.
+ */
+static void
+unpack_dna(const unsigned char *src, int64_t nbytes, char *dst, const char *code)
+{
+  int64_t i = 0;
+
+#ifdef eslSQNCBI_SSSE3
+  __m128i tbl  = _mm_setr_epi8(code[0], code[1], code[2], code[3], 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  __m128i mask = _mm_set1_epi8(0x03);
+  __m128i v, f0, f1, f2, f3, a, b;
+
+  for (; i + 16 <= nbytes; i += 16, dst += 64)
+    {
+      v  = _mm_loadu_si128((const __m128i *) (src + i));
+      f0 = _mm_shuffle_epi8(tbl, _mm_and_si128(_mm_srli_epi16(v, 6), mask));
+      f1 = _mm_shuffle_epi8(tbl, _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+      f2 = _mm_shuffle_epi8(tbl, _mm_and_si128(_mm_srli_epi16(v, 2), mask));
+      f3 = _mm_shuffle_epi8(tbl, _mm_and_si128(v,                    mask));
+
+      a = _mm_unpacklo_epi8(f0, f1);
+      b = _mm_unpacklo_epi8(f2, f3);
+      _mm_storeu_si128((__m128i *) (dst),      _mm_unpacklo_epi16(a, b));
+      _mm_storeu_si128((__m128i *) (dst + 16), _mm_unpackhi_epi16(a, b));
+      a = _mm_unpackhi_epi8(f0, f1);
+      b = _mm_unpackhi_epi8(f2, f3);
+      _mm_storeu_si128((__m128i *) (dst + 32), _mm_unpacklo_epi16(a, b));
+      _mm_storeu_si128((__m128i *) (dst + 48), _mm_unpackhi_epi16(a, b));
+    }
+#endif
+
+  for (; i < nbytes; ++i)
+    {
+      *dst++ = code[(src[i] >> 6) & 0x03];
+      *dst++ = code[(src[i] >> 4) & 0x03];
+      *dst++ = code[(src[i] >> 2) & 0x03];
+      *dst++ = code[(src[i]     ) & 0x03];
+    }
+}
+
+
 /* Function:  inmap_ncbi()
  * Synopsis:  Set up a translation map
  * Incept:    MSF, Mon Dec 10, 2009 [Janelia]
@@ -2429,12 +2609,19 @@ parse_header(ESL_SQNCBI_DATA *ncbi, ESL_SQ *sq)
   reset_header_values(ncbi);
   size  = ncbi->hoff - ncbi->roff;
 
-  /* read in the header data */
+  /* read in the header data.  even from a mapping it's copied,
+   * because the parser terminates the strings it finds in place.
+   */
   if (ncbi->hdr_alloced < size) {
     while (ncbi->hdr_alloced < size) ncbi->hdr_alloced += ncbi->hdr_alloced;
     ESL_RALLOC(ncbi->hdr_buf, tmp, sizeof(char) * ncbi->hdr_alloced);
   }
-  if (fread(ncbi->hdr_buf, sizeof(char), size, ncbi->fpphr) != size) return eslEFORMAT;
+  if (ncbi->phr_mem != NULL) {
+    if (ncbi->hoff > ncbi->phr_n) return eslEFORMAT;
+    memcpy(ncbi->hdr_buf, ncbi->phr_mem + ncbi->roff, size);
+  } else {
+    if (fread(ncbi->hdr_buf, sizeof(char), size, ncbi->fpphr) != size) return eslEFORMAT;
+  }
   ncbi->hdr_ptr = ncbi->hdr_buf;
 
   /* verify we are at the beginning of a structure */
@@ -3280,6 +3467,331 @@ ignore_sequence_of_integer(ESL_SQNCBI_DATA *ncbi)
 }
 
 
+/*****************************************************************
+ *# 6. Unit tests.
+ *****************************************************************/
+#ifdef eslSQNCBI_TESTDRIVE
+#include "esl_random.h"
+
+/* utest_unpack()
+ * unpack_dna() must give four residues per byte, high bits first,
+ * for any length: the SSSE3 path takes 16 bytes at a time and the
+ * scalar loop finishes the rest. Nothing may be written past the
+ * 4*<nbytes> residues.
+ */
+static void
+utest_unpack(ESL_RANDOMNESS *r)
+{
+  char          msg[]     = "ncbi unpack_dna() unit test failed";
+  char          code[4]   = { 'A', 'C', 'G', 'T' };
+  unsigned char known[17] = { 0x1b, 0xe4, 0x00, 0xff, 0x1b, 0xe4, 0x00, 0xff,
+			      0x1b, 0xe4, 0x00, 0xff, 0x1b, 0xe4, 0x00, 0xff, 0x6c };
+  unsigned char src[100];
+  char          dst[4*100+1];
+  int64_t       nbytes;
+  int64_t       i;
+  int           j;
+
+  /* known bytes: ACGT TGCA AAAA TTTT, four times, then CGTA */
+  unpack_dna(known, 17, dst, code);
+  if (strncmp(dst,      "ACGTTGCAAAAATTTT", 16) != 0) esl_fatal(msg);
+  if (strncmp(dst + 48, "ACGTTGCAAAAATTTT", 16) != 0) esl_fatal(msg);
+  if (strncmp(dst + 64, "CGTA",              4) != 0) esl_fatal(msg);
+
+  for (i = 0; i < 100; i++) src[i] = esl_rnd_Roll(r, 256);
+  for (nbytes = 0; nbytes <= 100; nbytes++)
+    {
+      memset(dst, '*', sizeof(dst));
+      unpack_dna(src, nbytes, dst, code);
+      for (i = 0; i < nbytes; i++)
+	for (j = 0; j < 4; j++)
+	  if (dst[4*i+j] != code[(src[i] >> (6 - 2*j)) & 0x03]) esl_fatal(msg);
+      if (dst[4*nbytes] != '*') esl_fatal(msg);
+    }
+}
+
+/* write_be32()
+ * Write <v> as four big-endian bytes, as ncbi databases store it.
+ */
+static void
+write_be32(FILE *fp, uint32_t v)
+{
+  fputc((v >> 24) & 0xff, fp);
+  fputc((v >> 16) & 0xff, fp);
+  fputc((v >>  8) & 0xff, fp);
+  fputc( v        & 0xff, fp);
+}
+
+/* write_test_db()
+ * Write <seq[0..nseq-1]> as a version 4 ncbi dna database
+ * <basename>.nin, .nhr, .nsq. Sequence <i> is named "seq<i>".
+ * Each run of a degenerate residue goes in the ambiguity table,
+ * in 64-bit entries if <i> is odd, else in 32-bit entries.
+ * The header is a minimal Blast-def-line-set: a title, and a
+ * BL_ORD_ID general seq-id.
+ */
+static void
+write_test_db(const char *basename, char **seq, int nseq)
+{
+  char          msg[]     = "ncbi test db writing failed";
+  unsigned char hdr_pre[] = { 0x30, 0x80, 0x30, 0x80, 0xa0, 0x80, 0x1a };
+  unsigned char hdr_post[] = { 0x00, 0x00, 0xa1, 0x80, 0x30, 0x80, 0xaa, 0x80, 0x30, 0x80, 0xa0, 0x80,
+			       0x1a, 0x09, 'B', 'L', '_', 'O', 'R', 'D', '_', 'I', 'D', 0x00, 0x00,
+			       0xa1, 0x80, 0xa0, 0x80, 0x02, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+			       0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xa2, 0x80, 0x02, 0x01, 0x00,
+			       0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+  const char   *ncbisym   = "-ACMGRSVTWYHKDBN";
+  uint32_t     *hoff      = malloc(sizeof(uint32_t) * (nseq+1));
+  uint32_t     *soff      = malloc(sizeof(uint32_t) * (nseq+1));
+  uint32_t     *aoff      = malloc(sizeof(uint32_t) * (nseq+1));
+  char         *fname     = NULL;
+  FILE         *hfp, *sfp, *ifp;
+  uint64_t      totres    = 0;
+  uint32_t      maxlen    = 0;
+  unsigned char b;
+  char          title[32];
+  int           i, j, k, n, L, nrun, runlen, maxrun;
+
+  if (hoff == NULL || soff == NULL || aoff == NULL) esl_fatal(msg);
+
+  esl_sprintf(&fname, "%s.nhr", basename); if ((hfp = fopen(fname, "wb")) == NULL) esl_fatal(msg); free(fname);
+  esl_sprintf(&fname, "%s.nsq", basename); if ((sfp = fopen(fname, "wb")) == NULL) esl_fatal(msg); free(fname);
+  esl_sprintf(&fname, "%s.nin", basename); if ((ifp = fopen(fname, "wb")) == NULL) esl_fatal(msg); free(fname);
+
+  hoff[0] = 0;
+  fputc(0, sfp);		/* the .nsq file starts with a sentinel byte */
+  for (i = 0; i < nseq; i++)
+    {
+      L = strlen(seq[i]);
+      totres += L;
+      maxlen  = ESL_MAX(maxlen, L);
+
+      n = snprintf(title, sizeof(title), "seq%d len%d", i, L);
+      fwrite(hdr_pre,  1, sizeof(hdr_pre),  hfp);
+      fputc(n, hfp);
+      fwrite(title,    1, n,                hfp);
+      fwrite(hdr_post, 1, sizeof(hdr_post), hfp);
+      hoff[i+1] = ftell(hfp);
+
+      /* 2-bit residues, four to a byte; degenerate ones are stored as A.
+       * The last byte holds L%4 residues, and L%4 in its low 2 bits.
+       */
+      soff[i] = ftell(sfp);
+      for (j = 0, b = 0; j < L; j++)
+	{
+	  b = (b << 2) | (strchr("ACGT", seq[i][j]) ? (strchr("ACGT", seq[i][j]) - "ACGT") : 0);
+	  if (j % 4 == 3) { fputc(b, sfp); b = 0; }
+	}
+      fputc(((b << (2 * (4 - L%4))) & 0xfc) | (L%4), sfp);
+      aoff[i] = ftell(sfp);
+
+      /* the ambiguity table, if any */
+      maxrun = (i % 2) ? 4096 : 16;
+      for (nrun = 0, j = 0; j < L; j += runlen) {
+	for (runlen = 1; j+runlen < L && seq[i][j+runlen] == seq[i][j] && runlen < maxrun; runlen++) ;
+	if (! strchr("ACGT", seq[i][j])) nrun++;
+      }
+      if (nrun == 0) continue;
+
+      write_be32(sfp, (i % 2) ? (0x80000000 | nrun) : nrun);
+      for (j = 0; j < L; j += runlen)
+	{
+	  for (runlen = 1; j+runlen < L && seq[i][j+runlen] == seq[i][j] && runlen < maxrun; runlen++) ;
+	  if (strchr("ACGT", seq[i][j])) continue;
+	  k = strchr(ncbisym, seq[i][j]) - ncbisym;
+	  if (i % 2) {
+	    write_be32(sfp, ((uint32_t) k << 28) | ((uint32_t) (runlen-1) << 16));
+	    write_be32(sfp, j);
+	  } else {
+	    write_be32(sfp, ((uint32_t) k << 28) | ((uint32_t) (runlen-1) << 24) | j);
+	  }
+	}
+    }
+  soff[nseq] = aoff[nseq] = ftell(sfp);
+
+  write_be32(ifp, NCBI_VERSION_4);
+  write_be32(ifp, NCBI_DNA_DB);
+  write_be32(ifp, 4); fwrite("test", 1, 4, ifp);
+  write_be32(ifp, 3); fwrite("now",  1, 3, ifp);
+  write_be32(ifp, nseq);
+  fwrite(&totres, sizeof(uint64_t), 1, ifp); /* native byte order, as the reader takes it */
+  write_be32(ifp, maxlen);
+  for (i = 0; i <= nseq; i++) write_be32(ifp, hoff[i]);
+  for (i = 0; i <= nseq; i++) write_be32(ifp, soff[i]);
+  for (i = 0; i <= nseq; i++) write_be32(ifp, aoff[i]);
+
+  fclose(hfp);
+  fclose(sfp);
+  fclose(ifp);
+  free(hoff);
+  free(soff);
+  free(aoff);
+}
+
+/* utest_read_dna()
+ * Sequences of lengths that aren't multiples of 4 or 16, with runs of
+ * degenerate residues in both 32- and 64-bit ambiguity tables, must
+ * come back exactly as written: read whole, in text and digital mode,
+ * and in windows.
+ */
+static void
+utest_read_dna(ESL_RANDOMNESS *r)
+{
+  char          msg[]      = "ncbi dna reading unit test failed";
+  int           len[]      = { 1, 2, 3, 4, 5, 15, 16, 17, 63, 64, 65, 67, 129, 200, 1001 };
+  int           nseq       = sizeof(len) / sizeof(int);
+  char        **seq        = malloc(sizeof(char *) * nseq);
+  char          basename[] = "esltmpXXXXXX";
+  const char   *degen      = "NRYKMSWBDHV";
+  ESL_ALPHABET *abc        = esl_alphabet_Create(eslDNA);
+  ESL_SQFILE   *sqfp       = NULL;
+  ESL_SQ       *sq         = NULL;
+  FILE         *fp         = NULL;
+  char         *fname      = NULL;
+  char          name[32];
+  int           W;
+  int           i, j, k, p, n;
+  int           status;
+
+  if (seq == NULL) esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    {
+      if ((seq[i] = malloc(len[i] + 1)) == NULL) esl_fatal(msg);
+      for (j = 0; j < len[i]; j++) seq[i][j] = "ACGT"[esl_rnd_Roll(r, 4)];
+      seq[i][len[i]] = '\0';
+      if (i % 3 == 2) continue;	/* some have no ambiguity table */
+
+      seq[i][0]          = degen[esl_rnd_Roll(r, 11)];
+      seq[i][len[i] - 1] = degen[esl_rnd_Roll(r, 11)];
+      for (k = 0; k < 5; k++) {
+	p = esl_rnd_Roll(r, len[i]);
+	n = 1 + esl_rnd_Roll(r, (i % 2) ? 40 : 20); /* runs longer than 16 split in a 32-bit table */
+	for (j = p; j < len[i] && j < p + n; j++) seq[i][j] = degen[k];
+      }
+    }
+
+  if (esl_tmpfile_named(basename, &fp) != eslOK) esl_fatal(msg);
+  fclose(fp);
+  write_test_db(basename, seq, nseq);
+
+  /* whole sequences, text mode */
+  if (esl_sqfile_Open(basename, eslSQFILE_NCBI, NULL, &sqfp) != eslOK) esl_fatal(msg);
+  sq = esl_sq_Create();
+  for (i = 0; (status = esl_sqio_Read(sqfp, sq)) == eslOK; i++)
+    {
+      snprintf(name, sizeof(name), "seq%d", i);
+      if (i >= nseq)                     esl_fatal(msg);
+      if (strcmp(sq->name, name)  != 0)  esl_fatal(msg);
+      if (sq->n != len[i])               esl_fatal(msg);
+      if (strcmp(sq->seq, seq[i]) != 0)  esl_fatal(msg);
+      esl_sq_Reuse(sq);
+    }
+  if (status != eslEOF || i != nseq)     esl_fatal(msg);
+  esl_sq_Destroy(sq);
+  esl_sqfile_Close(sqfp);
+
+  /* whole sequences, digital mode */
+  if (esl_sqfile_OpenDigital(abc, basename, eslSQFILE_NCBI, NULL, &sqfp) != eslOK) esl_fatal(msg);
+  sq = esl_sq_CreateDigital(abc);
+  for (i = 0; (status = esl_sqio_Read(sqfp, sq)) == eslOK; i++)
+    {
+      if (i >= nseq || sq->n != len[i]) esl_fatal(msg);
+      for (j = 0; j < len[i]; j++)
+	if (abc->sym[sq->dsq[j+1]] != seq[i][j]) esl_fatal(msg);
+      if (sq->dsq[len[i]+1] != eslDSQ_SENTINEL) esl_fatal(msg);
+      esl_sq_Reuse(sq);
+    }
+  if (status != eslEOF || i != nseq)     esl_fatal(msg);
+  esl_sq_Destroy(sq);
+  esl_sqfile_Close(sqfp);
+
+  /* windows, digital mode */
+  for (W = 1; W <= 70; W += 23)
+    {
+      if (esl_sqfile_OpenDigital(abc, basename, eslSQFILE_NCBI, NULL, &sqfp) != eslOK) esl_fatal(msg);
+      sq = esl_sq_CreateDigital(abc);
+      i  = 0;
+      while ((status = esl_sqio_ReadWindow(sqfp, 0, W, sq)) != eslEOF)
+	{
+	  if (status == eslEOD) { esl_sq_Reuse(sq); i++; continue; }
+	  if (status != eslOK)            esl_fatal(msg);
+	  if (i >= nseq)                  esl_fatal(msg);
+	  for (j = 0; j < sq->n; j++)
+	    if (abc->sym[sq->dsq[j+1]] != seq[i][sq->start - 1 + j]) esl_fatal(msg);
+	}
+      if (i != nseq) esl_fatal(msg);
+      esl_sq_Destroy(sq);
+      esl_sqfile_Close(sqfp);
+    }
+
+  esl_sprintf(&fname, "%s.nin", basename); remove(fname); free(fname);
+  esl_sprintf(&fname, "%s.nhr", basename); remove(fname); free(fname);
+  esl_sprintf(&fname, "%s.nsq", basename); remove(fname); free(fname);
+  remove(basename);
+  for (i = 0; i < nseq; i++) free(seq[i]);
+  free(seq);
+  esl_alphabet_Destroy(abc);
+}
+#endif /*eslSQNCBI_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+/*****************************************************************
+ *# 7. Test driver.
+ *****************************************************************/
+#ifdef eslSQNCBI_TESTDRIVE
+/* compile: gcc -g -Wall -I. -L. -o esl_sqio_ncbi_utest -DeslSQNCBI_TESTDRIVE esl_sqio_ncbi.c -leasel -lm
+ *  (SSSE3): add -mssse3, to test the byte shuffle unpacking of dna
+ * run:     ./esl_sqio_ncbi_utest
+ */
+#include "esl_config.h"
+
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+static ESL_OPTIONS options[] = {
+   /* name  type         default  env   range togs  reqs  incomp  help                docgrp */
+  {"-h",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show help and usage",                            0},
+  {"-s",  eslARG_INT,       "0", NULL, NULL, NULL, NULL, NULL, "set random number seed to <n>",                  0},
+  {"-v",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show verbose commentary/output",                 0},
+  { 0,0,0,0,0,0,0,0,0,0},
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for ncbi sequence database module";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r  = NULL;
+
+#if defined(eslSQNCBI_SSSE3) && defined(__GNUC__)
+  /* a -mssse3 build on a processor without SSSE3 has nothing to test */
+  if (! __builtin_cpu_supports("ssse3")) { printf("no SSSE3 on this processor; skipped\n"); esl_getopts_Destroy(go); return 0; }
+#endif
+
+  r = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  if (esl_opt_GetBoolean(go, "-v")) {
+#ifdef eslSQNCBI_SSSE3
+    printf("SSSE3 unpacking; ");
+#endif
+    printf("rng seed %" PRIu32 "\n", esl_randomness_GetSeed(r));
+  }
+
+  utest_unpack(r);
+  utest_read_dna(r);
+
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*eslSQNCBI_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
+
+
 /*****************************************************************
  * Easel - a library of C functions for biological sequence analysis
  * Version h3.1b2; February 2015
@@ -0,0 +1,800 @@
+/* Pipelined, multithreaded reading of sequence blocks.
+ *
+ * An <ESL_SQPIPE> reads an open sequence file as a stream of
+ * <ESL_SQ_BLOCK>s, the same blocks <esl_sqio_ReadBlock()> would
+ * return, with the work spread over several threads. One splitter
+ * thread reads the file and finds record boundaries; several parser
+ * threads parse (and digitize) the records, each into a block of its
+ * own. Callers receive finished blocks in file order, and hand them
+ * back to the pipe for reuse when they're done with them, so a fixed
+ * number of blocks circulate and no sequence memory is reallocated
+ * in steady state. The blocks are arena blocks (see
+ * <esl_sq_CreateArenaBlock()>): each block's sequences lie one after
+ * another in a single allocation, and are read-only views.
+ *
+ * Only unaligned FASTA is parsed in parallel. The splitter reads other
+ * formats into blocks itself with <esl_sqio_ReadBlock()>, so for them
+ * the pipe only overlaps input with the caller's processing.
+ *
+ * Contents:
+ *    1. The <ESL_SQPIPE> object.
+ *    2. Internal functions: splitter and parser threads.
+ *    3. Unit tests.
+ *    4. Test driver.
+ *    5. Benchmark.
+ *    6. Copyright and license.
+ */
+#include "esl_config.h"
+
+#ifdef HAVE_PTHREAD
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "easel.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+#include "esl_sqpipe.h"
+
+static void *splitter_thread(void *arg);
+static void *parser_thread  (void *arg);
+
+/*****************************************************************
+ *# 1. The <ESL_SQPIPE> object.
+ *****************************************************************/
+
+/* Function:  esl_sqpipe_Create()
+ * Synopsis:  Start reading a sequence file with a pipeline of threads.
+ *
+ * Purpose:   Create a pipe that reads open sequence file <sqfp> as a
+ *            stream of blocks, with <ncpu> parser threads and one
+ *            splitter thread. <nblocks> blocks circulate between the
+ *            threads and the callers; each holds up to
+ *            <max_sequences> sequences, and about <max_residues>
+ *            residues. On the FASTA fast path a block ends at the
+ *            first record boundary after <max_residues> bytes of
+ *            text, so every block but the last holds at least one
+ *            sequence. For other formats, <max_residues> is passed on
+ *            to <esl_sqio_ReadBlock()>.
+ *
+ *            Pass 0 for any of <nblocks>, <max_residues>, or
+ *            <max_sequences> to get the defaults: <2*(ncpu+1)>
+ *            blocks, <MAX_RESIDUE_COUNT> residues, and
+ *            <eslSQPIPE_MAXSEQ> sequences.
+ *
+ *            If <sqfp> is digital, the blocks are digital too.
+ *            The blocks are arena blocks, so callers may look at
+ *            their sequences and change residues in place, but
+ *            must <esl_sq_Copy()> a sequence out to do anything
+ *            that would reallocate it.
+ *
+ *            The pipe starts reading right away. The caller must not
+ *            use <sqfp> until the pipe is destroyed. Long-target
+ *            windowed reading isn't supported; use
+ *            <esl_sqio_ReadBlock()> for that.
+ *
+ * Returns:   a pointer to the new pipe.
+ *
+ * Throws:    <NULL> on allocation or thread creation failure.
+ */
+ESL_SQPIPE *
+esl_sqpipe_Create(ESL_SQFILE *sqfp, int ncpu, int nblocks, int max_residues, int max_sequences)
+{
+  ESL_SQPIPE *sqp = NULL;
+  int64_t     arena_size;
+  int         nthreads;
+  int         i;
+  int         status;
+
+  if (ncpu          < 1) ncpu          = 1;
+  if (nblocks       < 1) nblocks       = 2 * (ncpu + 1);
+  if (max_residues  < 1) max_residues  = MAX_RESIDUE_COUNT;
+  if (max_sequences < 1) max_sequences = eslSQPIPE_MAXSEQ;
+  arena_size = (int64_t) max_residues + (int64_t) max_sequences * 64; /* residues, plus a guess at names; arenas grow as needed */
+
+  ESL_ALLOC(sqp, sizeof(ESL_SQPIPE));
+  sqp->sqfp          = sqfp;
+  sqp->fastpath      = (sqfp->format == eslSQFILE_FASTA && ! sqfp->data.ascii.is_linebased);
+  sqp->max_residues  = max_residues;
+  sqp->max_sequences = max_sequences;
+  sqp->slot          = NULL;
+  sqp->nslots        = 0;
+  sqp->nsplit        = 0;
+  sqp->nout          = 0;
+  sqp->nseq          = 0;
+  sqp->split_done    = FALSE;
+  sqp->split_status  = eslOK;
+  sqp->status        = eslOK;
+  sqp->shutdown      = FALSE;
+  sqp->errbuf[0]       = '\0';
+  sqp->split_errbuf[0] = '\0';
+  sqp->tid           = NULL;
+  sqp->nthreads      = 0;
+
+  if (pthread_mutex_init(&sqp->lock, NULL) != 0) { free(sqp); esl_exception(eslESYS, FALSE, __FILE__, __LINE__, "mutex init failed"); return NULL; }
+  if (pthread_cond_init (&sqp->cond, NULL) != 0) { pthread_mutex_destroy(&sqp->lock); free(sqp); esl_exception(eslESYS, FALSE, __FILE__, __LINE__, "cond init failed"); return NULL; }
+
+  ESL_ALLOC(sqp->slot, sizeof(ESL_SQPIPE_SLOT) * nblocks);
+  for (i = 0; i < nblocks; i++)
+    {
+      sqp->slot[i].state  = eslSQPIPE_FREE;
+      sqp->slot[i].seqno  = -1;
+      sqp->slot[i].buf    = NULL;
+      sqp->slot[i].n      = 0;
+      sqp->slot[i].balloc = 0;
+      sqp->slot[i].status = eslOK;
+      sqp->slot[i].blk    = NULL;
+    }
+  sqp->nslots = nblocks;
+  for (i = 0; i < nblocks; i++)
+    {
+      if (sqfp->do_digital) sqp->slot[i].blk = esl_sq_CreateDigitalArenaBlock(max_sequences, sqfp->abc, arena_size);
+      else                  sqp->slot[i].blk = esl_sq_CreateArenaBlock(max_sequences, arena_size);
+      if (sqp->slot[i].blk == NULL) { status = eslEMEM; goto ERROR; }
+    }
+
+  nthreads = (sqp->fastpath ? ncpu + 1 : 1);
+  ESL_ALLOC(sqp->tid, sizeof(pthread_t) * nthreads);
+  for (i = 0; i < nthreads; i++)
+    {
+      if (pthread_create(&(sqp->tid[i]), NULL, (i == 0 ? splitter_thread : parser_thread), sqp) != 0)
+	{ esl_exception(eslESYS, FALSE, __FILE__, __LINE__, "thread creation failed"); goto ERROR; }
+      sqp->nthreads++;
+    }
+  return sqp;
+
+ ERROR:
+  esl_sqpipe_Destroy(sqp);
+  return NULL;
+}
+
+
+/* Function:  esl_sqpipe_Read()
+ * Synopsis:  Get the next block of sequences from a pipe.
+ *
+ * Purpose:   Wait for the next block of sequences from pipe <sqp>,
+ *            and return it in <*ret_block>. Blocks come in file
+ *            order, and <(*ret_block)->first_seqidx> is the index of
+ *            the block's first sequence in the file, counting from
+ *            0. The block belongs to the caller until it's given back
+ *            with <esl_sqpipe_Recycle()>.
+ *
+ *            Any number of threads may call this at once; each block
+ *            goes to one of them. A caller that holds on to blocks
+ *            stalls the pipe once all its blocks are out.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEOF> if there are no more sequences in the file.
+ *
+ *            <eslEFORMAT> on a parse error; <esl_sqpipe_GetErrorBuf()>
+ *            has an informative message, the same one
+ *            <esl_sqio_Read()> would have given. All sequences
+ *            before the error have been returned first, as they are
+ *            by <esl_sqio_Read()>.
+ *
+ *            Once this returns anything but <eslOK>, it keeps
+ *            returning the same thing. <*ret_block> is <NULL> on any
+ *            return but <eslOK>.
+ *
+ * Throws:    <eslEMEM> on allocation failure in the pipe.
+ */
+int
+esl_sqpipe_Read(ESL_SQPIPE *sqp, ESL_SQ_BLOCK **ret_block)
+{
+  ESL_SQPIPE_SLOT *s;
+  int              i;
+  int              status;
+
+  *ret_block = NULL;
+  pthread_mutex_lock(&sqp->lock);
+  while (sqp->status == eslOK)
+    {
+      for (s = NULL, i = 0; i < sqp->nslots; i++)
+	if (sqp->slot[i].state != eslSQPIPE_FREE && sqp->slot[i].state != eslSQPIPE_OUT && sqp->slot[i].seqno == sqp->nout)
+	  { s = sqp->slot + i; break; }
+
+      if (s != NULL && s->state == eslSQPIPE_DONE)
+	{
+	  /* a block that failed still holds the sequences before the error: give them out first */
+	  if (s->status != eslOK) { sqp->status = s->status; strcpy(sqp->errbuf, s->errbuf); }
+	  sqp->nout++;
+	  if (s->blk->count == 0) { s->state = eslSQPIPE_FREE; pthread_cond_broadcast(&sqp->cond); continue; }
+
+	  s->blk->first_seqidx = sqp->nseq;
+	  sqp->nseq += s->blk->count;
+	  s->state   = eslSQPIPE_OUT;
+	  *ret_block = s->blk;
+	  pthread_mutex_unlock(&sqp->lock);
+	  return eslOK;
+	}
+      if (s == NULL && sqp->split_done && sqp->nout == sqp->nsplit)
+	{ sqp->status = sqp->split_status; strcpy(sqp->errbuf, sqp->split_errbuf); break; }
+
+      pthread_cond_wait(&sqp->cond, &sqp->lock);
+    }
+  status = sqp->status;
+  pthread_mutex_unlock(&sqp->lock);
+  return status;
+}
+
+
+/* Function:  esl_sqpipe_Recycle()
+ * Synopsis:  Give a block back to a pipe.
+ *
+ * Purpose:   Return <block>, which the caller got from
+ *            <esl_sqpipe_Read()> on pipe <sqp>, so the pipe can read
+ *            more sequences into it. The caller must not use it
+ *            afterwards.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <block> isn't a block that <sqp> gave out.
+ */
+int
+esl_sqpipe_Recycle(ESL_SQPIPE *sqp, ESL_SQ_BLOCK *block)
+{
+  int i;
+
+  pthread_mutex_lock(&sqp->lock);
+  for (i = 0; i < sqp->nslots; i++)
+    if (sqp->slot[i].blk == block && sqp->slot[i].state == eslSQPIPE_OUT) break;
+  if (i < sqp->nslots)
+    {
+      sqp->slot[i].state = eslSQPIPE_FREE;
+      pthread_cond_broadcast(&sqp->cond);
+    }
+  pthread_mutex_unlock(&sqp->lock);
+
+  if (i == sqp->nslots) ESL_EXCEPTION(eslEINVAL, "not a block that this pipe gave out");
+  return eslOK;
+}
+
+
+/* Function:  esl_sqpipe_GetErrorBuf()
+ * Synopsis:  Return the error message of a failed pipe.
+ *
+ * Purpose:   After <esl_sqpipe_Read()> has returned an error, return
+ *            a pointer to its informative message.
+ */
+const char *
+esl_sqpipe_GetErrorBuf(const ESL_SQPIPE *sqp)
+{
+  return sqp->errbuf;
+}
+
+
+/* Function:  esl_sqpipe_Destroy()
+ * Synopsis:  Stop a pipe and free it.
+ *
+ * Purpose:   Stop the threads of pipe <sqp> and free it, including
+ *            all its blocks; blocks that callers haven't recycled
+ *            become invalid too. <sqp> may be destroyed at any time;
+ *            it doesn't need to be read to the end. The sequence file
+ *            it was reading is left open, at some unspecified
+ *            position.
+ */
+void
+esl_sqpipe_Destroy(ESL_SQPIPE *sqp)
+{
+  int i;
+
+  if (sqp == NULL) return;
+
+  pthread_mutex_lock(&sqp->lock);
+  sqp->shutdown = TRUE;
+  pthread_cond_broadcast(&sqp->cond);
+  pthread_mutex_unlock(&sqp->lock);
+  for (i = 0; i < sqp->nthreads; i++) pthread_join(sqp->tid[i], NULL);
+
+  if (sqp->slot != NULL)
+    for (i = 0; i < sqp->nslots; i++)
+      {
+	if (sqp->slot[i].buf != NULL) free(sqp->slot[i].buf);
+	if (sqp->slot[i].blk != NULL) esl_sq_DestroyBlock(sqp->slot[i].blk);
+      }
+  if (sqp->slot != NULL) free(sqp->slot);
+  if (sqp->tid  != NULL) free(sqp->tid);
+  pthread_cond_destroy(&sqp->cond);
+  pthread_mutex_destroy(&sqp->lock);
+  free(sqp);
+}
+/*-------------------- end, ESL_SQPIPE ---------------------------*/
+
+
+
+/*****************************************************************
+ *# 2. Internal functions: splitter and parser threads.
+ *****************************************************************/
+
+/* split_block()
+ * Read the next block's worth of input into slot <s>: on the fast
+ * path, the raw text of whole FASTA records; otherwise, the
+ * sequences themselves. The splitter calls this without the lock
+ * held; it's the only thread that touches <sqp->sqfp>'s position.
+ *
+ * Returns <eslOK> on success, <eslEOF> at end of file, or an error
+ * code. A fast path error has its message in <sqp->split_errbuf>.
+ * Otherwise the error belongs to the block, which may hold the
+ * sequences read before it: it's in <s->status> and <s->errbuf>, to
+ * be reported after those sequences.
+ */
+static int
+split_block(ESL_SQPIPE *sqp, ESL_SQPIPE_SLOT *s)
+{
+  int status;
+
+  if (sqp->fastpath)
+    {
+      status = esl_sqascii_ReadRecords(sqp->sqfp, sqp->max_residues, sqp->max_sequences, &(s->buf), &(s->balloc),
+				       &(s->n), &(s->boff), &(s->linenumber), &(s->at_eof));
+      if (status != eslOK && status != eslEOF)
+	snprintf(sqp->split_errbuf, eslERRBUFSIZE, "failed to read sequence file %s (error code %d)", sqp->sqfp->filename, status);
+    }
+  else
+    {
+      status = esl_sqio_ReadBlock(sqp->sqfp, s->blk, sqp->max_residues, sqp->max_sequences, FALSE);
+      if (status != eslOK && status != eslEOF)
+	snprintf(s->errbuf, eslERRBUFSIZE, "%s", esl_sqfile_GetErrorBuf(sqp->sqfp));
+      s->status = status;
+    }
+  return status;
+}
+
+/* splitter_thread()
+ * Reads the input into free slots, one after another, until the end
+ * of the file, an error, or shutdown.
+ */
+static void *
+splitter_thread(void *arg)
+{
+  ESL_SQPIPE      *sqp    = (ESL_SQPIPE *) arg;
+  ESL_SQPIPE_SLOT *s;
+  int              i;
+  int              status = eslEOF;
+
+  pthread_mutex_lock(&sqp->lock);
+  while (1)
+    {
+      for (s = NULL; ! sqp->shutdown; pthread_cond_wait(&sqp->cond, &sqp->lock))
+	{
+	  for (i = 0; i < sqp->nslots; i++)
+	    if (sqp->slot[i].state == eslSQPIPE_FREE) break;
+	  if (i < sqp->nslots) { s = sqp->slot + i; break; }
+	}
+      if (s == NULL) break;	/* shutdown */
+      pthread_mutex_unlock(&sqp->lock);
+
+      status = split_block(sqp, s);
+
+      pthread_mutex_lock(&sqp->lock);
+      if (status == eslEOF || (status != eslOK && sqp->fastpath)) break;
+      s->seqno  = sqp->nsplit++;
+      s->state  = (sqp->fastpath ? eslSQPIPE_SPLIT : eslSQPIPE_DONE);
+      pthread_cond_broadcast(&sqp->cond);
+      if (status != eslOK) break; /* the block carries the error to the caller */
+    }
+  sqp->split_done   = TRUE;
+  sqp->split_status = status;
+  pthread_cond_broadcast(&sqp->cond);
+  pthread_mutex_unlock(&sqp->lock);
+  return NULL;
+}
+
+/* parser_thread()
+ * Parses split slots into their blocks, oldest first, until
+ * shutdown.
+ */
+static void *
+parser_thread(void *arg)
+{
+  ESL_SQPIPE      *sqp = (ESL_SQPIPE *) arg;
+  ESL_SQPIPE_SLOT *s;
+  int              i;
+  int              status;
+
+  pthread_mutex_lock(&sqp->lock);
+  while (1)
+    {
+      for (s = NULL; ! sqp->shutdown; pthread_cond_wait(&sqp->cond, &sqp->lock))
+	{
+	  for (i = 0; i < sqp->nslots; i++)
+	    if (sqp->slot[i].state == eslSQPIPE_SPLIT && (s == NULL || sqp->slot[i].seqno < s->seqno)) s = sqp->slot + i;
+	  if (s != NULL) break;
+	}
+      if (s == NULL) break;	/* shutdown */
+      s->state = eslSQPIPE_PARSING;
+      pthread_mutex_unlock(&sqp->lock);
+
+      status = esl_sqascii_ParseRecords(sqp->sqfp, s->buf, s->n, s->boff, s->linenumber, s->at_eof, s->blk, s->errbuf);
+      if (status != eslOK && status != eslEFORMAT)
+	snprintf(s->errbuf, eslERRBUFSIZE, "failed to parse sequence file %s (error code %d)", sqp->sqfp->filename, status);
+
+      pthread_mutex_lock(&sqp->lock);
+      s->status = status;
+      s->state  = eslSQPIPE_DONE;
+      pthread_cond_broadcast(&sqp->cond);
+    }
+  pthread_mutex_unlock(&sqp->lock);
+  return NULL;
+}
+/*------------- end, splitter and parser threads -----------------*/
+
+
+
+/*****************************************************************
+ *# 3. Unit tests.
+ *****************************************************************/
+#ifdef eslSQPIPE_TESTDRIVE
+#include "esl_alphabet.h"
+#include "esl_random.h"
+
+/* write_test_fasta()
+ * Write <N> random DNA sequences of length 0..<maxL> to <fp> in
+ * FASTA format, with random line lengths, optional descriptions, and
+ * DOS line ends if <crlf>. If <badseq> is >= 0, that sequence gets an
+ * illegal character.
+ */
+static void
+write_test_fasta(ESL_RANDOMNESS *r, FILE *fp, int N, int maxL, int crlf, int badseq)
+{
+  const char *res = "ACGTRYNacgtn";
+  const char *eol = (crlf ? "\r\n" : "\n");
+  int         i, L, pos, w;
+
+  for (i = 0; i < N; i++)
+    {
+      if (esl_rnd_Roll(r, 2)) fprintf(fp, ">seq%d%s", i, eol);
+      else                    fprintf(fp, ">seq%d  description %d, with spaces%s", i, i, eol);
+      L = esl_rnd_Roll(r, maxL + 1);
+      if (i % 10 == 3) L = 0;
+      w = 1 + esl_rnd_Roll(r, 80);
+      for (pos = 0; pos < L; pos++)
+	{
+	  if (i == badseq && pos == L/2) fputc('9', fp);
+	  else                           fputc(res[esl_rnd_Roll(r, strlen(res))], fp);
+	  if ((pos+1) % w == 0 || pos == L-1) fputs(eol, fp);
+	}
+    }
+}
+
+/* read_serial()
+ * Read all sequences in <seqfile> with esl_sqio_Read(); return them in <*ret_sqarr>,
+ * their number in <*ret_N>. Return the status of the final read and its
+ * error message in <errbuf>.
+ */
+static int
+read_serial(ESL_ALPHABET *abc, char *seqfile, int format, ESL_SQ ***ret_sqarr, int *ret_N, char *errbuf)
+{
+  char        msg[]  = "sqpipe serial read failed";
+  ESL_SQFILE *sqfp   = NULL;
+  ESL_SQ    **sqarr  = NULL;
+  int         nalloc = 16;
+  int         N      = 0;
+  int         status;
+
+  if ((sqarr = malloc(sizeof(ESL_SQ *) * nalloc))                            == NULL)  esl_fatal(msg);
+  if (abc) { if (esl_sqfile_OpenDigital(abc, seqfile, format, NULL, &sqfp) != eslOK)  esl_fatal(msg); }
+  else     { if (esl_sqfile_Open(seqfile, format, NULL, &sqfp)              != eslOK)  esl_fatal(msg); }
+  while (1)
+    {
+      if (N == nalloc && (sqarr = realloc(sqarr, sizeof(ESL_SQ *) * (nalloc *= 2))) == NULL) esl_fatal(msg);
+      sqarr[N] = (abc ? esl_sq_CreateDigital(abc) : esl_sq_Create());
+      if ((status = esl_sqio_Read(sqfp, sqarr[N])) != eslOK) break;
+      N++;
+    }
+  esl_sq_Destroy(sqarr[N]);
+  if (status == eslEFORMAT) strcpy(errbuf, esl_sqfile_GetErrorBuf(sqfp));
+  else                      errbuf[0] = '\0';
+  esl_sqfile_Close(sqfp);
+
+  *ret_sqarr = sqarr;
+  *ret_N     = N;
+  return status;
+}
+
+/* utest_Read()
+ * Read <seqfile> through a pipe of <ncpu> parsers and <nblocks> blocks
+ * of <maxres> residues, and check that we get exactly what the
+ * serial reader gets: same sequences in the same order, same record
+ * offsets, same final status and error message.
+ */
+static void
+utest_Read(ESL_ALPHABET *abc, char *seqfile, int format, int ncpu, int nblocks, int maxres, int maxseq)
+{
+  char          msg[]  = "sqpipe Read unit test failed";
+  char          errbuf[eslERRBUFSIZE];
+  ESL_SQFILE   *sqfp   = NULL;
+  ESL_SQPIPE   *sqp    = NULL;
+  ESL_SQ_BLOCK *blk    = NULL;
+  ESL_SQ      **sqarr  = NULL;
+  ESL_SQ       *sq, *sq0;
+  int           N;
+  int64_t       nseq   = 0;
+  int           serial_status;
+  int           status;
+  int           i;
+
+  serial_status = read_serial(abc, seqfile, format, &sqarr, &N, errbuf);
+
+  if (abc) { if (esl_sqfile_OpenDigital(abc, seqfile, format, NULL, &sqfp) != eslOK)  esl_fatal(msg); }
+  else     { if (esl_sqfile_Open(seqfile, format, NULL, &sqfp)              != eslOK)  esl_fatal(msg); }
+  if ((sqp = esl_sqpipe_Create(sqfp, ncpu, nblocks, maxres, maxseq)) == NULL) esl_fatal(msg);
+
+  while ((status = esl_sqpipe_Read(sqp, &blk)) == eslOK)
+    {
+      if (blk->first_seqidx != nseq)                  esl_fatal(msg);
+      if (blk->count < 1 || blk->count > sqp->max_sequences) esl_fatal(msg);
+      for (i = 0; i < blk->count; i++, nseq++)
+	{
+	  if (nseq >= N)                               esl_fatal(msg);
+	  sq  = blk->list + i;
+	  sq0 = sqarr[nseq];
+	  if (strcmp(sq->name, sq0->name) != 0)        esl_fatal(msg);
+	  if (strcmp(sq->desc, sq0->desc) != 0)        esl_fatal(msg);
+	  if (sq->n != sq0->n || sq->L != sq0->L)      esl_fatal(msg);
+	  if (sq->roff != sq0->roff || sq->hoff != sq0->hoff || sq->doff != sq0->doff || sq->eoff != sq0->eoff) esl_fatal(msg);
+	  if (abc) { if (memcmp(sq->dsq, sq0->dsq, sizeof(ESL_DSQ) * (sq->n+2)) != 0) esl_fatal(msg); }
+	  else     { if (strcmp(sq->seq, sq0->seq) != 0)                              esl_fatal(msg); }
+	}
+      if (esl_sqpipe_Recycle(sqp, blk) != eslOK)    esl_fatal(msg);
+    }
+  if (nseq   != N)                                   esl_fatal(msg);
+  if (status != serial_status)                       esl_fatal(msg);
+  if (status == eslEFORMAT && strcmp(esl_sqpipe_GetErrorBuf(sqp), errbuf) != 0) esl_fatal(msg);
+  if (esl_sqpipe_Read(sqp, &blk) != status || blk != NULL) esl_fatal(msg);
+
+  esl_sqpipe_Destroy(sqp);
+  esl_sqfile_Close(sqfp);
+  for (i = 0; i < N; i++) esl_sq_Destroy(sqarr[i]);
+  free(sqarr);
+}
+
+/* utest_EarlyDestroy()
+ * Destroying a pipe that still has blocks in flight, and a block
+ * out, doesn't hang or leak.
+ */
+static void
+utest_EarlyDestroy(char *seqfile, int ncpu)
+{
+  char          msg[] = "sqpipe early destroy unit test failed";
+  ESL_SQFILE   *sqfp  = NULL;
+  ESL_SQPIPE   *sqp   = NULL;
+  ESL_SQ_BLOCK *blk   = NULL;
+
+  if (esl_sqfile_Open(seqfile, eslSQFILE_FASTA, NULL, &sqfp) != eslOK) esl_fatal(msg);
+  if ((sqp = esl_sqpipe_Create(sqfp, ncpu, 2, 100, 5)) == NULL)        esl_fatal(msg);
+  if (esl_sqpipe_Read(sqp, &blk) != eslOK)                              esl_fatal(msg);
+  esl_sqpipe_Destroy(sqp);
+  esl_sqfile_Close(sqfp);
+}
+#endif /*eslSQPIPE_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+
+
+/*****************************************************************
+ *# 4. Test driver.
+ *****************************************************************/
+#ifdef eslSQPIPE_TESTDRIVE
+/* gcc -g -Wall -pthread -o esl_sqpipe_utest -I. -L. -DeslSQPIPE_TESTDRIVE esl_sqpipe.c -leasel -lm
+ * ./esl_sqpipe_utest
+ */
+#include "esl_config.h"
+
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_sqio.h"
+#include "esl_sqpipe.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-L",        eslARG_INT,    "300",  NULL, "n>0", NULL,  NULL, NULL, "max length of test sequences",                     0 },
+  { "-N",        eslARG_INT,    "200",  NULL, "n>0", NULL,  NULL, NULL, "number of test sequences",                         0 },
+  { "-s",        eslARG_INT,     "42",  NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "--cpu",     eslARG_INT,      "3",  NULL, "n>0", NULL,  NULL, NULL, "test pipes of up to <n> parser threads",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "unit test driver for esl_sqpipe module";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go     = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r      = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc    = esl_alphabet_Create(eslDNA);
+  int             maxL   = esl_opt_GetInteger(go, "-L");
+  int             N      = esl_opt_GetInteger(go, "-N");
+  int             maxcpu = esl_opt_GetInteger(go, "--cpu");
+  char            fafile[32];
+  char            badfile[32];
+  char            stofile[32];
+  FILE           *fp;
+  ESL_SQFILE     *sqfp;
+  ESL_SQ         *sq;
+  int             crlf;
+  int             ncpu;
+
+  fprintf(stderr, "## %s\n", argv[0]);
+  fprintf(stderr, "#  rng seed = %" PRIu32 "\n", esl_randomness_GetSeed(r));
+
+  for (crlf = 0; crlf <= 1; crlf++)
+    {
+      strcpy(fafile,  "esltmpXXXXXX");
+      if (esl_tmpfile_named(fafile,  &fp) != eslOK) esl_fatal("failed to make tmpfile");
+      write_test_fasta(r, fp, N, maxL, crlf, -1);
+      fclose(fp);
+
+      for (ncpu = 1; ncpu <= maxcpu; ncpu++)
+	{
+	  utest_Read(NULL, fafile, eslSQFILE_FASTA, ncpu, 0,   0,    0);
+	  utest_Read(NULL, fafile, eslSQFILE_FASTA, ncpu, 3,   1000, 7);
+	  utest_Read(abc,  fafile, eslSQFILE_FASTA, ncpu, 0,   0,    0);
+	  utest_Read(abc,  fafile, eslSQFILE_FASTA, ncpu, 3,   1000, 7);
+	  utest_Read(abc,  fafile, eslSQFILE_FASTA, ncpu, 2,   1,    1);
+	}
+      utest_EarlyDestroy(fafile, maxcpu);
+      remove(fafile);
+    }
+
+  /* a parse error comes out in order, with the serial reader's message */
+  strcpy(badfile, "esltmpXXXXXX");
+  if (esl_tmpfile_named(badfile, &fp) != eslOK) esl_fatal("failed to make tmpfile");
+  write_test_fasta(r, fp, N, maxL, FALSE, N/2);
+  fclose(fp);
+  for (ncpu = 1; ncpu <= maxcpu; ncpu++)
+    {
+      utest_Read(NULL, badfile, eslSQFILE_FASTA, ncpu, 0, 500, 0);
+      utest_Read(abc,  badfile, eslSQFILE_FASTA, ncpu, 0, 500, 0);
+    }
+  remove(badfile);
+
+  /* other formats go through esl_sqio_ReadBlock() in the splitter */
+  strcpy(fafile,  "esltmpXXXXXX");
+  strcpy(stofile, "esltmpXXXXXX");
+  if (esl_tmpfile_named(fafile,  &fp) != eslOK) esl_fatal("failed to make tmpfile");
+  write_test_fasta(r, fp, N, maxL, FALSE, -1);
+  fclose(fp);
+  if (esl_tmpfile_named(stofile, &fp) != eslOK) esl_fatal("failed to make tmpfile");
+  if (esl_sqfile_OpenDigital(abc, fafile, eslSQFILE_FASTA, NULL, &sqfp) != eslOK) esl_fatal("failed to open tmpfile");
+  sq = esl_sq_CreateDigital(abc);
+  while (esl_sqio_Read(sqfp, sq) == eslOK)
+    {
+      if (sq->n > 0) esl_sqio_Write(fp, sq, eslMSAFILE_STOCKHOLM, FALSE);
+      esl_sq_Reuse(sq);
+    }
+  esl_sq_Destroy(sq);
+  esl_sqfile_Close(sqfp);
+  fclose(fp);
+  for (ncpu = 1; ncpu <= maxcpu; ncpu++)
+    utest_Read(abc, stofile, eslMSAFILE_STOCKHOLM, ncpu, 3, 1000, 7);
+  remove(fafile);
+  remove(stofile);
+
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+
+  fprintf(stderr, "#  status = ok\n");
+  return eslOK;
+}
+#endif /*eslSQPIPE_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
+
+
+
+
+/*****************************************************************
+ *# 5. Benchmark.
+ *****************************************************************/
+#ifdef eslSQPIPE_BENCHMARK
+/* gcc -O3 -Wall -pthread -o esl_sqpipe_benchmark -I. -L. -DeslSQPIPE_BENCHMARK esl_sqpipe.c -leasel -lm
+ * ./esl_sqpipe_benchmark --cpu 8 <seqfile>
+ *
+ * Reads <seqfile> digitally once with esl_sqio_ReadBlock(), then
+ * through pipes of 1..<--cpu> parser threads, and reports residues
+ * read per second.
+ */
+#include "esl_config.h"
+
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_sqio.h"
+#include "esl_sqpipe.h"
+#include "esl_stopwatch.h"
+
+static ESL_OPTIONS options[] = {
+  /* name     type         deflt   env   rng    togs  req   incmpt help                                    docgrp */
+  { "-h",     eslARG_NONE,  FALSE, NULL, NULL,  NULL, NULL, NULL, "show help and usage",                     0 },
+  { "--cpu",  eslARG_INT,   "4",   NULL, "n>0", NULL, NULL, NULL, "benchmark pipes of 1..<n> parsers",       0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <seqfile>";
+static char banner[] = "benchmark driver for esl_sqpipe module";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS   *go      = esl_getopts_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  char          *seqfile = esl_opt_GetArg(go, 1);
+  int            maxcpu  = esl_opt_GetInteger(go, "--cpu");
+  ESL_STOPWATCH *w       = esl_stopwatch_Create();
+  ESL_ALPHABET  *abc     = NULL;
+  ESL_SQFILE    *sqfp    = NULL;
+  ESL_SQPIPE    *sqp     = NULL;
+  ESL_SQ_BLOCK  *blk     = NULL;
+  int64_t        nres;
+  int            ncpu;
+  int            i;
+  int            status;
+
+  if (esl_sqfile_Open(seqfile, eslSQFILE_UNKNOWN, NULL, &sqfp) != eslOK) esl_fatal("failed to open %s", seqfile);
+  if (esl_sqfile_GuessAlphabet(sqfp, &i)                       != eslOK) esl_fatal("couldn't guess alphabet");
+  abc = esl_alphabet_Create(i);
+  esl_sqfile_Close(sqfp);
+
+  printf("# %6s %10s %10s\n", "ncpu", "time(s)", "Mres/s");
+
+  if (esl_sqfile_OpenDigital(abc, seqfile, eslSQFILE_UNKNOWN, NULL, &sqfp) != eslOK) esl_fatal("failed to open %s", seqfile);
+  blk  = esl_sq_CreateDigitalBlock(eslSQPIPE_MAXSEQ, abc);
+  nres = 0;
+  esl_stopwatch_Start(w);
+  while ((status = esl_sqio_ReadBlock(sqfp, blk, 0, eslSQPIPE_MAXSEQ, FALSE)) == eslOK)
+    {
+      for (i = 0; i < blk->count; i++) { nres += blk->list[i].n; esl_sq_Reuse(blk->list + i); }
+    }
+  esl_stopwatch_Stop(w);
+  if (status != eslEOF) esl_fatal("read failed: %s", esl_sqfile_GetErrorBuf(sqfp));
+  printf("  %6s %10.4f %10.2f\n", "serial", w->elapsed, (double) nres / 1e6 / w->elapsed);
+  esl_sq_DestroyBlock(blk);
+  esl_sqfile_Close(sqfp);
+
+  for (ncpu = 1; ncpu <= maxcpu; ncpu++)
+    {
+      if (esl_sqfile_OpenDigital(abc, seqfile, eslSQFILE_UNKNOWN, NULL, &sqfp) != eslOK) esl_fatal("failed to open %s", seqfile);
+      nres = 0;
+      esl_stopwatch_Start(w);
+      if ((sqp = esl_sqpipe_Create(sqfp, ncpu, 0, 0, 0)) == NULL) esl_fatal("pipe creation failed");
+      while ((status = esl_sqpipe_Read(sqp, &blk)) == eslOK)
+	{
+	  for (i = 0; i < blk->count; i++) nres += blk->list[i].n;
+	  esl_sqpipe_Recycle(sqp, blk);
+	}
+      esl_stopwatch_Stop(w);
+      if (status != eslEOF) esl_fatal("read failed: %s", esl_sqpipe_GetErrorBuf(sqp));
+      printf("  %6d %10.4f %10.2f\n", ncpu, w->elapsed, (double) nres / 1e6 / w->elapsed);
+      esl_sqpipe_Destroy(sqp);
+      esl_sqfile_Close(sqfp);
+    }
+
+  esl_alphabet_Destroy(abc);
+  esl_stopwatch_Destroy(w);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*eslSQPIPE_BENCHMARK*/
+/*-------------------- end, benchmark ---------------------------*/
+
+#endif /*HAVE_PTHREAD*/
+
+/*****************************************************************
+ * Easel - a library of C functions for biological sequence analysis
+ * Version h3.1b2; February 2015
+ * Copyright (C) 2015 Howard Hughes Medical Institute.
+ * Other copyrights also apply. See the COPYRIGHT file for a full list.
+ *
+ * Easel is distributed under the Janelia Farm Software License, a BSD
+ * license. See the LICENSE file for more details.
+ *****************************************************************/
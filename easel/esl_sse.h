@@ -9,6 +9,7 @@
  *    1. Function declarations (from esl_sse.c)
  *    2. Inlined utilities for ps vectors (4 floats in __m128)
  *    3. Inlined utilities for epu8 vectors (16 uchars in __m128i)
+ *    4. Inlined table lookups for epu8 vectors [SSSE3]
  */
 #ifdef HAVE_SSE2
 #ifndef eslSSE_INCLUDED
@@ -231,6 +232,52 @@ esl_sse_hmax_epi16(__m128i a)
 }
 
 
+/*****************************************************************
+ * 4. Inlined table lookups for epu8 vectors [SSSE3]
+ *****************************************************************/
+/* configure only checks for SSE2; these are available when the
+ * compiler is told it may use SSSE3 (-mssse3, -march=native...).
+ */
+#ifdef __SSSE3__
+#include <tmmintrin.h>		/* SSSE3 */
+
+/* Function:  esl_sse_lut128_load()
+ * Synopsis:  Load a 128-entry byte table for <esl_sse_lut128_epu8()>.
+ *
+ * Purpose:   Load the byte table <map[0..127]> (an alphabet's
+ *            <inmap>, for example) into the eight vectors <tbl[0..7]>,
+ *            16 entries each.
+ */
+static inline void
+esl_sse_lut128_load(const uint8_t *map, __m128i *tbl)
+{
+  int g;
+  for (g = 0; g < 8; g++) tbl[g] = _mm_loadu_si128((const __m128i *) (map + 16*g));
+}
+
+/* Function:  esl_sse_lut128_epu8()
+ * Synopsis:  Look up 16 bytes in a 128-entry table.
+ *
+ * Purpose:   Returns a vector <r[z] = map[v[z]]> for <v[z] < 128>,
+ *            and <r[z] = 0> for <v[z] >= 128>, where <tbl> holds
+ *            <map> as loaded by <esl_sse_lut128_load()>. Each group
+ *            of 16 entries is a <pshufb> by the low nibble of <v>,
+ *            kept where the high nibble selects that group.
+ */
+static inline __m128i
+esl_sse_lut128_epu8(const __m128i *tbl, __m128i v)
+{
+  __m128i lo = _mm_and_si128(v, _mm_set1_epi8(0x0f));
+  __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0f));
+  __m128i r  = _mm_setzero_si128();
+  int     g;
+
+  for (g = 0; g < 8; g++)
+    r = _mm_or_si128(r, _mm_and_si128(_mm_cmpeq_epi8(hi, _mm_set1_epi8(g)), _mm_shuffle_epi8(tbl[g], lo)));
+  return r;
+}
+#endif /*__SSSE3__*/
+
 #endif /*eslSSE_INCLUDED*/
 #endif /*HAVE_SSE2*/
 /*****************************************************************
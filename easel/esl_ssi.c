@@ -12,7 +12,18 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef _POSIX_VERSION
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif /* _POSIX_VERSION */
+
 #include "easel.h"
+#ifdef HAVE_PTHREAD
+#include "esl_threads.h"
+#endif
 #include "esl_ssi.h"
 
 static uint32_t v30magic = 0xd3d3c9b3; /* SSI 3.0: "ssi3" + 0x80808080 */
@@ -25,6 +36,24 @@ static uint32_t v30swap  = 0xb3c9d3d3; /* byteswapped */
 
 static int  binary_search(ESL_SSI *ssi, const char *key, uint32_t klen, off_t base, 
 			  uint32_t recsize, uint64_t maxidx);
+static int  mapped_find  (ESL_SSI *ssi, const char *key, const char **ret_rec);
+static int  mapped_lookup(ESL_SSI *ssi, const char *key, uint64_t *ret_idx);
+static int  mapped_search(const char *base, uint32_t klen, uint32_t recsize, uint64_t maxidx,
+			  const char *key, size_t n, uint64_t *ret_idx);
+static int  mapped_hash  (ESL_SSI *ssi);
+static uint64_t mapped_keyhash(const char *key, uint32_t maxlen);
+static uint16_t mapped_u16   (const char *p);
+static uint64_t mapped_u64   (const char *p);
+static off_t    mapped_offset(const char *p, uint32_t sz);
+
+/* SSI_LOC: where one key of a batch lookup lives, for sorting by file position. */
+typedef struct {
+  uint16_t fh;
+  off_t    roff;
+  int      idx;			/* index of the key in the caller's list */
+} SSI_LOC;
+
+static int  loc_sort(const void *p1, const void *p2);
 
 /* Function:  esl_ssi_Open()
  * Synopsis:  Open an SSI index as an <ESL_SSI>.
@@ -64,6 +93,11 @@ esl_ssi_Open(const char *filename, ESL_SSI **ret_ssi)
   ssi->bpl        = NULL;
   ssi->rpl        = NULL;
   ssi->nfiles     = 0;          
+  ssi->mem        = NULL;
+  ssi->memsize    = 0;
+  ssi->use_hash   = FALSE;
+  ssi->hash       = NULL;
+  ssi->nhash      = 0;
 
   /* Open the file.
    */
@@ -141,6 +175,113 @@ esl_ssi_Open(const char *filename, ESL_SSI **ret_ssi)
 }
 
 
+/* Function:  esl_ssi_OpenMapped()
+ * Synopsis:  Open an SSI index, mapped into memory.
+ *
+ * Purpose:   Same as <esl_ssi_Open()>, but the index file is also
+ *            <mmap()>'ed, and lookups (<esl_ssi_FindName()>,
+ *            <esl_ssi_FindNumber()>, <esl_ssi_FindSubseq()>) search
+ *            the sorted primary and secondary key tables directly in
+ *            memory, instead of <fseeko()>/<fread()>'ing each probe
+ *            of the binary search. This is the mode to use for
+ *            fetching many keys from one index. Lookups can be made
+ *            faster still with a hash table over the keys; see
+ *            <esl_ssi_SetHashing()>.
+ *            
+ *            If the index can't be mapped -- it isn't a regular file,
+ *            or <fstat()> or <mmap()> fails on it, as on a filesystem
+ *            that doesn't support mapping -- it is left open as a
+ *            stream, exactly as <esl_ssi_Open()> would open it, and
+ *            <ssi->mem> is <NULL>. On a system without <mmap()>, this
+ *            is always the case. Mapping only makes lookups faster;
+ *            the caller gets a working index either way.
+ *
+ * Args:      <filename>   - name of SSI index file to open.       
+ *            <ret_ssi>    - RETURN: the new <ESL_SSI>.
+ *
+ * Returns:   <eslOK>        on success;
+ *            <eslENOTFOUND> if <filename> cannot be opened for reading;
+ *            <eslEFORMAT>   if it's not in correct SSI file format, including
+ *                           if its key tables don't fit in the file;
+ *            <eslERANGE>    if it uses 64-bit file offsets, and we're on a system
+ *                           that doesn't support 64-bit file offsets.
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ */
+int
+esl_ssi_OpenMapped(const char *filename, ESL_SSI **ret_ssi)
+{
+  ESL_SSI    *ssi = NULL;
+  int         status;
+#ifdef _POSIX_VERSION
+  struct stat st;
+  void       *p;
+#endif
+
+  if ((status = esl_ssi_Open(filename, &ssi)) != eslOK) goto ERROR;
+
+#ifdef _POSIX_VERSION
+  /* Can't map it? Then it stays open as a stream. */
+  if (fstat(fileno(ssi->fp), &st) != 0 || ! S_ISREG(st.st_mode)) { *ret_ssi = ssi; return eslOK; }
+
+  /* We'll be trusting the key tables' geometry: check it first. */
+  status = eslEFORMAT;
+  if (ssi->precsize < ssi->plen + 2 + 2*ssi->offsz + 8)                             goto ERROR;
+  if (ssi->nsecondary > 0 && ssi->srecsize < ssi->slen + ssi->plen)                 goto ERROR;
+  if (ssi->poffset < 0 || ssi->soffset < 0)                                         goto ERROR;
+  if (ssi->poffset > st.st_size || ssi->soffset > st.st_size)                       goto ERROR;
+  if (ssi->nprimary   > (uint64_t) (st.st_size - ssi->poffset) / ssi->precsize)     goto ERROR;
+  if (ssi->nsecondary > 0 &&
+      ssi->nsecondary > (uint64_t) (st.st_size - ssi->soffset) / ssi->srecsize)     goto ERROR;
+
+  if ((p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(ssi->fp), 0)) != MAP_FAILED)
+    {
+      ssi->mem     = (char *) p;
+      ssi->memsize = st.st_size;
+    }
+#endif
+
+  *ret_ssi = ssi;
+  return eslOK;
+
+ ERROR:
+  if (ssi != NULL) esl_ssi_Close(ssi);
+  *ret_ssi = NULL;
+  return status;
+}
+
+
+/* Function:  esl_ssi_SetHashing()
+ * Synopsis:  Look up names in a mapped index by hashing.
+ *
+ * Purpose:   If <use_hash> is <TRUE>, name lookups in the mapped
+ *            index <ssi> use a hash table over all primary and
+ *            secondary keys, instead of binary searches. The table
+ *            is built by the first lookup that needs it, in one pass
+ *            over the key tables, and takes 4 bytes per slot, for
+ *            about twice as many slots as keys. After that, a lookup
+ *            usually costs a single string comparison. It pays off
+ *            when many keys are fetched from a large index.
+ *            
+ *            If <use_hash> is <FALSE>, lookups go back to binary
+ *            searches; a table that's already built is kept, in case
+ *            hashing is turned back on.
+ *            
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <use_hash> is <TRUE> and <ssi> isn't mapped
+ *            (wasn't opened by <esl_ssi_OpenMapped()>, or the system
+ *            doesn't support <mmap()>).
+ */
+int
+esl_ssi_SetHashing(ESL_SSI *ssi, int use_hash)
+{
+  if (use_hash && ssi->mem == NULL) ESL_EXCEPTION(eslEINVAL, "hashed lookup requires a mapped SSI index");
+  ssi->use_hash = use_hash;
+  return eslOK;
+}
+
+
 /* Function: esl_ssi_FindName()
  * Synopsis: Look up a primary or secondary key.
  *
@@ -170,10 +311,23 @@ esl_ssi_Open(const char *filename, ESL_SSI **ret_ssi)
 int
 esl_ssi_FindName(ESL_SSI *ssi, const char *key, uint16_t *ret_fh, off_t *ret_roff, off_t *opt_doff, int64_t *opt_L)
 {
-  int       status;
-  off_t     doff;
-  int64_t   L;
-  char     *pkey   = NULL;
+  int         status;
+  off_t       doff;
+  int64_t     L;
+  char       *pkey   = NULL;
+  const char *rec;
+
+  if (ssi->mem != NULL)
+    { /* Mapped index: decode the primary key record in memory. */
+      if ((status = mapped_find(ssi, key, &rec)) != eslOK) goto ERROR;
+      *ret_fh   = mapped_u16(rec);                       rec += 2;
+      *ret_roff = mapped_offset(rec, ssi->offsz);        rec += ssi->offsz;
+      doff      = mapped_offset(rec, ssi->offsz);        rec += ssi->offsz;
+      L         = (int64_t) mapped_u64(rec);
+      if (opt_doff != NULL) *opt_doff = doff;
+      if (opt_L    != NULL) *opt_L    = L;
+      return eslOK;
+    }
 
   /* Look in the primary keys.
    */
@@ -217,6 +371,79 @@ esl_ssi_FindName(ESL_SSI *ssi, const char *key, uint16_t *ret_fh, off_t *ret_rof
 
 
 
+/* Function:  esl_ssi_FindNameBatch()
+ * Synopsis:  Look up many keys, and sort them by file position.
+ *
+ * Purpose:   Look up <nk> keys <keys[0..nk-1]> in index <ssi>, each
+ *            a primary or secondary key. For each key <i>, set
+ *            <ret_fh[i]> and <ret_roff[i]> to the file handle and
+ *            record offset, as <esl_ssi_FindName()> would; if
+ *            key <i> isn't in the index, <ret_fh[i]> is 0 and
+ *            <ret_roff[i]> is -1. 
+ *            
+ *            Also set <ret_order[0..nk-1]> to the key indices in
+ *            order of their records on disk: sorted by file handle
+ *            then by record offset, with ties in the order the keys
+ *            were given, and keys that weren't found last. Fetching
+ *            records in <ret_order> reads each file front to back in
+ *            a single forward pass, instead of seeking randomly. 
+ *            
+ *            Optionally, return the number of keys found in
+ *            <*opt_nfound>.
+ *            
+ *            Caller provides all three arrays, allocated for at
+ *            least <nk> elements.
+ *
+ * Args:      <ssi>       - open index file
+ *            <keys>      - names to search for, [0..nk-1]
+ *            <nk>        - number of keys
+ *            <ret_fh>    - RETURN: handle on file that each key is in, [0..nk-1]
+ *            <ret_roff>  - RETURN: offset of each key's record, or -1, [0..nk-1]
+ *            <ret_order> - RETURN: key indices in file order, [0..nk-1]
+ *            <opt_nfound>- optRETURN: number of keys found
+ *
+ * Returns:   <eslOK> on success, even if some keys weren't found.
+ *            <eslEFORMAT> if a read or a seek fails, probably indicating
+ *            some kind of misformatting of the index.
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ */
+int
+esl_ssi_FindNameBatch(ESL_SSI *ssi, char *const *keys, int nk, uint16_t *ret_fh, off_t *ret_roff, int *ret_order, int *opt_nfound)
+{
+  SSI_LOC *loc    = NULL;
+  int      nfound = 0;
+  int      i;
+  int      status;
+
+  ESL_ALLOC(loc, sizeof(SSI_LOC) * ESL_MAX(1, nk));
+  for (i = 0; i < nk; i++)
+    {
+      status = esl_ssi_FindName(ssi, keys[i], &(ret_fh[i]), &(ret_roff[i]), NULL, NULL);
+      if      (status == eslOK)        nfound++;
+      else if (status == eslENOTFOUND) { ret_fh[i] = 0; ret_roff[i] = -1; }
+      else goto ERROR;
+
+      loc[i].fh   = ret_fh[i];
+      loc[i].roff = ret_roff[i];
+      loc[i].idx  = i;
+    }
+
+  qsort((void *) loc, nk, sizeof(SSI_LOC), loc_sort);
+  for (i = 0; i < nk; i++) ret_order[i] = loc[i].idx;
+
+  free(loc);
+  if (opt_nfound != NULL) *opt_nfound = nfound;
+  return eslOK;
+
+ ERROR:
+  if (loc != NULL) free(loc);
+  for (i = 0; i < nk; i++) ret_order[i] = i;
+  if (opt_nfound != NULL) *opt_nfound = 0;
+  return status;
+}
+
+
 /* Function:  esl_ssi_FindNumber()
  * Synopsis:  Look up the n'th primary key.
  *
@@ -251,15 +478,28 @@ esl_ssi_FindName(ESL_SSI *ssi, const char *key, uint16_t *ret_fh, off_t *ret_rof
 int
 esl_ssi_FindNumber(ESL_SSI *ssi, int64_t nkey, uint16_t *opt_fh, off_t *opt_roff, off_t *opt_doff, int64_t *opt_L, char **opt_pkey)
 {
-  int      status;
-  uint16_t fh;
-  off_t    doff, roff;
-  uint64_t L;
-  char    *pkey = NULL;
-
-  if (nkey >= ssi->nprimary) { status = eslENOTFOUND; goto ERROR; }
+  int         status;
+  uint16_t    fh;
+  off_t       doff, roff;
+  uint64_t    L;
+  char       *pkey = NULL;
+  const char *rec;
+
+  if (nkey < 0 || nkey >= ssi->nprimary) { status = eslENOTFOUND; goto ERROR; }
   ESL_ALLOC(pkey, sizeof(char) * ssi->plen);
 
+  if (ssi->mem != NULL)
+    {
+      rec  = ssi->mem + ssi->poffset + ssi->precsize * nkey;
+      memcpy(pkey, rec, ssi->plen);                      rec += ssi->plen;
+      pkey[ssi->plen-1] = '\0';
+      fh   = mapped_u16(rec);                            rec += 2;
+      roff = mapped_offset(rec, ssi->offsz);             rec += ssi->offsz;
+      doff = mapped_offset(rec, ssi->offsz);             rec += ssi->offsz;
+      L    = mapped_u64(rec);
+      goto DONE;
+    }
+
   status = eslEFORMAT;
   if (fseeko(ssi->fp, ssi->poffset+ssi->precsize*nkey, SEEK_SET)!= 0) goto ERROR;
   if (fread(pkey, sizeof(char), ssi->plen, ssi->fp)   != ssi->plen)   goto ERROR;
@@ -268,6 +508,7 @@ esl_ssi_FindNumber(ESL_SSI *ssi, int64_t nkey, uint16_t *opt_fh, off_t *opt_roff
   if (esl_fread_offset(ssi->fp, ssi->offsz, &doff)    != eslOK)       goto ERROR;
   if (esl_fread_u64   (ssi->fp, &L)                   != eslOK)       goto ERROR;
 
+ DONE:
   if (opt_fh   != NULL) *opt_fh   = fh;
   if (opt_roff != NULL) *opt_roff = roff;
   if (opt_doff != NULL) *opt_doff = doff;
@@ -512,6 +753,10 @@ esl_ssi_Close(ESL_SSI *ssi)
 
   if (ssi == NULL) return;
 
+#ifdef _POSIX_VERSION
+  if (ssi->mem != NULL) munmap(ssi->mem, ssi->memsize);
+#endif
+  if (ssi->hash != NULL) free(ssi->hash);
   if (ssi->fp != NULL) fclose(ssi->fp);
   if (ssi->filename != NULL) {
     for (i = 0; i < ssi->nfiles; i++) 
@@ -595,6 +840,211 @@ binary_search(ESL_SSI *ssi, const char *key, uint32_t klen, off_t base,
 }
 
 
+/* loc_sort()
+ * 
+ * qsort() order for esl_ssi_FindNameBatch(): by file handle, then by
+ * record offset, with missing keys (roff -1) last; ties keep the
+ * caller's order, so the sort is stable.
+ */
+static int
+loc_sort(const void *p1, const void *p2)
+{
+  const SSI_LOC *a = (const SSI_LOC *) p1;
+  const SSI_LOC *b = (const SSI_LOC *) p2;
+
+  if ((a->roff == -1) != (b->roff == -1)) return (a->roff == -1 ? 1 : -1);
+  if (a->fh   != b->fh)   return (a->fh   < b->fh   ? -1 : 1);
+  if (a->roff != b->roff) return (a->roff < b->roff ? -1 : 1);
+  return (a->idx < b->idx ? -1 : (a->idx > b->idx ? 1 : 0));
+}
+
+
+/* mapped_find()
+ *
+ * Purpose:  Find primary or secondary <key> in a mapped index, and
+ *           return <*ret_rec> pointing at the rest of its primary
+ *           key record (just past the key name): file handle, record
+ *           offset, data offset, length.
+ *
+ * Returns:  <eslOK> on success; <eslENOTFOUND> if <key> isn't in the
+ *           index; <eslEFORMAT> if <key> is a secondary key whose
+ *           primary key isn't in the index.
+ *
+ * Throws:   <eslEMEM> if a hash table is needed and can't be allocated.
+ */
+static int
+mapped_find(ESL_SSI *ssi, const char *key, const char **ret_rec)
+{
+  uint64_t    idx;
+  const char *pkey;
+  int         status;
+
+  if ((status = mapped_lookup(ssi, key, &idx)) != eslOK) return status;
+  if (idx >= ssi->nprimary) 
+    { /* a secondary key: flip to its primary key, and look that up */
+      pkey = ssi->mem + ssi->soffset + ssi->srecsize * (idx - ssi->nprimary) + ssi->slen;
+      if ((status = mapped_lookup(ssi, pkey, &idx)) != eslOK) return status;
+      if (idx >= ssi->nprimary) return eslEFORMAT;
+    }
+  *ret_rec = ssi->mem + ssi->poffset + ssi->precsize * idx + ssi->plen;
+  return eslOK;
+}
+
+/* mapped_lookup()
+ * 
+ * Purpose:  Find <key> in a mapped index, by hash table or by binary
+ *           search. Return its index in <*ret_idx>: <0..nprimary-1>
+ *           for a primary key, <nprimary..nprimary+nsecondary-1>
+ *           for a secondary key. A primary key is found in 
+ *           preference to a secondary key of the same name.
+ *
+ * Returns:  <eslOK> on success; <eslENOTFOUND> if not found.
+ *
+ * Throws:   <eslEMEM> if the hash table can't be allocated.
+ */
+static int
+mapped_lookup(ESL_SSI *ssi, const char *key, uint64_t *ret_idx)
+{
+  size_t      n = strlen(key);
+  uint64_t    h, v;
+  const char *name;
+  uint32_t    klen;
+  int         status;
+
+  if (ssi->use_hash)
+    {
+      if (ssi->hash == NULL && (status = mapped_hash(ssi)) != eslOK) return status;
+      for (h = mapped_keyhash(key, n+1) & (ssi->nhash-1); ssi->hash[h] != 0; h = (h+1) & (ssi->nhash-1))
+	{
+	  v = ssi->hash[h] - 1;
+	  if (v < ssi->nprimary) { name = ssi->mem + ssi->poffset + ssi->precsize * v;                    klen = ssi->plen; }
+	  else                   { name = ssi->mem + ssi->soffset + ssi->srecsize * (v - ssi->nprimary);  klen = ssi->slen; }
+	  if (n < klen && memcmp(name, key, n+1) == 0) { *ret_idx = v; return eslOK; }
+	}
+      return eslENOTFOUND;
+    }
+
+  if (mapped_search(ssi->mem + ssi->poffset, ssi->plen, ssi->precsize, ssi->nprimary, key, n, ret_idx) == eslOK) 
+    return eslOK;
+  if (mapped_search(ssi->mem + ssi->soffset, ssi->slen, ssi->srecsize, ssi->nsecondary, key, n, ret_idx) == eslOK)
+    { *ret_idx += ssi->nprimary; return eslOK; }
+  return eslENOTFOUND;
+}
+
+/* mapped_search()
+ *
+ * Purpose:  Binary search for <key> (of length <n>) in <maxidx> sorted,
+ *           <recsize>-byte records starting at <base>, with names of
+ *           up to <klen> bytes (including the NUL) at the start of
+ *           each record. If found, return <eslOK> and the record's
+ *           index in <*ret_idx>; else return <eslENOTFOUND>.
+ */
+static int
+mapped_search(const char *base, uint32_t klen, uint32_t recsize, uint64_t maxidx,
+	      const char *key, size_t n, uint64_t *ret_idx)
+{
+  uint64_t left  = 0;
+  uint64_t right = maxidx;	/* search [left..right-1] */
+  uint64_t mid;
+  int      cmp;
+
+  if (n >= klen) return eslENOTFOUND; /* longer than any key in this table */
+  while (left < right)
+    {
+      mid = left + (right-left) / 2;
+      cmp = strncmp(base + recsize*mid, key, klen);
+      if      (cmp == 0) { *ret_idx = mid; return eslOK; }
+      else if (cmp <  0) left  = mid+1;
+      else               right = mid;
+    }
+  return eslENOTFOUND;
+}
+
+/* mapped_hash()
+ *
+ * Purpose:  Build the hash table over all the keys of a mapped
+ *           index: open addressing with linear probing, in a table
+ *           of at least twice as many slots as keys. Primary keys
+ *           are added first, so a lookup meets a primary key before
+ *           a secondary key of the same name.
+ *
+ * Throws:   <eslEMEM> on allocation failure;
+ *           <eslERANGE> if there are too many keys to number in 32 bits.
+ */
+static int
+mapped_hash(ESL_SSI *ssi)
+{
+  uint64_t    nkeys = ssi->nprimary + ssi->nsecondary;
+  uint64_t    v, h;
+  const char *name;
+  int         status;
+
+  if (nkeys >= UINT32_MAX) ESL_EXCEPTION(eslERANGE, "too many keys to hash");
+  for (ssi->nhash = 16; ssi->nhash < 2*nkeys; ssi->nhash <<= 1) ;
+  ESL_ALLOC(ssi->hash, sizeof(uint32_t) * ssi->nhash);
+  memset(ssi->hash, 0, sizeof(uint32_t) * ssi->nhash);
+
+  for (v = 0; v < nkeys; v++)
+    {
+      if (v < ssi->nprimary) name = ssi->mem + ssi->poffset + ssi->precsize * v;
+      else                   name = ssi->mem + ssi->soffset + ssi->srecsize * (v - ssi->nprimary);
+      h = mapped_keyhash(name, (v < ssi->nprimary ? ssi->plen : ssi->slen)) & (ssi->nhash-1);
+      while (ssi->hash[h] != 0) h = (h+1) & (ssi->nhash-1);
+      ssi->hash[h] = (uint32_t) (v+1);
+    }
+  return eslOK;
+
+ ERROR:
+  ssi->nhash = 0;
+  return status;
+}
+
+/* mapped_keyhash()
+ * FNV-1a hash of string <key>, reading no more than <maxlen> bytes.
+ */
+static uint64_t
+mapped_keyhash(const char *key, uint32_t maxlen)
+{
+  uint64_t h = 14695981039346656037ULL;
+  uint32_t i;
+
+  for (i = 0; i < maxlen && key[i] != '\0'; i++)
+    {
+      h ^= (unsigned char) key[i];
+      h *= 1099511628211ULL;
+    }
+  return h;
+}
+
+/* mapped_u16(), mapped_u64(), mapped_offset()
+ * Read network-order integers (and offsets of <sz> bytes, 4 or 8)
+ * from a mapped index, at any alignment.
+ */
+static uint16_t
+mapped_u16(const char *p)
+{
+  uint16_t x;
+  memcpy(&x, p, sizeof(uint16_t));
+  return esl_ntoh16(x);
+}
+static uint64_t
+mapped_u64(const char *p)
+{
+  uint64_t x;
+  memcpy(&x, p, sizeof(uint64_t));
+  return esl_ntoh64(x);
+}
+static off_t
+mapped_offset(const char *p, uint32_t sz)
+{
+  uint32_t x32;
+
+  if (sz == 8) return (off_t) mapped_u64(p);
+  memcpy(&x32, p, sizeof(uint32_t));
+  return (off_t) esl_ntoh32(x32);
+}
+
+
 /*****************************************************************
  *# 2. Creating (writing) new SSI files.
  *****************************************************************/ 
@@ -605,6 +1055,78 @@ static int parse_skey(char *buf, ESL_SKEY *skey);
 static int pkeysort(const void *k1, const void *k2);
 static int skeysort(const void *k1, const void *k2);
 
+static void pack_pkey  (const ESL_NEWSSI *ns, const ESL_PKEY *pkey, char *rec);
+static void pack_skey  (const ESL_NEWSSI *ns, const ESL_SKEY *skey, char *rec);
+static void pack_offset(off_t offset, char *rec);
+
+/* SSI_SORT: state of a parallel merge sort, ssi_sort(). */
+typedef struct {
+  char      *src, *dst;		/* sorted runs; and where they're merged to (swapped after each pass) */
+  size_t     size;		/* size of each element                        */
+  int      (*cmp)(const void *, const void *);
+  uint64_t   n;			/* number of elements                          */
+  uint64_t  *bound;		/* run r is elements bound[r]..bound[r+1]-1     */
+  int        nrun;		/* number of runs                              */
+  int        pass;		/* 0 = sorting runs; >0 = merging pairs of runs */
+  int        ntask;		/* number of tasks in this pass                */
+  int        next;		/* next task to claim                          */
+#ifdef HAVE_PTHREAD
+  int        use_lock;
+  pthread_mutex_t lock;		/* protects <next>                             */
+#endif
+} SSI_SORT;
+
+/* SSI_MERGE: a multiway merge of sorted run files. */
+typedef struct {
+  FILE     **fp;		/* open runs [0..nrun-1]                         */
+  char     **line;		/* current line of each run (esl_fgets() buffers) */
+  int       *lalloc;		/* allocated sizes of line[]                     */
+  int       *heap;		/* runs that aren't done, as a heap by <line>    */
+  int        nheap;
+  int        nrun;
+  char     **runs;		/* run file names (not owned, except by merge_free()) */
+  char      *out;		/* last line returned by merge_next()            */
+  int        nout;
+} SSI_MERGE;
+
+/* SSI_GROUPS: state of one parallel merge pass over groups of runs. */
+typedef struct {
+  char     **runs;		/* runs to merge [0..nrun-1]                     */
+  int        nrun;
+  char     **newruns;		/* merged run for each group [0..ngroup-1]       */
+  int        ngroup;
+  int        next;		/* next group to claim                           */
+  int        status;		/* eslOK, or the error of a failed group         */
+#ifdef HAVE_PTHREAD
+  int        use_lock;
+  pthread_mutex_t lock;		/* protects <next>, <status>                     */
+#endif
+} SSI_GROUPS;
+
+static int  ssi_sort(void *base, uint64_t n, size_t size, int (*cmp)(const void *, const void *), int ncpu);
+#ifdef HAVE_PTHREAD
+static int  ssi_sort_pass  (SSI_SORT *ctx, int ncpu);
+static int  ssi_sort_next  (SSI_SORT *ctx);
+static void ssi_sort_task  (SSI_SORT *ctx, int k);
+static void ssi_sort_thread(void *arg);
+#endif
+static int  external_sort(ESL_NEWSSI *ns, FILE **tmpfp, const char *tmpfile, SSI_MERGE **ret_merge);
+static int  merge_pass   (ESL_NEWSSI *ns, const char *tmpfile, int pass, char ***runs, int *nrun);
+static int  merge_group_next(SSI_GROUPS *ctx);
+static void merge_group  (SSI_GROUPS *ctx, int g);
+#ifdef HAVE_PTHREAD
+static void merge_group_thread(void *arg);
+#endif
+static int  merge_open   (char **runs, int nrun, SSI_MERGE **ret_merge);
+static int  merge_next   (SSI_MERGE *m, char **ret_line);
+static void merge_siftdown(SSI_MERGE *m, int i);
+static int  merge_before (const SSI_MERGE *m, int a, int b);
+static void merge_close  (SSI_MERGE *m);
+static void merge_free   (SSI_MERGE *m);
+static void remove_runs  (char **runs, int nrun);
+static int  linecmp (const char *a, const char *b);
+static int  linesort(const void *a, const void *b);
+
 /* Function:  esl_newssi_Open()
  * Synopsis:  Create a new <ESL_NEWSSI>.
  *
@@ -633,6 +1155,7 @@ esl_newssi_Open(const char *ssifile, int allow_overwrite, ESL_NEWSSI **ret_newss
   ns->ssifp      = NULL;
   ns->external   = FALSE;	    /* we'll switch to external sort if...       */
   ns->max_ram    = eslSSI_MAXRAM;   /* ... if we exceed this memory limit in MB. */
+  ns->ncpu       = 1;
   ns->filenames  = NULL;
   ns->fileformat = NULL;
   ns->bpl        = NULL;
@@ -666,6 +1189,7 @@ esl_newssi_Open(const char *ssifile, int allow_overwrite, ESL_NEWSSI **ret_newss
     }
 
   if ((ns->ssifp = fopen(ssifile, "w")) == NULL)  { status = eslENOTFOUND; goto ERROR; }
+  setvbuf(ns->ssifp, NULL, _IOFBF, eslSSI_WRITEBUF); /* keys are written in one long stream of small records */
 
   ESL_ALLOC(ns->filenames,  sizeof(char *)   * eslSSI_FCHUNK);
   ESL_ALLOC(ns->fileformat, sizeof(uint32_t) * eslSSI_FCHUNK);
@@ -958,36 +1482,44 @@ esl_newssi_AddAlias(ESL_NEWSSI *ns, const char *alias, const char *key)
  *            secondary keys, including any externally sorted tmpfiles that
  *            may have been needed for large indices.
  *            
+ *            Keys held in memory are sorted with a parallel merge
+ *            sort, using the number of threads set by
+ *            <esl_newssi_SetThreads()>. Keys in external tmpfiles are
+ *            sorted in runs of up to <max_ram> MB, each sorted the
+ *            same way. Then the runs are merged: in parallel passes
+ *            if there are more than <eslSSI_MERGEWAY> of them, and
+ *            finally in one multiway merge that streams straight
+ *            into the index file.
+ *            
  * Args:      <ns>  - new SSI index to write                   
  *            
  * Returns:   <eslOK>       on success;
  *            <eslERANGE>   if index size exceeds system's maximum file size;
  *            <eslESYS>     if any of the steps of an external sort fail.
  *
- * Throws:    <eslEINVAL> on invalid argument, including too-long tmpfile names;
- *            <eslEMEM>   on buffer allocation failure;
+ * Throws:    <eslEMEM>   on buffer allocation failure;
  *            <eslEWRITE> on any system write failure, including filled disk.  
  */
 int
 esl_newssi_Write(ESL_NEWSSI *ns)
 {
-  int      status, 		/* convention                               */
-           i;			/* counter over files, keys                 */
-  uint32_t header_flags,	/* bitflags in the header                   */
-           file_flags,		/* bitflags for a file record               */
-           frecsize, 		/* size of a file record (bytes)            */
-           precsize, 		/* size of a primary key record (bytes)     */
-           srecsize;		/* size of a secondary key record (bytes)   */
-  off_t    foffset, 		/* offset to file section                   */
-           poffset, 		/* offset to primary key section            */
-           soffset;		/* offset to secondary key section          */
-  char    *fk       = NULL,     /* fixed-width (flen) file name             */
-          *pk       = NULL, 	/* fixed-width (plen) primary key string    */
-          *sk       = NULL,	/* fixed-width (slen) secondary key string  */
-          *buf      = NULL;	/* esl_fgets() growable buffer              */
-  int      n        = 0;	/* esl_fgets() buffer size                  */
-  ESL_PKEY pkey;		/* primary key info from external tmpfile   */
-  ESL_SKEY skey;		/* secondary key info from external tmpfile */
+  int        status, 		/* convention                               */
+             i;			/* counter over files, keys                 */
+  uint32_t   header_flags,	/* bitflags in the header                   */
+             file_flags,	/* bitflags for a file record               */
+             frecsize, 		/* size of a file record (bytes)            */
+             precsize, 		/* size of a primary key record (bytes)     */
+             srecsize;		/* size of a secondary key record (bytes)   */
+  off_t      foffset, 		/* offset to file section                   */
+             poffset, 		/* offset to primary key section            */
+             soffset;		/* offset to secondary key section          */
+  char      *fk       = NULL,   /* fixed-width (flen) file name             */
+            *rec      = NULL;	/* one key record, packed for writing       */
+  char      *line;		/* a line of a sorted key tmpfile           */
+  SSI_MERGE *pm       = NULL;	/* sorted primary key runs, being merged    */
+  SSI_MERGE *sm       = NULL;	/* sorted secondary key runs, being merged  */
+  ESL_PKEY   pkey;		/* primary key info from external tmpfile   */
+  ESL_SKEY   skey;		/* secondary key info from external tmpfile */
 
   /* We need fixed-width buffers to get our keys fwrite()'ten in their
    * full binary lengths; pkey->key (for instance) is not guaranteed
@@ -997,8 +1529,6 @@ esl_newssi_Write(ESL_NEWSSI *ns)
    * write uninitialized bytes from these buffers.
    */
   ESL_ALLOC(fk, sizeof(char) * ns->flen);
-  ESL_ALLOC(pk, sizeof(char) * ns->plen);
-  if (ns->slen) ESL_ALLOC(sk, sizeof(char) * ns->slen);
 
   /* How big is the index? If it's going to be > 2GB, we better have
    * 64-bit offsets. (2047 (instead of 2048) gives us
@@ -1017,6 +1547,7 @@ esl_newssi_Write(ESL_NEWSSI *ns)
   precsize     = 2*sizeof(off_t) + sizeof(uint16_t) + sizeof(uint64_t) + ns->plen;
   srecsize     = ns->slen + ns->plen;
   header_flags = 0;
+  ESL_ALLOC(rec, sizeof(char) * ESL_MAX(precsize, srecsize));
 
   /* Magic-looking numbers again come from adding up sizes 
    * of things in bytes: matches current_newssi_size()
@@ -1026,44 +1557,21 @@ esl_newssi_Write(ESL_NEWSSI *ns)
   soffset = poffset + precsize*ns->nprimary;
   
   /* Sort the keys.
-   * If external mode, make system calls to UNIX/POSIX "sort" in place, then
-   * open new sorted files for reading thru ptmp and stmp handles.
-   * If internal mode, call qsort. 
-   * 
-   * Note that you'd better force a POSIX locale for the sort; else,
-   * some silly distro (e.g. Mandrake Linux >=8.1) may have specified
-   * LC_COLLATE=en_US, and this'll give a sort "bug" in which it doesn't
-   * sort by byte order.
+   * If external mode, sort runs of the tmpfiles, and set up the 
+   * merge of the sorted runs: ptmp and stmp are consumed, and the
+   * merges give us the sorted lines. If internal mode, sort in memory.
+   * Either way, keys are ordered by byte value, as strcmp() does,
+   * regardless of locale.
    */
   if (ns->external) 
     {
-      char cmd[1024];
-
-      /* A last minute security check: make sure we won't overflow
-       * sprintf() with the tmpfile names. They're hardcoded now, so
-       * we know they don't overflow, but they might be configurable 
-       * in the future, and we wouldn't want a security hole to open
-       * up.
-       */
-      if (strlen(ns->ptmpfile) > 256 || strlen(ns->ptmpfile) > 256) 
-	ESL_XEXCEPTION(eslEINVAL, "tmpfile name too long"); 
-
-      fclose(ns->ptmp);
-      ns->ptmp = NULL;	
-      sprintf(cmd, "env LC_ALL=POSIX sort -o %s %s\n", ns->ptmpfile, ns->ptmpfile);
-      if (system(cmd) != 0)                              ESL_XFAIL(eslESYS, ns->errbuf, "external sort of primary keys failed");
-      if ((ns->ptmp = fopen(ns->ptmpfile, "r")) == NULL) ESL_XFAIL(eslESYS, ns->errbuf, "failed to reopen primary key tmp file after sort");
-
-      fclose(ns->stmp);
-      ns->stmp = NULL;
-      sprintf(cmd, "env LC_ALL=POSIX sort -o %s %s\n", ns->stmpfile, ns->stmpfile);
-      if (system(cmd) != 0)                              ESL_XFAIL(eslESYS, ns->errbuf, "external sort of secondary keys failed");
-      if ((ns->stmp = fopen(ns->stmpfile, "r")) == NULL) ESL_XFAIL(eslESYS, ns->errbuf, "failed to reopen secondary key tmp file after sort");
+      if ((status = external_sort(ns, &(ns->ptmp), ns->ptmpfile, &pm)) != eslOK) goto ERROR;
+      if ((status = external_sort(ns, &(ns->stmp), ns->stmpfile, &sm)) != eslOK) goto ERROR;
     }
   else 
     {
-      qsort((void *) ns->pkeys, ns->nprimary,   sizeof(ESL_PKEY), pkeysort); 
-      qsort((void *) ns->skeys, ns->nsecondary, sizeof(ESL_SKEY), skeysort); 
+      if ((status = ssi_sort(ns->pkeys, ns->nprimary,   sizeof(ESL_PKEY), pkeysort, ns->ncpu)) != eslOK) goto ERROR;
+      if ((status = ssi_sort(ns->skeys, ns->nsecondary, sizeof(ESL_SKEY), skeysort, ns->ncpu)) != eslOK) goto ERROR;
     }
 
   /* Write the header
@@ -1102,87 +1610,67 @@ esl_newssi_Write(ESL_NEWSSI *ns)
 	ESL_XEXCEPTION_SYS(eslEWRITE, "ssi write failed");
     }
 
-  /* Write the primary key section
+  /* Write the primary key section, one packed record at a time.
    */
-  if (ns->external) 
-    {
-      for (i = 0; i < ns->nprimary; i++) 
-	{
-	  if (esl_fgets(&buf, &n, ns->ptmp)  != eslOK)    ESL_XFAIL(eslESYS, ns->errbuf, "read from sorted primary key tmpfile failed");
-	  if (parse_pkey(buf, &pkey)         != eslOK)    ESL_XFAIL(eslESYS, ns->errbuf, "parse failed for a line of sorted primary key tmpfile failed");
-	  strncpy(pk, pkey.key, ns->plen); /* note: strncpy pads w/ nulls */
-
-	  if (fwrite(pk,sizeof(char),ns->plen,ns->ssifp) != ns->plen ||
-	      esl_fwrite_u16(   ns->ssifp, pkey.fnum)    != eslOK    ||
-	      esl_fwrite_offset(ns->ssifp, pkey.r_off)   != eslOK    ||
-	      esl_fwrite_offset(ns->ssifp, pkey.d_off)   != eslOK    ||
-	      esl_fwrite_i64(   ns->ssifp, pkey.len)     != eslOK)
-	    ESL_XEXCEPTION_SYS(eslEWRITE, "ssi write failed");
-	}
-    } 
-  else 
+  for (i = 0; i < ns->nprimary; i++) 
     {
-      for (i = 0; i < ns->nprimary; i++)
+      if (ns->external)
 	{
-	  strncpy(pk, ns->pkeys[i].key, ns->plen);
-
-	  if (fwrite(pk,sizeof(char),ns->plen,ns->ssifp)       != ns->plen ||
-	      esl_fwrite_u16(   ns->ssifp, ns->pkeys[i].fnum)  != eslOK    ||
-	      esl_fwrite_offset(ns->ssifp, ns->pkeys[i].r_off) != eslOK    ||
-	      esl_fwrite_offset(ns->ssifp, ns->pkeys[i].d_off) != eslOK    ||
-	      esl_fwrite_i64(   ns->ssifp, ns->pkeys[i].len)   != eslOK)
-	    ESL_XEXCEPTION_SYS(eslEWRITE, "ssi write failed");
+	  if (merge_next(pm, &line)    != eslOK) ESL_XFAIL(eslESYS, ns->errbuf, "read from sorted primary key tmpfile failed");
+	  if (parse_pkey(line, &pkey)  != eslOK) ESL_XFAIL(eslESYS, ns->errbuf, "parse failed for a line of sorted primary key tmpfile failed");
+	  pack_pkey(ns, &pkey, rec);
 	}
-    }
+      else pack_pkey(ns, &(ns->pkeys[i]), rec);
 
+      if (fwrite(rec, sizeof(char), precsize, ns->ssifp) != precsize) ESL_XEXCEPTION_SYS(eslEWRITE, "ssi write failed");
+    } 
 
   /* Write the secondary key section
    */
-  if (ns->external) 
+  for (i = 0; i < ns->nsecondary; i++)
     {
-      for (i = 0; i < ns->nsecondary; i++)
+      if (ns->external)
 	{
-	  if (esl_fgets(&buf, &n, ns->stmp) != eslOK) ESL_XFAIL(eslESYS, ns->errbuf, "read from sorted secondary key tmpfile failed");
-	  if (parse_skey(buf, &skey)        != eslOK) ESL_XFAIL(eslESYS, ns->errbuf, "parse failed for a line of sorted secondary key tmpfile failed");
-	  strncpy(sk, skey.key,  ns->slen);
-	  strncpy(pk, skey.pkey, ns->plen);
-
-	  if (fwrite(sk, sizeof(char), ns->slen, ns->ssifp) != ns->slen ||
-	      fwrite(pk, sizeof(char), ns->plen, ns->ssifp) != ns->plen) 
-	    ESL_XEXCEPTION_SYS(eslEWRITE, "ssi write failed");
+	  if (merge_next(sm, &line)    != eslOK) ESL_XFAIL(eslESYS, ns->errbuf, "read from sorted secondary key tmpfile failed");
+	  if (parse_skey(line, &skey)  != eslOK) ESL_XFAIL(eslESYS, ns->errbuf, "parse failed for a line of sorted secondary key tmpfile failed");
+	  pack_skey(ns, &skey, rec);
 	}
-    } 
-  else 
-    {
-      for (i = 0; i < ns->nsecondary; i++)
-	{
-	  strncpy(sk, ns->skeys[i].key,  ns->slen);
-	  strncpy(pk, ns->skeys[i].pkey, ns->plen);
+      else pack_skey(ns, &(ns->skeys[i]), rec);
 
-	  if (fwrite(sk, sizeof(char), ns->slen, ns->ssifp) != ns->slen ||
-	      fwrite(pk, sizeof(char), ns->plen, ns->ssifp) != ns->plen)
-	    ESL_XEXCEPTION_SYS(eslEWRITE, "ssi write failed");
-	} 
+      if (fwrite(rec, sizeof(char), srecsize, ns->ssifp) != srecsize) ESL_XEXCEPTION_SYS(eslEWRITE, "ssi write failed");
     }
 
   if (fk  != NULL)       free(fk);
-  if (pk  != NULL)       free(pk);
-  if (sk  != NULL)       free(sk);
-  if (buf != NULL)       free(buf);
-  if (ns->ptmp != NULL)  { fclose(ns->ptmp); ns->ptmp = NULL; }
-  if (ns->stmp != NULL)  { fclose(ns->stmp); ns->stmp = NULL; }
+  if (rec != NULL)       free(rec);
+  merge_free(pm);
+  merge_free(sm);
   return eslOK;
 
  ERROR:
   if (fk  != NULL)       free(fk);
-  if (pk  != NULL)       free(pk);
-  if (sk  != NULL)       free(sk);
-  if (buf != NULL)       free(buf);
+  if (rec != NULL)       free(rec);
+  merge_free(pm);
+  merge_free(sm);
   if (ns->ptmp != NULL)  { fclose(ns->ptmp); ns->ptmp = NULL; }
   if (ns->stmp != NULL)  { fclose(ns->stmp); ns->stmp = NULL; }
   return status;
 }
 
+/* Function:  esl_newssi_SetThreads()
+ * Synopsis:  Set the number of threads used to sort keys.
+ *
+ * Purpose:   Sort keys with up to <ncpu> threads in <esl_newssi_Write()>.
+ *            The default is 1. Without POSIX threads, <ncpu> is ignored.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+esl_newssi_SetThreads(ESL_NEWSSI *ns, int ncpu)
+{
+  ns->ncpu = ESL_MAX(1, ncpu);
+  return eslOK;
+}
+
 /* Function:  esl_newssi_Close()
  * Synopsis:  Free an <ESL_NEWSSI>.
  *
@@ -1419,6 +1907,594 @@ skeysort(const void *k1, const void *k2)
   return strcmp(key1->key, key2->key);
 }
 
+/* pack_pkey(), pack_skey()
+ * 
+ * Pack one primary or secondary key record into <rec>, in its
+ * on-disk format (fixed-width, NUL-padded key names; network-order
+ * integers), so it can be written with a single fwrite().
+ */
+static void
+pack_pkey(const ESL_NEWSSI *ns, const ESL_PKEY *pkey, char *rec)
+{
+  uint16_t x16 = esl_hton16(pkey->fnum);
+  uint64_t x64 = esl_hton64((uint64_t) pkey->len);
+
+  strncpy(rec, pkey->key, ns->plen);  rec += ns->plen;
+  memcpy(rec, &x16, sizeof(uint16_t)); rec += sizeof(uint16_t);
+  pack_offset(pkey->r_off, rec);       rec += sizeof(off_t);
+  pack_offset(pkey->d_off, rec);       rec += sizeof(off_t);
+  memcpy(rec, &x64, sizeof(uint64_t));
+}
+static void
+pack_skey(const ESL_NEWSSI *ns, const ESL_SKEY *skey, char *rec)
+{
+  strncpy(rec,          skey->key,  ns->slen);
+  strncpy(rec+ns->slen, skey->pkey, ns->plen);
+}
+static void
+pack_offset(off_t offset, char *rec)
+{
+  uint32_t x32;
+  uint64_t x64;
+
+  if (sizeof(off_t) == 4) { x32 = esl_hton32((uint32_t) offset); memcpy(rec, &x32, 4); }
+  else                    { x64 = esl_hton64((uint64_t) offset); memcpy(rec, &x64, 8); }
+}
+
+
+/* ssi_sort()
+ * 
+ * Sort <n> elements of <size> bytes at <base> by <cmp>, as qsort()
+ * would, using up to <ncpu> threads: each thread qsort()'s one run
+ * of the array, then pairs of sorted runs are merged, pairs of
+ * pairs, and so on, ping-ponging between <base> and a scratch copy.
+ * Small arrays, or <ncpu> = 1, just get qsort()'ed.
+ * 
+ * Returns <eslOK> on success.
+ * 
+ * Throws  <eslEMEM> on allocation failure;
+ *         <eslESYS> if a mutex can't be initialized.
+ */
+static int
+ssi_sort(void *base, uint64_t n, size_t size, int (*cmp)(const void *, const void *), int ncpu)
+{
+#ifdef HAVE_PTHREAD
+  SSI_SORT ctx;
+  char    *tmp = NULL;
+  int      r;
+  int      status;
+
+  if (ncpu > 1 && n >= (uint64_t) 2 * eslSSI_SORTCHUNK)
+    {
+      ctx.size     = size;
+      ctx.cmp      = cmp;
+      ctx.n        = n;
+      ctx.nrun     = ESL_MIN(ncpu, n / eslSSI_SORTCHUNK);
+      ctx.bound    = NULL;
+      ctx.use_lock = FALSE;
+      ESL_ALLOC(tmp,       size * n);
+      ESL_ALLOC(ctx.bound, sizeof(uint64_t) * (ctx.nrun+1));
+      if (pthread_mutex_init(&(ctx.lock), NULL) != 0) ESL_XEXCEPTION(eslESYS, "mutex init failed");
+      ctx.use_lock = TRUE;
+      ctx.src      = (char *) base;
+      ctx.dst      = tmp;
+      for (r = 0; r <= ctx.nrun; r++) ctx.bound[r] = n * r / ctx.nrun;
+
+      /* pass 0 sorts each run; pass 1.. merges pairs of runs */
+      ctx.pass  = 0;
+      ctx.ntask = ctx.nrun;
+      if ((status = ssi_sort_pass(&ctx, ncpu)) != eslOK) goto ERROR;
+      while (ctx.nrun > 1)
+	{
+	  ctx.pass++;
+	  ctx.ntask = (ctx.nrun + 1) / 2;
+	  if ((status = ssi_sort_pass(&ctx, ncpu)) != eslOK) goto ERROR;
+	}
+      if (ctx.src != (char *) base) memcpy(base, ctx.src, size * n);
+
+      pthread_mutex_destroy(&(ctx.lock));
+      free(ctx.bound);
+      free(tmp);
+      return eslOK;
+
+    ERROR:
+      if (ctx.use_lock) pthread_mutex_destroy(&(ctx.lock));
+      if (ctx.bound) free(ctx.bound);
+      if (tmp)       free(tmp);
+      return status;
+    }
+#endif /*HAVE_PTHREAD*/
+
+  qsort(base, n, size, cmp);
+  return eslOK;
+}
+
+#ifdef HAVE_PTHREAD
+/* ssi_sort_pass()
+ * Do the <ctx->ntask> tasks of one pass of ssi_sort() with up to
+ * <ncpu> threads; then, after a merge pass, the merged runs
+ * become the current runs.
+ */
+static int
+ssi_sort_pass(SSI_SORT *ctx, int ncpu)
+{
+  ESL_THREADS *thr = NULL;
+  char        *swap;
+  int          nt  = ESL_MIN(ncpu, ctx->ntask);
+  int          t, k;
+
+  ctx->next = 0;
+  if (nt > 1)
+    {
+      if ((thr = esl_threads_Create(&ssi_sort_thread)) == NULL) return eslEMEM;
+      for (t = 0; t < nt; t++)
+	if (esl_threads_AddThread(thr, (void *) ctx) != eslOK) break; /* the serial loop picks up the slack */
+      esl_threads_WaitForStart (thr);
+      esl_threads_WaitForFinish(thr);
+      esl_threads_Destroy(thr);
+    }
+  while ((k = ssi_sort_next(ctx)) != -1) ssi_sort_task(ctx, k);
+
+  if (ctx->pass > 0)
+    {
+      for (k = 0; k < ctx->ntask; k++) ctx->bound[k] = ctx->bound[2*k];
+      ctx->bound[ctx->ntask] = ctx->n;
+      ctx->nrun = ctx->ntask;
+      swap = ctx->src; ctx->src = ctx->dst; ctx->dst = swap;
+    }
+  return eslOK;
+}
+
+static int
+ssi_sort_next(SSI_SORT *ctx)
+{
+  int k = -1;
+
+  pthread_mutex_lock(&(ctx->lock));
+  if (ctx->next < ctx->ntask) k = ctx->next++;
+  pthread_mutex_unlock(&(ctx->lock));
+  return k;
+}
+
+/* ssi_sort_task()
+ * Pass 0: sort run <k>. Later passes: merge runs 2k and 2k+1 from
+ * <src> into <dst> (or just copy run 2k, if it's the odd one out).
+ * Ties go to the left run, so the merge is stable.
+ */
+static void
+ssi_sort_task(SSI_SORT *ctx, int k)
+{
+  size_t   size = ctx->size;
+  uint64_t i, j, ei, ej, o;
+
+  if (ctx->pass == 0) 
+    {
+      qsort(ctx->src + size * ctx->bound[k], ctx->bound[k+1] - ctx->bound[k], size, ctx->cmp);
+      return;
+    }
+
+  i  = o = ctx->bound[2*k];
+  ei = j = ctx->bound[ESL_MIN(2*k+1, ctx->nrun)];
+  ej =     ctx->bound[ESL_MIN(2*k+2, ctx->nrun)];
+  while (i < ei && j < ej)
+    {
+      if ((*ctx->cmp)(ctx->src + size*i, ctx->src + size*j) <= 0) memcpy(ctx->dst + size*(o++), ctx->src + size*(i++), size);
+      else                                                       memcpy(ctx->dst + size*(o++), ctx->src + size*(j++), size);
+    }
+  if (i < ei) memcpy(ctx->dst + size*o, ctx->src + size*i, size * (ei-i));
+  if (j < ej) memcpy(ctx->dst + size*o, ctx->src + size*j, size * (ej-j));
+}
+
+static void
+ssi_sort_thread(void *arg)
+{
+  ESL_THREADS *thr = (ESL_THREADS *) arg;
+  SSI_SORT    *ctx;
+  int          w, k;
+
+  esl_threads_Started(thr, &w);
+  ctx = (SSI_SORT *) esl_threads_GetData(thr, w);
+  while ((k = ssi_sort_next(ctx)) != -1) ssi_sort_task(ctx, k);
+  esl_threads_Finished(thr, w);
+}
+#endif /*HAVE_PTHREAD*/
+
+
+/* external_sort()
+ * 
+ * Sort the lines of key tmpfile <tmpfile> (open for writing as
+ * <*tmpfp>, which is closed here) by key: read it in runs of up to
+ * <max_ram> MB, sort each run in memory (with <ssi_sort()>) and
+ * save it to a run file <tmpfile>.<r>. While there are more than
+ * <eslSSI_MERGEWAY> runs, merge groups of them into longer runs,
+ * in parallel. Return <*ret_merge>, the multiway merge of the
+ * remaining runs, from which <merge_next()> gets the lines in
+ * sorted order. It removes its run files when it's closed.
+ * 
+ * Returns <eslOK> on success; <eslESYS> if a tmpfile can't be read
+ * or written, with a message in <ns->errbuf>.
+ * 
+ * Throws  <eslEMEM> on allocation failure.
+ */
+static int
+external_sort(ESL_NEWSSI *ns, FILE **tmpfp, const char *tmpfile, SSI_MERGE **ret_merge)
+{
+  FILE    *fp     = NULL;
+  FILE    *ofp    = NULL;
+  char   **runs   = NULL;	/* names of run files [0..nrun-1] */
+  int      nrun   = 0;
+  int      pass   = 0;
+  char    *buf    = NULL;	/* raw text of the current run    */
+  size_t   bufsize = ESL_MAX((size_t) ns->max_ram * 1048576, eslSSI_MINRUN);
+  size_t   nbuf   = 0;
+  size_t   end, pos;
+  char   **lines  = NULL;	/* ptrs to lines in <buf>         */
+  uint64_t nlines, lalloc = 0, k;
+  void    *p;
+  int      status;
+
+  *ret_merge = NULL;
+  fclose(*tmpfp);
+  *tmpfp = NULL;
+  if ((fp = fopen(tmpfile, "r")) == NULL) ESL_XFAIL(eslESYS, ns->errbuf, "failed to reopen key tmpfile %s for sorting", tmpfile);
+  ESL_ALLOC(buf, sizeof(char) * (bufsize+1));
+
+  for (;;)
+    {
+      if (nbuf < bufsize && ! feof(fp)) 
+	{
+	  nbuf += fread(buf+nbuf, sizeof(char), bufsize-nbuf, fp);
+	  if (ferror(fp)) ESL_XFAIL(eslESYS, ns->errbuf, "read from key tmpfile %s failed", tmpfile);
+	}
+      if (nbuf == 0) break;
+
+      /* Sort complete lines only; carry a partial last line over to the next run. */
+      for (end = nbuf; end > 0 && buf[end-1] != '\n'; end--) ;
+      if (end == 0)
+	{
+	  if (! feof(fp)) { bufsize *= 2; ESL_RALLOC(buf, p, sizeof(char) * (bufsize+1)); continue; } /* a line longer than a run */
+	  buf[nbuf++] = '\n';	/* unterminated last line; we left room for this */
+	  end = nbuf;
+	}
+
+      for (nlines = 0, pos = 0; pos < end; pos++) if (buf[pos] == '\n') nlines++;
+      if (nlines > lalloc) { lalloc = nlines; ESL_RALLOC(lines, p, sizeof(char *) * lalloc); }
+      for (k = 0, pos = 0; pos < end; pos++)
+	{
+	  if (pos == 0 || buf[pos-1] == '\0') lines[k++] = buf+pos;
+	  if (buf[pos] == '\n') buf[pos] = '\0';
+	}
+      if ((status = ssi_sort(lines, nlines, sizeof(char *), linesort, ns->ncpu)) != eslOK) goto ERROR;
+
+      if (nrun % 16 == 0) ESL_RALLOC(runs, p, sizeof(char *) * (nrun+16));
+      if ((status = esl_sprintf(&(runs[nrun]), "%s.%d", tmpfile, nrun)) != eslOK) goto ERROR;
+      nrun++;
+      if ((ofp = fopen(runs[nrun-1], "w")) == NULL) ESL_XFAIL(eslESYS, ns->errbuf, "failed to open sort run file %s", runs[nrun-1]);
+      for (k = 0; k < nlines; k++)
+	if (fputs(lines[k], ofp) < 0 || fputc('\n', ofp) == EOF) ESL_XEXCEPTION_SYS(eslEWRITE, "ssi sort run file write failed");
+      if (fclose(ofp) != 0) { ofp = NULL; ESL_XEXCEPTION_SYS(eslEWRITE, "ssi sort run file write failed"); }
+      ofp = NULL;
+
+      memmove(buf, buf+end, nbuf-end);
+      nbuf -= end;
+    }
+  fclose(fp);   fp    = NULL;
+  free(buf);    buf   = NULL;
+  free(lines);  lines = NULL;
+
+  while (nrun > eslSSI_MERGEWAY)
+    if ((status = merge_pass(ns, tmpfile, ++pass, &runs, &nrun)) != eslOK) goto ERROR;
+
+  if ((status = merge_open(runs, nrun, ret_merge)) != eslOK) 
+    ESL_XFAIL(status, ns->errbuf, "failed to open sort run files of %s", tmpfile);
+  return eslOK;
+
+ ERROR:
+  if (fp)    fclose(fp);
+  if (ofp)   fclose(ofp);
+  if (buf)   free(buf);
+  if (lines) free(lines);
+  remove_runs(runs, nrun);
+  return status;
+}
+
+/* merge_pass()
+ * 
+ * Merge groups of up to <eslSSI_MERGEWAY> of the <*nrun> sorted run
+ * files <*runs> into one run file each, named <tmpfile>.<pass>.<g>,
+ * with up to <ns->ncpu> groups merged at once. Old runs are
+ * removed; <*runs> and <*nrun> are replaced by the new runs.
+ */
+static int
+merge_pass(ESL_NEWSSI *ns, const char *tmpfile, int pass, char ***runs, int *nrun)
+{
+  SSI_GROUPS ctx;
+  int        g;
+  int        status;
+#ifdef HAVE_PTHREAD
+  ESL_THREADS *thr = NULL;
+  int          t, nt;
+#endif
+
+  ctx.runs     = *runs;
+  ctx.nrun     = *nrun;
+  ctx.ngroup   = (*nrun + eslSSI_MERGEWAY - 1) / eslSSI_MERGEWAY;
+  ctx.newruns  = NULL;
+  ctx.next     = 0;
+  ctx.status   = eslOK;
+#ifdef HAVE_PTHREAD
+  ctx.use_lock = FALSE;
+#endif
+  ESL_ALLOC(ctx.newruns, sizeof(char *) * ctx.ngroup);
+  for (g = 0; g < ctx.ngroup; g++) ctx.newruns[g] = NULL;
+  for (g = 0; g < ctx.ngroup; g++)
+    if ((status = esl_sprintf(&(ctx.newruns[g]), "%s.%d.%d", tmpfile, pass, g)) != eslOK) goto ERROR;
+
+#ifdef HAVE_PTHREAD
+  nt = ESL_MIN(ns->ncpu, ctx.ngroup);
+  if (nt > 1)
+    {
+      if (pthread_mutex_init(&(ctx.lock), NULL) != 0) ESL_XEXCEPTION(eslESYS, "mutex init failed");
+      ctx.use_lock = TRUE;
+      if ((thr = esl_threads_Create(&merge_group_thread)) == NULL) { status = eslEMEM; goto ERROR; }
+      for (t = 0; t < nt; t++)
+	if (esl_threads_AddThread(thr, (void *) &ctx) != eslOK) break; /* the serial loop picks up the slack */
+      esl_threads_WaitForStart (thr);
+      esl_threads_WaitForFinish(thr);
+      esl_threads_Destroy(thr);
+    }
+#endif
+  while ((g = merge_group_next(&ctx)) != -1) merge_group(&ctx, g);
+  if ((status = ctx.status) != eslOK) ESL_XFAIL(status, ns->errbuf, "failed to merge sort runs of %s", tmpfile);
+
+#ifdef HAVE_PTHREAD
+  if (ctx.use_lock) pthread_mutex_destroy(&(ctx.lock));
+#endif
+  remove_runs(*runs, *nrun);
+  *runs = ctx.newruns;
+  *nrun = ctx.ngroup;
+  return eslOK;
+
+ ERROR:
+#ifdef HAVE_PTHREAD
+  if (ctx.use_lock) pthread_mutex_destroy(&(ctx.lock));
+#endif
+  if (ctx.newruns) remove_runs(ctx.newruns, ctx.ngroup); 
+  return status;
+}
+
+static int
+merge_group_next(SSI_GROUPS *ctx)
+{
+  int g = -1;
+
+#ifdef HAVE_PTHREAD
+  if (ctx->use_lock) pthread_mutex_lock(&(ctx->lock));
+#endif
+  if (ctx->next < ctx->ngroup) g = ctx->next++;
+#ifdef HAVE_PTHREAD
+  if (ctx->use_lock) pthread_mutex_unlock(&(ctx->lock));
+#endif
+  return g;
+}
+
+/* merge_group()
+ * Merge the runs of group <g> into new run <g>. On failure, record
+ * the error in <ctx->status>.
+ */
+static void
+merge_group(SSI_GROUPS *ctx, int g)
+{
+  SSI_MERGE *m   = NULL;
+  FILE      *ofp = NULL;
+  char      *line;
+  int        r0  = g * eslSSI_MERGEWAY;
+  int        status;
+
+  if ((status = merge_open(ctx->runs + r0, ESL_MIN(eslSSI_MERGEWAY, ctx->nrun - r0), &m)) != eslOK) goto ERROR;
+  if ((ofp = fopen(ctx->newruns[g], "w")) == NULL) { status = eslESYS; goto ERROR; }
+  while ((status = merge_next(m, &line)) == eslOK)
+    if (fputs(line, ofp) < 0) { status = eslEWRITE; goto ERROR; }
+  if (status != eslEOF) goto ERROR;
+  if (fclose(ofp) != 0) { ofp = NULL; status = eslEWRITE; goto ERROR; }
+  merge_close(m);
+  return;
+
+ ERROR:
+  if (ofp) fclose(ofp);
+  merge_close(m);
+#ifdef HAVE_PTHREAD
+  if (ctx->use_lock) pthread_mutex_lock(&(ctx->lock));
+#endif
+  ctx->status = status;
+#ifdef HAVE_PTHREAD
+  if (ctx->use_lock) pthread_mutex_unlock(&(ctx->lock));
+#endif
+}
+
+#ifdef HAVE_PTHREAD
+static void
+merge_group_thread(void *arg)
+{
+  ESL_THREADS *thr = (ESL_THREADS *) arg;
+  SSI_GROUPS  *ctx;
+  int          w, g;
+
+  esl_threads_Started(thr, &w);
+  ctx = (SSI_GROUPS *) esl_threads_GetData(thr, w);
+  while ((g = merge_group_next(ctx)) != -1) merge_group(ctx, g);
+  esl_threads_Finished(thr, w);
+}
+#endif /*HAVE_PTHREAD*/
+
+
+/* merge_open(), merge_next(), merge_close()
+ * 
+ * A multiway merge of <nrun> sorted run files <runs>, with a heap
+ * of the runs ordered by their current lines. <merge_next()> returns
+ * the next line in sorted order (ties go to the lower-numbered run),
+ * with its newline, or <eslEOF> when all runs are done. The line is
+ * the caller's to modify until the next call. <merge_close()> closes
+ * the run files; <merge_free()> also removes them.
+ */
+static int
+merge_open(char **runs, int nrun, SSI_MERGE **ret_merge)
+{
+  SSI_MERGE *m = NULL;
+  int        r;
+  int        status;
+
+  ESL_ALLOC(m, sizeof(SSI_MERGE));
+  m->fp    = NULL;
+  m->line  = NULL;
+  m->lalloc= NULL;
+  m->heap  = NULL;
+  m->nheap = 0;
+  m->nrun  = nrun;
+  m->runs  = runs;
+  m->out   = NULL;
+  m->nout  = 0;
+  ESL_ALLOC(m->fp,     sizeof(FILE *) * ESL_MAX(1, nrun));
+  ESL_ALLOC(m->line,   sizeof(char *) * ESL_MAX(1, nrun));
+  ESL_ALLOC(m->lalloc, sizeof(int)    * ESL_MAX(1, nrun));
+  ESL_ALLOC(m->heap,   sizeof(int)    * ESL_MAX(1, nrun));
+  for (r = 0; r < nrun; r++) { m->fp[r] = NULL; m->line[r] = NULL; m->lalloc[r] = 0; }
+
+  for (r = 0; r < nrun; r++)
+    {
+      if ((m->fp[r] = fopen(runs[r], "r")) == NULL) { status = eslESYS; goto ERROR; }
+      status = esl_fgets(&(m->line[r]), &(m->lalloc[r]), m->fp[r]);
+      if      (status == eslOK)  m->heap[m->nheap++] = r;
+      else if (status != eslEOF) goto ERROR;
+    }
+  for (r = m->nheap/2 - 1; r >= 0; r--) merge_siftdown(m, r);
+
+  *ret_merge = m;
+  return eslOK;
+
+ ERROR:
+  merge_close(m);
+  *ret_merge = NULL;
+  return status;
+}
+
+static int
+merge_next(SSI_MERGE *m, char **ret_line)
+{
+  char *swap;
+  int   nswap;
+  int   r;
+  int   status;
+
+  if (m->nheap == 0) return eslEOF;
+
+  r = m->heap[0];
+  swap = m->out;    m->out  = m->line[r];   m->line[r]   = swap;
+  nswap = m->nout;  m->nout = m->lalloc[r]; m->lalloc[r] = nswap;
+
+  status = esl_fgets(&(m->line[r]), &(m->lalloc[r]), m->fp[r]);
+  if      (status == eslEOF) m->heap[0] = m->heap[--m->nheap];
+  else if (status != eslOK)  return status;
+  if (m->nheap > 0) merge_siftdown(m, 0);
+
+  *ret_line = m->out;
+  return eslOK;
+}
+
+static void
+merge_siftdown(SSI_MERGE *m, int i)
+{
+  int c, tmp;
+
+  while ((c = 2*i+1) < m->nheap)
+    {
+      if (c+1 < m->nheap && merge_before(m, m->heap[c+1], m->heap[c])) c++;
+      if (! merge_before(m, m->heap[c], m->heap[i])) break;
+      tmp = m->heap[i]; m->heap[i] = m->heap[c]; m->heap[c] = tmp;
+      i = c;
+    }
+}
+
+/* TRUE if run <a>'s current line sorts before run <b>'s. */
+static int
+merge_before(const SSI_MERGE *m, int a, int b)
+{
+  int cmp = linecmp(m->line[a], m->line[b]);
+  return (cmp < 0 || (cmp == 0 && a < b));
+}
+
+static void
+merge_close(SSI_MERGE *m)
+{
+  int r;
+
+  if (m == NULL) return;
+  for (r = 0; r < m->nrun; r++)
+    {
+      if (m->fp   && m->fp[r])   fclose(m->fp[r]);
+      if (m->line && m->line[r]) free(m->line[r]);
+    }
+  if (m->fp)     free(m->fp);
+  if (m->line)   free(m->line);
+  if (m->lalloc) free(m->lalloc);
+  if (m->heap)   free(m->heap);
+  if (m->out)    free(m->out);
+  free(m);
+}
+
+/* merge_free()
+ * Close a merge of runs made by <external_sort()>, and remove its run files.
+ */
+static void
+merge_free(SSI_MERGE *m)
+{
+  char **runs;
+  int    nrun;
+
+  if (m == NULL) return;
+  runs = m->runs;
+  nrun = m->nrun;
+  merge_close(m);
+  remove_runs(runs, nrun);
+}
+
+/* remove_runs()
+ * Remove run files <runs[0..nrun-1]> and free their names and <runs> itself.
+ */
+static void
+remove_runs(char **runs, int nrun)
+{
+  int r;
+
+  if (runs == NULL) return;
+  for (r = 0; r < nrun; r++)
+    if (runs[r] != NULL) { remove(runs[r]); free(runs[r]); }
+  free(runs);
+}
+
+/* linecmp(), linesort()
+ * Order lines of a key tmpfile by their key (the first field, up to
+ * a tab), byte by byte, the same order as strcmp() on the keys.
+ */
+static int
+linecmp(const char *a, const char *b)
+{
+  int ca, cb;
+
+  for (;;)
+    {
+      ca = (*a == '\t' || *a == '\n') ? 0 : (unsigned char) *a;
+      cb = (*b == '\t' || *b == '\n') ? 0 : (unsigned char) *b;
+      if (ca != cb || ca == 0) return ca - cb;
+      a++; b++;
+    }
+}
+static int
+linesort(const void *a, const void *b)
+{
+  return linecmp(*(char * const *) a, *(char * const *) b);
+}
+
 
 /*****************************************************************
  *# 3. Portable binary i/o
@@ -1763,6 +2839,180 @@ static ESL_OPTIONS options[] = {
 static char usage[]  = "[-options]";
 static char banner[] = "test driver for ssi module";
 
+/* utest_mapped()
+ * Every name and alias must be found identically by the stream,
+ * mapped, and hashed lookups; so must every key by number; and
+ * absent keys, including ones longer than any key, must not be found.
+ */
+static void
+utest_mapped(const char *ssifile, char **seqname, int nkeys)
+{
+  char     msg[] = "mapped SSI unit test failed";
+  ESL_SSI *ssi   = NULL;
+  ESL_SSI *mssi  = NULL;
+  char     alias[80];
+  char    *pkey;
+  uint16_t fh,   fh2;
+  off_t    roff, roff2, doff, doff2;
+  int64_t  L,    L2;
+  int      i, mode;
+
+  if (esl_ssi_Open      (ssifile, &ssi)  != eslOK) esl_fatal(msg);
+  if (esl_ssi_OpenMapped(ssifile, &mssi) != eslOK) esl_fatal(msg);
+#ifdef _POSIX_VERSION
+  if (mssi->mem == NULL)                           esl_fatal(msg);
+#endif
+
+  for (mode = 0; mode < 2 && (mode == 0 || mssi->mem != NULL); mode++)
+    {
+      if (esl_ssi_SetHashing(mssi, mode) != eslOK) esl_fatal(msg);
+      for (i = 0; i < nkeys; i++)
+	{
+	  if (esl_ssi_FindName(ssi,  seqname[i], &fh,  &roff,  &doff,  &L)  != eslOK) esl_fatal(msg);
+	  if (esl_ssi_FindName(mssi, seqname[i], &fh2, &roff2, &doff2, &L2) != eslOK) esl_fatal(msg);
+	  if (fh != fh2 || roff != roff2 || doff != doff2 || L != L2)                 esl_fatal(msg);
+
+	  sprintf(alias, "acc-%s", seqname[i]);
+	  if (esl_ssi_FindName(mssi, alias, &fh2, &roff2, &doff2, &L2) != eslOK)      esl_fatal(msg);
+	  if (fh != fh2 || roff != roff2 || doff != doff2 || L != L2)                 esl_fatal(msg);
+
+	  if (esl_ssi_FindNumber(mssi, i, &fh2, &roff2, &doff2, &L2, &pkey) != eslOK) esl_fatal(msg);
+	  if (esl_ssi_FindName(ssi, pkey, &fh,  &roff,  &doff,  &L)         != eslOK) esl_fatal(msg);
+	  if (fh != fh2 || roff != roff2 || doff != doff2 || L != L2)                 esl_fatal(msg);
+	  free(pkey);
+
+	  sprintf(alias, "%s-x", seqname[i]);
+	  if (esl_ssi_FindName(mssi, alias, &fh2, &roff2, NULL, NULL) != eslENOTFOUND) esl_fatal(msg);
+	  alias[3] = '\0';
+	  if (esl_ssi_FindName(mssi, alias, &fh2, &roff2, NULL, NULL) != eslENOTFOUND) esl_fatal(msg);
+	}
+      if (esl_ssi_FindName(mssi, "zzz-longer-than-any-key-in-the-index", &fh2, &roff2, NULL, NULL) != eslENOTFOUND) esl_fatal(msg);
+      if (esl_ssi_FindNumber(mssi, nkeys, NULL, NULL, NULL, NULL, NULL) != eslENOTFOUND) esl_fatal(msg);
+    }
+
+  esl_ssi_Close(ssi);
+  esl_ssi_Close(mssi);
+}
+
+/* utest_truncated()
+ * A mapped index whose key tables run past the end of the file must
+ * be rejected with eslEFORMAT: copies of <ssifile> truncated inside
+ * and at the start of each key table, and copies whose header puts
+ * a key table's offset past the end of the file.
+ */
+static void
+utest_truncated(const char *ssifile)
+{
+  char     msg[]  = "truncated SSI unit test failed";
+  char     tmpfile[32];
+  ESL_SSI *ssi    = NULL;
+  FILE    *fp     = NULL;
+  char    *buf    = NULL;
+  off_t    hdroff[2];
+  off_t    cut[5];
+  off_t    size;
+  int      i;
+
+#ifdef _POSIX_VERSION
+  if (esl_ssi_Open(ssifile, &ssi) != eslOK)                  esl_fatal(msg);
+  if (ssi->nsecondary == 0 || ssi->offsz != sizeof(off_t))   esl_fatal(msg);
+  hdroff[0] = 54 + ssi->offsz;	/* header: 54 bytes of counts and sizes, then foffset, poffset, soffset */
+  hdroff[1] = 54 + 2*ssi->offsz;
+  cut[0]    = ssi->poffset;
+  cut[1]    = (ssi->poffset + ssi->soffset) / 2;
+  cut[2]    = ssi->soffset;
+  esl_ssi_Close(ssi);
+
+  if ((fp = fopen(ssifile, "rb")) == NULL)                   esl_fatal(msg);
+  if (fseeko(fp, 0, SEEK_END) != 0)                          esl_fatal(msg);
+  size = ftello(fp);
+  rewind(fp);
+  if ((buf = malloc(size)) == NULL)                          esl_fatal(msg);
+  if (fread(buf, 1, size, fp) != (size_t) size)              esl_fatal(msg);
+  fclose(fp);
+  cut[3] = (cut[2] + size) / 2;
+  cut[4] = size - 1;
+
+  for (i = 0; i < 5; i++)
+    {
+      strcpy(tmpfile, "esltmpXXXXXX");
+      if (esl_tmpfile_named(tmpfile, &fp)     != eslOK)          esl_fatal(msg);
+      if (fwrite(buf, 1, cut[i], fp)          != (size_t) cut[i]) esl_fatal(msg);
+      fclose(fp);
+      if (esl_ssi_OpenMapped(tmpfile, &ssi)   != eslEFORMAT)     esl_fatal(msg);
+      if (ssi != NULL)                                           esl_fatal(msg);
+      remove(tmpfile);
+    }
+
+  for (i = 0; i < 2; i++)
+    {
+      strcpy(tmpfile, "esltmpXXXXXX");
+      if (esl_tmpfile_named(tmpfile, &fp)     != eslOK)          esl_fatal(msg);
+      if (fwrite(buf, 1, size, fp)            != (size_t) size)  esl_fatal(msg);
+      if (fseeko(fp, hdroff[i], SEEK_SET)     != 0)              esl_fatal(msg);
+      if (esl_fwrite_offset(fp, size+1)       != eslOK)          esl_fatal(msg);
+      fclose(fp);
+      if (esl_ssi_OpenMapped(tmpfile, &ssi)   != eslEFORMAT)     esl_fatal(msg);
+      if (ssi != NULL)                                           esl_fatal(msg);
+      remove(tmpfile);
+    }
+  free(buf);
+#endif
+}
+
+/* utest_sort()
+ * Index <nkeys> keys, added in scrambled order, each with an alias;
+ * in memory or through an external sort of many small runs (which
+ * takes more than one merge pass); with <ncpu> threads. The keys must
+ * come back in strcmp() order, and every key and alias must be found
+ * with its own data.
+ */
+static void
+utest_sort(const char *ssifile, int nkeys, int external, int ncpu)
+{
+  char        msg[] = "SSI sort unit test failed";
+  ESL_NEWSSI *ns    = NULL;
+  ESL_SSI    *ssi   = NULL;
+  char        key[32], prvkey[32];
+  char       *pkey;
+  uint16_t    fh;
+  off_t       roff, doff;
+  int64_t     L;
+  int         i, x;
+
+  if (esl_newssi_Open(ssifile, TRUE, &ns)          != eslOK) esl_fatal(msg);
+  if (esl_newssi_SetThreads(ns, ncpu)              != eslOK) esl_fatal(msg);
+  if (external) ns->max_ram = 0; /* external from the first key, in runs of eslSSI_MINRUN bytes */
+  if (esl_newssi_AddFile(ns, "dummy.fa", 1, &fh)   != eslOK) esl_fatal(msg);
+  for (i = 0; i < nkeys; i++)
+    {
+      x = (int) (((int64_t) i * 7919) % nkeys); /* scrambled; 1:1, as long as 7919 doesn't divide nkeys */
+      sprintf(key, "k%d", x);
+      if (esl_newssi_AddKey(ns, key, fh, (off_t) x, (off_t) 2*x, (int64_t) x+1) != eslOK) esl_fatal(msg);
+      sprintf(prvkey, "a%d", x);
+      if (esl_newssi_AddAlias(ns, prvkey, key)                                 != eslOK) esl_fatal(msg);
+    }
+  if (ns->external != external)  esl_fatal(msg);
+  if (esl_newssi_Write(ns) != eslOK) esl_fatal(msg);
+  esl_newssi_Close(ns);
+
+  if (esl_ssi_OpenMapped(ssifile, &ssi) != eslOK) esl_fatal(msg);
+  if (ssi->nprimary != nkeys || ssi->nsecondary != nkeys) esl_fatal(msg);
+  for (i = 0; i < nkeys; i++)
+    {
+      if (esl_ssi_FindNumber(ssi, i, NULL, &roff, &doff, &L, &pkey) != eslOK) esl_fatal(msg);
+      if (i > 0 && strcmp(prvkey, pkey) >= 0)                                esl_fatal(msg);
+      if (roff != atoi(pkey+1) || doff != 2*roff || L != roff+1)             esl_fatal(msg);
+      strcpy(prvkey, pkey);
+      free(pkey);
+
+      sprintf(key, "a%d", i);
+      if (esl_ssi_FindName(ssi, key, &fh, &roff, &doff, &L) != eslOK) esl_fatal(msg);
+      if (roff != i || doff != 2*i || L != i+1)                       esl_fatal(msg);
+    }
+  esl_ssi_Close(ssi);
+}
+
 int 
 main(int argc, char **argv)
 {
@@ -1785,7 +3035,7 @@ main(int argc, char **argv)
   char **seqname = NULL;
   char **seq     = NULL;
   int   *seqlen  = NULL;
-  char   query[32];
+  char   query[80];
   char  *qfile;
   int    qfmt;
   off_t  roff;
@@ -1844,6 +3094,8 @@ main(int argc, char **argv)
 	{
 	  if (be_verbose) printf("%16s  %ld  %ld  %" PRIi64 "\n", sq->name, (long) sq->roff, (long) sq->doff, sq->L);
 	  if (esl_newssi_AddKey(ns, sq->name, fh, sq->roff, sq->doff, sq->L) != eslOK) esl_fatal("esl_newssi_AddKey() failed");
+	  sprintf(query, "acc-%s", sq->name);
+	  if (esl_newssi_AddAlias(ns, query, sq->name) != eslOK) esl_fatal("esl_newssi_AddAlias() failed");
 	  esl_sq_Reuse(sq);
 	}
       if (status != eslEOF) esl_fatal("sequence read failure");
@@ -1886,6 +3138,13 @@ main(int argc, char **argv)
       esl_sq_Reuse(sq);
       esl_sqfile_Close(sqfp);
     }
+
+  utest_mapped(ssifile, seqname, nseq*nfiles);
+  utest_truncated(ssifile);
+  utest_sort(ssifile, 40001, FALSE, 1);
+  utest_sort(ssifile, 40001, FALSE, 3);
+  utest_sort(ssifile, 40001, TRUE,  1);
+  utest_sort(ssifile, 40001, TRUE,  3);
   
   for (j = 0; j < nfiles; j++) remove(sqfile[j]);
   remove(ssifile);
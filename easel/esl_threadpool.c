@@ -0,0 +1,1106 @@
+/* Work-stealing thread pool: parallel loops and reductions.
+ *
+ * An <ESL_THREADPOOL> is a fixed gang of workers that executes
+ * data-parallel loops over an integer range. Callers give a loop body
+ * (and for reductions, an accumulator type by its init/combine
+ * functions); the pool chops the range into chunks of <grain>
+ * iterations, and workers split ranges of chunks recursively, pushing
+ * halves onto their own deque and stealing halves from each other
+ * when they run dry.
+ *
+ * Loops nest: a loop body may itself call esl_threadpool_For() or
+ * esl_threadpool_Reduce() on the same pool. A worker waiting for a
+ * nested loop to finish helps run other tasks instead of blocking.
+ *
+ * Contents:
+ *    1. The <ESL_THREADPOOL> object.
+ *    2. Parallel loops and reductions.
+ *    3. Internal functions: scheduling.
+ *    4. Unit tests.
+ *    5. Test driver.
+ *    6. Benchmark.
+ *    7. Copyright and license.
+ */
+#include "esl_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "easel.h"
+#include "esl_threadpool.h"
+
+/* One parallel loop in progress. It lives on the stack of the
+ * thread that started it, and stays valid until <pending> reaches 0.
+ */
+typedef struct esl_threadpool_extra_s {	   /* an extra accumulator for a re-entered worker (see run_chunks()) */
+  struct esl_threadpool_extra_s *next;
+  void                          *acc;
+} THREADPOOL_EXTRA;
+
+typedef struct esl_threadpool_loop_s {
+  int64_t  start, end;		/* iteration range <start..end-1>                      */
+  int64_t  grain;		/* iterations per chunk                                */
+  int64_t  nchunks;		/* number of chunks                                    */
+
+  void   (*forbody)(int64_t lo, int64_t hi, void *arg);            /* For():    body  */
+  void   (*body)   (int64_t lo, int64_t hi, void *acc, void *arg); /* Reduce(): body  */
+  void   (*init)   (void *acc, void *arg);
+  void    *arg;
+
+  size_t   stride;		/* bytes per accumulator, rounded up for alignment      */
+  char    *acc;			/* deterministic: [0..nchunks-1]; else [0..nworkers-1] */
+  int     *busy;		/* nondeterministic: TRUE while worker's acc is in use */
+  THREADPOOL_EXTRA *extras;	/* nondeterministic: accumulators for re-entered workers */
+
+  int64_t  pending;		/* chunks not yet completed                            */
+  int      status;		/* eslOK, or eslEMEM if an extra accumulator failed    */
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t lock;		/* protects <pending>, <status>, <extras>              */
+#endif
+} THREADPOOL_LOOP;
+
+static int  loop_run(ESL_THREADPOOL *tp, THREADPOOL_LOOP *loop);
+static void run_chunks(ESL_THREADPOOL *tp, int w, THREADPOOL_LOOP *loop, int64_t c0, int64_t c1);
+#ifdef HAVE_PTHREAD
+static void *worker_thread(void *arg);
+#endif
+
+
+/*****************************************************************
+ *# 1. The <ESL_THREADPOOL> object.
+ *****************************************************************/
+
+/* Function:  esl_threadpool_Create()
+ * Synopsis:  Create a thread pool of <ncpu> workers.
+ *
+ * Purpose:   Create a work-stealing thread pool with <ncpu> workers,
+ *            counting the calling thread: <ncpu-1> new threads are
+ *            started, and a thread that calls a parallel loop on
+ *            the pool works on it as well. <ncpu> $\leq 1$ means
+ *            no new threads, and loops run serially in the caller.
+ *            Without POSIX threads support, the pool is always
+ *            serial.
+ *
+ *            The pool starts nondeterministic; see
+ *            <esl_threadpool_SetDeterministic()>.
+ *
+ * Returns:   ptr to the new <ESL_THREADPOOL>.
+ *
+ * Throws:    <NULL> on allocation or thread initialization failure.
+ */
+ESL_THREADPOOL *
+esl_threadpool_Create(int ncpu)
+{
+  ESL_THREADPOOL *tp = NULL;
+  int             w;
+  int             status;
+
+  ESL_ALLOC(tp, sizeof(ESL_THREADPOOL));
+#ifdef HAVE_PTHREAD
+  tp->nworkers      = ESL_MAX(1, ncpu);
+#else
+  tp->nworkers      = 1;
+#endif
+  tp->deterministic = FALSE;
+  tp->dq            = NULL;
+#ifdef HAVE_PTHREAD
+  tp->tid           = NULL;
+  tp->nthreads      = 0;
+  tp->nsleep        = 0;
+  tp->shutdown      = FALSE;
+
+  if (pthread_key_create(&tp->key, NULL) != 0 ||
+      pthread_mutex_init(&tp->extlock, NULL) != 0 ||
+      pthread_mutex_init(&tp->lock,    NULL) != 0 ||
+      pthread_cond_init (&tp->wake,    NULL) != 0)
+    {
+      free(tp);
+      esl_exception(eslESYS, FALSE, __FILE__, __LINE__, "thread pool initialization failed");
+      return NULL;
+    }
+#endif
+
+  ESL_ALLOC(tp->dq, sizeof(ESL_THREADPOOL_DEQUE) * tp->nworkers);
+  for (w = 0; w < tp->nworkers; w++)
+    {
+      tp->dq[w].task   = NULL;
+      tp->dq[w].top    = 0;
+      tp->dq[w].bot    = 0;
+      tp->dq[w].nalloc = 0;
+#ifdef HAVE_PTHREAD
+      if (pthread_mutex_init(&tp->dq[w].lock, NULL) != 0) ESL_XEXCEPTION(eslESYS, "mutex init failed");
+#endif
+    }
+  for (w = 0; w < tp->nworkers; w++)
+    {
+      tp->dq[w].nalloc = 64;
+      ESL_ALLOC(tp->dq[w].task, sizeof(ESL_THREADPOOL_TASK) * tp->dq[w].nalloc);
+    }
+
+#ifdef HAVE_PTHREAD
+  if (tp->nworkers > 1)
+    {
+      ESL_ALLOC(tp->tid, sizeof(pthread_t) * tp->nworkers);
+      for (w = 1; w < tp->nworkers; w++)
+	{
+	  /* a thread learns its index from its position in <tid>, which is filled before it can look */
+	  pthread_mutex_lock(&tp->lock);
+	  if (pthread_create(&tp->tid[w], NULL, worker_thread, tp) != 0) { pthread_mutex_unlock(&tp->lock); ESL_XEXCEPTION(eslESYS, "thread creation failed"); }
+	  tp->nthreads++;
+	  pthread_mutex_unlock(&tp->lock);
+	}
+    }
+#endif
+  return tp;
+
+ ERROR:
+  esl_threadpool_Destroy(tp);
+  return NULL;
+}
+
+/* Function:  esl_threadpool_Destroy()
+ * Synopsis:  Stop the pool's threads and free the pool.
+ *
+ * Purpose:   Stop the worker threads of pool <tp> and free it.
+ *            Must not be called while a loop is running on <tp>.
+ */
+void
+esl_threadpool_Destroy(ESL_THREADPOOL *tp)
+{
+  int w;
+
+  if (! tp) return;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&tp->lock);
+  tp->shutdown = TRUE;
+  pthread_cond_broadcast(&tp->wake);
+  pthread_mutex_unlock(&tp->lock);
+  for (w = 1; w <= tp->nthreads; w++)
+    pthread_join(tp->tid[w], NULL);
+#endif
+
+  if (tp->dq)
+    {
+      for (w = 0; w < tp->nworkers; w++)
+	{
+	  free(tp->dq[w].task);
+#ifdef HAVE_PTHREAD
+	  pthread_mutex_destroy(&tp->dq[w].lock);
+#endif
+	}
+      free(tp->dq);
+    }
+#ifdef HAVE_PTHREAD
+  free(tp->tid);
+  pthread_cond_destroy (&tp->wake);
+  pthread_mutex_destroy(&tp->lock);
+  pthread_mutex_destroy(&tp->extlock);
+  pthread_key_delete(tp->key);
+#endif
+  free(tp);
+}
+
+/* Function:  esl_threadpool_SetDeterministic()
+ * Synopsis:  Make reductions reproducible, independent of <ncpu>.
+ *
+ * Purpose:   If <deterministic> is <TRUE>, subsequent reductions on
+ *            <tp> give each chunk of the range its own accumulator
+ *            and combine them in chunk order, so the result is
+ *            identical from run to run and for any number of
+ *            workers, even for non-associative arithmetic like
+ *            floating point sums. This costs one accumulator per
+ *            chunk. If <FALSE> (the default), each worker keeps
+ *            one accumulator and combination order depends on
+ *            scheduling.
+ *
+ *            Parallel for loops are not affected.
+ *
+ * Returns:   <eslOK>.
+ */
+int
+esl_threadpool_SetDeterministic(ESL_THREADPOOL *tp, int deterministic)
+{
+  tp->deterministic = deterministic;
+  return eslOK;
+}
+
+/* Function:  esl_threadpool_GetWorkerCount()
+ * Synopsis:  Return the number of workers in the pool.
+ *
+ * Purpose:   Returns the number of workers in <tp>, including the
+ *            calling thread. Worker indices returned by
+ *            <esl_threadpool_GetWorkerIndex()> are in the range
+ *            <0..nworkers-1>, so callers can size per-worker
+ *            scratch space by it.
+ */
+int
+esl_threadpool_GetWorkerCount(const ESL_THREADPOOL *tp)
+{
+  return tp->nworkers;
+}
+
+/* Function:  esl_threadpool_GetWorkerIndex()
+ * Synopsis:  Return the index of the worker running the caller.
+ *
+ * Purpose:   Called from inside a loop body on pool <tp>, returns
+ *            the index <0..nworkers-1> of the worker executing it.
+ *            At most one chunk runs on a worker at a time, except
+ *            that a body that starts a nested loop may have other
+ *            chunks run on its worker before the nested loop
+ *            returns; per-worker scratch space must not be held
+ *            across a nested loop call.
+ *
+ *            Outside of a loop, returns 0.
+ */
+int
+esl_threadpool_GetWorkerIndex(const ESL_THREADPOOL *tp)
+{
+#ifdef HAVE_PTHREAD
+  intptr_t v = (intptr_t) pthread_getspecific(tp->key);
+  return (v > 0 ? (int) v - 1 : 0);
+#else
+  return 0;
+#endif
+}
+/*------------- end, the ESL_THREADPOOL object ------------------*/
+
+
+
+
+/*****************************************************************
+ *# 2. Parallel loops and reductions.
+ *****************************************************************/
+
+/* the accumulator stride; malloc'ed arrays of accumulators keep each one aligned */
+#define eslTHREADPOOL_ALIGN 16
+
+static void
+loop_init(THREADPOOL_LOOP *loop, int64_t start, int64_t end, int64_t grain, void *arg)
+{
+  int64_t n = (end > start ? end - start : 0);
+
+  if (grain <= 0) grain = (n + eslTHREADPOOL_NCHUNKS - 1) / eslTHREADPOOL_NCHUNKS;
+  if (grain <= 0) grain = 1;
+
+  loop->start   = start;
+  loop->end     = start + n;
+  loop->grain   = grain;
+  loop->nchunks = (n + grain - 1) / grain;
+  loop->forbody = NULL;
+  loop->body    = NULL;
+  loop->init    = NULL;
+  loop->arg     = arg;
+  loop->stride  = 0;
+  loop->acc     = NULL;
+  loop->busy    = NULL;
+  loop->extras  = NULL;
+  loop->pending = loop->nchunks;
+  loop->status  = eslOK;
+}
+
+
+/* Function:  esl_threadpool_For()
+ * Synopsis:  Parallel for loop over an integer range.
+ *
+ * Purpose:   Execute <body(lo, hi, arg)> over the range
+ *            <start..end-1> on the workers of pool <tp>. The range
+ *            is cut into consecutive chunks of <grain> iterations
+ *            (the last may be shorter), and <body> is called once
+ *            per chunk with the half-open interval <[lo,hi)>, on
+ *            whatever worker executes it. Chunks run concurrently
+ *            in no particular order; <body> must be safe to
+ *            execute that way. Returns after all chunks are done.
+ *
+ *            <grain> $\leq 0$ picks a grain that cuts the range into
+ *            about <eslTHREADPOOL_NCHUNKS> chunks.
+ *
+ *            <body> may itself call <esl_threadpool_For()> or
+ *            <esl_threadpool_Reduce()> on <tp>. Loops called from
+ *            threads outside the pool are serialized.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+esl_threadpool_For(ESL_THREADPOOL *tp, int64_t start, int64_t end, int64_t grain,
+		   void (*body)(int64_t lo, int64_t hi, void *arg), void *arg)
+{
+  THREADPOOL_LOOP loop;
+
+  loop_init(&loop, start, end, grain, arg);
+  loop.forbody = body;
+  return loop_run(tp, &loop);
+}
+
+
+/* Function:  esl_threadpool_Reduce()
+ * Synopsis:  Parallel reduction over an integer range.
+ *
+ * Purpose:   Reduce the range <start..end-1> into an accumulator of
+ *            <accsize> bytes, using the workers of pool <tp>.
+ *            <init(acc, arg)> sets an accumulator to the identity;
+ *            <body(lo, hi, acc, arg)> adds iterations <[lo,hi)> of
+ *            one chunk into <acc>; and <combine(acc, other, arg)>
+ *            adds accumulator <other> into <acc>. <grain> is as in
+ *            <esl_threadpool_For()>. The result is left in
+ *            <ret_acc>, which the caller provides (<accsize>
+ *            bytes).
+ *
+ *            In the default nondeterministic mode, each worker
+ *            accumulates into its own accumulator, and these are
+ *            combined at the end; results may vary with scheduling
+ *            if <combine> is not exactly associative and
+ *            commutative. In deterministic mode (see
+ *            <esl_threadpool_SetDeterministic()>) each chunk
+ *            accumulates separately and chunks are combined in
+ *            order <0..nchunks-1> into <ret_acc>, giving the same
+ *            result for any number of workers.
+ *
+ *            <init>, <body>, and <combine> must not take ownership
+ *            of memory by pointer inside the accumulator: the pool
+ *            copies and frees accumulators as flat bytes.
+ *
+ * Returns:   <eslOK> on success, with the result in <ret_acc>.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <ret_acc> is undefined.
+ */
+int
+esl_threadpool_Reduce(ESL_THREADPOOL *tp, int64_t start, int64_t end, int64_t grain,
+		      size_t accsize,
+		      void (*init)   (void *acc, void *arg),
+		      void (*body)   (int64_t lo, int64_t hi, void *acc, void *arg),
+		      void (*combine)(void *acc, const void *other, void *arg),
+		      void *arg, void *ret_acc)
+{
+  THREADPOOL_LOOP   loop;
+  THREADPOOL_EXTRA *x;
+  int64_t           nacc;
+  int64_t           a;
+  int               status;
+
+  loop_init(&loop, start, end, grain, arg);
+  loop.body   = body;
+  loop.init   = init;
+  loop.stride = (accsize + eslTHREADPOOL_ALIGN - 1) / eslTHREADPOOL_ALIGN * eslTHREADPOOL_ALIGN;
+  if (loop.stride == 0) loop.stride = eslTHREADPOOL_ALIGN;
+
+  if (tp->deterministic)
+    nacc = loop.nchunks;	/* run_chunks() inits each one */
+  else
+    {
+      nacc = tp->nworkers;
+      ESL_ALLOC(loop.busy, sizeof(int) * nacc);
+      for (a = 0; a < nacc; a++) loop.busy[a] = FALSE;
+    }
+  if (nacc > 0) ESL_ALLOC(loop.acc, loop.stride * nacc);
+  if (! tp->deterministic)
+    for (a = 0; a < nacc; a++) (*init)(loop.acc + a * loop.stride, arg);
+
+  if ((status = loop_run(tp, &loop)) != eslOK) goto ERROR;
+  if (loop.status != eslOK) ESL_XEXCEPTION(loop.status, "allocation failed in parallel reduction");
+
+  (*init)(ret_acc, arg);
+  for (a = 0; a < nacc; a++) (*combine)(ret_acc, loop.acc + a * loop.stride, arg);
+  for (x = loop.extras; x; x = x->next) (*combine)(ret_acc, x->acc, arg);
+
+  while ((x = loop.extras) != NULL) { loop.extras = x->next; free(x->acc); free(x); }
+  free(loop.acc);
+  free(loop.busy);
+  return eslOK;
+
+ ERROR:
+  while ((x = loop.extras) != NULL) { loop.extras = x->next; free(x->acc); free(x); }
+  free(loop.acc);
+  free(loop.busy);
+  return status;
+}
+/*------------- end, parallel loops and reductions --------------*/
+
+
+
+
+/*****************************************************************
+ *# 3. Internal functions: scheduling.
+ *****************************************************************/
+
+/* run_chunks()
+ * Worker <w> executes chunks <c0..c1-1> of <loop>, in order.
+ *
+ * In a nondeterministic reduction a worker normally accumulates into
+ * its own accumulator. The exception is when the worker is already
+ * inside a body of this same loop: that body started a nested loop,
+ * and while waiting for it the worker picked up another chunk of the
+ * outer loop. Then the chunk gets a fresh accumulator on the loop's
+ * <extras> list.
+ */
+static void
+run_chunks(ESL_THREADPOOL *tp, int w, THREADPOOL_LOOP *loop, int64_t c0, int64_t c1)
+{
+  THREADPOOL_EXTRA *x;
+  int64_t           c, lo, hi;
+
+  for (c = c0; c < c1; c++)
+    {
+      lo = loop->start + c * loop->grain;
+      hi = ESL_MIN(lo + loop->grain, loop->end);
+
+      if (loop->forbody)
+	(*loop->forbody)(lo, hi, loop->arg);
+      else if (tp->deterministic)
+	{
+	  (*loop->init)(loop->acc + c * loop->stride, loop->arg);
+	  (*loop->body)(lo, hi, loop->acc + c * loop->stride, loop->arg);
+	}
+      else if (! loop->busy[w])
+	{
+	  loop->busy[w] = TRUE;
+	  (*loop->body)(lo, hi, loop->acc + w * loop->stride, loop->arg);
+	  loop->busy[w] = FALSE;
+	}
+      else
+	{ /* no ESL_ALLOC here: we're in a worker, and report failure through <loop->status> */
+	  if ((x = malloc(sizeof(THREADPOOL_EXTRA))) == NULL || (x->acc = malloc(loop->stride)) == NULL)
+	    {
+	      free(x);
+#ifdef HAVE_PTHREAD
+	      pthread_mutex_lock(&loop->lock);
+#endif
+	      loop->status = eslEMEM;
+#ifdef HAVE_PTHREAD
+	      pthread_mutex_unlock(&loop->lock);
+#endif
+	      continue;
+	    }
+	  (*loop->init)(x->acc, loop->arg);
+	  (*loop->body)(lo, hi, x->acc, loop->arg);
+#ifdef HAVE_PTHREAD
+	  pthread_mutex_lock(&loop->lock);
+#endif
+	  x->next      = loop->extras;
+	  loop->extras = x;
+#ifdef HAVE_PTHREAD
+	  pthread_mutex_unlock(&loop->lock);
+#endif
+	}
+    }
+}
+
+
+#ifdef HAVE_PTHREAD
+/* dq_push()
+ * Push <task> on the bottom of worker <w>'s deque, and wake a
+ * sleeping worker to steal it. Returns <eslOK>, or <eslEMEM> if
+ * the deque can't grow; then the caller runs the task itself.
+ */
+static int
+dq_push(ESL_THREADPOOL *tp, int w, const ESL_THREADPOOL_TASK *task)
+{
+  ESL_THREADPOOL_DEQUE *dq = &tp->dq[w];
+  ESL_THREADPOOL_TASK  *p;
+
+  pthread_mutex_lock(&dq->lock);
+  if (dq->bot == dq->nalloc)
+    {
+      if (dq->top > 0)
+	{
+	  memmove(dq->task, dq->task + dq->top, sizeof(ESL_THREADPOOL_TASK) * (dq->bot - dq->top));
+	  dq->bot -= dq->top;
+	  dq->top  = 0;
+	}
+      else
+	{
+	  if ((p = realloc(dq->task, sizeof(ESL_THREADPOOL_TASK) * dq->nalloc * 2)) == NULL) { pthread_mutex_unlock(&dq->lock); return eslEMEM; }
+	  dq->task    = p;
+	  dq->nalloc *= 2;
+	}
+    }
+  dq->task[dq->bot++] = *task;
+  pthread_mutex_unlock(&dq->lock);
+
+  pthread_mutex_lock(&tp->lock);
+  if (tp->nsleep > 0) pthread_cond_signal(&tp->wake);
+  pthread_mutex_unlock(&tp->lock);
+  return eslOK;
+}
+
+/* dq_take()
+ * Take a task from deque <v> for worker <w>: from the bottom (newest)
+ * if it's <w>'s own, else steal from the top (oldest, and therefore
+ * biggest). Returns <eslOK> and the task in <ret_task>, or <eslEOD> if
+ * the deque is empty.
+ */
+static int
+dq_take(ESL_THREADPOOL *tp, int w, int v, ESL_THREADPOOL_TASK *ret_task)
+{
+  ESL_THREADPOOL_DEQUE *dq = &tp->dq[v];
+  int                   status = eslEOD;
+
+  pthread_mutex_lock(&dq->lock);
+  if (dq->top < dq->bot)
+    {
+      *ret_task = (v == w ? dq->task[--dq->bot] : dq->task[dq->top++]);
+      if (dq->top == dq->bot) dq->top = dq->bot = 0;
+      status = eslOK;
+    }
+  pthread_mutex_unlock(&dq->lock);
+  return status;
+}
+
+/* find_task()
+ * Worker <w> looks for a task: its own deque first, then the others',
+ * in round-robin order starting after its own.
+ */
+static int
+find_task(ESL_THREADPOOL *tp, int w, ESL_THREADPOOL_TASK *ret_task)
+{
+  int i;
+
+  for (i = 0; i < tp->nworkers; i++)
+    if (dq_take(tp, w, (w + i) % tp->nworkers, ret_task) == eslOK) return eslOK;
+  return eslEOD;
+}
+
+/* run_task()
+ * Worker <w> executes a task. While the range has more than one
+ * chunk, split it in half and push the upper half on <w>'s deque for
+ * itself or a thief; then run what's left, and count it done.
+ */
+static void
+run_task(ESL_THREADPOOL *tp, int w, ESL_THREADPOOL_TASK *task)
+{
+  THREADPOOL_LOOP    *loop = task->loop;
+  ESL_THREADPOOL_TASK half;
+  int64_t             c0   = task->c0;
+  int64_t             c1   = task->c1;
+  int                 done;
+
+  while (c1 - c0 > 1)
+    {
+      half.loop = loop;
+      half.c0   = c0 + (c1 - c0) / 2;
+      half.c1   = c1;
+      if (dq_push(tp, w, &half) != eslOK) break;
+      c1 = half.c0;
+    }
+
+  run_chunks(tp, w, loop, c0, c1);
+
+  pthread_mutex_lock(&loop->lock);
+  loop->pending -= c1 - c0;
+  done = (loop->pending == 0);
+  pthread_mutex_unlock(&loop->lock);
+
+  if (done)
+    {				/* wake whoever's waiting for this loop */
+      pthread_mutex_lock(&tp->lock);
+      pthread_cond_broadcast(&tp->wake);
+      pthread_mutex_unlock(&tp->lock);
+    }
+}
+
+static int
+loop_is_done(THREADPOOL_LOOP *loop)
+{
+  int done;
+
+  pthread_mutex_lock(&loop->lock);
+  done = (loop->pending == 0);
+  pthread_mutex_unlock(&loop->lock);
+  return done;
+}
+
+/* worker_thread()
+ * Main loop of pool threads 1..nworkers-1: run tasks, sleep when
+ * there aren't any, exit at shutdown.
+ */
+static void *
+worker_thread(void *arg)
+{
+  ESL_THREADPOOL     *tp = (ESL_THREADPOOL *) arg;
+  ESL_THREADPOOL_TASK task;
+  pthread_t           self = pthread_self();
+  int                 w;
+
+  pthread_mutex_lock(&tp->lock);	/* Create() holds it until tid[] is set */
+  for (w = 1; w < tp->nworkers; w++)
+    if (pthread_equal(tp->tid[w], self)) break;
+  pthread_mutex_unlock(&tp->lock);
+  pthread_setspecific(tp->key, (void *) (intptr_t) (w + 1));
+
+  while (1)
+    {
+      if (find_task(tp, w, &task) == eslOK) { run_task(tp, w, &task); continue; }
+
+      /* Nothing found. Look again under the pool lock before sleeping,
+       * so a push between the search and the wait can't be missed.
+       */
+      pthread_mutex_lock(&tp->lock);
+      if (tp->shutdown) { pthread_mutex_unlock(&tp->lock); break; }
+      if (find_task(tp, w, &task) == eslOK)
+	{
+	  pthread_mutex_unlock(&tp->lock);
+	  run_task(tp, w, &task);
+	  continue;
+	}
+      tp->nsleep++;
+      pthread_cond_wait(&tp->wake, &tp->lock);
+      tp->nsleep--;
+      pthread_mutex_unlock(&tp->lock);
+    }
+  return NULL;
+}
+#endif /*HAVE_PTHREAD*/
+
+
+/* loop_run()
+ * Execute all chunks of <loop> on pool <tp>, and return when they're
+ * done. The calling worker runs the whole range as one task, which
+ * splits it for others to steal; then it helps with whatever tasks it
+ * can find, in any loop, until this loop is done.
+ */
+static int
+loop_run(ESL_THREADPOOL *tp, THREADPOOL_LOOP *loop)
+{
+#ifdef HAVE_PTHREAD
+  ESL_THREADPOOL_TASK task;
+  int                 external;
+  int                 w;
+#endif
+
+  if (loop->nchunks == 0) return eslOK;
+#ifdef HAVE_PTHREAD
+  if (pthread_mutex_init(&loop->lock, NULL) != 0) ESL_EXCEPTION(eslESYS, "mutex init failed");
+  if (tp->nworkers > 1)
+    {
+
+      /* A thread from outside the pool borrows worker 0; one at a time. */
+      external = (pthread_getspecific(tp->key) == NULL);
+      if (external)
+	{
+	  pthread_mutex_lock(&tp->extlock);
+	  pthread_setspecific(tp->key, (void *) (intptr_t) 1);
+	}
+      w = esl_threadpool_GetWorkerIndex(tp);
+
+      task.loop = loop;
+      task.c0   = 0;
+      task.c1   = loop->nchunks;
+      run_task(tp, w, &task);
+
+      while (! loop_is_done(loop))
+	{
+	  if (find_task(tp, w, &task) == eslOK) { run_task(tp, w, &task); continue; }
+
+	  pthread_mutex_lock(&tp->lock);
+	  if (find_task(tp, w, &task) == eslOK)
+	    {
+	      pthread_mutex_unlock(&tp->lock);
+	      run_task(tp, w, &task);
+	      continue;
+	    }
+	  if (! loop_is_done(loop))
+	    {
+	      tp->nsleep++;
+	      pthread_cond_wait(&tp->wake, &tp->lock);
+	      tp->nsleep--;
+	    }
+	  pthread_mutex_unlock(&tp->lock);
+	}
+
+      if (external)
+	{
+	  pthread_setspecific(tp->key, NULL);
+	  pthread_mutex_unlock(&tp->extlock);
+	}
+      pthread_mutex_destroy(&loop->lock);
+      return eslOK;
+    }
+#endif
+
+  /* Serial: a single worker runs chunks in order. */
+  run_chunks(tp, 0, loop, 0, loop->nchunks);
+#ifdef HAVE_PTHREAD
+  pthread_mutex_destroy(&loop->lock);
+#endif
+  return eslOK;
+}
+/*------------- end, internal functions: scheduling -------------*/
+
+
+
+
+/*****************************************************************
+ *# 4. Unit tests.
+ *****************************************************************/
+#ifdef eslTHREADPOOL_TESTDRIVE
+#include "esl_random.h"
+
+struct utest_arg_s {
+  ESL_THREADPOOL *tp;
+  int            *visit;	/* number of times each index was visited */
+  int64_t         ncol;		/* for nested loops: row length           */
+  int64_t         grain;	/* for nested loops: inner grain          */
+  int             badw;		/* set TRUE if a worker index is out of range */
+};
+
+static void
+utest_forbody(int64_t lo, int64_t hi, void *arg)
+{
+  struct utest_arg_s *u = (struct utest_arg_s *) arg;
+  int                 w = esl_threadpool_GetWorkerIndex(u->tp);
+  int64_t             i;
+
+  if (w < 0 || w >= esl_threadpool_GetWorkerCount(u->tp)) u->badw = TRUE;
+  for (i = lo; i < hi; i++) u->visit[i]++;
+}
+
+/* utest_For()
+ * Each index of <start..end-1> is visited exactly once, for
+ * various grains, including ranges of 0 and 1.
+ */
+static void
+utest_For(ESL_THREADPOOL *tp, int64_t start, int64_t end, int64_t grain)
+{
+  char                msg[] = "threadpool For test failed";
+  struct utest_arg_s  u;
+  int64_t             i;
+
+  u.tp   = tp;
+  u.badw = FALSE;
+  if ((u.visit = calloc(ESL_MAX(1, end), sizeof(int))) == NULL) esl_fatal(msg);
+
+  if (esl_threadpool_For(tp, start, end, grain, utest_forbody, &u) != eslOK) esl_fatal(msg);
+  for (i = 0; i < end; i++)
+    if (u.visit[i] != (i >= start ? 1 : 0)) esl_fatal(msg);
+  if (u.badw) esl_fatal(msg);
+  free(u.visit);
+}
+
+/* accumulators for the reduction tests */
+struct utest_acc_s {
+  int64_t sum;
+  int64_t n;
+  double  x;
+};
+
+static void
+utest_init(void *acc, void *arg)
+{
+  struct utest_acc_s *a = (struct utest_acc_s *) acc;
+  a->sum = 0;
+  a->n   = 0;
+  a->x   = 0.;
+}
+
+static void
+utest_body(int64_t lo, int64_t hi, void *acc, void *arg)
+{
+  struct utest_acc_s *a = (struct utest_acc_s *) acc;
+  int64_t             i;
+
+  for (i = lo; i < hi; i++)
+    {
+      a->sum += i;
+      a->n   += 1;
+      a->x   += 1.0 / (double) (i+1);
+    }
+}
+
+static void
+utest_combine(void *acc, const void *other, void *arg)
+{
+  struct utest_acc_s       *a = (struct utest_acc_s *) acc;
+  const struct utest_acc_s *b = (const struct utest_acc_s *) other;
+
+  a->sum += b->sum;
+  a->n   += b->n;
+  a->x   += b->x;
+}
+
+/* utest_Reduce()
+ * Integer sums are exact in either mode; in deterministic mode, a
+ * floating point sum is identical for any number of workers.
+ */
+static void
+utest_Reduce(int64_t n, int64_t grain, int maxcpu)
+{
+  char               msg[] = "threadpool Reduce test failed";
+  ESL_THREADPOOL    *tp;
+  struct utest_acc_s acc;
+  double             x1 = 0.;
+  int                ncpu;
+  int                det;
+
+  for (det = 0; det <= 1; det++)
+    for (ncpu = 1; ncpu <= maxcpu; ncpu++)
+      {
+	if ((tp = esl_threadpool_Create(ncpu)) == NULL) esl_fatal(msg);
+	esl_threadpool_SetDeterministic(tp, det);
+	if (esl_threadpool_Reduce(tp, 0, n, grain, sizeof(struct utest_acc_s), utest_init, utest_body, utest_combine, NULL, &acc) != eslOK) esl_fatal(msg);
+	if (acc.n   != n)             esl_fatal(msg);
+	if (acc.sum != n * (n-1) / 2) esl_fatal(msg);
+	if (det)
+	  {
+	    if (ncpu == 1) x1 = acc.x;
+	    else if (memcmp(&x1, &acc.x, sizeof(double)) != 0) esl_fatal(msg);
+	  }
+	esl_threadpool_Destroy(tp);
+      }
+}
+
+/* utest_Nested()
+ * Loop bodies start nested loops on the same pool: a For over rows
+ * runs a For over columns, and a Reduce over rows runs a Reduce over
+ * columns; every cell is visited once, and the sums are right.
+ */
+static void
+utest_nested_rowbody(int64_t lo, int64_t hi, void *arg)
+{
+  struct utest_arg_s *u = (struct utest_arg_s *) arg;
+  struct utest_arg_s  row;
+  int64_t             r;
+
+  for (r = lo; r < hi; r++)
+    {
+      row        = *u;
+      row.visit  = u->visit + r * u->ncol;
+      if (esl_threadpool_For(u->tp, 0, u->ncol, u->grain, utest_forbody, &row) != eslOK) esl_fatal("nested For failed");
+      if (row.badw) u->badw = TRUE;
+    }
+}
+
+static void
+utest_nested_reducebody(int64_t lo, int64_t hi, void *acc, void *arg)
+{
+  struct utest_arg_s *u = (struct utest_arg_s *) arg;
+  struct utest_acc_s  inner;
+  int64_t             r;
+
+  for (r = lo; r < hi; r++)
+    {
+      if (esl_threadpool_Reduce(u->tp, r * u->ncol, (r+1) * u->ncol, u->grain, sizeof(struct utest_acc_s),
+				utest_init, utest_body, utest_combine, NULL, &inner) != eslOK) esl_fatal("nested Reduce failed");
+      utest_combine(acc, &inner, NULL);
+    }
+}
+
+static void
+utest_Nested(ESL_THREADPOOL *tp, int64_t nrow, int64_t ncol, int64_t grain)
+{
+  char               msg[] = "threadpool nested loop test failed";
+  struct utest_arg_s u;
+  struct utest_acc_s acc;
+  int64_t            i;
+  int64_t            n = nrow * ncol;
+
+  u.tp    = tp;
+  u.ncol  = ncol;
+  u.grain = grain;
+  u.badw  = FALSE;
+  if ((u.visit = calloc(n, sizeof(int))) == NULL) esl_fatal(msg);
+
+  if (esl_threadpool_For(tp, 0, nrow, 1, utest_nested_rowbody, &u) != eslOK) esl_fatal(msg);
+  for (i = 0; i < n; i++)
+    if (u.visit[i] != 1) esl_fatal(msg);
+  if (u.badw) esl_fatal(msg);
+
+  if (esl_threadpool_Reduce(tp, 0, nrow, 1, sizeof(struct utest_acc_s), utest_init, utest_nested_reducebody, utest_combine, &u, &acc) != eslOK) esl_fatal(msg);
+  if (acc.n   != n)             esl_fatal(msg);
+  if (acc.sum != n * (n-1) / 2) esl_fatal(msg);
+
+  free(u.visit);
+}
+#endif /*eslTHREADPOOL_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+
+
+/*****************************************************************
+ *# 5. Test driver.
+ *****************************************************************/
+#ifdef eslTHREADPOOL_TESTDRIVE
+/* gcc -g -Wall -pthread -o esl_threadpool_utest -I. -L. -DeslTHREADPOOL_TESTDRIVE esl_threadpool.c -leasel -lm
+ * ./esl_threadpool_utest
+ */
+#include "esl_config.h"
+
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_threadpool.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "--cpu",     eslARG_INT,      "4", NULL, "n>0", NULL,  NULL, NULL, "test pools of up to <n> workers",                0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "unit test driver for esl_threadpool module";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go     = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  int             maxcpu = esl_opt_GetInteger(go, "--cpu");
+  ESL_THREADPOOL *tp;
+  int             ncpu;
+  int             det;
+
+  fprintf(stderr, "## %s\n", argv[0]);
+
+  for (ncpu = 1; ncpu <= maxcpu; ncpu++)
+    for (det = 0; det <= 1; det++)
+      {
+	if ((tp = esl_threadpool_Create(ncpu)) == NULL) esl_fatal("pool creation failed");
+	esl_threadpool_SetDeterministic(tp, det);
+
+	utest_For(tp, 0, 0,      0);
+	utest_For(tp, 0, 1,      0);
+	utest_For(tp, 5, 3,      0);
+	utest_For(tp, 0, 100000, 0);
+	utest_For(tp, 0, 1000,   1);
+	utest_For(tp, 17, 1000,  7);
+	utest_For(tp, 0, 1000,   5000);
+
+	utest_Nested(tp, 50, 200, 3);
+	utest_Nested(tp, 1,  1,   0);
+
+	esl_threadpool_Destroy(tp);
+      }
+
+  utest_Reduce(0,      0,    maxcpu);
+  utest_Reduce(1,      0,    maxcpu);
+  utest_Reduce(100000, 0,    maxcpu);
+  utest_Reduce(10000,  1,    maxcpu);
+  utest_Reduce(10007,  33,   maxcpu);
+
+  esl_getopts_Destroy(go);
+
+  fprintf(stderr, "#  status = ok\n");
+  return eslOK;
+}
+#endif /*eslTHREADPOOL_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
+
+
+
+
+/*****************************************************************
+ *# 6. Benchmark.
+ *****************************************************************/
+#ifdef eslTHREADPOOL_BENCHMARK
+/* gcc -O3 -Wall -pthread -o esl_threadpool_benchmark -I. -L. -DeslTHREADPOOL_BENCHMARK esl_threadpool.c -leasel -lm
+ * ./esl_threadpool_benchmark --cpu 8
+ *
+ * Times a parallel for and a parallel reduction over <-N> iterations
+ * of synthetic work, for 1..<--cpu> workers, and reports the speedup
+ * over one worker.
+ */
+#include "esl_config.h"
+
+#include <stdio.h>
+#include <math.h>
+
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_stopwatch.h"
+#include "esl_threadpool.h"
+
+static ESL_OPTIONS options[] = {
+  /* name     type         deflt       env   rng    togs  req   incmpt help                                    docgrp */
+  { "-h",     eslARG_NONE,  FALSE,     NULL, NULL,  NULL, NULL, NULL, "show help and usage",                     0 },
+  { "-N",     eslARG_INT,  "10000000", NULL, "n>0", NULL, NULL, NULL, "number of loop iterations",               0 },
+  { "-g",     eslARG_INT,   "0",       NULL, "n>=0",NULL, NULL, NULL, "grain; 0 = automatic",                    0 },
+  { "--cpu",  eslARG_INT,   "4",       NULL, "n>0", NULL, NULL, NULL, "benchmark pools of 1..<n> workers",       0 },
+  { "--det",  eslARG_NONE,  FALSE,     NULL, NULL,  NULL, NULL, NULL, "deterministic reductions",                0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "benchmark driver for esl_threadpool module";
+
+static void
+bench_forbody(int64_t lo, int64_t hi, void *arg)
+{
+  double *x = (double *) arg;
+  int64_t i;
+
+  for (i = lo; i < hi; i++) x[i] = sqrt((double) i) * log((double) i + 1.);
+}
+
+static void bench_init   (void *acc, void *arg)                   { *(double *) acc = 0.; }
+static void bench_combine(void *acc, const void *other, void *arg) { *(double *) acc += *(const double *) other; }
+static void
+bench_body(int64_t lo, int64_t hi, void *acc, void *arg)
+{
+  const double *x = (const double *) arg;
+  double        s = 0.;
+  int64_t       i;
+
+  for (i = lo; i < hi; i++) s += sin(x[i]);
+  *(double *) acc += s;
+}
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go     = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_STOPWATCH  *w      = esl_stopwatch_Create();
+  int64_t         N      = esl_opt_GetInteger(go, "-N");
+  int64_t         grain  = esl_opt_GetInteger(go, "-g");
+  int             maxcpu = esl_opt_GetInteger(go, "--cpu");
+  ESL_THREADPOOL *tp;
+  double         *x;
+  double          sum;
+  double          t1_for = 0., t1_red = 0.;
+  double          t_for, t_red;
+  int             ncpu;
+
+  if ((x = malloc(sizeof(double) * N)) == NULL) esl_fatal("allocation failed");
+
+  printf("# %6s %10s %8s %10s %8s %s\n", "ncpu", "for(s)", "speedup", "reduce(s)", "speedup", "sum");
+  for (ncpu = 1; ncpu <= maxcpu; ncpu++)
+    {
+      if ((tp = esl_threadpool_Create(ncpu)) == NULL) esl_fatal("pool creation failed");
+      esl_threadpool_SetDeterministic(tp, esl_opt_GetBoolean(go, "--det"));
+
+      esl_stopwatch_Start(w);
+      esl_threadpool_For(tp, 0, N, grain, bench_forbody, x);
+      esl_stopwatch_Stop(w);
+      t_for = w->elapsed;
+
+      esl_stopwatch_Start(w);
+      esl_threadpool_Reduce(tp, 0, N, grain, sizeof(double), bench_init, bench_body, bench_combine, x, &sum);
+      esl_stopwatch_Stop(w);
+      t_red = w->elapsed;
+
+      if (ncpu == 1) { t1_for = t_for; t1_red = t_red; }
+      printf("  %6d %10.4f %8.2f %10.4f %8.2f %.17g\n", ncpu, t_for, t1_for / t_for, t_red, t1_red / t_red, sum);
+      esl_threadpool_Destroy(tp);
+    }
+
+  free(x);
+  esl_stopwatch_Destroy(w);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*eslTHREADPOOL_BENCHMARK*/
+/*-------------------- end, benchmark ---------------------------*/
+
+
+
+
+/*****************************************************************
+ * Easel - a library of C functions for biological sequence analysis
+ * Version h3.1b2; February 2015
+ * Copyright (C) 2015 Howard Hughes Medical Institute.
+ * Other copyrights also apply. See the COPYRIGHT file for a full list.
+ *
+ * Easel is distributed under the Janelia Farm Software License, a BSD
+ * license. See the LICENSE file for more details.
+ *****************************************************************/
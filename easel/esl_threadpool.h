@@ -0,0 +1,76 @@
+/* Work-stealing thread pool: parallel loops and reductions.
+ */
+#ifndef eslTHREADPOOL_INCLUDED
+#define eslTHREADPOOL_INCLUDED
+#include "esl_config.h"
+
+#include <stdint.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#define eslTHREADPOOL_NCHUNKS  1024   /* default grain splits a loop into about this many chunks */
+
+struct esl_threadpool_loop_s;	      /* one parallel loop in progress; private to esl_threadpool.c */
+
+/* A task is a range of chunks <c0..c1-1> of a loop. */
+typedef struct {
+  struct esl_threadpool_loop_s *loop;
+  int64_t                       c0, c1;
+} ESL_THREADPOOL_TASK;
+
+/* Each worker owns a deque of tasks: it pushes and pops at the
+ * bottom, and idle workers steal the oldest (biggest) task from
+ * the top.
+ */
+typedef struct {
+  ESL_THREADPOOL_TASK *task;	/* tasks [top..bot-1]                */
+  int                  top;	/* next task a thief takes           */
+  int                  bot;	/* one past the task the owner takes */
+  int                  nalloc;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t      lock;
+#endif
+} ESL_THREADPOOL_DEQUE;
+
+typedef struct {
+  int                   nworkers;      /* workers, including the calling thread: >= 1             */
+  int                   deterministic; /* TRUE: reductions combine in a fixed order, independent of scheduling */
+  ESL_THREADPOOL_DEQUE *dq;	       /* [0..nworkers-1]; dq[0] belongs to the calling thread   */
+#ifdef HAVE_PTHREAD
+  pthread_t            *tid;	       /* [1..nworkers-1] pool threads; tid[0] unused            */
+  int                   nthreads;      /* number of pool threads started (nworkers-1 on success) */
+  pthread_key_t         key;	       /* in a thread working for this pool: its worker index + 1 */
+  pthread_mutex_t       extlock;       /* serializes loops started from outside the pool          */
+  pthread_mutex_t       lock;	       /* protects <nsleep>, <shutdown>; idle workers wait on <wake> */
+  pthread_cond_t        wake;
+  volatile int          nsleep;	       /* number of workers waiting on <wake>                     */
+  int                   shutdown;      /* TRUE when pool threads should exit                      */
+#endif
+} ESL_THREADPOOL;
+
+extern ESL_THREADPOOL *esl_threadpool_Create(int ncpu);
+extern void            esl_threadpool_Destroy(ESL_THREADPOOL *tp);
+extern int             esl_threadpool_SetDeterministic(ESL_THREADPOOL *tp, int deterministic);
+extern int             esl_threadpool_GetWorkerCount(const ESL_THREADPOOL *tp);
+extern int             esl_threadpool_GetWorkerIndex(const ESL_THREADPOOL *tp);
+
+extern int esl_threadpool_For   (ESL_THREADPOOL *tp, int64_t start, int64_t end, int64_t grain,
+				 void (*body)(int64_t lo, int64_t hi, void *arg), void *arg);
+extern int esl_threadpool_Reduce(ESL_THREADPOOL *tp, int64_t start, int64_t end, int64_t grain,
+				 size_t accsize,
+				 void (*init)   (void *acc, void *arg),
+				 void (*body)   (int64_t lo, int64_t hi, void *acc, void *arg),
+				 void (*combine)(void *acc, const void *other, void *arg),
+				 void *arg, void *ret_acc);
+
+#endif /*eslTHREADPOOL_INCLUDED*/
+/*****************************************************************
+ * Easel - a library of C functions for biological sequence analysis
+ * Version h3.1b2; February 2015
+ * Copyright (C) 2015 Howard Hughes Medical Institute.
+ * Other copyrights also apply. See the COPYRIGHT file for a full list.
+ *
+ * Easel is distributed under the Janelia Farm Software License, a BSD
+ * license. See the LICENSE file for more details.
+ *****************************************************************/
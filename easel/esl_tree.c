@@ -8,8 +8,9 @@
  *   5. Generating simulated trees.
  *   6. Unit tests.
  *   7. Test driver.
- *   8. Examples.
- *   9. Copyright notice and license.
+ *   8. Benchmark.
+ *   9. Examples.
+ *  10. Copyright notice and license.
  */
 #include "esl_config.h"
 
@@ -24,6 +25,10 @@
 #include "esl_stack.h"
 #include "esl_vectorops.h"
 #include "esl_random.h"
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include "esl_threads.h"
+#endif
 
 /*****************************************************************
  *# 1. The ESL_TREE object.
@@ -1549,7 +1554,10 @@ esl_tree_Compare(ESL_TREE *T1, ESL_TREE *T2)
  * 
  * Input <D_original> is a symmetric distance matrix, for <D->n> taxa.
  * The diagonal is all 0's, and off-diagonals are $\geq 0$. <D->n>
- * must be at least two.
+ * must be at least two. It is copied into a packed triangle of
+ * doubles to work on. <cluster_engine_fsmx()> does the same for a
+ * packed float matrix <D>, using <D> itself as working space (its
+ * off-diagonal contents are destroyed).
  * 
  * <mode> is one of <eslUPGMA>, <eslWPGMA>, <eslSINGLE_LINKAGE>, or
  * <eslCOMPLETE_LINKAGE>: a flag specifying which algorithm to use.
@@ -1560,57 +1568,101 @@ esl_tree_Compare(ESL_TREE *T1, ESL_TREE *T2)
  * 
  * Throws <eslEMEM> on allocation failure.
  * 
- * Complexity: O(N^2) in memory, O(N^3) in time.
- * 
- * This function can be optimized. Memory usage is at least
- * 4x more than necessary. First, we don't need to make a copy of D
- * if the caller doesn't mind it being consumed. Second, D only
- * needs to be lower- or upper-triangular, because it's symmetric,
- * but that requires changing dmatrix module. In time,
- * O(N^2 log N) if not O(N^2) should be possible, by being more
- * sophisticated about identifying the minimum element; 
- * see Gronau and Moran (2006).
- * 
+ * Complexity: O(N^2) in memory; O(N^2) in time in practice, O(N^3)
+ * worst case.
+ *
+ * The tree is exactly the one the original O(N^3) implementation
+ * built (see cluster_engine_cubic() in the unit tests), down to
+ * which of several exactly tied pairs is merged, node numbering, and
+ * left/right order. That matters: fractional identity distances are
+ * full of ties, and GSC weights depend on how they're resolved.
+ *
+ * The original repeatedly took the first minimum, in row-major
+ * order, of a shrinking matrix; after each merge it swapped the pair
+ * to the last two rows (j to N-1, then i to N-2), merged them into
+ * row N-2, and dropped row N-1. Here, clusters stay put in their
+ * storage "slots", and pslot[] tracks which slot is in each row of
+ * that virtual matrix. For each row p we cache the first minimum of
+ * row p right of the diagonal, rmin[p] at column rarg[p]. A merge
+ * changes at most three columns (i, j, and N-2) and drops column
+ * N-1, so most cached rows are updated by looking at those columns,
+ * and a row is only rescanned when the cached minimum itself got
+ * larger or went away.
+ */
+typedef struct {
+  double       *dp;		/* packed triangle of doubles, see cluster_tri(); or NULL */
+  ESL_FSMATRIX *F;		/* ... or a packed float matrix, used in place            */
+  int64_t       N;		/* number of taxa                                         */
+} CLUSTER_DIST;
+
+/* index of d(i,j), i != j, in a packed upper triangle for N taxa */
+static int64_t
+cluster_tri(int64_t N, int64_t i, int64_t j)
+{
+  if (i > j) ESL_SWAP(i, j, int64_t);
+  return i * N - i * (i+1) / 2 + (j - i - 1);
+}
+
+static inline double
+cluster_get(const CLUSTER_DIST *W, int a, int b)
+{
+  return (W->dp ? W->dp[cluster_tri(W->N, a, b)] : (double) W->F->mx[esl_fsmx_Index(W->F, a, b)]);
+}
+
+static inline void
+cluster_set(CLUSTER_DIST *W, int a, int b, double d)
+{
+  if (W->dp) W->dp[cluster_tri(W->N, a, b)]       = d;
+  else       W->F->mx[esl_fsmx_Index(W->F, a, b)] = (float) d;
+}
+
+/* first minimum of virtual row p, right of the diagonal, among <n>
+ * rows; NaN's never compare less, so they're skipped.
  */
+static void
+cluster_rowscan(const CLUSTER_DIST *W, const int *pslot, int n, int p, double *rmin, int *rarg)
+{
+  double d;
+  int    q;
+
+  rarg[p] = -1;
+  for (q = p+1; q < n; q++)
+    {
+      d = cluster_get(W, pslot[p], pslot[q]);
+      if (! isnan(d) && (rarg[p] == -1 || d < rmin[p])) { rmin[p] = d; rarg[p] = q; }
+    }
+}
+
 static int
-cluster_engine(ESL_DMATRIX *D_original, int mode, ESL_TREE **ret_T)
+cluster_engine_work(CLUSTER_DIST *W, int mode, ESL_TREE **ret_T)
 {
-  ESL_DMATRIX *D = NULL;
-  ESL_TREE    *T = NULL;
-  double      *height = NULL;	/* height of internal nodes  [0..N-2]          */
-  int         *idx    = NULL;	/* taxa or node index of row/col in D [0..N-1] */
-  int         *nin    = NULL;	/* # of taxa in clade in row/col in D [0..N-1] */
+  ESL_TREE    *T      = NULL;
+  double      *height = NULL;	/* height of internal nodes  [0..N-2]                    */
+  int         *idx    = NULL;	/* taxa or node index of cluster in slot s [0..N-1]      */
+  int         *nin    = NULL;	/* # of taxa in cluster in slot s [0..N-1]               */
+  int         *pslot  = NULL;	/* slot of the cluster in virtual row/col p [0..N-1]     */
+  double      *rmin   = NULL;	/* first minimum of row p, right of diagonal [0..N-1]    */
+  int         *rarg   = NULL;	/* ... and its column; -1 if none                        */
+  int          chg[3];		/* rows/cols changed by a merge                          */
+  int          nchg;
   int          N;
-  int          i = 0, j = 0;
-  int          row,col;
-  double       minD;
+  int          i, j, si, sj, c, k, p, q;
+  double       minD, d;
   int          status;
 
-  /* Contract checks.
-   */
-  ESL_DASSERT1((D_original != NULL));               /* matrix exists      */
-  ESL_DASSERT1((D_original->n == D_original->m));   /* D is NxN square    */
-  ESL_DASSERT1((D_original->n >= 2));               /* >= 2 taxa          */
-#if (eslDEBUGLEVEL >=1)
-  for (i = 0; i < D_original->n; i++) {
-    assert(D_original->mx[i][i] == 0.);	           /* self-self d = 0    */
-    for (j = i+1; j < D_original->n; j++)	   /* D symmetric        */
-      assert(D_original->mx[i][j] == D_original->mx[j][i]);
-  }
-#endif
-
-  /* Allocations.
-   * NxN copy of the distance matrix, which we'll iteratively whittle down to 2x2;
-   * tree for N taxa;
-   */
-  if ((D = esl_dmatrix_Clone(D_original)) == NULL) return eslEMEM;
-  if ((T = esl_tree_Create(D->n))         == NULL) return eslEMEM;
-  ESL_ALLOC(idx,    sizeof(int)    *  D->n);
-  ESL_ALLOC(nin,    sizeof(int)    *  D->n);
-  ESL_ALLOC(height, sizeof(double) * (D->n-1));
-  for (i = 0; i < D->n;   i++) idx[i]    = -i; /* assign taxa indices to row/col coords */
-  for (i = 0; i < D->n;   i++) nin[i ]   = 1;  /* each cluster starts as 1  */
-  for (i = 0; i < D->n-1; i++) height[i] = 0.; 
+  N = W->N;
+  if ((T = esl_tree_Create(N)) == NULL) return eslEMEM;
+  ESL_ALLOC(idx,    sizeof(int)    * N);
+  ESL_ALLOC(nin,    sizeof(int)    * N);
+  ESL_ALLOC(pslot,  sizeof(int)    * N);
+  ESL_ALLOC(rmin,   sizeof(double) * N);
+  ESL_ALLOC(rarg,   sizeof(int)    * N);
+  ESL_ALLOC(height, sizeof(double) * (N-1));
+  for (i = 0; i < N;   i++) idx[i]    = -i; /* assign taxa indices to slots */
+  for (i = 0; i < N;   i++) nin[i]    = 1;  /* each cluster starts as 1     */
+  for (i = 0; i < N;   i++) pslot[i]  = i;
+  for (i = 0; i < N-1; i++) height[i] = 0.; 
+  for (p = 0; p < N;   p++) cluster_rowscan(W, pslot, N, p, rmin, rarg);
 
   /* If we're doing either single linkage or complete linkage clustering,
    * we will construct a "linkage tree", where ld[v], rd[v] "branch lengths"
@@ -1622,27 +1674,30 @@ cluster_engine(ESL_DMATRIX *D_original, int mode, ESL_TREE **ret_T)
   if (mode == eslSINGLE_LINKAGE || mode == eslCOMPLETE_LINKAGE)
     T->is_linkage_tree = TRUE;
 
-  for (N = D->n; N >= 2; N--)
+  for (; N >= 2; N--)
     {
-      /* Find minimum in our current N x N matrix.
-       * (Don't init minD to -infinity; linkage trees use sparse distance matrices 
-       * with -infinity representing unlinked.)
+      /* Find the first minimum, in row-major order, of our current
+       * N x N virtual matrix. (Don't init minD to -infinity; linkage
+       * trees use sparse distance matrices with -infinity
+       * representing unlinked.) Like the original, which started
+       * from 0-1 and took anything strictly less: if d(0,1) is NaN,
+       * link 0-1; otherwise NaN's are passed over.
        */
-      minD = D->mx[0][1]; i = 0; j = 1;	/* init with: if nothing else, try to link 0-1 */
-      for (row = 0; row < N; row++)
-	for (col = row+1; col < N; col++)
-	  if (D->mx[row][col] < minD)
-	    {
-	      minD = D->mx[row][col];
-	      i    = row;
-	      j    = col;
-	    }
+      minD = cluster_get(W, pslot[0], pslot[1]); i = 0; j = 1;
+      if (! isnan(minD))
+	{
+	  for (p = 0; p < N-1; p++)
+	    if (rarg[p] != -1 && rmin[p] < minD) { minD = rmin[p]; i = p; }
+	  j = rarg[i];
+	}
+      si = pslot[i];
+      sj = pslot[j];
 
-      /* We're joining node at row/col i with node at row/col j.
+      /* We're joining the cluster at row/col i with the one at row/col j.
        * Add node (index = N-2) to the tree at height minD/2.
        */
-      T->left[N-2]  = idx[i];
-      T->right[N-2] = idx[j];
+      T->left[N-2]  = idx[si];
+      T->right[N-2] = idx[sj];
       if (T->is_linkage_tree)        height[N-2]   = minD;
       else                           height[N-2]   = minD / 2.;
 
@@ -1650,79 +1705,150 @@ cluster_engine(ESL_DMATRIX *D_original, int mode, ESL_TREE **ret_T)
        */
       T->ld[N-2] = T->rd[N-2] = height[N-2];
       if (! T->is_linkage_tree) {
-	if (idx[i] > 0) T->ld[N-2] -= height[idx[i]];
-	if (idx[j] > 0) T->rd[N-2] -= height[idx[j]];      
+	if (idx[si] > 0) T->ld[N-2] -= height[idx[si]];
+	if (idx[sj] > 0) T->rd[N-2] -= height[idx[sj]];      
       }
       
       /* If either node was an internal node, record parent in it.
        */
-      if (idx[i] > 0)  T->parent[idx[i]] = N-2;
-      if (idx[j] > 0)  T->parent[idx[j]] = N-2;
-
-      /* Now, build a new matrix by merging row i+j and col i+j.
-       *  1. move j to N-1 (unless it's already there)
-       *  2. move i to N-2 (unless it's already there)
-       */
-      if (j != N-1)
-	{
-	  for (row = 0; row < N; row++)
-	    ESL_SWAP(D->mx[row][N-1], D->mx[row][j], double);
-	  for (col = 0; col < N; col++)
-	    ESL_SWAP(D->mx[N-1][col], D->mx[j][col], double);
-	  ESL_SWAP(idx[j],  idx[N-1],  int);
-	  ESL_SWAP(nin[j], nin[N-1], int);
-	}
-      if (i != N-2)
-	{
-	  for (row = 0; row < N; row++)
-	    ESL_SWAP(D->mx[row][N-2], D->mx[row][i], double);
-	  for (col = 0; col < N; col++)
-	    ESL_SWAP(D->mx[N-2][col], D->mx[i][col], double);
-	  ESL_SWAP(idx[i], idx[N-2], int);
-	  ESL_SWAP(nin[i], nin[N-2], int);
-	}
-      i = N-2;
-      j = N-1;
+      if (idx[si] > 0)  T->parent[idx[si]] = N-2;
+      if (idx[sj] > 0)  T->parent[idx[sj]] = N-2;
 
-      /* 3. merge i (now at N-2) with j (now at N-1) 
-       *    according to the desired clustering rule.
+      /* Merge sj into si according to the desired clustering rule.
        */
-      for (col = 0; col < N; col++)
+      for (p = 0; p < N; p++)
 	{
+	  c = pslot[p];
+	  if (c == si || c == sj) continue;
 	  switch (mode) {
 	  case eslUPGMA: 
-	    D->mx[i][col] = (nin[i] * D->mx[i][col] + nin[j] * D->mx[j][col]) / (double) (nin[i] + nin[j]);
+	    d = (nin[si] * cluster_get(W, si, c) + nin[sj] * cluster_get(W, sj, c)) / (double) (nin[si] + nin[sj]);
 	    break;
-	  case eslWPGMA:            D->mx[i][col] = (D->mx[i][col] + D->mx[j][col]) / 2.;    break;
-	  case eslSINGLE_LINKAGE:   D->mx[i][col] = ESL_MIN(D->mx[i][col], D->mx[j][col]);   break;
-	  case eslCOMPLETE_LINKAGE: D->mx[i][col] = ESL_MAX(D->mx[i][col], D->mx[j][col]);   break;
+	  case eslWPGMA:            d = (cluster_get(W, si, c) + cluster_get(W, sj, c)) / 2.;              break;
+	  case eslSINGLE_LINKAGE:   d = ESL_MIN(cluster_get(W, si, c), cluster_get(W, sj, c));             break;
+	  case eslCOMPLETE_LINKAGE: d = ESL_MAX(cluster_get(W, si, c), cluster_get(W, sj, c));             break;
 	  default:                  ESL_XEXCEPTION(eslEINCONCEIVABLE, "no such strategy");
 	  }
-	  D->mx[col][i] = D->mx[i][col];
+	  cluster_set(W, si, c, d);
 	}
+      nin[si] += nin[sj];
+      idx[si]  = N-2;
 
-      /* row/col i is now the new cluster, and it corresponds to node N-2
-       * in the tree (remember, N is decrementing at each iteration).
-       * row/col j (N-1) falls away when we go back to the start of the loop 
-       * and decrement N. 
+      /* Move the merged pair to the end, as the original did:
+       *  1. the cluster in row N-1 moves to row j (unless j is N-1)
+       *  2. the cluster in row N-2 moves to row i (unless i is N-2)
+       * The merged cluster ends up in row N-2; row N-1 falls away.
        */
-      nin[i] += nin[j];
-      idx[i]  = N-2;
+      nchg = 0;
+      chg[nchg++] = N-2;
+      if (j != N-1) { pslot[j] = pslot[N-1]; if (j != N-2) chg[nchg++] = j; }
+      if (i != N-2) { pslot[i] = pslot[N-2]; chg[nchg++] = i; }
+      pslot[N-2] = si;
+
+      /* Bring the cached row minima up to date for the N-1 rows left.
+       */
+      for (p = 0; p < N-1; p++)
+	{
+	  for (k = 0; k < nchg; k++) if (chg[k] == p) break;
+	  if (k < nchg || rarg[p] == N-1) { cluster_rowscan(W, pslot, N-1, p, rmin, rarg); continue; }
+
+	  for (k = 0; k < nchg; k++) if (chg[k] == rarg[p]) break;
+	  if (k < nchg)
+	    { /* the minimum's own column changed: still first if it didn't grow */
+	      d = cluster_get(W, pslot[p], pslot[rarg[p]]);
+	      if (isnan(d) || d > rmin[p]) { cluster_rowscan(W, pslot, N-1, p, rmin, rarg); continue; }
+	      rmin[p] = d;
+	    }
+	  for (k = 0; k < nchg; k++)
+	    {
+	      q = chg[k];
+	      if (q <= p || q == rarg[p]) continue;
+	      d = cluster_get(W, pslot[p], pslot[q]);
+	      if (d < rmin[p] || (d == rmin[p] && q < rarg[p])) { rmin[p] = d; rarg[p] = q; }
+	    }
+	}
     }  
 
-  esl_dmatrix_Destroy(D);
   free(height);
   free(idx);
   free(nin);
+  free(pslot);
+  free(rmin);
+  free(rarg);
   if (ret_T != NULL) *ret_T = T;
   return eslOK;
 
  ERROR:
-  if (D      != NULL) esl_dmatrix_Destroy(D);
   if (T      != NULL) esl_tree_Destroy(T);
   if (height != NULL) free(height);
   if (idx    != NULL) free(idx);
   if (nin    != NULL) free(nin);
+  if (pslot  != NULL) free(pslot);
+  if (rmin   != NULL) free(rmin);
+  if (rarg   != NULL) free(rarg);
+  if (ret_T  != NULL) *ret_T = NULL;
+  return status;
+}
+
+static int
+cluster_engine_fsmx(ESL_FSMATRIX *D, int mode, ESL_TREE **ret_T)
+{
+  CLUSTER_DIST W;
+
+  /* Contract checks.
+   */
+  ESL_DASSERT1((D != NULL));               /* matrix exists      */
+  ESL_DASSERT1((D->n >= 2));               /* >= 2 taxa          */
+#if (eslDEBUGLEVEL >=1)
+  { int a;
+    for (a = 0; a < D->n; a++)
+      assert(esl_fsmx_Get(D, a, a) == 0.);   /* self-self d = 0    */
+  }
+#endif
+
+  W.dp = NULL;
+  W.F  = D;
+  W.N  = D->n;
+  return cluster_engine_work(&W, mode, ret_T);
+}
+
+static int
+cluster_engine(ESL_DMATRIX *D_original, int mode, ESL_TREE **ret_T)
+{
+  CLUSTER_DIST W;
+  int64_t      N = D_original->n;
+  int          a, b;
+  int          status;
+
+  /* Contract checks.
+   */
+  ESL_DASSERT1((D_original != NULL));               /* matrix exists      */
+  ESL_DASSERT1((D_original->n == D_original->m));   /* D is NxN square    */
+  ESL_DASSERT1((D_original->n >= 2));               /* >= 2 taxa          */
+#if (eslDEBUGLEVEL >=1)
+  for (a = 0; a < D_original->n; a++) {
+    assert(D_original->mx[a][a] == 0.);	           /* self-self d = 0    */
+    for (b = a+1; b < D_original->n; b++)	   /* D symmetric (NaN's, from empty seqs, too) */
+      assert(D_original->mx[a][b] == D_original->mx[b][a] || (isnan(D_original->mx[a][b]) && isnan(D_original->mx[b][a])));
+  }
+#endif
+
+  /* Working copy: a packed triangle of doubles, half the size of a
+   * clone of D, with the same values.
+   */
+  W.F  = NULL;
+  W.N  = N;
+  W.dp = NULL;
+  ESL_ALLOC(W.dp, sizeof(double) * ESL_MAX(1, N * (N-1) / 2));
+  for (a = 0; a < N; a++)
+    for (b = a+1; b < N; b++)
+      W.dp[cluster_tri(N, a, b)] = D_original->mx[a][b];
+
+  status = cluster_engine_work(&W, mode, ret_T);
+  free(W.dp);
+  return status;
+
+ ERROR:
   if (ret_T != NULL) *ret_T = NULL;
   return status;
 }
@@ -1733,6 +1859,18 @@ cluster_engine(ESL_DMATRIX *D_original, int mode, ESL_TREE **ret_T)
  * Purpose:   Given distance matrix <D>, use the UPGMA algorithm
  *            to construct a tree <T>.
  *
+ *            Takes $O(N^2)$ memory. Time is about $O(N^2)$ on real
+ *            data, but $O(N^3)$ in the worst case. Each merge only
+ *            rescans the rows whose cached minimum got larger or
+ *            went away. Most rows are not affected. But if many
+ *            rows have their minimum in one of the merged clusters
+ *            (a star-like matrix, say), each merge costs $O(N^2)$.
+ *            The limit comes from reproducing the original
+ *            $O(N^3)$ algorithm's tree exactly, including which of
+ *            several tied pairs is merged first. A method that is
+ *            $O(N^2)$ in the worst case (such as nearest-neighbor
+ *            chains) would resolve ties differently.
+ *
  * Returns:   <eslOK> on success; the tree is returned in <ret_T>,
  *            and must be freed by the caller with <esl_tree_Destroy()>.
  *
@@ -1749,6 +1887,9 @@ esl_tree_UPGMA(ESL_DMATRIX *D, ESL_TREE **ret_T)
  * Purpose:   Given distance matrix <D>, use the WPGMA algorithm
  *            to construct a tree <T>.
  *
+ *            Complexity is the same as <esl_tree_UPGMA()>: $O(N^2)$
+ *            memory, and $O(N^3)$ time in the worst case.
+ *
  * Returns:   <eslOK> on success; the tree is returned in <ret_T>,
  *            and must be freed by the caller with <esl_tree_Destroy()>.
  *
@@ -1765,6 +1906,9 @@ esl_tree_WPGMA(ESL_DMATRIX *D, ESL_TREE **ret_T)
  * Purpose:   Given distance matrix <D>, construct a single-linkage
  *            (minimum distances) clustering tree <T>.
  *
+ *            Complexity is the same as <esl_tree_UPGMA()>: $O(N^2)$
+ *            memory, and $O(N^3)$ time in the worst case.
+ *
  * Returns:   <eslOK> on success; the tree is returned in <ret_T>,
  *            and must be freed by the caller with <esl_tree_Destroy()>.
  *
@@ -1781,6 +1925,9 @@ esl_tree_SingleLinkage(ESL_DMATRIX *D, ESL_TREE **ret_T)
  * Purpose:   Given distance matrix <D>, construct a complete-linkage
  *            (maximum distances) clustering tree <T>.
  *
+ *            Complexity is the same as <esl_tree_UPGMA()>: $O(N^2)$
+ *            memory, and $O(N^3)$ time in the worst case.
+ *
  * Returns:   <eslOK> on success; the tree is returned in <ret_T>,
  *            and must be freed by the caller with <esl_tree_Destroy()>.
  *
@@ -1791,103 +1938,643 @@ esl_tree_CompleteLinkage(ESL_DMATRIX *D, ESL_TREE **ret_T)
 {
   return cluster_engine(D, eslCOMPLETE_LINKAGE, ret_T);
 }
-/*----------------- end, clustering algorithms  ----------------*/
-
 
+/* Function:  esl_tree_ClusterFMx()
+ * Synopsis:  Distance clustering of a packed float distance matrix.
+ *
+ * Purpose:   Same as <esl_tree_UPGMA()>, <esl_tree_WPGMA()>,
+ *            <esl_tree_SingleLinkage()>, or <esl_tree_CompleteLinkage()>,
+ *            according to <mode> (<eslUPGMA>, <eslWPGMA>,
+ *            <eslSINGLE_LINKAGE>, <eslCOMPLETE_LINKAGE>), for a
+ *            distance matrix <D> in a packed symmetric float matrix,
+ *            as from <esl_dst_XDiffFMx()>.
+ *
+ *            To save memory on large problems, <D> itself is used as
+ *            working space, instead of a copy: on return, its
+ *            off-diagonal contents are garbage. Merged distances are
+ *            stored back as floats, so branch lengths are only good
+ *            to float precision, and the tree can differ from the
+ *            one the <ESL_DMATRIX> equivalent builds in double
+ *            precision where distances are tied, or nearly so.
+ *
+ *            <D> may be a memory-mapped matrix from
+ *            <esl_fsmatrix_CreateMapped()>, for problems too big for
+ *            RAM. Its tiled layout keeps each row scan of the
+ *            clustering to about <N/eslFSMATRIX_TILE> pages.
+ *
+ *            Time is $O(N^3)$ in the worst case, as described for
+ *            <esl_tree_UPGMA()>. That bound also counts row scans,
+ *            and so page reads, on a mapped <D>.
+ *
+ * Returns:   <eslOK> on success; the tree is returned in <ret_T>,
+ *            and must be freed by the caller with <esl_tree_Destroy()>.
+ *
+ * Throws:    <eslEMEM> on allocation problem, and <ret_T> is set <NULL>.
+ *            <eslEINVAL> if <mode> isn't one of the four above.
+ */
+int
+esl_tree_ClusterFMx(ESL_FSMATRIX *D, int mode, ESL_TREE **ret_T)
+{
+  if (mode != eslUPGMA && mode != eslWPGMA && mode != eslSINGLE_LINKAGE && mode != eslCOMPLETE_LINKAGE)
+    { if (ret_T) *ret_T = NULL; ESL_EXCEPTION(eslEINVAL, "no such clustering mode"); }
+  return cluster_engine_fsmx(D, mode, ret_T);
+}
 
-/*****************************************************************
- * 5. Generating simulated trees
- *****************************************************************/
 
-/* Function:  esl_tree_Simulate()
- * Synopsis:  Generate a random rooted ultrametric tree.
+/* Function:  esl_tree_NJ()
+ * Synopsis:  Neighbor-joining tree from a distance matrix.
  *
- * Purpose:   Generate a random rooted ultrametric tree of <N> taxa,
- *            using the algorithm of Kuhner and Felsenstein (1994).
- *            
- *            The branch lengths are generated by choosing <N-1>
- *            exponentially distributed split times, with decreasing
- *            expectations of $\frac{1}{2},\frac{1}{3}..\frac{1}{N}$
- *            as the simulation proceeds from the root. Thus the
- *            total expected branch length on the tree is
- *            $\sum_{k=2}^{N} \frac{1}{k}$.
+ * Purpose:   Given distance matrix <D>, use the neighbor-joining
+ *            algorithm of Saitou and Nei (1987) to construct an
+ *            unrooted additive tree <T>.
  *
- * Args:      r     - random number source
- *            N     - number of taxa (>= 2)
- *            ret_T - RETURN: sampled tree
+ *            The tree follows the unrooted tree convention: the
+ *            "root" node 0 sits on the branch to taxon 0, with
+ *            <T->left[0] = 0> and <T->rd[0] = 0.0>, and
+ *            <T->show_unrooted> is set, so <esl_tree_WriteNewick()>
+ *            writes it as a trifurcation. Negative branch length
+ *            estimates are set to 0.
  *
- * Returns:   <eslOK> on success, and the new tree is allocated
- *            here and returned via <ret_tree>; caller is 
- *            responsible for free'ing it.
+ *            Same as <esl_tree_NJParallel()> with one thread.
  *
- * Throws:    <eslEMEM> on allocation failure, in which case
- *            the <ret_T> is returned <NULL>.
+ * Returns:   <eslOK> on success; the tree is returned in <ret_T>,
+ *            and must be freed by the caller with <esl_tree_Destroy()>.
  *
- * Xref:      STL11/65.
+ * Throws:    <eslEMEM> on allocation problem, and <ret_T> is set <NULL>.
  */
 int
-esl_tree_Simulate(ESL_RANDOMNESS *r, int N, ESL_TREE **ret_T)
+esl_tree_NJ(ESL_DMATRIX *D, ESL_TREE **ret_T)
 {
-  ESL_TREE       *T          = NULL;
-  int            *branchpapa = NULL;
-  int            *branchside = NULL;
-  int       nactive;
-  double    d;
-  int       node;
-  int       bidx;	        	/* index of an active branch */
-  int       status;
+  return esl_tree_NJParallel(D, 1, ret_T);
+}
 
-  ESL_DASSERT1( (r != NULL) );
-  ESL_DASSERT1( (N >= 2) );
 
-  /* Kuhner/Felsenstein uses a list of active branches,
-   * which we implement by tracking the index of the parent
-   * node (in <branchpapa>) and a 0/1 flag (in <branchside>)
-   * for the branch to the left vs. right child.
-   */
-  if ((T = esl_tree_Create(N)) == NULL)  goto ERROR;
-  ESL_ALLOC(branchpapa, sizeof(int) * N);
-  ESL_ALLOC(branchside, sizeof(int) * N);
-  
-  /* Initialize: add two branches from the root
-   * onto the active list, and set internal node
-   * counter to start at 1.
-   */
-  branchpapa[0] = 0;   branchside[0] = 0;
-  branchpapa[1] = 0;   branchside[1] = 1;
-  nactive = 2;
-  node    = 1;			
+/* nj_*: neighbor joining, RapidNJ-style [Simonsen, Mailund and
+ * Pedersen, 2008].
+ *
+ * Each round joins the pair i,j that minimizes
+ *    Q(i,j) = (n-2) d(i,j) - (u_i + u_j)
+ * where u_i is the sum of i's distances to the other n-1 active
+ * clusters. Rather than evaluating all n^2/2 pairs, each cluster
+ * keeps a row of its distances to the clusters that existed when it
+ * was made, sorted by distance. Since u_j <= umax, a row can be
+ * abandoned as soon as (n-2) d - (u_i + umax) exceeds the best Q
+ * found so far; usually that's after a few entries. Distances
+ * between surviving clusters never change, so rows stay sorted;
+ * entries for clusters that have since been joined are skipped.
+ *
+ * Clusters are identified by <id>: taxa 0..N-1, joins N..2N-3.
+ * Active clusters live in "slots" 0..N-1 of a packed triangular
+ * distance matrix; a join goes into the lower of its two slots.
+ * The pair to join is the minimum of (Q, lower id, higher id), so
+ * the result doesn't depend on how rows are shared among threads.
+ */
+struct nj_entry_s {
+  float d;			/* distance, rounded down: a lower bound for pruning */
+  int   id;			/* id of the other cluster */
+};
+
+struct nj_s {
+  int      N;			/* number of taxa */
+  int      nact;		/* number of active clusters */
+  int     *act;			/* active slots, in increasing order [0..nact-1] */
+  int     *id;			/* id[s] = id of cluster in slot s [0..N-1] */
+  int     *slot;		/* slot[k] = slot of cluster k, or -1 once joined [0..2N-3] */
+  double  *dp;			/* packed upper triangle of distances between slots */
+  double  *u;			/* u[s] = sum of distances from slot s to other active slots */
+  double   umax;		/* max of u[] over active slots */
+  struct nj_entry_s **row;	/* row[s][head[s]..len[s]-1]: sorted distances to older clusters */
+  int     *head;
+  int     *len;
+  int     *cap;			/* allocated size of row[s] */
+  int      nw;			/* number of row scanners */
+  double  *qbest;		/* best Q found by each scanner [0..nw-1] */
+  int     *abest;		/* ... and its lower id, or -1 if none  */
+  int     *bbest;		/* ... and its higher id */
+#ifdef HAVE_PTHREAD
+  int             gen;		/* incremented to start a scan */
+  int             ndone;	/* # of scanners done with this scan */
+  int             quit;		/* TRUE when threads should exit */
+  int             use_lock;
+  pthread_mutex_t mutex;
+  pthread_cond_t  go;
+  pthread_cond_t  done;
+#endif
+};
 
-  /* Algorithm proceeds by iterating:
-   *    1. choose random time <d> from exponential(1/nactive)
-   *    2. choose random active branch, <bidx>
-   *    3. add new <node> to active branch at length d
-   *    4. add d to all other active branches      
-   *    5. delete the old parent branch from the active list,
-   *       add the two new child branches to the active list
-   */
-  while (nactive < N)
-    {
-      d               = (double) nactive * -log(esl_rnd_UniformPositive(r));
-      bidx            = esl_rnd_Roll(r, nactive);
-      T->parent[node] = branchpapa[bidx];
-      
-      if (branchside[bidx] == 0) {
-	T->left[branchpapa[bidx]]   = node;
-	T->ld  [branchpapa[bidx]]  += d;
-      } else {
-	T->right[branchpapa[bidx]]  = node;
-	T->rd   [branchpapa[bidx]] += d;
-      }
+/* below this many active clusters, scanning isn't worth waking threads */
+#define eslTREE_NJ_MINPAR 256
 
-      ESL_SWAP(branchpapa[bidx], branchpapa[nactive-1], int);
-      ESL_SWAP(branchside[bidx], branchside[nactive-1], int);
-      for (bidx = 0; bidx < nactive-1; bidx++) {
-	if (branchside[bidx] == 0) T->ld[branchpapa[bidx]] += d;
-	else                       T->rd[branchpapa[bidx]] += d;
-      }
-      
-      /* delete the branch at nactive-1 that we just added to;
+static int
+nj_entry_compare(const void *v1, const void *v2)
+{
+  const struct nj_entry_s *e1 = (const struct nj_entry_s *) v1;
+  const struct nj_entry_s *e2 = (const struct nj_entry_s *) v2;
+
+  if      (e1->d  < e2->d)  return -1;
+  else if (e1->d  > e2->d)  return  1;
+  else if (e1->id < e2->id) return -1;
+  else if (e1->id > e2->id) return  1;
+  return 0;
+}
+
+/* float nearest to <d> from below, so pruning bounds stay bounds */
+static float
+nj_floor(double d)
+{
+  float f = (float) d;
+  if ((double) f > d) f = nextafterf(f, -HUGE_VALF);
+  return f;
+}
+
+/* nj_scan()
+ * Scanner <w> of <nw> finds the best pair in rows act[w], act[w+nw]...
+ */
+static void
+nj_scan(struct nj_s *nj, int w, int nw)
+{
+  int     N    = nj->N;
+  double  nm2  = (double) (nj->nact - 2);
+  double  best = eslINFINITY;
+  int     ba   = -1;
+  int     bb   = -1;
+  struct nj_entry_s *e;
+  double  q, us;
+  int     k, x, s, c, a, b;
+
+  for (k = w; k < nj->nact; k += nw)
+    {
+      s  = nj->act[k];
+      us = nj->u[s];
+      e  = nj->row[s];
+      for (x = nj->head[s]; x < nj->len[s]; x++)
+	{
+	  if (nm2 * e[x].d - (us + nj->umax) > best) break;
+	  if ((c = nj->slot[e[x].id]) < 0) {
+	    if (x == nj->head[s]) nj->head[s]++; /* drop dead entries off the front */
+	    continue;
+	  }
+	  q = nm2 * nj->dp[cluster_tri(N, s, c)] - (us + nj->u[c]);
+	  a = ESL_MIN(nj->id[s], e[x].id);
+	  b = ESL_MAX(nj->id[s], e[x].id);
+	  if (q < best || (q == best && (a < ba || (a == ba && b < bb))))
+	    { best = q; ba = a; bb = b; }
+	}
+    }
+  nj->qbest[w] = best;
+  nj->abest[w] = ba;
+  nj->bbest[w] = bb;
+}
+
+#ifdef HAVE_PTHREAD
+static void
+nj_thread(void *arg)
+{
+  ESL_THREADS *thr = (ESL_THREADS *) arg;
+  struct nj_s *nj;
+  int          w;
+  int          gen = 0;
+
+  esl_threads_Started(thr, &w);
+  nj = (struct nj_s *) esl_threads_GetData(thr, w);
+
+  pthread_mutex_lock(&(nj->mutex));
+  while (1)
+    {
+      while (nj->gen == gen && ! nj->quit) pthread_cond_wait(&(nj->go), &(nj->mutex));
+      if (nj->quit) break;
+      gen = nj->gen;
+      pthread_mutex_unlock(&(nj->mutex));
+
+      nj_scan(nj, w, nj->nw);
+
+      pthread_mutex_lock(&(nj->mutex));
+      if (++nj->ndone == nj->nw) pthread_cond_signal(&(nj->done));
+    }
+  pthread_mutex_unlock(&(nj->mutex));
+  esl_threads_Finished(thr, w);
+}
+#endif /*HAVE_PTHREAD*/
+
+
+/* nj_build_tree()
+ *
+ * Given the unrooted tree found by NJ, as links up[k] from each
+ * cluster k to the join that took it (the last two clusters linked
+ * to each other), with branch lengths upd[k], and the two clusters
+ * child1[k-N], child2[k-N] of each join k: make an <ESL_TREE>
+ * rooted on the branch to taxon 0, numbering nodes in preorder.
+ * Shared with the unit tests.
+ */
+static int
+nj_build_tree(int N, const int *up, const double *upd, const int *child1, const int *child2, ESL_TREE **ret_T)
+{
+  ESL_TREE  *T  = NULL;
+  ESL_STACK *ns = NULL;
+  int        nbr[3];
+  int        k, from, pv, side, v, x, c, nn;
+  int        status;
+
+  if ((T  = esl_tree_Create(N))    == NULL) { status = eslEMEM; goto ERROR; }
+  if ((ns = esl_stack_ICreate())   == NULL) { status = eslEMEM; goto ERROR; }
+  T->show_unrooted = TRUE;
+
+  T->parent[0] = 0;
+  T->left[0]   = 0;
+  T->ld[0]     = upd[0];
+  T->rd[0]     = 0.;
+  if (up[0] < N) T->right[0] = -up[0]; /* N=2: just two taxa */
+  else {
+    if ((status = esl_stack_IPush(ns, up[0])) != eslOK) goto ERROR; /* join k, reached from cluster <from>, */
+    if ((status = esl_stack_IPush(ns, 0))     != eslOK) goto ERROR; /* becomes child <side> of node <pv> */
+    if ((status = esl_stack_IPush(ns, 0))     != eslOK) goto ERROR;
+    if ((status = esl_stack_IPush(ns, 1))     != eslOK) goto ERROR;
+  }
+
+  v = 1;
+  while (esl_stack_IPop(ns, &side) == eslOK)
+    {
+      esl_stack_IPop(ns, &pv);
+      esl_stack_IPop(ns, &from);
+      esl_stack_IPop(ns, &k);
+
+      T->parent[v] = pv;
+      if (side == 0) T->left[pv]  = v;
+      else           T->right[pv] = v;
+
+      /* the other two neighbors of k become its children */
+      nbr[0] = child1[k-N];
+      nbr[1] = child2[k-N];
+      nbr[2] = up[k];
+      for (nn = 0, x = 0; x < 3; x++)
+	{
+	  if ((c = nbr[x]) == from) continue;
+	  if (nn == 0) T->ld[v] = (c == up[k] ? upd[k] : upd[c]);
+	  else         T->rd[v] = (c == up[k] ? upd[k] : upd[c]);
+	  if (c < N) {
+	    if (nn == 0) T->left[v]  = -c;
+	    else         T->right[v] = -c;
+	  } else {
+	    if ((status = esl_stack_IPush(ns, c))  != eslOK) goto ERROR;
+	    if ((status = esl_stack_IPush(ns, k))  != eslOK) goto ERROR;
+	    if ((status = esl_stack_IPush(ns, v))  != eslOK) goto ERROR;
+	    if ((status = esl_stack_IPush(ns, nn)) != eslOK) goto ERROR;
+	  }
+	  nn++;
+	}
+      v++;
+    }
+
+  esl_stack_Destroy(ns);
+  *ret_T = T;
+  return eslOK;
+
+ ERROR:
+  if (T  != NULL) esl_tree_Destroy(T);
+  if (ns != NULL) esl_stack_Destroy(ns);
+  *ret_T = NULL;
+  return status;
+}
+
+
+/* Function:  esl_tree_NJParallel()
+ * Synopsis:  Neighbor-joining tree, using multiple threads.
+ *
+ * Purpose:   Same as <esl_tree_NJ()>, using up to <ncpu> threads to
+ *            search for each join. The tree is the same for any
+ *            <ncpu>.
+ *
+ *            The search uses the sorted-row bounds of RapidNJ
+ *            (Simonsen et al., 2008), which typically look at a
+ *            small fraction of the $O(N^2)$ pairs in each of the
+ *            $N-2$ rounds. Memory is about $8N^2$ bytes: a packed
+ *            triangle of distances in doubles, plus sorted rows.
+ *            Among pairs with exactly tied join criteria, the pair
+ *            with the lowest-numbered clusters is joined.
+ *
+ * Args:      D     - symmetric distance matrix; not modified
+ *            ncpu  - number of threads to use ($\geq 1$)
+ *            ret_T - RETURN: the tree
+ *
+ * Returns:   <eslOK> on success; the tree is returned in <ret_T>,
+ *            and must be freed by the caller with <esl_tree_Destroy()>.
+ *
+ * Throws:    <eslEMEM> on allocation problem; <eslESYS> if a thread
+ *            can't be created. <ret_T> is set <NULL>.
+ */
+int
+esl_tree_NJParallel(ESL_DMATRIX *D, int ncpu, ESL_TREE **ret_T)
+{
+  struct nj_s nj;
+  int        *up     = NULL;	/* up[k]: cluster k's neighbor toward the last join [0..2N-3] */
+  double     *upd    = NULL;	/* upd[k]: branch length from k to up[k] */
+  int        *child1 = NULL;	/* child1[k-N], child2[k-N]: the clusters join k took */
+  int        *child2 = NULL;
+  int         N      = D->n;
+  int         njoin  = 0;
+  int         s, t, c, k, x, w, nw, a, b, nrow;
+  double      dij, li, lj, dsc, dtc, dn, uk;
+  void       *p;
+  int         status;
+#ifdef HAVE_PTHREAD
+  ESL_THREADS *thr   = NULL;
+#endif
+
+  ESL_DASSERT1((D->n == D->m));	/* D is NxN square    */
+  ESL_DASSERT1((D->n >= 2));	/* >= 2 taxa          */
+
+  memset(&nj, 0, sizeof(struct nj_s));
+  ncpu  = ESL_MAX(1, ncpu);
+  nj.N  = N;
+  nj.nw = ncpu;
+  ESL_ALLOC(nj.act,   sizeof(int)    * N);
+  ESL_ALLOC(nj.id,    sizeof(int)    * N);
+  ESL_ALLOC(nj.slot,  sizeof(int)    * (2*N-2));
+  ESL_ALLOC(nj.dp,    sizeof(double) * ((int64_t) N * (N-1) / 2 + 1));
+  ESL_ALLOC(nj.u,     sizeof(double) * N);
+  ESL_ALLOC(nj.row,   sizeof(struct nj_entry_s *) * N);
+  for (s = 0; s < N; s++) nj.row[s] = NULL;
+  ESL_ALLOC(nj.head,  sizeof(int)    * N);
+  ESL_ALLOC(nj.len,   sizeof(int)    * N);
+  ESL_ALLOC(nj.cap,   sizeof(int)    * N);
+  ESL_ALLOC(nj.qbest, sizeof(double) * ncpu);
+  ESL_ALLOC(nj.abest, sizeof(int)    * ncpu);
+  ESL_ALLOC(nj.bbest, sizeof(int)    * ncpu);
+  ESL_ALLOC(up,       sizeof(int)    * (2*N-2));
+  ESL_ALLOC(upd,      sizeof(double) * (2*N-2));
+  ESL_ALLOC(child1,   sizeof(int)    * ESL_MAX(1, N-2));
+  ESL_ALLOC(child2,   sizeof(int)    * ESL_MAX(1, N-2));
+
+  /* Taxon s's row holds taxa 0..s-1; each pair is in exactly one row. */
+  for (s = 0; s < N; s++)
+    {
+      nj.act[s]  = s;
+      nj.id[s]   = s;
+      nj.slot[s] = s;
+      nj.u[s]    = 0.;
+      nj.head[s] = 0;
+      nj.len[s]  = s;
+      nj.cap[s]  = ESL_MAX(1, s);
+      ESL_ALLOC(nj.row[s], sizeof(struct nj_entry_s) * nj.cap[s]);
+      for (c = 0; c < s; c++) {
+	nj.dp[cluster_tri(N, c, s)] = D->mx[c][s];
+	nj.row[s][c].d  = nj_floor(D->mx[c][s]);
+	nj.row[s][c].id = c;
+      }
+      qsort(nj.row[s], s, sizeof(struct nj_entry_s), nj_entry_compare);
+    }
+  for (s = 0; s < N; s++)
+    for (c = 0; c < N; c++)
+      if (c != s) nj.u[s] += nj.dp[cluster_tri(N, s, c)];
+  nj.nact = N;
+
+#ifdef HAVE_PTHREAD
+  if (ncpu > 1 && N >= eslTREE_NJ_MINPAR)
+    {
+      if (pthread_mutex_init(&(nj.mutex), NULL) != 0) ESL_XEXCEPTION(eslESYS, "mutex init failed");
+      if (pthread_cond_init (&(nj.go),    NULL) != 0) { pthread_mutex_destroy(&(nj.mutex)); ESL_XEXCEPTION(eslESYS, "cond init failed"); }
+      if (pthread_cond_init (&(nj.done),  NULL) != 0) { pthread_mutex_destroy(&(nj.mutex)); pthread_cond_destroy(&(nj.go)); ESL_XEXCEPTION(eslESYS, "cond init failed"); }
+      nj.use_lock = TRUE;
+
+      if ((thr = esl_threads_Create(&nj_thread)) == NULL) { status = eslEMEM; goto ERROR; }
+      for (w = 0; w < ncpu; w++)
+	if ((status = esl_threads_AddThread(thr, (void *) &nj)) != eslOK) break;
+      nj.nw = w;
+      esl_threads_WaitForStart(thr);
+      if (w < ncpu) goto ERROR;
+    }
+#endif
+
+  while (nj.nact > 2)
+    {
+      /* Find the best pair to join */
+      for (nj.umax = -eslINFINITY, x = 0; x < nj.nact; x++)
+	nj.umax = ESL_MAX(nj.umax, nj.u[nj.act[x]]);
+
+#ifdef HAVE_PTHREAD
+      if (thr != NULL && nj.nact >= eslTREE_NJ_MINPAR)
+	{
+	  pthread_mutex_lock(&(nj.mutex));
+	  nj.ndone = 0;
+	  nj.gen++;
+	  pthread_cond_broadcast(&(nj.go));
+	  while (nj.ndone < nj.nw) pthread_cond_wait(&(nj.done), &(nj.mutex));
+	  pthread_mutex_unlock(&(nj.mutex));
+	  nw = nj.nw;
+	}
+      else
+#endif
+	{ nj_scan(&nj, 0, 1); nw = 1; }
+
+      for (a = nj.abest[0], b = nj.bbest[0], w = 1; w < nw; w++)
+	if (nj.abest[w] != -1 &&
+	    (a == -1 || nj.qbest[w] < nj.qbest[0] ||
+	     (nj.qbest[w] == nj.qbest[0] && (nj.abest[w] < a || (nj.abest[w] == a && nj.bbest[w] < b)))))
+	  { nj.qbest[0] = nj.qbest[w]; a = nj.abest[w]; b = nj.bbest[w]; }
+      if (a == -1) ESL_XEXCEPTION(eslEINCONCEIVABLE, "no pair found to join"); /* NaN distances? */
+
+      /* Join a and b into new cluster k, in the lower slot s. */
+      s   = ESL_MIN(nj.slot[a], nj.slot[b]);
+      t   = ESL_MAX(nj.slot[a], nj.slot[b]);
+      k   = N + njoin;
+      dij = nj.dp[cluster_tri(N, s, t)];
+      li  = 0.5 * dij + (nj.u[s] - nj.u[t]) / (2. * (nj.nact - 2));
+      lj  = dij - li;
+      if (li < 0.) { li = 0.; lj = ESL_MAX(0., dij); }
+      if (lj < 0.) { lj = 0.; li = ESL_MAX(0., dij); }
+      child1[njoin]    = nj.id[s];
+      child2[njoin]    = nj.id[t];
+      up[nj.id[s]]     = k;  upd[nj.id[s]] = li;
+      up[nj.id[t]]     = k;  upd[nj.id[t]] = lj;
+      nj.slot[nj.id[s]] = -1;
+      nj.slot[nj.id[t]] = -1;
+      nj.slot[k]        = s;
+      nj.id[s]          = k;
+      njoin++;
+
+      for (x = 0; nj.act[x] != t; x++) ;
+      memmove(nj.act+x, nj.act+x+1, sizeof(int) * (nj.nact-x-1));
+      nj.nact--;
+
+      /* New distances, row sums, and k's sorted row */
+      nrow = nj.nact - 1;
+      if (nrow > nj.cap[s]) {
+	ESL_RALLOC(nj.row[s], p, sizeof(struct nj_entry_s) * nrow);
+	nj.cap[s] = nrow;
+      }
+      for (uk = 0., nrow = 0, x = 0; x < nj.nact; x++)
+	{
+	  c = nj.act[x];
+	  if (c == s) continue;
+	  dsc = nj.dp[cluster_tri(N, s, c)];
+	  dtc = nj.dp[cluster_tri(N, t, c)];
+	  dn  = 0.5 * (dsc + dtc - dij);
+	  nj.u[c] += dn - dsc - dtc;
+	  uk      += dn;
+	  nj.dp[cluster_tri(N, s, c)] = dn;
+	  nj.row[s][nrow].d  = nj_floor(dn);
+	  nj.row[s][nrow].id = nj.id[c];
+	  nrow++;
+	}
+      qsort(nj.row[s], nrow, sizeof(struct nj_entry_s), nj_entry_compare);
+      nj.u[s]    = uk;
+      nj.head[s] = 0;
+      nj.len[s]  = nrow;
+      free(nj.row[t]);
+      nj.row[t]  = NULL;
+    }
+
+  /* The last two clusters are linked to each other. */
+  s = nj.act[0];
+  t = nj.act[1];
+  up[nj.id[s]]  = nj.id[t];
+  up[nj.id[t]]  = nj.id[s];
+  upd[nj.id[s]] = upd[nj.id[t]] = ESL_MAX(0., nj.dp[cluster_tri(N, s, t)]);
+
+  if ((status = nj_build_tree(N, up, upd, child1, child2, ret_T)) != eslOK) goto ERROR;
+  status = eslOK;
+  goto CLEANUP;
+
+ ERROR:
+  if (ret_T != NULL) *ret_T = NULL;
+
+ CLEANUP:
+#ifdef HAVE_PTHREAD
+  if (thr != NULL)
+    {
+      pthread_mutex_lock(&(nj.mutex));
+      nj.quit = TRUE;
+      pthread_cond_broadcast(&(nj.go));
+      pthread_mutex_unlock(&(nj.mutex));
+      esl_threads_WaitForFinish(thr);
+      esl_threads_Destroy(thr);
+    }
+  if (nj.use_lock)
+    {
+      pthread_mutex_destroy(&(nj.mutex));
+      pthread_cond_destroy(&(nj.go));
+      pthread_cond_destroy(&(nj.done));
+    }
+#endif
+  if (nj.row != NULL) {
+    for (s = 0; s < N; s++)
+      if (nj.row[s] != NULL) free(nj.row[s]);
+    free(nj.row);
+  }
+  if (nj.act   != NULL) free(nj.act);
+  if (nj.id    != NULL) free(nj.id);
+  if (nj.slot  != NULL) free(nj.slot);
+  if (nj.dp    != NULL) free(nj.dp);
+  if (nj.u     != NULL) free(nj.u);
+  if (nj.head  != NULL) free(nj.head);
+  if (nj.len   != NULL) free(nj.len);
+  if (nj.cap   != NULL) free(nj.cap);
+  if (nj.qbest != NULL) free(nj.qbest);
+  if (nj.abest != NULL) free(nj.abest);
+  if (nj.bbest != NULL) free(nj.bbest);
+  if (up       != NULL) free(up);
+  if (upd      != NULL) free(upd);
+  if (child1   != NULL) free(child1);
+  if (child2   != NULL) free(child2);
+  return status;
+}
+/*----------------- end, clustering algorithms  ----------------*/
+
+
+
+/*****************************************************************
+ * 5. Generating simulated trees
+ *****************************************************************/
+
+/* Function:  esl_tree_Simulate()
+ * Synopsis:  Generate a random rooted ultrametric tree.
+ *
+ * Purpose:   Generate a random rooted ultrametric tree of <N> taxa,
+ *            using the algorithm of Kuhner and Felsenstein (1994).
+ *            
+ *            The branch lengths are generated by choosing <N-1>
+ *            exponentially distributed split times, with decreasing
+ *            expectations of $\frac{1}{2},\frac{1}{3}..\frac{1}{N}$
+ *            as the simulation proceeds from the root. Thus the
+ *            total expected branch length on the tree is
+ *            $\sum_{k=2}^{N} \frac{1}{k}$.
+ *
+ * Args:      r     - random number source
+ *            N     - number of taxa (>= 2)
+ *            ret_T - RETURN: sampled tree
+ *
+ * Returns:   <eslOK> on success, and the new tree is allocated
+ *            here and returned via <ret_tree>; caller is 
+ *            responsible for free'ing it.
+ *
+ * Throws:    <eslEMEM> on allocation failure, in which case
+ *            the <ret_T> is returned <NULL>.
+ *
+ * Xref:      STL11/65.
+ */
+int
+esl_tree_Simulate(ESL_RANDOMNESS *r, int N, ESL_TREE **ret_T)
+{
+  ESL_TREE       *T          = NULL;
+  int            *branchpapa = NULL;
+  int            *branchside = NULL;
+  int       nactive;
+  double    d;
+  int       node;
+  int       bidx;	        	/* index of an active branch */
+  int       status;
+
+  ESL_DASSERT1( (r != NULL) );
+  ESL_DASSERT1( (N >= 2) );
+
+  /* Kuhner/Felsenstein uses a list of active branches,
+   * which we implement by tracking the index of the parent
+   * node (in <branchpapa>) and a 0/1 flag (in <branchside>)
+   * for the branch to the left vs. right child.
+   */
+  if ((T = esl_tree_Create(N)) == NULL)  goto ERROR;
+  ESL_ALLOC(branchpapa, sizeof(int) * N);
+  ESL_ALLOC(branchside, sizeof(int) * N);
+  
+  /* Initialize: add two branches from the root
+   * onto the active list, and set internal node
+   * counter to start at 1.
+   */
+  branchpapa[0] = 0;   branchside[0] = 0;
+  branchpapa[1] = 0;   branchside[1] = 1;
+  nactive = 2;
+  node    = 1;			
+
+  /* Algorithm proceeds by iterating:
+   *    1. choose random time <d> from exponential(1/nactive)
+   *    2. choose random active branch, <bidx>
+   *    3. add new <node> to active branch at length d
+   *    4. add d to all other active branches      
+   *    5. delete the old parent branch from the active list,
+   *       add the two new child branches to the active list
+   */
+  while (nactive < N)
+    {
+      d               = (double) nactive * -log(esl_rnd_UniformPositive(r));
+      bidx            = esl_rnd_Roll(r, nactive);
+      T->parent[node] = branchpapa[bidx];
+      
+      if (branchside[bidx] == 0) {
+	T->left[branchpapa[bidx]]   = node;
+	T->ld  [branchpapa[bidx]]  += d;
+      } else {
+	T->right[branchpapa[bidx]]  = node;
+	T->rd   [branchpapa[bidx]] += d;
+      }
+
+      ESL_SWAP(branchpapa[bidx], branchpapa[nactive-1], int);
+      ESL_SWAP(branchside[bidx], branchside[nactive-1], int);
+      for (bidx = 0; bidx < nactive-1; bidx++) {
+	if (branchside[bidx] == 0) T->ld[branchpapa[bidx]] += d;
+	else                       T->rd[branchpapa[bidx]] += d;
+      }
+      
+      /* delete the branch at nactive-1 that we just added to;
        * replace it with two new branches
        */
       branchpapa[nactive-1]  = node;  branchside[nactive-1] = 0;
@@ -2072,6 +2759,470 @@ utest_UPGMA(ESL_RANDOMNESS *r, int ntaxa)
   return;
 }
 
+
+/* The original O(N^3) cluster_engine(), repeatedly finding the
+ * global minimum in a shrinking copy of D: a reference for testing
+ * the current one, which must build exactly the same trees.
+ */
+static int
+cluster_engine_cubic(ESL_DMATRIX *D_original, int mode, ESL_TREE **ret_T)
+{
+  ESL_DMATRIX *D = NULL;
+  ESL_TREE    *T = NULL;
+  double      *height = NULL;	/* height of internal nodes  [0..N-2]          */
+  int         *idx    = NULL;	/* taxa or node index of row/col in D [0..N-1] */
+  int         *nin    = NULL;	/* # of taxa in clade in row/col in D [0..N-1] */
+  int          N;
+  int          i = 0, j = 0;
+  int          row,col;
+  double       minD;
+  int          status;
+
+  /* Contract checks.
+   */
+  ESL_DASSERT1((D_original != NULL));               /* matrix exists      */
+  ESL_DASSERT1((D_original->n == D_original->m));   /* D is NxN square    */
+  ESL_DASSERT1((D_original->n >= 2));               /* >= 2 taxa          */
+#if (eslDEBUGLEVEL >=1)
+  for (i = 0; i < D_original->n; i++) {
+    assert(D_original->mx[i][i] == 0.);	           /* self-self d = 0    */
+    for (j = i+1; j < D_original->n; j++)	   /* D symmetric        */
+      assert(D_original->mx[i][j] == D_original->mx[j][i] || (isnan(D_original->mx[i][j]) && isnan(D_original->mx[j][i])));
+  }
+#endif
+
+  /* Allocations.
+   * NxN copy of the distance matrix, which we'll iteratively whittle down to 2x2;
+   * tree for N taxa;
+   */
+  if ((D = esl_dmatrix_Clone(D_original)) == NULL) return eslEMEM;
+  if ((T = esl_tree_Create(D->n))         == NULL) return eslEMEM;
+  ESL_ALLOC(idx,    sizeof(int)    *  D->n);
+  ESL_ALLOC(nin,    sizeof(int)    *  D->n);
+  ESL_ALLOC(height, sizeof(double) * (D->n-1));
+  for (i = 0; i < D->n;   i++) idx[i]    = -i; /* assign taxa indices to row/col coords */
+  for (i = 0; i < D->n;   i++) nin[i ]   = 1;  /* each cluster starts as 1  */
+  for (i = 0; i < D->n-1; i++) height[i] = 0.; 
+
+  /* If we're doing either single linkage or complete linkage clustering,
+   * we will construct a "linkage tree", where ld[v], rd[v] "branch lengths"
+   * below node v are the linkage value for clustering node v; thus 
+   * ld[v] == rd[v] in a linkage tree.
+   * For UPGMA or WPGMA, we're building an additive tree, where ld[v] and
+   * rd[v] are branch lengths.
+   */
+  if (mode == eslSINGLE_LINKAGE || mode == eslCOMPLETE_LINKAGE)
+    T->is_linkage_tree = TRUE;
+
+  for (N = D->n; N >= 2; N--)
+    {
+      /* Find minimum in our current N x N matrix.
+       * (Don't init minD to -infinity; linkage trees use sparse distance matrices 
+       * with -infinity representing unlinked.)
+       */
+      minD = D->mx[0][1]; i = 0; j = 1;	/* init with: if nothing else, try to link 0-1 */
+      for (row = 0; row < N; row++)
+	for (col = row+1; col < N; col++)
+	  if (D->mx[row][col] < minD)
+	    {
+	      minD = D->mx[row][col];
+	      i    = row;
+	      j    = col;
+	    }
+
+      /* We're joining node at row/col i with node at row/col j.
+       * Add node (index = N-2) to the tree at height minD/2.
+       */
+      T->left[N-2]  = idx[i];
+      T->right[N-2] = idx[j];
+      if (T->is_linkage_tree)        height[N-2]   = minD;
+      else                           height[N-2]   = minD / 2.;
+
+      /* Set the branch lengths (additive trees) or heights (linkage trees)
+       */
+      T->ld[N-2] = T->rd[N-2] = height[N-2];
+      if (! T->is_linkage_tree) {
+	if (idx[i] > 0) T->ld[N-2] -= height[idx[i]];
+	if (idx[j] > 0) T->rd[N-2] -= height[idx[j]];      
+      }
+      
+      /* If either node was an internal node, record parent in it.
+       */
+      if (idx[i] > 0)  T->parent[idx[i]] = N-2;
+      if (idx[j] > 0)  T->parent[idx[j]] = N-2;
+
+      /* Now, build a new matrix by merging row i+j and col i+j.
+       *  1. move j to N-1 (unless it's already there)
+       *  2. move i to N-2 (unless it's already there)
+       */
+      if (j != N-1)
+	{
+	  for (row = 0; row < N; row++)
+	    ESL_SWAP(D->mx[row][N-1], D->mx[row][j], double);
+	  for (col = 0; col < N; col++)
+	    ESL_SWAP(D->mx[N-1][col], D->mx[j][col], double);
+	  ESL_SWAP(idx[j],  idx[N-1],  int);
+	  ESL_SWAP(nin[j], nin[N-1], int);
+	}
+      if (i != N-2)
+	{
+	  for (row = 0; row < N; row++)
+	    ESL_SWAP(D->mx[row][N-2], D->mx[row][i], double);
+	  for (col = 0; col < N; col++)
+	    ESL_SWAP(D->mx[N-2][col], D->mx[i][col], double);
+	  ESL_SWAP(idx[i], idx[N-2], int);
+	  ESL_SWAP(nin[i], nin[N-2], int);
+	}
+      i = N-2;
+      j = N-1;
+
+      /* 3. merge i (now at N-2) with j (now at N-1) 
+       *    according to the desired clustering rule.
+       */
+      for (col = 0; col < N; col++)
+	{
+	  switch (mode) {
+	  case eslUPGMA: 
+	    D->mx[i][col] = (nin[i] * D->mx[i][col] + nin[j] * D->mx[j][col]) / (double) (nin[i] + nin[j]);
+	    break;
+	  case eslWPGMA:            D->mx[i][col] = (D->mx[i][col] + D->mx[j][col]) / 2.;    break;
+	  case eslSINGLE_LINKAGE:   D->mx[i][col] = ESL_MIN(D->mx[i][col], D->mx[j][col]);   break;
+	  case eslCOMPLETE_LINKAGE: D->mx[i][col] = ESL_MAX(D->mx[i][col], D->mx[j][col]);   break;
+	  default:                  ESL_XEXCEPTION(eslEINCONCEIVABLE, "no such strategy");
+	  }
+	  D->mx[col][i] = D->mx[i][col];
+	}
+
+      /* row/col i is now the new cluster, and it corresponds to node N-2
+       * in the tree (remember, N is decrementing at each iteration).
+       * row/col j (N-1) falls away when we go back to the start of the loop 
+       * and decrement N. 
+       */
+      nin[i] += nin[j];
+      idx[i]  = N-2;
+    }  
+
+  esl_dmatrix_Destroy(D);
+  free(height);
+  free(idx);
+  free(nin);
+  if (ret_T != NULL) *ret_T = T;
+  return eslOK;
+
+ ERROR:
+  if (D      != NULL) esl_dmatrix_Destroy(D);
+  if (T      != NULL) esl_tree_Destroy(T);
+  if (height != NULL) free(height);
+  if (idx    != NULL) free(idx);
+  if (nin    != NULL) free(nin);
+  if (ret_T != NULL) *ret_T = NULL;
+  return status;
+}
+
+/* utest_Linkage():
+ * On a random distance matrix, all four clustering rules must give
+ * exactly the same tree as the O(N^3) reference: same node
+ * numbering, left/right order, and branch lengths. Packed float
+ * matrices, in memory or mapped, give the same tree to float
+ * precision. With all distances tied, trees must still be valid.
+ */
+static void
+utest_Linkage(ESL_RANDOMNESS *r, int ntaxa)
+{
+  char        *msg     = "clustering engine unit test failed";
+  int          modes[4] = { eslUPGMA, eslWPGMA, eslSINGLE_LINKAGE, eslCOMPLETE_LINKAGE };
+  ESL_DMATRIX *D  = esl_dmatrix_Create(ntaxa, ntaxa);
+  ESL_DMATRIX *D1 = NULL;
+  ESL_DMATRIX *D2 = NULL;
+  ESL_FSMATRIX *F = NULL;
+  ESL_TREE    *T1 = NULL;
+  ESL_TREE    *T2 = NULL;
+  int          i, j, m, v;
+
+  for (i = 0; i < ntaxa; i++) {
+    D->mx[i][i] = 0.;
+    for (j = i+1; j < ntaxa; j++)
+      D->mx[i][j] = D->mx[j][i] = esl_random(r);
+  }
+
+  for (m = 0; m < 4; m++)
+    {
+      if (cluster_engine      (D, modes[m], &T1)   != eslOK) esl_fatal(msg);
+      if (cluster_engine_cubic(D, modes[m], &T2)   != eslOK) esl_fatal(msg);
+      if (esl_tree_Validate(T1, NULL)              != eslOK) esl_fatal(msg);
+      if (T1->is_linkage_tree != T2->is_linkage_tree)        esl_fatal(msg);
+      for (v = 0; v < ntaxa-1; v++)
+	if (T1->left[v] != T2->left[v] || T1->right[v] != T2->right[v] || T1->parent[v] != T2->parent[v] ||
+	    T1->ld[v]   != T2->ld[v]   || T1->rd[v]    != T2->rd[v]) esl_fatal(msg);
+      esl_tree_Destroy(T2);
+
+      /* packed float input gives the same tree, to float precision */
+      if ((F = esl_fsmatrix_CreateFromDMatrix(D))  == NULL)  esl_fatal(msg);
+      if (esl_tree_ClusterFMx(F, modes[m], &T2)    != eslOK) esl_fatal(msg);
+      for (v = 0; v < ntaxa-1; v++) {
+	if (T1->left[v] != T2->left[v] || T1->right[v] != T2->right[v])   esl_fatal(msg);
+	if (esl_DCompareAbs(T1->ld[v], T2->ld[v], 1e-5)          != eslOK) esl_fatal(msg);
+	if (esl_DCompareAbs(T1->rd[v], T2->rd[v], 1e-5)          != eslOK) esl_fatal(msg);
+      }
+      if (esl_tree_ToDistanceMatrix(T1, &D1)       != eslOK) esl_fatal(msg);
+      if (esl_tree_ToDistanceMatrix(T2, &D2)       != eslOK) esl_fatal(msg);
+      if (esl_dmatrix_Compare(D1, D2, 1e-5)        != eslOK) esl_fatal(msg);
+      esl_fsmatrix_Destroy(F);
+      esl_tree_Destroy(T1);
+      T1 = T2;
+
+      /* ... and a memory-mapped, tiled one gives exactly that */
+      if ((F = esl_fsmatrix_CreateMapped(ntaxa))   == NULL)  esl_fatal(msg);
+      for (i = 0; i < ntaxa; i++)
+	for (j = i; j < ntaxa; j++)
+	  esl_fsmx_Set(F, i, j, (float) D->mx[i][j]);
+      if (esl_tree_ClusterFMx(F, modes[m], &T2)    != eslOK) esl_fatal(msg);
+      for (v = 0; v < ntaxa-1; v++)
+	if (T1->left[v] != T2->left[v] || T1->ld[v] != T2->ld[v] || T1->rd[v] != T2->rd[v]) esl_fatal(msg);
+      esl_fsmatrix_Destroy(F);
+
+      esl_tree_Destroy(T1);    esl_tree_Destroy(T2);
+      esl_dmatrix_Destroy(D1); esl_dmatrix_Destroy(D2);
+    }
+
+  esl_dmatrix_SetZero(D);
+  for (m = 0; m < 4; m++)
+    {
+      if (cluster_engine(D, modes[m], &T1) != eslOK) esl_fatal(msg);
+      if (esl_tree_Validate(T1, NULL)      != eslOK) esl_fatal(msg);
+      esl_tree_Destroy(T1);
+    }
+  esl_dmatrix_Destroy(D);
+}
+
+
+/* GSC weights from tree <T>, as esl_msaweight_GSC() calculates them,
+ * in <w>[0..N-1], without the final renormalization.
+ */
+static void
+utest_gsc_weights(ESL_TREE *T, double *w)
+{
+  double *x = malloc(sizeof(double) * (T->N-1));
+  double  lw, rw, lx, rx;
+  int     i;
+
+  if (x == NULL) esl_fatal("allocation failed");
+  esl_tree_SetCladesizes(T);
+  for (i = T->N-2; i >= 0; i--)
+    {
+      x[i] = T->ld[i] + T->rd[i];
+      if (T->left[i]  > 0) x[i] += x[T->left[i]];
+      if (T->right[i] > 0) x[i] += x[T->right[i]];
+    }
+  x[0] = 0;
+  for (i = 0; i <= T->N-2; i++)
+    {
+      lw = T->ld[i];   if (T->left[i]  > 0) lw += x[T->left[i]];
+      rw = T->rd[i];   if (T->right[i] > 0) rw += x[T->right[i]];
+      if (lw+rw == 0.)
+	{
+	  lx = (T->left[i]  > 0 ? x[i] * ((double) T->cladesize[T->left[i]]  / (double) T->cladesize[i]) : x[i] / (double) T->cladesize[i]);
+	  rx = (T->right[i] > 0 ? x[i] * ((double) T->cladesize[T->right[i]] / (double) T->cladesize[i]) : x[i] / (double) T->cladesize[i]);
+	}
+      else { lx = x[i] * lw/(lw+rw); rx = x[i] * rw/(lw+rw); }
+
+      if (T->left[i]  <= 0) w[-(T->left[i])]  = lx + T->ld[i]; else x[T->left[i]]  = lx + T->ld[i];
+      if (T->right[i] <= 0) w[-(T->right[i])] = rx + T->rd[i]; else x[T->right[i]] = rx + T->rd[i];
+    }
+  free(x);
+}
+
+/* utest_LinkageTies():
+ * Fractional identity distances, as GSC weighting clusters, are
+ * multiples of 1/L and full of exact ties. On such a quantized
+ * matrix, the clustering engine must resolve the ties exactly as the
+ * O(N^3) reference does: same trees, bit for bit, and so the same
+ * GSC weights. Then again with NaN distances for one taxon, as an
+ * empty text sequence gets from esl_dst_CDiffMx().
+ */
+static void
+utest_LinkageTies(ESL_RANDOMNESS *r, int ntaxa, int L)
+{
+  char        *msg      = "clustering engine tie-breaking unit test failed";
+  int          modes[4] = { eslUPGMA, eslWPGMA, eslSINGLE_LINKAGE, eslCOMPLETE_LINKAGE };
+  ESL_DMATRIX *D        = esl_dmatrix_Create(ntaxa, ntaxa);
+  double      *w1       = malloc(sizeof(double) * ntaxa);
+  double      *w2       = malloc(sizeof(double) * ntaxa);
+  ESL_TREE    *T1       = NULL;
+  ESL_TREE    *T2       = NULL;
+  int          i, j, k, m, v;
+
+  if (D == NULL || w1 == NULL || w2 == NULL) esl_fatal(msg);
+  for (i = 0; i < ntaxa; i++) {
+    D->mx[i][i] = 0.;
+    for (j = i+1; j < ntaxa; j++)
+      D->mx[i][j] = D->mx[j][i] = (double) esl_rnd_Roll(r, L+1) / (double) L;
+  }
+
+  for (k = 0; k < 2; k++)
+    {
+      if (k == 1) {
+	i = esl_rnd_Roll(r, ntaxa);
+	for (j = 0; j < ntaxa; j++)
+	  if (j != i) D->mx[i][j] = D->mx[j][i] = eslNaN;
+      }
+
+      for (m = 0; m < 4; m++)
+	{
+	  if (cluster_engine      (D, modes[m], &T1) != eslOK) esl_fatal(msg);
+	  if (cluster_engine_cubic(D, modes[m], &T2) != eslOK) esl_fatal(msg);
+	  for (v = 0; v < ntaxa-1; v++) 
+	    {
+	      if (T1->left[v] != T2->left[v] || T1->right[v] != T2->right[v] || T1->parent[v] != T2->parent[v]) esl_fatal(msg);
+	      if (memcmp(&(T1->ld[v]), &(T2->ld[v]), sizeof(double)) != 0) esl_fatal(msg); /* NaN's too */
+	      if (memcmp(&(T1->rd[v]), &(T2->rd[v]), sizeof(double)) != 0) esl_fatal(msg);
+	    }
+
+	  utest_gsc_weights(T1, w1);
+	  utest_gsc_weights(T2, w2);
+	  if (memcmp(w1, w2, sizeof(double) * ntaxa) != 0) esl_fatal(msg);
+
+	  esl_tree_Destroy(T1);
+	  esl_tree_Destroy(T2);
+	}
+    }
+
+  free(w1);
+  free(w2);
+  esl_dmatrix_Destroy(D);
+}
+
+
+/* The obvious O(N^3) neighbor joining, evaluating every pair in
+ * every round, with the same join rule as esl_tree_NJParallel():
+ * a reference for testing it.
+ */
+static int
+nj_engine_cubic(ESL_DMATRIX *D, ESL_TREE **ret_T)
+{
+  int          N      = D->n;
+  ESL_DMATRIX *Dc     = esl_dmatrix_Clone(D);
+  int         *act    = malloc(sizeof(int)    * N);
+  int         *id     = malloc(sizeof(int)    * N);
+  double      *u      = malloc(sizeof(double) * N);
+  int         *up     = malloc(sizeof(int)    * (2*N-2));
+  double      *upd    = malloc(sizeof(double) * (2*N-2));
+  int         *child1 = malloc(sizeof(int)    * ESL_MAX(1, N-2));
+  int         *child2 = malloc(sizeof(int)    * ESL_MAX(1, N-2));
+  int          nact   = N;
+  int          njoin  = 0;
+  int          x, y, s, t, c, a, b, ba, bb;
+  double       q, best, dij, li, lj, dn, uk;
+  int          status;
+
+  for (s = 0; s < N; s++) {
+    act[s] = id[s] = s;
+    for (u[s] = 0., c = 0; c < N; c++)
+      if (c != s) u[s] += Dc->mx[s][c];
+  }
+
+  while (nact > 2)
+    {
+      best = eslINFINITY; ba = bb = -1; s = t = -1;
+      for (x = 0; x < nact; x++)
+	for (y = x+1; y < nact; y++)
+	  {
+	    q = (double) (nact-2) * Dc->mx[act[x]][act[y]] - (u[act[x]] + u[act[y]]);
+	    a = ESL_MIN(id[act[x]], id[act[y]]);
+	    b = ESL_MAX(id[act[x]], id[act[y]]);
+	    if (q < best || (q == best && (a < ba || (a == ba && b < bb))))
+	      { best = q; ba = a; bb = b; s = act[x]; t = act[y]; }
+	  }
+
+      dij = Dc->mx[s][t];
+      li  = 0.5 * dij + (u[s] - u[t]) / (2. * (nact - 2));
+      lj  = dij - li;
+      if (li < 0.) { li = 0.; lj = ESL_MAX(0., dij); }
+      if (lj < 0.) { lj = 0.; li = ESL_MAX(0., dij); }
+      child1[njoin] = id[s];  up[id[s]] = N + njoin;  upd[id[s]] = li;
+      child2[njoin] = id[t];  up[id[t]] = N + njoin;  upd[id[t]] = lj;
+      id[s] = N + njoin;
+      njoin++;
+
+      for (x = 0; act[x] != t; x++) ;
+      for (; x < nact-1; x++) act[x] = act[x+1];
+      nact--;
+
+      for (uk = 0., x = 0; x < nact; x++)
+	{
+	  c = act[x];
+	  if (c == s) continue;
+	  dn     = 0.5 * (Dc->mx[s][c] + Dc->mx[t][c] - dij);
+	  u[c]  += dn - Dc->mx[s][c] - Dc->mx[t][c];
+	  uk    += dn;
+	  Dc->mx[s][c] = Dc->mx[c][s] = dn;
+	}
+      u[s] = uk;
+    }
+  s = act[0];
+  t = act[1];
+  up[id[s]]  = id[t];
+  up[id[t]]  = id[s];
+  upd[id[s]] = upd[id[t]] = ESL_MAX(0., Dc->mx[s][t]);
+
+  status = nj_build_tree(N, up, upd, child1, child2, ret_T);
+
+  esl_dmatrix_Destroy(Dc);
+  free(act);  free(id);   free(u);
+  free(up);   free(upd);  free(child1); free(child2);
+  return status;
+}
+
+/* utest_NJ():
+ * On a random (non-additive) distance matrix, esl_tree_NJParallel()
+ * with any number of threads gives the same tree as the O(N^3)
+ * reference. On an additive matrix, from a simulated tree, NJ
+ * recovers that tree's distances.
+ */
+static void
+utest_NJ(ESL_RANDOMNESS *r, int ntaxa)
+{
+  char        *msg = "esl_tree_NJ unit test failed";
+  ESL_DMATRIX *D   = esl_dmatrix_Create(ntaxa, ntaxa);
+  ESL_DMATRIX *D1  = NULL;
+  ESL_DMATRIX *D2  = NULL;
+  ESL_TREE    *T1  = NULL;
+  ESL_TREE    *T2  = NULL;
+  int          i, j, ncpu;
+
+  for (i = 0; i < ntaxa; i++) {
+    D->mx[i][i] = 0.;
+    for (j = i+1; j < ntaxa; j++)
+      D->mx[i][j] = D->mx[j][i] = esl_random(r);
+  }
+
+  if (nj_engine_cubic(D, &T1)             != eslOK) esl_fatal(msg);
+  if (esl_tree_Validate(T1, NULL)         != eslOK) esl_fatal(msg);
+  if (T1->left[0] != 0 || T1->rd[0] != 0.)          esl_fatal(msg);
+  if (esl_tree_ToDistanceMatrix(T1, &D1)  != eslOK) esl_fatal(msg);
+  for (ncpu = 1; ncpu <= 4; ncpu++)
+    {
+      if (esl_tree_NJParallel(D, ncpu, &T2) != eslOK) esl_fatal(msg);
+      if (esl_tree_Validate(T2, NULL)       != eslOK) esl_fatal(msg);
+      if (esl_tree_Compare(T1, T2)          != eslOK) esl_fatal(msg);
+      if (esl_tree_ToDistanceMatrix(T2, &D2)!= eslOK) esl_fatal(msg);
+      if (esl_dmatrix_Compare(D1, D2, 1e-9) != eslOK) esl_fatal(msg);
+      esl_tree_Destroy(T2);
+      esl_dmatrix_Destroy(D2);
+    }
+  esl_tree_Destroy(T1);
+  esl_dmatrix_Destroy(D1);
+  esl_dmatrix_Destroy(D);
+
+  if (esl_tree_Simulate(r, ntaxa, &T1)   != eslOK) esl_fatal(msg);
+  if (esl_tree_ToDistanceMatrix(T1, &D1) != eslOK) esl_fatal(msg);
+  if (esl_tree_NJParallel(D1, 2, &T2)    != eslOK) esl_fatal(msg);
+  if (esl_tree_Validate(T2, NULL)        != eslOK) esl_fatal(msg);
+  if (esl_tree_ToDistanceMatrix(T2, &D2) != eslOK) esl_fatal(msg);
+  if (esl_dmatrix_Compare(D1, D2, 1e-6)  != eslOK) esl_fatal(msg);
+  esl_tree_Destroy(T1);    esl_tree_Destroy(T2);
+  esl_dmatrix_Destroy(D1); esl_dmatrix_Destroy(D2);
+}
 #endif /*eslTREE_TESTDRIVE*/
 /*-------------------- end, unit tests  -------------------------*/
 
@@ -2102,6 +3253,16 @@ main(int argc, char **argv)
   utest_OptionalInformation(r, ntaxa); /* SetTaxaparents(), SetCladesizes() */
   utest_WriteNewick(r, ntaxa);
   utest_UPGMA(r, ntaxa);
+  utest_Linkage(r, ntaxa);
+  utest_Linkage(r, 2);
+  utest_Linkage(r, 300);
+  utest_LinkageTies(r, ntaxa, 4);
+  utest_LinkageTies(r, 200, 20);
+  utest_LinkageTies(r, 300, 60);
+  utest_NJ(r, ntaxa);
+  utest_NJ(r, 2);
+  utest_NJ(r, 3);
+  utest_NJ(r, 600);
 
   esl_randomness_Destroy(r);
   return eslOK;
@@ -2114,7 +3275,84 @@ main(int argc, char **argv)
 
 
 /*****************************************************************
- * 8. Examples.
+ * 8. Benchmark.
+ *****************************************************************/
+#ifdef eslTREE_BENCHMARK
+/* gcc -O2 -o esl_tree_benchmark -I. -L. -DeslTREE_BENCHMARK esl_tree.c -leasel -lm
+ * ./esl_tree_benchmark -N 10000
+ *
+ * Times the four distance-clustering algorithms and neighbor joining
+ * on a random NxN distance matrix.
+ */
+#include "esl_config.h"
+
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_dmatrix.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_stopwatch.h"
+#include "esl_tree.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,     "42",  NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-N",        eslARG_INT,   "2000",  NULL,"n>=2", NULL,  NULL, NULL, "number of taxa",                                   0 },
+  { "--cpu",     eslARG_INT,      "1",  NULL,"n>=1", NULL,  NULL, NULL, "number of threads for neighbor joining",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "benchmark driver for tree module";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go    = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r     = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_STOPWATCH  *w     = esl_stopwatch_Create();
+  int             N     = esl_opt_GetInteger(go, "-N");
+  ESL_DMATRIX    *D     = esl_dmatrix_Create(N, N);
+  ESL_TREE       *T     = NULL;
+  char           *name[5] = { "UPGMA:             ", "WPGMA:             ",
+                            "single linkage:    ", "complete linkage:  ",
+                            "neighbor joining:  " };
+  int             m, i, j;
+
+  for (i = 0; i < N; i++) {
+    D->mx[i][i] = 0.;
+    for (j = i+1; j < N; j++)
+      D->mx[i][j] = D->mx[j][i] = esl_random(r);
+  }
+
+  for (m = 0; m < 5; m++)
+    {
+      esl_stopwatch_Start(w);
+      switch (m) {
+      case 0: esl_tree_UPGMA          (D, &T); break;
+      case 1: esl_tree_WPGMA          (D, &T); break;
+      case 2: esl_tree_SingleLinkage  (D, &T); break;
+      case 3: esl_tree_CompleteLinkage(D, &T); break;
+      case 4: esl_tree_NJParallel     (D, esl_opt_GetInteger(go, "--cpu"), &T); break;
+      }
+      esl_stopwatch_Stop(w);
+      esl_stopwatch_Display(stdout, w, name[m]);
+      esl_tree_Destroy(T);
+    }
+
+  esl_dmatrix_Destroy(D);
+  esl_stopwatch_Destroy(w);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*eslTREE_BENCHMARK*/
+/*-------------------- end, benchmark  --------------------------*/
+
+
+/*****************************************************************
+ * 9. Examples.
  *****************************************************************/
 
 /* The first example is an example of inferring a tree by the
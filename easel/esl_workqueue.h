@@ -6,6 +6,8 @@
 #ifndef eslWORKQUEUE_INCLUDED
 #define eslWORKQUEUE_INCLUDED
 
+struct esl_workqueue_ring_s;	        /* lock-free ring; private to esl_workqueue.c */
+
 typedef struct {
   pthread_mutex_t  queueMutex;          /* mutex for queue serialization                           */
   pthread_cond_t   readerQueueCond;     /* condition variable used to wake up the producer         */
@@ -21,9 +23,14 @@ typedef struct {
 
   int              queueSize;           /* max number of items a queue will hold                   */
   int              pendingWorkers;      /* number of consumers waiting for work                    */
+
+  int                         lockfree;   /* TRUE: queues are the lock-free rings below, not the arrays above */
+  struct esl_workqueue_ring_s *readerRing; /* lock-free: objects the workers have completed        */
+  struct esl_workqueue_ring_s *workerRing; /* lock-free: objects ready to be processed by workers  */
 } ESL_WORK_QUEUE;
 
 extern ESL_WORK_QUEUE *esl_workqueue_Create(int size);
+extern ESL_WORK_QUEUE *esl_workqueue_CreateLockFree(int size);
 extern void            esl_workqueue_Destroy(ESL_WORK_QUEUE *queue);
 
 extern int esl_workqueue_Init    (ESL_WORK_QUEUE *queue, void *ptr);
@@ -5,9 +5,13 @@
 #define eslMSACLUSTER_INCLUDED
 
 #include "esl_msa.h"
+#include "esl_random.h"
 
 extern int esl_msacluster_SingleLinkage(const ESL_MSA *msa, double maxid, 
 					int **opt_c, int **opt_nin, int *opt_nc);
+extern int esl_msacluster_SingleLinkageApprox(const ESL_MSA *msa, double maxid, int nbands, int bandw, ESL_RANDOMNESS *r,
+					      int **opt_c, int **opt_nin, int *opt_nc);
+extern int esl_msacluster_PairRecall(const int *c_ref, const int *c_test, int n, double *opt_recall, double *opt_precision);
 
 #endif /*eslMSACLUSTER_INCLUDED*/
 /*****************************************************************
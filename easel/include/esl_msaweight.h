@@ -10,9 +10,13 @@
 #include "esl_msa.h"
 
 extern int esl_msaweight_GSC(ESL_MSA *msa);
+extern int esl_msaweight_GSCParallel(ESL_MSA *msa, int ncpu);
+extern int esl_msaweight_GSCMapped(ESL_MSA *msa);
 extern int esl_msaweight_PB(ESL_MSA *msa);
+extern int esl_msaweight_PBParallel(ESL_MSA *msa, int ncpu);
 extern int esl_msaweight_BLOSUM(ESL_MSA *msa, double maxid);
 extern int esl_msaweight_IDFilter(const ESL_MSA *msa, double maxid, ESL_MSA **ret_newmsa);
+extern int esl_msaweight_IDFilterParallel(const ESL_MSA *msa, double maxid, int ncpu, ESL_MSA **ret_newmsa);
 
 
 #endif /*eslMSAWEIGHT_INCLUDED*/
@@ -137,12 +137,27 @@ typedef struct {
 #endif
 } ESL_SQ;
 
+/* Object: ESL_SQ_ARENA
+ *
+ * Storage of a block made by <esl_sq_CreateArenaBlock()>: the
+ * strings, residues, and ss of all the block's sequences, packed
+ * one sequence after another in a single allocation.
+ */
+typedef struct {
+  char    *mem;         /* the arena: list[0..count-1]'s strings and residues, in order */
+  int64_t  n;           /* bytes in use                                                 */
+  int64_t  nalloc;      /* bytes allocated                                              */
+  int      do_digital;  /* TRUE if the block's sequences are digital                    */
+  ESL_SQ  *tmpsq;       /* sequences are read into this, then packed                    */
+} ESL_SQ_ARENA;
+
 typedef struct {
   int      count;       /* number of <ESL_SQ> objects in the block */
   int      listSize;    /* maximum number elements in the list     */
   int      complete;    /*TRUE if the the final ESL_SQ element on the block is complete, FALSE if it's only a partial winow of the full sequence*/
   int64_t  first_seqidx;/*unique identifier of the first ESL_SQ object on list;  the seqidx of the i'th entry on list is first_seqidx+i */
   ESL_SQ  *list;        /* array of <ESL_SQ> objects               */
+  ESL_SQ_ARENA *arena;  /* list[] is stored in an arena; or NULL   */
 } ESL_SQ_BLOCK;
 
 /* These control default initial allocation sizes in an ESL_SQ.     */
@@ -196,9 +211,15 @@ extern int     esl_sq_FetchFromMSA(const ESL_MSA *msa, int which, ESL_SQ **ret_s
 #endif
 
 extern ESL_SQ_BLOCK *esl_sq_CreateBlock(int count);
+extern ESL_SQ_BLOCK *esl_sq_CreateArenaBlock(int count, int64_t arena_size);
 #ifdef eslAUGMENT_ALPHABET
 extern ESL_SQ_BLOCK *esl_sq_CreateDigitalBlock(int count, const ESL_ALPHABET *abc);
+extern ESL_SQ_BLOCK *esl_sq_CreateDigitalArenaBlock(int count, const ESL_ALPHABET *abc, int64_t arena_size);
 #endif
+extern int           esl_sq_ReuseBlock(ESL_SQ_BLOCK *sqBlock);
+extern int           esl_sq_BlockAppend(ESL_SQ_BLOCK *sqBlock, const ESL_SQ *sq);
+extern int           esl_sq_BlockReserve(ESL_SQ_BLOCK *sqBlock, const char *name, int64_t nlen, const char *desc, int64_t dlen,
+					 int64_t nres, ESL_SQ **ret_sq);
 extern void          esl_sq_DestroyBlock(ESL_SQ_BLOCK *sqBlock);
 
 #endif /*eslSQ_INCLUDED*/
@@ -75,6 +75,7 @@ typedef struct esl_sqio_s {
   int   (*fetch)           (struct esl_sqio_s *sqfp, const char *key, ESL_SQ *sq);
   int   (*fetch_info)      (struct esl_sqio_s *sqfp, const char *key, ESL_SQ *sq);
   int   (*fetch_subseq)    (struct esl_sqio_s *sqfp, const char *source, int64_t start, int64_t end, ESL_SQ *sq);
+  int   (*fetch_batch)     (struct esl_sqio_s *sqfp, char *const *keys, int nk, int in_file_order, ESL_SQ **sq, int *opt_order);
 #endif
 
   int   (*is_rewindable)   (const struct esl_sqio_s *sqfp);
@@ -168,6 +169,7 @@ extern int   esl_sqfile_PositionByNumber(ESL_SQFILE *sqfp, int which);
 extern int   esl_sqio_Fetch      (ESL_SQFILE *sqfp, const char *key, ESL_SQ *sq);
 extern int   esl_sqio_FetchInfo  (ESL_SQFILE *sqfp, const char *key, ESL_SQ *sq);
 extern int   esl_sqio_FetchSubseq(ESL_SQFILE *sqfp, const char *source, int64_t start, int64_t end, ESL_SQ *sq);
+extern int   esl_sqio_FetchBatch (ESL_SQFILE *sqfp, char *const *keys, int nk, int in_file_order, ESL_SQ **sq, int *opt_order);
 #endif
 
 extern int   esl_sqio_Write(FILE *fp, ESL_SQ *s, int format, int update);
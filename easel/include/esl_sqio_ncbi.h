@@ -44,6 +44,12 @@ typedef struct esl_sqncbi_s {
   FILE      *fppin;                /* Open .pin file ptr                       */
   FILE      *fpphr;                /* Open .phr file ptr                       */
   FILE      *fppsq;                /* Open .psq file ptr                       */
+  unsigned char *pin_mem;          /* .pin mapped in memory, or NULL           */
+  unsigned char *phr_mem;          /* .phr mapped in memory, or NULL           */
+  unsigned char *psq_mem;          /* .psq mapped in memory, or NULL           */
+  off_t          pin_n;            /* size of the mapped .pin                  */
+  off_t          phr_n;            /* size of the mapped .phr                  */
+  off_t          psq_n;            /* size of the mapped .psq                  */
   char       errbuf[eslERRBUFSIZE];/* parse error mesg.  Size must match msa.h */
 
   char      *title;                /* database title                           */
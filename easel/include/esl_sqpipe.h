@@ -0,0 +1,79 @@
+/* Pipelined, multithreaded reading of sequence blocks.
+ */
+#ifndef eslSQPIPE_INCLUDED
+#define eslSQPIPE_INCLUDED
+#include "esl_config.h"
+
+#ifdef HAVE_PTHREAD
+#include <stdint.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "esl_sq.h"
+#include "esl_sqio.h"
+
+#define eslSQPIPE_MAXSEQ  1000	/* default max number of sequences per block */
+
+/* One block in flight, with the raw text it's parsed from. */
+typedef struct {
+  int           state;		/* eslSQPIPE_FREE | _SPLIT | _PARSING | _DONE | _OUT      */
+  int64_t       seqno;		/* order of this block in the file, 0..                  */
+  char         *buf;		/* raw FASTA text [0..n-1], NUL-terminated (fast path)   */
+  int64_t       n;
+  int64_t       balloc;
+  off_t         boff;		/* disk offset of buf[0]                                 */
+  int64_t       linenumber;	/* line number of buf[0]                                 */
+  int           at_eof;		/* TRUE if buf ends at the end of the file               */
+  int           status;		/* eslOK, or parse error status once DONE                */
+  char          errbuf[eslERRBUFSIZE];
+  ESL_SQ_BLOCK *blk;
+} ESL_SQPIPE_SLOT;
+
+#define eslSQPIPE_FREE     0	/* available to the splitter        */
+#define eslSQPIPE_SPLIT    1	/* raw text read, waiting for parse */
+#define eslSQPIPE_PARSING  2	/* a parser thread has it           */
+#define eslSQPIPE_DONE     3	/* parsed, waiting for its turn     */
+#define eslSQPIPE_OUT      4	/* handed to a caller               */
+
+typedef struct {
+  ESL_SQFILE      *sqfp;	/* open input; owned by the pipe while it's alive                */
+  int              fastpath;	/* TRUE: splitter finds FASTA records, parsers parse them        */
+  int              max_residues; /* block size: residues (bytes, on the fast path)               */
+  int              max_sequences;
+
+  ESL_SQPIPE_SLOT *slot;	/* [0..nslots-1] */
+  int              nslots;
+
+  int64_t          nsplit;	/* number of blocks the splitter has read                        */
+  int64_t          nout;	/* seqno of the next block to give a caller                      */
+  int64_t          nseq;	/* number of sequences given to callers                          */
+  int              split_done;	/* TRUE when the splitter has stopped                            */
+  int              split_status;/* why it stopped: eslEOF, or an error                           */
+  int              status;	/* eslOK, or first error a caller has seen (then sticky)         */
+  int              shutdown;	/* TRUE when threads should exit                                 */
+  char             errbuf[eslERRBUFSIZE];
+  char             split_errbuf[eslERRBUFSIZE];
+
+  pthread_t       *tid;		/* [0] splitter; [1..nthreads-1] parsers                         */
+  int              nthreads;	/* number of threads started                                     */
+  pthread_mutex_t  lock;	/* protects everything above except the input                   */
+  pthread_cond_t   cond;	/* broadcast on any change of state                              */
+} ESL_SQPIPE;
+
+extern ESL_SQPIPE *esl_sqpipe_Create(ESL_SQFILE *sqfp, int ncpu, int nblocks, int max_residues, int max_sequences);
+extern int         esl_sqpipe_Read(ESL_SQPIPE *sqp, ESL_SQ_BLOCK **ret_block);
+extern int         esl_sqpipe_Recycle(ESL_SQPIPE *sqp, ESL_SQ_BLOCK *block);
+extern const char *esl_sqpipe_GetErrorBuf(const ESL_SQPIPE *sqp);
+extern void        esl_sqpipe_Destroy(ESL_SQPIPE *sqp);
+
+#endif /*HAVE_PTHREAD*/
+#endif /*eslSQPIPE_INCLUDED*/
+/*****************************************************************
+ * Easel - a library of C functions for biological sequence analysis
+ * Version h3.1b2; February 2015
+ * Copyright (C) 2015 Howard Hughes Medical Institute.
+ * Other copyrights also apply. See the COPYRIGHT file for a full list.
+ *
+ * Easel is distributed under the Janelia Farm Software License, a BSD
+ * license. See the LICENSE file for more details.
+ *****************************************************************/
@@ -52,6 +52,13 @@ typedef struct {
   uint32_t  *fileflags;	      /* optional per-file behavior flags    */
   uint32_t  *bpl;             /* bytes per line in file              */
   uint32_t  *rpl;             /* residues per line in file           */
+
+  /* Mapped mode (esl_ssi_OpenMapped()): */
+  char      *mem;	      /* whole index, mmap()'ed; or NULL     */
+  off_t      memsize;	      /* size of <mem> in bytes              */
+  int        use_hash;	      /* TRUE to look up names by <hash>     */
+  uint32_t  *hash;	      /* key table, built on first lookup; 0=empty, 1..np = primary key, np+1.. = secondary */
+  uint64_t   nhash;	      /* size of <hash>, a power of 2        */
 } ESL_SSI;
 
 /* Flags for the <ssi->fileflags> bit vectors. */
@@ -79,6 +86,7 @@ typedef struct {
   FILE       *ssifp;		/* open SSI file being created            */
   int         external;	        /* TRUE if pkeys and skeys are on disk    */
   int         max_ram;	        /* threshold in MB to trigger extern sort */
+  int         ncpu;		/* number of threads to sort keys with    */
 
   char      **filenames;
   uint32_t   *fileformat;
@@ -106,12 +114,21 @@ typedef struct {
 #define eslSSI_FCHUNK  16	/* chunk size for file name reallocation */
 #define eslSSI_KCHUNK  128	/* and for key reallocation              */
 
+#define eslSSI_SORTCHUNK  8192	   /* min keys per thread in a parallel sort            */
+#define eslSSI_MINRUN     16384	   /* min bytes of keys per run, in an external sort     */
+#define eslSSI_MERGEWAY   64	   /* max runs merged at once, in an external sort       */
+#define eslSSI_WRITEBUF   1048576  /* stdio buffer for writing the index                 */
+
 
 /* 1. Using (reading) SSI indices */
 extern int  esl_ssi_Open(const char *filename, ESL_SSI **ret_ssi);
+extern int  esl_ssi_OpenMapped(const char *filename, ESL_SSI **ret_ssi);
+extern int  esl_ssi_SetHashing(ESL_SSI *ssi, int use_hash);
 extern void esl_ssi_Close(ESL_SSI *ssi);
 extern int  esl_ssi_FindName(ESL_SSI *ssi, const char *key,
 			     uint16_t *ret_fh, off_t *ret_roff, off_t *opt_doff, int64_t *opt_L);
+extern int  esl_ssi_FindNameBatch(ESL_SSI *ssi, char *const *keys, int nk,
+				  uint16_t *ret_fh, off_t *ret_roff, int *ret_order, int *opt_nfound);
 extern int  esl_ssi_FindNumber(ESL_SSI *ssi, int64_t nkey,
 			       uint16_t *opt_fh, off_t *opt_roff, off_t *opt_doff, int64_t *opt_L, char **opt_pkey);
 extern int  esl_ssi_FindSubseq(ESL_SSI *ssi, const char *key, int64_t requested_start,
@@ -124,6 +141,7 @@ extern int  esl_ssi_FileInfo(ESL_SSI *ssi, uint16_t fh, char **ret_filename, int
 extern int  esl_newssi_Open(const char *ssifile, int allow_overwrite, ESL_NEWSSI **ret_newssi);
 extern int  esl_newssi_AddFile  (ESL_NEWSSI *ns, const char *filename, int fmt, uint16_t *ret_fh);
 extern int  esl_newssi_SetSubseq(ESL_NEWSSI *ns, uint16_t fh, uint32_t bpl, uint32_t rpl);
+extern int  esl_newssi_SetThreads(ESL_NEWSSI *ns, int ncpu);
 extern int  esl_newssi_AddKey   (ESL_NEWSSI *ns, const char *key, uint16_t fh, off_t r_off, off_t d_off, int64_t L);
 extern int  esl_newssi_AddAlias (ESL_NEWSSI *ns, const char *alias, const char *key);
 extern int  esl_newssi_Write    (ESL_NEWSSI *ns);
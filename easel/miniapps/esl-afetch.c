@@ -56,6 +56,7 @@ static ESL_OPTIONS options[] = {
   { "-O",         eslARG_NONE,        FALSE, NULL, NULL, NULL, NULL,"-o,-f,--index","output alignment to file named <key>",              0 },
   { "--informat", eslARG_STRING,      FALSE, NULL, NULL, NULL, NULL, NULL,          "specify that <msafile> is in format <s>",           0 },
   { "--outformat",eslARG_STRING,"Stockholm", NULL, NULL, NULL, NULL, "--index",     "output fetched alignment(s) in format <s>",         0 },
+  { "--fileorder",eslARG_NONE,        FALSE, NULL, NULL, NULL, "-f","--index",      "with -f: output MSAs in file order, read in one pass", 0 },
   { "--index",    eslARG_NONE,        FALSE, NULL, NULL, NULL, NULL, NULL,          "index the <msafile>, creating <msafile>.ssi",       0 },
   { 0,0,0,0,0,0,0,0,0,0 },
 };
@@ -110,7 +111,7 @@ main(int argc, char **argv)
 	  char *ssifile = NULL;
 	  esl_sprintf(&ssifile, "%s.ssi", afp->bf->filename);
       
-	  status = esl_ssi_Open(ssifile, &(afp->ssi));
+	  status = esl_ssi_OpenMapped(ssifile, &(afp->ssi));
 	  if      (status == eslERANGE )   esl_fatal("SSI index %s has 64-bit offsets; this system doesn't support them", ssifile);
 	  else if (status == eslEFORMAT)   esl_fatal("SSI index %s has an unrecognized format. Try recreating, w/ esl-afetch --index", ssifile);
 	  else if (status == eslENOTFOUND) afp->ssi = NULL;
@@ -234,6 +235,11 @@ create_ssi_index(ESL_GETOPTS *go, ESLX_MSAFILE *afp)
  * Note that with an SSI index, you get the MSAs in the order they
  * appear in the <keyfile>, but without an SSI index, you get MSAs in
  * the order they occur in the MSA file.
+ * 
+ * With an SSI index and --fileorder, the keys are fetched as one
+ * batch by eslx_msafile_FetchBatch(), reading the MSA file front to
+ * back; you get MSAs in the order they occur in the MSA file. The
+ * whole batch is held in memory until it's output.
  */
 static void
 multifetch(ESL_GETOPTS *go, FILE *ofp, int outfmt, char *keyfile, ESLX_MSAFILE *afp)
@@ -245,12 +251,16 @@ multifetch(ESL_GETOPTS *go, FILE *ofp, int outfmt, char *keyfile, ESLX_MSAFILE *
   char           *key;
   int             keylen;
   int             keyidx;
+  int             in_file_order = (afp->ssi != NULL && esl_opt_GetBoolean(go, "--fileorder"));
   int             status;
   
   if (esl_fileparser_Open(keyfile, NULL, &efp) != eslOK) 
     esl_fatal("Failed to open key file %s\n", keyfile);
   esl_fileparser_SetCommentChar(efp, '#');
 
+  /* Many lookups in one index: worth hashing its keys, if it's mapped. */
+  if (afp->ssi && afp->ssi->mem) esl_ssi_SetHashing(afp->ssi, TRUE);
+
   while (esl_fileparser_NextLine(efp) == eslOK)
     {
       if (esl_fileparser_GetTokenOnLine(efp, &key, &keylen) != eslOK)
@@ -259,8 +269,45 @@ multifetch(ESL_GETOPTS *go, FILE *ofp, int outfmt, char *keyfile, ESLX_MSAFILE *
       status = esl_keyhash_Store(keys, key, keylen, &keyidx);
       if (status == eslEDUP) esl_fatal("MSA key %s occurs more than once in file %s\n", key, keyfile);
 	
-      if (afp->ssi) { onefetch(go, ofp, outfmt, key, afp);  nali++; }
+      if (afp->ssi && ! in_file_order) { onefetch(go, ofp, outfmt, key, afp);  nali++; }
+
+    }
+
+  /* With --fileorder, fetch the whole batch in the order of the records on disk. */
+  if (in_file_order)
+    {
+      int       nkeys = esl_keyhash_GetNumber(keys);
+      char    **klist = malloc(sizeof(char *)    * ESL_MAX(1, nkeys));
+      ESL_MSA **msas  = malloc(sizeof(ESL_MSA *) * ESL_MAX(1, nkeys));
+      int       i;
+
+      if (klist == NULL || msas == NULL) esl_fatal("malloc failed");
+      for (i = 0; i < nkeys; i++) klist[i] = (char *) esl_keyhash_Get(keys, i);
+
+      status = eslx_msafile_FetchBatch(afp, klist, nkeys, TRUE, msas, NULL);
+      if      (status == eslENOTFOUND) esl_fatal("%s (file %s)\n", afp->errmsg, afp->bf->filename);
+      else if (status == eslEFORMAT)   eslx_msafile_ReadFailure(afp, status);
+      else if (status != eslOK)        esl_fatal("Failed to fetch MSAs from file %s\n", afp->bf->filename);
+
+      for (i = 0; i < nkeys; i++)
+	{
+	  /* Stockholm to Stockholm: go back and echo the raw record, as onefetch() does. */
+	  if ( (afp->format == eslMSAFILE_STOCKHOLM && outfmt == eslMSAFILE_STOCKHOLM) ||
+	       (afp->format == eslMSAFILE_PFAM      && outfmt == eslMSAFILE_PFAM))
+	    {
+	      if (esl_buffer_SetOffset(afp->bf, msas[i]->offset) != eslOK)
+		esl_fatal("Failed to reposition MSA file %s\n", afp->bf->filename);
+	      afp->linenumber = -1;
+	      regurgitate_one_stockholm_entry(ofp, afp);
+	    }
+	  else eslx_msafile_Write(ofp, msas[i], outfmt);
+
+	  esl_msa_Destroy(msas[i]);
+	  nali++;
+	}
 
+      free(msas);
+      free(klist);
     }
 
   if (! afp->ssi)
@@ -136,6 +136,31 @@ if ($? != 0)                       { die "FAIL: esl-afetch failed, returned nonz
 if ($? != 0)                       { die "FAIL: esl-afetch failed, returned nonzero"; }
 if ($output[0] !~ /^CLUSTAL/)      { die "FAIL: esl-afetch fetched incorrectly";      }
 
+# With SSI and --fileorder, MSAs come back in order of .sto file, fetched verbatim,
+# and identical to what's fetched one key at a time.
+@output = `$esl_afetch -f --fileorder $tmppfx.sto $tmppfx.list`;               
+if ($? != 0)                       { die "FAIL: esl-afetch --fileorder failed, returned nonzero"; }
+if ($output[1] !~ /^#=GF ID foo$/) { die "FAIL: esl-afetch --fileorder fetched incorrectly";      }
+if ($output[7] !~ /^#=GF ID baz$/) { die "FAIL: esl-afetch --fileorder fetched incorrectly";      }
+if ($#output != 11)                { die "FAIL: esl-afetch --fileorder fetched incorrectly";      }
+
+@output = `$esl_afetch    $tmppfx.sto foo  > $tmppfx.tmp`;                       if ($? != 0) { die "FAIL: esl-afetch failed, returned nonzero"; }
+@output = `$esl_afetch    $tmppfx.sto baz >> $tmppfx.tmp`;                       if ($? != 0) { die "FAIL: esl-afetch failed, returned nonzero"; }
+@output = `$esl_afetch -f --fileorder $tmppfx.sto $tmppfx.list > $tmppfx.tmp2`;  if ($? != 0) { die "FAIL: esl-afetch --fileorder failed, returned nonzero"; }
+system "diff $tmppfx.tmp $tmppfx.tmp2 > /dev/null 2>&1";                         if ($? != 0) { die "FAIL: esl-afetch --fileorder bad diff"; }
+
+@output = `$esl_afetch -f --fileorder --outformat clustal $tmppfx.sto $tmppfx.list`;
+if ($? != 0)                       { die "FAIL: esl-afetch --fileorder failed, returned nonzero"; }
+if ($output[0] !~ /^CLUSTAL/)      { die "FAIL: esl-afetch --fileorder fetched incorrectly";      }
+if ((grep { /^seq5 / } @output) != 1 || (grep { /^seq1 / } @output) != 1) { die "FAIL: esl-afetch --fileorder fetched incorrectly"; }
+
+open(TESTLIST, ">$tmppfx.list2") || die "FAIL: couldn't open $tmppfx.list2 for writing test name list";
+print TESTLIST "baz\nnosuchkey\n";
+close TESTLIST;
+@output = `$esl_afetch -f --fileorder $tmppfx.sto $tmppfx.list2 2>&1`;
+if ($? == 0)                              { die "FAIL: esl-afetch --fileorder should fail on a missing key"; }
+if (! grep { /nosuchkey/ } @output)       { die "FAIL: esl-afetch --fileorder didn't name the missing key"; }
+
 
 print "ok\n"; 
 unlink "$tmppfx.sto";
@@ -143,4 +168,6 @@ unlink "$tmppfx.sto.ssi";
 unlink "$tmppfx.tmp";
 unlink "$tmppfx.tmp2";
 unlink "$tmppfx.name";
+unlink "$tmppfx.list";
+unlink "$tmppfx.list2";
 exit 0;
@@ -8,10 +8,12 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <float.h>
 #include <math.h>
 #include <string.h>
 
 #include "easel.h"
+#include "esl_dmatrix.h"
 #include "esl_fileparser.h"
 #include "esl_getopts.h"
 #include "esl_keyhash.h"
@@ -26,6 +28,7 @@ static ESL_OPTIONS options[] = {
   { "-t",      eslARG_INT,      "5", NULL,    "n>0",   NULL,NULL,   NULL,          "field to read as target name, 1..n",          0 },
   { "-v",      eslARG_INT,      "1", NULL,    "n>0",   NULL,NULL,   NULL,          "field to read as distance value, 1..n",       0 },
   { "-x",      eslARG_REAL,  "1e-4", NULL,    "x>0",   NULL,NULL,   NULL,          "clustering threshold",                        0 },
+  { "--mmap",  eslARG_NONE,   FALSE, NULL,     NULL,   NULL,NULL,   NULL,          "keep distances in a memory-mapped tmp file (in single precision)", 0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 static char usage[]  = "[-options] <keyfile> <tabfile>";
@@ -33,7 +36,7 @@ static char banner[] = "clusters tabular data file";
 
 
 static void  read_keyfile   (ESL_GETOPTS *go, char *keyfile, ESL_KEYHASH *kh);
-static void  read_tabfile   (ESL_GETOPTS *go, char *tabfile, ESL_KEYHASH *kh, ESL_DMATRIX *D);
+static void  read_tabfile   (ESL_GETOPTS *go, char *tabfile, ESL_KEYHASH *kh, ESL_DMATRIX *D, ESL_FSMATRIX *F);
 static void  output_clusters(ESL_GETOPTS *go, ESL_TREE *T, ESL_KEYHASH *kh);
 
 static void
@@ -70,6 +73,7 @@ main(int argc, char **argv)
   ESL_KEYHASH    *kh       = esl_keyhash_Create();
   int             nkeys    = 0;
   ESL_DMATRIX    *D        = NULL;
+  ESL_FSMATRIX   *F        = NULL;
   ESL_TREE       *T        = NULL;
 
   go = esl_getopts_Create(options);
@@ -83,10 +87,18 @@ main(int argc, char **argv)
   read_keyfile(go, keyfile, kh);
   nkeys = esl_keyhash_GetNumber(kh);
 
-  D = esl_dmatrix_Create(nkeys, nkeys);
-  read_tabfile(go, tabfile, kh, D);
-
-  esl_tree_SingleLinkage(D, &T);
+  /* Distances are kept in double precision (E-values can be tiny),
+   * unless --mmap asks for the single-precision, disk-backed store.
+   */
+  if (esl_opt_GetBoolean(go, "--mmap")) {
+    if ((F = esl_fsmatrix_CreateMapped(nkeys))  == NULL) esl_fatal("Failed to create %d x %d distance matrix", nkeys, nkeys);
+  } else {
+    if ((D = esl_dmatrix_Create(nkeys, nkeys)) == NULL) esl_fatal("Failed to create %d x %d distance matrix", nkeys, nkeys);
+  }
+  read_tabfile(go, tabfile, kh, D, F);
+
+  if      (D && esl_tree_SingleLinkage(D, &T)                 != eslOK) esl_fatal("Clustering failed");
+  else if (F && esl_tree_ClusterFMx(F, eslSINGLE_LINKAGE, &T) != eslOK) esl_fatal("Clustering failed");
     
   //esl_tree_WriteNewick(stdout, T);
   output_clusters(go, T, kh);
@@ -94,6 +106,7 @@ main(int argc, char **argv)
 
   esl_tree_Destroy(T);
   esl_dmatrix_Destroy(D);
+  esl_fsmatrix_Destroy(F);
   esl_keyhash_Destroy(kh);
   esl_getopts_Destroy(go);
   return 0;
@@ -125,8 +138,16 @@ read_keyfile(ESL_GETOPTS *go, char *keyfile, ESL_KEYHASH *kh)
   esl_fileparser_Close(efp);
 }
 
+/* read_tabfile()
+ * Read the query/target/value lines of <tabfile> into the distance
+ * matrix: <D> if it's non-NULL, else <F>. Pairs that aren't listed
+ * are unlinked (infinite distance). A pair listed more than once,
+ * in either order, gets the smallest of its values, so the result
+ * doesn't depend on line order. Values too small for <F>'s single
+ * precision are raised to FLT_MIN, with a warning.
+ */
 static void
-read_tabfile(ESL_GETOPTS *go, char *tabfile, ESL_KEYHASH *kh, ESL_DMATRIX *D)
+read_tabfile(ESL_GETOPTS *go, char *tabfile, ESL_KEYHASH *kh, ESL_DMATRIX *D, ESL_FSMATRIX *F)
 {
   ESL_FILEPARSER *efp      = NULL;
   int             nline    = 0;
@@ -138,11 +159,18 @@ read_tabfile(ESL_GETOPTS *go, char *tabfile, ESL_KEYHASH *kh, ESL_DMATRIX *D)
   int             ntok;
   double          value;
   int             qidx, tidx;
+  int             nclamped = 0;
   
   if (esl_fileparser_Open(tabfile, NULL, &efp) != eslOK) esl_fatal("File open failed");
   esl_fileparser_SetCommentChar(efp, '#');
 
-  esl_dmatrix_Set(D, eslINFINITY);
+  if (D) {
+    esl_dmatrix_Set(D, eslINFINITY);
+    for (qidx = 0; qidx < D->n; qidx++) D->mx[qidx][qidx] = 0.;
+  } else {
+    esl_fsmatrix_Set(F, eslINFINITY);
+    for (qidx = 0; qidx < F->n; qidx++) esl_fsmx_Set(F, qidx, qidx, 0.);
+  }
 
   while (esl_fileparser_NextLine(efp) == eslOK)
     {
@@ -161,10 +189,20 @@ read_tabfile(ESL_GETOPTS *go, char *tabfile, ESL_KEYHASH *kh, ESL_DMATRIX *D)
       if (tidx  == -1)  esl_fatal("Failed to find target name on line %d (looking for field %d)\n", nline, tfield);
       if (isnan(value)) esl_fatal("Failed to find value on line %d (looking for field %d)\n",       nline, vfield);
 
-      D->mx[qidx][tidx] = value;
-      if (D->mx[tidx][qidx] == eslINFINITY) D->mx[tidx][qidx] = value;
+      if (qidx == tidx) continue;
+
+      if (D) 
+	{
+	  if (value < D->mx[qidx][tidx]) D->mx[qidx][tidx] = D->mx[tidx][qidx] = value;
+	}
+      else
+	{
+	  if (value > 0. && value < FLT_MIN) { value = FLT_MIN; nclamped++; }
+	  if (value < esl_fsmx_Get(F, qidx, tidx)) esl_fsmx_Set(F, qidx, tidx, value);
+	}
     }
 
+  if (nclamped) fprintf(stderr, "Warning: %d values below %g were raised to %g to fit single precision (--mmap)\n", nclamped, FLT_MIN, FLT_MIN);
   esl_fileparser_Close(efp);
 }
 
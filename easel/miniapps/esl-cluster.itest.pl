@@ -0,0 +1,67 @@
+#! /usr/bin/perl
+
+# Integrated test of the esl-cluster miniapp.
+#
+# Usage:     ./esl-cluster.itest.pl <esl-cluster binary> <tmpfile prefix>
+# Example:   ./esl-cluster.itest.pl ./esl-cluster        foo
+#
+# Distances are double precision: an E-value of 1e-50 must come back
+# as 1e-50, not underflow. A pair listed twice, as (q,t) and (t,q),
+# is linked at the smaller value, whatever the order of the lines.
+
+$eslcluster = shift;
+$tmppfx     = shift;
+
+if (! -x "$eslcluster") { die "FAIL: didn't find esl-cluster binary $eslcluster"; }
+
+open(KEYFILE, ">$tmppfx.keys") || die "FAIL: couldn't open $tmppfx.keys for writing";
+print KEYFILE << "EOF";
+a
+b
+c
+d
+e
+f
+EOF
+close KEYFILE;
+
+# Default fields: value is 1, target is 5, query is 8.
+open(TABFILE, ">$tmppfx.tab1") || die "FAIL: couldn't open $tmppfx.tab1 for writing";
+print TABFILE << "EOF";
+1e-50  x x x  b  x x  a
+1e-3   x x x  a  x x  c
+1e-2   x x x  d  x x  e
+1e-6   x x x  e  x x  d
+EOF
+close TABFILE;
+
+open(TABFILE, ">$tmppfx.tab2") || die "FAIL: couldn't open $tmppfx.tab2 for writing";
+print TABFILE << "EOF";
+1e-50  x x x  b  x x  a
+1e-3   x x x  a  x x  c
+1e-6   x x x  e  x x  d
+1e-2   x x x  d  x x  e
+EOF
+close TABFILE;
+
+$output1 = `$eslcluster $tmppfx.keys $tmppfx.tab1 2>&1`;
+if ($? != 0)                              { die "FAIL: esl-cluster failed unexpectedly"; }
+if ($output1 !~ /Cluster 1:  1e-50\n/)    { die "FAIL: tiny distance underflowed"; }
+if ($output1 !~ /= a \t1\t1e-50\n/)       { die "FAIL: tiny distance underflowed"; }
+if ($output1 !~ /Cluster 2:  1e-06\n/)    { die "FAIL: duplicate pair not linked at its smaller value"; }
+if ($output1 !~ /Singleton:\n= c\t/)      { die "FAIL: c should be a singleton"; }
+
+$output2 = `$eslcluster $tmppfx.keys $tmppfx.tab2 2>&1`;
+if ($? != 0)                              { die "FAIL: esl-cluster failed unexpectedly"; }
+if ($output1 ne $output2)                 { die "FAIL: result depends on the order of duplicate lines"; }
+
+$output = `$eslcluster --mmap $tmppfx.keys $tmppfx.tab2 2>&1`;
+if ($? != 0)                              { die "FAIL: esl-cluster --mmap failed unexpectedly"; }
+if ($output !~ /Warning: 1 values below/) { die "FAIL: --mmap didn't warn about a value below FLT_MIN"; }
+if ($output !~ /Cluster 1:  1.17549e-38/) { die "FAIL: --mmap didn't raise a tiny value to FLT_MIN"; }
+if ($output !~ /Cluster 2:  1e-06\n/)     { die "FAIL: --mmap duplicate pair not linked at its smaller value"; }
+
+print "ok\n";
+unlink <$tmppfx.keys>;
+unlink <$tmppfx.tab*>;
+exit 0;
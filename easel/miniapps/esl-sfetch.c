@@ -71,12 +71,14 @@ static ESL_OPTIONS options[] = {
   { "-O",          eslARG_NONE,   FALSE,  NULL, NULL, NULL, NULL,              "-o,-f,--index",      "output sequence to file named <key>",               1 },
   { "-n",          eslARG_STRING, FALSE,  NULL, NULL, NULL, NULL,              "-f,--index",         "rename the sequence <s>",                           1 },
   { "-r",          eslARG_NONE,   FALSE,  NULL, NULL, NULL, NULL,              "--index",            "reverse complement the seq(s)",                     1 },
+  { "--fileorder", eslARG_NONE,   FALSE,  NULL, NULL, NULL, "-f",              "--index",            "with -f: output seqs in file order, read in one pass", 1 },
 
 
   { "-c",          eslARG_STRING, FALSE,  NULL, NULL, NULL, NULL,              "-f,--index",         "retrieve subsequence coords <from>..<to>",          2 },
   { "-C",          eslARG_NONE,   FALSE,  NULL, NULL, NULL, "-f",              "--index",            "<namefile> in <f> contains subseq coords too",      2 },
 
   { "--informat",  eslARG_STRING, FALSE,  NULL, NULL, NULL, NULL,              NULL,                 "specify that input file is in format <s>",          3 },
+  { "--cpu",       eslARG_INT,    "1",   NULL, "n>0", NULL, "--index",         NULL,                 "with --index: number of threads for sorting keys",  3 },
 
   /* undocumented as options, because they're documented as alternative invocations: */
   { "-f",          eslARG_NONE,  FALSE,   NULL, NULL, NULL, NULL,              "--index",           "second cmdline arg is a file of names to retrieve", 99 },
@@ -88,6 +90,7 @@ static ESL_OPTIONS options[] = {
 static void create_ssi_index(ESL_GETOPTS *go, ESL_SQFILE *sqfp);
 static void multifetch(ESL_GETOPTS *go, FILE *ofp, char *keyfile, ESL_SQFILE *sqfp);
 static void onefetch(ESL_GETOPTS *go, FILE *ofp, char *key, ESL_SQFILE *sqfp);
+static void output_one(ESL_GETOPTS *go, FILE *ofp, ESL_SQ *sq, ESL_SQFILE *sqfp);
 static void multifetch_subseq(ESL_GETOPTS *go, FILE *ofp, char *keyfile, ESL_SQFILE *sqfp);
 static void onefetch_subseq(ESL_GETOPTS *go, FILE *ofp, ESL_SQFILE *sqfp, char *newname, 
 			    char *key, uint32_t given_start, uint32_t given_end);
@@ -226,6 +229,7 @@ create_ssi_index(ESL_GETOPTS *go, ESL_SQFILE *sqfp)
   if      (status == eslENOTFOUND)   esl_fatal("failed to open SSI index %s", ssifile);
   else if (status == eslEOVERWRITE)  esl_fatal("SSI index %s already exists; delete or rename it", ssifile); /* won't happen, see TRUE above... */
   else if (status != eslOK)          esl_fatal("failed to create a new SSI index");
+  esl_newssi_SetThreads(ns, esl_opt_GetInteger(go, "--cpu"));
 
   if (esl_newssi_AddFile(ns, sqfp->filename, sqfp->format, &fh) != eslOK)
     esl_fatal("Failed to add sequence file %s to new SSI index\n", sqfp->filename);
@@ -287,6 +291,12 @@ create_ssi_index(ESL_GETOPTS *go, ESL_SQFILE *sqfp)
  * Note that with an SSI index, you get the seqs in the order they
  * appear in the <keyfile>, but without an SSI index, you get seqs in
  * the order they occur in the seq file.
+ * 
+ * With an SSI index and --fileorder, the keys are fetched as one
+ * batch by esl_sqio_FetchBatch(), which reads the seq file front to
+ * back instead of by one random seek per key; you get seqs in the
+ * order they occur in the seq file. The whole batch is held in memory
+ * until it's output.
  */
 static void
 multifetch(ESL_GETOPTS *go, FILE *ofp, char *keyfile, ESL_SQFILE *sqfp)
@@ -298,12 +308,17 @@ multifetch(ESL_GETOPTS *go, FILE *ofp, char *keyfile, ESL_SQFILE *sqfp)
   char           *key;
   int             keylen;
   int             keyidx;
+  int             in_file_order = (sqfp->data.ascii.ssi != NULL && esl_opt_GetBoolean(go, "--fileorder"));
   int             status;
 
   
   if (esl_fileparser_Open(keyfile, NULL, &efp) != eslOK)  esl_fatal("Failed to open key file %s\n", keyfile);
   esl_fileparser_SetCommentChar(efp, '#');
 
+  /* Many lookups in one index: worth hashing its keys, if it's mapped. */
+  if (sqfp->data.ascii.ssi != NULL && sqfp->data.ascii.ssi->mem != NULL) 
+    esl_ssi_SetHashing(sqfp->data.ascii.ssi, TRUE);
+
   while (esl_fileparser_NextLine(efp) == eslOK)
     {
       if (esl_fileparser_GetTokenOnLine(efp, &key, &keylen) != eslOK)
@@ -313,10 +328,33 @@ multifetch(ESL_GETOPTS *go, FILE *ofp, char *keyfile, ESL_SQFILE *sqfp)
       if (status == eslEDUP) esl_fatal("seq key %s occurs more than once in file %s\n", key, keyfile);
 	
       /* if we have an SSI index, just fetch them as we go. */
-      if (sqfp->data.ascii.ssi != NULL) { onefetch(go, ofp, key, sqfp);  nseq++; }
+      if (sqfp->data.ascii.ssi != NULL && ! in_file_order) { onefetch(go, ofp, key, sqfp);  nseq++; }
       nkeys++;
     }
 
+  /* With --fileorder, fetch the whole batch in the order of the records on disk. */
+  if (in_file_order)
+    {
+      char  **klist = malloc(sizeof(char *)   * ESL_MAX(1, nkeys));
+      ESL_SQ **sqs  = malloc(sizeof(ESL_SQ *) * ESL_MAX(1, nkeys));
+      int     i;
+
+      if (klist == NULL || sqs == NULL) esl_fatal("malloc failed");
+      for (i = 0; i < nkeys; i++) klist[i] = (char *) esl_keyhash_Get(keys, i);
+      for (i = 0; i < nkeys; i++) if ((sqs[i] = esl_sq_Create()) == NULL) esl_fatal("malloc failed");
+
+      status = esl_sqio_FetchBatch(sqfp, klist, nkeys, TRUE, sqs, NULL);
+      if      (status == eslENOTFOUND) esl_fatal("%s\n", esl_sqfile_GetErrorBuf(sqfp));
+      else if (status == eslEFORMAT)   esl_fatal("Parse failed (sequence file %s):\n%s\n", sqfp->filename, esl_sqfile_GetErrorBuf(sqfp));
+      else if (status != eslOK)        esl_fatal("Failed to fetch sequences from file %s\n", sqfp->filename);
+
+      for (i = 0; i < nkeys; i++) { output_one(go, ofp, sqs[i], sqfp); nseq++; }
+
+      for (i = 0; i < nkeys; i++) esl_sq_Destroy(sqs[i]);
+      free(sqs);
+      free(klist);
+    }
+
   /* If we don't have an SSI index, we haven't fetched anything yet; do it now. */
   if (sqfp->data.ascii.ssi == NULL) 
     {
@@ -364,8 +402,6 @@ static void
 onefetch(ESL_GETOPTS *go, FILE *ofp, char *key, ESL_SQFILE *sqfp)
 {
   ESL_SQ  *sq            = esl_sq_Create();
-  int      do_revcomp    = esl_opt_GetBoolean(go, "-r");
-  char    *newname       = esl_opt_GetString(go, "-n");
   int      status;
 
   /* Try to position the file at the desired sequence with SSI. */
@@ -402,18 +438,32 @@ onefetch(ESL_GETOPTS *go, FILE *ofp, char *key, ESL_SQFILE *sqfp)
 
     }
 
+  output_one(go, ofp, sq, sqfp);
+  esl_sq_Destroy(sq);
+}
+
+/* output_one():
+ * Output one fetched sequence <sq>, read from <sqfp>.
+ * If we're not manipulating the sequence in any way, and it's not from
+ * an alignment file, we can Echo() it; otherwise we Write() the parsed
+ * version.
+ */
+static void
+output_one(ESL_GETOPTS *go, FILE *ofp, ESL_SQ *sq, ESL_SQFILE *sqfp)
+{
+  int      do_revcomp    = esl_opt_GetBoolean(go, "-r");
+  char    *newname       = esl_opt_GetString(go, "-n");
+
   if (do_revcomp == FALSE && newname == NULL && ! esl_sqio_IsAlignment(sqfp->format)) 
-    { /* If we're not manipulating the sequence in any way, and it's not from an alignment file, we can Echo() it. */
+    {
       if (esl_sqio_Echo(sqfp, sq, ofp) != eslOK) esl_fatal("Echo failed: %s\n", esl_sqfile_GetErrorBuf(sqfp));
     }
   else
-    { /* Otherwise we Write() the parsed version. */
+    {
       if (do_revcomp && esl_sq_ReverseComplement(sq) != eslOK) esl_fatal("Failed to reverse complement %s; is it a protein?\n", sq->name);
       if (newname != NULL) esl_sq_SetName(sq, newname);
       esl_sqio_Write(ofp, sq, eslSQFILE_FASTA, FALSE);
     }
-
-  esl_sq_Destroy(sq);
 }
 
 static void
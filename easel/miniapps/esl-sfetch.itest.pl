@@ -0,0 +1,67 @@
+#! /usr/bin/perl
+
+# Integrated test of the esl-sfetch miniapp.
+#
+# Usage:     ./esl-sfetch.itest.pl <esl-sfetch binary> <tmpfile prefix>
+# Example:   ./esl-sfetch.itest.pl ./esl-sfetch        foo
+#
+# With an SSI index, -f fetches seqs in the order of the key file;
+# -f --fileorder fetches the same seqs in the order of the seq file,
+# and each one is echoed verbatim, just as a one-key fetch would.
+
+$eslsfetch = shift;
+$tmppfx    = shift;
+
+if (! -x "$eslsfetch") { die "FAIL: didn't find esl-sfetch binary $eslsfetch"; }
+
+# Existence of a previous .ssi index will screw up this test.
+if (  -e "$tmppfx.fa.ssi") { unlink "$tmppfx.fa.ssi"; }
+
+open(SEQFILE, ">$tmppfx.fa") || die "FAIL: couldn't open $tmppfx.fa for writing seqfile";
+print SEQFILE << "EOF2";
+>seq1 first
+ACGTACGTAC
+GTAC
+>seq2 second
+GGGGCCCCAA
+>seq3 third
+TTTTAAAACC
+GG
+>seq4 fourth
+CCCCAAAAGG
+EOF2
+close SEQFILE;
+
+open(KEYFILE, ">$tmppfx.keys") || die "FAIL: couldn't open $tmppfx.keys for writing keyfile";
+print KEYFILE "seq4\nseq1\nseq3\n";
+close KEYFILE;
+
+@output = `$eslsfetch --index $tmppfx.fa`;
+if ($? != 0) { die "FAIL: esl-sfetch --index failed"; }
+
+$output = `$eslsfetch -f $tmppfx.fa $tmppfx.keys`;
+if ($? != 0)                                   { die "FAIL: esl-sfetch -f failed"; }
+if ($output !~ /^>seq4 .*>seq1 .*>seq3 /s)     { die "FAIL: esl-sfetch -f should use key file order"; }
+
+$output = `$eslsfetch -f --fileorder $tmppfx.fa $tmppfx.keys`;
+if ($? != 0)                                   { die "FAIL: esl-sfetch -f --fileorder failed"; }
+$expect = `$eslsfetch $tmppfx.fa seq1; $eslsfetch $tmppfx.fa seq3; $eslsfetch $tmppfx.fa seq4`;
+if ($output ne $expect)                        { die "FAIL: esl-sfetch --fileorder output differs from one-key fetches"; }
+
+$output = `$eslsfetch -f --fileorder -r $tmppfx.fa $tmppfx.keys`;
+if ($? != 0)                                   { die "FAIL: esl-sfetch -f --fileorder -r failed"; }
+if ($output !~ /^>seq1 .*\nGTACGTACGTACGT\n>seq3 .*\nCCGGTTTTAAAA\n>seq4 /s) { die "FAIL: esl-sfetch --fileorder -r didn't revcomp"; }
+
+open(KEYFILE, ">$tmppfx.keys2") || die "FAIL: couldn't open $tmppfx.keys2 for writing keyfile";
+print KEYFILE "seq2\nnosuchkey\n";
+close KEYFILE;
+$output = `$eslsfetch -f --fileorder $tmppfx.fa $tmppfx.keys2 2>&1`;
+if ($? == 0)                                   { die "FAIL: esl-sfetch --fileorder should fail on a missing key"; }
+if ($output !~ /nosuchkey/)                    { die "FAIL: esl-sfetch --fileorder didn't name the missing key"; }
+
+print "ok\n";
+unlink "$tmppfx.fa";
+unlink "$tmppfx.fa.ssi";
+unlink "$tmppfx.keys";
+unlink "$tmppfx.keys2";
+exit 0;
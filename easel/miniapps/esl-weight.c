@@ -25,6 +25,8 @@ static ESL_OPTIONS options[] = {
   { "-o",         eslARG_OUTFILE, NULL, NULL,     NULL,   NULL,NULL,   NULL,          "send output to file <f>, not stdout",         1 },
   { "--id",       eslARG_REAL,  "0.62", NULL,"0<=x<=1",   NULL,"-b",   NULL,          "for -b: set identity cutoff",                 1 },
   { "--idf",      eslARG_REAL,  "0.80", NULL,"0<=x<=1",   NULL,"-f",   NULL,          "for -f: set identity cutoff",                 1 },
+  { "--mmap",     eslARG_NONE,   FALSE, NULL,     NULL,   NULL,"-g",   NULL,          "for -g: keep distances in a mapped tmp file", 1 },
+  { "--cpu",      eslARG_INT,      "1", NULL,    "n>0",   NULL,NULL,"--mmap",        "number of threads to use, for -g, -p, -f",    1 },
   { "--informat", eslARG_STRING, FALSE, NULL,     NULL,   NULL,NULL,   NULL,          "specify that input file is in format <s>",    1 },
   { "--amino",    eslARG_NONE,   FALSE, NULL,     NULL,   NULL,NULL,"--dna,--rna",    "<msa file> contains protein alignments",      1 },
   { "--dna",      eslARG_NONE,   FALSE, NULL,     NULL,   NULL,NULL,"--amino,--rna",  "<msa file> contains DNA alignments",          1 },
@@ -102,18 +104,19 @@ main(int argc, char **argv)
       if       (esl_opt_GetBoolean(go, "-f")) 
 	{
 	  ESL_MSA *fmsa;
-	  status = esl_msaweight_IDFilter(msa, esl_opt_GetReal(go, "--idf"), &fmsa);
+	  status = esl_msaweight_IDFilterParallel(msa, esl_opt_GetReal(go, "--idf"), esl_opt_GetInteger(go, "--cpu"), &fmsa);
 	  eslx_msafile_Write(ofp, fmsa, eslMSAFILE_STOCKHOLM); 
 	  if (fmsa != NULL) esl_msa_Destroy(fmsa);
 	}
       else if  (esl_opt_GetBoolean(go, "-g"))
 	{ 
-	  status = esl_msaweight_GSC(msa);                                 
+	  if (esl_opt_GetBoolean(go, "--mmap")) status = esl_msaweight_GSCMapped(msa);
+	  else                                  status = esl_msaweight_GSCParallel(msa, esl_opt_GetInteger(go, "--cpu"));
 	  eslx_msafile_Write(ofp, msa, eslMSAFILE_STOCKHOLM);
 	} 
       else if  (esl_opt_GetBoolean(go, "-p")) 
 	{
-	  status = esl_msaweight_PB(msa);                                  
+	  status = esl_msaweight_PBParallel(msa, esl_opt_GetInteger(go, "--cpu"));
 	  eslx_msafile_Write(ofp, msa, eslMSAFILE_STOCKHOLM);
 	} 
       else if  (esl_opt_GetBoolean(go, "-b"))
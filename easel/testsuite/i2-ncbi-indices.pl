@@ -42,6 +42,13 @@ if ($? != 0) { die "FAIL: esl-seqstat fails to read BLAST-formatted FASTA file\n
 # We could check more (like whether the output was what we expected)
 # but that's all we need for the bug in question.
 
+# Now read the BLAST db itself, through the memory-mapped NCBI parser.
+#
+$output = `$top_builddir/miniapps/esl-seqstat --informat ncbi $tmppfx.fa 2>&1`;
+if ($? != 0) { die "FAIL: esl-seqstat fails to read NCBI BLAST db\n"; }
+if ($output !~ /Number of sequences:\s+10\n/) { die "FAIL: wrong number of seqs in NCBI BLAST db\n"; }
+if ($output !~ /Total # residues:\s+600\n/)   { die "FAIL: wrong residue count in NCBI BLAST db\n"; }
+
 print "ok\n";
 unlink "$tmppfx.fa";
 unlink "$tmppfx.fa.phr";
@@ -531,6 +531,9 @@ int main(int argc, char * argv[])
     }
     int status = eslx_msafile_Open(NULL, argv[optind], NULL, esl_format, NULL, &afp);
     if (status != eslOK) eslx_msafile_OpenFailure(afp, status);
+    // only residues are displayed: leave per-residue annotation in the
+    // file (not possible for stdin, which is fine)
+    eslx_msafile_SetLazyAnnotation(afp, TRUE);
 
     status = eslx_msafile_Read( afp, &msa);
     if (status != eslOK) eslx_msafile_ReadFailure(afp, status);